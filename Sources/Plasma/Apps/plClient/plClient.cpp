@@ -44,13 +44,16 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsWindows.h"
 #include "plClient.h"
 #include "hsStream.h"
+#include "hsWorkerPool.h"
 #include "plResMgr/plResManager.h"
 #include "plResMgr/plKeyFinder.h"
+#include "plResMgr/plPagePrefetcher.h"
 #include "pnKeyedObject/plKey.h"
 #include "pnKeyedObject/plFixedKey.h"
 #include "pnMessage/plRefMsg.h"
 #include "pnSceneObject/plSceneObject.h"
 #include "pnSceneObject/plCoordinateInterface.h"
+#include "pnSceneObject/plTransformHierarchy.h"
 #include "plScene/plSceneNode.h"
 #include "pnMessage/plTimeMsg.h"
 #include "pnMessage/plClientMsg.h"
@@ -105,6 +108,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plDrawable/plVisLOSMgr.h"
 
 #include "plGImage/plBitmap.h"
+#include "plGImage/plMipmapDecoder.h"
+#include "plGImage/plMipmapStreamer.h"
 
 #include "plStatusLog/plStatusLog.h"
 #include "plProgressMgr/plProgressMgr.h"
@@ -192,6 +197,8 @@ plClient::plClient()
     fFontCache(nil),
     fHoldLoadRequests(false),
     fNumLoadingRooms(0),
+    fRoomLoadStart(0),
+    fNumRoomsInLoad(0),
     fNumPostLoadMsgs(0),
     fPostLoadMsgInc(0.f)
 {
@@ -281,6 +288,10 @@ bool plClient::Shutdown()
     if (plAVIWriter::IsInitialized())
         plAVIWriter::Instance().Shutdown();
 
+    plMipmapStreamer::Instance().Shutdown();
+    plMipmapDecoder::Instance().Shutdown();
+    hsWorkerPool::Instance().Shutdown();
+
     hsStatusMessage( "Shutting down client...\n" );
 
     // First, before anybody else goes away, write out our key mappings
@@ -968,7 +979,31 @@ void plClient::IQueueRoomLoad(const std::vector<plLocation>& locs, bool hold)
     if (numRooms == 0)
         return;
 
+    if (fNumRoomsInLoad == 0)
+        fRoomLoadStart = hsTimer::GetSeconds();
+    fNumRoomsInLoad += numRooms;
+
     fNumLoadingRooms += numRooms;
+
+    // Get the disk started on the first few while the load message goes round
+    IPrefetchRooms();
+}
+
+void plClient::IPrefetchRooms()
+{
+    std::vector<plLocation> locs;
+    for (LoadList::const_iterator it = fLoadRooms.begin(); it != fLoadRooms.end(); ++it)
+    {
+        if (locs.size() == plPagePrefetcher::kMaxRoomsInFlight)
+            break;
+        locs.push_back((*it)->loc);
+    }
+
+    if (!locs.empty())
+    {
+        plResManager* mgr = (plResManager*)hsgResMgr::ResMgr();
+        mgr->PrefetchRooms(locs);
+    }
 }
 
 void plClient::ILoadNextRoom()
@@ -1000,6 +1035,9 @@ void plClient::ILoadNextRoom()
 
         fRoomsLoading.push_back(req->loc); // flag the location as currently loading
 
+        // Keep the next rooms reading in while we construct this one
+        IPrefetchRooms();
+
         // PageInPage is not guaranteed to finish synchronously, just FYI
         plResManager *mgr = (plResManager *)hsgResMgr::ResMgr();
         mgr->PageInRoom(req->loc, plSceneNode::Index(), pRefMsg);
@@ -1091,6 +1129,10 @@ void plClient::IUnloadRooms(const std::vector<plLocation>& locs)
 
 void plClient::IRoomLoaded(plSceneNode* node, bool hold)
 {
+    // Everything in the room is read, so its textures are all the decoder
+    // has left to do.  Have them whole before the room can draw.
+    plMipmapDecoder::Instance().Flush();
+
     fCurrentNode = node; 
     // make sure we don't already have this room in the list:
     bool bAppend = true;
@@ -1202,7 +1244,25 @@ void plClient::IRoomLoaded(plSceneNode* node, bool hold)
     }
     
     if (!fNumLoadingRooms)
+    {
         IStopProgress();
+
+        // Done with the shared pages too
+        plResManager* mgr = (plResManager*)hsgResMgr::ResMgr();
+        mgr->ReleasePrefetchedPages();
+
+        #ifndef PLASMA_EXTERNAL_RELEASE
+        if (fNumRoomsInLoad > 0)
+        {
+            plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+            plStatusLog::AddLineS("roomloads.log", "Loaded %d rooms in %.2f s (prefetch %s: %d pages read ahead, %d missed, waited %.1f ms)",
+                                  fNumRoomsInLoad, hsTimer::GetSeconds() - fRoomLoadStart,
+                                  prefetcher.IsEnabled() ? "on" : "off", prefetcher.GetNumPrefetched(),
+                                  prefetcher.GetNumMissed(), prefetcher.GetWaitTime());
+        }
+        #endif
+        fNumRoomsInLoad = 0;
+    }
 }
 
 //============================================================================
@@ -1567,6 +1627,9 @@ bool plClient::MainLoop()
     plProfileManagerFull::Instance().EndFrame();
     plProfileManager::Instance().EndFrame();
 
+    // Nothing from the frame arena outlives the frame
+    hsFrameArena::Frame().Reset();
+
     // Draw the stats
     plProfileManagerFull::Instance().Update();
 
@@ -1655,6 +1718,7 @@ bool plClient::IUpdate()
     plProfile_BeginLap(TransformMsg, xFormLap1);
     plTransformMsg* xform = new plTransformMsg(nil, nil, nil, nil);
     plgDispatch::MsgSend(xform);
+    plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseNormal);
     plProfile_EndLap(TransformMsg, xFormLap1);
 
     plCoordinateInterface::SetTransformPhase(plCoordinateInterface::kTransformPhaseDelayed);    
@@ -1673,6 +1737,7 @@ bool plClient::IUpdate()
         plProfile_BeginLap(TransformMsg, xFormLap2);
         xform = new plTransformMsg(nil, nil, nil, nil);
         plgDispatch::MsgSend(xform);
+        plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseNormal);
         plProfile_EndLap(TransformMsg, xFormLap2);
     }
     else
@@ -1681,6 +1746,7 @@ bool plClient::IUpdate()
         plProfile_BeginLap(TransformMsg, xFormLap3);
         xform = new plDelayedTransformMsg(nil, nil, nil, nil);
         plgDispatch::MsgSend(xform);
+        plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseDelayed);
         plProfile_EndLap(TransformMsg, xFormLap3);
     }
 
@@ -1755,6 +1821,11 @@ bool plClient::IDraw()
         fPipeline->LoadResources();
     }
 
+    // Swap in mip levels streamed since last frame, and queue the ones it asked for
+    plMipmapStreamer::Instance().Update();
+    plMipmapDecoder::Instance().Update();
+    plPagePrefetcher::Instance().Update();
+
     plProfile_EndTiming(UpdateTime);
 
     plProfile_BeginTiming(DrawTime);
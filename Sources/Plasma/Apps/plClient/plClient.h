@@ -169,6 +169,8 @@ protected:
     typedef std::list<LoadRequest*> LoadList;
     LoadList fLoadRooms;
     int fNumLoadingRooms;   // Number of rooms we're waiting for load callbacks on
+    double fRoomLoadStart;  // When the current batch of room loads started
+    int fNumRoomsInLoad;    // Rooms queued since fNumLoadingRooms was last zero
     std::vector<plLocation> fRoomsLoading; // the locations we are currently in the middle of loading
 
     int fNumPostLoadMsgs;
@@ -204,6 +206,7 @@ protected:
     bool IIsRoomLoading(const plLocation& loc);
     void IQueueRoomLoad(const std::vector<plLocation>& locs, bool hold);
     void ILoadNextRoom();
+    void IPrefetchRooms();
     void IUnloadRooms(const std::vector<plLocation>& locs);
     void IRoomLoaded(plSceneNode* node, bool hold);
     void IRoomUnloaded(plSceneNode* node);
@@ -48,12 +48,15 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plResMgr/plRegistryHelpers.h"
 #include "plResMgr/plRegistryNode.h"
+#include "plResMgr/plPageCompressor.h"
 
 #include "plAudioCore/plSoundBuffer.h"
 #include "hsStream.h"
 
 #include "plProduct.h"
 
+#include <string_theory/stdio>
+
 
 //// Globals /////////////////////////////////////////////////////////////////
 
@@ -61,6 +64,7 @@ plResManager* gResMgr = nil;
 
 bool DumpStats(const plFileName& patchDir);
 bool DumpSounds();
+bool ConvertPage(const plFileName& pageFile, bool compress);
 
 //// PrintVersion ///////////////////////////////////////////////////////////////
 void PrintVersion()
@@ -76,11 +80,14 @@ int PrintHelp( void )
     PrintVersion();
     puts("");
     puts("Usage: plPageInfo [-s -i] pageFile");
+    puts("       plPageInfo [-c | -u] pageFile");
     puts("       plPageInfo -v");
     puts("Where:" );
     puts("       -v print version and exit.");
     puts("       -s dump sounds in page to the console");
     puts("       -i dump object size info to .csv files");
+    puts("       -c compress each object in the page");
+    puts("       -u uncompress the objects in the page");
     puts("       pageFile is the path to the .prp file");
     puts("");
 
@@ -102,6 +109,8 @@ int main(int argc, char* argv[])
 
     bool sounds = false;
     bool stats = false;
+    bool compress = false;
+    bool uncompress = false;
 
     int arg = 1;
     for (arg = 1; arg < argc; arg++)
@@ -110,6 +119,10 @@ int main(int argc, char* argv[])
             sounds = true;
         else if (strcmp(argv[arg], "-i") == 0)
             stats = true;
+        else if (strcmp(argv[arg], "-c") == 0)
+            compress = true;
+        else if (strcmp(argv[arg], "-u") == 0)
+            uncompress = true;
         else
             break;
     }
@@ -121,6 +134,14 @@ int main(int argc, char* argv[])
     else
         return PrintHelp();
 
+    // Converting works straight off the file, no resMgr needed
+    if (compress || uncompress)
+    {
+        if (compress == uncompress || sounds || stats)
+            return PrintHelp();
+        return ConvertPage(pageFile, compress) ? 0 : -1;
+    }
+
     // Init our special resMgr
     plResMgrSettings::Get().SetFilterNewerPageVersions(false);
     plResMgrSettings::Get().SetFilterOlderPageVersions(false);
@@ -258,3 +279,31 @@ bool DumpStats(const plFileName& patchDir)
     gResMgr->IterateAllPages(&statDump);
     return true;
 }
+
+//// ConvertPage /////////////////////////////////////////////////////////////
+//  Rewrites the page with its objects compressed (or not), replacing the
+//  original once the new one is written.
+
+bool ConvertPage(const plFileName& pageFile, bool compress)
+{
+    plFileName tempFile = pageFile.StripFileExt() + "_conv.prp";
+
+    plPageCompressor::Stats stats;
+    if (!plPageCompressor::Convert(pageFile, tempFile, compress, &stats))
+    {
+        ST::printf("Failed to convert {}\n", pageFile);
+        plFileSystem::Unlink(tempFile);
+        return false;
+    }
+
+    uint64_t oldSize = plFileInfo(pageFile).FileSize();
+    uint64_t newSize = plFileInfo(tempFile).FileSize();
+
+    plFileSystem::Unlink(pageFile);
+    plFileSystem::Move(tempFile, pageFile);
+
+    ST::printf("{}: {} of {} objects compressed, object data {} -> {} bytes, page {} -> {} bytes\n",
+               pageFile, stats.fNumCompressed, stats.fNumObjects, stats.fRawSize, stats.fStoredSize,
+               oldSize, newSize);
+    return true;
+}
@@ -47,6 +47,15 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 int main(int argc, char* argv[])
 {
+    // plPageOptimizer [-trace loadtrace] page.prp
+    plFileName tracePath;
+    if (argc == 4 && strcmp(argv[1], "-trace") == 0)
+    {
+        tracePath = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc != 2)
     {
         puts("plPageOptimizer: wrong number of arguments");
@@ -75,7 +84,7 @@ int main(int argc, char* argv[])
     try
 #endif
     {
-        plPageOptimizer optimizer(argv[1]);
+        plPageOptimizer optimizer(argv[1], tracePath);
         optimizer.Optimize();
     }
 #ifndef _DEBUG
@@ -52,9 +52,16 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "hsStream.h"
 
+#include <string_theory/stdio>
+
+// Reads in a trace that are further apart than this start a new burst, and a
+// new read-ahead range.  Ages page in as one burst; things like clones and
+// avatar animations get loaded later on.
+static const float kBurstGap = 0.5f;
+
 plPageOptimizer* plPageOptimizer::fInstance = nil;
 
-plPageOptimizer::plPageOptimizer(const plFileName& pagePath) :
+plPageOptimizer::plPageOptimizer(const plFileName& pagePath, const plFileName& tracePath) :
     fOptimized(true),
     fPageNode(nil),
     fPagePath(pagePath)
@@ -64,6 +71,9 @@ plPageOptimizer::plPageOptimizer(const plFileName& pagePath) :
     fTempPagePath = fPagePath.StripFileExt() + "_opt.prp";
 
     fResMgr = (plResManager*)hsgResMgr::ResMgr();
+
+    if (tracePath.IsValid() && !fTrace.Read(tracePath))
+        ST::printf("couldn't read load trace {}, ignoring it...", tracePath);
 }
 
 void plPageOptimizer::IFindLoc()
@@ -119,6 +129,9 @@ void plPageOptimizer::Optimize()
         // Load the page
         snKey->VerifyLoaded();
 
+        // Let the trace override the order we got from the scene node
+        IApplyTrace();
+
         // Unload everything
         snKey->RefObject();
         snKey->UnRefObject();
@@ -132,8 +145,22 @@ void plPageOptimizer::Optimize()
     if (loaded)
         IRewritePage();
 
+    // Everything but the header and read-ahead table should be the same size
     uint64_t oldSize = plFileInfo(fPagePath).FileSize();
     uint64_t newSize = plFileInfo(fTempPagePath).FileSize();
+    if (loaded)
+    {
+        hsUNIXStream newPage;
+        plPageInfo newInfo;
+        if (newPage.Open(fTempPagePath))
+        {
+            newInfo.Read(&newPage);
+            newPage.Close();
+        }
+
+        oldSize -= fPageNode->GetPageInfo().GetDataStart() + IReadAheadSize(fPageNode->GetReadAhead());
+        newSize -= newInfo.GetDataStart() + IReadAheadSize(fReadAhead);
+    }
 
     if (!loaded)
     {
@@ -182,6 +209,65 @@ void plPageOptimizer::KeyedObjectProc(plKey key)
     }
 }
 
+void plPageOptimizer::IApplyTrace()
+{
+    fTraceOrder.clear();
+    fBurstEnds.clear();
+
+    const plLoadTrace::RecordVec& records = fTrace.GetRecords();
+
+    // Pull out the first read of each object in our page.  Reads of other pages
+    // in between don't split a burst, only a gap in time does.
+    KeySet traced;
+    float lastTime = 0.f;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const plLoadTrace::Record& rec = records[i];
+        if (rec.fUoid.GetLocation() != fLoc || rec.fUoid.IsClone())
+            continue;
+
+        plKey key = fResMgr->FindKey(rec.fUoid);
+        if (!key)
+        {
+            ST::printf("Traced object {} isn't in the page\n", rec.fUoid.GetObjectName());
+            continue;
+        }
+
+        KeySet::iterator it = traced.lower_bound(key);
+        if (it != traced.end() && *it == key)
+            continue;
+        traced.insert(it, key);
+
+        if (!fTraceOrder.empty() && rec.fTime - lastTime > kBurstGap)
+            fBurstEnds.push_back(fTraceOrder.size());
+        fTraceOrder.push_back(key);
+        lastTime = rec.fTime;
+    }
+
+    if (fTraceOrder.empty())
+        return;
+    fBurstEnds.push_back(fTraceOrder.size());
+
+    // Traced objects go first, then whatever else the scene node loaded, in
+    // the order it loaded it
+    KeyVec loadOrder = fTraceOrder;
+    for (size_t i = 0; i < fKeyLoadOrder.size(); i++)
+    {
+        if (traced.find(fKeyLoadOrder[i]) == traced.end())
+            loadOrder.push_back(fKeyLoadOrder[i]);
+    }
+
+    fKeyLoadOrder.swap(loadOrder);
+    fLoadedKeys.insert(traced.begin(), traced.end());
+}
+
+uint32_t plPageOptimizer::IReadAheadSize(const RangeVec& ranges)
+{
+    if (ranges.empty())
+        return 0;
+    return 2 * sizeof(uint32_t) + uint32_t(ranges.size()) * 2 * sizeof(uint32_t);
+}
+
 void plPageOptimizer::IWriteKeyData(hsStream* oldPage, hsStream* newPage, plKey key)
 {
     class plUpdateKeyImp : public plKeyImp
@@ -218,19 +304,42 @@ void plPageOptimizer::IRewritePage()
         hsUNIXStream oldPage;
         oldPage.Open(fPagePath);
 
-        const plPageInfo& pageInfo = fPageNode->GetPageInfo();
-
-        uint32_t dataStart = pageInfo.GetDataStart();
+        // Write a placeholder header, we'll come back and fix up the offsets
+        plPageInfo pageInfo = fPageNode->GetPageInfo();
+        pageInfo.Write(&newPage);
+        pageInfo.SetDataStart(newPage.GetPosition());
 
-        fBuf.resize(dataStart);
+        // The data moves if the header changed size
+        if (pageInfo.GetDataStart() != fPageNode->GetPageInfo().GetDataStart())
+            fOptimized = false;
 
-        oldPage.Read(dataStart, &fBuf[0]);
-        newPage.Write(dataStart, &fBuf[0]);
+        fReadAhead.clear();
+        size_t burst = 0;
+        uint32_t burstStart = pageInfo.GetDataStart();
 
         int size = (int)fKeyLoadOrder.size();
         for (int i = 0; i < size; i++)
+        {
             IWriteKeyData(&oldPage, &newPage, fKeyLoadOrder[i]);
 
+            // Close off the read-ahead range for each burst in the trace.  A
+            // single object will be buffered anyway, so skip those.
+            if (burst < fBurstEnds.size() && i + 1 == fBurstEnds[burst])
+            {
+                size_t burstLen = fBurstEnds[burst] - (burst > 0 ? fBurstEnds[burst - 1] : 0);
+                uint32_t burstEnd = newPage.GetPosition();
+                if (burstLen > 1)
+                {
+                    plReadAheadRange range;
+                    range.fStart = burstStart;
+                    range.fLength = burstEnd - burstStart;
+                    fReadAhead.push_back(range);
+                }
+                burstStart = burstEnd;
+                burst++;
+            }
+        }
+
         // If there are any objects that we didn't write (because they didn't load for
         // some reason), put them at the end
         for (int i = 0; i < fAllKeys.size(); i++)
@@ -241,9 +350,11 @@ void plPageOptimizer::IRewritePage()
         }
 
         uint32_t newKeyStart = newPage.GetPosition();
-        uint32_t oldKeyStart = pageInfo.GetIndexStart();
+        uint32_t oldKeyStart = fPageNode->GetPageInfo().GetIndexStart();
         oldPage.SetPosition(oldKeyStart);
+        pageInfo.SetIndexStart(newKeyStart);
 
+        bool compressed = fPageNode->GetPageInfo().IsCompressed();
         uint32_t numTypes = oldPage.ReadLE32();
         newPage.WriteLE32(numTypes);
 
@@ -265,6 +376,7 @@ void plPageOptimizer::IRewritePage()
                 uoid.Read(&oldPage);
                 uint32_t startPos = oldPage.ReadLE32();
                 uint32_t dataLen = oldPage.ReadLE32();
+                uint32_t uncompressedLen = compressed ? oldPage.ReadLE32() : 0;
 
                 // Get the new start pos
                 plKeyImp* key = (plKeyImp*)fResMgr->FindKey(uoid);
@@ -273,9 +385,31 @@ void plPageOptimizer::IRewritePage()
                 uoid.Write(&newPage);
                 newPage.WriteLE32(startPos);
                 newPage.WriteLE32(dataLen);
+                if (compressed)
+                    newPage.WriteLE32(uncompressedLen);
             }
         }
 
+        // Without a trace, any read-ahead table the page had is dropped, since
+        // the objects may have moved out from under it
+        if (!fReadAhead.empty())
+            plRegistryPageNode::WriteReadAhead(&newPage, fReadAhead);
+
+        const RangeVec& oldReadAhead = fPageNode->GetReadAhead();
+        if (oldReadAhead.size() != fReadAhead.size())
+            fOptimized = false;
+        for (size_t i = 0; i < fReadAhead.size() && fOptimized; i++)
+        {
+            // WriteReadAhead sorts by start, but bursts are written in order anyway
+            if (oldReadAhead[i].fStart != fReadAhead[i].fStart || oldReadAhead[i].fLength != fReadAhead[i].fLength)
+                fOptimized = false;
+        }
+
+        // Rewind and write the header with the final offsets
+        pageInfo.SetChecksum(newPage.GetPosition() - pageInfo.GetDataStart());
+        newPage.Rewind();
+        pageInfo.Write(&newPage);
+
         newPage.Close();
         oldPage.Close();
     }
@@ -45,6 +45,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnKeyedObject/plKey.h"
 #include "pnKeyedObject/plUoid.h"
 #include "plFileSystem.h"
+#include "plResMgr/plLoadTrace.h"
+#include "plResMgr/plRegistryNode.h"
 #include <vector>
 #include <set>
 
@@ -62,6 +64,12 @@ protected:
     KeyVec fAllKeys;        // All the keys in the page
     std::vector<uint8_t> fBuf;
 
+    typedef std::vector<plReadAheadRange> RangeVec;
+    plLoadTrace fTrace;             // Load trace recorded in-game, if we were given one
+    KeyVec fTraceOrder;             // Keys in our page, in the order the trace first read them
+    std::vector<size_t> fBurstEnds; // End of each burst of reads in fTraceOrder
+    RangeVec fReadAhead;            // Read-ahead table for the new page
+
     bool fOptimized;        // True after optimization if the page was already optimized
 
     plFileName fPagePath;           // Path to our page
@@ -76,10 +84,15 @@ protected:
 
     void IWriteKeyData(hsStream* oldPage, hsStream* newPage, plKey key);
     void IFindLoc();
+    void IApplyTrace();
     void IRewritePage();
 
+    static uint32_t IReadAheadSize(const RangeVec& ranges);
+
 public:
-    plPageOptimizer(const plFileName& pagePath);
+    // If tracePath is set, the objects read in that trace are put first, in
+    // the order they were read, and the page gets a read-ahead table.
+    plPageOptimizer(const plFileName& pagePath, const plFileName& tracePath = plFileName());
 
     void Optimize();
 };
@@ -82,11 +82,8 @@ void hsBounds3::Transform(const hsMatrix44 *mat)
     hsAssert(fType != kBoundsUninitialized, "Can't transform an unitialized bound");
     if(fType == kBoundsNormal)
     {
-        hsPoint3 corners[8];
-        this->GetCorners(corners);
-        
-        mat->MapPoints(8, corners);
-        this->Reset(8,corners);
+        // Same as bounding the 8 transformed corners
+        hsMatrix44::map_bounds.call(*mat, &fMins, &fMaxs, 0, &fMins, &fMaxs, 0, 1);
         fBounds3Flags &= ~kCenterValid;
     }
 }
@@ -978,9 +975,7 @@ void hsBounds3Ext::Transform(const hsMatrix44 *m)
 #endif // IDENT
 
         fCorner = *m * fCorner;
-        fAxes[0] = *m * fAxes[0];
-        fAxes[1] = *m * fAxes[1];
-        fAxes[2] = *m * fAxes[2];
+        hsMatrix44::map_vectors.call(*m, fAxes, sizeof(hsVector3), fAxes, sizeof(hsVector3), 3);
 
         fExtFlags &= kAxisZeroZero|kAxisOneZero|kAxisTwoZero;
     }
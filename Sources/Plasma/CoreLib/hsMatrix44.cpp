@@ -198,6 +198,295 @@ static hsMatrix44 mat_mult_sse3(const hsMatrix44 &a, const hsMatrix44 &b)
     return c;
 }
 
+// Batch transforms. The translation column only applies to points, so the
+// point and vector kernels share one body each.
+template <bool kPoints>
+static void IMapPoints_fpu(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    for (size_t i = 0; i < count; i++, s += srcStride, d += dstStride)
+    {
+        const float* p = (const float*)s;
+        float x = p[0], y = p[1], z = p[2];
+
+        float* o = (float*)d;
+        if (kPoints)
+        {
+            o[0] = (x * m.fMap[0][0]) + (y * m.fMap[0][1]) + (z * m.fMap[0][2]) + m.fMap[0][3];
+            o[1] = (x * m.fMap[1][0]) + (y * m.fMap[1][1]) + (z * m.fMap[1][2]) + m.fMap[1][3];
+            o[2] = (x * m.fMap[2][0]) + (y * m.fMap[2][1]) + (z * m.fMap[2][2]) + m.fMap[2][3];
+        }
+        else
+        {
+            o[0] = (x * m.fMap[0][0]) + (y * m.fMap[0][1]) + (z * m.fMap[0][2]);
+            o[1] = (x * m.fMap[1][0]) + (y * m.fMap[1][1]) + (z * m.fMap[1][2]);
+            o[2] = (x * m.fMap[2][0]) + (y * m.fMap[2][1]) + (z * m.fMap[2][2]);
+        }
+    }
+}
+
+static void map_points_fpu(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+    IMapPoints_fpu<true>(m, src, srcStride, dst, dstStride, count);
+}
+
+static void map_vectors_fpu(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+    IMapPoints_fpu<false>(m, src, srcStride, dst, dstStride, count);
+}
+
+#ifdef HS_SSE41
+// Columns of the upper 3x4, with a zero in the unused fourth lane.
+#   define LOADCOLUMN(m, j) \
+        _mm_set_ps(0.f, m.fMap[2][j], m.fMap[1][j], m.fMap[0][j])
+// Writes the first three lanes without touching whatever follows them.
+#   define STORE3(o, v) \
+        _mm_storel_pi((__m64*)(o), v); \
+        _MM_EXTRACT_FLOAT((o)[2], v, 2);
+
+template <bool kPoints>
+static void IMapPoints_sse41(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+    const __m128 c0 = LOADCOLUMN(m, 0);
+    const __m128 c1 = LOADCOLUMN(m, 1);
+    const __m128 c2 = LOADCOLUMN(m, 2);
+    const __m128 c3 = kPoints ? LOADCOLUMN(m, 3) : _mm_setzero_ps();
+
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    for (size_t i = 0; i < count; i++, s += srcStride, d += dstStride)
+    {
+        const float* p = (const float*)s;
+        __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), c0), _mm_mul_ps(_mm_set1_ps(p[1]), c1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p[2]), c2));
+        if (kPoints)
+            r = _mm_add_ps(r, c3);
+        STORE3((float*)d, r);
+    }
+}
+#endif  // HS_SSE41
+
+static void map_points_sse41(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+#ifdef HS_SSE41
+    IMapPoints_sse41<true>(m, src, srcStride, dst, dstStride, count);
+#endif  // HS_SSE41
+}
+
+static void map_vectors_sse41(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+#ifdef HS_SSE41
+    IMapPoints_sse41<false>(m, src, srcStride, dst, dstStride, count);
+#endif  // HS_SSE41
+}
+
+#ifdef HS_AVX2
+// Eight at a time, gathering each component across the strided elements.
+// There is no scatter, so the results go back out a float at a time.
+template <bool kPoints>
+static void IMapPoints_avx2(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+    hsAssert(srcStride * 7 <= 0x7fffffff, "Stride too large to gather");
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(srcStride)));
+
+    __m256 mat[3][4];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+            mat[r][c] = _mm256_set1_ps(m.fMap[r][c]);
+    }
+
+    const uint8_t* s = (const uint8_t*)src;
+    uint8_t* d = (uint8_t*)dst;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const float* p = (const float*)s;
+        const __m256 x = _mm256_i32gather_ps(p, offsets, 1);
+        const __m256 y = _mm256_i32gather_ps(p + 1, offsets, 1);
+        const __m256 z = _mm256_i32gather_ps(p + 2, offsets, 1);
+
+        float out[3][8];
+        for (int r = 0; r < 3; r++)
+        {
+            __m256 v = _mm256_add_ps(_mm256_mul_ps(x, mat[r][0]), _mm256_mul_ps(y, mat[r][1]));
+            v = _mm256_add_ps(v, _mm256_mul_ps(z, mat[r][2]));
+            if (kPoints)
+                v = _mm256_add_ps(v, mat[r][3]);
+            _mm256_storeu_ps(out[r], v);
+        }
+
+        for (int k = 0; k < 8; k++, d += dstStride)
+        {
+            float* o = (float*)d;
+            o[0] = out[0][k];
+            o[1] = out[1][k];
+            o[2] = out[2][k];
+        }
+        s += 8 * srcStride;
+    }
+    IMapPoints_fpu<kPoints>(m, s, srcStride, d, dstStride, count - i);
+}
+#endif  // HS_AVX2
+
+static void map_points_avx2(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+#ifdef HS_AVX2
+    IMapPoints_avx2<true>(m, src, srcStride, dst, dstStride, count);
+#endif  // HS_AVX2
+}
+
+static void map_vectors_avx2(const hsMatrix44& m, const void* src, size_t srcStride, void* dst, size_t dstStride, size_t count)
+{
+#ifdef HS_AVX2
+    IMapPoints_avx2<false>(m, src, srcStride, dst, dstStride, count);
+#endif  // HS_AVX2
+}
+
+// Each output extent is the translation plus, per input axis, the smaller
+// (or larger) of that column scaled by the box's min and max.
+static void map_bounds_fpu(const hsMatrix44& m, const hsPoint3* mins, const hsPoint3* maxs, size_t srcStride,
+                           hsPoint3* outMins, hsPoint3* outMaxs, size_t dstStride, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const hsPoint3& lo = *(const hsPoint3*)((const uint8_t*)mins + i * srcStride);
+        const hsPoint3& hi = *(const hsPoint3*)((const uint8_t*)maxs + i * srcStride);
+
+        float newLo[3], newHi[3];
+        for (int r = 0; r < 3; r++)
+        {
+            newLo[r] = newHi[r] = m.fMap[r][3];
+            for (int c = 0; c < 3; c++)
+            {
+                float a = m.fMap[r][c] * lo[c];
+                float b = m.fMap[r][c] * hi[c];
+                if (a < b)
+                {
+                    newLo[r] += a;
+                    newHi[r] += b;
+                }
+                else
+                {
+                    newLo[r] += b;
+                    newHi[r] += a;
+                }
+            }
+        }
+
+        hsPoint3& outLo = *(hsPoint3*)((uint8_t*)outMins + i * dstStride);
+        hsPoint3& outHi = *(hsPoint3*)((uint8_t*)outMaxs + i * dstStride);
+        outLo.Set(newLo[0], newLo[1], newLo[2]);
+        outHi.Set(newHi[0], newHi[1], newHi[2]);
+    }
+}
+
+static void map_bounds_sse41(const hsMatrix44& m, const hsPoint3* mins, const hsPoint3* maxs, size_t srcStride,
+                             hsPoint3* outMins, hsPoint3* outMaxs, size_t dstStride, size_t count)
+{
+#ifdef HS_SSE41
+    const __m128 c0 = LOADCOLUMN(m, 0);
+    const __m128 c1 = LOADCOLUMN(m, 1);
+    const __m128 c2 = LOADCOLUMN(m, 2);
+    const __m128 c3 = LOADCOLUMN(m, 3);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* lo = (const float*)((const uint8_t*)mins + i * srcStride);
+        const float* hi = (const float*)((const uint8_t*)maxs + i * srcStride);
+
+        __m128 a = _mm_mul_ps(c0, _mm_set1_ps(lo[0]));
+        __m128 b = _mm_mul_ps(c0, _mm_set1_ps(hi[0]));
+        __m128 newLo = _mm_add_ps(c3, _mm_min_ps(a, b));
+        __m128 newHi = _mm_add_ps(c3, _mm_max_ps(a, b));
+
+        a = _mm_mul_ps(c1, _mm_set1_ps(lo[1]));
+        b = _mm_mul_ps(c1, _mm_set1_ps(hi[1]));
+        newLo = _mm_add_ps(newLo, _mm_min_ps(a, b));
+        newHi = _mm_add_ps(newHi, _mm_max_ps(a, b));
+
+        a = _mm_mul_ps(c2, _mm_set1_ps(lo[2]));
+        b = _mm_mul_ps(c2, _mm_set1_ps(hi[2]));
+        newLo = _mm_add_ps(newLo, _mm_min_ps(a, b));
+        newHi = _mm_add_ps(newHi, _mm_max_ps(a, b));
+
+        STORE3((float*)((uint8_t*)outMins + i * dstStride), newLo);
+        STORE3((float*)((uint8_t*)outMaxs + i * dstStride), newHi);
+    }
+#endif  // HS_SSE41
+}
+
+static inline void IMul34_fpu(hsMatrix44& ret, const hsMatrix44& lhs, const hsMatrix44& rhs)
+{
+    hsMatrix44 tmp;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            tmp.fMap[i][j] = lhs.fMap[i][0] * rhs.fMap[0][j]
+                + lhs.fMap[i][1] * rhs.fMap[1][j]
+                + lhs.fMap[i][2] * rhs.fMap[2][j];
+        }
+        tmp.fMap[i][3] = lhs.fMap[i][0] * rhs.fMap[0][3]
+            + lhs.fMap[i][1] * rhs.fMap[1][3]
+            + lhs.fMap[i][2] * rhs.fMap[2][3]
+            + lhs.fMap[i][3];
+    }
+    tmp.fMap[3][0] = tmp.fMap[3][1] = tmp.fMap[3][2] = 0;
+    tmp.fMap[3][3] = 1.f;
+    tmp.NotIdentity();
+    ret = tmp;
+}
+
+static void mul_34_batch_fpu(const hsMatrix44* lhs, size_t lhsStep, const hsMatrix44* rhs, size_t rhsStep,
+                             hsMatrix44* out, const uint32_t* idx, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t k = idx ? idx[i] : i;
+        IMul34_fpu(out[k], lhs[k * lhsStep], rhs[k * rhsStep]);
+    }
+}
+
+#ifdef HS_SSE1
+// Each result row is a weighted sum of the right hand rows, plus the
+// translation which only the left hand side contributes.
+#   define MUL34ROW(ret, lhs, r, r0, r1, r2) \
+        _mm_storeu_ps(ret.fMap[r], \
+            _mm_add_ps( \
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lhs.fMap[r][0]), r0), \
+                           _mm_mul_ps(_mm_set1_ps(lhs.fMap[r][1]), r1)), \
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lhs.fMap[r][2]), r2), \
+                           _mm_set_ps(lhs.fMap[r][3], 0.f, 0.f, 0.f))));
+#endif  // HS_SSE1
+
+static void mul_34_batch_sse1(const hsMatrix44* lhs, size_t lhsStep, const hsMatrix44* rhs, size_t rhsStep,
+                              hsMatrix44* out, const uint32_t* idx, size_t count)
+{
+#ifdef HS_SSE1
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t k = idx ? idx[i] : i;
+        const hsMatrix44& l = lhs[k * lhsStep];
+        const hsMatrix44& rm = rhs[k * rhsStep];
+        hsMatrix44& ret = out[k];
+
+        // All of the right hand side is loaded, and each left hand row read,
+        // before the row it lands in is written, so out may alias either.
+        __m128 r0 = _mm_loadu_ps(rm.fMap[0]);
+        __m128 r1 = _mm_loadu_ps(rm.fMap[1]);
+        __m128 r2 = _mm_loadu_ps(rm.fMap[2]);
+
+        MUL34ROW(ret, l, 0, r0, r1, r2);
+        MUL34ROW(ret, l, 1, r0, r1, r2);
+        MUL34ROW(ret, l, 2, r0, r1, r2);
+        _mm_storeu_ps(ret.fMap[3], _mm_set_ps(1.f, 0.f, 0.f, 0.f));
+        ret.NotIdentity();
+    }
+#endif  // HS_SSE1
+}
+
 // CPU-optimized functions requiring dispatch
 hsCpuFunctionDispatcher<hsMatrix44::mat_mult_ptr> hsMatrix44::mat_mult {
     &mat_mult_fpu,
@@ -206,6 +495,44 @@ hsCpuFunctionDispatcher<hsMatrix44::mat_mult_ptr> hsMatrix44::mat_mult {
     &mat_mult_sse3
 };
 
+hsCpuFunctionDispatcher<hsMatrix44::map_points_ptr> hsMatrix44::map_points {
+    &map_points_fpu,
+    nullptr,            // SSE1
+    nullptr,            // SSE2
+    nullptr,            // SSE3
+    nullptr,            // SSSE3
+    &map_points_sse41,  // SSE4.1
+    nullptr,            // SSE4.2
+    nullptr,            // AVX
+    &map_points_avx2    // AVX2
+};
+
+hsCpuFunctionDispatcher<hsMatrix44::map_points_ptr> hsMatrix44::map_vectors {
+    &map_vectors_fpu,
+    nullptr,            // SSE1
+    nullptr,            // SSE2
+    nullptr,            // SSE3
+    nullptr,            // SSSE3
+    &map_vectors_sse41, // SSE4.1
+    nullptr,            // SSE4.2
+    nullptr,            // AVX
+    &map_vectors_avx2   // AVX2
+};
+
+hsCpuFunctionDispatcher<hsMatrix44::map_bounds_ptr> hsMatrix44::map_bounds {
+    &map_bounds_fpu,
+    nullptr,            // SSE1
+    nullptr,            // SSE2
+    nullptr,            // SSE3
+    nullptr,            // SSSE3
+    &map_bounds_sse41   // SSE4.1
+};
+
+hsCpuFunctionDispatcher<hsMatrix44::mul_34_batch_ptr> hsMatrix44::mul_34_batch {
+    &mul_34_batch_fpu,
+    &mul_34_batch_sse1  // SSE1
+};
+
 hsPoint3 hsMatrix44::operator*(const hsPoint3& p) const
 {
     if (fFlags & hsMatrix44::kIsIdent)
@@ -819,13 +1146,7 @@ const hsPoint3 hsMatrix44::GetTranslate() const
 hsPoint3*  hsMatrix44::MapPoints(long count, hsPoint3 points[]) const
 {
     if( !(fFlags & hsMatrix44::kIsIdent) )
-    {
-        int i;
-        for(i = 0; i < count; i++)
-        {
-            points[i] = *this * points[i];  
-        }
-    }
+        map_points.call(*this, points, sizeof(hsPoint3), points, sizeof(hsPoint3), count);
     return points;
 }
 
@@ -152,6 +152,29 @@ struct hsMatrix44 {
     //  CPU-optimized functions
     typedef hsMatrix44(*mat_mult_ptr)(const hsMatrix44&, const hsMatrix44&);
     static hsCpuFunctionDispatcher<mat_mult_ptr> mat_mult;
+
+    // Transform count points (map_points) or vectors (map_vectors, no
+    // translation), reading and writing them at the given byte strides.
+    // src and dst may be the same array. The identity flag is ignored.
+    typedef void(*map_points_ptr)(const hsMatrix44& m, const void* src, size_t srcStride,
+                                  void* dst, size_t dstStride, size_t count);
+    static hsCpuFunctionDispatcher<map_points_ptr> map_points;
+    static hsCpuFunctionDispatcher<map_points_ptr> map_vectors;
+
+    // The axis aligned bounds of each of count boxes after transforming
+    // them, the same as bounding their transformed corners. Boxes are read
+    // and written at the given byte strides, and may be updated in place.
+    typedef void(*map_bounds_ptr)(const hsMatrix44& m, const hsPoint3* mins, const hsPoint3* maxs, size_t srcStride,
+                                  hsPoint3* outMins, hsPoint3* outMaxs, size_t dstStride, size_t count);
+    static hsCpuFunctionDispatcher<map_bounds_ptr> map_bounds;
+
+    // For i < count, out[k] = lhs[k * lhsStep] * rhs[k * rhsStep] with
+    // k = idx ? idx[i] : i. Steps are 0, to use the one matrix for every k,
+    // or 1. Only the top three rows are multiplied; results get a bottom
+    // row of 0,0,0,1.
+    typedef void(*mul_34_batch_ptr)(const hsMatrix44* lhs, size_t lhsStep, const hsMatrix44* rhs, size_t rhsStep,
+                                    hsMatrix44* out, const uint32_t* idx, size_t count);
+    static hsCpuFunctionDispatcher<mul_34_batch_ptr> mul_34_batch;
 };
 
 ST_DECL_FORMAT_TYPE(const hsMatrix44&);
@@ -40,7 +40,10 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 *==LICENSE==*/
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <cstdlib>
 #pragma hdrstop
 
 #include "hsMemory.h"
@@ -186,6 +189,212 @@ void* hsChunkAllocator::Allocate(uint32_t size, const void* data)
 
 //////////////////////////////////////////////////////////////////////////////////////
 
+namespace
+{
+    struct hsMemTagStats
+    {
+        std::atomic<int64_t>    fLive;
+        std::atomic<int64_t>    fPeak;
+        std::atomic<uint64_t>   fAllocs;
+        std::atomic<uint64_t>   fFrees;
+    };
+
+    // Zero initialized before any static constructor can allocate through it
+    hsMemTagStats gMemTagStats[kNumMemTags];
+
+    // Sits in front of every hsMemTracker::Alloc() block, padded so the
+    // caller still gets max_align_t alignment
+    struct alignas(std::max_align_t) hsMemTagHeader
+    {
+        size_t      fSize;
+        uint32_t    fTag;
+    };
+
+    const char* kMemTagNames[] =
+    {
+        "Untagged",
+        "ResMgr",
+        "Textures",
+        "Geometry",
+        "SDL",
+        "Python",
+        "Net",
+        "Audio",
+    };
+    static_assert(arrsize(kMemTagNames) == kNumMemTags, "missing memory tag name");
+}
+
+void* hsMemTracker::Alloc(size_t size, hsMemTag tag)
+{
+    hsMemTagHeader* head = static_cast<hsMemTagHeader*>(malloc(sizeof(hsMemTagHeader) + size));
+    if (!head)
+        throw std::bad_alloc();
+
+    head->fSize = size;
+    head->fTag = tag;
+    Add(tag, size);
+    return head + 1;
+}
+
+void hsMemTracker::Free(void* addr)
+{
+    if (!addr)
+        return;
+
+    hsMemTagHeader* head = static_cast<hsMemTagHeader*>(addr) - 1;
+    Remove(hsMemTag(head->fTag), head->fSize);
+    free(head);
+}
+
+void hsMemTracker::Add(hsMemTag tag, size_t size)
+{
+    hsMemTagStats& stats = gMemTagStats[tag];
+    int64_t live = stats.fLive.fetch_add(size, std::memory_order_relaxed) + size;
+    stats.fAllocs.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t peak = stats.fPeak.load(std::memory_order_relaxed);
+    while (live > peak && !stats.fPeak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        ;
+}
+
+void hsMemTracker::Remove(hsMemTag tag, size_t size)
+{
+    hsMemTagStats& stats = gMemTagStats[tag];
+    stats.fLive.fetch_sub(size, std::memory_order_relaxed);
+    stats.fFrees.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t hsMemTracker::GetLiveBytes(hsMemTag tag)
+{
+    return gMemTagStats[tag].fLive.load(std::memory_order_relaxed);
+}
+
+int64_t hsMemTracker::GetPeakBytes(hsMemTag tag)
+{
+    return gMemTagStats[tag].fPeak.load(std::memory_order_relaxed);
+}
+
+uint64_t hsMemTracker::GetNumAllocs(hsMemTag tag)
+{
+    return gMemTagStats[tag].fAllocs.load(std::memory_order_relaxed);
+}
+
+uint64_t hsMemTracker::GetNumFrees(hsMemTag tag)
+{
+    return gMemTagStats[tag].fFrees.load(std::memory_order_relaxed);
+}
+
+const char* hsMemTracker::GetTagName(hsMemTag tag)
+{
+    return kMemTagNames[tag];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+
+struct hsArenaChunk {
+    hsArenaChunk*   fNext;
+    size_t          fSize;
+    size_t          fUsed;
+
+    uint8_t*        Data() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+hsFrameArena::hsFrameArena(size_t chunkSize)
+    : fChunks(nil), fChunkSize(chunkSize), fUsed(0), fLastFrame(0), fPeak(0), fNumChunkAllocs(0)
+{
+}
+
+hsFrameArena::~hsFrameArena()
+{
+    IFreeChunks();
+}
+
+hsArenaChunk* hsFrameArena::INewChunk(size_t size)
+{
+    hsArenaChunk* chunk = static_cast<hsArenaChunk*>(malloc(sizeof(hsArenaChunk) + size));
+    if (!chunk)
+        throw std::bad_alloc();
+
+    chunk->fNext = fChunks;
+    chunk->fSize = size;
+    chunk->fUsed = 0;
+    fChunks = chunk;
+    fNumChunkAllocs++;
+    return chunk;
+}
+
+void hsFrameArena::IFreeChunks()
+{
+    while (fChunks)
+    {
+        hsArenaChunk* next = fChunks->fNext;
+        free(fChunks);
+        fChunks = next;
+    }
+}
+
+void* hsFrameArena::Alloc(size_t size, size_t align)
+{
+    hsAssert(align && !(align & (align - 1)), "arena alignment must be a power of two");
+
+    hsArenaChunk* chunk = fChunks;
+    size_t pad = 0;
+    if (chunk)
+    {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(chunk->Data() + chunk->fUsed);
+        pad = (align - (addr & (align - 1))) & (align - 1);
+    }
+    if (!chunk || chunk->fUsed + pad + size > chunk->fSize)
+    {
+        // Chunk data starts max_align_t aligned, only larger alignments need slack
+        size_t slack = align > alignof(std::max_align_t) ? align : 0;
+        chunk = INewChunk(std::max(fChunkSize, size + slack));
+        uintptr_t addr = reinterpret_cast<uintptr_t>(chunk->Data());
+        pad = (align - (addr & (align - 1))) & (align - 1);
+    }
+
+    void* mem = chunk->Data() + chunk->fUsed + pad;
+    chunk->fUsed += pad + size;
+    fUsed += pad + size;
+    if (fUsed > fPeak)
+        fPeak = fUsed;
+    return mem;
+}
+
+void hsFrameArena::Reset()
+{
+    fLastFrame = fUsed;
+    fUsed = 0;
+
+    // A frame that spilled into more chunks gets one chunk that would have held
+    // it all, so steady state is a single chunk and no allocations at all
+    if (fChunks && fChunks->fNext)
+    {
+        size_t capacity = GetCapacity();
+        IFreeChunks();
+        fChunkSize = std::max(fChunkSize, capacity);
+        INewChunk(fChunkSize);
+    }
+    else if (fChunks)
+        fChunks->fUsed = 0;
+}
+
+size_t hsFrameArena::GetCapacity() const
+{
+    size_t capacity = 0;
+    for (hsArenaChunk* chunk = fChunks; chunk; chunk = chunk->fNext)
+        capacity += chunk->fSize;
+    return capacity;
+}
+
+hsFrameArena& hsFrameArena::Frame()
+{
+    static hsFrameArena theArena;
+    return theArena;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+
 struct hsAppenderHead {
     struct hsAppenderHead*  fNext;
     struct hsAppenderHead*  fPrev;
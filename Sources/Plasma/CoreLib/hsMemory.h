@@ -43,6 +43,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #define hsMemoryDefined
 
 #include "HeadSpin.h"
+#include <cstddef>
+#include <new>
+#include <type_traits>
 //#include "hsTemplates.h"
 
 class HSMemory {
@@ -111,6 +114,92 @@ public:
     void*   Allocate(uint32_t size, const void* data = nil);
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////
+//  Subsystem memory tags.  Tagged allocations go through hsMemTracker, which keeps
+//  live/peak bytes and allocation counts per tag for the profiler.  Subsystems that
+//  already size their own buffers report them with Add()/Remove() instead.
+
+enum hsMemTag
+{
+    kMemTagUntagged,
+    kMemTagResMgr,
+    kMemTagTextures,
+    kMemTagGeometry,
+    kMemTagSDL,
+    kMemTagPython,
+    kMemTagNet,
+    kMemTagAudio,
+
+    kNumMemTags
+};
+
+class hsMemTracker {
+public:
+    static void*    Alloc(size_t size, hsMemTag tag);
+    static void     Free(void* addr);
+
+    static void     Add(hsMemTag tag, size_t size);
+    static void     Remove(hsMemTag tag, size_t size);
+
+    static int64_t  GetLiveBytes(hsMemTag tag);
+    static int64_t  GetPeakBytes(hsMemTag tag);
+    static uint64_t GetNumAllocs(hsMemTag tag);     // running totals, never reset
+    static uint64_t GetNumFrees(hsMemTag tag);
+    static const char* GetTagName(hsMemTag tag);
+};
+
+// Gives a class (and everything derived from it) a tagged operator new/delete
+#define HS_MEMTAG_NEW(tag) \
+    static void* operator new(size_t size) { return hsMemTracker::Alloc(size, tag); } \
+    static void  operator delete(void* addr) { hsMemTracker::Free(addr); } \
+    static void* operator new(size_t, void* place) { return place; } \
+    static void  operator delete(void*, void*) { }
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//  Linear allocator for scratch memory that only lives until the end of the frame.
+//  Nothing is freed individually; Reset() at the frame boundary hands it all back and
+//  folds the chunks into one big enough for the last frame's peak.  Not thread safe,
+//  the shared Frame() arena belongs to the main thread.
+
+class hsFrameArena {
+    enum {
+        kDefaultChunkSize = 64 * 1024
+    };
+    struct hsArenaChunk*    fChunks;
+    size_t                  fChunkSize;
+    size_t                  fUsed;
+    size_t                  fLastFrame;
+    size_t                  fPeak;
+    uint32_t                fNumChunkAllocs;
+
+    hsArenaChunk*   INewChunk(size_t size);
+    void            IFreeChunks();
+public:
+            hsFrameArena(size_t chunkSize = kDefaultChunkSize);
+            ~hsFrameArena();
+
+    void*   Alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+    template <class T> T* New(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+        T* mem = static_cast<T*>(Alloc(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++)
+            new (&mem[i]) T;
+        return mem;
+    }
+
+    void    Reset();
+
+    size_t  GetUsedBytes() const { return fUsed; }
+    size_t  GetLastFrameBytes() const { return fLastFrame; } // used when Reset() was last called
+    size_t  GetPeakBytes() const { return fPeak; }
+    size_t  GetCapacity() const;
+    uint32_t GetNumChunkAllocs() const { return fNumChunkAllocs; }
+
+    static hsFrameArena& Frame();
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 
 class hsAppender {
@@ -120,7 +120,7 @@ void hsVectorStream::Truncate()
     fEnd = fPosition-1;
 }
 
-uint32_t hsVectorStream::GetEOF()
+uint64_t hsVectorStream::GetEOF()
 {
     return fEnd;
 }
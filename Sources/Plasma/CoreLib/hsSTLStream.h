@@ -71,7 +71,7 @@ public:
     virtual void      FastFwd();
     virtual void      Truncate();
 
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
     virtual void    CopyToMem(void* mem);
 
     virtual void    Reset();        // clears the buffers
@@ -43,6 +43,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include <cctype>
 #if HS_BUILD_FOR_WIN32
 #   include <io.h>
+#   include "hsWindows.h"
 #endif
 #include <algorithm>
 #pragma hdrstop
@@ -53,6 +54,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #if HS_BUILD_FOR_UNIX
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #endif
 //////////////////////////////////////////////////////////////////////////////////
 
@@ -61,17 +64,22 @@ void hsStream::FastFwd()
     hsThrow("FastFwd unimplemented by subclass of stream");
 }
 
-uint32_t hsStream::GetPosition() const
+uint64_t hsStream::GetPosition() const
 {
     return fPosition;
 }
 
-void hsStream::SetPosition(uint32_t position)
+void hsStream::SetPosition(uint64_t position)
 {
     if (position == fPosition)
         return;
     Rewind();
-    Skip(position);
+    while (position > 0)
+    {
+        uint32_t delta = position > UINT32_MAX ? UINT32_MAX : (uint32_t)position;
+        Skip(delta);
+        position -= delta;
+    }
 }
 
 void hsStream::Truncate()
@@ -81,7 +89,7 @@ void hsStream::Truncate()
 
 uint32_t hsStream::GetSizeLeft()
 {
-    uint32_t ret = 0;
+    uint64_t ret = 0;
     if (GetPosition() > GetEOF())
     {
         hsThrow("Position is beyond EOF");
@@ -91,12 +99,12 @@ uint32_t hsStream::GetSizeLeft()
         ret = GetEOF() - GetPosition();
     }
 
-    return ret;
+    return ret > UINT32_MAX ? UINT32_MAX : (uint32_t)ret;
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 
-uint32_t hsStream::GetEOF()
+uint64_t hsStream::GetEOF()
 {
     hsThrow( "GetEOF() unimplemented by subclass of stream");
     return 0;
@@ -285,53 +293,10 @@ ST::string hsStream::ReadSafeWString()
     return ST::string::from_utf16(retVal);
 }
 
-bool  hsStream::Read4Bytes(void *pv)  // Virtual, faster version in sub classes
-{
-    int knt = this->Read(sizeof(uint32_t), pv);
-    if (knt != 4)
-        return false;
-    return true;
-}
-
-bool  hsStream::Read12Bytes(void *buffer) // Reads 12 bytes, return true if success
-{
-    int knt = this->Read(12,buffer);
-    if (knt != 12)
-        return false;
-    return true;
-}
-
-bool  hsStream::Read8Bytes(void *buffer)  // Reads 12 bytes, return true if success
-{
-    int knt = this->Read(8,buffer);
-    if (knt !=8)
-        return false;
-    return true;
-}
-
-bool hsStream::ReadBOOL()
-{
-    uint32_t val;
-    this->Read(sizeof(uint32_t), &val);
-    return val != 0;
-}
-
-bool hsStream::ReadBool() // Virtual, faster version in sub classes
-{
-    return (this->ReadByte() != 0);
-}
-
 void hsStream::ReadBool(int count, bool values[])
 {
-    this->Read(count, values);
-}
-
-uint8_t hsStream::ReadByte()
-{
-    uint8_t   value;
-
-    this->Read(sizeof(uint8_t), &value);
-    return value;
+    if (!IReadFromWindow(count, values))
+        this->Read(count, values);
 }
 
 bool hsStream::AtEnd()
@@ -443,83 +408,38 @@ bool hsStream::ReadLn(char *s, uint32_t maxLen, const char beginComment, const c
     return true;
 }
 
-uint16_t hsStream::ReadLE16()
-{
-    uint16_t  value;
-    this->Read(sizeof(uint16_t), &value);
-    value = hsToLE16(value);
-    return value;
-}
-
 void hsStream::ReadLE16(int count, uint16_t values[])
 {
-    this->Read(count * sizeof(uint16_t), values);
+    if (!IReadFromWindow(count * sizeof(uint16_t), values))
+        this->Read(count * sizeof(uint16_t), values);
     for (int i = 0; i < count; i++)
         values[i] = hsToLE16(values[i]);
 }
 
-uint32_t hsStream::ReadLE32()
-{
-    uint32_t  value;
-    Read4Bytes(&value);
-    value = hsToLE32(value);
-    return value;
-}
-
 void hsStream::ReadLE32(int count, uint32_t values[])
 {
-    this->Read(count * sizeof(uint32_t), values);
+    if (!IReadFromWindow(count * sizeof(uint32_t), values))
+        this->Read(count * sizeof(uint32_t), values);
     for (int i = 0; i < count; i++)
         values[i] = hsToLE32(values[i]);
 }
 
-uint32_t hsStream::ReadBE32()
-{
-    uint32_t  value;
-    Read4Bytes(&value);
-    value = hsToBE32(value);
-    return value;
-}
-
-double hsStream::ReadLEDouble()
-{
-    double  value;
-    Read8Bytes(&value);
-    value = hsToLEDouble(value);
-    return value;
-}
-
 void hsStream::ReadLEDouble(int count, double values[])
 {
-    this->Read(count * sizeof(double), values);
+    if (!IReadFromWindow(count * sizeof(double), values))
+        this->Read(count * sizeof(double), values);
     for (int i = 0; i < count; i++)
         values[i] = hsToLEDouble(values[i]);
 }
 
-
-float hsStream::ReadLEFloat()
-{
-    float   value;
-    Read4Bytes(&value);
-    value = hsToLEFloat(value);
-    return value;
-}
-
 void hsStream::ReadLEFloat(int count, float values[])
 {
-    this->Read(count * sizeof(float), values);
+    if (!IReadFromWindow(count * sizeof(float), values))
+        this->Read(count * sizeof(float), values);
     for (int i = 0; i < count; i++)
         values[i] = hsToLEFloat(values[i]);
 }
 
-float hsStream::ReadBEFloat()
-{
-    float   value;
-    this->Read(sizeof(float), &value);
-    value = hsToBEFloat(value);
-    return value;
-}
-
 
 void hsStream::WriteBOOL(bool value)
 {
@@ -622,6 +542,26 @@ uint32_t hsStream::ReadLEAtom(uint32_t* sizePtr)
 
 //////////////////////////////////////////////////////////////////////////////////////
 
+// 64-bit stdio seeks; plain fseek/ftell are limited to a long, which is only
+// 32 bits on Windows.
+static inline int IFileSeek(FILE* file, int64_t offset, int origin)
+{
+#if HS_BUILD_FOR_WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+static inline int64_t IFileTell(FILE* file)
+{
+#if HS_BUILD_FOR_WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
 
 hsUNIXStream::~hsUNIXStream()
 {
@@ -683,13 +623,13 @@ uint32_t hsUNIXStream::Write(uint32_t bytes, const void* buffer)
     return fwrite(buffer, bytes, 1, fRef);
 }
 
-void hsUNIXStream::SetPosition(uint32_t position)
+void hsUNIXStream::SetPosition(uint64_t position)
 {
     if (!fRef || (position == fPosition))
         return;
-    fBytesRead = position;
+    fBytesRead = (uint32_t)position;
     fPosition = position;
-    (void)::fseek(fRef, position, SEEK_SET);
+    (void)IFileSeek(fRef, position, SEEK_SET);
 }
 
 void hsUNIXStream::Skip(uint32_t delta)
@@ -715,18 +655,19 @@ void hsUNIXStream::FastFwd()
     if (!fRef)
         return;
     (void)::fseek(fRef, 0, SEEK_END);
-    fBytesRead = fPosition = ftell(fRef);
+    fPosition = IFileTell(fRef);
+    fBytesRead = (uint32_t)fPosition;
 }
 
-uint32_t  hsUNIXStream::GetEOF()
+uint64_t  hsUNIXStream::GetEOF()
 {
     if( !fRef )
         return 0;
 
-    long oldPos = ftell( fRef );
+    int64_t oldPos = IFileTell( fRef );
     (void)::fseek( fRef, 0, SEEK_END );
-    uint32_t end = (uint32_t)ftell( fRef );
-    (void)::fseek( fRef, oldPos, SEEK_SET );
+    uint64_t end = (uint64_t)IFileTell( fRef );
+    (void)IFileSeek( fRef, oldPos, SEEK_SET );
 
     return end;
 }
@@ -821,7 +762,7 @@ void    plReadOnlySubStream::Truncate()
     hsAssert( false, "Can't truncate a read-only stream" );
 }
 
-uint32_t  plReadOnlySubStream::GetEOF()
+uint64_t  plReadOnlySubStream::GetEOF()
 {
     return fLength;
 }
@@ -898,7 +839,7 @@ void hsRAMStream::Truncate()
     Reset();
 }
 
-uint32_t hsRAMStream::GetEOF()
+uint64_t hsRAMStream::GetEOF()
 {
     return fAppender.Count() * fAppender.ElemSize();
 }
@@ -944,19 +885,19 @@ void hsNullStream::Truncate()
 
 bool hsReadOnlyStream::AtEnd()
 {
-    return fData >= fStop;
+    return IData() >= fStop;
 }
 
 uint32_t hsReadOnlyStream::Read(uint32_t byteCount, void* buffer)
 {
-    if (fData + byteCount > fStop)
+    if (IData() + byteCount > fStop)
     {
         hsThrow("Attempting to read past end of stream");
         byteCount = GetSizeLeft();
     }
 
-    HSMemory::BlockMove(fData, buffer, byteCount);
-    fData += byteCount;
+    HSMemory::BlockMove(IData(), buffer, byteCount);
+    fWindow += byteCount;
     fBytesRead += byteCount;
     fPosition += byteCount;
     return byteCount;
@@ -972,8 +913,8 @@ void hsReadOnlyStream::Skip(uint32_t deltaByteCount)
 {
     fBytesRead += deltaByteCount;
     fPosition += deltaByteCount;
-    fData += deltaByteCount;
-    if (fData > fStop)
+    fWindow += deltaByteCount;
+    if (IData() > fStop)
         hsThrow( "Skip went past end of stream");
 }
 
@@ -981,7 +922,7 @@ void hsReadOnlyStream::Rewind()
 {
     fBytesRead = 0;
     fPosition = 0;
-    fData = fStart;
+    fWindow = (const uint8_t*)fStart;
 }
 
 void hsReadOnlyStream::Truncate()
@@ -991,8 +932,8 @@ void hsReadOnlyStream::Truncate()
 
 void hsReadOnlyStream::CopyToMem(void* mem)
 {
-    if (fData < fStop)
-        HSMemory::BlockMove(fData, mem, fStop-fData);
+    if (IData() < fStop)
+        HSMemory::BlockMove(IData(), mem, fStop-IData());
 }
 
 
@@ -1005,16 +946,103 @@ uint32_t hsWriteOnlyStream::Read(uint32_t byteCount, void* buffer)
 
 uint32_t hsWriteOnlyStream::Write(uint32_t byteCount, const void* buffer)
 {
-    if (fData + byteCount > fStop)
+    if (IData() + byteCount > fStop)
         hsThrow("Write past end of stream");
-    HSMemory::BlockMove(buffer, fData, byteCount);
-    fData += byteCount;
+    HSMemory::BlockMove(buffer, IData(), byteCount);
+    fWindow += byteCount;
     fBytesRead += byteCount;
     fPosition += byteCount;
     return byteCount;
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////
+
+hsMappedFileStream::hsMappedFileStream()
+#if HS_BUILD_FOR_WIN32
+    : fFileHandle(INVALID_HANDLE_VALUE), fMapHandle(nullptr), fMapSize(0)
+#else
+    : fFileDesc(-1), fMapSize(0)
+#endif
+{
+    Init(0, nullptr);
+}
+
+hsMappedFileStream::~hsMappedFileStream()
+{
+    Close();
+}
+
+bool hsMappedFileStream::Open(const plFileName& name, const char* mode)
+{
+    hsAssert(strcmp(mode, "rb") == 0, "hsMappedFileStream only supports reading");
+    Close();
+
+    plFileInfo info(name);
+    if (!info.Exists() || info.FileSize() <= 0 || info.FileSize() > UINT32_MAX)
+        return false;
+    uint32_t size = (uint32_t)info.FileSize();
+
+    void* data = nullptr;
+#if HS_BUILD_FOR_WIN32
+    fFileHandle = CreateFileW(name.WideString().data(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fFileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    fMapHandle = CreateFileMappingW(fFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (fMapHandle)
+        data = MapViewOfFile(fMapHandle, FILE_MAP_READ, 0, 0, size);
+#else
+    fFileDesc = open(name.AsString().c_str(), O_RDONLY);
+    if (fFileDesc < 0)
+        return false;
+
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fFileDesc, 0);
+    if (data == MAP_FAILED)
+        data = nullptr;
+#endif
+
+    if (!data)
+    {
+        Close();
+        return false;
+    }
+
+    fMapSize = size;
+    Init(size, data);
+    fBytesRead = 0;
+    fPosition = 0;
+    return true;
+}
+
+bool hsMappedFileStream::Close()
+{
+#if HS_BUILD_FOR_WIN32
+    if (fStart)
+        UnmapViewOfFile(fStart);
+    if (fMapHandle)
+        CloseHandle(fMapHandle);
+    if (fFileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fFileHandle);
+    fMapHandle = nullptr;
+    fFileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (fStart)
+        munmap(fStart, fMapSize);
+    if (fFileDesc >= 0)
+        close(fFileDesc);
+    fFileDesc = -1;
+#endif
+
+    fMapSize = 0;
+    Init(0, nullptr);
+    fBytesRead = 0;
+    fPosition = 0;
+    return true;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////
 
 hsQueueStream::hsQueueStream(int32_t size) :
@@ -1147,9 +1175,14 @@ inline void FastByteCopy(void* dest, const void* src, uint32_t bytes)
 
 //#define LOG_BUFFERED
 
-hsBufferedStream::hsBufferedStream()
+uint32_t hsBufferedStream::fDefaultBufferSize = hsBufferedStream::kDefaultBufferSize;
+
+hsBufferedStream::hsBufferedStream(uint32_t bufferSize)
 : fRef(nil)
 , fFileSize(0)
+, fBuffer(nil)
+, fBufferSize(bufferSize ? bufferSize : fDefaultBufferSize)
+, fBufferStart(0)
 , fBufferLen(0)
 , fWriteBufferUsed(false)
 #ifdef HS_DEBUGGING
@@ -1162,6 +1195,12 @@ hsBufferedStream::hsBufferedStream()
 , fCloseReason(nil)
 #endif
 {
+    fBuffer = new char[fBufferSize];
+}
+
+hsBufferedStream::~hsBufferedStream()
+{
+    delete [] fBuffer;
 }
 
 bool hsBufferedStream::Open(const plFileName& name, const char* mode)
@@ -1172,11 +1211,11 @@ bool hsBufferedStream::Open(const plFileName& name, const char* mode)
         return false;
 
     SetFileRef(fRef);
+    fFilename = name;
 
 #ifdef LOG_BUFFERED
     fBufferHits = fBufferMisses = 0;
     fBufferReadIn = fBufferReadOut = fReadDirect = fLastReadPos = 0;
-    fFilename = name;
     fCloseReason = nil;
 #endif // LOG_BUFFERED
 
@@ -1189,6 +1228,9 @@ bool hsBufferedStream::Close()
     if (fRef)
         rtn = fclose(fRef);
     fRef = nil;
+    fBufferStart = 0;
+    fBufferLen = 0;
+    IClearWindow();
 
 #ifdef LOG_BUFFERED
     hsUNIXStream s;
@@ -1228,12 +1270,74 @@ void hsBufferedStream::SetFileRef(FILE* ref)
     fRef = ref;
 
     fseek(fRef, 0, SEEK_END);
-    fFileSize = ftell(fRef);
+    fFileSize = IFileTell(fRef);
     fseek(fRef, 0, SEEK_SET);
 
+    fBufferStart = 0;
     fBufferLen = 0;
     fPosition = 0;
     fWriteBufferUsed = false;
+    IUpdateWindow();
+}
+
+void hsBufferedStream::SetBufferSize(uint32_t bufferSize)
+{
+    hsAssert(bufferSize > 0, "hsBufferedStream needs a buffer");
+    if (bufferSize == fBufferSize)
+        return;
+
+    delete [] fBuffer;
+    fBuffer = new char[bufferSize];
+    fBufferSize = bufferSize;
+
+    // Keep the file pointer where the (now empty) buffer ends
+    fBufferStart += fBufferLen;
+    fBufferLen = 0;
+    IUpdateWindow();
+}
+
+void hsBufferedStream::Prefetch(uint64_t position, uint32_t length)
+{
+    hsAssert(fRef, "fRef uninitialized");
+    if (!fRef || fWriteBufferUsed || position >= fFileSize)
+        return;
+
+    if (position + length > fFileSize)
+        length = uint32_t(fFileSize - position);
+    if (position >= fBufferStart && position + length <= fBufferStart + fBufferLen)
+        return;
+
+    if (length > fBufferSize)
+        SetBufferSize(length);
+
+    ISeekFile(position);
+    fBufferLen = ::fread(fBuffer, 1, fBufferSize, fRef);
+
+#ifdef HS_DEBUGGING
+    fBufferReadIn += fBufferLen;
+#endif
+
+    IUpdateWindow();
+}
+
+void hsBufferedStream::IUpdateWindow()
+{
+    // The inline readers may only see the buffer while we're reading and
+    // fPosition actually falls inside it.
+    if (!fWriteBufferUsed && fPosition >= fBufferStart && fPosition < fBufferStart + fBufferLen)
+        ISetWindow(fBuffer + (fPosition - fBufferStart), fBuffer + fBufferLen);
+    else
+        IClearWindow();
+}
+
+void hsBufferedStream::ISeekFile(uint64_t position)
+{
+    // Drop the buffer and move the file pointer, keeping the invariant that
+    // it sits at fBufferStart + fBufferLen.
+    if (position != fBufferStart + fBufferLen)
+        IFileSeek(fRef, position, SEEK_SET);
+    fBufferStart = position;
+    fBufferLen = 0;
 }
 
 uint32_t hsBufferedStream::Read(uint32_t bytes, void* buffer)
@@ -1247,10 +1351,11 @@ uint32_t hsBufferedStream::Read(uint32_t bytes, void* buffer)
     while (bytes > 0 && fPosition < fFileSize)
     {
         // First, see if we've got anything in the buffer
-        if (fBufferLen > 0)
+        uint64_t bufferEnd = fBufferStart + fBufferLen;
+        if (fPosition >= fBufferStart && fPosition < bufferEnd)
         {
             // Figure out how much we can copy out of the buffer
-            uint32_t bufferPos = fPosition % kBufferSize;
+            uint32_t bufferPos = uint32_t(fPosition - fBufferStart);
             uint32_t bytesInBuffer = fBufferLen - bufferPos;
             uint32_t cachedReadSize = bytesInBuffer < bytes ? bytesInBuffer : bytes;
 
@@ -1261,39 +1366,40 @@ uint32_t hsBufferedStream::Read(uint32_t bytes, void* buffer)
             bytes -= cachedReadSize;
             buffer = (void*)(((char*)buffer) + cachedReadSize);
 
-            // If we read all the data out of the buffer, set it to empty
-            if ((bufferPos + cachedReadSize) == fBufferLen)
-                fBufferLen = 0;
-
 #ifdef HS_DEBUGGING
             fLastReadPos = fPosition;
             fBufferHits++;
             fBufferReadOut += cachedReadSize;
 #endif
+            continue;
         }
 
-        // Now see if the remaining read (if any) is the size of the buffer or larger.
-        // If it is, read as many complete blocks as possible directly into the output buffer.
-        if (bytes >= kBufferSize && fPosition % kBufferSize == 0)
+        if (fPosition != bufferEnd)
+            ISeekFile(fPosition);
+
+        // If the remaining read is the size of the buffer or larger, read it
+        // directly into the output buffer.
+        if (bytes >= fBufferSize)
         {
-            uint32_t directReadSize = bytes - (bytes % kBufferSize);
-            hsAssert(ftell(fRef) % kBufferSize == 0 , "read buffer is not in alignment.");
-            int amtRead = ::fread(buffer, 1, directReadSize, fRef);
+            int amtRead = ::fread(buffer, 1, bytes, fRef);
             fPosition += amtRead;
             numReadBytes += amtRead;
             bytes -= amtRead;
             buffer = (void*)(((char*)buffer) + amtRead);
+            fBufferStart = fPosition;
+            fBufferLen = 0;
 #ifdef HS_DEBUGGING
             fLastReadPos = fPosition;
-            fReadDirect += directReadSize;
+            fReadDirect += amtRead;
 #endif
+            if (amtRead == 0)
+                break;
         }
-
-        // If we've got bytes left to read and we didn't pass the end of the file, buffer a new block
-        if (bytes > 0 && fPosition < fFileSize)
+        // Otherwise buffer a new block
+        else
         {
-            hsAssert(ftell(fRef) % kBufferSize == 0 , "read buffer is not in alignment.");
-            fBufferLen = ::fread(fBuffer, 1, kBufferSize, fRef);
+            fBufferStart = fPosition;
+            fBufferLen = ::fread(fBuffer, 1, fBufferSize, fRef);
 
 #ifdef HS_DEBUGGING
             // If our last read wasn't at the start of the new buffer, it's a miss.
@@ -1305,16 +1411,23 @@ uint32_t hsBufferedStream::Read(uint32_t bytes, void* buffer)
 
             fBufferReadIn += fBufferLen;
 #endif
+            if (fBufferLen == 0)
+                break;
         }
     }
 
+    IUpdateWindow();
     return numReadBytes;
 }
 
 uint32_t hsBufferedStream::Write(uint32_t bytes, const void* buffer)
 {
     hsAssert(fRef, "fRef uninitialized");
-    fWriteBufferUsed = true;
+    if (!fWriteBufferUsed)
+    {
+        fWriteBufferUsed = true;
+        IClearWindow();
+    }
     int amtWritten = fwrite((void*)buffer, 1, bytes, fRef);
     fPosition += amtWritten;
     return amtWritten;
@@ -1345,28 +1458,10 @@ void hsBufferedStream::Skip(uint32_t delta)
     {
         // buffered write not implemented yet.
         fseek(fRef, delta, SEEK_CUR);
+        fPosition += delta;
     }
     else
-    {
-        uint32_t blockStart = ((fPosition + delta) / kBufferSize) * kBufferSize;
-
-        // We've got data in the buffer, see if we can just skip in that
-        if (fBufferLen > 0)
-        {
-            int32_t newBufferPos = int32_t(fPosition % kBufferSize) + int32_t(delta);
-
-            // If we skipped outside of our buffer, invalidate it
-            if (newBufferPos < 0 || uint32_t(newBufferPos) >= fBufferLen)
-            {
-                fBufferLen = 0;
-                fseek(fRef, blockStart, SEEK_SET);
-            }
-        }
-        else
-            fseek(fRef, blockStart, SEEK_SET);
-    }
-
-    fPosition += delta;
+        SetPosition(fPosition + delta);
 }
 
 void hsBufferedStream::Rewind()
@@ -1375,25 +1470,38 @@ void hsBufferedStream::Rewind()
     {
         // buffered write not implemented yet.
         fseek(fRef, 0, SEEK_SET);
+        fPosition = 0;
     }
-    // If the currently buffered block isn't the first one, invalidate our buffer
-    else if (fPosition >= kBufferSize)
-        fBufferLen = 0;
+    else
+        SetPosition(0);
+}
 
-    fPosition = 0;
+void hsBufferedStream::SetPosition(uint64_t position)
+{
+    if (fWriteBufferUsed)
+    {
+        IFileSeek(fRef, position, SEEK_SET);
+        fPosition = position;
+        return;
+    }
+
+    // Seeking within the buffer is free; anywhere else drops it, and the next
+    // Read() refills from the new position.
+    fPosition = position;
+    IUpdateWindow();
 }
 
-uint32_t hsBufferedStream::GetEOF()
+uint64_t hsBufferedStream::GetEOF()
 {
     if (fWriteBufferUsed)
     {
         if (!fRef)
             return 0;
 
-        long oldPos = ftell(fRef);
+        int64_t oldPos = IFileTell(fRef);
         fseek(fRef, 0, SEEK_END);
-        uint32_t end = (uint32_t)ftell(fRef);
-        fseek(fRef, oldPos, SEEK_SET);
+        uint64_t end = (uint64_t)IFileTell(fRef);
+        IFileSeek(fRef, oldPos, SEEK_SET);
 
         return end;
     }
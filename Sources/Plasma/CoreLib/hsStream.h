@@ -46,6 +46,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsMemory.h"
 #include "plFileSystem.h"
 #include <string_theory/format>
+#include <cstring>
 
 
 // Define this for use of Streams with Logging (commonly used w/ a packet sniffer)
@@ -74,11 +75,40 @@ enum {
     };
 protected:
     uint32_t      fBytesRead;
-    uint32_t      fPosition;
+    uint64_t      fPosition;
+
+    // Bytes at fPosition that the subclass already holds in memory.  The
+    // primitive readers below consume them inline and only go through the
+    // virtual Read() once the window is empty.  Subclasses that set a window
+    // must treat fWindow as their read cursor, since the inline readers
+    // advance it along with fPosition without telling them.
+    const uint8_t*  fWindow;
+    const uint8_t*  fWindowEnd;
+
+    void            ISetWindow(const void* begin, const void* end) { fWindow = (const uint8_t*)begin; fWindowEnd = (const uint8_t*)end; }
+    void            IClearWindow() { fWindow = fWindowEnd = nil; }
+    bool            IReadFromWindow(uint32_t byteCount, void* buffer)
+                    {
+                        if (fWindowEnd - fWindow < (ptrdiff_t)byteCount)
+                            return false;
+                        memcpy(buffer, fWindow, byteCount);
+                        fWindow += byteCount;
+                        fBytesRead += byteCount;
+                        fPosition += byteCount;
+                        return true;
+                    }
+    template <typename T>
+    T               IReadPrimitive()
+                    {
+                        T value;
+                        if (!IReadFromWindow(sizeof(T), &value))
+                            this->Read(sizeof(T), &value);
+                        return value;
+                    }
 
     bool      IsTokenSeparator(char c);
 public:
-                hsStream() : fBytesRead(0), fPosition(0) {}
+                hsStream() : fBytesRead(0), fPosition(0), fWindow(nil), fWindowEnd(nil) {}
     virtual     ~hsStream() { }
 
     virtual bool      Open(const plFileName &, const char * = "rb") = 0;
@@ -89,8 +119,8 @@ public:
     virtual void      Skip(uint32_t deltaByteCount) = 0;
     virtual void      Rewind() = 0;
     virtual void      FastFwd();
-    virtual uint32_t  GetPosition() const;
-    virtual void      SetPosition(uint32_t position);
+    virtual uint64_t  GetPosition() const;
+    virtual void      SetPosition(uint64_t position);
     virtual void      Truncate();
     virtual void      Flush() {}
 
@@ -110,16 +140,36 @@ public:
     void LogVoidFunc() { }
 
     // Optimization for small Reads
-    virtual uint8_t ReadByte();
-    virtual bool    Read4Bytes(void *buffer);   // Reads 4 bytes,  return true if success 
-    virtual bool    Read8Bytes(void *buffer);   // Reads 8 bytes,  return true if success 
-    virtual bool    Read12Bytes(void *buffer);  // Reads 12 bytes, return true if success
+    uint8_t         ReadByte() { return IReadPrimitive<uint8_t>(); }
+    bool            Read4Bytes(void *buffer) { return IReadFromWindow(4, buffer) || this->Read(4, buffer) == 4; }
+    bool            Read8Bytes(void *buffer) { return IReadFromWindow(8, buffer) || this->Read(8, buffer) == 8; }
+    bool            Read12Bytes(void *buffer) { return IReadFromWindow(12, buffer) || this->Read(12, buffer) == 12; }
+
+    // Returns the next byteCount bytes in place and skips over them, when the
+    // read window holds them and slack more bytes after them (for decoders
+    // whose vector loads run past the end).  Otherwise returns nil and leaves
+    // the stream alone.
+    const void*     ReadInPlace(uint32_t byteCount, uint32_t slack = 0)
+                    {
+                        if (fWindowEnd - fWindow < (ptrdiff_t)byteCount + (ptrdiff_t)slack)
+                            return nil;
+                        const void* data = fWindow;
+                        fWindow += byteCount;
+                        fBytesRead += byteCount;
+                        fPosition += byteCount;
+                        return data;
+                    }
 
-    virtual uint32_t  GetEOF();
-    uint32_t          GetSizeLeft();
+    virtual uint64_t  GetEOF();
+    uint32_t          GetSizeLeft();    // clamped, since Read() and Skip() take 32-bit counts
     virtual void      CopyToMem(void* mem);
     virtual bool      IsCompressed() { return false; }
 
+    // The file this stream reads straight from, so a caller can come back
+    // for bytes at a known offset later.  Empty for memory and filtered
+    // streams, whose positions don't map onto a file.
+    virtual plFileName GetFileName() const { return plFileName(); }
+
     uint32_t        WriteString(const ST::string & string) { return Write(string.size(), string.c_str()); }
 
     template        <typename... _Args>
@@ -139,15 +189,15 @@ public:
     bool            ReadLn(char* s, uint32_t maxLen=uint32_t(-1), const char beginComment=kComment, const char endComment=kEolnCode);
     
     // Reads a 4-byte BOOLean
-    bool            ReadBOOL();
+    bool            ReadBOOL() { return IReadPrimitive<uint32_t>() != 0; }
     // Reads a 1-byte boolean
-    bool            ReadBool();
+    bool            ReadBool() { return IReadPrimitive<uint8_t>() != 0; }
     void            ReadBool(int count, bool values[]);
-    uint16_t        ReadLE16();
+    uint16_t        ReadLE16() { return hsToLE16(IReadPrimitive<uint16_t>()); }
     void            ReadLE16(int count, uint16_t values[]);
-    uint32_t        ReadLE32();
+    uint32_t        ReadLE32() { return hsToLE32(IReadPrimitive<uint32_t>()); }
     void            ReadLE32(int count, uint32_t values[]);
-    uint32_t        ReadBE32();
+    uint32_t        ReadBE32() { return hsToBE32(IReadPrimitive<uint32_t>()); }
 
     void            WriteBOOL(bool value);
     void            WriteBool(bool value);
@@ -220,11 +270,11 @@ public:
     /* Overloaded  End */
 
 
-    float           ReadLEFloat();
+    float           ReadLEFloat() { return hsToLEFloat(IReadPrimitive<float>()); }
     void            ReadLEFloat(int count, float values[]);
-    double          ReadLEDouble();
+    double          ReadLEDouble() { return hsToLEDouble(IReadPrimitive<double>()); }
     void            ReadLEDouble(int count, double values[]);
-    float           ReadBEFloat();
+    float           ReadBEFloat() { return hsToBEFloat(IReadPrimitive<float>()); }
     void            WriteLEFloat(float value);
     void            WriteLEFloat(int count, const float values[]);
     void            WriteLEDouble(double value);
@@ -295,7 +345,7 @@ public:
     virtual bool      AtEnd();
     virtual uint32_t  Read(uint32_t byteCount, void* buffer);
     virtual uint32_t  Write(uint32_t byteCount, const void* buffer);
-    virtual void      SetPosition(uint32_t position);
+    virtual void      SetPosition(uint64_t position);
     virtual void      Skip(uint32_t deltaByteCount);
     virtual void      Rewind();
     virtual void      FastFwd();
@@ -305,7 +355,7 @@ public:
     FILE*           GetFILE() { return fRef; }
     void            SetFILE(FILE* file) { fRef = file; }
 
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
 };
 
 // Small substream class: give it a base stream, an offset and a length, and it'll
@@ -334,7 +384,7 @@ public:
     virtual void      FastFwd();
     virtual void      Truncate();
 
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
 };
 
 class hsRAMStream : public hsStream {
@@ -356,7 +406,7 @@ public:
     virtual void      Rewind();
     virtual void      Truncate();
 
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
     virtual void    CopyToMem(void* mem);
 
     void            Reset();        // clears the buffers
@@ -379,16 +429,18 @@ public:
 };
 
 // read only mem stream
+// The whole buffer is the read window, so fWindow doubles as the data cursor.
 class hsReadOnlyStream : public hsStream {
 protected:
     char*   fStart;
-    char*   fData;
     char*   fStop;
+
+    char*   IData() const { return (char*)fWindow; }
 public:
     hsReadOnlyStream(int size, const void* data) { Init(size, data); }
     hsReadOnlyStream() {}
 
-    virtual void      Init(int size, const void* data) { fStart=((char*)data); fData=((char*)data); fStop=((char*)data + size); }
+    virtual void      Init(int size, const void* data) { fStart=((char*)data); fStop=((char*)data + size); ISetWindow(fStart, fStop); }
     virtual bool      Open(const plFileName &, const char *) { hsAssert(0, "hsReadOnlyStream::Open  NotImplemented"); return false; }
     virtual bool      Close() { hsAssert(0, "hsReadOnlyStream::Close  NotImplemented"); return false; }
     virtual bool      AtEnd();
@@ -398,16 +450,19 @@ public:
     virtual void      Rewind();
     virtual void      Truncate();
     virtual uint32_t  GetBytesRead() const { return fBytesRead; }
-    virtual uint32_t  GetEOF() { return (uint32_t)(fStop-fStart); }
+    virtual uint64_t  GetEOF() { return (uint64_t)(fStop-fStart); }
     virtual void      CopyToMem(void* mem);
 };
 
 // write only mem stream
+// The window end is pinned to fStart, so inline reads always fall through to
+// Read() and throw.
 class hsWriteOnlyStream : public hsReadOnlyStream {
 public:
-    hsWriteOnlyStream(int size, const void* data) : hsReadOnlyStream(size, data) {}
+    hsWriteOnlyStream(int size, const void* data) { Init(size, data); }
     hsWriteOnlyStream() {}
 
+    virtual void      Init(int size, const void* data) { hsReadOnlyStream::Init(size, data); fWindowEnd = (const uint8_t*)fStart; }
     virtual bool      Open(const plFileName &, const char *) { hsAssert(0, "hsWriteOnlyStream::Open  NotImplemented"); return false; }
     virtual bool      Close() { hsAssert(0, "hsWriteOnlyStream::Close  NotImplemented"); return false; }
     virtual uint32_t  Read(uint32_t byteCount, void * buffer);  // throws exception
@@ -416,6 +471,29 @@ public:
     virtual uint32_t  GetBytesWritten() const { return fBytesRead; }
 };
 
+// read only memory mapped file stream
+// The whole file is mapped into the address space on Open, so GetData() can be
+// handed straight to decoders that want a pointer instead of a stream.
+class hsMappedFileStream : public hsReadOnlyStream {
+#if HS_BUILD_FOR_WIN32
+    void*   fFileHandle;
+    void*   fMapHandle;
+#else
+    int     fFileDesc;
+#endif
+    uint32_t fMapSize;
+
+public:
+    hsMappedFileStream();
+    ~hsMappedFileStream();
+
+    virtual bool      Open(const plFileName& name, const char* mode = "rb");
+    virtual bool      Close();
+
+    const void*       GetData() const { return fStart; }
+    bool              IsMapped() const { return fStart != nullptr; }
+};
+
 // circular queue stream
 class hsQueueStream : public hsStream {
 private:
@@ -444,31 +522,44 @@ public:
     uint32_t GetWriteCursor() { return fWriteCursor; }
 };
 
+// Buffered file reads.  The buffered block is exposed as the read window, so
+// primitive reads out of it never leave the inline fast path.
 class hsBufferedStream : public hsStream
 {
     FILE* fRef;
-    uint32_t fFileSize;
+    uint64_t fFileSize;
 
-    enum { kBufferSize = 2*1024 };
-    char fBuffer[kBufferSize];
+    char* fBuffer;
+    uint32_t fBufferSize;
+    // File offset of the first byte in fBuffer.  While reading, the file
+    // pointer always sits at fBufferStart + fBufferLen.
+    uint64_t fBufferStart;
     // If the buffer is empty, this is zero.  Otherwise it is the size of the
     // buffer (if we read a full block), or something less than that if we read
     // a partial block at the end of the file.
     uint32_t fBufferLen;
 
     bool fWriteBufferUsed;
+    plFileName fFilename;
+
+    static uint32_t fDefaultBufferSize;
 
 #ifdef HS_DEBUGGING
     // For doing statistics on how efficient we are
     int fBufferHits, fBufferMisses;
-    uint32_t fBufferReadIn, fBufferReadOut, fReadDirect, fLastReadPos;
-    plFileName fFilename;
+    uint32_t fBufferReadIn, fBufferReadOut, fReadDirect;
+    uint64_t fLastReadPos;
     const char* fCloseReason;
 #endif
 
+    void    IUpdateWindow();
+    void    ISeekFile(uint64_t position);
+
 public:
-    hsBufferedStream();
-    virtual ~hsBufferedStream() { }
+    enum { kDefaultBufferSize = 2*1024 };
+
+    hsBufferedStream(uint32_t bufferSize = 0);
+    virtual ~hsBufferedStream();
 
     virtual bool  Open(const plFileName& name, const char* mode = "rb");
     virtual bool  Close();
@@ -478,12 +569,27 @@ public:
     virtual uint32_t  Write(uint32_t byteCount, const void* buffer);
     virtual void      Skip(uint32_t deltaByteCount);
     virtual void      Rewind();
+    virtual void      SetPosition(uint64_t position);
     virtual void      Truncate();
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
+    virtual plFileName GetFileName() const { return fFilename; }
 
     FILE*   GetFileRef();
     void    SetFileRef(FILE* file);
 
+    // Buffer size for this stream.  Changing it drops whatever is buffered.
+    void        SetBufferSize(uint32_t bufferSize);
+    uint32_t    GetBufferSize() const { return fBufferSize; }
+
+    // Fills the buffer from position with one read, growing it to length if
+    // needed.  Doesn't move the read position, and does nothing if the range
+    // is already buffered.
+    void        Prefetch(uint64_t position, uint32_t length);
+
+    // Buffer size used by streams constructed without an explicit one.
+    static void     SetDefaultBufferSize(uint32_t bufferSize) { fDefaultBufferSize = bufferSize; }
+    static uint32_t GetDefaultBufferSize() { return fDefaultBufferSize; }
+
     // Something optional for when we're doing stats.  Will log the reason why
     // the file was closed.  Really just for plRegistryPageNode.
     void SetCloseReason(const char* reason)
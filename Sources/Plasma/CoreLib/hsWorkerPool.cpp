@@ -0,0 +1,251 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "hsWorkerPool.h"
+#include "hsLockGuard.h"
+
+#include <algorithm>
+
+// Set on the pool's threads, and on a caller for the length of its Run()
+static thread_local bool sInPool = false;
+
+//// hsWorkerPoolThread ///////////////////////////////////////////////////////
+
+class hsWorkerPoolThread : public hsThread
+{
+    hsWorkerPool*   fPool;
+
+public:
+    hsWorkerPoolThread(hsWorkerPool* pool) : fPool(pool) { }
+
+    void Run() HS_OVERRIDE { fPool->IWork(); }
+};
+
+//// Instance /////////////////////////////////////////////////////////////////
+
+hsWorkerPool& hsWorkerPool::Instance()
+{
+    static hsWorkerPool theInstance;
+    return theInstance;
+}
+
+hsWorkerPool::hsWorkerPool()
+:   fShutdown(false),
+    fRunning(false),
+    fJob(nil),
+    fCount(0),
+    fNext(0),
+    fPending(0),
+    fNumWorkers(0)
+{
+}
+
+hsWorkerPool::~hsWorkerPool()
+{
+    Shutdown();
+}
+
+//// Workers //////////////////////////////////////////////////////////////////
+
+void hsWorkerPool::IStartWorkers()
+{
+    // The caller makes one more
+    uint32_t numWorkers = std::thread::hardware_concurrency();
+    numWorkers = numWorkers > 1 ? std::min<uint32_t>(numWorkers - 1, kMaxWorkers) : 0;
+
+    fRunning = true;
+    for (uint32_t i = 0; i < numWorkers; i++)
+    {
+        hsWorkerPoolThread* worker = new hsWorkerPoolThread(this);
+        fWorkers.push_back(worker);
+        worker->Start();
+    }
+
+    hsLockGuard(fMutex);
+    fNumWorkers = numWorkers;
+}
+
+uint32_t hsWorkerPool::GetNumThreads()
+{
+    hsLockGuard(fRunMutex);
+    if (!fRunning && !fShutdown)
+        IStartWorkers();
+    return fWorkers.size() + 1;
+}
+
+void hsWorkerPool::Shutdown()
+{
+    hsLockGuard(fRunMutex);
+
+    fShutdown = true;
+    fRunning = false;
+    {
+        hsLockGuard(fMutex);
+        fNumWorkers = 0;
+        fTasks.clear();
+    }
+    for (size_t i = 0; i < fWorkers.size(); i++)
+        fWorkSemaphore.Signal();
+    for (hsWorkerPoolThread* worker : fWorkers)
+    {
+        worker->Stop();
+        delete worker;
+    }
+    fWorkers.clear();
+}
+
+void hsWorkerPool::IWork()
+{
+    sInPool = true;
+    while (fRunning)
+    {
+        fWorkSemaphore.Wait();
+
+        // A wakeup left over from a job that's already finished finds
+        // nothing to take, and goes back to sleep.  Run() pieces go first,
+        // somebody is waiting on those.
+        while (IRunOne() || IRunTask())
+            ;
+    }
+}
+
+bool hsWorkerPool::IRunOne()
+{
+    const Job* job;
+    uint32_t index;
+    {
+        hsLockGuard(fMutex);
+        if (fNext >= fCount)
+            return false;
+        job = fJob;
+        index = fNext++;
+    }
+
+    (*job)(index);
+
+    bool done;
+    {
+        hsLockGuard(fMutex);
+        done = (--fPending == 0);
+    }
+    if (done)
+        fDoneCondition.notify_all();
+    return true;
+}
+
+bool hsWorkerPool::IRunTask()
+{
+    Task task;
+    {
+        hsLockGuard(fMutex);
+        if (fTasks.empty())
+            return false;
+        task = std::move(fTasks.front());
+        fTasks.pop_front();
+    }
+
+    task();
+    return true;
+}
+
+//// Queue ////////////////////////////////////////////////////////////////////
+
+bool hsWorkerPool::Queue(const Task& task)
+{
+    // Don't wait out somebody's Run() once the threads are up
+    if (!fRunning && !sInPool)
+    {
+        hsLockGuard(fRunMutex);
+        if (!fRunning && !fShutdown)
+            IStartWorkers();
+    }
+
+    {
+        hsLockGuard(fMutex);
+        if (!fNumWorkers)
+            return false;
+        fTasks.push_back(task);
+    }
+    fWorkSemaphore.Signal();
+    return true;
+}
+
+//// Run //////////////////////////////////////////////////////////////////////
+
+void hsWorkerPool::Run(uint32_t count, const Job& job)
+{
+    if (!count)
+        return;
+
+    if (sInPool || count == 1)
+    {
+        for (uint32_t i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    hsLockGuard(fRunMutex);
+    if (!fRunning && !fShutdown)
+        IStartWorkers();
+
+    {
+        hsLockGuard(fMutex);
+        fJob = &job;
+        fCount = count;
+        fNext = 0;
+        fPending = count;
+    }
+
+    uint32_t numWake = std::min<uint32_t>(count - 1, fWorkers.size());
+    for (uint32_t i = 0; i < numWake; i++)
+        fWorkSemaphore.Signal();
+
+    // With no workers (one core, or shut down) this does the lot
+    sInPool = true;
+    while (IRunOne())
+        ;
+    sInPool = false;
+
+    std::unique_lock<std::mutex> lock(fMutex);
+    fDoneCondition.wait(lock, [this] { return fPending == 0; });
+    fJob = nil;
+}
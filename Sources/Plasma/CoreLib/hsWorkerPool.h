@@ -0,0 +1,125 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#ifndef hsWorkerPool_inc
+#define hsWorkerPool_inc
+
+#include "HeadSpin.h"
+#include "hsThread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class hsWorkerPoolThread;
+
+//// hsWorkerPool /////////////////////////////////////////////////////////////
+//  A few threads kept around for splitting up a frame's work.  Run() hands
+//  out the pieces of one job, works on them alongside the pool, and returns
+//  when they're all done.  The threads start with the first Run() and sleep
+//  between jobs, so there's no thread setup in the frame.
+//
+//  Queue() gives the same threads work that nobody waits on, like decoding
+//  or reading ahead as pages load.  They take Run() pieces first; a Run()
+//  that finds them all busy does its pieces on the calling thread.
+
+class hsWorkerPool
+{
+    friend class hsWorkerPoolThread;
+
+public:
+    enum
+    {
+        kMaxWorkers = 7,
+    };
+
+    typedef std::function<void(uint32_t)> Job;
+    typedef std::function<void()> Task;
+
+    static hsWorkerPool& Instance();
+
+    // Calls job(0) through job(count - 1), spread across the pool and the
+    // calling thread.  One job at a time; a Run() from inside a job, or after
+    // Shutdown(), runs everything on the calling thread.
+    void    Run(uint32_t count, const Job& job);
+
+    // Runs task on one of the pool's threads, some time later.  Returns false
+    // if there's no thread to run it on (one core, or after Shutdown()), in
+    // which case it's up to the caller.
+    bool    Queue(const Task& task);
+
+    // Threads a Run() can use, counting the caller
+    uint32_t    GetNumThreads();
+
+    // Stops the threads, dropping any tasks that haven't started.  Called
+    // once at client shutdown.
+    void    Shutdown();
+
+protected:
+    hsWorkerPool();
+    virtual ~hsWorkerPool();
+
+    bool    fShutdown;
+    std::atomic<bool>   fRunning;
+    std::vector<hsWorkerPoolThread*>    fWorkers;
+    std::mutex      fRunMutex;      // Held for a whole Run()
+
+    // Shared with the workers
+    std::mutex      fMutex;
+    std::condition_variable fDoneCondition;
+    hsSemaphore     fWorkSemaphore;
+    const Job*      fJob;
+    uint32_t        fCount;
+    uint32_t        fNext;          // Next piece to hand out
+    uint32_t        fPending;       // Pieces not finished yet
+    uint32_t        fNumWorkers;    // Threads that will get to a task
+    std::deque<Task>    fTasks;
+
+    void    IStartWorkers();
+    void    IWork();
+    bool    IRunOne();
+    bool    IRunTask();
+};
+
+#endif // hsWorkerPool_inc
@@ -81,6 +81,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plPipeline/plFogEnvironment.h"
 #include "plPipeline/plPlates.h"
 #include "plPipeline/plDynamicEnvMap.h"
+#include "plPipeline/plHiZBuffer.h"
 #include "hsTimer.h"
 #include "pnMessage/plClientMsg.h"
 #include "pnMessage/plEnableMsg.h"
@@ -130,6 +131,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plSurface/hsGMaterial.h"
 #include "pnSceneObject/plDrawInterface.h"
 #include "pnSceneObject/plCoordinateInterface.h"
+#include "plInterp/plController.h"
 #include "plScene/plSceneNode.h"
 #include "plScene/plPageTreeMgr.h"
 #include "plScene/plPostEffectMod.h"
@@ -143,6 +145,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plDrawable/plDynaBulletMgr.h"
 
 #include "plGImage/plMipmap.h"
+#include "plGImage/plMipmapDecoder.h"
+#include "plGImage/plMipmapStreamer.h"
 
 #include "plGLight/plShadowCaster.h"
 #include "plGLight/plShadowMaster.h"
@@ -161,6 +165,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsTemplates.h"
 
 #include "plResMgr/plResManagerHelper.h"
+#include "plResMgr/plPagePrefetcher.h"
 #include "plResMgr/plResMgrSettings.h"
 #include "plResMgr/plLocalization.h"
 
@@ -377,6 +382,18 @@ static bool     plDoesFileExist( const char *path )
     return true;
 }
 
+#ifndef LIMIT_CONSOLE_COMMANDS
+
+//// PrintToggle //////////////////////////////////////////////////////////////
+//  Reports the new state of a feature flipped by one of the Toggle commands
+
+static void PrintToggle( void (*PrintString)( const char * ), const char *feature, bool enabled )
+{
+    PrintString( ST::format( "{} is now {}", feature, enabled ? "ENABLED" : "DISABLED" ).c_str() );
+}
+
+#endif // LIMIT_CONSOLE_COMMANDS
+
 
 //////////////////////////////////////////////////////////////////////////////
 //// Base Commands ///////////////////////////////////////////////////////////
@@ -1047,6 +1064,48 @@ PF_CONSOLE_CMD( Graphics, ForceGeForce2Quality, "", "Forces higher-level hardwar
     PrintString( "Hardware caps forced down to GeForce 2 level." );
 }
 
+PF_CONSOLE_CMD( Graphics, ToggleHiZOcclusion, "", "Toggle rasterizing occluders into a software depth buffer instead of the cull tree BSP." )
+{
+    bool enabled = !plHiZBuffer::GetEnabled();
+    plHiZBuffer::SetEnabled(enabled);
+    PrintToggle(PrintString, "Hierarchical Z occlusion", enabled);
+}
+
+PF_CONSOLE_CMD( Graphics, ToggleTextureStreaming, "", "Toggle loading only the small mip levels of textures, and streaming the rest in as they're needed. Affects pages loaded afterwards." )
+{
+    bool enabled = !plMipmapStreamer::Instance().IsEnabled();
+    plMipmapStreamer::Instance().SetEnabled(enabled);
+    PrintToggle(PrintString, "Texture streaming", enabled);
+}
+
+PF_CONSOLE_CMD( Graphics, TextureStreamingBudget, "int megabytes", "Set how much memory streamed mip levels may use." )
+{
+    plMipmapStreamer::Instance().SetBudget(uint32_t((int)params[0]) * 1024 * 1024);
+}
+
+PF_CONSOLE_CMD( Graphics, TextureStreamingStats, "", "Print mip streaming counters." )
+{
+    plMipmapStreamer& streamer = plMipmapStreamer::Instance();
+
+    char buff[256];
+    sprintf(buff, "%d maps streamed, %d KB of %d KB resident, %d KB requested, %.1f ms latency",
+            int(streamer.GetNumStreamed()), int(streamer.GetResidentBytes() / 1024),
+            int(streamer.GetBudget() / 1024), int(streamer.GetRequestedBytes() / 1024),
+            streamer.GetAverageLatency());
+    PrintString(buff);
+}
+
+PF_CONSOLE_CMD( Graphics, TextureDecodeStats, "", "Print texture decoder counters." )
+{
+    plMipmapDecoder& decoder = plMipmapDecoder::Instance();
+
+    char buff[256];
+    sprintf(buff, "%d textures decoded, %d pending, %.2f ms average",
+            int(decoder.GetNumDecoded()), int(decoder.GetNumPending()),
+            decoder.GetAverageTime());
+    PrintString(buff);
+}
+
 #endif // LIMIT_CONSOLE_COMMANDS
 
 
@@ -2635,7 +2694,7 @@ PF_CONSOLE_CMD( Registry, SetLoggingLevel, "int level", "Sets the logging level
 class plActiveRefPeekerKey : public plKeyImp
 {
     public:
-        uint16_t      PeekNumNotifies() { return GetNumNotifyCreated(); }
+        uint32_t      PeekNumNotifies() { return GetNumNotifyCreated(); }
         plRefMsg*   PeekNotifyCreated(int i) { return GetNotifyCreated(i); }
         bool        PeekIsActiveRef(int i) const { return IsActiveRef(i); }
 };
@@ -2720,6 +2779,38 @@ PF_CONSOLE_CMD(Registry, LogReadTimes, "", "Dumps the time for each object read
     ((plResManager*)hsgResMgr::ResMgr())->LogReadTimes(true);
 }
 
+PF_CONSOLE_CMD(Registry, StartLoadTrace, "string file", "Records every object read off disk until StopLoadTrace, for plPageOptimizer")
+{
+    ((plResManager*)hsgResMgr::ResMgr())->StartLoadTrace((const char*)params[0]);
+    PrintString("Recording load trace");
+}
+
+PF_CONSOLE_CMD(Registry, StopLoadTrace, "", "Stops recording the load trace and writes it out")
+{
+    if (((plResManager*)hsgResMgr::ResMgr())->StopLoadTrace())
+        PrintString("Load trace written");
+    else
+        PrintString("ERROR: No load trace written");
+}
+
+PF_CONSOLE_CMD(Registry, TogglePagePrefetch, "", "Toggles reading the next rooms' pages into memory on the worker pool while a room loads")
+{
+    bool enabled = !plPagePrefetcher::Instance().IsEnabled();
+    plPagePrefetcher::Instance().SetEnabled(enabled);
+    PrintToggle(PrintString, "Page prefetching", enabled);
+}
+
+PF_CONSOLE_CMD(Registry, PagePrefetchStats, "", "Print page prefetcher counters")
+{
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+
+    char buff[256];
+    sprintf(buff, "%d pages read ahead, %d missed, %d pending, %d KB resident, %.1f ms reading, %.1f ms waited",
+            int(prefetcher.GetNumPrefetched()), int(prefetcher.GetNumMissed()), int(prefetcher.GetNumPending()),
+            int(prefetcher.GetBytesResident() / 1024), prefetcher.GetReadTime(), prefetcher.GetWaitTime());
+    PrintString(buff);
+}
+
 #endif // LIMIT_CONSOLE_COMMANDS
 
 
@@ -6523,6 +6614,16 @@ PF_CONSOLE_CMD( Animation,
     PrintString(buff);
 }
 
+PF_CONSOLE_CMD( Animation,
+               ToggleCompressKeys,
+               "",
+               "Toggle requantizing rotation and position keys as animations are loaded. Affects pages loaded afterwards." )
+{
+    bool enabled = !plLeafController::GetCompressOnRead();
+    plLeafController::SetCompressOnRead(enabled);
+    PrintToggle(PrintString, "Animation key compression on load", enabled);
+}
+
 #endif // LIMIT_CONSOLE_COMMANDS
 
 ////////////////////////////////////////////////////////////////////////
@@ -6877,6 +6978,40 @@ PF_CONSOLE_CMD( Python,
     PrintString(output.c_str());
 }
 
+#include "pfPython/plPythonPack.h"
+PF_CONSOLE_CMD( Python,
+                TimePackedUnmarshal,
+                "",                 // Params - None
+                "Reopens python.pak and times unmarshalling every module in it" )
+{
+    // Start from scratch, as if we were starting up
+    PythonPack::ClosePythonPacked();
+
+    uint64_t start = hsTimer::GetTicks();
+    std::vector<ST::string> modules = PythonPack::GetPythonPackedFiles();
+    uint64_t opened = hsTimer::GetTicks();
+
+    uint32_t failed = 0;
+    for (const ST::string& module : modules)
+    {
+        if (!PythonPack::OpenPythonPacked(module))
+            failed++;
+    }
+    uint64_t loaded = hsTimer::GetTicks();
+
+    // Second pass should be served entirely from the cache
+    for (const ST::string& module : modules)
+        PythonPack::OpenPythonPacked(module);
+    uint64_t cached = hsTimer::GetTicks();
+
+    PrintString(ST::format("Index: {.3f} ms for {} modules",
+                hsTimer::GetMilliSeconds<float>(opened - start), modules.size()).c_str());
+    PrintString(ST::format("Unmarshal: {.3f} ms ({} failed)",
+                hsTimer::GetMilliSeconds<float>(loaded - opened), failed).c_str());
+    PrintString(ST::format("Cached: {.3f} ms",
+                hsTimer::GetMilliSeconds<float>(cached - loaded)).c_str());
+}
+
 #endif // LIMIT_CONSOLE_COMMANDS
 
 
@@ -69,6 +69,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnMessage/plEnableMsg.h"
 #include "pnMessage/plAudioSysMsg.h"
 #include "plNetMessage/plNetMessage.h"
+#include "plNetMessage/plNetMsgHelpers.h"
 #include "plMessage/plAvatarMsg.h"
 #include "plMessage/plOneShotMsg.h"
 #include "plMessage/plConsoleMsg.h"
@@ -571,6 +572,19 @@ PF_CONSOLE_CMD( Net, SetProxyAddr,
 
 #ifndef LIMIT_CONSOLE_COMMANDS
 
+PF_CONSOLE_CMD( Net, SetStreamCompression,
+               "string codec", // paramList
+               "Compress outgoing state and clone streams with 'zlib' (default) or 'lz4', once the server says it can read it" ) // helpString
+{
+    ST::string codec = static_cast<const char *>(params[0]);
+    if (codec.compare_i("lz4") == 0)
+        plNetMsgStreamHelper::SetPreferredCompressionType(plNetMessage::kCompressionLZ4);
+    else if (codec.compare_i("zlib") == 0)
+        plNetMsgStreamHelper::SetPreferredCompressionType(plNetMessage::kCompressionZlib);
+    else
+        PrintString("Unknown codec, use zlib or lz4");
+}
+
 PF_CONSOLE_CMD( Net, GetCCRAwayStatus,
                "", // paramList
                "Find out if CCR's are offline" )    // helpString
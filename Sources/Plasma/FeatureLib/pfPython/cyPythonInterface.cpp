@@ -1553,6 +1553,9 @@ void PythonInterface::finiPython()
             plasmaVaultConstantsMod = nil;
         }
 
+        // release the cached code objects from python.pak
+        PythonPack::ClosePythonPacked();
+
         // let Python clean up after itself
         Py_Finalize();
 
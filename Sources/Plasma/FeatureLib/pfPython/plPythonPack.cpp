@@ -42,8 +42,10 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include <Python.h>
 #include <marshal.h>
-#include <ctime>
-#include <string>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "HeadSpin.h"
 #include "hsStream.h"
@@ -51,28 +53,56 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plPythonPack.h"
 
+#include "hsLockGuard.h"
+#include "plProfile.h"
 #include "plFile/plSecureStream.h"
 #include "plFile/plStreamSource.h"
 
 static const char* kPackFilePath = ".\\Python\\";
 
-struct plPackOffsetInfo
+plProfile_CreateMemCounterTagged("Python Packs", "Memory", MemPythonPacks, kMemTagPython);
+
+// A single .pak file, held in memory for the lifetime of the pack.  Plain
+// files on disk are mapped directly, anything else (encrypted or preloaded)
+// is read out of its stream once so we never touch the shared stream again.
+struct plPackFile
 {
-    uint32_t fOffset;
-    uint32_t fStreamIndex; // index of the stream object in the plPythonPack object that the file resides in
+    hsMappedFileStream          fMapping;
+    std::unique_ptr<uint8_t[]>  fImage;
+    const uint8_t*              fData;
+    uint32_t                    fSize;
+    uint64_t                    fModTime;
+
+    plPackFile() : fData(nullptr), fSize(0), fModTime(0) { }
+};
+
+struct plPackEntry
+{
+    ST::string      fName;
+    const uint8_t*  fCode;          // marshalled code, points into the owning plPackFile
+    uint32_t        fCodeSize;
+    uint32_t        fPackIndex;
+    PyObject*       fCodeObject;    // unmarshalled lazily, owned by the pack
+
+    bool operator<(const plPackEntry& other) const { return fName < other.fName; }
 };
 
 class plPythonPack
 {
 protected:
-    std::vector<hsStream*> fPackStreams;
+    std::vector<std::unique_ptr<plPackFile>> fPackFiles;
     bool fPackNotFound;     // No pack file, don't keep trying
 
-    typedef std::map<ST::string, plPackOffsetInfo> FileOffset;
-    FileOffset fFileOffsets;
+    // Flat index over all packs, sorted by name so lookups are a binary search
+    std::vector<plPackEntry> fEntries;
+    std::mutex fMutex;
 
     plPythonPack();
 
+    bool ILoadPackFile(const plFileName& fileName, plPackFile* pack);
+    void IReadIndex(uint32_t packIndex, std::vector<plPackEntry>& entries);
+    plPackEntry* IFindEntry(const ST::string& fileName);
+
 public:
     ~plPythonPack();
 
@@ -83,6 +113,7 @@ public:
 
     PyObject* OpenPacked(const ST::string& sfileName);
     bool IsPackedFile(const ST::string& fileName);
+    std::vector<ST::string> GetPackedFiles();
 };
 
 PyObject* PythonPack::OpenPythonPacked(const ST::string& fileName)
@@ -95,6 +126,16 @@ bool PythonPack::IsItPythonPacked(const ST::string& fileName)
     return plPythonPack::Instance().IsPackedFile(fileName);
 }
 
+std::vector<ST::string> PythonPack::GetPythonPackedFiles()
+{
+    return plPythonPack::Instance().GetPackedFiles();
+}
+
+void PythonPack::ClosePythonPacked()
+{
+    plPythonPack::Instance().Close();
+}
+
 plPythonPack::plPythonPack() : fPackNotFound(false)
 {
 }
@@ -110,9 +151,84 @@ plPythonPack& plPythonPack::Instance()
     return theInstance;
 }
 
+bool plPythonPack::ILoadPackFile(const plFileName& fileName, plPackFile* pack)
+{
+#ifndef PLASMA_EXTERNAL_RELEASE
+    // Unencrypted paks on disk can be used in place
+    if (!plSecureStream::IsSecureFile(fileName) && pack->fMapping.Open(fileName))
+    {
+        pack->fData = static_cast<const uint8_t*>(pack->fMapping.GetData());
+        pack->fSize = pack->fMapping.GetEOF();
+        // Anything shorter can't even hold the file count
+        return pack->fSize >= sizeof(uint32_t);
+    }
+#endif
+
+    // obtain the stream
+    hsStream* packStream = plStreamSource::GetInstance()->GetFile(fileName);
+    if (!packStream)
+        return false;
+
+    // The stream is shared with the preloader, so take our own copy of the
+    // decrypted contents now and leave the stream alone afterwards
+    packStream->Rewind();
+    uint32_t size = packStream->GetEOF();
+    pack->fImage.reset(new uint8_t[size]);
+    pack->fSize = packStream->Read(size, pack->fImage.get());
+    pack->fData = pack->fImage.get();
+    packStream->Rewind();
+
+    return pack->fSize >= sizeof(uint32_t);
+}
+
+void plPythonPack::IReadIndex(uint32_t packIndex, std::vector<plPackEntry>& entries)
+{
+    const plPackFile* pack = fPackFiles[packIndex].get();
+    hsReadOnlyStream index(pack->fSize, pack->fData);
+
+    // read the index data
+    uint32_t numFiles = index.ReadLE32();
+
+    // Each entry takes at least a string length and an offset, don't let a
+    // bad count walk (or reserve) past the end of the pack
+    const uint32_t kMinEntrySize = sizeof(uint16_t) + sizeof(uint32_t);
+    uint32_t maxFiles = (pack->fSize - uint32_t(sizeof(uint32_t))) / kMinEntrySize;
+    hsAssert(numFiles <= maxFiles, "Python PackFile: bad file count");
+    numFiles = std::min(numFiles, maxFiles);
+
+    entries.reserve(entries.size() + numFiles);
+    for (uint32_t i = 0; i < numFiles; i++)
+    {
+        // and pack the index into our own data structure
+        plPackEntry entry;
+        entry.fName = index.ReadSafeString();
+        uint32_t offset = index.ReadLE32();
+
+        uint32_t size = 0;
+        if (offset < pack->fSize && pack->fSize - offset >= sizeof(uint32_t))
+        {
+            memcpy(&size, pack->fData + offset, sizeof(uint32_t));
+            size = hsToLE32(size);
+        }
+        if (size == 0 || size > pack->fSize - offset - sizeof(uint32_t))
+        {
+            hsAssert(0, ST::format("Python PackFile: bad entry for {}", entry.fName).c_str());
+            continue;
+        }
+
+        entry.fCode = pack->fData + offset + sizeof(uint32_t);
+        entry.fCodeSize = size;
+        entry.fPackIndex = packIndex;
+        entry.fCodeObject = nullptr;
+        entries.push_back(entry);
+    }
+}
+
 bool plPythonPack::Open()
 {
-    if (fPackStreams.size() > 0)
+    hsLockGuard(fMutex);
+
+    if (fPackFiles.size() > 0)
         return true;
     
     // We already tried and it wasn't there
@@ -124,48 +240,40 @@ bool plPythonPack::Open()
     // Get the names of all the pak files
     std::vector<plFileName> files = plStreamSource::GetInstance()->GetListOfNames("python", "pak");
 
-    std::vector<time_t> modTimes; // the modification time for each of the streams (to resolve duplicate file issues)
-
     // grab all the .pak files in the folder
-    for (int curName = 0; curName < files.size(); curName++)
+    std::vector<plPackEntry> entries;
+    for (const plFileName& file : files)
+    {
+        std::unique_ptr<plPackFile> pack(new plPackFile);
+        if (!ILoadPackFile(file, pack.get()))
+            continue;
+
+        fPackNotFound = false;
+
+        // the modification time for each of the packs (to resolve duplicate file issues)
+        plFileInfo info(file);
+        if (info.Exists())
+            pack->fModTime = info.ModifyTime();
+
+        plProfile_NewMem(MemPythonPacks, pack->fSize);
+        fPackFiles.push_back(std::move(pack));
+        IReadIndex((uint32_t)(fPackFiles.size() - 1), entries);
+    }
+
+    // Sort the entries, keeping the newest copy of anything that shows up in
+    // more than one pak.  Ties go to whichever pak was found first.
+    std::stable_sort(entries.begin(), entries.end());
+    fEntries.reserve(entries.size());
+    for (const plPackEntry& entry : entries)
     {
-        // obtain the stream
-        hsStream *fPackStream = plStreamSource::GetInstance()->GetFile(files[curName]);
-        if (fPackStream)
+        if (!fEntries.empty() && fEntries.back().fName == entry.fName)
         {
-            fPackStream->Rewind(); // make sure we're at the beginning of the file
-            fPackNotFound = false;
-
-            time_t curModTime = 0;
-            plFileInfo info(files[curName]);
-            if (info.Exists())
-                curModTime = info.ModifyTime();
-            modTimes.push_back(curModTime);
-
-            // read the index data
-            int numFiles = fPackStream->ReadLE32();
-            uint32_t streamIndex = (uint32_t)(fPackStreams.size());
-            for (int i = 0; i < numFiles; i++)
-            {
-                // and pack the index into our own data structure
-                ST::string pythonName = fPackStream->ReadSafeString();
-                uint32_t offset = fPackStream->ReadLE32();
-
-                plPackOffsetInfo offsetInfo;
-                offsetInfo.fOffset = offset;
-                offsetInfo.fStreamIndex = streamIndex;
-
-                if (fFileOffsets.find(pythonName) != fFileOffsets.end())
-                {
-                    uint32_t index = fFileOffsets[pythonName].fStreamIndex;
-                    if (modTimes[index] < curModTime) // is the existing file older then the new one?
-                        fFileOffsets[pythonName] = offsetInfo; // yup, so replace it with the new info
-                }
-                else
-                    fFileOffsets[pythonName] = offsetInfo; // no conflicts, add the info
-            }
-            fPackStreams.push_back(fPackStream);
+            uint64_t existingTime = fPackFiles[fEntries.back().fPackIndex]->fModTime;
+            if (existingTime < fPackFiles[entry.fPackIndex]->fModTime)
+                fEntries.back() = entry;
         }
+        else
+            fEntries.push_back(entry);
     }
 
     return !fPackNotFound;
@@ -173,20 +281,32 @@ bool plPythonPack::Open()
 
 void plPythonPack::Close()
 {
-    if (fPackStreams.size() == 0)
-        return;
-    
-    int i;
-    for (i=0; i<fPackStreams.size(); i++)
-    {
-        hsStream* fPackStream = fPackStreams[i];
+    hsLockGuard(fMutex);
 
-        // do NOT close or delete the streams, the preloader will do that for us
-        fPackStreams[i] = nil;
+    // Don't try to release the code objects if python is already gone
+    if (Py_IsInitialized())
+    {
+        for (plPackEntry& entry : fEntries)
+            Py_XDECREF(entry.fCodeObject);
     }
 
-    fPackStreams.clear();
-    fFileOffsets.clear();
+    // The streams belong to plStreamSource, we only drop our own copies
+    for (const std::unique_ptr<plPackFile>& pack : fPackFiles)
+        plProfile_DelMem(MemPythonPacks, pack->fSize);
+    fEntries.clear();
+    fPackFiles.clear();
+    fPackNotFound = false;
+}
+
+plPackEntry* plPythonPack::IFindEntry(const ST::string& fileName)
+{
+    plPackEntry key;
+    key.fName = fileName + ".py";
+
+    auto it = std::lower_bound(fEntries.begin(), fEntries.end(), key);
+    if (it != fEntries.end() && it->fName == key.fName)
+        return &(*it);
+    return nullptr;
 }
 
 PyObject* plPythonPack::OpenPacked(const ST::string& fileName)
@@ -194,34 +314,18 @@ PyObject* plPythonPack::OpenPacked(const ST::string& fileName)
     if (!Open())
         return nil;
 
-    ST::string pythonName = fileName + ".py";
-
-    FileOffset::iterator it = fFileOffsets.find(pythonName);
-    if (it != fFileOffsets.end())
-    {
-        plPackOffsetInfo offsetInfo = (*it).second;
-        hsStream* fPackStream = fPackStreams[offsetInfo.fStreamIndex];
-        
-        fPackStream->SetPosition(offsetInfo.fOffset);
-
-        int32_t size = fPackStream->ReadLE32();
-        if (size > 0)
-        {
-            char *buf = new char[size];
-            uint32_t readSize = fPackStream->Read(size, buf);
-            hsAssert(readSize <= size, ST::format("Python PackFile {}: Incorrect amount of data, read {} instead of {}",
-                     fileName, readSize, size).c_str());
-
-            // let the python marshal make it back into a code object
-            PyObject *pythonCode = PyMarshal_ReadObjectFromString(buf, size);
+    hsLockGuard(fMutex);
 
-            delete [] buf;
+    plPackEntry* entry = IFindEntry(fileName);
+    if (!entry)
+        return nil;
 
-            return pythonCode;
-        }
-    }
+    // let the python marshal make it back into a code object, straight out
+    // of the pack's memory.  The result is kept around for later imports.
+    if (!entry->fCodeObject)
+        entry->fCodeObject = PyMarshal_ReadObjectFromString((char*)entry->fCode, entry->fCodeSize);
 
-    return nil;
+    return entry->fCodeObject;
 }
 
 bool plPythonPack::IsPackedFile(const ST::string& fileName)
@@ -229,11 +333,22 @@ bool plPythonPack::IsPackedFile(const ST::string& fileName)
     if (!Open())
         return false;
 
-    ST::string pythonName = fileName + ".py";
+    hsLockGuard(fMutex);
+    return IFindEntry(fileName) != nullptr;
+}
 
-    FileOffset:: iterator it = fFileOffsets.find(pythonName);
-    if (it != fFileOffsets.end())
-        return true;
+std::vector<ST::string> plPythonPack::GetPackedFiles()
+{
+    std::vector<ST::string> names;
+    if (!Open())
+        return names;
 
-    return false;
+    hsLockGuard(fMutex);
+    names.reserve(fEntries.size());
+    for (const plPackEntry& entry : fEntries)
+    {
+        if (entry.fName.ends_with(".py"))
+            names.push_back(entry.fName.substr(0, entry.fName.size() - 3));
+    }
+    return names;
 }
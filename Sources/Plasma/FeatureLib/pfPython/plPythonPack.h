@@ -42,13 +42,23 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #ifndef plPythonPack_h_inc
 #define plPythonPack_h_inc
 
+#include <vector>
+
 typedef struct _object PyObject;
 namespace ST { class string; }
 
 namespace PythonPack
 {
+    // Returns a borrowed reference; the code object is cached by the pack
+    // until ClosePythonPacked() is called.
     PyObject* OpenPythonPacked(const ST::string& fileName);
     bool IsItPythonPacked(const ST::string& fileName);
+
+    // Names of every module in the loaded packs, without the .py extension
+    std::vector<ST::string> GetPythonPackedFiles();
+
+    // Drops the pak mappings and cached code objects (call before Py_Finalize)
+    void ClosePythonPacked();
 }
 
 #endif // plPythonPack_h_inc
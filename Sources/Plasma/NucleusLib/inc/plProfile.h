@@ -43,6 +43,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #define plProfile_h_inc
 
 #include "HeadSpin.h"
+#include "hsMemory.h"
 
 #ifndef PLASMA_EXTERNAL_RELEASE
 #define PL_PROFILE_ENABLED
@@ -96,6 +97,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #define plProfile_CreateMemCounter(name, group, varName)    plProfileVar gProfileVar##varName(name, group, plProfileVar::kDisplayMem | plProfileVar::kDisplayNoReset)
 #define plProfile_CreateMemCounterReset(name, group, varName)   plProfileVar gProfileVar##varName(name, group, plProfileVar::kDisplayMem)
+#define plProfile_CreateMemCounterTagged(name, group, varName, tag) plProfileVar gProfileVar##varName(name, group, plProfileVar::kDisplayMem | plProfileVar::kDisplayNoReset, tag)
 #define plProfile_NewMem(varName, memAmount)                gProfileVar##varName.NewMem(memAmount)
 #define plProfile_DelMem(varName, memAmount)                gProfileVar##varName.DelMem(memAmount)
 
@@ -123,6 +125,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #define plProfile_CreateMemCounter(name, group, varName)
 #define plProfile_CreateMemCounterReset(name, group, varName)
+#define plProfile_CreateMemCounterTagged(name, group, varName, tag)
 #define plProfile_NewMem(varName, memAmount)
 #define plProfile_DelMem(varName, memAmount)
 
@@ -205,8 +208,9 @@ protected:
     const char* fGroup;
     plProfileLaps* fLaps;
     bool fLapsActive;
+    hsMemTag fMemTag;       // NewMem/DelMem are also reported to hsMemTracker under this tag
 
-    plProfileVar() {}
+    plProfileVar() : fMemTag(kMemTagUntagged) {}
 
     void IBeginTiming();
     void IEndTiming();
@@ -216,15 +220,25 @@ protected:
 
 public:
     // Name is the timer name. Each timer group gets its own plStatusLog
-    plProfileVar(const char *name, const char* group, uint8_t flags);
+    plProfileVar(const char *name, const char* group, uint8_t flags, hsMemTag memTag = kMemTagUntagged);
     ~plProfileVar();
 
     // For timing
     void BeginTiming() { if (fActive && fRunning) IBeginTiming(); }
     void EndTiming() { if (fActive && fRunning) IEndTiming(); }
 
-    void NewMem(uint32_t memAmount) { fValue += memAmount; }
-    void DelMem(uint32_t memAmount) { fValue -= memAmount; }
+    void NewMem(uint32_t memAmount)
+    {
+        fValue += memAmount;
+        if (fMemTag != kMemTagUntagged)
+            hsMemTracker::Add(fMemTag, memAmount);
+    }
+    void DelMem(uint32_t memAmount)
+    {
+        fValue -= memAmount;
+        if (fMemTag != kMemTagUntagged)
+            hsMemTracker::Remove(fMemTag, memAmount);
+    }
 
     // For Counting
     void Inc(int i = 1) { fValue += i;}
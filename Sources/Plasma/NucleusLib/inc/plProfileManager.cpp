@@ -363,9 +363,10 @@ plProfileBase* plProfileLaps::GetLap(int i)
 ///////////////////////////////////////////////////////////////////////////////
 
 
-plProfileVar::plProfileVar(const char *name, const char* group, uint8_t flags) :
+plProfileVar::plProfileVar(const char *name, const char* group, uint8_t flags, hsMemTag memTag) :
     fGroup(group),
-    fLaps(nil)
+    fLaps(nil),
+    fMemTag(memTag)
 {
     fName = name;
     fDisplayFlags = flags;
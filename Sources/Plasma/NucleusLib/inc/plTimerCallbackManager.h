@@ -46,7 +46,11 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnKeyedObject/hsKeyedObject.h"
 #include "hsTemplates.h"
 
+#include <unordered_map>
+#include <vector>
+
 class plMessage;
+class plKeyImp;
 
 class plTimerCallback
 {
@@ -60,8 +64,22 @@ public:
 
     double      fTime;
     plMessage*  fMsg;
+
+protected:
+    friend class plTimerCallbackManager;
+
+    uint32_t    fSerial;        // Order of creation, breaks ties between equal times
+    size_t      fHeapIdx;       // Where we are in the manager's heap
 };
 
+//
+// Holds the pending callbacks in a binary heap on fire time, so adding and
+// cancelling are O(log n), and every callback that's due goes out on the
+// same plTimeMsg.  The plTimerCallback that NewTimer returns doubles as the
+// handle for CancelCallback, and is good until the callback fires or is
+// cancelled.  Callbacks are also indexed by the receivers their message had
+// when it was handed over, for CancelCallbacksToKey.
+//
 class plTimerCallbackManager : public hsKeyedObject
 {
 public:
@@ -75,6 +93,10 @@ public:
     bool CancelCallback(plTimerCallback* pTimer);
     bool CancelCallbacksToKey(const plKey& key);
 
+    size_t GetNumCallbacks() const { return fCallbacks.size(); }
+
+    // Sends and deletes every callback due by the given time
+    void FireCallbacks(double time);
 
     bool MsgReceive(plMessage* msg) HS_OVERRIDE;
 
@@ -82,7 +104,20 @@ public:
     void Write(hsStream* stream, hsResMgr* mgr) HS_OVERRIDE;
 
 private:
-    hsTArray<plTimerCallback*>  fCallbacks;
+    std::vector<plTimerCallback*>   fCallbacks;     // Min-heap on (fTime, fSerial)
+    uint32_t                        fNextSerial;
+
+    typedef std::unordered_map<plKeyImp*, std::vector<plTimerCallback*>> ReceiverMap;
+    ReceiverMap                     fByReceiver;
+
+    static bool IFiresBefore(const plTimerCallback* a, const plTimerCallback* b)
+    {
+        return a->fTime < b->fTime || (a->fTime == b->fTime && a->fSerial < b->fSerial);
+    }
+
+    void ISiftUp(size_t idx);
+    void ISiftDown(size_t idx);
+    void IRemove(plTimerCallback* pTimer);
 };
 
 class plgTimerCallbackMgr
@@ -62,8 +62,22 @@ plProfile_CreateTimer("  EvalMsg", "Update", EvalMsg);
 plProfile_CreateTimer("  TransformMsg", "Update", TransformMsg);
 plProfile_CreateTimer("  CameraMsg", "Update", CameraMsg);
 
+plProfile_CreateCounter("Msg Wraps Allocated", "Update", MsgWrapAllocs);
+
+// Wraps come and go with every message sent, so finished ones go back on a
+// free list instead of the heap.  They keep their receiver arrays too, which
+// spares the regrowth on the next broadcast.
 class plMsgWrap
 {
+    enum { kMaxFree = 256 };
+
+    static plMsgWrap*               fFreeList;
+    static uint32_t                 fNumFree;
+    static std::mutex               fFreeMutex;
+
+    plMsgWrap() : fBack(nil), fNext(nil), fMsg(nil) { }
+    ~plMsgWrap() { }
+
 public:
     plMsgWrap**                     fBack;
     plMsgWrap*                      fNext;
@@ -71,10 +85,11 @@ public:
 
     plMessage*                      fMsg;
 
-    plMsgWrap(plMessage* msg) : fMsg(msg) { hsRefCnt_SafeRef(msg); }
-    virtual ~plMsgWrap() { hsRefCnt_SafeUnRef(fMsg); }
+    static plMsgWrap*               Acquire(plMessage* msg);
+    static void                     Release(plMsgWrap* wrap);
+    static void                     FreeCache();
 
-    plMsgWrap&                      ClearReceivers() { fReceivers.SetCount(0); return *this; }
+    plMsgWrap&                      ClearReceivers();
     plMsgWrap&                      AddReceiver(const plKey& rcv) 
                                     { 
                                         hsAssert(rcv, "Trying to send mail to nil receiver");
@@ -84,6 +99,75 @@ public:
     uint32_t                          GetNumReceivers() const { return fReceivers.GetCount(); }
 };
 
+plMsgWrap*  plMsgWrap::fFreeList = nil;
+uint32_t    plMsgWrap::fNumFree = 0;
+std::mutex  plMsgWrap::fFreeMutex;
+
+plMsgWrap* plMsgWrap::Acquire(plMessage* msg)
+{
+    plMsgWrap* wrap = nil;
+    {
+        hsLockGuard(fFreeMutex);
+        if (fFreeList)
+        {
+            wrap = fFreeList;
+            fFreeList = wrap->fNext;
+            fNumFree--;
+        }
+    }
+    if (!wrap)
+    {
+        wrap = new plMsgWrap;
+        plProfile_Inc(MsgWrapAllocs);
+    }
+
+    wrap->fBack = nil;
+    wrap->fNext = nil;
+    wrap->fMsg = msg;
+    hsRefCnt_SafeRef(msg);
+    return wrap;
+}
+
+void plMsgWrap::Release(plMsgWrap* wrap)
+{
+    hsRefCnt_SafeUnRef(wrap->fMsg);
+    wrap->fMsg = nil;
+    wrap->ClearReceivers();
+
+    {
+        hsLockGuard(fFreeMutex);
+        if (fNumFree < kMaxFree)
+        {
+            wrap->fNext = fFreeList;
+            fFreeList = wrap;
+            fNumFree++;
+            return;
+        }
+    }
+    delete wrap;
+}
+
+void plMsgWrap::FreeCache()
+{
+    hsLockGuard(fFreeMutex);
+    while (fFreeList)
+    {
+        plMsgWrap* nuke = fFreeList;
+        fFreeList = nuke->fNext;
+        delete nuke;
+    }
+    fNumFree = 0;
+}
+
+plMsgWrap& plMsgWrap::ClearReceivers()
+{
+    // Drop the key refs now, but hang on to the array
+    for (int i = 0; i < fReceivers.GetCount(); i++)
+        fReceivers[i] = nullptr;
+    fReceivers.SetCount(0);
+    return *this;
+}
+
 int32_t                 plDispatch::fNumBufferReq = 0;
 bool                    plDispatch::fMsgActive = false;
 plMsgWrap*              plDispatch::fMsgCurrent = nil;
@@ -122,7 +206,7 @@ void plDispatch::ITrashUndelivered()
         plMsgWrap* nuke = fFutureMsgQueue;
         fFutureMsgQueue = fFutureMsgQueue->fNext;
         hsRefCnt_SafeUnRef(nuke->fMsg);
-        delete nuke;
+        plMsgWrap::Release(nuke);
     }
 
     // If we're the main dispatch, any unsent messages at this
@@ -135,13 +219,15 @@ void plDispatch::ITrashUndelivered()
         {
             plMsgWrap* nuke = fMsgHead;
             fMsgHead = fMsgHead->fNext;
-            // hsRefCnt_SafeUnRef(nuke->fMsg);      // MOOSE - done in plMsgWrap dtor
-            delete nuke;
+            // hsRefCnt_SafeUnRef(nuke->fMsg);      // MOOSE - done in plMsgWrap::Release
+            plMsgWrap::Release(nuke);
         }
 
         // reset static members which we just deleted - MOOSE
         fMsgCurrent=fMsgHead=fMsgTail=nil;
 
+        plMsgWrap::FreeCache();
+
         fMsgActive = false;
     }
 }
@@ -172,7 +258,7 @@ plMsgWrap* plDispatch::IDequeue(plMsgWrap** head, plMsgWrap** tail)
 
 bool plDispatch::ISortToDeferred(plMessage* msg)
 {
-    plMsgWrap* msgWrap = new plMsgWrap(msg);
+    plMsgWrap* msgWrap = plMsgWrap::Acquire(msg);
     if( !fFutureMsgQueue )
     {
         if( IGetOwner() )
@@ -201,7 +287,7 @@ void plDispatch::ICheckDeferred(double secs)
     {
         plMsgWrap* send = IDequeue(&fFutureMsgQueue, nil);
         MsgSend(send->fMsg);
-        delete send;
+        plMsgWrap::Release(send);
     }
 
     int timeIdx = plTimeMsg::Index();
@@ -399,7 +485,7 @@ void plDispatch::IMsgDispatch()
 
         msgCurrentLock.lock();
 
-        delete fMsgCurrent;
+        plMsgWrap::Release(fMsgCurrent);
         // TEMP
         fMsgCurrent = (class plMsgWrap *)0xdeadc0de;
     }
@@ -461,7 +547,7 @@ bool plDispatch::MsgSend(plMessage* msg, bool async)
     else if((timeMsg = plTimeMsg::ConvertNoRef(msg)))
         ICheckDeferred(timeMsg->DSeconds());
 
-    plMsgWrap* msgWrap = new plMsgWrap(msg);
+    plMsgWrap* msgWrap = plMsgWrap::Acquire(msg);
     hsRefCnt_SafeUnRef(msg);
 
     // broadcast
@@ -473,6 +559,7 @@ bool plDispatch::MsgSend(plMessage* msg, bool async)
             plTypeFilter* filt = fRegisteredExactTypes[idx];
             if( filt )
             {
+                msgWrap->fReceivers.Expand(filt->fReceivers.GetCount());
                 int j;
                 for( j = 0; j < filt->fReceivers.GetCount(); j++ )
                 {
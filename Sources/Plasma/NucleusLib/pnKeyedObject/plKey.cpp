@@ -71,7 +71,7 @@ static const int kLocSeq = -1;
 class keyDataFriend : public plKeyData
 {
 public:
-    uint16_t RefCount() const { return fRefCount; }
+    uint32_t RefCount() const { return fRefCount; }
 };
 
 static int IsTracked(const plKeyData* keyData)
@@ -219,7 +219,7 @@ void plKey::IIncRef()
     if (!fKeyData)
         return;
 
-    hsAssert(fKeyData->fRefCount < 0xffff, "Too many refs to plKeyImp");
+    hsAssert(fKeyData->fRefCount < 0xffffffff, "Too many refs to plKeyImp");
     fKeyData->fRefCount++;
 
 #if TRACK_REFS  // FOR DEBUGGING ONLY
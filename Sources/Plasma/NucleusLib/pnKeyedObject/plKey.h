@@ -118,9 +118,9 @@ public:
     //----------------------
     virtual void Release(plKey targetKey)=0;
 
-    virtual uint16_t      GetActiveRefs() const = 0;
+    virtual uint32_t      GetActiveRefs() const = 0;
 
-    virtual uint16_t      GetNumNotifyCreated() const = 0;
+    virtual uint32_t      GetNumNotifyCreated() const = 0;
     virtual plRefMsg*   GetNotifyCreated(int i) const = 0;
     virtual const hsBitVector& GetActiveBits() const = 0;
 
@@ -152,7 +152,7 @@ protected:
     friend class plKey;
 
     // Refcount--the number of plKeys that have pointers to us.
-    uint16_t fRefCount;
+    uint32_t fRefCount;
 };
 
 #endif // plKey_h_inc
@@ -50,7 +50,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plProfile.h"
 #include "plgDispatch.h"
 
-plProfile_CreateMemCounter("Keys", "Memory", KeyMem);
+#include <algorithm>
+
+plProfile_CreateMemCounterTagged("Keys", "Memory", KeyMem, kMemTagResMgr);
 
 static uint32_t CalcKeySize(plKeyImp* key)
 {
@@ -78,10 +80,50 @@ hsKeyedObject* plKeyImp::SafeGetObject(const plKeyImp* key) {
     return key ? key->fObjectPtr : nullptr;
 }
 
+//// Reverse index helpers ///////////////////////////////////////////////////
+
+static bool IIsReceiver(const plRefMsg* msg, const plKeyImp* key)
+{
+    for (int i = 0; i < msg->GetNumReceivers(); i++)
+    {
+        if (&(*msg->GetReceiver(i)) == (plKeyData*)key)
+            return true;
+    }
+    return false;
+}
+
+// Drops one of key's slots, leaving the rest in the order they were added
+static void IRemoveSlot(plKeySlotIndex& idx, plKeyImp* key, uint32_t slot)
+{
+    plKeySlotIndex::iterator it = idx.find(key);
+    if (it == idx.end())
+        return;
+
+    std::vector<uint32_t>& slots = it->second;
+    std::vector<uint32_t>::iterator s = std::find(slots.begin(), slots.end(), slot);
+    if (s != slots.end())
+        slots.erase(s);
+    if (slots.empty())
+        idx.erase(it);
+}
+
+static void IMoveSlot(plKeySlotIndex& idx, plKeyImp* key, uint32_t from, uint32_t to)
+{
+    plKeySlotIndex::iterator it = idx.find(key);
+    if (it == idx.end())
+        return;
+
+    std::vector<uint32_t>& slots = it->second;
+    std::vector<uint32_t>::iterator s = std::find(slots.begin(), slots.end(), from);
+    if (s != slots.end())
+        *s = to;
+}
+
 plKeyImp::plKeyImp() :
     fObjectPtr(nil),
     fStartPos(-1),
     fDataLen(-1),
+    fUncompressedLen(0),
     fNumActiveRefs(0),
     fPendingRefs(1),
     fCloneOwner(nil)
@@ -96,6 +138,7 @@ plKeyImp::plKeyImp(plUoid u, uint32_t pos,uint32_t len):
     fObjectPtr(nil),
     fStartPos(pos),
     fDataLen(len),
+    fUncompressedLen(0),
     fNumActiveRefs(0),
     fPendingRefs(1),
     fCloneOwner(nil)
@@ -127,12 +170,13 @@ plKeyImp::~plKeyImp()
         ((plKeyImp*)fCloneOwner)->RemoveClone(this);
     }
 
-    for (int i = 0; i < fClones.GetCount(); i++)
+    for (size_t i = 0; i < fClones.size(); i++)
     {
         if (fClones[i])
             fClones[i]->UnRegister();
     }
-    fClones.Reset();
+    fClones.clear();
+    fCloneIdx.reset();
 
     // This is normally empty by now, but if we never got loaded,
     // there will be unsent ref messages in the NotifyCreated list
@@ -176,6 +220,7 @@ void plKeyImp::CopyForClone(const plKeyImp *p, uint32_t playerID, uint32_t clone
 
     fStartPos = p->GetStartPos();
     fDataLen = p->GetDataLen();
+    fUncompressedLen = p->GetUncompressedLen();
     fUoid.SetClone(playerID, cloneID);
 }
 
@@ -191,11 +236,12 @@ hsKeyedObject* plKeyImp::VerifyLoaded()
 //  The actual key read/writes for the index file, the only time the whole
 //  key is ever actually stored.
 
-void plKeyImp::Read(hsStream* s)
+void plKeyImp::Read(hsStream* s, bool compressed)
 {
     fUoid.Read(s);
     s->ReadLE(&fStartPos);
     s->ReadLE(&fDataLen);
+    fUncompressedLen = compressed ? s->ReadLE32() : 0;
 
     plProfile_NewMem(KeyMem, CalcKeySize(this));
 
@@ -205,19 +251,23 @@ void plKeyImp::Read(hsStream* s)
 #endif
 }
 
-void plKeyImp::SkipRead(hsStream* s)
+void plKeyImp::SkipRead(hsStream* s, bool compressed)
 {
     plUoid tempUoid;
     tempUoid.Read(s);
     s->ReadLE32();
     s->ReadLE32();
+    if (compressed)
+        s->ReadLE32();
 }
 
-void plKeyImp::Write(hsStream* s)
+void plKeyImp::Write(hsStream* s, bool compressed)
 {
     fUoid.Write(s);
     s->WriteLE(fStartPos);
     s->WriteLE(fDataLen);
+    if (compressed)
+        s->WriteLE(fUncompressedLen);
     if (fStartPos == (uint32_t)-1)
         int foo = 0;
 }
@@ -338,9 +388,10 @@ hsKeyedObject* plKeyImp::SetObjectPtr(hsKeyedObject* p)
 
 void plKeyImp::ClearNotifyCreated()
 {
-    for (int i = 0; i < fNotifyCreated.GetCount(); i++)
+    for (size_t i = 0; i < fNotifyCreated.size(); i++)
         hsRefCnt_SafeUnRef(fNotifyCreated[i]);
-    fNotifyCreated.Reset();
+    fNotifyCreated.clear();
+    fNotifyIdx.reset();
     fNotified.Reset();
     fActiveRefs.Reset();
 }
@@ -362,30 +413,144 @@ void plKeyImp::AddNotifyCreated(plRefMsg* msg, plRefFlags::Type flags)
     }
 
     hsRefCnt_SafeRef(msg);
-    fNotifyCreated.Append(msg);
+    fNotifyCreated.push_back(msg);
+    IIndexNotifyCreated(uint32_t(fNotifyCreated.size() - 1));
 }
 
 void plKeyImp::RemoveNotifyCreated(int i)
 {
-    hsRefCnt_SafeUnRef(fNotifyCreated[i]);
-    fNotifyCreated.Remove(i);
+    plRefMsg* msg = fNotifyCreated[i];
+
+    if (fNotifyIdx)
+    {
+        // Move our last entry into the hole so no other slot changes
+        uint32_t last = uint32_t(fNotifyCreated.size() - 1);
+        for (int j = 0; msg && j < msg->GetNumReceivers(); j++)
+            IRemoveSlot(*fNotifyIdx, (plKeyImp*)msg->GetReceiver(j), i);
+
+        if (uint32_t(i) != last)
+        {
+            plRefMsg* moved = fNotifyCreated[last];
+            for (int j = 0; moved && j < moved->GetNumReceivers(); j++)
+                IMoveSlot(*fNotifyIdx, (plKeyImp*)moved->GetReceiver(j), last, i);
+
+            fNotifyCreated[i] = moved;
+            fNotified.SetBit(i, fNotified.IsBitSet(last));
+            fActiveRefs.SetBit(i, fActiveRefs.IsBitSet(last));
+        }
+        fNotifyCreated.pop_back();
+        fNotified.ClearBit(last);
+        fActiveRefs.ClearBit(last);
+    }
+    else
+    {
+        fNotifyCreated.erase(fNotifyCreated.begin() + i);
+        fNotified.RemoveBit(i);
+        fActiveRefs.RemoveBit(i);
+    }
+
+    hsRefCnt_SafeUnRef(msg);
+}
+
+void plKeyImp::IIndexNotifyCreated(uint32_t i)
+{
+    if (!fNotifyIdx)
+    {
+        if (fNotifyCreated.size() <= kIndexThreshold)
+            return;
+
+        // Just got long enough, so index everything before us too
+        fNotifyIdx.reset(new plKeySlotIndex);
+        for (uint32_t j = 0; j < i; j++)
+            IIndexNotifyCreated(j);
+    }
+
+    plRefMsg* msg = fNotifyCreated[i];
+    for (int j = 0; msg && j < msg->GetNumReceivers(); j++)
+        (*fNotifyIdx)[(plKeyImp*)msg->GetReceiver(j)].push_back(i);
+}
+
+int plKeyImp::IFindNotifyCreated(const plKeyImp* rcv) const
+{
+    if (fNotifyIdx)
+    {
+        plKeySlotIndex::const_iterator it = fNotifyIdx->find(const_cast<plKeyImp*>(rcv));
+        return (it != fNotifyIdx->end()) ? int(it->second.front()) : -1;
+    }
+
+    for (size_t i = 0; i < fNotifyCreated.size(); i++)
+    {
+        if (fNotifyCreated[i] && IIsReceiver(fNotifyCreated[i], rcv))
+            return int(i);
+    }
+    return -1;
+}
+
+void plKeyImp::IFindNotifyCreated(const plKeyImp* rcv, std::vector<uint32_t>& slots) const
+{
+    slots.clear();
 
-    fNotified.RemoveBit(i);
-    fActiveRefs.RemoveBit(i);
+    if (fNotifyIdx)
+    {
+        plKeySlotIndex::const_iterator it = fNotifyIdx->find(const_cast<plKeyImp*>(rcv));
+        if (it != fNotifyIdx->end())
+            slots = it->second;
+        return;
+    }
+
+    for (size_t i = 0; i < fNotifyCreated.size(); i++)
+    {
+        if (fNotifyCreated[i] && IIsReceiver(fNotifyCreated[i], rcv))
+            slots.push_back(uint32_t(i));
+    }
 }
 
 void plKeyImp::AddRef(plKeyImp* key) const
 {
     fPendingRefs++;
-    fRefs.Append(key);
+    fRefs.push_back(key);
+    IIndexRef(uint32_t(fRefs.size() - 1));
 }
 
+void plKeyImp::IIndexRef(uint32_t i) const
+{
+    if (!fRefIdx)
+    {
+        if (fRefs.size() <= kIndexThreshold)
+            return;
+
+        fRefIdx.reset(new plKeySlotIndex);
+        for (uint32_t j = 0; j < i; j++)
+            IIndexRef(j);
+    }
+
+    (*fRefIdx)[fRefs[i]].push_back(i);
+}
 
 void plKeyImp::RemoveRef(plKeyImp* key) const
 {
-    int idx = fRefs.Find(key);
-    if (fRefs.kMissingIndex != idx)
-        fRefs.Remove(idx);
+    if (fRefIdx)
+    {
+        plKeySlotIndex::iterator it = fRefIdx->find(key);
+        if (it == fRefIdx->end())
+            return;
+
+        uint32_t i = it->second.front();
+        uint32_t last = uint32_t(fRefs.size() - 1);
+        IRemoveSlot(*fRefIdx, key, i);
+        if (i != last)
+        {
+            fRefs[i] = fRefs[last];
+            IMoveSlot(*fRefIdx, fRefs[i], last, i);
+        }
+        fRefs.pop_back();
+    }
+    else
+    {
+        std::vector<plKeyImp*>::iterator it = std::find(fRefs.begin(), fRefs.end(), key);
+        if (it != fRefs.end())
+            fRefs.erase(it);
+    }
 }
 
 void plKeyImp::AddClone(plKeyImp* key)
@@ -394,25 +559,77 @@ void plKeyImp::AddClone(plKeyImp* key)
                 "Adding a clone which is already there?");
 
     key->fCloneOwner = plKey::Make(this);
-    fClones.Append(key);
+    fClones.push_back(key);
+    IIndexClone(uint32_t(fClones.size() - 1));
+}
+
+void plKeyImp::IIndexClone(uint32_t i) const
+{
+    if (!fCloneIdx)
+    {
+        if (fClones.size() <= kIndexThreshold)
+            return;
+
+        fCloneIdx.reset(new plKeyCloneIndex);
+        for (uint32_t j = 0; j < i; j++)
+            IIndexClone(j);
+    }
+
+    // First one in wins, same as the linear search
+    fCloneIdx->insert(std::make_pair(CloneIndexID(fClones[i]), i));
 }
 
 void plKeyImp::RemoveClone(plKeyImp* key) const
 {
-    if (key->GetUoid().IsClone())
+    if (!key->GetUoid().IsClone())
+        return;
+
+    // The index only has the first clone of each ID, so a duplicate that
+    // slipped past AddClone's assert still needs the search
+    uint32_t i;
+    plKeyCloneIndex::iterator it;
+    if (fCloneIdx && (it = fCloneIdx->find(CloneIndexID(key))) != fCloneIdx->end() && fClones[it->second] == key)
+    {
+        i = it->second;
+        fCloneIdx->erase(it);
+    }
+    else
+    {
+        std::vector<plKeyImp*>::iterator found = std::find(fClones.begin(), fClones.end(), key);
+        if (found == fClones.end())
+            return;
+        i = uint32_t(found - fClones.begin());
+    }
+
+    if (fCloneIdx)
     {
-        int idx = fClones.Find(key);
-        if (idx != -1)
+        uint32_t last = uint32_t(fClones.size() - 1);
+        if (i != last)
         {
-            fClones.Remove(idx);
-            key->fCloneOwner = nil;
+            fClones[i] = fClones[last];
+            it = fCloneIdx->find(CloneIndexID(fClones[i]));
+            if (it != fCloneIdx->end() && it->second == last)
+                it->second = i;
         }
+        fClones.pop_back();
     }
+    else
+        fClones.erase(fClones.begin() + i);
+
+    key->fCloneOwner = nil;
 }
 
 plKey plKeyImp::GetClone(uint32_t playerID, uint32_t cloneID) const
 {
-    for (int i = 0; i < fClones.GetCount(); i++)
+    if (fCloneIdx)
+    {
+        plKeyCloneIndex::const_iterator it = fCloneIdx->find(CloneIndexID(playerID, cloneID));
+        if (it != fCloneIdx->end())
+            return plKey::Make(fClones[it->second]);
+        return plKey();
+    }
+
+    for (size_t i = 0; i < fClones.size(); i++)
     {
         plKeyImp* cloneKey = fClones[i];
         if (cloneKey
@@ -426,12 +643,12 @@ plKey plKeyImp::GetClone(uint32_t playerID, uint32_t cloneID) const
 
 uint32_t plKeyImp::GetNumClones()
 {
-    return fClones.GetCount();
+    return uint32_t(fClones.size());
 }
 
 plKey plKeyImp::GetCloneByIdx(uint32_t idx)
 {
-    if (idx < fClones.GetCount())
+    if (idx < fClones.size())
         return plKey::Make(fClones[idx]);
 
     return nil;
@@ -500,36 +717,35 @@ void plKeyImp::SetupNotify(plRefMsg* msg, plRefFlags::Type flags)
 // up fNotified to only get set when the message actually was delivered (i.e.
 // refMsg->GetReceiver(0)->GetObjectPtr() != nil. But that only really works
 // if we guarantee the refMsg->GetNumReceivers() == 1.
-// This looks like it'll take forever to run, but this is only called right
-// when our object has just been loaded, at which time normally fRefs.GetCount() == 0.
+// This is only called right when our object has just been loaded. We only
+// look at the messages each ref has for us, which its index hands us directly
+// when it's a heavily referenced key (shared materials, scene nodes).
 void plKeyImp::INotifySelf(hsKeyedObject* ko)
 {
-    for (int i = 0; i < fRefs.GetCount(); i++)
+    std::vector<uint32_t> slots;
+    for (size_t i = 0; i < fRefs.size(); i++)
     {
-        hsKeyedObject* rcv = fRefs[i]->GetObjectPtr();
-        if (rcv)
+        plKeyImp* target = fRefs[i];
+        hsKeyedObject* rcv = target->GetObjectPtr();
+        if (!rcv)
+            continue;
+
+        target->IFindNotifyCreated(this, slots);
+        for (uint32_t j : slots)
         {
-            for (int j = 0; j < fRefs[i]->fNotifyCreated.GetCount(); j++)
+            // Sending can shuffle the target's list, so check the slot is still ours
+            if (j >= target->GetNumNotifyCreated())
+                continue;
+            plRefMsg* refMsg = target->fNotifyCreated[j];
+            if (refMsg && refMsg->GetRef() && !target->IsNotified(j) && IIsReceiver(refMsg, this))
             {
-                plRefMsg* refMsg = fRefs[i]->fNotifyCreated[j];
-                if (refMsg && refMsg->GetRef() && !fRefs[i]->IsNotified(j))
-                {
-                    hsAssert(refMsg->GetRef() == rcv, "Ref message out of sync with its ref");
-
-                    // GetNumReceivers() should always be 1 for a refMsg.
-                    for (int k = 0; k < refMsg->GetNumReceivers(); k++)
-                    {
-                        if (&(*refMsg->GetReceiver(k)) == (plKeyData*)this)
-                        {
-                            fRefs[i]->SetNotified(j);
-                            fRefs[i]->SatisfyPending(refMsg);
-
-                            hsRefCnt_SafeRef(refMsg);
-                            plgDispatch::MsgSend(refMsg);
-                            break;
-                        }
-                    }
-                }
+                hsAssert(refMsg->GetRef() == rcv, "Ref message out of sync with its ref");
+
+                target->SetNotified(j);
+                target->SatisfyPending(refMsg);
+
+                hsRefCnt_SafeRef(refMsg);
+                plgDispatch::MsgSend(refMsg);
             }
         }
     }
@@ -584,7 +800,8 @@ void plKeyImp::IClearRefs()
 {
     while (GetNumRefs())
         IRelease(GetRef(0));
-    fRefs.Reset();
+    fRefs.clear();
+    fRefIdx.reset();
 
     for (int i = 0; i < GetNumNotifyCreated(); i++)
     {
@@ -607,20 +824,8 @@ void plKeyImp::IRelease(plKeyImp* iTargetKey)
     // Inspect the target key to find whether it is supposed to send a message
     // to me on destruction, and to find out if I have an active of passive 
     // ref on this key.  Not sure why I don't track my own active/passive ref states
-    bool isActive = false;
-    int iTarg = -1;
-    for (int i = 0; (iTarg < 0) && (i < iTargetKey->GetNumNotifyCreated()); i++)
-    {
-        plMessage* rcvMsg = iTargetKey->GetNotifyCreated(i);
-        for (int j = 0; j < rcvMsg->GetNumReceivers(); j++)
-        {
-            if (&(*rcvMsg->GetReceiver(j)) == (plKeyData*)this)
-            {
-                isActive = iTargetKey->IsActiveRef(iTarg = i);
-                break;
-            }
-        }
-    }
+    int iTarg = iTargetKey->IFindNotifyCreated(this);
+    bool isActive = (iTarg >= 0) && iTargetKey->IsActiveRef(iTarg);
 
     if (iTarg < 0)
     {
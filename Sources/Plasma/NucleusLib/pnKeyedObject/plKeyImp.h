@@ -48,8 +48,26 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsBitVector.h"
 #include "plRefFlags.h"
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class plKeyImp;
+
+// Slots in one of a key's lists, by the key they belong to
+typedef std::unordered_map<plKeyImp*, std::vector<uint32_t>> plKeySlotIndex;
+// Slots in a key's clone list, by plKeyImp::CloneIndexID()
+typedef std::unordered_map<uint64_t, uint32_t> plKeyCloneIndex;
+
 //------------------------------------
 // plKey is a handle to a keyedObject
+//
+// The notify, ref and clone lists are flat arrays while they're short. Once
+// one of them grows past kIndexThreshold it also gets a hashed reverse index
+// (receiver -> notify slots, key -> ref slots, player/clone ID -> clone slot),
+// so heavily referenced keys don't rescan their lists on every page in/out.
+// An indexed list removes by moving its last entry into the hole, so its
+// order is only insertion order until the first removal.
 //------------------------------------
 class plKeyImp : public plKeyData 
 {
@@ -75,14 +93,16 @@ public:
     // I/O
     // ResMgr performs read, so it can search for an existing instance....
     //----------------------
-    void Read(hsStream* s);
-    void Write(hsStream* s);
+    // Keys in compressed pages also store the length of the uncompressed object
+    void Read(hsStream* s, bool compressed = false);
+    void Write(hsStream* s, bool compressed = false);
     void WriteObject(hsStream* s);
     // For when you need to skip over a key in a stream
-    static void SkipRead(hsStream* s);
+    static void SkipRead(hsStream* s, bool compressed = false);
 
     uint32_t GetStartPos() const  { return fStartPos; } // for ResMgr to read the Objects
     uint32_t GetDataLen() const   { return fDataLen;  } // for ResMgr to read the Objects
+    uint32_t GetUncompressedLen() const { return fUncompressedLen; } // Zero if the object is stored raw
 
     //----------------------
     // Allow a keyed object to behave as if it has an active ref when in fact the object
@@ -122,28 +142,42 @@ public:
     plKey   GetCloneByIdx(uint32_t idx);
     plKey   GetCloneOwner() { return fCloneOwner; }
 
+    static uint64_t CloneIndexID(uint32_t playerID, uint32_t cloneID) { return (uint64_t(playerID) << 32) | cloneID; }
+    static uint64_t CloneIndexID(const plKeyImp* key) { return CloneIndexID(key->fUoid.GetClonePlayerID(), key->fUoid.GetCloneID()); }
+
     void NotifyCreated();
     void ISetupNotify(plRefMsg* msg, plRefFlags::Type flags); // Setup notifcations for reference, don't send anything.
 
     void        AddRef(plKeyImp* key) const;
-    uint16_t      GetNumRefs() const { return fRefs.GetCount(); }
+    uint32_t    GetNumRefs() const { return uint32_t(fRefs.size()); }
     plKeyImp*   GetRef(int i) const { return fRefs[i]; }
     void        RemoveRef(plKeyImp *key) const;
 
-    virtual uint16_t      GetActiveRefs() const           { return fNumActiveRefs; }
-    virtual uint16_t      GetNumNotifyCreated() const     { return fNotifyCreated.GetCount(); }
+    virtual uint32_t    GetActiveRefs() const           { return fNumActiveRefs; }
+    virtual uint32_t    GetNumNotifyCreated() const     { return uint32_t(fNotifyCreated.size()); }
     virtual plRefMsg*   GetNotifyCreated(int i) const   { return fNotifyCreated[i]; }
     virtual const hsBitVector& GetActiveBits() const    { return fActiveRefs; }
 
+    // Lists longer than this get a reverse index
+    enum { kIndexThreshold = 16 };
+
 protected:
     void        AddNotifyCreated(plRefMsg* msg, plRefFlags::Type flags);
     void        ClearNotifyCreated();
-    uint16_t      GetNumNotifyCreated() { return fNotifyCreated.GetCount(); }
+    uint32_t    GetNumNotifyCreated() { return uint32_t(fNotifyCreated.size()); }
     plRefMsg*   GetNotifyCreated(int i) { return fNotifyCreated[i]; }
     void        RemoveNotifyCreated(int i);
 
-    uint16_t      IncActiveRefs() { return ++fNumActiveRefs; }
-    uint16_t      DecActiveRefs() { return fNumActiveRefs ? --fNumActiveRefs : 0; }
+    // Slots in fNotifyCreated whose message goes to rcv, in the order they were added
+    int         IFindNotifyCreated(const plKeyImp* rcv) const;
+    void        IFindNotifyCreated(const plKeyImp* rcv, std::vector<uint32_t>& slots) const;
+
+    void        IIndexNotifyCreated(uint32_t i);
+    void        IIndexRef(uint32_t i) const;
+    void        IIndexClone(uint32_t i) const;
+
+    uint32_t    IncActiveRefs() { return ++fNumActiveRefs; }
+    uint32_t    DecActiveRefs() { return fNumActiveRefs ? --fNumActiveRefs : 0; }
 
     bool    IsActiveRef(int i) const            { return fActiveRefs.IsBitSet(i) != 0; }
     void    SetActiveRef(int i, bool on=true) { fActiveRefs.SetBit(i, on); }
@@ -165,16 +199,22 @@ protected:
     plUoid fUoid;
     uint32_t fStartPos;   // where I live in the Datafile  
     uint32_t fDataLen;    // Length in the Datafile
+    uint32_t fUncompressedLen; // Length once uncompressed, or zero if it's stored raw
 
     // Following used by hsResMgr to notify on defered load or when a passive ref is destroyed.
-    uint16_t                      fNumActiveRefs; // num active refs on me
-    hsBitVector                 fActiveRefs;    // Which of notify created are active refs
-    hsBitVector                 fNotified;      // which of notifycreated i've already notified.
-    hsTArray<plRefMsg*>         fNotifyCreated; // people to notify when I'm created or destroyed
-    mutable hsTArray<plKeyImp*> fRefs;          // refs I've made (to be released when I'm unregistered).
-    mutable int16_t               fPendingRefs;   // Outstanding requests I have out.
-    mutable hsTArray<plKeyImp*> fClones;        // clones of me
-    mutable plKey               fCloneOwner;    // pointer for clones back to the owning key
+    uint32_t                        fNumActiveRefs; // num active refs on me
+    hsBitVector                     fActiveRefs;    // Which of notify created are active refs
+    hsBitVector                     fNotified;      // which of notifycreated i've already notified.
+    std::vector<plRefMsg*>          fNotifyCreated; // people to notify when I'm created or destroyed
+    mutable std::vector<plKeyImp*>  fRefs;          // refs I've made (to be released when I'm unregistered).
+    mutable int32_t                 fPendingRefs;   // Outstanding requests I have out.
+    mutable std::vector<plKeyImp*>  fClones;        // clones of me
+    mutable plKey                   fCloneOwner;    // pointer for clones back to the owning key
+
+    // Reverse indexes, nil until their list passes kIndexThreshold
+    std::unique_ptr<plKeySlotIndex>             fNotifyIdx; // receiver -> slots in fNotifyCreated
+    mutable std::unique_ptr<plKeySlotIndex>     fRefIdx;    // target -> slots in fRefs
+    mutable std::unique_ptr<plKeyCloneIndex>    fCloneIdx;  // player/clone ID -> slot in fClones
 };
 
 #endif // hsRegistry_inc
@@ -63,7 +63,8 @@ bool plCoordinateInterface::fDelayedTransformsEnabled = true;
 
 plCoordinateInterface::plCoordinateInterface()
 : fParent(nil),
-  fReason(kReasonUnknown)
+  fReason(kReasonUnknown),
+  fTree(nil)
 {
     fLocalToParent.Reset();
     fParentToLocal.Reset();
@@ -81,6 +82,8 @@ plCoordinateInterface::~plCoordinateInterface()
     int i;
     for( i = fChildren.GetCount()-1; i >= 0; i-- )
         IRemoveChild(i);
+    if( fTree )
+        plTransformHierarchy::Instance()->IReleaseTree(this);
 }
 
 void plCoordinateInterface::ISetSceneNode(plKey newNode)
@@ -103,8 +106,14 @@ void plCoordinateInterface::ISetOwner(plSceneObject* so)
 
 void plCoordinateInterface::ISetParent(plCoordinateInterface* par)
 {
+    IDirtyTreeLayout();
     fParent = par;
 
+    // Only roots keep a flat tree
+    if( fParent && fTree )
+        plTransformHierarchy::Instance()->IReleaseTree(this);
+    IDirtyTreeLayout();
+
     // This won't have any effect if my owner is NetGroupConstant
     if( fParent )
         ISetNetGroupRecur(fParent->GetNetGroup());
@@ -127,6 +136,7 @@ void plCoordinateInterface::IRemoveChild(int i)
             childCI->ISetParent(nil);
     }
     fChildren.Remove(i);
+    IDirtyTreeLayout();
 }
 
 void plCoordinateInterface::IRemoveChild(plSceneObject* child)
@@ -147,6 +157,7 @@ void plCoordinateInterface::ISetChild(plSceneObject* child, int which)
         which = fChildren.GetCount();
     fChildren.ExpandAndZero(which+1);
     fChildren[which] = child;
+    IDirtyTreeLayout();
 
     // If we can't delay our transform update, neither can any of our parents.
     if (!childCI->GetProperty(kDelayedTransformEval))
@@ -262,7 +273,10 @@ void plCoordinateInterface::IRegisterForTransformMessage(bool delayed)
 {
     if( IGetOwner() )
     {
-        if ((delayed || fTransformPhase == kTransformPhaseDelayed) && fDelayedTransformsEnabled)
+        delayed = (delayed || fTransformPhase == kTransformPhaseDelayed) && fDelayedTransformsEnabled;
+        if( plTransformHierarchy::GetEnabled() )
+            plTransformHierarchy::Instance()->IQueue(this, delayed);
+        else if( delayed )
             plgDispatch::Dispatch()->RegisterForExactType(plDelayedTransformMsg::Index(), IGetOwner()->GetKey());
         else
             plgDispatch::Dispatch()->RegisterForExactType(plTransformMsg::Index(), IGetOwner()->GetKey());
@@ -283,6 +297,14 @@ void plCoordinateInterface::IDirtyTransform()
     IGetRoot()->IRegisterForTransformMessage(GetProperty(kDelayedTransformEval));
 }
 
+// Called whenever a parent or child link changes under our root
+void plCoordinateInterface::IDirtyTreeLayout()
+{
+    plCoordinateInterface* root = IGetRoot();
+    if( root->fTree )
+        plTransformHierarchy::Instance()->IDirtyLayout(root);
+}
+
 void plCoordinateInterface::MultTransformLocal(const hsMatrix44& move, const hsMatrix44& invMove)
 {
     fReason |= kReasonUnknown;
@@ -479,14 +501,7 @@ void plCoordinateInterface::ITransformChanged(bool force, uint16_t reasons, bool
     if( force )
     {
         IRecalcTransforms();
-
-        plProfile_IncCount(CISet, 1);
-        plProfile_BeginTiming(CISetT);
-        if( IGetOwner() )
-        {
-            IGetOwner()->ISetTransform(fLocalToWorld, fWorldToLocal);
-        }
-        plProfile_EndTiming(CISetT);
+        ISendTransform();
         fState &= ~kTransformDirty;     
     }
 
@@ -513,9 +528,22 @@ void plCoordinateInterface::ITransformChanged(bool force, uint16_t reasons, bool
     }       
 }
 
+void plCoordinateInterface::ISendTransform()
+{
+    plProfile_IncCount(CISet, 1);
+    plProfile_BeginTiming(CISetT);
+    if( IGetOwner() )
+    {
+        IGetOwner()->ISetTransform(fLocalToWorld, fWorldToLocal);
+    }
+    plProfile_EndTiming(CISetT);
+}
+
 void plCoordinateInterface::FlushTransform(bool fromRoot)
 {
-    if( fromRoot )
+    if( fromRoot && plTransformHierarchy::GetEnabled() )
+        plTransformHierarchy::Instance()->IFlushNow(IGetRoot());
+    else if( fromRoot )
         IGetRoot()->ITransformChanged(false, 0, false);
     else
         ITransformChanged(false, 0, false);
@@ -48,6 +48,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsTemplates.h"
 #include "hsMatrix44.h"
 #include "pnNetCommon/plSynchedValue.h"
+#include "plTransformHierarchy.h"
 
 class hsStream;
 class hsResMgr;
@@ -108,6 +109,8 @@ protected:
     hsMatrix44                              fLocalToWorld;
     hsMatrix44                              fWorldToLocal;
 
+    plTransformHierarchy::Tree*             fTree;      // our flat hierarchy, if we're a root that has moved
+
     virtual void ISetOwner(plSceneObject* so);
 
     virtual void ISetParent(plCoordinateInterface* par); // don't use, use AddChild on parent
@@ -130,11 +133,14 @@ protected:
     virtual void ITransformChanged(bool force, uint16_t reasons, bool checkForDelay); // called by SceneObject on TransformChanged messsage
 
     void                    IDirtyTransform();
+    void                    IDirtyTreeLayout();
+    void                    ISendTransform();
     void                    IRegisterForTransformMessage(bool delayed);
     void                    IUnRegisterForTransformMessage();
     plCoordinateInterface*  IGetRoot();
 
     friend class plSceneObject;
+    friend class plTransformHierarchy;
 
 public:
     plCoordinateInterface();
@@ -0,0 +1,546 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "hsWorkerPool.h"
+#include "plTransformHierarchy.h"
+#include "plCoordinateInterface.h"
+
+#include <algorithm>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+#include "plProfile.h"
+
+// Below this many recalcs in one flush it isn't worth waking up any extra threads
+static const uint32_t kMinParallelRecalcs = 4096;
+
+bool plTransformHierarchy::fEnabled = false;
+bool plTransformHierarchy::fParallel = false;
+
+plProfile_CreateCounter("   CIFlatTrees", "Object", CIFlatTrees);
+plProfile_CreateCounter("   CIFlatRecalc", "Object", CIFlatRecalc);
+plProfile_CreateCounter("   CIFlatLayout", "Object", CIFlatLayout);
+plProfile_CreateTimer("   CIFlatMulT", "Object", CIFlatMulT);
+
+///////////////////////////////////////////////////////////////////////////////
+
+static inline void IPack(plTransformHierarchy::Matrix34& dst, const hsMatrix44& src)
+{
+    memcpy(dst.fMap, src.fMap, sizeof(dst.fMap));
+}
+
+static inline void IUnpack(hsMatrix44& dst, const plTransformHierarchy::Matrix34& src)
+{
+    // same as the IMatrixMul34 result in plCoordinateInterface
+    dst.NotIdentity();
+    memcpy(dst.fMap, src.fMap, sizeof(src.fMap));
+    dst.fMap[3][0] = dst.fMap[3][1] = dst.fMap[3][2] = 0;
+    dst.fMap[3][3] = 1.f;
+}
+
+static inline void IMul34(plTransformHierarchy::Matrix34& ret,
+                          const plTransformHierarchy::Matrix34& lhs,
+                          const plTransformHierarchy::Matrix34& rhs)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        ret.fMap[i][0] = lhs.fMap[i][0] * rhs.fMap[0][0]
+            + lhs.fMap[i][1] * rhs.fMap[1][0]
+            + lhs.fMap[i][2] * rhs.fMap[2][0];
+
+        ret.fMap[i][1] = lhs.fMap[i][0] * rhs.fMap[0][1]
+            + lhs.fMap[i][1] * rhs.fMap[1][1]
+            + lhs.fMap[i][2] * rhs.fMap[2][1];
+
+        ret.fMap[i][2] = lhs.fMap[i][0] * rhs.fMap[0][2]
+            + lhs.fMap[i][1] * rhs.fMap[1][2]
+            + lhs.fMap[i][2] * rhs.fMap[2][2];
+
+        ret.fMap[i][3] = lhs.fMap[i][0] * rhs.fMap[0][3]
+            + lhs.fMap[i][1] * rhs.fMap[1][3]
+            + lhs.fMap[i][2] * rhs.fMap[2][3]
+            + lhs.fMap[i][3];
+    }
+}
+
+static void mul_batch_fpu(const uint32_t* recalc, uint32_t count, const int32_t* parents,
+                          const plTransformHierarchy::Matrix34* l2p, const plTransformHierarchy::Matrix34* p2l,
+                          plTransformHierarchy::Matrix34* l2w, plTransformHierarchy::Matrix34* w2l)
+{
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = recalc[n];
+        int32_t p = parents[i];
+        if (p < 0)
+        {
+            l2w[i] = l2p[i];
+            w2l[i] = p2l[i];
+            continue;
+        }
+        IMul34(l2w[i], l2w[p], l2p[i]);
+        IMul34(w2l[i], p2l[i], w2l[p]);
+    }
+}
+
+#ifdef HS_SSE1
+// Each result row is a weighted sum of the right hand rows, plus the
+// translation which only the left hand side contributes.
+#   define MUL34ROW(ret, lhs, r, r0, r1, r2) \
+        _mm_storeu_ps(ret.fMap[r], \
+            _mm_add_ps( \
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lhs.fMap[r][0]), r0), \
+                           _mm_mul_ps(_mm_set1_ps(lhs.fMap[r][1]), r1)), \
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(lhs.fMap[r][2]), r2), \
+                           _mm_set_ps(lhs.fMap[r][3], 0.f, 0.f, 0.f))));
+
+static inline void IMul34_sse1(plTransformHierarchy::Matrix34& ret,
+                               const plTransformHierarchy::Matrix34& lhs,
+                               const plTransformHierarchy::Matrix34& rhs)
+{
+    __m128 r0 = _mm_loadu_ps(rhs.fMap[0]);
+    __m128 r1 = _mm_loadu_ps(rhs.fMap[1]);
+    __m128 r2 = _mm_loadu_ps(rhs.fMap[2]);
+
+    MUL34ROW(ret, lhs, 0, r0, r1, r2);
+    MUL34ROW(ret, lhs, 1, r0, r1, r2);
+    MUL34ROW(ret, lhs, 2, r0, r1, r2);
+}
+#endif  // HS_SSE1
+
+static void mul_batch_sse1(const uint32_t* recalc, uint32_t count, const int32_t* parents,
+                           const plTransformHierarchy::Matrix34* l2p, const plTransformHierarchy::Matrix34* p2l,
+                           plTransformHierarchy::Matrix34* l2w, plTransformHierarchy::Matrix34* w2l)
+{
+#ifdef HS_SSE1
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t i = recalc[n];
+        int32_t p = parents[i];
+        if (p < 0)
+        {
+            l2w[i] = l2p[i];
+            w2l[i] = p2l[i];
+            continue;
+        }
+        IMul34_sse1(l2w[i], l2w[p], l2p[i]);
+        IMul34_sse1(w2l[i], p2l[i], w2l[p]);
+    }
+#endif  // HS_SSE1
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plTransformHierarchy::mul_batch_ptr> plTransformHierarchy::mul_batch {
+    &mul_batch_fpu,
+    &mul_batch_sse1
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+plTransformHierarchy::Tree::Tree(plCoordinateInterface* root)
+    : fRoot(root), fLayoutDirty(true), fForceAll(false), fBusy(false), fHasCustom(false)
+{
+    fQueued[kPhaseNormal] = fQueued[kPhaseDelayed] = false;
+}
+
+plTransformHierarchy* plTransformHierarchy::Instance()
+{
+    static plTransformHierarchy gInstance;
+    return &gInstance;
+}
+
+plTransformHierarchy::~plTransformHierarchy()
+{
+    // Whatever interfaces are left at shutdown have already been torn down
+    // or never will be, so just drop the trees.
+    IFreeReleased();
+}
+
+void plTransformHierarchy::SetEnabled(bool on)
+{
+    if (fEnabled && !on)
+    {
+        // Nobody is registered for the transform messages for these, so
+        // settle them now.
+        Instance()->Flush(kPhaseNormal);
+        Instance()->Flush(kPhaseDelayed);
+    }
+    fEnabled = on;
+}
+
+plTransformHierarchy::Tree* plTransformHierarchy::IGetTree(plCoordinateInterface* root)
+{
+    hsAssert(!root->fParent, "Transform trees belong to roots");
+    if (!root->fTree)
+        root->fTree = new Tree(root);
+    return root->fTree;
+}
+
+void plTransformHierarchy::IQueue(plCoordinateInterface* root, bool delayed)
+{
+    Tree* tree = IGetTree(root);
+    Phase phase = delayed ? kPhaseDelayed : kPhaseNormal;
+    if (!tree->fQueued[phase])
+    {
+        tree->fQueued[phase] = true;
+        fQueues[phase].push_back(tree);
+    }
+}
+
+void plTransformHierarchy::IDirtyLayout(plCoordinateInterface* root)
+{
+    if (root->fTree)
+        root->fTree->fLayoutDirty = true;
+}
+
+void plTransformHierarchy::IReleaseTree(plCoordinateInterface* root)
+{
+    Tree* tree = root->fTree;
+    if (!tree)
+        return;
+    root->fTree = nil;
+
+    // The queues and anything mid-flush skip trees without a root,
+    // the memory goes once no flush is running.
+    tree->fRoot = nil;
+    fReleased.push_back(tree);
+    if (!fFlushDepth)
+        IFreeReleased();
+}
+
+void plTransformHierarchy::IFreeReleased()
+{
+    if (fReleased.empty())
+        return;
+
+    for (int phase = 0; phase < kNumPhases; phase++)
+    {
+        std::vector<Tree*>& queue = fQueues[phase];
+        queue.erase(std::remove_if(queue.begin(), queue.end(),
+                                   [](Tree* tree) { return !tree->fRoot; }),
+                    queue.end());
+    }
+    for (Tree* tree : fReleased)
+        delete tree;
+    fReleased.clear();
+}
+
+//
+// Lay the hierarchy under the root out in level order, so that every parent
+// comes before its children.
+//
+void plTransformHierarchy::IBuildLayout(Tree* tree)
+{
+    plProfile_IncCount(CIFlatLayout, 1);
+
+    tree->fNodes.clear();
+    tree->fParents.clear();
+    tree->fHasCustom = false;
+
+    tree->fNodes.push_back(tree->fRoot);
+    tree->fParents.push_back(-1);
+    for (size_t i = 0; i < tree->fNodes.size(); i++)
+    {
+        plCoordinateInterface* ci = tree->fNodes[i];
+        if (ci->ClassIndex() != plCoordinateInterface::Index())
+            tree->fHasCustom = true;
+
+        int j;
+        for (j = 0; j < ci->GetNumChildren(); j++)
+        {
+            plCoordinateInterface* child = ci->GetChild(j);
+            if (child)
+            {
+                tree->fNodes.push_back(child);
+                tree->fParents.push_back((int32_t)i);
+            }
+        }
+    }
+
+    size_t numNodes = tree->fNodes.size();
+    tree->fFlags.resize(numNodes);
+    tree->fReasons.resize(numNodes);
+    tree->fLocalToParent.resize(numNodes);
+    tree->fParentToLocal.resize(numNodes);
+    tree->fLocalToWorld.resize(numNodes);
+    tree->fWorldToLocal.resize(numNodes);
+    tree->fLayoutDirty = false;
+}
+
+//
+// Walk the tree the way plCoordinateInterface::ITransformChanged recurses:
+// pass change reasons down, decide who recalcs, and gather their matrices.
+// Dirty flags are cleared here, so anything that moves after this point
+// stays dirty for the next flush.
+//
+void plTransformHierarchy::IPrepare(Tree* tree, bool checkForDelay)
+{
+    if (tree->fLayoutDirty)
+        IBuildLayout(tree);
+
+    bool delayEnabled = plCoordinateInterface::GetDelayedTransformsEnabled();
+    bool forceAll = tree->fForceAll;
+    tree->fForceAll = false;
+    tree->fRecalc.clear();
+
+    size_t numNodes = tree->fNodes.size();
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        plCoordinateInterface* ci = tree->fNodes[i];
+        int32_t p = tree->fParents[i];
+
+        uint8_t flags = kVisited;
+        bool force = forceAll;
+        if (p >= 0)
+        {
+            uint8_t parentFlags = tree->fFlags[p];
+            if ((parentFlags & (kVisited | kProcess)) != (kVisited | kProcess))
+            {
+                tree->fFlags[i] = 0;
+                continue;
+            }
+            force = (parentFlags & kForce) != 0;
+            ci->fReason |= tree->fReasons[p];
+        }
+        tree->fReasons[i] = ci->fReason;
+
+        if (!(checkForDelay && ci->GetProperty(plCoordinateInterface::kDelayedTransformEval)) || !delayEnabled)
+        {
+            flags |= kProcess;
+            if (ci->fState & plCoordinateInterface::kTransformDirty)
+                force = true;
+        }
+
+        if (force)
+        {
+            flags |= kForce;
+            if (ci->ClassIndex() != plCoordinateInterface::Index())
+                flags |= kCustomRecalc;
+
+            ci->fState &= ~plCoordinateInterface::kTransformDirty;
+            IPack(tree->fLocalToParent[i], ci->fLocalToParent);
+            IPack(tree->fParentToLocal[i], ci->fParentToLocal);
+            tree->fRecalc.push_back((uint32_t)i);
+
+            // A parent that isn't being recalced still has to supply its world
+            if (p >= 0 && !(tree->fFlags[p] & (kForce | kWorldLoaded)))
+            {
+                plCoordinateInterface* parent = tree->fNodes[p];
+                IPack(tree->fLocalToWorld[p], parent->fLocalToWorld);
+                IPack(tree->fWorldToLocal[p], parent->fWorldToLocal);
+                tree->fFlags[p] |= kWorldLoaded;
+            }
+        }
+        tree->fFlags[i] = flags;
+    }
+}
+
+void plTransformHierarchy::IMultiply(Tree* tree, uint32_t begin, uint32_t end)
+{
+    mul_batch.call(tree->fRecalc.data() + begin, end - begin, tree->fParents.data(),
+                   tree->fLocalToParent.data(), tree->fParentToLocal.data(),
+                   tree->fLocalToWorld.data(), tree->fWorldToLocal.data());
+}
+
+//
+// Trees with a custom IRecalcTransforms somewhere in them are multiplied as
+// they are applied instead, since their children depend on what it does.
+//
+void plTransformHierarchy::IMultiplyTrees(Tree* const* trees, size_t numTrees)
+{
+    size_t i;
+    for (i = 0; i < numTrees; i++)
+    {
+        if (!trees[i]->fHasCustom)
+            IMultiply(trees[i], 0, (uint32_t)trees[i]->fRecalc.size());
+    }
+}
+
+//
+// Hand the new transforms to the interfaces and their owners, parents first.
+// Owners react to their new transforms however they like, including moving
+// or reparenting things in this tree; if the layout changes under us, what's
+// left is forced through on the next flush instead.
+//
+void plTransformHierarchy::IApply(Tree* tree, Phase phase)
+{
+    size_t n;
+    for (n = 0; n < tree->fRecalc.size(); n++)
+    {
+        if (!tree->fRoot)
+            break;
+        if (tree->fLayoutDirty)
+        {
+            tree->fForceAll = true;
+            IQueue(tree->fRoot, phase == kPhaseDelayed);
+            break;
+        }
+
+        uint32_t i = tree->fRecalc[n];
+        plCoordinateInterface* ci = tree->fNodes[i];
+        uint8_t flags = tree->fFlags[i];
+
+        if (flags & kCustomRecalc)
+        {
+            ci->IRecalcTransforms();
+            IPack(tree->fLocalToWorld[i], ci->fLocalToWorld);
+            IPack(tree->fWorldToLocal[i], ci->fWorldToLocal);
+        }
+        else
+        {
+            if (tree->fHasCustom)
+                IMultiply(tree, (uint32_t)n, (uint32_t)n + 1);
+
+            if (tree->fParents[i] < 0)
+            {
+                ci->fLocalToWorld = ci->fLocalToParent;
+                ci->fWorldToLocal = ci->fParentToLocal;
+            }
+            else
+            {
+                IUnpack(ci->fLocalToWorld, tree->fLocalToWorld[i]);
+                IUnpack(ci->fWorldToLocal, tree->fWorldToLocal[i]);
+            }
+        }
+
+        ci->ISendTransform();
+
+        // Held back for the delayed pass, but our parent moved
+        if (!(flags & kProcess))
+            ci->IDirtyTransform();
+    }
+
+    tree->fBusy = false;
+}
+
+void plTransformHierarchy::Flush(Phase phase)
+{
+    if (fQueues[phase].empty())
+        return;
+
+    // Anything queued while we work goes to the next flush
+    std::vector<Tree*> trees;
+    trees.swap(fQueues[phase]);
+    fFlushDepth++;
+
+    uint32_t numRecalc = 0;
+    size_t i;
+    for (i = 0; i < trees.size(); i++)
+    {
+        trees[i]->fQueued[phase] = false;
+        if (!trees[i]->fRoot)
+        {
+            trees[i]->fRecalc.clear();
+            continue;
+        }
+        trees[i]->fBusy = true;
+        IPrepare(trees[i], phase == kPhaseNormal);
+        numRecalc += (uint32_t)trees[i]->fRecalc.size();
+    }
+    plProfile_IncCount(CIFlatTrees, (int)trees.size());
+    plProfile_IncCount(CIFlatRecalc, (int)numRecalc);
+
+    plProfile_BeginTiming(CIFlatMulT);
+    uint32_t numThreads = fParallel ? numRecalc / kMinParallelRecalcs : 0;
+    numThreads = std::min(numThreads, (uint32_t)trees.size());
+    if (numThreads > 1)
+        numThreads = std::min(numThreads, hsWorkerPool::Instance().GetNumThreads());
+    if (numThreads > 1)
+    {
+        // Hand each thread a run of trees with about the same amount of work
+        std::vector<size_t> firsts(1, 0);
+        uint32_t perThread = numRecalc / numThreads;
+        uint32_t work = 0;
+        for (i = 0; i + 1 < trees.size() && firsts.size() < numThreads; i++)
+        {
+            work += (uint32_t)trees[i]->fRecalc.size();
+            if (work >= perThread)
+            {
+                firsts.push_back(i + 1);
+                work = 0;
+            }
+        }
+        firsts.push_back(trees.size());
+
+        hsWorkerPool::Instance().Run((uint32_t)(firsts.size() - 1), [&](uint32_t run)
+        {
+            IMultiplyTrees(trees.data() + firsts[run], firsts[run + 1] - firsts[run]);
+        });
+    }
+    else
+        IMultiplyTrees(trees.data(), trees.size());
+    plProfile_EndTiming(CIFlatMulT);
+
+    for (i = 0; i < trees.size(); i++)
+        IApply(trees[i], phase);
+
+    if (!--fFlushDepth)
+        IFreeReleased();
+}
+
+//
+// FlushTransform(true) for a single tree, right now.  If the tree is in
+// the middle of a flush already (an owner asking from its ISetTransform),
+// fall back on the recursive update, which doesn't use the tree's arrays.
+//
+void plTransformHierarchy::IFlushNow(plCoordinateInterface* root)
+{
+    Tree* tree = IGetTree(root);
+    if (tree->fBusy)
+    {
+        // and stop the flush in progress, it may be holding stale matrices now
+        tree->fLayoutDirty = true;
+        root->ITransformChanged(false, 0, false);
+        return;
+    }
+
+    fFlushDepth++;
+    tree->fBusy = true;
+    IPrepare(tree, false);
+    if (!tree->fHasCustom)
+        IMultiply(tree, 0, (uint32_t)tree->fRecalc.size());
+    IApply(tree, kPhaseNormal);
+    if (!--fFlushDepth)
+        IFreeReleased();
+}
@@ -0,0 +1,167 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plTransformHierarchy_inc
+#define plTransformHierarchy_inc
+
+#include "HeadSpin.h"
+#include "hsCpuID.h"
+#include <vector>
+
+class plCoordinateInterface;
+
+//
+// Flat update of coordinate interface hierarchies.
+//
+// Instead of each root registering with the dispatcher for a plTransformMsg
+// whenever anything under it moves, and then recursing through the children
+// one node at a time, dirty roots are queued here per transform phase.  Each
+// root owns a cached tree: its nodes in level order with parent indices, and
+// contiguous 3x4 local and world matrices.  A flush gathers what is dirty,
+// multiplies all of it in one batched pass (optionally spread over threads,
+// tree by tree), then hands the results back to the interfaces and their
+// scene objects in order.
+//
+// The plCoordinateInterface API and semantics (delayed evaluation, change
+// reasons) are unchanged; this only replaces how the work gets scheduled.
+//
+class plTransformHierarchy
+{
+public:
+    // Affine rows of an hsMatrix44, the bottom row is always 0,0,0,1
+    struct Matrix34
+    {
+        float fMap[3][4];
+    };
+
+    enum Phase
+    {
+        kPhaseNormal,
+        kPhaseDelayed,
+
+        kNumPhases
+    };
+
+protected:
+    enum NodeFlags
+    {
+        kVisited        = 0x1,  // our parent was processed, so we were looked at
+        kProcess        = 0x2,  // not held back for the delayed pass
+        kForce          = 0x4,  // recalc this node
+        kWorldLoaded    = 0x8,  // world matrices are in the tree's arrays
+        kCustomRecalc   = 0x10, // subclass overrides IRecalcTransforms
+    };
+
+    struct Tree
+    {
+        plCoordinateInterface*              fRoot;          // nil once released
+        bool                                fLayoutDirty;
+        bool                                fForceAll;
+        bool                                fBusy;
+        bool                                fHasCustom;
+        bool                                fQueued[kNumPhases];
+
+        std::vector<plCoordinateInterface*> fNodes;         // level order, root first
+        std::vector<int32_t>                fParents;       // -1 for the root
+        std::vector<uint8_t>                fFlags;
+        std::vector<uint16_t>               fReasons;       // reasons passed on to children
+        std::vector<uint32_t>               fRecalc;        // nodes to recalc this flush, parents first
+
+        std::vector<Matrix34>               fLocalToParent;
+        std::vector<Matrix34>               fParentToLocal;
+        std::vector<Matrix34>               fLocalToWorld;
+        std::vector<Matrix34>               fWorldToLocal;
+
+        Tree(plCoordinateInterface* root);
+    };
+
+    static bool                 fEnabled;
+    static bool                 fParallel;
+
+    std::vector<Tree*>          fQueues[kNumPhases];
+    std::vector<Tree*>          fReleased;      // freed once nothing is flushing
+    int                         fFlushDepth;
+
+    plTransformHierarchy() : fFlushDepth(0) { }
+    ~plTransformHierarchy();
+
+    Tree*   IGetTree(plCoordinateInterface* root);
+    void    IBuildLayout(Tree* tree);
+    void    IPrepare(Tree* tree, bool checkForDelay);
+    void    IMultiply(Tree* tree, uint32_t begin, uint32_t end);
+    void    IMultiplyTrees(Tree* const* trees, size_t numTrees);
+    void    IApply(Tree* tree, Phase phase);
+    void    IFreeReleased();
+
+    // Called by plCoordinateInterface
+    void    IQueue(plCoordinateInterface* root, bool delayed);
+    void    IFlushNow(plCoordinateInterface* root);
+    void    IReleaseTree(plCoordinateInterface* root);
+    void    IDirtyLayout(plCoordinateInterface* root);
+
+    friend class plCoordinateInterface;
+
+public:
+    static plTransformHierarchy* Instance();
+
+    // Update every tree queued for this phase.  Called by the client where it
+    // used to send plTransformMsg and plDelayedTransformMsg.
+    void Flush(Phase phase);
+
+    // Off by default, roots register for the transform messages instead
+    static bool GetEnabled() { return fEnabled; }
+    static void SetEnabled(bool on);
+
+    // Multiply independent trees on worker threads when a flush is big enough
+    static bool GetParallel() { return fParallel; }
+    static void SetParallel(bool on) { fParallel = on; }
+
+    //  CPU-optimized functions
+    // For each of the count nodes listed in recalc, parents first:
+    //      l2w[i] = l2w[parent] * l2p[i],  w2l[i] = p2l[i] * w2l[parent]
+    // or a copy of the locals for the root.
+    typedef void(*mul_batch_ptr)(const uint32_t* recalc, uint32_t count, const int32_t* parents,
+                                 const Matrix34* l2p, const Matrix34* p2l, Matrix34* l2w, Matrix34* w2l);
+    static hsCpuFunctionDispatcher<mul_batch_ptr> mul_batch;
+};
+
+#endif // plTransformHierarchy_inc
@@ -47,98 +47,174 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnKeyedObject/plFixedKey.h"
 #include "hsTimer.h"
 
-plTimerCallbackManager::plTimerCallbackManager() 
+#include <algorithm>
+
+plTimerCallbackManager::plTimerCallbackManager()
+    : fNextSerial(0)
 {
 }
 
 plTimerCallbackManager::~plTimerCallbackManager()
 {
-    while (fCallbacks.GetCount() > 0)
-        delete fCallbacks.Pop();
+    for (plTimerCallback* callback : fCallbacks)
+        delete callback;
 }
 
 bool plTimerCallbackManager::MsgReceive(plMessage* msg)
 {
     plTimeMsg* pTimeMsg = plTimeMsg::ConvertNoRef(msg);
-    int i = fCallbacks.Count();
-    if (pTimeMsg )
+    if (pTimeMsg)
     {
-        if(i)
-        {
-            i--;
-            if (pTimeMsg->GetTimeStamp() >= fCallbacks[i]->fTime)
-            {
-                plgDispatch::MsgSend( fCallbacks[i]->fMsg );
-
-                // Set it nil so the TimerCallback destructor doesn't unRef it
-                fCallbacks[i]->fMsg = nil; 
-
-                delete(fCallbacks[i]);
-                fCallbacks.SetCount(i);
-            }
-        }
+        FireCallbacks(pTimeMsg->GetTimeStamp());
         return true;
     }
     return hsKeyedObject::MsgReceive(msg);
 }
 
+void plTimerCallbackManager::FireCallbacks(double time)
+{
+    // Take each one out before sending, in case whoever gets it adds or
+    // cancels timers on the spot.  Anything added while we're at it waits
+    // for the next tick, so a callback that sets itself up again can't keep
+    // us here.
+    uint32_t serialLimit = fNextSerial;
+    while (!fCallbacks.empty() && time >= fCallbacks[0]->fTime && fCallbacks[0]->fSerial < serialLimit)
+    {
+        plTimerCallback* callback = fCallbacks[0];
+        IRemove(callback);
+
+        plgDispatch::MsgSend(callback->fMsg);
+
+        // Set it nil so the TimerCallback destructor doesn't unRef it
+        callback->fMsg = nil;
+        delete callback;
+    }
+}
+
 plTimerCallback* plTimerCallbackManager::NewTimer(float time, plMessage* pMsg)
 {
     plTimerCallback* t = new plTimerCallback( hsTimer::GetSysSeconds() + time, pMsg );
-    fCallbacks.Append(t); 
-    // sort them
-    for (int i = 0; i < fCallbacks.Count(); i++)
+    t->fSerial = fNextSerial++;
+    t->fHeapIdx = fCallbacks.size();
+    fCallbacks.push_back(t);
+    ISiftUp(t->fHeapIdx);
+
+    // A message can list the same receiver more than once, index it once
+    for (uint32_t i = 0; i < pMsg->GetNumReceivers(); i++)
     {
-        for (int j = i + 1; j < fCallbacks.Count(); j++)
-        {
-#if 0
-            float a = fCallbacks[i]->fTime;
-            float b = fCallbacks[j]->fTime;
-#endif
-            if (fCallbacks[i]->fTime < fCallbacks[j]->fTime)
-            {
-                plTimerCallback* pTemp = fCallbacks[i];
-                fCallbacks[i] = fCallbacks[j];
-                fCallbacks[j] = pTemp;
-            }
-        }
+        plKeyImp* rKey = (plKeyImp*)pMsg->GetReceiver(i);
+        if (!rKey)
+            continue;
+        std::vector<plTimerCallback*>& callbacks = fByReceiver[rKey];
+        if (callbacks.empty() || callbacks.back() != t)
+            callbacks.push_back(t);
     }
     return t;
 }
 
 bool plTimerCallbackManager::CancelCallback(plTimerCallback* pTimer)
 {
-    for (int i = 0; i < fCallbacks.Count(); i++)
+    if (!pTimer || pTimer->fHeapIdx >= fCallbacks.size() || fCallbacks[pTimer->fHeapIdx] != pTimer)
+        return false;
+
+    IRemove(pTimer);
+    delete pTimer;
+    return true;
+}
+
+bool plTimerCallbackManager::CancelCallbacksToKey(const plKey& key)
+{
+    ReceiverMap::iterator it = fByReceiver.find((plKeyImp*)key);
+    if (it == fByReceiver.end())
+        return false;
+
+    // One at a time off the live list, since IRemove() edits it (and drops
+    // it from the map once it's empty)
+    while (it != fByReceiver.end() && !it->second.empty())
     {
-        if (fCallbacks[i] == pTimer)
-        {   fCallbacks.Remove(i);
-            return true;
-        }
+        plTimerCallback* callback = it->second.back();
+        it->second.pop_back();
+        IRemove(callback);
+        delete callback;
+        it = fByReceiver.find((plKeyImp*)key);
     }
-    return false;
+    if (it != fByReceiver.end())
+        fByReceiver.erase(it);
+    return true;
 }
 
-bool plTimerCallbackManager::CancelCallbacksToKey(const plKey& key)
+//// Heap ////////////////////////////////////////////////////////////////////
+
+void plTimerCallbackManager::ISiftUp(size_t idx)
+{
+    plTimerCallback* callback = fCallbacks[idx];
+    while (idx > 0)
+    {
+        size_t parent = (idx - 1) / 2;
+        if (!IFiresBefore(callback, fCallbacks[parent]))
+            break;
+        fCallbacks[idx] = fCallbacks[parent];
+        fCallbacks[idx]->fHeapIdx = idx;
+        idx = parent;
+    }
+    fCallbacks[idx] = callback;
+    callback->fHeapIdx = idx;
+}
+
+void plTimerCallbackManager::ISiftDown(size_t idx)
 {
-    bool removed = false;
+    plTimerCallback* callback = fCallbacks[idx];
+    size_t count = fCallbacks.size();
+    for (;;)
+    {
+        size_t child = idx * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && IFiresBefore(fCallbacks[child + 1], fCallbacks[child]))
+            child++;
+        if (!IFiresBefore(fCallbacks[child], callback))
+            break;
+        fCallbacks[idx] = fCallbacks[child];
+        fCallbacks[idx]->fHeapIdx = idx;
+        idx = child;
+    }
+    fCallbacks[idx] = callback;
+    callback->fHeapIdx = idx;
+}
 
-    for (int i = fCallbacks.Count() - 1; i >= 0 ; i--)
+void plTimerCallbackManager::IRemove(plTimerCallback* pTimer)
+{
+    if (pTimer->fHeapIdx == size_t(-1))
+        return;
+
+    // Out of the heap: the last one takes its place and moves whichever way
+    // it needs to
+    size_t idx = pTimer->fHeapIdx;
+    plTimerCallback* last = fCallbacks.back();
+    fCallbacks.pop_back();
+    if (last != pTimer)
     {
-        for (int j = 0; j < fCallbacks[i]->fMsg->GetNumReceivers(); j++)
-        {
-            const plKey rKey = fCallbacks[i]->fMsg->GetReceiver(j);
-            
-            if (rKey == key)
-            {
-                delete fCallbacks[i];
-                fCallbacks.Remove(i);
-                removed = true;
-                break;
-            }
-        }
+        fCallbacks[idx] = last;
+        last->fHeapIdx = idx;
+        if (idx > 0 && IFiresBefore(last, fCallbacks[(idx - 1) / 2]))
+            ISiftUp(idx);
+        else
+            ISiftDown(idx);
     }
+    pTimer->fHeapIdx = size_t(-1);
 
-    return removed;
+    // ...and out of the receiver index
+    for (uint32_t i = 0; pTimer->fMsg && i < pTimer->fMsg->GetNumReceivers(); i++)
+    {
+        ReceiverMap::iterator it = fByReceiver.find((plKeyImp*)pTimer->fMsg->GetReceiver(i));
+        if (it == fByReceiver.end())
+            continue;
+
+        std::vector<plTimerCallback*>& callbacks = it->second;
+        callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), pTimer), callbacks.end());
+        if (callbacks.empty())
+            fByReceiver.erase(it);
+    }
 }
 
 void plTimerCallbackManager::Read(hsStream* stream, hsResMgr* mgr)
@@ -152,7 +228,9 @@ void plTimerCallbackManager::Write(hsStream* stream, hsResMgr* mgr)
 
 plTimerCallback::plTimerCallback(double time, plMessage* pMsg) :
 fTime(time),
-fMsg(pMsg)
+fMsg(pMsg),
+fSerial(0),
+fHeapIdx(size_t(-1))
 {
 }
 
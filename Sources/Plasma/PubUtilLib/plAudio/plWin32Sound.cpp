@@ -65,7 +65,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #    include <unistd.h>
 #endif
 
-plProfile_CreateMemCounter("Sounds", "Memory", MemSounds);
+plProfile_CreateMemCounterTagged("Sounds", "Memory", MemSounds, kMemTagAudio);
 plProfile_Extern(SoundPlaying);
 
 plWin32Sound::plWin32Sound() :
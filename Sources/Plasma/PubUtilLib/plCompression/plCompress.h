@@ -60,6 +60,9 @@ public:
     // in place versions
     virtual bool Uncompress(uint8_t** bufIn, uint32_t* bufLenIn, uint32_t maxBufLenOut, int offset=0) = 0;
     virtual bool Compress(uint8_t** bufIn, uint32_t* bufLenIn, int offset=0) = 0;
+
+    // largest output Compress can produce for bufLenIn bytes
+    virtual uint32_t GetMaxCompressedSize(uint32_t bufLenIn) const = 0;
 };
 
 
@@ -0,0 +1,297 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include "plLZ4Compress.h"
+
+#include <cstring>
+
+// LZ4 block format: each sequence is a token (literal length << 4 | match length - 4),
+// extended literal length, literals, a 16-bit little endian offset and extended match
+// length.  The last sequence is literals only.
+static const uint32_t kMinMatch = 4;
+static const uint32_t kLastLiterals = 5;     // the last 5 bytes are always literals
+static const uint32_t kMatchFindLimit = 12;  // no match may start this close to the end
+static const uint32_t kMaxOffset = 0xFFFF;
+static const uint32_t kSkipTrigger = 6;      // skip ahead faster through incompressible data
+
+static inline uint32_t IRead32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t IHash(uint32_t sequence, int hashLog)
+{
+    return (sequence * 2654435761U) >> (32 - hashLog);
+}
+
+static inline uint8_t* IWriteLength(uint8_t* op, uint32_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static inline uint8_t* IWriteLiterals(uint8_t* op, const uint8_t* literals, uint32_t len, uint8_t& token)
+{
+    if (len >= 15)
+    {
+        token = 15 << 4;
+        op = IWriteLength(op, len - 15);
+    }
+    else
+        token = (uint8_t)(len << 4);
+    memcpy(op, literals, len);
+    return op + len;
+}
+
+static inline bool IReadLength(const uint8_t*& ip, const uint8_t* iend, uint32_t& len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= iend)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+plLZ4Compress::plLZ4Compress()
+    : fHashBase(1)
+{
+    memset(fHashTable, 0, sizeof(fHashTable));
+}
+
+bool plLZ4Compress::Compress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn)
+{
+    // Bounds are only checked once up front, so the caller has to leave room for the worst case
+    hsAssert(*bufLenOut >= GetMaxCompressedSize(bufLenIn), "bufOut compress buffer is not large enough");
+    if (*bufLenOut < GetMaxCompressedSize(bufLenIn))
+        return false;
+
+    // Positions are stored relative to fHashBase so the table never needs clearing between
+    // calls.  It starts at 1 so the zeroed table doesn't point at the start of the input.
+    if (fHashBase > 0x80000000 || bufLenIn > 0x80000000 - fHashBase)
+    {
+        memset(fHashTable, 0, sizeof(fHashTable));
+        fHashBase = 1;
+        if (bufLenIn >= 0x80000000)
+            return false;
+    }
+    const uint32_t base = fHashBase;
+    fHashBase += bufLenIn + 1;
+
+    const uint8_t* ip = bufIn;
+    const uint8_t* anchor = bufIn;
+    const uint8_t* const iend = bufIn + bufLenIn;
+    uint8_t* op = bufOut;
+    uint8_t token;
+
+    if (bufLenIn > kMatchFindLimit)
+    {
+        const uint8_t* const mflimit = iend - kMatchFindLimit;
+        const uint8_t* const matchlimit = iend - kLastLiterals;
+
+        while (ip < mflimit)
+        {
+            // Find a match
+            uint32_t sequence = IRead32(ip);
+            uint32_t& entry = fHashTable[IHash(sequence, kHashLog)];
+            uint32_t pos = (uint32_t)(ip - bufIn);
+            uint32_t candidate = entry;
+            entry = base + pos;
+
+            if (candidate < base || pos - (candidate - base) > kMaxOffset ||
+                IRead32(bufIn + (candidate - base)) != sequence)
+            {
+                ip += 1 + ((ip - anchor) >> kSkipTrigger);
+                continue;
+            }
+            const uint8_t* match = bufIn + (candidate - base);
+
+            // Extend it both ways
+            while (ip > anchor && match > bufIn && ip[-1] == match[-1])
+            {
+                ip--;
+                match--;
+            }
+            const uint8_t* mend = ip + kMinMatch;
+            while (mend < matchlimit && *mend == match[mend - ip])
+                mend++;
+
+            // Emit the sequence
+            uint8_t* tokenPos = op++;
+            op = IWriteLiterals(op, anchor, (uint32_t)(ip - anchor), token);
+
+            uint32_t offset = (uint32_t)(ip - match);
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            uint32_t matchLen = (uint32_t)(mend - ip) - kMinMatch;
+            if (matchLen >= 15)
+            {
+                token |= 15;
+                op = IWriteLength(op, matchLen - 15);
+            }
+            else
+                token |= (uint8_t)matchLen;
+            *tokenPos = token;
+
+            // Prime the table with the end of the match, it often starts the next one
+            ip = mend;
+            anchor = ip;
+            if (ip < mflimit)
+                fHashTable[IHash(IRead32(ip - 2), kHashLog)] = base + (uint32_t)(ip - 2 - bufIn);
+        }
+    }
+
+    // Last literals
+    uint8_t* tokenPos = op++;
+    op = IWriteLiterals(op, anchor, (uint32_t)(iend - anchor), token);
+    *tokenPos = token;
+
+    *bufLenOut = (uint32_t)(op - bufOut);
+    return true;
+}
+
+bool plLZ4Compress::Uncompress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn)
+{
+    const uint8_t* ip = bufIn;
+    const uint8_t* const iend = bufIn + bufLenIn;
+    uint8_t* op = bufOut;
+    uint8_t* const oend = bufOut + *bufLenOut;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        uint32_t literalLen = token >> 4;
+        if (literalLen == 15 && !IReadLength(ip, iend, literalLen))
+            return false;
+        if (literalLen > (uint32_t)(iend - ip) || literalLen > (uint32_t)(oend - op))
+            return false;
+        memcpy(op, ip, literalLen);
+        ip += literalLen;
+        op += literalLen;
+
+        // The last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - bufOut))
+            return false;
+
+        uint32_t matchLen = token & 15;
+        if (matchLen == 15 && !IReadLength(ip, iend, matchLen))
+            return false;
+        matchLen += kMinMatch;
+        if (matchLen > (uint32_t)(oend - op))
+            return false;
+
+        const uint8_t* match = op - offset;
+        if (offset >= matchLen)
+            memcpy(op, match, matchLen);
+        else
+        {
+            // Overlapping copy repeats the last offset bytes
+            for (uint32_t i = 0; i < matchLen; i++)
+                op[i] = match[i];
+        }
+        op += matchLen;
+    }
+
+    *bufLenOut = (uint32_t)(op - bufOut);
+    return true;
+}
+
+//
+// In place version
+// offset is how much to skip over when compressing
+//
+bool plLZ4Compress::Compress(uint8_t** bufIn, uint32_t* bufLenIn, int offset)
+{
+    uint32_t adjBufLenIn = *bufLenIn - offset;
+    uint32_t bufLenOut = GetMaxCompressedSize(adjBufLenIn);
+    uint8_t* bufOut = new uint8_t[offset + bufLenOut];
+
+    if (!Compress(bufOut + offset, &bufLenOut, *bufIn + offset, adjBufLenIn) || bufLenOut >= adjBufLenIn)
+    {
+        delete [] bufOut;
+        return false;
+    }
+
+    memcpy(bufOut, *bufIn, offset);
+    delete [] *bufIn;
+    *bufIn = bufOut;
+    *bufLenIn = bufLenOut + offset;
+    return true;
+}
+
+//
+// In place version
+//
+bool plLZ4Compress::Uncompress(uint8_t** bufIn, uint32_t* bufLenIn, uint32_t bufLenOut, int offset)
+{
+    uint8_t* bufOut = new uint8_t[offset + bufLenOut];
+
+    if (!Uncompress(bufOut + offset, &bufLenOut, *bufIn + offset, *bufLenIn - offset))
+    {
+        delete [] bufOut;
+        return false;
+    }
+
+    memcpy(bufOut, *bufIn, offset);
+    delete [] *bufIn;
+    *bufIn = bufOut;
+    *bufLenIn = bufLenOut + offset;
+    return true;
+}
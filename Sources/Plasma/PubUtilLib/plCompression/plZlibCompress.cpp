@@ -44,24 +44,74 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsMemory.h"
 #include "hsStream.h"
 
+plZlibCompress::~plZlibCompress()
+{
+    if (fDeflateStream)
+    {
+        deflateEnd(fDeflateStream);
+        delete fDeflateStream;
+    }
+    if (fInflateStream)
+    {
+        inflateEnd(fInflateStream);
+        delete fInflateStream;
+    }
+}
+
 bool plZlibCompress::Uncompress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn)
 {
-    unsigned long buflen_out = *bufLenOut;
-    bool result = (uncompress(bufOut, &buflen_out, bufIn, bufLenIn) == Z_OK);
-    *bufLenOut = buflen_out;
+    if (fInflateStream)
+        inflateReset(fInflateStream);
+    else
+    {
+        fInflateStream = new z_stream();
+        if (inflateInit(fInflateStream) != Z_OK)
+        {
+            delete fInflateStream;
+            fInflateStream = nullptr;
+            return false;
+        }
+    }
+
+    fInflateStream->next_in = const_cast<Bytef*>(bufIn);
+    fInflateStream->avail_in = bufLenIn;
+    fInflateStream->next_out = bufOut;
+    fInflateStream->avail_out = *bufLenOut;
+    bool result = (inflate(fInflateStream, Z_FINISH) == Z_STREAM_END);
+    *bufLenOut = fInflateStream->total_out;
     return result;
 }
 
 bool plZlibCompress::Compress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn)
 {
-    // according to compress doc, the bufOut buffer should be at least .1% larger than source buffer, plus 12 bytes.
-    hsAssert(*bufLenOut>=(int)(bufLenIn*1.1+12), "bufOut compress buffer is not large enough");
-    unsigned long buflen_out = *bufLenOut;
-    bool result = (compress(bufOut, &buflen_out, bufIn, bufLenIn) == Z_OK);
-    *bufLenOut = buflen_out;
+    hsAssert(*bufLenOut>=GetMaxCompressedSize(bufLenIn), "bufOut compress buffer is not large enough");
+    if (fDeflateStream)
+        deflateReset(fDeflateStream);
+    else
+    {
+        fDeflateStream = new z_stream();
+        if (deflateInit(fDeflateStream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            delete fDeflateStream;
+            fDeflateStream = nullptr;
+            return false;
+        }
+    }
+
+    fDeflateStream->next_in = const_cast<Bytef*>(bufIn);
+    fDeflateStream->avail_in = bufLenIn;
+    fDeflateStream->next_out = bufOut;
+    fDeflateStream->avail_out = *bufLenOut;
+    bool result = (deflate(fDeflateStream, Z_FINISH) == Z_STREAM_END);
+    *bufLenOut = fDeflateStream->total_out;
     return result;
 }
 
+uint32_t plZlibCompress::GetMaxCompressedSize(uint32_t bufLenIn) const
+{
+    return compressBound(bufLenIn);
+}
+
 //
 // copy bufOut to bufIn, set bufLenIn=bufLenOut
 //
@@ -92,8 +142,7 @@ bool plZlibCompress::Compress(uint8_t** bufIn, uint32_t* bufLenIn, int offset)
     uint32_t adjBufLenIn = *bufLenIn - offset;
     uint8_t* adjBufIn = *bufIn + offset;
 
-    // according to compress doc, the bufOut buffer should be at least .1% larger than source buffer, plus 12 bytes.
-    uint32_t bufLenOut = (int)(adjBufLenIn*1.1+12);
+    uint32_t bufLenOut = GetMaxCompressedSize(adjBufLenIn);
     char* bufOut = new char[bufLenOut];
     
     bool ok=(Compress((uint8_t*)bufOut, &bufLenOut, (uint8_t*)adjBufIn, adjBufLenIn) && 
@@ -45,12 +45,20 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plCompress.h"
 
 class hsStream;
+struct z_stream_s;
 
 class plZlibCompress : public plCompress
 {
 protected:
+    // deflate/inflate state is kept around, reusing an instance saves reallocating it
+    z_stream_s* fDeflateStream;
+    z_stream_s* fInflateStream;
+
     bool ICopyBuffers(uint8_t** bufIn, uint32_t* bufLenIn, char* bufOut, uint32_t bufLenOut, int offset, bool ok );
 public:
+    plZlibCompress() : fDeflateStream(nullptr), fInflateStream(nullptr) { }
+    ~plZlibCompress();
+
     bool Uncompress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn);
     bool Compress(uint8_t* bufOut, uint32_t* bufLenOut, const uint8_t* bufIn, uint32_t bufLenIn);
 
@@ -58,6 +66,8 @@ public:
     bool Uncompress(uint8_t** bufIn, uint32_t* bufLenIn, uint32_t maxBufLenOut, int offset=0);
     bool Compress(uint8_t** bufIn, uint32_t* bufLenIn, int offset=0);
 
+    uint32_t GetMaxCompressedSize(uint32_t bufLenIn) const;
+
     // .gz versions
     static bool   UncompressFile( const char *compressedPath, const char *destPath );
     static bool   CompressFile( const char *uncompressedPath, const char *destPath );
@@ -298,7 +298,7 @@ void plZlibStream::FastFwd()
     hsAssert(0, "FastFwd not supported");
 }
 
-uint32_t plZlibStream::GetEOF()
+uint64_t plZlibStream::GetEOF()
 {
     hsAssert(0, "GetEOF not supported");
     return 0;
@@ -85,7 +85,7 @@ public:
     virtual void     Skip(uint32_t deltaByteCount);
     virtual void     Rewind();
     virtual void     FastFwd();
-    virtual uint32_t GetEOF();
+    virtual uint64_t GetEOF();
 };
 
 #endif // plZlibStream_h_inc
\ No newline at end of file
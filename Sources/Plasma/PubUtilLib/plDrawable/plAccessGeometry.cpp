@@ -294,6 +294,9 @@ void plAccessGeometry::IOpen(plDrawable* d, uint32_t spanIdx, plAccessSpan& acc,
         {
             plVertexSpan* vtx = (plVertexSpan*)ds->GetSpan(spanIdx);
             ds->DirtyVertexBuffer(vtx->fGroupIdx, vtx->fVBufferIdx);
+
+            if( vtx->fTypeMask & plSpan::kIcicleSpan )
+                ((plIcicle*)vtx)->DirtyTriTree();
         }
 
         if( idxToo && acc.HasAccessTri() )
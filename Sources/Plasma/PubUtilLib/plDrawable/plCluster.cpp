@@ -191,16 +191,13 @@ void plCluster::UnPack(uint8_t* vDst, uint16_t* iDst, int idxOffset, hsBounds3Ex
             GetInst(i).WorldToLocal().GetTranspose(&w2l);
             
             const int numVerts = templ.NumVerts();
+            hsMatrix44::map_points.call(l2w, vDst + posOff, stride, vDst + posOff, stride, numVerts);
+            hsMatrix44::map_vectors.call(w2l, vDst + normOff, stride, vDst + normOff, stride, numVerts);
+
             int iVert;
             for( iVert = 0; iVert < numVerts; iVert++ )
             {
-                hsPoint3* pos = (hsPoint3*)(vDst + posOff);
-                *pos = l2w * *pos;
-                inlTESTPOINT(*pos, minX, minY, minZ, maxX, maxY, maxZ);
-
-                hsVector3* norm = (hsVector3*)(vDst + normOff);
-                *norm = w2l * *norm;
-
+                inlTESTPOINT(*(hsPoint3*)(vDst + posOff), minX, minY, minZ, maxX, maxY, maxZ);
                 vDst += stride;
             }
         }
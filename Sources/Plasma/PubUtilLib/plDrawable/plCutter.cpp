@@ -45,6 +45,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plAccessSpan.h"
 #include "hsFastMath.h"
 #include "plAccessGeometry.h"
+#include "plSpanTriTree.h"
 
 #include "hsStream.h"
 
@@ -58,6 +59,13 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plSurface/hsGMaterial.h"
 #include "plSurface/plLayerInterface.h"
 
+#include <algorithm>
+#include <cfloat>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
 void plCutter::Read(hsStream* stream, hsResMgr* mgr)
 {
     plCreatable::Read(stream, mgr);
@@ -134,6 +142,109 @@ void plCutter::Set(const hsPoint3& pos, const hsVector3& dir, const hsVector3& o
 }
 
 
+static void classify_tris_fpu(const float* pos, int numTris, const float* planes, float* uvw, uint8_t* codes)
+{
+    const int kStride = plCutter::kCutBatch;
+    int iTri;
+    for( iTri = 0; iTri < numTris; iTri++ )
+    {
+        uint8_t code = plCutter::kCutInside;
+        int iAx;
+        for( iAx = 0; iAx < 3; iAx++ )
+        {
+            const float* plane = planes + iAx * 4;
+            int lo = 1;
+            int hi = 1;
+            int iVtx;
+            for( iVtx = 0; iVtx < 3; iVtx++ )
+            {
+                const float* p = pos + iVtx * 3 * kStride + iTri;
+                const float val = p[0] * plane[0] + p[kStride] * plane[1] + p[2 * kStride] * plane[2] - plane[3];
+                uvw[(iVtx * 3 + iAx) * kStride + iTri] = val;
+
+                lo &= val <= 0;
+                hi &= val >= 1.f;
+                if( (val < 0) || (val > 1.f) )
+                    code = plCutter::kCutClip;
+            }
+            if( lo || hi )
+            {
+                code = plCutter::kCutReject;
+                break;
+            }
+        }
+        codes[iTri] = code;
+    }
+}
+
+static void classify_tris_sse1(const float* pos, int numTris, const float* planes, float* uvw, uint8_t* codes)
+{
+#ifdef HS_SSE1
+    const int kStride = plCutter::kCutBatch;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+
+    // The batch arrays are always kCutBatch long, so the last group of four
+    // can run off the end of numTris without going out of bounds.
+    int iTri;
+    for( iTri = 0; iTri < numTris; iTri += 4 )
+    {
+        __m128 reject = zero;
+        __m128 clip = zero;
+        int iAx;
+        for( iAx = 0; iAx < 3; iAx++ )
+        {
+            const float* plane = planes + iAx * 4;
+            const __m128 px = _mm_set1_ps(plane[0]);
+            const __m128 py = _mm_set1_ps(plane[1]);
+            const __m128 pz = _mm_set1_ps(plane[2]);
+            const __m128 pd = _mm_set1_ps(plane[3]);
+
+            __m128 lo = _mm_cmpeq_ps(zero, zero);
+            __m128 hi = lo;
+            int iVtx;
+            for( iVtx = 0; iVtx < 3; iVtx++ )
+            {
+                const float* p = pos + iVtx * 3 * kStride + iTri;
+                __m128 val = _mm_mul_ps(_mm_loadu_ps(p), px);
+                val = _mm_add_ps(val, _mm_mul_ps(_mm_loadu_ps(p + kStride), py));
+                val = _mm_add_ps(val, _mm_mul_ps(_mm_loadu_ps(p + 2 * kStride), pz));
+                val = _mm_sub_ps(val, pd);
+                _mm_storeu_ps(uvw + (iVtx * 3 + iAx) * kStride + iTri, val);
+
+                lo = _mm_and_ps(lo, _mm_cmple_ps(val, zero));
+                hi = _mm_and_ps(hi, _mm_cmpge_ps(val, one));
+                clip = _mm_or_ps(clip, _mm_or_ps(_mm_cmplt_ps(val, zero), _mm_cmpgt_ps(val, one)));
+            }
+            reject = _mm_or_ps(reject, _mm_or_ps(lo, hi));
+        }
+
+        const int rejectBits = _mm_movemask_ps(reject);
+        const int clipBits = _mm_movemask_ps(clip);
+        const int n = std::min(4, numTris - iTri);
+        int i;
+        for( i = 0; i < n; i++ )
+        {
+            codes[iTri + i] = (rejectBits & (1 << i))
+                ? plCutter::kCutReject
+                : (clipBits & (1 << i)) ? plCutter::kCutClip : plCutter::kCutInside;
+        }
+    }
+#endif  // HS_SSE1
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plCutter::classify_tris_ptr> plCutter::classify_tris {
+    &classify_tris_fpu,
+    &classify_tris_sse1,    // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
 inline void plCutter::ISetPosNorm(float parm, const plCutoutVtx& inVtx, const plCutoutVtx& outVtx, plCutoutVtx& dst) const
 {
     dst.fPos = outVtx.fPos;
@@ -273,45 +384,15 @@ inline void plCutter::ICutoutVtxMidW(const plCutoutVtx& inVtx, const plCutoutVtx
     dst.fUVW.fZ = 0.5f;
 }
 
-// IPolyClip
-bool plCutter::IPolyClip(hsTArray<plCutoutVtx>& poly, const hsPoint3 vPos[]) const
+// IClipToBox
+// Clip a poly whose verts already have their UVWs to the unit cube.
+bool plCutter::IClipToBox(hsTArray<plCutoutVtx>& poly) const
 {
     static hsTArray<plCutoutVtx> accum;
     accum.SetCount(0);
 
-    poly[0].fUVW.fX = vPos[0].InnerProduct(fDirU) - fDistU;
-    poly[0].fUVW.fY = vPos[0].InnerProduct(fDirV) - fDistV;
-    poly[0].fUVW.fZ = vPos[0].InnerProduct(fDirW) - fDistW;
-
-    poly[1].fUVW.fX = vPos[1].InnerProduct(fDirU) - fDistU;
-    poly[1].fUVW.fY = vPos[1].InnerProduct(fDirV) - fDistV;
-    poly[1].fUVW.fZ = vPos[1].InnerProduct(fDirW) - fDistW;
-
-    poly[2].fUVW.fX = vPos[2].InnerProduct(fDirU) - fDistU;
-    poly[2].fUVW.fY = vPos[2].InnerProduct(fDirV) - fDistV;
-    poly[2].fUVW.fZ = vPos[2].InnerProduct(fDirW) - fDistW;
-
-    // Try an early out test.
-    int i;
-    for( i = 0; i < 3; i++ )
-    {
-        int lo = 1;
-        int hi = 1;
-        int j;
-        for( j = 0; j < 3; j++ )
-        {
-            lo &= poly[j].fUVW[i] <= 0;
-            hi &= poly[j].fUVW[i] >= 1.f;
-        }
-        if( lo || hi )
-        {
-            poly.SetCount(0);
-            return false;
-        }
-    }
-
-
     // First trim to lower bounds.
+    int i;
     for( i = 0; i < poly.GetCount(); i++ )
     {
         int j = i ? i-1 : poly.GetCount()-1;
@@ -735,160 +816,180 @@ bool plCutter::FindHitPointsConstHeight(const hsTArray<plCutoutPoly>& src, hsTAr
     return false;
 }
 
-void plCutter::ICutoutTransformedConstHeight(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const
-{
-    const hsMatrix44& l2w = src.GetLocalToWorld();
-    hsMatrix44 l2wNorm;
-    src.GetWorldToLocal().GetTranspose(&l2wNorm);
-
-    bool baseHasAlpha = 0 != (src.GetMaterial()->GetLayer(0)->GetBlendFlags() & hsGMatState::kBlendAlpha);
-
-    plAccTriIterator tri(&src.AccessTri());
-    // For each tri
-    for( tri.Begin(); tri.More(); tri.Advance() )
-    {
-        // Do a polygon clip of tri to box
-        static hsTArray<plCutoutVtx> poly;
-        poly.SetCount(3);
-
-        // Not sure about this, whether the constant water height should be world space or local.
-        // We'll leave it in local for now.
-        const hsVector3 up(0, 0, 1.f);
-        hsPoint3 vPos[3];
-        vPos[0] = l2w * hsPoint3(tri.Position(0).fX, tri.Position(0).fY, src.GetWaterHeight());
-        vPos[1] = l2w * hsPoint3(tri.Position(1).fX, tri.Position(1).fY, src.GetWaterHeight());
-        vPos[2] = l2w * hsPoint3(tri.Position(2).fX, tri.Position(2).fY, src.GetWaterHeight());
-
-        poly[0].Init(l2w * hsPoint3(tri.Position(0).fX, tri.Position(0).fY, tri.Position(0).fZ), l2wNorm * up, tri.DiffuseRGBA(0));
-        poly[1].Init(l2w * hsPoint3(tri.Position(1).fX, tri.Position(1).fY, tri.Position(1).fZ), l2wNorm * up, tri.DiffuseRGBA(1));
-        poly[2].Init(l2w * hsPoint3(tri.Position(2).fX, tri.Position(2).fY, tri.Position(2).fZ), l2wNorm * up, tri.DiffuseRGBA(2));
-
-        // If we got a polygon
-        if( IPolyClip(poly, vPos) )
-        {
-            // tessalate the polygon into dst
-            IConstruct(dst, poly, baseHasAlpha);
-        }
-    }
-}
-
-// We usually don't need to do any transform, because the kind of surface you
-// would leave prints on tends to be static, with the transform folded into the
-// verts. So it's worth having 2 separate versions of the function.
-void plCutter::ICutoutTransformed(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const
+// Cutout
+void plCutter::Cutout(plAccessSpan& src, hsTArray<plCutoutPoly>& dst, const plSpanTriTree* tree) const
 {
-    const hsMatrix44& l2w = src.GetLocalToWorld();
-    hsMatrix44 l2wNorm;
-    src.GetWorldToLocal().GetTranspose(&l2wNorm);
+    if( !src.HasAccessTri() )
+        return;
 
     bool baseHasAlpha = 0 != (src.GetMaterial()->GetLayer(0)->GetBlendFlags() & hsGMatState::kBlendAlpha);
 
-    plAccTriIterator tri(&src.AccessTri());
-    // For each tri
-    for( tri.Begin(); tri.More(); tri.Advance() )
-    {
-        // Do a polygon clip of tri to box
-        static hsTArray<plCutoutVtx> poly;
-        poly.SetCount(3);
-
-        hsPoint3 vPos[3];
-        vPos[0] = l2w * tri.Position(0);
-        vPos[1] = l2w * tri.Position(1);
-        vPos[2] = l2w * tri.Position(2);
+    // We usually don't need to do any transform, because the kind of surface you
+    // would leave prints on tends to be static, with the transform folded into the
+    // verts.
+    const bool isIdent = !!(src.GetLocalToWorld().fFlags & hsMatrix44::kIsIdent);
 
-        poly[0].Init(vPos[0], l2wNorm * tri.Normal(0), tri.DiffuseRGBA(0));
-        poly[1].Init(vPos[1], l2wNorm * tri.Normal(1), tri.DiffuseRGBA(1));
-        poly[2].Init(vPos[2], l2wNorm * tri.Normal(2), tri.DiffuseRGBA(2));
+    float waterHeight = 0;
+    if( src.HasWaterHeight() )
+        waterHeight = src.GetWaterHeight();
 
-        // If we got a polygon
-        if( IPolyClip(poly, vPos) )
-        {
-            // tessalate the polygon into dst
-            IConstruct(dst, poly, baseHasAlpha);
-        }
-    }
+    CutoutTris(src.AccessTri(),
+               isIdent ? nil : &src.GetLocalToWorld(),
+               isIdent ? nil : &src.GetWorldToLocal(),
+               src.HasWaterHeight() ? &waterHeight : nil,
+               baseHasAlpha, tree, dst);
 }
 
-void plCutter::ICutoutConstHeight(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const
+void plCutter::IGetCandidates(const plAccessTriSpan& tris, const hsMatrix44* w2l, bool waterHeight,
+                              const plSpanTriTree* tree, std::vector<uint32_t>& cands) const
 {
-    if( !(src.GetLocalToWorld().fFlags & hsMatrix44::kIsIdent) )
+    if( !tree || (tree->GetNumTris() != tris.TriCount()) )
     {
-        ICutoutTransformedConstHeight(src, dst);
+        cands.resize(tris.TriCount());
+        uint32_t i;
+        for( i = 0; i < cands.size(); i++ )
+            cands[i] = i;
         return;
     }
 
-    bool baseHasAlpha = 0 != (src.GetMaterial()->GetLayer(0)->GetBlendFlags() & hsGMatState::kBlendAlpha);
-
-    plAccTriIterator tri(&src.AccessTri());
-    // For each tri
-    for( tri.Begin(); tri.More(); tri.Advance() )
+    // The tree is in the span's local space, so take the box around our
+    // corners there. The corners come from the UVW planes rather than
+    // fWorldBounds, which the approximate normalize in Set leaves a hair
+    // smaller than what the clip keeps.
+    hsMatrix44 worldToUVW;
+    worldToUVW.Reset();
+    int i;
+    for( i = 0; i < 3; i++ )
     {
-        // Do a polygon clip of tri to box
-        static hsTArray<plCutoutVtx> poly;
-        poly.SetCount(3);
-
-        const hsVector3 up(0, 0, 1.f);
+        worldToUVW.fMap[0][i] = fDirU[i];
+        worldToUVW.fMap[1][i] = fDirV[i];
+        worldToUVW.fMap[2][i] = fDirW[i];
+    }
+    worldToUVW.fMap[0][3] = -fDistU;
+    worldToUVW.fMap[1][3] = -fDistV;
+    worldToUVW.fMap[2][3] = -fDistW;
+    worldToUVW.NotIdentity();
+    hsMatrix44 uvwToWorld;
+    worldToUVW.GetInverse(&uvwToWorld);
+
+    hsPoint3 lo(FLT_MAX, FLT_MAX, FLT_MAX);
+    hsPoint3 hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for( i = 0; i < 8; i++ )
+    {
+        const hsPoint3 corner = uvwToWorld * hsPoint3(float(i & 1), float((i >> 1) & 1), float((i >> 2) & 1));
+        const hsPoint3 p = w2l ? *w2l * corner : corner;
+        lo.Set(std::min(lo.fX, p.fX), std::min(lo.fY, p.fY), std::min(lo.fZ, p.fZ));
+        hi.Set(std::max(hi.fX, p.fX), std::max(hi.fY, p.fY), std::max(hi.fZ, p.fZ));
+    }
 
-        hsPoint3 vPos[3];
-        vPos[0].Set(tri.Position(0).fX, tri.Position(0).fY, src.GetWaterHeight());
-        vPos[1].Set(tri.Position(1).fX, tri.Position(1).fY, src.GetWaterHeight());
-        vPos[2].Set(tri.Position(2).fX, tri.Position(2).fY, src.GetWaterHeight());
+    // Water gets clipped flattened to its height, so how high the verts
+    // really are doesn't matter.
+    if( waterHeight )
+    {
+        lo.fZ = -FLT_MAX;
+        hi.fZ = FLT_MAX;
+    }
 
-        poly[0].Init(hsPoint3(tri.Position(0).fX, tri.Position(0).fY, tri.Position(0).fZ), up, tri.DiffuseRGBA(0));
-        poly[1].Init(hsPoint3(tri.Position(1).fX, tri.Position(1).fY, tri.Position(1).fZ), up, tri.DiffuseRGBA(1));
-        poly[2].Init(hsPoint3(tri.Position(2).fX, tri.Position(2).fY, tri.Position(2).fZ), up, tri.DiffuseRGBA(2));
+    tree->Overlap(lo, hi, cands);
 
-        // If we got a polygon
-        if( IPolyClip(poly, vPos) )
-        {
-            // tessalate the polygon into dst
-            IConstruct(dst, poly, baseHasAlpha);
-        }
-    }
+    // Back into span order, so the polys come out the same as without a tree.
+    std::sort(cands.begin(), cands.end());
 }
 
-// Cutout
-void plCutter::Cutout(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const
+void plCutter::CutoutTris(plAccessTriSpan& tris, const hsMatrix44* l2w, const hsMatrix44* w2l, const float* waterHeight,
+                          bool baseHasAlpha, const plSpanTriTree* tree, hsTArray<plCutoutPoly>& dst) const
 {
-    if( !src.HasAccessTri() )
+    static std::vector<uint32_t> cands;
+    IGetCandidates(tris, w2l, waterHeight != nil, tree, cands);
+    if( cands.empty() )
         return;
 
-    if( src.HasWaterHeight() )
-    {
-        ICutoutConstHeight(src, dst);
-        return;
-    }
+    hsMatrix44 l2wNorm;
+    if( w2l )
+        w2l->GetTranspose(&l2wNorm);
 
-    if( !(src.GetLocalToWorld().fFlags & hsMatrix44::kIsIdent) )
-    {
-        ICutoutTransformed(src, dst);
-        return;
-    }
+    const float planes[12] = {
+        fDirU.fX, fDirU.fY, fDirU.fZ, fDistU,
+        fDirV.fX, fDirV.fY, fDirV.fZ, fDistV,
+        fDirW.fX, fDirW.fY, fDirW.fZ, fDistW
+    };
 
-    bool baseHasAlpha = 0 != (src.GetMaterial()->GetLayer(0)->GetBlendFlags() & hsGMatState::kBlendAlpha);
+    // Positions to clip against, which for water are flattened to its
+    // height, and their UVWs, [corner][axis][tri].
+    float pos[3][3][kCutBatch];
+    float uvw[3][3][kCutBatch];
+    uint8_t codes[kCutBatch];
+
+    // Not sure about this, whether the constant water height should be world space or local.
+    // We'll leave it in local for now.
+    const hsVector3 up(0, 0, 1.f);
 
-    plAccTriIterator tri(&src.AccessTri());
-    // For each tri
-    for( tri.Begin(); tri.More(); tri.Advance() )
+    plAccTriIterator tri(&tris);
+
+    uint32_t base;
+    for( base = 0; base < cands.size(); base += kCutBatch )
     {
-        // Do a polygon clip of tri to box
-        static hsTArray<plCutoutVtx> poly;
-        poly.SetCount(3);
+        const int numTris = int(std::min<size_t>(kCutBatch, cands.size() - base));
 
-        hsPoint3 vPos[3];
-        vPos[0] = tri.Position(0);
-        vPos[1] = tri.Position(1);
-        vPos[2] = tri.Position(2);
+        int iTri;
+        for( iTri = 0; iTri < numTris; iTri++ )
+        {
+            tri.SetTri(cands[base + iTri]);
+            int iVtx;
+            for( iVtx = 0; iVtx < 3; iVtx++ )
+            {
+                hsPoint3 vPos = tri.Position(iVtx);
+                if( waterHeight )
+                    vPos.fZ = *waterHeight;
+                if( l2w )
+                    vPos = *l2w * vPos;
+                pos[iVtx][0][iTri] = vPos.fX;
+                pos[iVtx][1][iTri] = vPos.fY;
+                pos[iVtx][2][iTri] = vPos.fZ;
+            }
+        }
 
-        poly[0].Init(vPos[0], tri.Normal(0), tri.DiffuseRGBA(0));
-        poly[1].Init(vPos[1], tri.Normal(1), tri.DiffuseRGBA(1));
-        poly[2].Init(vPos[2], tri.Normal(2), tri.DiffuseRGBA(2));
+        classify_tris.call(&pos[0][0][0], numTris, planes, &uvw[0][0][0], codes);
 
-        // If we got a polygon
-        if( IPolyClip(poly, vPos) )
+        for( iTri = 0; iTri < numTris; iTri++ )
         {
-            // tessalate the polygon into dst
-            IConstruct(dst, poly, baseHasAlpha);
+            if( codes[iTri] == kCutReject )
+                continue;
+
+            tri.SetTri(cands[base + iTri]);
+
+            // Do a polygon clip of tri to box
+            static hsTArray<plCutoutVtx> poly;
+            poly.SetCount(3);
+
+            int iVtx;
+            for( iVtx = 0; iVtx < 3; iVtx++ )
+            {
+                plCutoutVtx& vtx = poly[iVtx];
+                if( waterHeight )
+                {
+                    if( l2w )
+                        vtx.Init(*l2w * tri.Position(iVtx), l2wNorm * up, tri.DiffuseRGBA(iVtx));
+                    else
+                        vtx.Init(tri.Position(iVtx), up, tri.DiffuseRGBA(iVtx));
+                }
+                else
+                {
+                    const hsPoint3 vPos(pos[iVtx][0][iTri], pos[iVtx][1][iTri], pos[iVtx][2][iTri]);
+                    if( l2w )
+                        vtx.Init(vPos, l2wNorm * tri.Normal(iVtx), tri.DiffuseRGBA(iVtx));
+                    else
+                        vtx.Init(vPos, tri.Normal(iVtx), tri.DiffuseRGBA(iVtx));
+                }
+                vtx.fUVW.Set(uvw[iVtx][0][iTri], uvw[iVtx][1][iTri], uvw[iVtx][2][iTri]);
+            }
+
+            // If we got a polygon
+            if( (codes[iTri] == kCutInside) || IClipToBox(poly) )
+            {
+                // tessalate the polygon into dst
+                IConstruct(dst, poly, baseHasAlpha);
+            }
         }
     }
 }
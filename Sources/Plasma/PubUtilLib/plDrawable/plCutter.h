@@ -50,6 +50,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsBounds.h"
 #include "plIntersect/plVolumeIsect.h"
 #include "hsColorRGBA.h"
+#include "hsCpuID.h"
+
+#include <vector>
 
 struct hsPoint3;
 struct hsVector3;
@@ -57,6 +60,8 @@ struct hsVector3;
 class plPrintCollect;
 class plAccTriIterator;
 class plAccessSpan;
+class plAccessTriSpan;
+class plSpanTriTree;
 
 class plCutoutHit
 {
@@ -102,6 +107,18 @@ public:
 
 class plCutter : public plCreatable
 {
+public:
+    enum
+    {
+        kCutBatch       = 64    // Triangles classified per call to classify_tris
+    };
+    enum
+    {
+        kCutReject      = 0,    // Entirely outside one of the cutter's faces
+        kCutClip        = 1,
+        kCutInside      = 2     // Nothing to clip
+    };
+
 protected:
 
     // Permanent attributes
@@ -122,7 +139,7 @@ protected:
     plBoundsIsect   fIsect;
 
     void            IConstruct(hsTArray<plCutoutPoly>& dst, hsTArray<plCutoutVtx>& poly, bool baseHasAlpha) const;
-    bool            IPolyClip(hsTArray<plCutoutVtx>& poly, const hsPoint3 vPos[]) const;
+    bool            IClipToBox(hsTArray<plCutoutVtx>& poly) const;
     
     inline void     ICutoutVtxHiU(const plCutoutVtx& inVtx, const plCutoutVtx& outVtx, plCutoutVtx& dst) const;
     inline void     ICutoutVtxHiV(const plCutoutVtx& inVtx, const plCutoutVtx& outVtx, plCutoutVtx& dst) const;
@@ -138,9 +155,8 @@ protected:
 
     inline void     ISetPosNorm(float parm, const plCutoutVtx& inVtx, const plCutoutVtx& outVtx, plCutoutVtx& dst) const;
 
-    void            ICutoutTransformed(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const;
-    void            ICutoutConstHeight(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const;
-    void            ICutoutTransformedConstHeight(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const;
+    void            IGetCandidates(const plAccessTriSpan& tris, const hsMatrix44* w2l, bool waterHeight,
+                                   const plSpanTriTree* tree, std::vector<uint32_t>& cands) const;
 
 
 public:
@@ -159,7 +175,20 @@ public:
 
     void        Set(const hsPoint3& pos, const hsVector3& dir, const hsVector3& out, bool flip=false);
 
-    void        Cutout(plAccessSpan& src, hsTArray<plCutoutPoly>& dst) const;
+    /**
+     * Clip the span's triangles to the cutter, appending what's left to dst.
+     * With a tree over the span's triangles only the ones under the cutter
+     * are looked at, otherwise every one is.
+     */
+    void        Cutout(plAccessSpan& src, hsTArray<plCutoutPoly>& dst, const plSpanTriTree* tree = nil) const;
+
+    /**
+     * The guts of Cutout, for callers with the triangles in hand. l2w and w2l
+     * are nil when the verts are already in world space, and waterHeight nil
+     * unless the span has one.
+     */
+    void        CutoutTris(plAccessTriSpan& tris, const hsMatrix44* l2w, const hsMatrix44* w2l, const float* waterHeight,
+                           bool baseHasAlpha, const plSpanTriTree* tree, hsTArray<plCutoutPoly>& dst) const;
     bool        CutoutGrid(int nWid, int nLen, plFlatGridMesh& dst) const;
 
     void        SetLength(const hsVector3& s) { fLengthU = s.fX; fLengthV = s.fY; fLengthW = s.fZ; }
@@ -173,6 +202,14 @@ public:
 
     static bool MakeGrid(int nWid, int nLen, const hsPoint3& center, const hsVector3& halfU, const hsVector3& halfV, plFlatGridMesh& grid);
 
+    //  CPU-optimized functions
+    // Works out the cutter space UVW of each corner of numTris triangles, pos
+    // and uvw being laid out [corner][axis][kCutBatch], and a kCut code for
+    // each triangle. planes holds the U, V and W directions, each followed by
+    // its distance.
+    typedef void(*classify_tris_ptr)(const float* pos, int numTris, const float* planes, float* uvw, uint8_t* codes);
+    static hsCpuFunctionDispatcher<classify_tris_ptr> classify_tris;
+
 };
 
 #endif // plCutter_inc
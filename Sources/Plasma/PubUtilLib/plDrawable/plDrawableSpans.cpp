@@ -55,6 +55,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 //////////////////////////////////////////////////////////////////////////////
 
 #include "HeadSpin.h"
+#include "hsWorkerPool.h"
 
 #include "plAccessSpan.h"
 #include "plAccessTriSpan.h"
@@ -73,8 +74,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plCluster.h"
 #include "plSpanTemplate.h"
 #include "plGBufferGroup.h"
+#include "plFaceSorter.h"
 
-#include "plMath/hsRadixSort.h"
 #include "plSurface/hsGMaterial.h"
 #include "plSurface/plLayerInterface.h"
 #include "plPipeline/plFogEnvironment.h"
@@ -129,6 +130,9 @@ plDrawableSpans::plDrawableSpans() :
 
     fSkinTime = 0;
 
+    fPresortedVisList = nil;
+    fPresortedSerial = 0;
+
     fType = kNormal;
     fMaterials.Reset();
 
@@ -416,66 +420,6 @@ bool plDrawableSpans::IBoundsInvalid(const hsBounds3Ext& bnd) const
 }
 
 //// SetTransform ////////////////////////////////////////////////////////////
-static inline hsMatrix44 IMatrixMul34(const hsMatrix44& lhs, const hsMatrix44& rhs)
-{
-    hsMatrix44 ret;
-    ret.NotIdentity();
-    ret.fMap[3][0] = ret.fMap[3][1] = ret.fMap[3][2] = 0;
-    ret.fMap[3][3] = 1.f;
-
-    ret.fMap[0][0] = lhs.fMap[0][0] * rhs.fMap[0][0]
-        + lhs.fMap[0][1] * rhs.fMap[1][0]
-        + lhs.fMap[0][2] * rhs.fMap[2][0];
-
-    ret.fMap[0][1] = lhs.fMap[0][0] * rhs.fMap[0][1]
-        + lhs.fMap[0][1] * rhs.fMap[1][1]
-        + lhs.fMap[0][2] * rhs.fMap[2][1];
-
-    ret.fMap[0][2] = lhs.fMap[0][0] * rhs.fMap[0][2]
-        + lhs.fMap[0][1] * rhs.fMap[1][2]
-        + lhs.fMap[0][2] * rhs.fMap[2][2];
-
-    ret.fMap[0][3] = lhs.fMap[0][0] * rhs.fMap[0][3]
-        + lhs.fMap[0][1] * rhs.fMap[1][3]
-        + lhs.fMap[0][2] * rhs.fMap[2][3]
-        + lhs.fMap[0][3];
-
-    ret.fMap[1][0] = lhs.fMap[1][0] * rhs.fMap[0][0]
-        + lhs.fMap[1][1] * rhs.fMap[1][0]
-        + lhs.fMap[1][2] * rhs.fMap[2][0];
-
-    ret.fMap[1][1] = lhs.fMap[1][0] * rhs.fMap[0][1]
-        + lhs.fMap[1][1] * rhs.fMap[1][1]
-        + lhs.fMap[1][2] * rhs.fMap[2][1];
-
-    ret.fMap[1][2] = lhs.fMap[1][0] * rhs.fMap[0][2]
-        + lhs.fMap[1][1] * rhs.fMap[1][2]
-        + lhs.fMap[1][2] * rhs.fMap[2][2];
-
-    ret.fMap[1][3] = lhs.fMap[1][0] * rhs.fMap[0][3]
-        + lhs.fMap[1][1] * rhs.fMap[1][3]
-        + lhs.fMap[1][2] * rhs.fMap[2][3]
-        + lhs.fMap[1][3];
-
-    ret.fMap[2][0] = lhs.fMap[2][0] * rhs.fMap[0][0]
-        + lhs.fMap[2][1] * rhs.fMap[1][0]
-        + lhs.fMap[2][2] * rhs.fMap[2][0];
-
-    ret.fMap[2][1] = lhs.fMap[2][0] * rhs.fMap[0][1]
-        + lhs.fMap[2][1] * rhs.fMap[1][1]
-        + lhs.fMap[2][2] * rhs.fMap[2][1];
-
-    ret.fMap[2][2] = lhs.fMap[2][0] * rhs.fMap[0][2]
-        + lhs.fMap[2][1] * rhs.fMap[1][2]
-        + lhs.fMap[2][2] * rhs.fMap[2][2];
-
-    ret.fMap[2][3] = lhs.fMap[2][0] * rhs.fMap[0][3]
-        + lhs.fMap[2][1] * rhs.fMap[1][3]
-        + lhs.fMap[2][2] * rhs.fMap[2][3]
-        + lhs.fMap[2][3];
-
-    return ret;
-}
 
 #ifdef MF_TEST_UPDATE
 plProfile_CreateCounter("DSSetTrans", "Update", DSSetTrans);
@@ -517,11 +461,11 @@ plDrawable& plDrawableSpans::SetTransform( uint32_t index, const hsMatrix44& l2w
             plProfile_IncCount(DSMatSpans, spans->GetCount());
             plProfile_BeginTiming(DSMatTransT);
 #endif // MF_TEST_UPDATE
-            for( i = 0; i < spans->GetCount(); i++ )
+            if( spans->GetCount() )
             {
-                fLocalToWorlds[ (*spans)[ i ] ] = IMatrixMul34(l2w, fLocalToBones[ (*spans)[ i ] ]);
-                fWorldToLocals[ (*spans)[ i ] ] = IMatrixMul34(fBoneToLocals[ (*spans)[ i ] ], w2l);
-
+                const uint32_t* idx = &(*spans)[ 0 ];
+                hsMatrix44::mul_34_batch.call(&l2w, 0, fLocalToBones.data(), 1, fLocalToWorlds.data(), idx, spans->GetCount());
+                hsMatrix44::mul_34_batch.call(fBoneToLocals.data(), 1, &w2l, 0, fWorldToLocals.data(), idx, spans->GetCount());
             }
 #ifdef MF_TEST_UPDATE
             plProfile_EndTiming(DSMatTransT);
@@ -1523,94 +1467,48 @@ bool plDrawableSpans::GetSubVisDists(int index, float& minDist, float& maxDist)
 plProfile_CreateTimer("Face Sort", "Draw", FaceSort);
 plProfile_CreateCounter("Face Sort Calls", "Draw", FaceSortCalls);
 plProfile_CreateCounter("Faces Sorted", "Draw", FacesSorted);
+plProfile_CreateTimer("Face Presort", "Draw", FacePresort);
+plProfile_CreateCounter("Face Presort Threads", "Draw", FacePresortThreads);
+
+// Each thread sorts with its own scratch, kept from frame to frame.
+static thread_local plFaceSorter sFaceSorter;
 
 void    plDrawableSpans::SortSpan( uint32_t index, plPipeline *pipe )
 {
     plProfile_Inc(FaceSortCalls);
 
-    plProfile_BeginLap(FaceSort, "0");
+    plProfile_BeginTiming(FaceSort);
 
     plIcicle            *span = (plIcicle *)fSpans[ index ];
-    plGBufferTriangle   *list, temp;
-    uint32_t              numTris;
-    int                 i;
     hsMatrix44          w2cMatrix = pipe->GetWorldToCamera() * pipe->GetLocalToWorld();
-    float            dist;
 
     ICheckSpanForSortable(index);
 
-    static hsTArray<hsRadixSort::Elem>  sortList;
-    static hsTArray<uint16_t>             tempTriList;
-    hsRadixSort::Elem                   *elem;
-
-
-    /// Get some stuff
-    list = span->fSortData;
-    numTris = span->fILength / 3;
+    uint32_t numTris = span->fILength / 3;
 
     plProfile_IncCount(FacesSorted, numTris);
 
     hsAssert( numTris > 0, "How could we start sorting no triangles??" );
 
-    /// Sort the triangles in "list"
-    sortList.SetCount( numTris );
-    tempTriList.SetCount( numTris * 3 );
-    elem = sortList.AcquireArray();
-
-    plProfile_EndLap(FaceSort, "0");
-    plProfile_BeginLap(FaceSort, "1");
-
-    hsVector3 vec(w2cMatrix.fMap[2][0], w2cMatrix.fMap[2][1], w2cMatrix.fMap[2][2]);
-    float trans = w2cMatrix.fMap[2][3];
-
-    // Fill out the radix sort elements with our data
-    for( i = 0; i < numTris; i++ )
-    {
-        dist = vec.InnerProduct(list[ i ].fCenter) + trans;
-        elem[ i ].fKey.fFloat = dist;
-        elem[ i ].fBody = &list[ i ];
-        elem[ i ].fNext = elem + i + 1;
-    }
-    elem[ i - 1 ].fNext = nil;
-
-    plProfile_EndLap(FaceSort, "1");
-    plProfile_BeginLap(FaceSort, "2");
+    /// Sort the triangles on their view space depth
+    plFaceSorter::KeyParams params;
+    params.fViewPos.Set(0, 0, 0);
+    params.fScale = 0;
+    params.fDir.Set(w2cMatrix.fMap[2][0], w2cMatrix.fMap[2][1], w2cMatrix.fMap[2][2]);
+    params.fDist = w2cMatrix.fMap[2][3];
 
-    // Do da sort thingy
-    hsRadixSort         rad;
-    hsRadixSort::Elem   *sortedList = rad.Sort( elem, 0 );
-
-    plProfile_EndLap(FaceSort, "2");
-    plProfile_BeginLap(FaceSort, "3");
-
-    uint16_t* indices = tempTriList.AcquireArray();
-    // Stuff into the temp array
-    for( i = 0, elem = sortedList; i < numTris; i++ )
-    {
-        *indices++ = ((plGBufferTriangle *)elem->fBody)->fIndex1;
-        *indices++ = ((plGBufferTriangle *)elem->fBody)->fIndex2;
-        *indices++ = ((plGBufferTriangle *)elem->fBody)->fIndex3;
-        elem = elem->fNext;
-    }
-
-    plProfile_EndLap(FaceSort, "3");
-    plProfile_BeginLap(FaceSort, "4");
+    sFaceSorter.Reset();
+    sFaceSorter.AddSpan(span->fSortData, numTris, params, false);
+    sFaceSorter.Sort();
 
     /// Now send them on to the buffer group
     fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                  numTris, tempTriList.AcquireArray() );
-
-    /// Optional step in a way: copy back our new, sorted list to our original
-    /// array. This lets us do less sorting next call, since the order should
-    /// remain largely unchanged from the last call. If this turns out NOT to
-    /// be the case, or if the sorting step takes less time than this copy,
-    /// take this out!
-//  memcpy( list, tempTriList.AcquireArray(), numTris * sizeof( plGBufferTriangle ) );
+                                                  numTris, sFaceSorter.GetIndices(0) );
 
     /// All done! (force buffer groups to refresh during next render call)
     fReadyToRender = false;
 
-    plProfile_EndLap(FaceSort, "4");
+    plProfile_EndTiming(FaceSort);
 }
 
 //// SortVisibleSpans ////////////////////////////////////////////////////////
@@ -1620,374 +1518,189 @@ void    plDrawableSpans::SortSpan( uint32_t index, plPipeline *pipe )
 
 void plDrawableSpans::SortVisibleSpans(const hsTArray<int16_t>& visList, plPipeline* pipe)
 {
-#define MF_CHUNKSORT
-#ifndef MF_CHUNKSORT
-
     plProfile_Inc(FaceSortCalls);
 
     if( !visList.GetCount() )
         return;
 
+    // PresortVisibleSpans beat us to it, this time around
+    if( fPresortedVisList == &visList && fPresortedSerial == fPresortSerial )
+    {
+        fPresortedVisList = nil;
+        return;
+    }
+    fPresortedVisList = nil;
 
-    static hsLargeArray<hsRadixSort::Elem>  sortScratch;
-    static hsLargeArray<uint16_t>         triList;
-    static hsTArray<int32_t>              counters;
-    static hsTArray<uint32_t>             startIndex;
-    
-    int i;
-    
     plProfile_BeginTiming(FaceSort);
-    if( pipe->IsDebugFlagSet( plPipeDbg::kFlagDontSortFaces ) )
-    {
-        /// Don't sort, just send unchanged
-        int     j, idx;
 
-        for( i = 0; i < visList.GetCount(); i++ )
-        {
-            plIcicle* span = (plIcicle*)fSpans[visList[i]];
-            ICheckSpanForSortable(visList[i]);
+    bool sortFaces = !pipe->IsDebugFlagSet( plPipeDbg::kFlagDontSortFaces );
+    uint32_t totTris = ISortVisibleFaces(visList, pipe->GetViewPositionWorld(), sortFaces, sFaceSorter);
+    if( sortFaces )
+        plProfile_IncCount(FacesSorted, totTris);
 
-            /// Build a fake list of indices....
-            plGBufferTriangle*      list = span->fSortData;
-            triList.SetCount( span->fILength );
-            for( j = 0, idx = 0; j < span->fILength / 3; j++, idx += 3 )
-            {
-                triList[ idx ] = list[ j ].fIndex1;
-                triList[ idx + 1 ] = list[ j ].fIndex2;
-                triList[ idx + 2 ] = list[ j ].fIndex3;
-            }
-
-            /// Now send them on to the buffer group
-            fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                          span->fILength / 3, triList.AcquireArray() );
-        }
-        fReadyToRender = false;
-        return;
-    }
     plProfile_EndTiming(FaceSort);
+}
 
-    plProfile_BeginLap(FaceSort, "0");
-
-    startIndex.SetCount(fSpans.GetCount());
+uint32_t plDrawableSpans::ISortVisibleFaces(const hsTArray<int16_t>& visList, const hsPoint3& viewPos, bool sortFaces, plFaceSorter& sorter)
+{
+    sorter.Reset();
 
-    // First figure out the total number of tris to deal with.
-    int totTris = 0;
+    int i;
     for( i = 0; i < visList.GetCount(); i++ )
     {
         plIcicle* span = (plIcicle*)fSpans[visList[i]];
+        ICheckSpanForSortable(visList[i]);
 
-        startIndex[visList[i]] = totTris * 3;
-        if( span->fProps & plSpan::kPropReverseSort )
-            startIndex[visList[i]] += span->fILength - 3;
-
-        totTris += span->fILength / 3;
-    }
-    if( totTris == 0 )
-    {
-        plProfile_EndLap(FaceSort, "0");
-        return;
+        sorter.AddSpan(span->fSortData, span->fILength / 3, span->fWorldToLocal * viewPos,
+                       0 != (span->fProps & plSpan::kPropReverseSort));
     }
 
-    plProfile_IncCount(FacesSorted, totTris);
-
-    sortScratch.SetCount(totTris);
-    triList.SetCount(3 * totTris);
+    uint32_t totTris = sorter.Sort(sortFaces);
+    if( !totTris )
+        return 0;
 
-    hsRadixSort::Elem* elem = sortScratch.AcquireArray();
-
-    plProfile_EndLap(FaceSort, "0");
-    plProfile_BeginLap(FaceSort, "1");
-
-    // Pack them into the sort structure. We probably want to make the 
-    // plGBufferTriangle look like plTriSortData (just add span index) 
-    // which would get rid of this copy and help the data alignment.
-    // Oops, I already did.
-    int cnt = 0;
-    for( i = 0; i < visList.GetCount(); i++ )
+    if( !sortFaces )
     {
-        plIcicle* span = (plIcicle*)fSpans[visList[i]];
-        
-        int nTris = span->fILength / 3;
-
-        hsPoint3 viewPos = span->fWorldToLocal * pipe->GetViewPositionWorld();
-
-        plGBufferTriangle*      list = span->fSortData;
-        int j;
-        for( j = 0; j < nTris; j++ )
+        /// Don't sort, just send unchanged
+        for( i = 0; i < visList.GetCount(); i++ )
         {
-            float dist = -(viewPos - list[j].fCenter).MagnitudeSquared();
-            elem[cnt].fKey.fFloat = dist;
-            elem[cnt].fBody = &list[j];
-            elem[cnt].fNext = elem + cnt + 1;
+            plIcicle* span = (plIcicle*)fSpans[visList[i]];
 
-            cnt++;
+            fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
+                                                          span->fILength / 3, sorter.GetIndices(i) );
         }
+        fReadyToRender = false;
+        return totTris;
     }
-    elem[cnt-1].fNext = nil;
-
-    plProfile_EndLap(FaceSort, "1");
-    plProfile_BeginLap(FaceSort, "2");
-
-    // Actual sort
-    hsRadixSort         rad;
-    hsRadixSort::Elem* sortedList = rad.Sort( elem, 0 );
-
-    plProfile_EndLap(FaceSort, "2");
-    plProfile_BeginLap(FaceSort, "3");
-
-    counters.SetCountAndZero(fSpans.GetCount());
-
-    while( sortedList )
-    {
-        plGBufferTriangle* data = (plGBufferTriangle*)sortedList->fBody;
-        plIcicle* span = (plIcicle*)fSpans[data->fSpanIndex];
-
-        uint16_t* idx = &triList[startIndex[data->fSpanIndex] + counters[data->fSpanIndex]];
-        *idx++ = data->fIndex1;
-        *idx++ = data->fIndex2;
-        *idx++ = data->fIndex3;
-        if( span->fProps & plSpan::kPropReverseSort )
-            counters[data->fSpanIndex] -= 3;
-        else
-            counters[data->fSpanIndex] += 3;
-
-        sortedList = sortedList->fNext;
-    }
-
-    plProfile_EndLap(FaceSort, "3");
-    plProfile_BeginLap(FaceSort, "4");
 
+    // Pack the visible spans at the front of their index buffers, in visList
+    // order, so they batch up.
     const int kMaxBufferGroups = 20;
     const int kMaxIndexBuffers = 20;
-    static int16_t    newStarts[kMaxBufferGroups][kMaxIndexBuffers];
+    int16_t   newStarts[kMaxBufferGroups][kMaxIndexBuffers];
 
-    // Temp hack stuff so we can switch back and forth (to see if it really does any good).
-    static int oldWay = false;
-    static int lastOldWay = oldWay;
-    if( oldWay != lastOldWay )
-    {
-        memset(newStarts, 0, kMaxBufferGroups * kMaxIndexBuffers * sizeof(int16_t));
-
-        for( i = 0; i < fSpans.GetCount(); i++ )
-        {
-            plIcicle* span = (plIcicle*)fSpans[i];
-
-            span->fPackedIdx = span->fIStartIdx = newStarts[span->fGroupIdx][span->fIBufferIdx];
-            newStarts[span->fGroupIdx][span->fIBufferIdx] += span->fILength;
-        }
-        lastOldWay = oldWay;
-    }
+    hsAssert(kMaxBufferGroups >= GetNumBufferGroups(), "Bigger than we counted on num groups sort.");
 
-    if( oldWay )
-    {
-        for( i = 0; i < visList.GetCount(); i++ )
-        {
-            plIcicle* span = (plIcicle*)fSpans[visList[i]];
+    memset(newStarts, 0, kMaxBufferGroups * kMaxIndexBuffers * sizeof(int16_t));
 
-            /// Now send them on to the buffer group
-            fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                          span->fILength / 3, triList.AcquireArray() + startIndex[visList[i]]);
-        }
-    }
-    else
+    for( i = 0; i < visList.GetCount(); i++ )
     {
-        memset(newStarts, 0, kMaxBufferGroups * kMaxIndexBuffers * sizeof(int16_t));
+        plIcicle* span = (plIcicle*)fSpans[visList[i]];
 
-        uint32_t start = 0;
-        for( i = 0; i < visList.GetCount(); i++ )
-        {
-            plIcicle* span = (plIcicle*)fSpans[visList[i]];
+        hsAssert(kMaxIndexBuffers > span->fIBufferIdx, "Bigger than we counted on num buffers sort.");
 
-            /// Now send them on to the buffer group
-            span->fPackedIdx = span->fIStartIdx = newStarts[span->fGroupIdx][span->fIBufferIdx];
-            newStarts[span->fGroupIdx][span->fIBufferIdx] += span->fILength;
-            fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                          span->fILength / 3, triList.AcquireArray() + startIndex[visList[i]]);
-        }
+        /// Now send them on to the buffer group
+        span->fIPackedIdx = span->fIStartIdx = newStarts[span->fGroupIdx][span->fIBufferIdx];
+        newStarts[span->fGroupIdx][span->fIBufferIdx] += (int16_t)(span->fILength);
+        fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
+                                                      span->fILength / 3, sorter.GetIndices(i) );
     }
 
-    plProfile_EndLap(FaceSort, "4");
-
     fReadyToRender = false;
 
-    return;
+    return totTris;
+}
 
-#else // MF_CHUNKSORT
+//// PresortVisibleSpans /////////////////////////////////////////////////////
+//  Face sorts a batch of drawables at once, each one's sort being
+//  independent of the others. Below this many faces it isn't worth waking
+//  the worker pool for them.
 
-    plProfile_Inc(FaceSortCalls);
+static const uint32_t kMinParallelFaces = 8192;
 
-    if( !visList.GetCount() )
+bool plDrawableSpans::fPresortFaces = true;
+uint32_t plDrawableSpans::fPresortSerial = 0;
+
+void plDrawableSpans::PresortVisibleSpans(plDrawableSpans* const* drawables, const hsTArray<int16_t>* const* visLists,
+                                          size_t count, const hsPoint3& viewPos)
+{
+    // Anything presorted last time around is stale now, whether or not we
+    // get to sort again.
+    fPresortSerial++;
+    if( !fPresortFaces )
         return;
 
-    plProfile_BeginTiming(FaceSort);
+    plProfile_BeginTiming(FacePresort);
 
-    static std::vector<hsRadixSort::Elem> sortScratch;
-    static std::vector<uint16_t> triList;
-    static std::vector<int32_t> counters;
-    static std::vector<uint32_t> startIndex;
-    
-    int i;
-    
-    if( pipe->IsDebugFlagSet( plPipeDbg::kFlagDontSortFaces ) )
+    size_t i;
+    for( i = 0; i < count; i++ )
+        drawables[i]->fPresortedVisList = nil;
+
+    // Make the spans sortable up front, and only take each drawable once, so
+    // no two threads ever touch the same one.
+    std::vector<plDrawableSpans*> draws;
+    std::vector<const hsTArray<int16_t>*> vis;
+    std::vector<uint32_t> work;
+    uint32_t totTris = 0;
+    for( i = 0; i < count; i++ )
     {
-        /// Don't sort, just send unchanged
-        int     j, idx;
+        plDrawableSpans* drawable = drawables[i];
+        const hsTArray<int16_t>& visList = *visLists[i];
+        if( drawable->fPresortedVisList || !visList.GetCount() )
+            continue;
+        drawable->fPresortedVisList = &visList;
+        drawable->fPresortedSerial = fPresortSerial;
 
-        for( i = 0; i < visList.GetCount(); i++ )
+        uint32_t numTris = 0;
+        int j;
+        for( j = 0; j < visList.GetCount(); j++ )
         {
-            plIcicle* span = (plIcicle*)fSpans[visList[i]];
-            ICheckSpanForSortable(visList[i]);
-
-            /// Build a fake list of indices....
-            plGBufferTriangle*      list = span->fSortData;
-            triList.resize(span->fILength);
-            for( j = 0, idx = 0; j < span->fILength / 3; j++, idx += 3 )
-            {
-                triList[ idx ] = list[ j ].fIndex1;
-                triList[ idx + 1 ] = list[ j ].fIndex2;
-                triList[ idx + 2 ] = list[ j ].fIndex3;
-            }
-
-            /// Now send them on to the buffer group
-            fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                          span->fILength / 3, triList.data() );
+            drawable->ICheckSpanForSortable(visList[j]);
+            numTris += ((plIcicle*)drawable->fSpans[visList[j]])->fILength / 3;
         }
-        fReadyToRender = false;
-        return;
-    }
-
-    plProfile_EndTiming(FaceSort);
-
-    plProfile_BeginLap(FaceSort, "0");
-
-    startIndex.resize(fSpans.GetCount());
-
-    // First figure out the total number of tris to deal with.
-    int totTris = 0;
-    for( i = 0; i < visList.GetCount(); i++ )
-    {
-        plIcicle* span = (plIcicle*)fSpans[visList[i]];
-        ICheckSpanForSortable(visList[i]);
-        
-        startIndex[visList[i]] = totTris * 3;
-        if( span->fProps & plSpan::kPropReverseSort )
-            startIndex[visList[i]] += span->fILength - 3;
-
-
-        totTris += span->fILength / 3;
-    }
-    if( totTris == 0 )
-    {
-        plProfile_EndLap(FaceSort, "0");
-        return;
+        draws.push_back(drawable);
+        vis.push_back(&visList);
+        work.push_back(numTris);
+        totTris += numTris;
     }
-
     plProfile_IncCount(FacesSorted, totTris);
 
-    sortScratch.resize(totTris);
-    triList.resize(3 * totTris);
-
-    hsRadixSort::Elem* elem = sortScratch.data();
-
-    plProfile_EndLap(FaceSort, "0");
-
-    int iVis = 0;
-    while( iVis < visList.GetCount() )
-    {
-        plProfile_BeginLap(FaceSort, "1");
-
-        // Pack them into the sort structure. We probably want to make the 
-        // plGBufferTriangle look like plTriSortData (just add span index) 
-        // which would get rid of this copy and help the data alignment.
-        // Oops, I already did.
-        const int kTriCutoff = 4000;
-        int cnt = 0;
-        while( (iVis < visList.GetCount()) && (cnt < kTriCutoff) )
-        {
-            plIcicle* span = (plIcicle*)fSpans[visList[iVis]];
-            
-            int nTris = span->fILength / 3;
-
-            hsPoint3 viewPos = span->fWorldToLocal * pipe->GetViewPositionWorld();
-
-            plGBufferTriangle*      list = span->fSortData;
-            int j;
-            for( j = 0; j < nTris; j++ )
+    uint32_t numThreads = totTris / kMinParallelFaces;
+    numThreads = std::min(numThreads, (uint32_t)draws.size());
+    if( numThreads > 1 )
+        numThreads = std::min(numThreads, hsWorkerPool::Instance().GetNumThreads());
+    if( numThreads > 1 )
+    {
+        // Hand each thread a run of drawables with about the same number of
+        // faces
+        std::vector<size_t> firsts(1, 0);
+        uint32_t perThread = totTris / numThreads;
+        uint32_t faces = 0;
+        for( i = 0; i + 1 < draws.size() && firsts.size() < numThreads; i++ )
+        {
+            faces += work[i];
+            if( faces >= perThread )
             {
-                float dist = -(viewPos - list[j].fCenter).MagnitudeSquared();
-                elem[cnt].fKey.fFloat = dist;
-                elem[cnt].fBody = &list[j];
-                elem[cnt].fNext = elem + cnt + 1;
-
-                cnt++;
+                firsts.push_back(i + 1);
+                faces = 0;
             }
-            iVis++;
         }
-        elem[cnt-1].fNext = nil;
-
-        plProfile_EndLap(FaceSort, "1");
-        plProfile_BeginLap(FaceSort, "2");
-
-        // Actual sort
-        hsRadixSort         rad;
-        hsRadixSort::Elem* sortedList = rad.Sort( elem, 0 );
-
-        plProfile_EndLap(FaceSort, "2");
-        plProfile_BeginLap(FaceSort, "3");
+        firsts.push_back(draws.size());
 
-        counters.assign(fSpans.GetCount(), 0);
-
-        while( sortedList )
+        // Each thread sorts with its own sFaceSorter
+        hsWorkerPool::Instance().Run(uint32_t(firsts.size() - 1), [&](uint32_t run)
         {
-            plGBufferTriangle* data = (plGBufferTriangle*)sortedList->fBody;
-            plIcicle* span = (plIcicle*)fSpans[data->fSpanIndex];
-
-            uint16_t* idx = &triList[startIndex[data->fSpanIndex] + counters[data->fSpanIndex]];
-            *idx++ = data->fIndex1;
-            *idx++ = data->fIndex2;
-            *idx++ = data->fIndex3;
-            if( span->fProps & plSpan::kPropReverseSort )
-                counters[data->fSpanIndex] -= 3;
-            else
-                counters[data->fSpanIndex] += 3;
-            
-            sortedList = sortedList->fNext;
-        }
+            IPresortRun(draws.data() + firsts[run], vis.data() + firsts[run],
+                        firsts[run + 1] - firsts[run], viewPos, &sFaceSorter);
+        });
 
-        plProfile_EndLap(FaceSort, "3");
+        plProfile_IncCount(FacePresortThreads, int(firsts.size() - 1));
     }
-
-    plProfile_BeginLap(FaceSort, "4");
-
-    const int kMaxBufferGroups = 20;
-    const int kMaxIndexBuffers = 20;
-    static int16_t    newStarts[kMaxBufferGroups][kMaxIndexBuffers];
-
-    hsAssert(kMaxBufferGroups >= GetNumBufferGroups(), "Bigger than we counted on num groups sort.");
-
-    memset(newStarts, 0, kMaxBufferGroups * kMaxIndexBuffers * sizeof(int16_t));
-
-    for( i = 0; i < visList.GetCount(); i++ )
+    else
     {
-        plIcicle* span = (plIcicle*)fSpans[visList[i]];
-
-        hsAssert(kMaxIndexBuffers > span->fIBufferIdx, "Bigger than we counted on num buffers sort.");
-
-        if( span->fProps & plSpan::kPropReverseSort )
-            startIndex[visList[i]] -= span->fILength - 3;
-
-        /// Now send them on to the buffer group
-        span->fIPackedIdx = span->fIStartIdx = newStarts[span->fGroupIdx][span->fIBufferIdx];
-        newStarts[span->fGroupIdx][span->fIBufferIdx] += (int16_t)(span->fILength);
-        fGroups[ span->fGroupIdx ]->StuffFromTriList( span->fIBufferIdx, span->fIStartIdx, 
-                                                      span->fILength / 3, triList.data() + startIndex[visList[i]]);
+        IPresortRun(draws.data(), vis.data(), draws.size(), viewPos, &sFaceSorter);
+        plProfile_Inc(FacePresortThreads);
     }
 
-    plProfile_EndLap(FaceSort, "4");
-
-    fReadyToRender = false;
+    plProfile_EndTiming(FacePresort);
+}
 
-#endif // MF_CHUNKSORT
+void plDrawableSpans::IPresortRun(plDrawableSpans* const* drawables, const hsTArray<int16_t>* const* visLists,
+                                  size_t count, const hsPoint3& viewPos, plFaceSorter* sorter)
+{
+    size_t i;
+    for( i = 0; i < count; i++ )
+        drawables[i]->ISortVisibleFaces(*visLists[i], viewPos, true, *sorter);
 }
 
 struct buffTriCmpBackToFront : public std::binary_function<plGBufferTriangle, plGBufferTriangle, bool>
@@ -78,6 +78,7 @@ class hsGMaterial;
 class plGeometrySpan;
 class plSpaceTree;
 class plFogEnvironment;
+class plFaceSorter;
 class plLightInfo;
 class plGBufferGroup;
 class plParticleCore;
@@ -174,6 +175,15 @@ class plDrawableSpans : public plDrawable
 
         uint32_t              fSkinTime;
 
+        // Set when PresortVisibleSpans has already face sorted this visList
+        // for the coming SortVisibleSpans. Only good while the serial still
+        // matches, since the visLists are reused from frame to frame.
+        const hsTArray<int16_t>*    fPresortedVisList;
+        uint32_t                    fPresortedSerial;
+
+        static bool         fPresortFaces;
+        static uint32_t     fPresortSerial;     // Bumped by every PresortVisibleSpans
+
         /// Export-only members
         hsTArray<plGeometrySpan *>  fSourceSpans;
         bool                        fOptimized;
@@ -209,6 +219,12 @@ class plDrawableSpans : public plDrawable
         void            ICheckSpanForSortable( uint32_t idx ) { if( !(fSpans[idx]->fProps & plSpan::kPropFacesSortable) )IMakeSpanSortable(idx); }
         void            IMakeSpanSortable( uint32_t index );
 
+        // Face sort the spans in visList and stuff them into the index buffers.
+        // Touches nothing outside this drawable but its own sort data and
+        // buffer groups, so different drawables can sort on different threads.
+        uint32_t        ISortVisibleFaces( const hsTArray<int16_t>& visList, const hsPoint3& viewPos, bool sortFaces, plFaceSorter& sorter );
+        static void     IPresortRun( plDrawableSpans* const* drawables, const hsTArray<int16_t>* const* visLists, size_t count, const hsPoint3& viewPos, plFaceSorter* sorter );
+
         /// Bit vector build thingies
         virtual void            IBuildVectors( void );
 
@@ -375,6 +391,18 @@ class plDrawableSpans : public plDrawable
         void            SortSpan( uint32_t index, plPipeline *pipe );
         void            SortVisibleSpans(const hsTArray<int16_t>& visList, plPipeline* pipe);
         void            SortVisibleSpansPartial(const hsTArray<int16_t>& visList, plPipeline* pipe);
+
+        /**
+         * Face sort a batch of drawables ahead of their SortVisibleSpans calls,
+         * spreading them across threads when there are enough faces to make it
+         * worthwhile. The visLists must not change before each drawable's
+         * SortVisibleSpans, which then has nothing left to do. Call it even with
+         * nothing to sort, so last frame's presorts are forgotten. Render thread only.
+         */
+        static void     PresortVisibleSpans(plDrawableSpans* const* drawables, const hsTArray<int16_t>* const* visLists,
+                                            size_t count, const hsPoint3& viewPos);
+        static void     SetPresortFaces(bool on) { fPresortFaces = on; }
+        static bool     GetPresortFaces() { return fPresortFaces; }
         void            CleanUpGarbage( void ) { IRemoveGarbage(); }
 
         /// Funky particle system functions
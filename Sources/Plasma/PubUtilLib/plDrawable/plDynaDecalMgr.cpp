@@ -53,6 +53,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plDrawableSpans.h"
 #include "plAuxSpan.h"
 #include "plSpaceTree.h"
+#include "plSpanTriTree.h"
 
 #include "plPrintShape.h"
 
@@ -1435,6 +1436,26 @@ bool plDynaDecalMgr::ICutoutGrid(plDrawableSpans* drawable, int iSpan, hsGMateri
     return IProcessGrid(drawable, iSpan, mat, secs, grid);
 }
 
+// Spans smaller than this are cut faster by just walking their triangles
+// than by building and querying a tree over them.
+static const uint32_t kMinTrisForTree = 64;
+
+plSpanTriTree* plDynaDecalMgr::IGetTriTree(plDrawableSpans* drawable, int iSpan, plAccessSpan& src) const
+{
+    if( !src.HasAccessTri() || (src.AccessTri().TriCount() < kMinTrisForTree) )
+        return nil;
+
+    if( iSpan >= drawable->GetSpanArray().GetCount() )
+        return nil;
+
+    // Particles are rewritten every frame, no point building a tree over them.
+    plSpan* span = drawable->GetSpanArray()[iSpan];
+    if( (span->fTypeMask & (plSpan::kIcicleSpan | plSpan::kParticleSpan)) != plSpan::kIcicleSpan )
+        return nil;
+
+    return ((plIcicle*)span)->GetTriTree(src.AccessTri());
+}
+
 bool plDynaDecalMgr::ICutoutObject(plSceneObject* so, double secs)
 {
     if( fDisableAccumulate )
@@ -1472,7 +1493,7 @@ bool plDynaDecalMgr::ICutoutObject(plSceneObject* so, double secs)
                         dst.SetCount(0);
 
                         plProfile_BeginTiming(Cutter);
-                        fCutter->Cutout(src, dst);
+                        fCutter->Cutout(src, dst, IGetTriTree(dr, diIndex[k], src));
                         plProfile_EndTiming(Cutter);
 
                         plProfile_BeginTiming(Process);
@@ -1529,9 +1550,10 @@ bool plDynaDecalMgr::ICutoutList(hsTArray<plDrawVisList>& drawVis, double secs)
 
         plAccessGeometry::Instance()->OpenRO(drawVis[iDraw].fDrawable, drawVis[iDraw].fVisList[iSpan], src[i]);
 
-        fCutter->Cutout(src[i], dst);
+        plDrawableSpans* dr = (plDrawableSpans*)drawVis[iDraw].fDrawable;
+        fCutter->Cutout(src[i], dst, IGetTriTree(dr, drawVis[iDraw].fVisList[iSpan], src[i]));
 
-        if( IProcessPolys((plDrawableSpans*)drawVis[iDraw].fDrawable, drawVis[iDraw].fVisList[iSpan], secs, dst) )
+        if( IProcessPolys(dr, drawVis[iDraw].fVisList[iSpan], secs, dst) )
             retVal = true;
 
         plAccessGeometry::Instance()->Close(src[i]);
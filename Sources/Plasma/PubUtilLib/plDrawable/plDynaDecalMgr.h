@@ -76,6 +76,7 @@ class plDrawVisList;
 class plRenderLevel;
 
 class plAccessSpan;
+class plSpanTriTree;
 class plAuxSpan;
 class plDecalVtxFormat;
 
@@ -219,6 +220,7 @@ protected:
     bool                ICutoutGrid(plDrawableSpans* drawable, int iSpan, hsGMaterial* mat, double secs);
     bool                IHitTestFlatGrid(const plFlatGridMesh& grid) const;
 
+    plSpanTriTree*      IGetTriTree(plDrawableSpans* drawable, int iSpan, plAccessSpan& src) const;
     bool                ICutoutList(hsTArray<plDrawVisList>& drawVis, double secs);
     bool                ICutoutObject(plSceneObject* so, double secs);
     bool                ICutoutTargets(double secs);
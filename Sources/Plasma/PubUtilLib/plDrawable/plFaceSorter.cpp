@@ -0,0 +1,276 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "plFaceSorter.h"
+#include "plGBufferGroup.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void face_keys_fpu(const plGBufferTriangle* tris, uint32_t numTris, const plFaceSorter::KeyParams& params, float* keys)
+{
+    uint32_t i;
+    for( i = 0; i < numTris; i++ )
+    {
+        const hsPoint3& c = tris[i].fCenter;
+        hsVector3 del(&c, &params.fViewPos);
+        keys[i] = params.fScale * del.MagnitudeSquared() + params.fDir.InnerProduct(c) + params.fDist;
+    }
+}
+
+static void face_keys_sse1(const plGBufferTriangle* tris, uint32_t numTris, const plFaceSorter::KeyParams& params, float* keys)
+{
+#ifdef HS_SSE1
+    const __m128 px = _mm_set1_ps(params.fViewPos.fX);
+    const __m128 py = _mm_set1_ps(params.fViewPos.fY);
+    const __m128 pz = _mm_set1_ps(params.fViewPos.fZ);
+    const __m128 scale = _mm_set1_ps(params.fScale);
+    const __m128 dx = _mm_set1_ps(params.fDir.fX);
+    const __m128 dy = _mm_set1_ps(params.fDir.fY);
+    const __m128 dz = _mm_set1_ps(params.fDir.fZ);
+    const __m128 dist = _mm_set1_ps(params.fDist);
+
+    // The centers are 20 bytes apart, so gather four and go across them
+    uint32_t i;
+    for( i = 0; i + 4 <= numTris; i += 4 )
+    {
+        const plGBufferTriangle* t = tris + i;
+        __m128 cx = _mm_set_ps(t[3].fCenter.fX, t[2].fCenter.fX, t[1].fCenter.fX, t[0].fCenter.fX);
+        __m128 cy = _mm_set_ps(t[3].fCenter.fY, t[2].fCenter.fY, t[1].fCenter.fY, t[0].fCenter.fY);
+        __m128 cz = _mm_set_ps(t[3].fCenter.fZ, t[2].fCenter.fZ, t[1].fCenter.fZ, t[0].fCenter.fZ);
+
+        __m128 ex = _mm_sub_ps(cx, px);
+        __m128 ey = _mm_sub_ps(cy, py);
+        __m128 ez = _mm_sub_ps(cz, pz);
+        __m128 magSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, dx), _mm_mul_ps(cy, dy)), _mm_mul_ps(cz, dz));
+
+        _mm_storeu_ps(keys + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(scale, magSq), dot), dist));
+    }
+    face_keys_fpu(tris + i, numTris - i, params, keys + i);
+#endif  // HS_SSE1
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plFaceSorter::face_keys_ptr> plFaceSorter::face_keys {
+    &face_keys_fpu,
+    &face_keys_sse1,        // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+void plFaceSorter::AddSpan(const plGBufferTriangle* tris, uint32_t numTris, const hsPoint3& viewPos, bool reverse)
+{
+    KeyParams params;
+    params.fViewPos = viewPos;
+    params.fScale = -1.f;
+    params.fDir.Set(0, 0, 0);
+    params.fDist = 0;
+
+    AddSpan(tris, numTris, params, reverse);
+}
+
+void plFaceSorter::AddSpan(const plGBufferTriangle* tris, uint32_t numTris, const KeyParams& params, bool reverse)
+{
+    hsAssert(fSpans.size() < 0x10000, "Too many spans for one face sort");
+
+    Span span;
+    span.fTris = tris;
+    span.fNumTris = numTris;
+    span.fStart = fNumTris * 3;
+    span.fParams = params;
+    span.fReverse = reverse;
+    fSpans.push_back(span);
+
+    fNumTris += numTris;
+}
+
+uint32_t plFaceSorter::Sort(bool sortFaces)
+{
+    fIndices.resize(fNumTris * 3);
+
+    if( !sortFaces )
+    {
+        uint16_t* idx = fIndices.data();
+        size_t i;
+        for( i = 0; i < fSpans.size(); i++ )
+        {
+            const plGBufferTriangle* iter = fSpans[i].fTris;
+            uint32_t j;
+            for( j = 0; j < fSpans[i].fNumTris; j++ )
+            {
+                *idx++ = iter->fIndex1;
+                *idx++ = iter->fIndex2;
+                *idx++ = iter->fIndex3;
+                iter++;
+            }
+        }
+        return fNumTris;
+    }
+
+    size_t first = 0;
+    while( first < fSpans.size() )
+    {
+        size_t last = first;
+        uint32_t cnt = 0;
+        while( (last < fSpans.size()) && (cnt < kTriCutoff) )
+            cnt += fSpans[last++].fNumTris;
+
+        if( fKeys.size() < cnt )
+        {
+            fKeys.resize(cnt);
+            fOwners.resize(cnt);
+            fFaces.resize(cnt);
+            fItems[0].resize(cnt);
+            fItems[1].resize(cnt);
+        }
+        ISortChunk(first, last);
+
+        first = last;
+    }
+
+    return fNumTris;
+}
+
+// Flip a float's bits so they sort as unsigned ints in the float's order.
+static inline uint32_t ISortableKey(float key)
+{
+    uint32_t bits;
+    memcpy(&bits, &key, sizeof(bits));
+    return bits & 0x80000000 ? ~bits : bits | 0x80000000;
+}
+
+void plFaceSorter::ISortChunk(size_t first, size_t last)
+{
+    float* keys = fKeys.data();
+    uint16_t* owners = fOwners.data();
+    const plGBufferTriangle** faces = fFaces.data();
+    uint64_t* items = fItems[0].data();
+    uint64_t* swap = fItems[1].data();
+
+    uint32_t cnt = 0;
+    size_t i;
+    for( i = first; i < last; i++ )
+    {
+        // Reversed spans fill their run from the back
+        Span& span = fSpans[i];
+        span.fCursor = span.fReverse && span.fNumTris ? span.fStart + (span.fNumTris - 1) * 3 : span.fStart;
+
+        face_keys.call(span.fTris, span.fNumTris, span.fParams, keys + cnt);
+
+        uint32_t j;
+        for( j = 0; j < span.fNumTris; j++ )
+        {
+            faces[cnt] = span.fTris + j;
+            owners[cnt] = uint16_t(i);
+            cnt++;
+        }
+    }
+    if( !cnt )
+        return;
+
+    // Key in the high half, face number in the low, and count every byte
+    // of the keys in one go.
+    uint32_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    uint32_t j;
+    for( j = 0; j < cnt; j++ )
+    {
+        uint32_t key = ISortableKey(keys[j]);
+        items[j] = (uint64_t(key) << 32) | j;
+        counts[0][key & 0xff]++;
+        counts[1][(key >> 8) & 0xff]++;
+        counts[2][(key >> 16) & 0xff]++;
+        counts[3][key >> 24]++;
+    }
+
+    // Stable passes from the low byte up, skipping any byte all the keys share
+    int pass;
+    for( pass = 0; pass < 4; pass++ )
+    {
+        const int shift = 32 + pass * 8;
+        uint32_t* count = counts[pass];
+        if( count[(items[0] >> shift) & 0xff] == cnt )
+            continue;
+
+        uint32_t offset = 0;
+        int b;
+        for( b = 0; b < 256; b++ )
+        {
+            uint32_t n = count[b];
+            count[b] = offset;
+            offset += n;
+        }
+        for( j = 0; j < cnt; j++ )
+            swap[count[(items[j] >> shift) & 0xff]++] = items[j];
+        std::swap(items, swap);
+    }
+
+    for( j = 0; j < cnt; j++ )
+    {
+        uint32_t face = uint32_t(items[j]);
+        const plGBufferTriangle* data = faces[face];
+        Span& span = fSpans[owners[face]];
+
+        uint16_t* idx = &fIndices[span.fCursor];
+        *idx++ = data->fIndex1;
+        *idx++ = data->fIndex2;
+        *idx++ = data->fIndex3;
+        if( span.fReverse )
+            span.fCursor -= 3;
+        else
+            span.fCursor += 3;
+    }
+}
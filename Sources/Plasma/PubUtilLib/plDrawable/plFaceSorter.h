@@ -0,0 +1,137 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plFaceSorter_inc
+#define plFaceSorter_inc
+
+#include "hsCpuID.h"
+#include "hsGeometry3.h"
+
+#include <vector>
+
+class plGBufferTriangle;
+
+// Back to front sort of the faces of a run of spans, as plDrawableSpans does
+// for its alpha blended spans each frame. Everything the sort needs lives in
+// the sorter, so one sorter per thread makes it safe to sort drawables side
+// by side, and reusing a sorter keeps its arrays from being reallocated.
+//
+// Spans are added in the order their faces will be packed into the index
+// buffers. Faces are keyed, radix sorted a chunk of spans at a time, and
+// each span's indices come back as one contiguous run. The radix sort runs
+// over flat arrays of key and face number, rather than hsRadixSort's linked
+// lists, so it streams through memory instead of chasing pointers.
+class plFaceSorter
+{
+public:
+    enum
+    {
+        // Spans are gathered into one sort until it has at least this many
+        // faces, so far apart spans don't pay for one another's sort.
+        kTriCutoff      = 4000
+    };
+
+    // A face's key is fScale * |center - fViewPos|^2 + center . fDir + fDist,
+    // sorted ascending. Distance sorts use a scale of -1 and no direction,
+    // view depth sorts a scale of 0 and the view axis in local space.
+    struct KeyParams
+    {
+        hsPoint3    fViewPos;
+        float       fScale;
+        hsVector3   fDir;
+        float       fDist;
+    };
+
+protected:
+    struct Span
+    {
+        const plGBufferTriangle*    fTris;
+        uint32_t                    fNumTris;
+        uint32_t                    fStart;
+        uint32_t                    fCursor;
+        KeyParams                   fParams;
+        bool                        fReverse;
+    };
+
+    std::vector<Span>                       fSpans;
+    std::vector<float>                      fKeys;
+    std::vector<uint16_t>                   fOwners;
+    std::vector<const plGBufferTriangle*>   fFaces;
+    std::vector<uint64_t>                   fItems[2];
+    std::vector<uint16_t>                   fIndices;
+    uint32_t                                fNumTris;
+
+    void            ISortChunk(size_t first, size_t last);
+
+public:
+    plFaceSorter() : fNumTris(0) {}
+
+    void            Reset() { fSpans.clear(); fNumTris = 0; }
+
+    /**
+     * Queue a span's faces sorted back to front from viewPos, given in the
+     * span's local space. Reversed spans get their faces front to back.
+     */
+    void            AddSpan(const plGBufferTriangle* tris, uint32_t numTris, const hsPoint3& viewPos, bool reverse);
+
+    // Queue a span's faces sorted by key, see KeyParams.
+    void            AddSpan(const plGBufferTriangle* tris, uint32_t numTris, const KeyParams& params, bool reverse);
+
+    /**
+     * Sort the queued spans, or only pack their indices in their original
+     * order when sortFaces is false. Returns the number of faces.
+     */
+    uint32_t        Sort(bool sortFaces = true);
+
+    size_t          GetNumSpans() const { return fSpans.size(); }
+    uint32_t        GetNumTris() const { return fNumTris; }
+
+    // Three indices per face of span i, valid until the next Sort.
+    const uint16_t* GetIndices(size_t i) const { return fIndices.data() + fSpans[i].fStart; }
+
+    //  CPU-optimized functions
+    // Writes the key of each of numTris faces, see KeyParams.
+    typedef void(*face_keys_ptr)(const plGBufferTriangle* tris, uint32_t numTris, const KeyParams& params, float* keys);
+    static hsCpuFunctionDispatcher<face_keys_ptr> face_keys;
+};
+
+#endif // plFaceSorter_inc
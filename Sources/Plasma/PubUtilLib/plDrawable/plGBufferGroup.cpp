@@ -63,8 +63,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plVertCoder.h"
 
-plProfile_CreateMemCounter("Buf Group Vertices", "Memory", MemBufGrpVertex);
-plProfile_CreateMemCounter("Buf Group Indices", "Memory", MemBufGrpIndex);
+plProfile_CreateMemCounterTagged("Buf Group Vertices", "Memory", MemBufGrpVertex, kMemTagGeometry);
+plProfile_CreateMemCounterTagged("Buf Group Indices", "Memory", MemBufGrpIndex, kMemTagGeometry);
 plProfile_CreateTimer("Refill Vertex", "Draw", DrawRefillVertex);
 plProfile_CreateTimer("Refill Index", "Draw", DrawRefillIndex);
 
@@ -1167,7 +1167,7 @@ plGBufferTriangle   *plGBufferGroup::ConvertToTriList( int16_t spanIndex, uint32
 //  Stuffs the indices from an array of plGBufferTriangles into the index 
 //  storage.
 
-void    plGBufferGroup::StuffFromTriList( uint32_t which, uint32_t start, uint32_t numTriangles, uint16_t *data )
+void    plGBufferGroup::StuffFromTriList( uint32_t which, uint32_t start, uint32_t numTriangles, const uint16_t *data )
 {
     uint16_t          *storagePtr;
 
@@ -291,7 +291,7 @@ class plGBufferGroup
         plGBufferTriangle   *ConvertToTriList( int16_t spanIndex, uint32_t whichIdx, uint32_t whichVtx, uint32_t whichCell, uint32_t start, uint32_t numTriangles );
 
         // Stuffs the indices from an array of plGBufferTriangles into the index storage
-        void    StuffFromTriList( uint32_t which, uint32_t start, uint32_t numTriangles, uint16_t *data );
+        void    StuffFromTriList( uint32_t which, uint32_t start, uint32_t numTriangles, const uint16_t *data );
         void    StuffTri( uint32_t iBuff, uint32_t iTri, uint16_t idx0, uint16_t idx1, uint16_t idx2 );
 
         // Stuff the data from a geometry span into vertex storage
@@ -44,17 +44,252 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plSpaceTree.h"
 #include "hsStream.h"
 #include "hsBitVector.h"
+#include "hsGeometry3.h"
 #include "plProfile.h"
 
 #include "plIntersect/plVolumeIsect.h"
 #include "plMath/hsRadixSort.h"
 
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+struct plQuadVisit
+{
+    int16_t     fQuad;
+    uint32_t    fActive;
+};
+
 static hsBitVector scratchTotVec;
 static hsBitVector scratchBitVec;
 static hsTArray<int16_t> scratchList;
 static hsTArray<hsRadixSort::Elem> scratchSort;
+static hsTArray<hsPlane3> scratchPlanes;
+static hsTArray<plQuadVisit> scratchVisits;
 
 plProfile_CreateCounter("Harvest Leaves", "Draw", HarvestLeaves);
+plProfile_CreateCounter("Harvest Quads", "Draw", HarvestQuads);
+
+bool plSpaceTree::fPackedCulling = true;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t cull_quad_fpu(const plSpaceTreeQuad& quad, const plSpaceTreePlaneSet& planes,
+                              uint32_t active, uint32_t* laneActive)
+{
+    uint32_t culled = 0;
+    laneActive[0] = laneActive[1] = laneActive[2] = laneActive[3] = active;
+
+    for (int i = 0; i < planes.fNumPlanes; i++)
+    {
+        const uint32_t bit = 1 << i;
+        if (!(active & bit))
+            continue;
+
+        const hsPlane3& plane = planes.fPlanes[i];
+        for (int j = 0; j < 4; j++)
+        {
+            if (!(quad.fValid & (1 << j)))
+                continue;
+
+            float lo = plane.fD;
+            float hi = plane.fD;
+            for (int k = 0; k < 3; k++)
+            {
+                float a = plane.fN[k] * quad.fMins[k][j];
+                float b = plane.fN[k] * quad.fMaxs[k][j];
+                lo += a < b ? a : b;
+                hi += a < b ? b : a;
+            }
+
+            bool isCulled = hi < planes.fCullBias;
+            bool isClear = lo >= 0;
+            if (planes.fSphereTest)
+            {
+                float dist = plane.fN.fX * quad.fCenter[0][j]
+                    + plane.fN.fY * quad.fCenter[1][j]
+                    + plane.fN.fZ * quad.fCenter[2][j]
+                    + plane.fD;
+                isCulled |= dist < -quad.fRadius[j];
+                isClear |= dist > quad.fRadius[j];
+            }
+
+            if (isCulled)
+                culled |= 1 << j;
+            else if (isClear)
+                laneActive[j] &= ~bit;
+        }
+
+        if (((culled | ~quad.fValid) & 0xf) == 0xf)
+            break;
+    }
+    return culled;
+}
+
+static uint32_t cull_quad_sse1(const plSpaceTreeQuad& quad, const plSpaceTreePlaneSet& planes,
+                               uint32_t active, uint32_t* laneActive)
+{
+#ifdef HS_SSE1
+    const __m128 minX = _mm_loadu_ps(quad.fMins[0]);
+    const __m128 minY = _mm_loadu_ps(quad.fMins[1]);
+    const __m128 minZ = _mm_loadu_ps(quad.fMins[2]);
+    const __m128 maxX = _mm_loadu_ps(quad.fMaxs[0]);
+    const __m128 maxY = _mm_loadu_ps(quad.fMaxs[1]);
+    const __m128 maxZ = _mm_loadu_ps(quad.fMaxs[2]);
+    const __m128 cenX = _mm_loadu_ps(quad.fCenter[0]);
+    const __m128 cenY = _mm_loadu_ps(quad.fCenter[1]);
+    const __m128 cenZ = _mm_loadu_ps(quad.fCenter[2]);
+    const __m128 rad = _mm_loadu_ps(quad.fRadius);
+    const __m128 negRad = _mm_sub_ps(_mm_setzero_ps(), rad);
+    const __m128 bias = _mm_set1_ps(planes.fCullBias);
+    const __m128 sphere = planes.fSphereTest ? _mm_cmpeq_ps(rad, rad) : _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+
+    uint32_t culled = 0;
+    laneActive[0] = laneActive[1] = laneActive[2] = laneActive[3] = active;
+
+    for (int i = 0; i < planes.fNumPlanes; i++)
+    {
+        const uint32_t bit = 1 << i;
+        if (!(active & bit))
+            continue;
+
+        const hsPlane3& plane = planes.fPlanes[i];
+        __m128 nx = _mm_set1_ps(plane.fN.fX);
+        __m128 ny = _mm_set1_ps(plane.fN.fY);
+        __m128 nz = _mm_set1_ps(plane.fN.fZ);
+        __m128 d = _mm_set1_ps(plane.fD);
+
+        __m128 ax = _mm_mul_ps(nx, minX), bx = _mm_mul_ps(nx, maxX);
+        __m128 ay = _mm_mul_ps(ny, minY), by = _mm_mul_ps(ny, maxY);
+        __m128 az = _mm_mul_ps(nz, minZ), bz = _mm_mul_ps(nz, maxZ);
+
+        __m128 lo = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)),
+                               _mm_add_ps(_mm_min_ps(az, bz), d));
+        __m128 hi = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)),
+                               _mm_add_ps(_mm_max_ps(az, bz), d));
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cenX), _mm_mul_ps(ny, cenY)),
+                                 _mm_add_ps(_mm_mul_ps(nz, cenZ), d));
+
+        __m128 isCulled = _mm_or_ps(_mm_cmplt_ps(hi, bias),
+                                    _mm_and_ps(sphere, _mm_cmplt_ps(dist, negRad)));
+        __m128 isClear = _mm_or_ps(_mm_cmpge_ps(lo, zero),
+                                   _mm_and_ps(sphere, _mm_cmpgt_ps(dist, rad)));
+
+        uint32_t cullMask = _mm_movemask_ps(isCulled) & quad.fValid;
+        uint32_t clearMask = _mm_movemask_ps(isClear) & quad.fValid & ~cullMask;
+        culled |= cullMask;
+        for (int j = 0; clearMask; j++, clearMask >>= 1)
+        {
+            if (clearMask & 1)
+                laneActive[j] &= ~bit;
+        }
+
+        if (((culled | ~quad.fValid) & 0xf) == 0xf)
+            break;
+    }
+    return culled;
+#else
+    return 0;
+#endif  // HS_SSE1
+}
+
+static uint32_t cull_quad_avx(const plSpaceTreeQuad& quad, const plSpaceTreePlaneSet& planes,
+                              uint32_t active, uint32_t* laneActive)
+{
+#ifdef HS_AVX
+    // The quad is repeated in both halves of the registers, so each pass
+    // tests two planes, the first in the low half and the second in the high.
+    int planeIdx[plSpaceTree::kMaxCullPlanes];
+    int numActive = 0;
+    for (int i = 0; i < planes.fNumPlanes; i++)
+    {
+        if (active & (1 << i))
+            planeIdx[numActive++] = i;
+    }
+    if (numActive & 1)
+        planeIdx[numActive] = planeIdx[numActive - 1];
+
+    const __m256 minX = _mm256_broadcast_ps((const __m128*)quad.fMins[0]);
+    const __m256 minY = _mm256_broadcast_ps((const __m128*)quad.fMins[1]);
+    const __m256 minZ = _mm256_broadcast_ps((const __m128*)quad.fMins[2]);
+    const __m256 maxX = _mm256_broadcast_ps((const __m128*)quad.fMaxs[0]);
+    const __m256 maxY = _mm256_broadcast_ps((const __m128*)quad.fMaxs[1]);
+    const __m256 maxZ = _mm256_broadcast_ps((const __m128*)quad.fMaxs[2]);
+    const __m256 cenX = _mm256_broadcast_ps((const __m128*)quad.fCenter[0]);
+    const __m256 cenY = _mm256_broadcast_ps((const __m128*)quad.fCenter[1]);
+    const __m256 cenZ = _mm256_broadcast_ps((const __m128*)quad.fCenter[2]);
+    const __m256 rad = _mm256_broadcast_ps((const __m128*)quad.fRadius);
+    const __m256 negRad = _mm256_sub_ps(_mm256_setzero_ps(), rad);
+    const __m256 bias = _mm256_set1_ps(planes.fCullBias);
+    const __m256 sphere = planes.fSphereTest ? _mm256_cmp_ps(rad, rad, _CMP_EQ_OQ) : _mm256_setzero_ps();
+    const __m256 zero = _mm256_setzero_ps();
+    const uint32_t valid = quad.fValid | (quad.fValid << 4);
+
+    uint32_t culled = 0;
+    laneActive[0] = laneActive[1] = laneActive[2] = laneActive[3] = active;
+
+    for (int i = 0; i < numActive; i += 2)
+    {
+        const hsPlane3& p0 = planes.fPlanes[planeIdx[i]];
+        const hsPlane3& p1 = planes.fPlanes[planeIdx[i + 1]];
+        __m256 nx = _mm256_setr_ps(p0.fN.fX, p0.fN.fX, p0.fN.fX, p0.fN.fX, p1.fN.fX, p1.fN.fX, p1.fN.fX, p1.fN.fX);
+        __m256 ny = _mm256_setr_ps(p0.fN.fY, p0.fN.fY, p0.fN.fY, p0.fN.fY, p1.fN.fY, p1.fN.fY, p1.fN.fY, p1.fN.fY);
+        __m256 nz = _mm256_setr_ps(p0.fN.fZ, p0.fN.fZ, p0.fN.fZ, p0.fN.fZ, p1.fN.fZ, p1.fN.fZ, p1.fN.fZ, p1.fN.fZ);
+        __m256 d = _mm256_setr_ps(p0.fD, p0.fD, p0.fD, p0.fD, p1.fD, p1.fD, p1.fD, p1.fD);
+
+        __m256 ax = _mm256_mul_ps(nx, minX), bx = _mm256_mul_ps(nx, maxX);
+        __m256 ay = _mm256_mul_ps(ny, minY), by = _mm256_mul_ps(ny, maxY);
+        __m256 az = _mm256_mul_ps(nz, minZ), bz = _mm256_mul_ps(nz, maxZ);
+
+        __m256 lo = _mm256_add_ps(_mm256_add_ps(_mm256_min_ps(ax, bx), _mm256_min_ps(ay, by)),
+                                  _mm256_add_ps(_mm256_min_ps(az, bz), d));
+        __m256 hi = _mm256_add_ps(_mm256_add_ps(_mm256_max_ps(ax, bx), _mm256_max_ps(ay, by)),
+                                  _mm256_add_ps(_mm256_max_ps(az, bz), d));
+        __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cenX), _mm256_mul_ps(ny, cenY)),
+                                    _mm256_add_ps(_mm256_mul_ps(nz, cenZ), d));
+
+        __m256 isCulled = _mm256_or_ps(_mm256_cmp_ps(hi, bias, _CMP_LT_OQ),
+                                       _mm256_and_ps(sphere, _mm256_cmp_ps(dist, negRad, _CMP_LT_OQ)));
+        __m256 isClear = _mm256_or_ps(_mm256_cmp_ps(lo, zero, _CMP_GE_OQ),
+                                      _mm256_and_ps(sphere, _mm256_cmp_ps(dist, rad, _CMP_GT_OQ)));
+
+        uint32_t cullMask = _mm256_movemask_ps(isCulled) & valid;
+        uint32_t clearMask = _mm256_movemask_ps(isClear) & valid;
+        culled |= (cullMask | (cullMask >> 4)) & 0xf;
+
+        const uint32_t bit0 = 1 << planeIdx[i];
+        const uint32_t bit1 = 1 << planeIdx[i + 1];
+        for (int j = 0; j < 4; j++)
+        {
+            if (clearMask & (1 << j))
+                laneActive[j] &= ~bit0;
+            if (clearMask & (0x10 << j))
+                laneActive[j] &= ~bit1;
+        }
+
+        if (((culled | ~quad.fValid) & 0xf) == 0xf)
+            break;
+    }
+    return culled;
+#else
+    return 0;
+#endif  // HS_AVX
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plSpaceTree::cull_quad_ptr> plSpaceTree::cull_quad {
+    &cull_quad_fpu,
+    &cull_quad_sse1,        // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    &cull_quad_avx          // AVX
+};
+
+///////////////////////////////////////////////////////////////////////////////
 
 void plSpaceTreeNode::Read(hsStream* s)
 {
@@ -84,7 +319,8 @@ void plSpaceTreeNode::Write(hsStream* s)
 plSpaceTree::plSpaceTree()
 :   fCullFunc(nil),
     fNumLeaves(0),
-    fCache(nil)
+    fCache(nil),
+    fQuadsDirty(true)
 {
 }
 
@@ -114,6 +350,9 @@ void plSpaceTree::IRefreshRecur(int16_t which)
             sub.fWorldBounds.Union(&fTree[sub.fChildren[1]].fWorldBounds);
 
         sub.fFlags &= ~plSpaceTreeNode::kDirty;
+
+        if( !fQuadsDirty )
+            IPackBounds(which);
     }
 }
 
@@ -327,6 +566,9 @@ void plSpaceTree::MoveLeaf(int16_t idx, const hsBounds3Ext& bnd)
 
     fTree[idx].fWorldBounds = bnd;
 
+    if( !fQuadsDirty )
+        IPackBounds(idx);
+
     while( idx != kRootParent )
     {
         if( fTree[idx].fFlags & plSpaceTreeNode::kDirty )
@@ -374,7 +616,15 @@ void plSpaceTree::HarvestLeaves(plVolumeIsect* cull, hsBitVector& list) const
     if( !IsEmpty() )
     {
         fCullFunc = cull;
-        if (fCullFunc)
+        scratchPlanes.SetCount(0);
+        if( fCullFunc && fPackedCulling
+            && fCullFunc->GetCullPlanes(scratchPlanes)
+            && (scratchPlanes.GetCount() <= kMaxCullPlanes) )
+        {
+            plSpaceTreePlaneSet planes(scratchPlanes.AcquireArray(), scratchPlanes.GetCount());
+            IHarvestQuads(planes, list);
+        }
+        else if (fCullFunc)
             IHarvestAndCullLeaves(fTree[fRoot], scratchTotVec, list);
         else
             IHarvestLeaves(fTree[fRoot], scratchTotVec, list);
@@ -382,6 +632,13 @@ void plSpaceTree::HarvestLeaves(plVolumeIsect* cull, hsBitVector& list) const
     scratchTotVec.Clear();
 }
 
+void plSpaceTree::HarvestLeaves(const plSpaceTreePlaneSet& planes, hsBitVector& list) const
+{
+    hsAssert(planes.fNumPlanes <= kMaxCullPlanes, "Too many planes to harvest against");
+    if( !IsEmpty() )
+        IHarvestQuads(planes, list);
+}
+
 void plSpaceTree::HarvestLeaves(int16_t subRoot, hsBitVector& list) const 
 { 
     IHarvestLeaves(GetNode(subRoot), scratchTotVec, list);
@@ -543,6 +800,166 @@ void plSpaceTree::IHarvestLeaves(const plSpaceTreeNode& subRoot, hsTArray<int16_
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Packed quads.
+// Each quad is tested a plane at a time, four bounds per test. Planes a lane
+// is entirely inside of are dropped for everything below it, so once a lane
+// is inside all of them the quads under it are just walked for their leaves.
+///////////////////////////////////////////////////////////////////////////////
+
+void plSpaceTree::IHarvestQuads(const plSpaceTreePlaneSet& planes, hsBitVector& list) const
+{
+    if( fQuadsDirty )
+        IPackQuads();
+
+    scratchVisits.SetCount(0);
+
+    plQuadVisit* visit = scratchVisits.Push();
+    visit->fQuad = 0;
+    visit->fActive = planes.fNumPlanes < 32 ? (1 << planes.fNumPlanes) - 1 : uint32_t(-1);
+
+    while( scratchVisits.GetCount() )
+    {
+        plQuadVisit curr = scratchVisits[scratchVisits.GetCount()-1];
+        scratchVisits.SetCount(scratchVisits.GetCount()-1);
+
+        const plSpaceTreeQuad& quad = fQuads[curr.fQuad];
+        uint32_t laneActive[4] = { 0, 0, 0, 0 };
+        uint32_t culled = 0;
+        if( curr.fActive )
+        {
+            plProfile_Inc(HarvestQuads);
+            culled = cull_quad.call(quad, planes, curr.fActive, laneActive);
+        }
+
+        // Lanes without proper bounds only count as culled when they're
+        // tested, like plCullNode does it.
+        uint32_t skip = curr.fActive ? culled | ~quad.fValid : 0;
+
+        int i;
+        for( i = 0; i < 4; i++ )
+        {
+            int16_t node = quad.fNode[i];
+            if( (node < 0) || (skip & (1 << i)) || IsDisabled(node) )
+                continue;
+
+            if( fTree[node].fFlags & plSpaceTreeNode::kIsLeaf )
+            {
+                plProfile_Inc(HarvestLeaves);
+                list.SetBit(fTree[node].fLeafIndex);
+            }
+            else
+            {
+                visit = scratchVisits.Push();
+                visit->fQuad = quad.fChild[i];
+                visit->fActive = laneActive[i];
+            }
+        }
+    }
+}
+
+void plSpaceTree::IPackQuads() const
+{
+    fQuads.SetCount(0);
+    fQuadSlots.SetCount(fTree.GetCount());
+
+    int i;
+    for( i = 0; i < fQuadSlots.GetCount(); i++ )
+        fQuadSlots[i] = -1;
+
+    // The root gets a quad to itself, so it's tested like everyone else.
+    if( !IsEmpty() )
+        IPackLanes(&fRoot, 1);
+
+    fQuadsDirty = false;
+}
+
+int16_t plSpaceTree::IPackQuad(int16_t parent) const
+{
+    int16_t lanes[4];
+    int numLanes = 0;
+    lanes[numLanes++] = fTree[parent].fChildren[0];
+    lanes[numLanes++] = fTree[parent].fChildren[1];
+
+    // Fill the spare lanes with grandchildren. The interior node they replace
+    // isn't tested on its own, but its bounds hold both of theirs, so that
+    // only costs us the chance of culling both children in one test.
+    int i;
+    for( i = 0; (i < 2) && (numLanes < 4); i++ )
+    {
+        const plSpaceTreeNode& node = fTree[lanes[i]];
+        if( !(node.fFlags & plSpaceTreeNode::kIsLeaf) )
+        {
+            lanes[i] = node.fChildren[0];
+            lanes[numLanes++] = node.fChildren[1];
+        }
+    }
+
+    return IPackLanes(lanes, numLanes);
+}
+
+int16_t plSpaceTree::IPackLanes(const int16_t* lanes, int numLanes) const
+{
+    hsAssert(fQuads.GetCount() < 0x7fff, "Too many quads for a space tree");
+    int16_t quadIdx = fQuads.GetCount();
+    plSpaceTreeQuad* quad = fQuads.Push();
+    memset(quad, 0, sizeof(*quad));
+
+    int i;
+    for( i = 0; i < 4; i++ )
+    {
+        quad->fNode[i] = i < numLanes ? lanes[i] : -1;
+        quad->fChild[i] = -1;
+    }
+    for( i = 0; i < numLanes; i++ )
+    {
+        fQuadSlots[lanes[i]] = (int32_t(quadIdx) << 2) | i;
+        IPackBounds(lanes[i]);
+    }
+
+    // Recursing will grow fQuads, so no holding on to quad past here.
+    for( i = 0; i < numLanes; i++ )
+    {
+        if( !(fTree[lanes[i]].fFlags & plSpaceTreeNode::kIsLeaf) )
+        {
+            int16_t child = IPackQuad(lanes[i]);
+            fQuads[quadIdx].fChild[i] = child;
+        }
+    }
+
+    return quadIdx;
+}
+
+void plSpaceTree::IPackBounds(int16_t which) const
+{
+    int32_t slot = fQuadSlots[which];
+    if( slot < 0 )
+        return;
+
+    plSpaceTreeQuad& quad = fQuads[slot >> 2];
+    int lane = slot & 3;
+
+    const hsBounds3Ext& bnd = fTree[which].fWorldBounds;
+    if( bnd.GetType() != kBoundsNormal )
+    {
+        quad.fValid &= ~(1 << lane);
+        return;
+    }
+
+    const hsPoint3& mins = bnd.GetMins();
+    const hsPoint3& maxs = bnd.GetMaxs();
+    const hsPoint3& center = bnd.GetCenter();
+    int i;
+    for( i = 0; i < 3; i++ )
+    {
+        quad.fMins[i][lane] = mins[i];
+        quad.fMaxs[i][lane] = maxs[i];
+        quad.fCenter[i][lane] = center[i];
+    }
+    quad.fRadius[lane] = bnd.GetRadius();
+    quad.fValid |= 1 << lane;
+}
+
 void plSpaceTree::Read(hsStream* s, hsResMgr* mgr)
 {
     plCreatable::Read(s, mgr);
@@ -556,6 +973,8 @@ void plSpaceTree::Read(hsStream* s, hsResMgr* mgr)
     int i;
     for( i = 0; i < n; i++ )
         fTree[i].Read(s);
+
+    fQuadsDirty = true;
 }
 
 void plSpaceTree::Write(hsStream* s, hsResMgr* mgr)
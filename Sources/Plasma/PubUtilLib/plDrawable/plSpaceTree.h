@@ -47,10 +47,12 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsBounds.h"
 #include "pnFactory/plCreatable.h"
 #include "hsBitVector.h"
+#include "hsCpuID.h"
 
 class hsStream;
 class hsResMgr;
 class plVolumeIsect;
+struct hsPlane3;
 
 class plSpaceTreeNode 
 {
@@ -86,6 +88,40 @@ public:
 };
 
 
+// Four sibling nodes of a plSpaceTree with their bounds split out by axis,
+// so a plane can be tested against all of them at once. A quad holds the
+// children of one interior node, with interior children pulled up into their
+// own children while there are lanes to spare, so each quad covers two levels
+// of the binary tree.
+class plSpaceTreeQuad
+{
+public:
+    float       fMins[3][4];
+    float       fMaxs[3][4];
+    float       fCenter[3][4];
+    float       fRadius[4];
+
+    int16_t     fNode[4];       // Index into the space tree, -1 for an unused lane
+    int16_t     fChild[4];      // Quad under an interior lane, -1 for a leaf
+    uint32_t    fValid;         // Lanes whose bounds are kBoundsNormal
+};
+
+// A convex volume to harvest a plSpaceTree against. A point is inside when
+// n.p + d >= 0 for every plane. A bounds is culled by a plane if its far
+// corner is below fCullBias, and if fSphereTest its bounding sphere is also
+// tested first, the way plCullNode::TestBounds does.
+class plSpaceTreePlaneSet
+{
+public:
+    const hsPlane3*     fPlanes;
+    int                 fNumPlanes;
+    float               fCullBias;
+    bool                fSphereTest;
+
+    plSpaceTreePlaneSet(const hsPlane3* planes, int numPlanes, float cullBias = 0, bool sphereTest = false)
+        : fPlanes(planes), fNumPlanes(numPlanes), fCullBias(cullBias), fSphereTest(sphereTest) { }
+};
+
 class plSpaceTree : public plCreatable
 {
 public:
@@ -97,6 +133,9 @@ public:
     enum {
         kRootParent = -1
     };
+    enum {
+        kMaxCullPlanes = 32
+    };
 private:
     hsTArray<plSpaceTreeNode>       fTree;
     const hsBitVector*              fCache;
@@ -110,7 +149,20 @@ private:
 
     hsPoint3                        fViewPos;
 
+    // Packed copy of fTree for plane culling, built on first use.
+    mutable hsTArray<plSpaceTreeQuad>   fQuads;
+    mutable hsTArray<int32_t>           fQuadSlots; // (quad << 2) | lane per node, -1 if folded into a quad
+    mutable bool                        fQuadsDirty;
+
+    static bool                     fPackedCulling;
+
     void        IRefreshRecur(int16_t which);
+
+    void        IPackQuads() const;
+    int16_t     IPackQuad(int16_t parent) const;
+    int16_t     IPackLanes(const int16_t* lanes, int numLanes) const;
+    void        IPackBounds(int16_t which) const;
+    void        IHarvestQuads(const plSpaceTreePlaneSet& planes, hsBitVector& list) const;
     
     void        IHarvestAndCullLeaves(const plSpaceTreeNode& subRoot, hsTArray<int16_t>& list) const;
     void        IHarvestLeaves(const plSpaceTreeNode& subRoot, hsTArray<int16_t>& list) const;
@@ -138,6 +190,7 @@ public:
 
     const plSpaceTreeNode&  GetNode(int16_t w) const { return fTree[w]; }
     int16_t                   GetRoot() const { return fRoot; }
+    int16_t                   GetNumNodes() const { return fTree.GetCount(); }
     bool                    IsRoot(int16_t w) const { return fRoot == w; }
     bool                    IsLeaf(int16_t w) const { return GetNode(w).IsLeaf(); }
 
@@ -151,6 +204,11 @@ public:
     void HarvestLeaves(plVolumeIsect* cullFunc, hsTArray<int16_t>& list) const;
     void HarvestLeaves(int16_t subRoot, hsTArray<int16_t>& list) const;
 
+    // Harvest the enabled leaves inside a convex volume, from the packed quads.
+    // Bounds are tested by their axis aligned box, so this may keep a few leaves
+    // the per node path would cull, but never culls one it would keep.
+    void HarvestLeaves(const plSpaceTreePlaneSet& planes, hsBitVector& list) const;
+
     void EnableLeaf(int16_t idx, hsBitVector& cache) const;
     void EnableLeaves(const hsTArray<int16_t>& list, hsBitVector& cache) const;
     void HarvestEnabledLeaves(plVolumeIsect* cullFunc, const hsBitVector& cache, hsTArray<int16_t>& list) const;
@@ -185,6 +243,18 @@ public:
 
     void HarvestLevel(int level, hsTArray<int16_t>& list) const;
 
+    // Use the packed quads for plane harvests. On by default.
+    static bool GetPackedCulling() { return fPackedCulling; }
+    static void SetPackedCulling(bool on) { fPackedCulling = on; }
+
+    //  CPU-optimized functions
+    // Tests the valid lanes of a quad against the planes set in active. Returns
+    // the mask of lanes culled by any of them, and for each lane the planes it
+    // is not entirely inside of in laneActive.
+    typedef uint32_t(*cull_quad_ptr)(const plSpaceTreeQuad& quad, const plSpaceTreePlaneSet& planes,
+                                     uint32_t active, uint32_t* laneActive);
+    static hsCpuFunctionDispatcher<cull_quad_ptr> cull_quad;
+
     friend class plSpaceTreeMaker;
 };
 
@@ -47,8 +47,12 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
  // for testing, get hsRand()
 #include "hsTimer.h"
+#include "hsWorkerPool.h"
 #include "plIntersect/plVolumeIsect.h"
 
+#include <algorithm>
+#include <cfloat>
+
 //#define MF_DO_TIMES
 
 enum mfTimeTypes
@@ -380,12 +384,266 @@ void plSpaceTreeMaker::IMakeTree()
     fSortScratch = nil;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Binned surface area heuristic builder.
+// Each split bins the leaf centers into kNumSAHBins buckets along each axis
+// and takes the bucket boundary minimizing (area * count) summed over both
+// halves, so every level is linear in the leaves it holds. The n-1 interior
+// nodes of a tree over n leaves come out of one arena. A subtree over leaves
+// [i, i+m) with its root at arena slot k keeps its interior nodes in
+// [k, k+m-1), so sibling subtrees never share slots. The top few levels
+// are split on the calling thread and the subtrees under them built on the
+// worker pool.
+///////////////////////////////////////////////////////////////////////////////
+
+bool plSpaceTreeMaker::fBuildSAH = true;
+
+static const int kNumSAHBins = 16;
+static const int kMinSAHLeavesPerThread = 1024;
+
+class plSpaceTreeMaker::SAHLeaf
+{
+public:
+    float               fMins[3];
+    float               fMaxs[3];
+    float               fCenter[3];
+
+    plSpacePrepNode*    fNode;
+};
+
+// A subtree left for the worker pool, and where its root goes
+class plSpaceTreeMaker::SAHSubtree
+{
+public:
+    plSpacePrepNode**   fSlot;
+    SAHLeaf*            fLeaves;
+    int                 fCount;
+    int                 fArenaIdx;
+};
+
+static inline float ISAHHalfArea(const float* mins, const float* maxs)
+{
+    float dx = maxs[0] - mins[0];
+    float dy = maxs[1] - mins[1];
+    float dz = maxs[2] - mins[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static inline void ISAHGrow(float* mins, float* maxs, const float* lo, const float* hi)
+{
+    mins[0] = std::min(mins[0], lo[0]);
+    mins[1] = std::min(mins[1], lo[1]);
+    mins[2] = std::min(mins[2], lo[2]);
+    maxs[0] = std::max(maxs[0], hi[0]);
+    maxs[1] = std::max(maxs[1], hi[1]);
+    maxs[2] = std::max(maxs[2], hi[2]);
+}
+
+static inline void ISAHEmpty(float* mins, float* maxs)
+{
+    mins[0] = mins[1] = mins[2] = FLT_MAX;
+    maxs[0] = maxs[1] = maxs[2] = -FLT_MAX;
+}
+
+plSpacePrepNode* plSpaceTreeMaker::IMakeSAHTreeRecur(SAHLeaf* leaves, int count, int arenaIdx, int splitDepth, hsTArray<SAHSubtree>* deferred)
+{
+    if( count == 1 )
+        return leaves[0].fNode;
+
+    float mins[3], maxs[3];
+    float cMins[3], cMaxs[3];
+    ISAHEmpty(mins, maxs);
+    ISAHEmpty(cMins, cMaxs);
+    int i;
+    for( i = 0; i < count; i++ )
+    {
+        ISAHGrow(mins, maxs, leaves[i].fMins, leaves[i].fMaxs);
+        ISAHGrow(cMins, cMaxs, leaves[i].fCenter, leaves[i].fCenter);
+    }
+
+    plSpacePrepNode* subRoot = &fArena[arenaIdx];
+    hsPoint3 lo(mins[0], mins[1], mins[2]);
+    hsPoint3 hi(maxs[0], maxs[1], maxs[2]);
+    subRoot->fWorldBounds.Reset(&lo);
+    subRoot->fWorldBounds.Union(&hi);
+    subRoot->fDataIndex = int16_t(-1);
+
+    float scale[3];
+    int axis;
+    for( axis = 0; axis < 3; axis++ )
+    {
+        float extent = cMaxs[axis] - cMins[axis];
+        scale[axis] = extent > 0 ? kNumSAHBins / extent : 0;
+    }
+
+    // Bin every leaf along all three axes in one pass.
+    float binMins[3][kNumSAHBins][3];
+    float binMaxs[3][kNumSAHBins][3];
+    int binCount[3][kNumSAHBins];
+    int b;
+    for( axis = 0; axis < 3; axis++ )
+    {
+        for( b = 0; b < kNumSAHBins; b++ )
+        {
+            ISAHEmpty(binMins[axis][b], binMaxs[axis][b]);
+            binCount[axis][b] = 0;
+        }
+    }
+    for( i = 0; i < count; i++ )
+    {
+        for( axis = 0; axis < 3; axis++ )
+        {
+            b = std::min(int((leaves[i].fCenter[axis] - cMins[axis]) * scale[axis]), kNumSAHBins-1);
+            binCount[axis][b]++;
+            ISAHGrow(binMins[axis][b], binMaxs[axis][b], leaves[i].fMins, leaves[i].fMaxs);
+        }
+    }
+
+    // Find the cheapest bucket boundary over all three axes. Sweep down from
+    // the top to get the cost of everything above each boundary, then back up
+    // adding in everything below.
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for( axis = 0; axis < 3; axis++ )
+    {
+        if( scale[axis] <= 0 )
+            continue;
+
+        float upperCost[kNumSAHBins];
+        float accMins[3], accMaxs[3];
+        ISAHEmpty(accMins, accMaxs);
+        int accCount = 0;
+        for( b = kNumSAHBins-1; b > 0; b-- )
+        {
+            accCount += binCount[axis][b];
+            if( binCount[axis][b] )
+                ISAHGrow(accMins, accMaxs, binMins[axis][b], binMaxs[axis][b]);
+            upperCost[b] = accCount ? ISAHHalfArea(accMins, accMaxs) * accCount : 0;
+        }
+
+        ISAHEmpty(accMins, accMaxs);
+        accCount = 0;
+        for( b = 0; b < kNumSAHBins-1; b++ )
+        {
+            accCount += binCount[axis][b];
+            if( binCount[axis][b] )
+                ISAHGrow(accMins, accMaxs, binMins[axis][b], binMaxs[axis][b]);
+            if( !accCount || (accCount == count) )
+                continue;
+
+            float cost = ISAHHalfArea(accMins, accMaxs) * accCount + upperCost[b+1];
+            if( cost < bestCost )
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    int mid = 0;
+    if( bestAxis >= 0 )
+    {
+        const float base = cMins[bestAxis];
+        const float bestScale = scale[bestAxis];
+        SAHLeaf* upper = std::partition(leaves, leaves + count,
+            [bestAxis, bestBin, bestScale, base](const SAHLeaf& leaf)
+            {
+                return std::min(int((leaf.fCenter[bestAxis] - base) * bestScale), kNumSAHBins-1) <= bestBin;
+            });
+        mid = int(upper - leaves);
+    }
+
+    // Every center in the same spot (or the binning couldn't separate them),
+    // just cut the list in half.
+    if( !mid || (mid == count) )
+        mid = count >> 1;
+
+    subRoot->fChildren[0] = nil;
+    subRoot->fChildren[1] = nil;
+    if( deferred && (splitDepth > 0) && (count >= 2 * kMinSAHLeavesPerThread) )
+    {
+        // Keep splitting the big halves, leave the rest to IMakeSAHTree()
+        SAHSubtree halves[2] = {
+            { &subRoot->fChildren[0], leaves, mid, arenaIdx + 1 },
+            { &subRoot->fChildren[1], leaves + mid, count - mid, arenaIdx + mid }
+        };
+        for( i = 0; i < 2; i++ )
+        {
+            if( (splitDepth > 1) && (halves[i].fCount >= 2 * kMinSAHLeavesPerThread) )
+                *halves[i].fSlot = IMakeSAHTreeRecur(halves[i].fLeaves, halves[i].fCount, halves[i].fArenaIdx, splitDepth - 1, deferred);
+            else
+                deferred->Append(halves[i]);
+        }
+    }
+    else
+    {
+        subRoot->fChildren[0] = IMakeSAHTreeRecur(leaves, mid, arenaIdx + 1, 0, nil);
+        subRoot->fChildren[1] = IMakeSAHTreeRecur(leaves + mid, count - mid, arenaIdx + mid, 0, nil);
+    }
+
+    return subRoot;
+}
+
+void plSpaceTreeMaker::IMakeSAHTree()
+{
+    const int numLeaves = fLeaves.GetCount();
+
+    SAHLeaf* leaves = new SAHLeaf[numLeaves];
+    int i;
+    for( i = 0; i < numLeaves; i++ )
+    {
+        const hsPoint3& mins = fLeaves[i]->fWorldBounds.GetMins();
+        const hsPoint3& maxs = fLeaves[i]->fWorldBounds.GetMaxs();
+        leaves[i].fMins[0] = mins.fX;
+        leaves[i].fMins[1] = mins.fY;
+        leaves[i].fMins[2] = mins.fZ;
+        leaves[i].fMaxs[0] = maxs.fX;
+        leaves[i].fMaxs[1] = maxs.fY;
+        leaves[i].fMaxs[2] = maxs.fZ;
+        int j;
+        for( j = 0; j < 3; j++ )
+            leaves[i].fCenter[j] = (leaves[i].fMins[j] + leaves[i].fMaxs[j]) * 0.5f;
+        leaves[i].fNode = fLeaves[i];
+    }
+
+    fArena = new plSpacePrepNode[numLeaves-1];
+    fTreeSize += numLeaves-1;
+
+    // About twice as many subtrees as threads, the splits aren't even
+    hsWorkerPool& pool = hsWorkerPool::Instance();
+    int splitDepth = 0;
+    if( numLeaves >= 2 * kMinSAHLeavesPerThread )
+    {
+        uint32_t numThreads = pool.GetNumThreads();
+        while( (numThreads > 1) && ((1U << splitDepth) < 2 * numThreads) )
+            splitDepth++;
+    }
+
+    if( splitDepth > 0 )
+    {
+        hsTArray<SAHSubtree> subtrees;
+        fPrepTree = IMakeSAHTreeRecur(leaves, numLeaves, 0, splitDepth, &subtrees);
+        pool.Run(subtrees.GetCount(), [this, &subtrees](uint32_t j)
+        {
+            const SAHSubtree& sub = subtrees[j];
+            *sub.fSlot = IMakeSAHTreeRecur(sub.fLeaves, sub.fCount, sub.fArenaIdx, 0, nil);
+        });
+    }
+    else
+        fPrepTree = IMakeSAHTreeRecur(leaves, numLeaves, 0, 0, nil);
+
+    delete [] leaves;
+}
+
 void plSpaceTreeMaker::Reset()
 {
     fLeaves.Reset();
     fPrepTree = nil;
     fTreeSize = 0;
     fSortScratch = nil;
+    fArena = nil;
 }
 
 void plSpaceTreeMaker::IDeleteTreeRecur(plSpacePrepNode* node)
@@ -401,7 +659,16 @@ void plSpaceTreeMaker::IDeleteTreeRecur(plSpacePrepNode* node)
 
 void plSpaceTreeMaker::Cleanup()
 {
-    IDeleteTreeRecur(fPrepTree);
+    // Arena trees point straight at the leaves, which go below.
+    if( fArena )
+    {
+        delete [] fArena;
+        fArena = nil;
+    }
+    else
+    {
+        IDeleteTreeRecur(fPrepTree);
+    }
     fPrepTree = nil;
 
     int i;
@@ -535,7 +802,10 @@ plSpaceTree* plSpaceTreeMaker::MakeTree()
     if( fLeaves.GetCount() < 2 )
         return IMakeDegenerateTree();
 
-    IMakeTree();
+    if( fBuildSAH )
+        IMakeSAHTree();
+    else
+        IMakeTree();
 
     plSpaceTree* retVal = IMakeSpaceTree();
 
@@ -605,6 +875,7 @@ plSpaceTree* plSpaceTreeMaker::IMakeSpaceTree()
     plSpacePrepNode* head = fPrepTree;
 
     tree->fTree.SetCount(fLeaves.GetCount());
+    tree->fTree.Expand(2 * fLeaves.GetCount() - 1);
     
     IGatherLeavesRecur(head, tree);
     
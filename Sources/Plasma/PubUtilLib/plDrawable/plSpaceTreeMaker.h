@@ -64,6 +64,9 @@ public:
 class plSpaceTreeMaker
 {
 protected:
+    class SAHLeaf;
+    class SAHSubtree;
+
     hsTArray<plSpacePrepNode*>      fLeaves; // input
 
     hsRadixSortElem*                fSortScratch;
@@ -73,6 +76,10 @@ protected:
     plSpacePrepNode*                fPrepTree;
     int16_t                           fTreeSize;
 
+    plSpacePrepNode*                fArena; // interior nodes of a binned SAH build, nil for the legacy build
+
+    static bool                     fBuildSAH;
+
     plSpacePrepNode*                INewSubRoot(const hsBounds3Ext& bnd);
     void                            IFindBigList(hsTArray<plSpacePrepNode*>& nodes, float length, const hsVector3& axis, hsTArray<plSpacePrepNode*>& giants, hsTArray<plSpacePrepNode*>& strimp);
     void                            ISortList(hsTArray<plSpacePrepNode*>& nodes, const hsVector3& axis);
@@ -84,6 +91,9 @@ protected:
 
     void                            IMakeTree();
 
+    void                            IMakeSAHTree();
+    plSpacePrepNode*                IMakeSAHTreeRecur(SAHLeaf* leaves, int count, int arenaIdx, int splitDepth, hsTArray<SAHSubtree>* deferred);
+
     plSpaceTree*                    IMakeEmptyTree();
     plSpaceTree*                    IMakeDegenerateTree();
     void                            IGatherLeavesRecur(plSpacePrepNode* sub, plSpaceTree* tree);
@@ -102,6 +112,11 @@ public:
     plSpaceTree*                    MakeTree();
 
     void                            TestTree(); // development only - NUKE ME mf horse
+
+    // Selects the binned surface area heuristic builder (default) over the
+    // original median split builder for every tree made afterwards.
+    static void                     SetBuildSAH(bool on) { fBuildSAH = on; }
+    static bool                     GetBuildSAH() { return fBuildSAH; }
 };
 
 #endif // plSpaceTreeMaker_inc
@@ -0,0 +1,589 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "plSpanTriTree.h"
+#include "plAccessTriSpan.h"
+#include "plProfile.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+plProfile_CreateCounter("Tri Trees Built", "Draw", TriTreesBuilt);
+
+// Triangles seen this close to edge on are skipped, the same threshold the
+// brute force loop in plVisLOSMgr applies to the unnormalized face normal.
+static const float kMinDet = 1.e-3f;
+
+// Direction components are kept at least this far from zero, so the slab
+// test never has to divide by zero.
+static const float kMinDirComp = 1.e-20f;
+
+static const int kMaxStack = 128;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t ray_boxes_fpu(const plSpanTriTree::Node* node, const float* from, const float* invDir, float maxDist, float* tNear)
+{
+    uint32_t mask = 0;
+    int i;
+    for( i = 0; i < plSpanTriTree::kWidth; i++ )
+    {
+        float tMin = 0;
+        float tMax = maxDist;
+        int j;
+        for( j = 0; j < 3; j++ )
+        {
+            const float t0 = (node->fBounds[j][i] - from[j]) * invDir[j];
+            const float t1 = (node->fBounds[j+3][i] - from[j]) * invDir[j];
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        tNear[i] = tMin;
+        if( tMin <= tMax )
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+static uint32_t ray_boxes_sse1(const plSpanTriTree::Node* node, const float* from, const float* invDir, float maxDist, float* tNear)
+{
+#ifdef HS_SSE1
+    __m128 tMin = _mm_setzero_ps();
+    __m128 tMax = _mm_set1_ps(maxDist);
+    int j;
+    for( j = 0; j < 3; j++ )
+    {
+        const __m128 o = _mm_set1_ps(from[j]);
+        const __m128 inv = _mm_set1_ps(invDir[j]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->fBounds[j]), o), inv);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->fBounds[j+3]), o), inv);
+        tMin = _mm_max_ps(tMin, _mm_min_ps(t0, t1));
+        tMax = _mm_min_ps(tMax, _mm_max_ps(t0, t1));
+    }
+    _mm_storeu_ps(tNear, tMin);
+    return uint32_t(_mm_movemask_ps(_mm_cmple_ps(tMin, tMax)));
+#endif  // HS_SSE1
+}
+
+static int ray_packet_fpu(const plSpanTriTree::Packet* packet, const float* from, const float* dir, float maxDist, bool twoSided, float* t)
+{
+    int hit = -1;
+    int i;
+    for( i = 0; i < plSpanTriTree::kWidth; i++ )
+    {
+        const float e1x = packet->fEdge1[0][i], e1y = packet->fEdge1[1][i], e1z = packet->fEdge1[2][i];
+        const float e2x = packet->fEdge2[0][i], e2y = packet->fEdge2[1][i], e2z = packet->fEdge2[2][i];
+
+        const float px = dir[1] * e2z - dir[2] * e2y;
+        const float py = dir[2] * e2x - dir[0] * e2z;
+        const float pz = dir[0] * e2y - dir[1] * e2x;
+        const float det = e1x * px + e1y * py + e1z * pz;
+        if( twoSided ? (fabs(det) <= kMinDet) : (det <= kMinDet) )
+            continue;
+        const float invDet = 1.f / det;
+
+        const float sx = from[0] - packet->fVert[0][i];
+        const float sy = from[1] - packet->fVert[1][i];
+        const float sz = from[2] - packet->fVert[2][i];
+        const float u = (sx * px + sy * py + sz * pz) * invDet;
+        if( (u < 0) || (u > 1.f) )
+            continue;
+
+        const float qx = sy * e1z - sz * e1y;
+        const float qy = sz * e1x - sx * e1z;
+        const float qz = sx * e1y - sy * e1x;
+        const float v = (dir[0] * qx + dir[1] * qy + dir[2] * qz) * invDet;
+        if( (v < 0) || (u + v > 1.f) )
+            continue;
+
+        const float dist = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+        if( (dist >= 0) && (dist < maxDist) )
+        {
+            maxDist = dist;
+            hit = i;
+        }
+    }
+    if( hit >= 0 )
+        *t = maxDist;
+    return hit;
+}
+
+static int ray_packet_sse1(const plSpanTriTree::Packet* packet, const float* from, const float* dir, float maxDist, bool twoSided, float* t)
+{
+#ifdef HS_SSE1
+    const __m128 dx = _mm_set1_ps(dir[0]);
+    const __m128 dy = _mm_set1_ps(dir[1]);
+    const __m128 dz = _mm_set1_ps(dir[2]);
+
+    const __m128 e1x = _mm_loadu_ps(packet->fEdge1[0]);
+    const __m128 e1y = _mm_loadu_ps(packet->fEdge1[1]);
+    const __m128 e1z = _mm_loadu_ps(packet->fEdge1[2]);
+    const __m128 e2x = _mm_loadu_ps(packet->fEdge2[0]);
+    const __m128 e2y = _mm_loadu_ps(packet->fEdge2[1]);
+    const __m128 e2z = _mm_loadu_ps(packet->fEdge2[2]);
+
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+    __m128 testDet = det;
+    if( twoSided )
+        testDet = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+    __m128 mask = _mm_cmpgt_ps(testDet, _mm_set1_ps(kMinDet));
+    if( !_mm_movemask_ps(mask) )
+        return -1;
+
+    // Lanes failing the determinant test may divide by zero, they're masked off anyway.
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), _mm_or_ps(_mm_and_ps(mask, det), _mm_andnot_ps(mask, _mm_set1_ps(1.f))));
+
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(from[0]), _mm_loadu_ps(packet->fVert[0]));
+    const __m128 sy = _mm_sub_ps(_mm_set1_ps(from[1]), _mm_loadu_ps(packet->fVert[1]));
+    const __m128 sz = _mm_sub_ps(_mm_set1_ps(from[2]), _mm_loadu_ps(packet->fVert[2]));
+    const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+    const __m128 dist = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+    const __m128 zero = _mm_setzero_ps();
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(dist, zero));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(dist, _mm_set1_ps(maxDist)));
+
+    uint32_t bits = uint32_t(_mm_movemask_ps(mask));
+    if( !bits )
+        return -1;
+
+    float dists[plSpanTriTree::kWidth];
+    _mm_storeu_ps(dists, dist);
+    int hit = -1;
+    int i;
+    for( i = 0; bits; i++, bits >>= 1 )
+    {
+        if( (bits & 1) && (dists[i] < maxDist) )
+        {
+            maxDist = dists[i];
+            hit = i;
+        }
+    }
+    *t = maxDist;
+    return hit;
+#endif  // HS_SSE1
+}
+
+static uint32_t overlap_boxes_fpu(const plSpanTriTree::Node* node, const float* mins, const float* maxs)
+{
+    uint32_t mask = 0;
+    int i;
+    for( i = 0; i < plSpanTriTree::kWidth; i++ )
+    {
+        if( (node->fBounds[0][i] <= maxs[0]) && (node->fBounds[3][i] >= mins[0])
+            && (node->fBounds[1][i] <= maxs[1]) && (node->fBounds[4][i] >= mins[1])
+            && (node->fBounds[2][i] <= maxs[2]) && (node->fBounds[5][i] >= mins[2]) )
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+static uint32_t overlap_boxes_sse1(const plSpanTriTree::Node* node, const float* mins, const float* maxs)
+{
+#ifdef HS_SSE1
+    __m128 in = _mm_cmpge_ps(_mm_loadu_ps(node->fBounds[3]), _mm_set1_ps(mins[0]));
+    int j;
+    for( j = 0; j < 3; j++ )
+    {
+        in = _mm_and_ps(in, _mm_cmple_ps(_mm_loadu_ps(node->fBounds[j]), _mm_set1_ps(maxs[j])));
+        if( j )
+            in = _mm_and_ps(in, _mm_cmpge_ps(_mm_loadu_ps(node->fBounds[j+3]), _mm_set1_ps(mins[j])));
+    }
+    return uint32_t(_mm_movemask_ps(in));
+#endif  // HS_SSE1
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plSpanTriTree::ray_boxes_ptr> plSpanTriTree::ray_boxes {
+    &ray_boxes_fpu,
+    &ray_boxes_sse1,        // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+hsCpuFunctionDispatcher<plSpanTriTree::ray_packet_ptr> plSpanTriTree::ray_packet {
+    &ray_packet_fpu,
+    &ray_packet_sse1,       // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+hsCpuFunctionDispatcher<plSpanTriTree::overlap_boxes_ptr> plSpanTriTree::overlap_boxes {
+    &overlap_boxes_fpu,
+    &overlap_boxes_sse1,    // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+void plSpanTriTree::Reset()
+{
+    fNodes.clear();
+    fPackets.clear();
+    fNumTris = 0;
+}
+
+void plSpanTriTree::Build(const plAccessTriSpan& src)
+{
+    Reset();
+
+    fNumTris = src.TriCount();
+    if( !fNumTris )
+        return;
+
+    plProfile_Inc(TriTreesBuilt);
+
+    std::vector<uint32_t> tris(fNumTris);
+    std::vector<hsPoint3> centers(fNumTris);
+    uint32_t i;
+    for( i = 0; i < fNumTris; i++ )
+    {
+        const uint16_t* idx = src.fTris + i * 3;
+        tris[i] = i;
+        centers[i] = (src.PositionOff(idx[0]) + src.PositionOff(idx[1]) + src.PositionOff(idx[2])) * (1.f / 3.f);
+    }
+
+    fNodes.reserve(fNumTris / kWidth + 1);
+    fPackets.reserve(fNumTris / kWidth + kWidth);
+
+    // The root is always a node, even over a single packet, so Intersect
+    // has only one way in.
+    if( fNumTris <= kWidth )
+    {
+        fNodes.push_back(Node());
+        Node& root = fNodes[0];
+        root.fChild[0] = IMakePacket(tris, src, 0, fNumTris);
+        ISetChildBounds(root, 0, tris, src, 0, fNumTris);
+        for( i = 1; i < kWidth; i++ )
+            ISetChildBounds(root, i, tris, src, 0, 0);
+        return;
+    }
+    IBuildRecur(tris, centers, src, 0, fNumTris);
+}
+
+void plSpanTriTree::ISetChildBounds(Node& node, int i, const std::vector<uint32_t>& tris,
+                                    const plAccessTriSpan& src, uint32_t begin, uint32_t end) const
+{
+    if( begin == end )
+    {
+        node.fChild[i] = kEmptyChild;
+        int j;
+        for( j = 0; j < 6; j++ )
+            node.fBounds[j][i] = 0;
+        return;
+    }
+
+    float mins[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxs[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    uint32_t k;
+    for( k = begin; k < end; k++ )
+    {
+        const uint16_t* idx = src.fTris + tris[k] * 3;
+        int v;
+        for( v = 0; v < 3; v++ )
+        {
+            const hsPoint3& pos = src.PositionOff(idx[v]);
+            mins[0] = std::min(mins[0], pos.fX);
+            mins[1] = std::min(mins[1], pos.fY);
+            mins[2] = std::min(mins[2], pos.fZ);
+            maxs[0] = std::max(maxs[0], pos.fX);
+            maxs[1] = std::max(maxs[1], pos.fY);
+            maxs[2] = std::max(maxs[2], pos.fZ);
+        }
+    }
+    int j;
+    for( j = 0; j < 3; j++ )
+    {
+        node.fBounds[j][i] = mins[j];
+        node.fBounds[j+3][i] = maxs[j];
+    }
+}
+
+int32_t plSpanTriTree::IMakePacket(const std::vector<uint32_t>& tris, const plAccessTriSpan& src,
+                                   uint32_t begin, uint32_t end)
+{
+    hsAssert(end - begin <= kWidth, "Too many triangles for one packet");
+
+    const int32_t idx = int32_t(fPackets.size());
+    fPackets.push_back(Packet());
+    Packet& packet = fPackets.back();
+    memset(&packet, 0, sizeof(packet));
+
+    int i;
+    for( i = 0; i < kWidth; i++ )
+        packet.fTri[i] = kNoTri;
+    for( i = 0; begin + i < end; i++ )
+    {
+        packet.fTri[i] = tris[begin + i];
+        const uint16_t* tri = src.fTris + tris[begin + i] * 3;
+        const hsPoint3& p0 = src.PositionOff(tri[0]);
+        const hsPoint3& p1 = src.PositionOff(tri[1]);
+        const hsPoint3& p2 = src.PositionOff(tri[2]);
+
+        packet.fVert[0][i] = p0.fX;
+        packet.fVert[1][i] = p0.fY;
+        packet.fVert[2][i] = p0.fZ;
+        packet.fEdge1[0][i] = p1.fX - p0.fX;
+        packet.fEdge1[1][i] = p1.fY - p0.fY;
+        packet.fEdge1[2][i] = p1.fZ - p0.fZ;
+        packet.fEdge2[0][i] = p2.fX - p0.fX;
+        packet.fEdge2[1][i] = p2.fY - p0.fY;
+        packet.fEdge2[2][i] = p2.fZ - p0.fZ;
+    }
+    return ~idx;
+}
+
+int32_t plSpanTriTree::IBuildRecur(std::vector<uint32_t>& tris, const std::vector<hsPoint3>& centers,
+                                   const plAccessTriSpan& src, uint32_t begin, uint32_t end)
+{
+    // Carve the range into up to four, always halving the biggest piece at
+    // the centroid median along its longest axis. Splits are rounded to
+    // whole packets so the leaves come out full.
+    uint32_t lo[kWidth];
+    uint32_t hi[kWidth];
+    int numRanges = 1;
+    lo[0] = begin;
+    hi[0] = end;
+    while( numRanges < kWidth )
+    {
+        int biggest = 0;
+        int i;
+        for( i = 1; i < numRanges; i++ )
+        {
+            if( hi[i] - lo[i] > hi[biggest] - lo[biggest] )
+                biggest = i;
+        }
+        const uint32_t count = hi[biggest] - lo[biggest];
+        if( count <= kWidth )
+            break;
+
+        hsPoint3 cMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        hsPoint3 cMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        uint32_t k;
+        for( k = lo[biggest]; k < hi[biggest]; k++ )
+        {
+            const hsPoint3& c = centers[tris[k]];
+            cMin.Set(std::min(cMin.fX, c.fX), std::min(cMin.fY, c.fY), std::min(cMin.fZ, c.fZ));
+            cMax.Set(std::max(cMax.fX, c.fX), std::max(cMax.fY, c.fY), std::max(cMax.fZ, c.fZ));
+        }
+        const hsVector3 extent(&cMax, &cMin);
+        int axis = 0;
+        if( extent.fY > extent[axis] )
+            axis = 1;
+        if( extent.fZ > extent[axis] )
+            axis = 2;
+
+        const uint32_t mid = lo[biggest] + ((count / 2 + kWidth - 1) / kWidth) * kWidth;
+        std::nth_element(tris.begin() + lo[biggest], tris.begin() + mid, tris.begin() + hi[biggest],
+            [&centers, axis](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+        lo[numRanges] = mid;
+        hi[numRanges] = hi[biggest];
+        hi[biggest] = mid;
+        numRanges++;
+    }
+
+    const int32_t idx = int32_t(fNodes.size());
+    fNodes.push_back(Node());
+
+    int i;
+    for( i = 0; i < kWidth; i++ )
+    {
+        int32_t child = kEmptyChild;
+        if( i < numRanges )
+        {
+            if( hi[i] - lo[i] <= kWidth )
+                child = IMakePacket(tris, src, lo[i], hi[i]);
+            else
+                child = IBuildRecur(tris, centers, src, lo[i], hi[i]);
+        }
+
+        // The recursion may have moved the node array.
+        Node& node = fNodes[idx];
+        if( i < numRanges )
+        {
+            ISetChildBounds(node, i, tris, src, lo[i], hi[i]);
+            node.fChild[i] = child;
+        }
+        else
+            ISetChildBounds(node, i, tris, src, 0, 0);
+    }
+    return idx;
+}
+
+bool plSpanTriTree::Intersect(const hsPoint3& from, const hsVector3& dir, bool twoSided, float& maxDist) const
+{
+    if( fNodes.empty() )
+        return false;
+
+    const float f[3] = { from.fX, from.fY, from.fZ };
+    const float d[3] = { dir.fX, dir.fY, dir.fZ };
+    float invDir[3];
+    int i;
+    for( i = 0; i < 3; i++ )
+    {
+        float comp = d[i];
+        if( fabs(comp) < kMinDirComp )
+            comp = comp < 0 ? -kMinDirComp : kMinDirComp;
+        invDir[i] = 1.f / comp;
+    }
+
+    int32_t stack[kMaxStack];
+    float stackDist[kMaxStack];
+    int numStack = 0;
+    stack[numStack] = 0;
+    stackDist[numStack++] = 0;
+
+    bool retVal = false;
+    while( numStack )
+    {
+        --numStack;
+        const int32_t who = stack[numStack];
+        if( stackDist[numStack] > maxDist )
+            continue;
+
+        if( who < 0 )
+        {
+            float t;
+            if( ray_packet.call(&fPackets[~who], f, d, maxDist, twoSided, &t) >= 0 )
+            {
+                maxDist = t;
+                retVal = true;
+            }
+            continue;
+        }
+
+        const Node& node = fNodes[who];
+        float tNear[kWidth];
+        uint32_t mask = ray_boxes.call(&node, f, invDir, maxDist, tNear);
+
+        // Push the hits farthest first, so the nearest comes off next and
+        // pulls maxDist in before the others are looked at.
+        int order[kWidth];
+        int numHit = 0;
+        for( i = 0; i < kWidth; i++ )
+        {
+            if( !(mask & (1 << i)) || (node.fChild[i] == kEmptyChild) )
+                continue;
+            int j = numHit++;
+            for( ; (j > 0) && (tNear[order[j-1]] < tNear[i]); j-- )
+                order[j] = order[j-1];
+            order[j] = i;
+        }
+        hsAssert(numStack + numHit <= kMaxStack, "Span tri tree too deep");
+        for( i = 0; i < numHit; i++ )
+        {
+            stack[numStack] = node.fChild[order[i]];
+            stackDist[numStack++] = tNear[order[i]];
+        }
+    }
+    return retVal;
+}
+
+void plSpanTriTree::Overlap(const hsPoint3& mins, const hsPoint3& maxs, std::vector<uint32_t>& tris) const
+{
+    tris.clear();
+    if( fNodes.empty() )
+        return;
+
+    const float lo[3] = { mins.fX, mins.fY, mins.fZ };
+    const float hi[3] = { maxs.fX, maxs.fY, maxs.fZ };
+
+    int32_t stack[kMaxStack];
+    int numStack = 0;
+    stack[numStack++] = 0;
+    while( numStack )
+    {
+        const Node& node = fNodes[stack[--numStack]];
+        uint32_t mask = overlap_boxes.call(&node, lo, hi);
+        int i;
+        for( i = 0; mask; i++, mask >>= 1 )
+        {
+            if( !(mask & 1) || (node.fChild[i] == kEmptyChild) )
+                continue;
+
+            if( node.fChild[i] >= 0 )
+            {
+                hsAssert(numStack < kMaxStack, "Span tri tree too deep");
+                stack[numStack++] = node.fChild[i];
+                continue;
+            }
+
+            const Packet& packet = fPackets[~node.fChild[i]];
+            int j;
+            for( j = 0; (j < kWidth) && (packet.fTri[j] != kNoTri); j++ )
+                tris.push_back(packet.fTri[j]);
+        }
+    }
+}
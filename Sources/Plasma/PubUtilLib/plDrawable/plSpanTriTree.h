@@ -0,0 +1,143 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plSpanTriTree_inc
+#define plSpanTriTree_inc
+
+#include "hsCpuID.h"
+#include "hsGeometry3.h"
+
+#include <vector>
+
+class plAccessTriSpan;
+
+// A bounding volume hierarchy over the triangles of a single icicle span, in
+// the span's local space, for ray picking without walking every triangle.
+// Nodes have four children with their boxes stored side by side, and leaves
+// are packets of up to four triangles laid out the same way, so both tests
+// go four at a time. Built lazily by plVisLOSMgr and hung off the plIcicle,
+// which drops it whenever its vertices are opened for writing. The decal
+// managers use the same tree to find the triangles under a plCutter.
+class plSpanTriTree
+{
+public:
+    enum
+    {
+        kWidth          = 4,
+        kEmptyChild     = 0x7fffffff
+    };
+
+    // Each of fBounds is one of min x, y, z, max x, y, z for the four
+    // children. Children >= 0 are nodes, otherwise ~child is a packet.
+    struct Node
+    {
+        float       fBounds[6][kWidth];
+        int32_t     fChild[kWidth];
+    };
+
+    // First vertex and the two edges leaving it, for each of four triangles,
+    // and which triangles of the span they are. Unused slots are zero, which
+    // no ray ever hits, and have kNoTri for their index.
+    struct Packet
+    {
+        float       fVert[3][kWidth];
+        float       fEdge1[3][kWidth];
+        float       fEdge2[3][kWidth];
+        uint32_t    fTri[kWidth];
+    };
+
+    static const uint32_t kNoTri = 0xffffffff;
+
+protected:
+    std::vector<Node>       fNodes;
+    std::vector<Packet>     fPackets;
+    uint32_t                fNumTris;
+
+    int32_t         IBuildRecur(std::vector<uint32_t>& tris, const std::vector<hsPoint3>& centers,
+                                const plAccessTriSpan& src, uint32_t begin, uint32_t end);
+    int32_t         IMakePacket(const std::vector<uint32_t>& tris, const plAccessTriSpan& src,
+                                uint32_t begin, uint32_t end);
+    void            ISetChildBounds(Node& node, int i, const std::vector<uint32_t>& tris,
+                                    const plAccessTriSpan& src, uint32_t begin, uint32_t end) const;
+
+public:
+    plSpanTriTree() : fNumTris(0) {}
+
+    void            Build(const plAccessTriSpan& src);
+    void            Reset();
+
+    uint32_t        GetNumTris() const { return fNumTris; }
+    uint32_t        GetNumNodes() const { return uint32_t(fNodes.size()); }
+    bool            IsEmpty() const { return fPackets.empty(); }
+
+    /**
+     * Find the nearest triangle the segment from + dir * [0, maxDist] hits,
+     * dir being unit length. Back faces are only hit when twoSided is set.
+     * On a hit maxDist is pulled in to the hit distance and true returned.
+     */
+    bool            Intersect(const hsPoint3& from, const hsVector3& dir, bool twoSided, float& maxDist) const;
+
+    /**
+     * Fill tris with the index of every triangle whose packet's bounds
+     * overlap the box, in no particular order. A few near misses come along
+     * with the packets they share.
+     */
+    void            Overlap(const hsPoint3& mins, const hsPoint3& maxs, std::vector<uint32_t>& tris) const;
+
+    //  CPU-optimized functions
+    // Slab test of the ray against the four child boxes of node, invDir
+    // being the componentwise reciprocal of the direction. Returns a bit
+    // per child hit within [0, maxDist], and each one's entry distance.
+    typedef uint32_t(*ray_boxes_ptr)(const Node* node, const float* from, const float* invDir, float maxDist, float* tNear);
+    static hsCpuFunctionDispatcher<ray_boxes_ptr> ray_boxes;
+
+    // Ray against the four triangles of packet. Returns the slot of the
+    // nearest hit closer than maxDist, storing its distance in t, or -1.
+    typedef int(*ray_packet_ptr)(const Packet* packet, const float* from, const float* dir, float maxDist, bool twoSided, float* t);
+    static hsCpuFunctionDispatcher<ray_packet_ptr> ray_packet;
+
+    // Returns a bit per child of node whose box overlaps [mins, maxs].
+    typedef uint32_t(*overlap_boxes_ptr)(const Node* node, const float* mins, const float* maxs);
+    static hsCpuFunctionDispatcher<overlap_boxes_ptr> overlap_boxes;
+};
+
+#endif // plSpanTriTree_inc
@@ -58,6 +58,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plGLight/plLightInfo.h"
 #include "plDrawable.h"
 #include "plAuxSpan.h"
+#include "plAccessTriSpan.h"
+#include "plSpanTriTree.h"
 #include "plAccessSnapShot.h"
 
 /////////////////////////////////////////////////////////////////////////////
@@ -466,6 +468,31 @@ void    plIcicle::Destroy( void )
     plSpan::Destroy();
     delete [] fSortData;
     fSortData = nil;
+    DirtyTriTree();
+}
+
+//// GetTriTree //////////////////////////////////////////////////////////////
+
+plSpanTriTree*  plIcicle::GetTriTree( const plAccessTriSpan& tris )
+{
+    // Anything that rewrites the vertices through plAccessGeometry throws the
+    // tree away, but check the count too in case the indices were swapped out
+    // from under us some other way.
+    if( !fTriTree || ( fTriTree->GetNumTris() != tris.TriCount() ) )
+    {
+        if( !fTriTree )
+            fTriTree = new plSpanTriTree;
+        fTriTree->Build( tris );
+    }
+    return fTriTree;
+}
+
+//// DirtyTriTree ////////////////////////////////////////////////////////////
+
+void    plIcicle::DirtyTriTree( void )
+{
+    delete fTriTree;
+    fTriTree = nil;
 }
 
 //// CanMergeInto ////////////////////////////////////////////////////////////
@@ -510,6 +537,7 @@ plIcicle::plIcicle()
     fTypeMask |= kIcicleSpan;
 
     fSortData = nil;
+    fTriTree = nil;
 }
 
 //////////////////////////////////////////////////////////////////////////////
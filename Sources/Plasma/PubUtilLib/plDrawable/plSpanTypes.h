@@ -70,6 +70,8 @@ class plShadowSlave;
 class plAuxSpan;
 class plAccessSnapShot;
 class plDrawableSpans;
+class plSpanTriTree;
+class plAccessTriSpan;
 
 //// plSpan Class Definition /////////////////////////////////////////////////
 //  Represents the generic span for any kind of drawableMatter derivative.
@@ -254,6 +256,7 @@ class plIcicle : public plVertexSpan
 
         // Run-time-only stuff
         plGBufferTriangle   *fSortData; // Indices & center points for sorting tris in this span (optional)
+        plSpanTriTree       *fTriTree;  // Built on demand for LOS picking, nil until then
 
         plIcicle();
 
@@ -263,6 +266,12 @@ class plIcicle : public plVertexSpan
         virtual bool    CanMergeInto( plSpan* other );
         virtual void    MergeInto( plSpan* other );
         virtual void    Destroy( void );
+
+        // The pick tree over tris, built on first use. tris must be this span's.
+        plSpanTriTree*  GetTriTree( const plAccessTriSpan& tris );
+
+        // Throw away the pick tree, the triangles under it have moved
+        void            DirtyTriTree( void );
 };
 
 //// plParticleSpan Class Definition /////////////////////////////////////////
@@ -44,9 +44,15 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plVertCoder.h"
 
 #include "hsStream.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include "plGBufferGroup.h"
 
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
 const float kPosQuantum = 1.f / float(1 << 10);
 const float kWeightQuantum = 1.f / float(1 << 15);
 const float kUVWQuantum = 1.f / float(1 << 16);
@@ -56,6 +62,8 @@ uint32_t  plVertCoder::fCodedBytes = 0;
 uint32_t  plVertCoder::fRawBytes = 0;
 uint32_t  plVertCoder::fSkippedBytes = 0;
 
+bool      plVertCoder::fBulkDecode = true;
+
 static const float kQuanta[plVertCoder::kNumFloatFields] =
 {
     kPosQuantum,
@@ -279,6 +287,10 @@ inline void plVertCoder::IEncodeByte(hsStream* s, const int chan, const uint32_t
     if( !fColors[chan].fCount )
     {
         ICountBytes(vertsLeft, src, stride, fColors[chan].fCount, fColors[chan].fSame);
+        // The top bit of the coded count is the same flag, so longer runs
+        // have to be split.
+        if( fColors[chan].fCount > uint16_t(~kSameMask) )
+            fColors[chan].fCount = uint16_t(~kSameMask);
 
         uint16_t cnt = fColors[chan].fCount;
         if( fColors[chan].fSame )
@@ -419,13 +431,321 @@ inline void plVertCoder::IDecode(hsStream* s, uint8_t*& dst, const uint32_t stri
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+uint16_t plVertCoder::IRunLength(const uint8_t format) const
+{
+    uint16_t len = fFloats[kPosition][0].fCount;
+    int i, j;
+    for( j = 1; j < 3; j++ )
+        len = std::min(len, fFloats[kPosition][j].fCount);
+
+    const int numWeights = INumWeights(format);
+    for( j = 0; j < numWeights; j++ )
+        len = std::min(len, fFloats[kWeight][j].fCount);
+
+    for( j = 0; j < 4; j++ )
+        len = std::min(len, fColors[j].fCount);
+
+    const int numUVWs = format & plGBufferGroup::kUVCountMask;
+    for( i = 0; i < numUVWs; i++ )
+    {
+        for( j = 0; j < 3; j++ )
+            len = std::min(len, fFloats[kUVW + i][j].fCount);
+    }
+    return len;
+}
+
+void plVertCoder::IEndRun(const uint8_t format, const uint16_t len)
+{
+    int i, j;
+    for( j = 0; j < 3; j++ )
+        fFloats[kPosition][j].fCount -= len;
+
+    const int numWeights = INumWeights(format);
+    for( j = 0; j < numWeights; j++ )
+        fFloats[kWeight][j].fCount -= len;
+
+    for( j = 0; j < 4; j++ )
+        fColors[j].fCount -= len;
+
+    const int numUVWs = format & plGBufferGroup::kUVCountMask;
+    for( i = 0; i < numUVWs; i++ )
+    {
+        for( j = 0; j < 3; j++ )
+            fFloats[kUVW + i][j].fCount -= len;
+    }
+}
+
+void plVertCoder::IAddFloatGroup(RunLayout& layout, const int field, const int numChans, uint32_t& src, uint32_t& dst) const
+{
+    RunLayout::FloatGroup& grp = layout.fFloats[layout.fNumFloatGroups++];
+    grp.fDstOffset = dst;
+    grp.fSrcOffset = src;
+    grp.fNumChans = numChans;
+    memset(grp.fShuffle, 0x80, sizeof(grp.fShuffle));
+
+    int i;
+    for( i = 0; i < 4; i++ )
+    {
+        const FloatCode* code = i < numChans ? &fFloats[field][i] : nil;
+        if( code && !code->fAllSame )
+        {
+            const uint32_t chanSrc = src - grp.fSrcOffset;
+            grp.fChanSrc[i] = chanSrc;
+            grp.fScale[i] = kQuanta[field];
+            grp.fCodedMask[i] = ~0u;
+            grp.fShuffle[i * 4 + 0] = uint8_t(chanSrc);
+            grp.fShuffle[i * 4 + 1] = uint8_t(chanSrc + 1);
+            src += 2;
+        }
+        else
+        {
+            grp.fChanSrc[i] = -1;
+            grp.fScale[i] = 0;
+            grp.fCodedMask[i] = 0;
+        }
+        grp.fBias[i] = code ? code->fOffset : 0;
+    }
+    dst += numChans * sizeof(float);
+}
+
+void plVertCoder::IBuildRunLayout(RunLayout& layout, const uint8_t format) const
+{
+    // Same order IDecode reads the fields in
+    uint32_t src = 0;
+    uint32_t dst = 0;
+    layout.fNumFloatGroups = 0;
+
+    IAddFloatGroup(layout, kPosition, 3, src, dst);
+
+    layout.fIdxSrc = -1;
+    layout.fIdxDst = 0;
+    const int numWeights = INumWeights(format);
+    if( numWeights )
+    {
+        IAddFloatGroup(layout, kWeight, numWeights, src, dst);
+
+        if( format & plGBufferGroup::kSkinIndices )
+        {
+            layout.fIdxSrc = src;
+            layout.fIdxDst = dst;
+            src += 4;
+            dst += 4;
+        }
+    }
+
+    layout.fNormSrc = src;
+    layout.fNormDst = dst;
+    src += 3;
+    dst += 3 * sizeof(float);
+
+    layout.fColorSrc = src;
+    layout.fColorDst = dst;
+    memset(layout.fColorShuffle, 0x80, sizeof(layout.fColorShuffle));
+    int i;
+    for( i = 0; i < 4; i++ )
+    {
+        if( fColors[i].fSame )
+        {
+            layout.fColorChanSrc[i] = -1;
+            layout.fColorSame[i] = fColors[i].fVal;
+        }
+        else
+        {
+            layout.fColorChanSrc[i] = src - layout.fColorSrc;
+            layout.fColorSame[i] = 0;
+            layout.fColorShuffle[i] = uint8_t(src - layout.fColorSrc);
+            src++;
+        }
+    }
+    dst += 4;
+
+    layout.fColor2Dst = dst;
+    dst += 4;
+
+    const int numUVWs = format & plGBufferGroup::kUVCountMask;
+    for( i = 0; i < numUVWs; i++ )
+        IAddFloatGroup(layout, kUVW + i, 3, src, dst);
+
+    layout.fRecordSize = src;
+    layout.fVertSize = dst;
+}
+
+static void decode_run_fpu(const plVertCoder::RunLayout& layout, const uint8_t* src, uint8_t* dst, uint32_t stride, uint32_t count)
+{
+    uint32_t v;
+    for( v = 0; v < count; v++ )
+    {
+        uint32_t g, i;
+        for( g = 0; g < layout.fNumFloatGroups; g++ )
+        {
+            const plVertCoder::RunLayout::FloatGroup& grp = layout.fFloats[g];
+            float* val = (float*)(dst + grp.fDstOffset);
+            for( i = 0; i < grp.fNumChans; i++ )
+            {
+                if( grp.fChanSrc[i] < 0 )
+                    val[i] = grp.fBias[i];
+                else
+                {
+                    uint16_t ival;
+                    memcpy(&ival, src + grp.fSrcOffset + grp.fChanSrc[i], sizeof(ival));
+                    float fval = float(hsToLE16(ival)) * grp.fScale[i];
+                    fval += grp.fBias[i];
+                    val[i] = fval;
+                }
+            }
+        }
+
+        if( layout.fIdxSrc >= 0 )
+        {
+            uint32_t idx;
+            memcpy(&idx, src + layout.fIdxSrc, sizeof(idx));
+            *(uint32_t*)(dst + layout.fIdxDst) = hsToLE32(idx);
+        }
+
+        float* norm = (float*)(dst + layout.fNormDst);
+        for( i = 0; i < 3; i++ )
+            norm[i] = (src[layout.fNormSrc + i] / 255.9f - .5f) * 2.f;
+
+        uint8_t* color = dst + layout.fColorDst;
+        for( i = 0; i < 4; i++ )
+            color[i] = layout.fColorChanSrc[i] < 0 ? layout.fColorSame[i] : src[layout.fColorSrc + layout.fColorChanSrc[i]];
+
+        *(uint32_t*)(dst + layout.fColor2Dst) = 0;
+
+        src += layout.fRecordSize;
+        dst += stride;
+    }
+}
+
+static void decode_run_ssse3(const plVertCoder::RunLayout& layout, const uint8_t* src, uint8_t* dst, uint32_t stride, uint32_t count)
+{
+#ifdef HS_SSSE3
+    // Each float group is one 16 byte load, shuffled so the coded values land
+    // zero extended in their lanes, then scaled and offset in one go. All same
+    // channels are blended in from the bias, so they come out exactly as the
+    // run offset the same as IDecodeFloat leaves them.
+    const __m128 normScale = _mm_set1_ps(255.9f);
+    const __m128 normBias = _mm_set1_ps(.5f);
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128i normShuffle = _mm_setr_epi8(0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i colorShuffle = _mm_loadu_si128((const __m128i*)layout.fColorShuffle);
+    uint32_t colorSame;
+    memcpy(&colorSame, layout.fColorSame, sizeof(colorSame));
+    const __m128i colorBias = _mm_cvtsi32_si128(colorSame);
+
+    uint32_t v;
+    for( v = 0; v < count; v++ )
+    {
+        uint32_t g;
+        for( g = 0; g < layout.fNumFloatGroups; g++ )
+        {
+            const plVertCoder::RunLayout::FloatGroup& grp = layout.fFloats[g];
+            __m128i raw = _mm_loadu_si128((const __m128i*)(src + grp.fSrcOffset));
+            __m128i ival = _mm_shuffle_epi8(raw, _mm_loadu_si128((const __m128i*)grp.fShuffle));
+            __m128 bias = _mm_loadu_ps(grp.fBias);
+            __m128 fval = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(ival), _mm_loadu_ps(grp.fScale)), bias);
+            __m128 coded = _mm_loadu_ps((const float*)grp.fCodedMask);
+            fval = _mm_or_ps(_mm_and_ps(coded, fval), _mm_andnot_ps(coded, bias));
+
+            float* val = (float*)(dst + grp.fDstOffset);
+            if( grp.fNumChans == 3 )
+            {
+                _mm_storel_pi((__m64*)val, fval);
+                _mm_store_ss(val + 2, _mm_movehl_ps(fval, fval));
+            }
+            else if( grp.fNumChans == 2 )
+                _mm_storel_pi((__m64*)val, fval);
+            else
+                _mm_store_ss(val, fval);
+        }
+
+        if( layout.fIdxSrc >= 0 )
+            memcpy(dst + layout.fIdxDst, src + layout.fIdxSrc, sizeof(uint32_t));
+
+        __m128i rawNorm = _mm_loadu_si128((const __m128i*)(src + layout.fNormSrc));
+        __m128 norm = _mm_cvtepi32_ps(_mm_shuffle_epi8(rawNorm, normShuffle));
+        norm = _mm_mul_ps(_mm_sub_ps(_mm_div_ps(norm, normScale), normBias), two);
+        float* normDst = (float*)(dst + layout.fNormDst);
+        _mm_storel_pi((__m64*)normDst, norm);
+        _mm_store_ss(normDst + 2, _mm_movehl_ps(norm, norm));
+
+        __m128i rawColor = _mm_loadu_si128((const __m128i*)(src + layout.fColorSrc));
+        uint32_t color = _mm_cvtsi128_si32(_mm_or_si128(_mm_shuffle_epi8(rawColor, colorShuffle), colorBias));
+        memcpy(dst + layout.fColorDst, &color, sizeof(color));
+
+        *(uint32_t*)(dst + layout.fColor2Dst) = 0;
+
+        src += layout.fRecordSize;
+        dst += stride;
+    }
+#endif  // HS_SSSE3
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plVertCoder::decode_run_ptr> plVertCoder::decode_run {
+    &decode_run_fpu,
+    nullptr,                // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    &decode_run_ssse3,      // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+// Shorter runs than this aren't worth laying out, they just go field by field
+static const uint16_t kMinBulkRun = 4;
+
 void plVertCoder::Read(hsStream* s, uint8_t* dst, const uint8_t format, const uint32_t stride, const uint16_t numVerts)
 {
     Clear();
 
-    int i = numVerts;
-    for( i = 0; i < numVerts; i++ )
+    if( !fBulkDecode )
+    {
+        int i;
+        for( i = 0; i < numVerts; i++ )
+            IDecode(s, dst, stride, format);
+        return;
+    }
+
+    RunLayout layout;
+    uint32_t numLeft = numVerts;
+    while( numLeft )
+    {
+        // A vertex that starts a new run on any channel has that run's header
+        // coded in front of its value, so it goes the slow way.
         IDecode(s, dst, stride, format);
+        numLeft--;
+
+        // Every channel is inside a run now, so up to the end of the shortest
+        // one the vertices are fixed size records with no headers in between.
+        uint16_t len = IRunLength(format);
+        if( len > numLeft )
+            len = (uint16_t)numLeft;
+        if( len < kMinBulkRun )
+            continue;
+
+        IBuildRunLayout(layout, format);
+        hsAssert(layout.fVertSize == stride, "Vertex format doesn't match stride");
+
+        const uint32_t size = len * layout.fRecordSize;
+        const uint8_t* src = (const uint8_t*)s->ReadInPlace(size, kRunSlack);
+        if( !src )
+        {
+            if( fStage.size() < size + kRunSlack )
+                fStage.resize(size + kRunSlack);
+            s->Read(size, fStage.data());
+            src = fStage.data();
+        }
+
+        decode_run.call(layout, src, dst, stride, len);
+        IEndRun(format, len);
+
+        dst += len * stride;
+        numLeft -= len;
+    }
 }
 
 
@@ -458,6 +778,7 @@ plVertCoder::~plVertCoder()
 
 void plVertCoder::Clear()
 {
-    memset(this, 0, sizeof(*this));
+    memset(fFloats, 0, sizeof(fFloats));
+    memset(fColors, 0, sizeof(fColors));
 }
 
@@ -43,6 +43,10 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #ifndef plVertCoder_inc
 #define plVertCoder_inc
 
+#include "hsCpuID.h"
+
+#include <vector>
+
 class hsStream;
 
 class plVertCoder
@@ -55,6 +59,50 @@ public:
         kNumFloatFields = kUVW + 8
     };
 
+    // Once every channel is in the middle of a run, no run headers come
+    // between the coded vertices, and each is a fixed size record up to the
+    // end of the shortest run. This is where the fields sit in that record
+    // (src) and in the vertex (dst), so a whole stretch can be expanded at once.
+    class RunLayout
+    {
+    public:
+        enum { kMaxFloatGroups = 2 + 8 }; // position, weights, one per uvw
+
+        // Up to 3 consecutive float channels of one field
+        class FloatGroup
+        {
+        public:
+            uint32_t    fDstOffset;
+            uint32_t    fSrcOffset;     // of the group's first coded value
+            uint32_t    fNumChans;
+            int32_t     fChanSrc[4];    // relative to fSrcOffset, -1 if all same
+            float       fScale[4];      // quantum, 0 if all same
+            float       fBias[4];       // run offset
+            uint32_t    fCodedMask[4];  // ~0 if coded, 0 if all same
+            uint8_t     fShuffle[16];   // coded values out of a 16 byte load at fSrcOffset
+        };
+
+        FloatGroup  fFloats[kMaxFloatGroups];
+        uint32_t    fNumFloatGroups;
+
+        int32_t     fIdxSrc;            // skin indices, -1 if none
+        uint32_t    fIdxDst;
+        uint32_t    fNormSrc;
+        uint32_t    fNormDst;
+        uint32_t    fColorSrc;
+        uint32_t    fColorDst;
+        int32_t     fColorChanSrc[4];   // relative to fColorSrc, -1 if all same
+        uint8_t     fColorSame[4];
+        uint8_t     fColorShuffle[16];  // coded channels out of a 16 byte load at fColorSrc
+        uint32_t    fColor2Dst;
+        uint32_t    fRecordSize;
+        uint32_t    fVertSize;
+    };
+
+    // Coded records are read 16 bytes at a time, so this much must be
+    // readable past the end of a run.
+    enum { kRunSlack = 16 };
+
 protected:
 
     class FloatCode
@@ -77,11 +125,16 @@ protected:
 
     byteCode        fColors[4];
 
+    // Coded runs that aren't in the stream's read window are read in here
+    std::vector<uint8_t> fStage;
+
     static uint32_t   fCodedVerts;
     static uint32_t   fCodedBytes;
     static uint32_t   fRawBytes;
     static uint32_t   fSkippedBytes;
 
+    static bool       fBulkDecode;
+
     inline void ICountFloats(const uint8_t* src, uint16_t maxCnt, const float quant, const uint32_t stride, float& lo, bool& allSame, uint16_t& count);
     inline void IEncodeFloat(hsStream* s, const uint32_t vertsLeft, const int field, const int chan, const uint8_t*& src, const uint32_t stride);
     inline void IDecodeFloat(hsStream* s, const int field, const int chan, uint8_t*& dst, const uint32_t stride);
@@ -98,6 +151,11 @@ protected:
     inline void IEncode(hsStream* s, const uint32_t vertsLeft, const uint8_t*& src, const uint32_t stride, const uint8_t format);
     inline void IDecode(hsStream* s, uint8_t*& dst, const uint32_t stride, const uint8_t format);
 
+    uint16_t    IRunLength(const uint8_t format) const;
+    void        IEndRun(const uint8_t format, const uint16_t len);
+    void        IAddFloatGroup(RunLayout& layout, const int field, const int numChans, uint32_t& src, uint32_t& dst) const;
+    void        IBuildRunLayout(RunLayout& layout, const uint8_t format) const;
+
 public:
     plVertCoder();
     ~plVertCoder();
@@ -117,6 +175,16 @@ public:
 
     static uint32_t SkippedBytes() { return fSkippedBytes; }
     static void AddSkippedBytes(uint32_t f) { fSkippedBytes += f; }
+
+    // Expand header free runs in bulk, instead of a field at a time off the stream
+    static void SetBulkDecode(bool on) { fBulkDecode = on; }
+    static bool GetBulkDecode() { return fBulkDecode; }
+
+    //  CPU-optimized functions
+    // Expands count fixed size records, packed back to back at src, into
+    // vertices stride apart at dst.
+    typedef void(*decode_run_ptr)(const RunLayout& layout, const uint8_t* src, uint8_t* dst, uint32_t stride, uint32_t count);
+    static hsCpuFunctionDispatcher<decode_run_ptr> decode_run;
 };
 
 #endif // plVertCoder_inc
@@ -50,6 +50,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plDrawableSpans.h"
 #include "plAccessGeometry.h"
 #include "plAccessSpan.h"
+#include "plSpanTriTree.h"
 
 #include "plSurface/hsGMaterial.h"
 #include "plSurface/plLayerInterface.h"
@@ -71,6 +72,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include <algorithm>
 #include <functional>
 
+bool plVisLOSMgr::fUseTriTrees = true;
+
 plVisLOSMgr* plVisLOSMgr::Instance()
 {
     static plVisLOSMgr inst;
@@ -247,7 +250,8 @@ bool plVisLOSMgr::ICheckDrawable(plDrawable* d, plVisHit& hit)
 
 bool plVisLOSMgr::ICheckSpan(plDrawableSpans* dr, uint32_t spanIdx, plVisHit& hit)
 {
-    if( !(dr->GetSpan(spanIdx)->fTypeMask & plSpan::kIcicleSpan) )
+    plSpan* span = dr->GetSpanArray()[spanIdx];
+    if( !(span->fTypeMask & plSpan::kIcicleSpan) )
         return false;
 
     plAccessSpan src;
@@ -255,8 +259,6 @@ bool plVisLOSMgr::ICheckSpan(plDrawableSpans* dr, uint32_t spanIdx, plVisHit& hi
 
     const bool twoSided = !!(src.GetMaterial()->GetLayer(0)->GetMiscFlags() & hsGMatState::kMiscTwoSided);
 
-    bool retVal = false;
-
     // We move into local space, look for hits, and convert the closest we find 
     // (if any) back into world space at the end.
     hsPoint3 currFrom = src.GetWorldToLocal() * fCurrFrom;
@@ -267,6 +269,41 @@ bool plVisLOSMgr::ICheckSpan(plDrawableSpans* dr, uint32_t spanIdx, plVisHit& hi
 
     currDir /= maxDist;
 
+    // Particles are rewritten every frame, no point building a tree over them.
+    bool retVal;
+    if( fUseTriTrees && !(span->fTypeMask & plSpan::kParticleSpan) )
+        retVal = ICheckTriTree((plIcicle*)span, src, currFrom, currDir, twoSided, maxDist, hit);
+    else
+        retVal = ICheckTris(src, currFrom, currDir, twoSided, maxDist, hit);
+
+    plAccessGeometry::Instance()->Close(src);
+
+    if( retVal )
+    {
+        hit.fPos = src.GetLocalToWorld() * hit.fPos;
+        fCurrTarg = hit.fPos;
+        fMaxDist = hsVector3(&fCurrTarg, &fCurrFrom).Magnitude();
+    }
+
+    return retVal;
+}
+
+bool plVisLOSMgr::ICheckTriTree(plIcicle* span, plAccessSpan& src, const hsPoint3& currFrom, const hsVector3& currDir,
+                                bool twoSided, float& maxDist, plVisHit& hit)
+{
+    if( !span->GetTriTree(src.AccessTri())->Intersect(currFrom, currDir, twoSided, maxDist) )
+        return false;
+
+    hit.fPos = currFrom;
+    hit.fPos += currDir * maxDist;
+    return true;
+}
+
+bool plVisLOSMgr::ICheckTris(plAccessSpan& src, const hsPoint3& currFrom, const hsVector3& currDir,
+                             bool twoSided, float& maxDist, plVisHit& hit)
+{
+    bool retVal = false;
+
     plAccTriIterator tri(&src.AccessTri());
     for( tri.Begin(); tri.More(); tri.Advance() )
     {
@@ -318,14 +355,6 @@ bool plVisLOSMgr::ICheckSpan(plDrawableSpans* dr, uint32_t spanIdx, plVisHit& hi
             }
         }
     }
-    plAccessGeometry::Instance()->Close(src);
-
-    if( retVal )
-    {
-        hit.fPos = src.GetLocalToWorld() * hit.fPos;
-        fCurrTarg = hit.fPos;
-        fMaxDist = hsVector3(&fCurrTarg, &fCurrFrom).Magnitude();
-    }
 
     return retVal;
 }
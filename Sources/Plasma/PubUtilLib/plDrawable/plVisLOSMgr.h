@@ -54,6 +54,8 @@ class plSceneNode;
 class plPageTreeMgr;
 class plPipeline;
 class hsBounds3Ext;
+class plIcicle;
+class plAccessSpan;
 
 class plVisHit
 {
@@ -79,6 +81,8 @@ protected:
     hsPoint3        fCurrFrom;
     hsPoint3        fCurrTarg;
 
+    static bool     fUseTriTrees;
+
     bool ISetup(const hsPoint3& pStart, const hsPoint3& pEnd);
     bool ICheckBound(const hsBounds3Ext& bnd, float& closest);
     bool ICheckSpaceTreeRecur(plSpaceTree* space, int which, hsTArray<plSpaceHit>& hits);
@@ -86,6 +90,10 @@ protected:
     bool ICheckSceneNode(plSceneNode* node, plVisHit& hit);
     bool ICheckDrawable(plDrawable* d, plVisHit& hit);
     bool ICheckSpan(plDrawableSpans* dr, uint32_t spanIdx, plVisHit& hit);
+    bool ICheckTriTree(plIcicle* span, plAccessSpan& src, const hsPoint3& currFrom, const hsVector3& currDir,
+                       bool twoSided, float& maxDist, plVisHit& hit);
+    bool ICheckTris(plAccessSpan& src, const hsPoint3& currFrom, const hsVector3& currDir,
+                    bool twoSided, float& maxDist, plVisHit& hit);
     
 public:
     bool Check(const hsPoint3& pStart, const hsPoint3& pEnd, plVisHit& hit);
@@ -95,6 +103,10 @@ public:
 
     static void Init(plPipeline* pipe, plPageTreeMgr* mgr) { Instance()->fPipe = pipe; Instance()->fPageMgr = mgr; }
     static void DeInit() { Instance()->fPipe = nil; Instance()->fPageMgr = nil; }
+
+    // Pick against a cached per span triangle tree rather than every triangle.
+    static bool GetUseTriTrees() { return fUseTriTrees; }
+    static void SetUseTriTrees(bool on) { fUseTriTrees = on; }
 };
 
 #endif // plVisLOSMgr_inc
@@ -283,7 +283,7 @@ void plEncryptedStream::FastFwd()
     }
 }
 
-uint32_t plEncryptedStream::GetEOF()
+uint64_t plEncryptedStream::GetEOF()
 {
     return fActualFileSize;
 }
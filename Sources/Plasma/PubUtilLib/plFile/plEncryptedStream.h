@@ -91,7 +91,7 @@ public:
     virtual void    Skip(uint32_t deltaByteCount);
     virtual void    Rewind();
     virtual void    FastFwd();
-    virtual uint32_t  GetEOF();
+    virtual uint64_t  GetEOF();
 
     uint32_t GetActualFileSize() const { return fActualFileSize;}
 
@@ -46,6 +46,11 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsWindows.h"
 
 #include "hsSTLStream.h"
+#include "hsWorkerPool.h"
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
 
 #if !HS_BUILD_FOR_WIN32
 #include <errno.h>
@@ -64,6 +69,9 @@ static const int kFileStartOffset = kMagicStringLen + sizeof(uint32_t);
 
 static const int kMaxBufferedFileSize = 10*1024;
 
+// Below this many chunks it isn't worth waking up any extra threads
+static const uint32_t kMinChunksPerThread = (64*1024) / kEncryptChunkSize;
+
 const char plSecureStream::kKeyFilename[] = "encryption.key";
 
 plSecureStream::plSecureStream(bool deleteOnExit, uint32_t* key) :
@@ -151,6 +159,160 @@ void plSecureStream::IDecipher(uint32_t* const v, uint32_t n)
     }
 }
 
+#undef MX
+
+//
+// Bulk decipher for runs of 8 byte chunks.  Every chunk is encrypted on its
+// own, so these do exactly what IDecipher(v, 2) does, several chunks at a
+// time.  With n == 2 both y and z always hold the word that was just
+// updated, which is what lets the rounds collapse into a single value.
+//
+
+static const uint32_t kDecipherDelta = 0x9E3779B9;
+static const uint32_t kDecipherRounds = 6 + 52/2;
+
+static void decipher_chunks_fpu(const uint32_t* key, uint32_t* v, uint32_t numChunks)
+{
+    for (uint32_t i = 0; i < numChunks; i++, v += 2)
+    {
+        uint32_t v0 = v[0], v1 = v[1];
+        uint32_t sum = kDecipherRounds * kDecipherDelta;
+        for (uint32_t q = 0; q < kDecipherRounds; q++)
+        {
+            uint32_t e = (sum >> 2) & 3;
+            v1 -= ((v0>>5 ^ v0<<2) + (v0>>3 ^ v0<<4)) ^ ((sum^v0) + (key[1^e]^v0));
+            v0 -= ((v1>>5 ^ v1<<2) + (v1>>3 ^ v1<<4)) ^ ((sum^v1) + (key[e]^v1));
+            sum -= kDecipherDelta;
+        }
+        v[0] = v0;
+        v[1] = v1;
+    }
+}
+
+#ifdef HS_SSE2
+#   define SIMD_MX(t, s, k) \
+        _mm_xor_si128(_mm_add_epi32(_mm_xor_si128(_mm_srli_epi32(t, 5), _mm_slli_epi32(t, 2)), \
+                                    _mm_xor_si128(_mm_srli_epi32(t, 3), _mm_slli_epi32(t, 4))), \
+                      _mm_add_epi32(_mm_xor_si128(s, t), _mm_xor_si128(k, t)))
+#endif  // HS_SSE2
+
+static void decipher_chunks_sse2(const uint32_t* key, uint32_t* v, uint32_t numChunks)
+{
+#ifdef HS_SSE2
+    // Four chunks per pass, with the first and second words split into
+    // separate registers
+    uint32_t numSimd = numChunks & ~3;
+    for (uint32_t i = 0; i < numSimd; i += 4, v += 8)
+    {
+        __m128 lo = _mm_loadu_ps((const float*)v);
+        __m128 hi = _mm_loadu_ps((const float*)(v + 4));
+        __m128i v0 = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i v1 = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        uint32_t sum = kDecipherRounds * kDecipherDelta;
+        for (uint32_t q = 0; q < kDecipherRounds; q++)
+        {
+            uint32_t e = (sum >> 2) & 3;
+            __m128i s = _mm_set1_epi32(sum);
+            v1 = _mm_sub_epi32(v1, SIMD_MX(v0, s, _mm_set1_epi32(key[1^e])));
+            v0 = _mm_sub_epi32(v0, SIMD_MX(v1, s, _mm_set1_epi32(key[e])));
+            sum -= kDecipherDelta;
+        }
+
+        _mm_storeu_si128((__m128i*)v, _mm_unpacklo_epi32(v0, v1));
+        _mm_storeu_si128((__m128i*)(v + 4), _mm_unpackhi_epi32(v0, v1));
+    }
+    numChunks -= numSimd;
+#endif  // HS_SSE2
+    decipher_chunks_fpu(key, v, numChunks);
+}
+
+#ifdef HS_AVX2
+#   define SIMD256_MX(t, s, k) \
+        _mm256_xor_si256(_mm256_add_epi32(_mm256_xor_si256(_mm256_srli_epi32(t, 5), _mm256_slli_epi32(t, 2)), \
+                                          _mm256_xor_si256(_mm256_srli_epi32(t, 3), _mm256_slli_epi32(t, 4))), \
+                         _mm256_add_epi32(_mm256_xor_si256(s, t), _mm256_xor_si256(k, t)))
+#endif  // HS_AVX2
+
+static void decipher_chunks_avx2(const uint32_t* key, uint32_t* v, uint32_t numChunks)
+{
+#ifdef HS_AVX2
+    // Eight chunks per pass.  The shuffles stay within 128-bit lanes, so the
+    // chunks end up out of order in the registers, but the unpacks at the end
+    // put them right back.
+    uint32_t numSimd = numChunks & ~7;
+    for (uint32_t i = 0; i < numSimd; i += 8, v += 16)
+    {
+        __m256 lo = _mm256_loadu_ps((const float*)v);
+        __m256 hi = _mm256_loadu_ps((const float*)(v + 8));
+        __m256i v0 = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i v1 = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        uint32_t sum = kDecipherRounds * kDecipherDelta;
+        for (uint32_t q = 0; q < kDecipherRounds; q++)
+        {
+            uint32_t e = (sum >> 2) & 3;
+            __m256i s = _mm256_set1_epi32(sum);
+            v1 = _mm256_sub_epi32(v1, SIMD256_MX(v0, s, _mm256_set1_epi32(key[1^e])));
+            v0 = _mm256_sub_epi32(v0, SIMD256_MX(v1, s, _mm256_set1_epi32(key[e])));
+            sum -= kDecipherDelta;
+        }
+
+        _mm256_storeu_si256((__m256i*)v, _mm256_unpacklo_epi32(v0, v1));
+        _mm256_storeu_si256((__m256i*)(v + 8), _mm256_unpackhi_epi32(v0, v1));
+    }
+    numChunks -= numSimd;
+#endif  // HS_AVX2
+    decipher_chunks_sse2(key, v, numChunks);
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plSecureStream::decipher_chunks_ptr> plSecureStream::decipher_chunks {
+    &decipher_chunks_fpu,
+    nullptr,                // SSE1
+    &decipher_chunks_sse2,  // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr,                // AVX
+    &decipher_chunks_avx2   // AVX2
+};
+
+void plSecureStream::IDecipherChunks(void* buffer, uint32_t numChunks)
+{
+    uint32_t* v = static_cast<uint32_t*>(buffer);
+    const uint32_t wordsPerChunk = kEncryptChunkSize / sizeof(uint32_t);
+
+    uint32_t numThreads = numChunks / kMinChunksPerThread;
+    if (numThreads > 1)
+        numThreads = std::min(numThreads, hsWorkerPool::Instance().GetNumThreads());
+    if (numThreads <= 1)
+    {
+        decipher_chunks.call(fKey, v, numChunks);
+        return;
+    }
+
+    // Hand each thread a contiguous slice, the last one takes the remainder
+    uint32_t chunksPerThread = numChunks / numThreads;
+    hsWorkerPool::Instance().Run(numThreads, [&](uint32_t i)
+    {
+        uint32_t first = i * chunksPerThread;
+        uint32_t count = (i + 1 < numThreads) ? chunksPerThread : numChunks - first;
+        decipher_chunks.call(fKey, v + (first * wordsPerChunk), count);
+    });
+}
+
+void plSecureStream::IOpenDecrypted(uint32_t numChunks)
+{
+    IDecipherChunks(fDecryptedBuffer.get(), numChunks);
+
+    // The padding in the final chunk stays in the buffer, out of the stream's reach
+    fRAMStream = new hsReadOnlyStream(fActualFileSize, fDecryptedBuffer.get());
+    fBufferedStream = true;
+    fPosition = 0;
+}
+
 bool plSecureStream::Open(const plFileName& name, const char* mode)
 {
     if (strcmp(mode, "rb") == 0)
@@ -205,6 +367,9 @@ bool plSecureStream::Open(const plFileName& name, const char* mode)
             fRef = INVALID_HANDLE_VALUE;
             return false;
         }
+
+        fread(&fActualFileSize, sizeof(uint32_t), 1, fRef);
+        fActualFileSize = hsToLE32(fActualFileSize);
 #endif
 
         // The encrypted stream is inefficient if you do reads smaller than
@@ -244,27 +409,18 @@ bool plSecureStream::Open(hsStream* stream)
         return false;
 
     fActualFileSize = stream->ReadLE32();
-    uint32_t trimSize = kMagicStringLen + sizeof(uint32_t) + fActualFileSize;
-    fRAMStream = new hsRAMStream;
-    while (!stream->AtEnd())
-    {
-        // Don't write out any garbage
-        uint32_t size;
-        if ((trimSize - stream->GetPosition()) < kEncryptChunkSize)
-            size = (trimSize - stream->GetPosition());
-        else
-            size = kEncryptChunkSize;
 
-        uint8_t buf[kEncryptChunkSize];
-        stream->Read(kEncryptChunkSize, &buf);
-        IDecipher((uint32_t*)&buf, kEncryptChunkSize / sizeof(uint32_t));
-        fRAMStream->Write(size, &buf);
-    }
+    // Pull in every chunk at once and decrypt the lot in place
+    uint32_t numChunks = (fActualFileSize + kEncryptChunkSize - 1) / kEncryptChunkSize;
+    uint32_t bufferSize = numChunks * kEncryptChunkSize;
+    fDecryptedBuffer.reset(new uint8_t[bufferSize]);
+    uint32_t numRead = stream->Read(std::min(bufferSize, stream->GetSizeLeft()), fDecryptedBuffer.get());
+    if (numRead < bufferSize)
+        memset(fDecryptedBuffer.get() + numRead, 0, bufferSize - numRead);
+
+    IOpenDecrypted(numChunks);
 
     stream->SetPosition(pos);
-    fRAMStream->Rewind();
-    fPosition = 0;
-    fBufferedStream = true;
     fOpenMode = kOpenRead;
     return true;
 }
@@ -293,6 +449,7 @@ bool plSecureStream::Close()
         delete fRAMStream;
         fRAMStream = nil;
     }
+    fDecryptedBuffer.reset();
 
     fWriteFileName = ST::null;
     fActualFileSize = 0;
@@ -310,7 +467,7 @@ uint32_t plSecureStream::IRead(uint32_t bytes, void* buffer)
 #if HS_BUILD_FOR_WIN32
     bool success = (ReadFile(fRef, buffer, bytes, (LPDWORD)&numItems, NULL) != 0);
 #elif HS_BUILD_FOR_UNIX
-    numItems = fread(buffer, bytes, 1, fRef);
+    numItems = fread(buffer, 1, bytes, fRef);
     bool success = numItems != 0;
 #endif
     fBytesRead += numItems;
@@ -338,16 +495,16 @@ uint32_t plSecureStream::IRead(uint32_t bytes, void* buffer)
 
 void plSecureStream::IBufferFile()
 {
-    fRAMStream = new hsVectorStream;
-    char buf[1024];
-    while (!AtEnd())
-    {
-        uint32_t numRead = Read(1024, buf);
-        fRAMStream->Write(numRead, buf);
-    }
-    fRAMStream->Rewind();
+    uint32_t numChunks = (fActualFileSize + kEncryptChunkSize - 1) / kEncryptChunkSize;
+    uint32_t bufferSize = numChunks * kEncryptChunkSize;
+    fDecryptedBuffer.reset(new uint8_t[bufferSize]);
+    uint32_t numRead = IRead(bufferSize, fDecryptedBuffer.get());
+    if (numRead < bufferSize)
+        memset(fDecryptedBuffer.get() + numRead, 0, bufferSize - numRead);
+
+    IOpenDecrypted(numChunks);
+    fBytesRead = 0;
 
-    fBufferedStream = true;
 #if HS_BUILD_FOR_WIN32
     CloseHandle(fRef);
 #elif HS_BUILD_FOR_UNIX
@@ -369,7 +526,7 @@ void plSecureStream::Skip(uint32_t delta)
 {
     if (fBufferedStream)
     {
-        fRAMStream->Skip(delta);
+        fRAMStream->Skip(std::min(delta, fRAMStream->GetSizeLeft()));
         fPosition = fRAMStream->GetPosition();
     }
     else if (fRef != INVALID_HANDLE_VALUE)
@@ -420,7 +577,7 @@ void plSecureStream::FastFwd()
     }
 }
 
-uint32_t plSecureStream::GetEOF()
+uint64_t plSecureStream::GetEOF()
 {
     return fActualFileSize;
 }
@@ -429,7 +586,7 @@ uint32_t plSecureStream::Read(uint32_t bytes, void* buffer)
 {
     if (fBufferedStream)
     {
-        uint32_t numRead = fRAMStream->Read(bytes, buffer);
+        uint32_t numRead = fRAMStream->Read(std::min(bytes, fRAMStream->GetSizeLeft()), buffer);
         fPosition = fRAMStream->GetPosition();
         return numRead;
     }
@@ -465,15 +622,7 @@ uint32_t plSecureStream::Read(uint32_t bytes, void* buffer)
     }
 
     if (numMidChunks != 0)
-    {
-        uint32_t* bufferPos = (uint32_t*)(((char*)buffer)+startAmt);
-        for (int i = 0; i < numMidChunks; i++)
-        {
-            // Decrypt chunk
-            IDecipher(bufferPos, kEncryptChunkSize / sizeof(uint32_t));
-            bufferPos += (kEncryptChunkSize / sizeof(uint32_t));
-        }
-    }
+        IDecipherChunks(((char*)buffer)+startAmt, numMidChunks);
 
     if (endAmt != 0)
     {
@@ -44,6 +44,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "HeadSpin.h"
 #include "hsStream.h"
+#include "hsCpuID.h"
+
+#include <memory>
 
 #if HS_BUILD_FOR_WIN32
     typedef void* HANDLE;
@@ -68,6 +71,7 @@ protected:
     bool fBufferedStream;
 
     hsStream* fRAMStream;
+    std::unique_ptr<uint8_t[]> fDecryptedBuffer;    // backing store for a buffered read stream
 
     plFileName fWriteFileName;
 
@@ -83,6 +87,11 @@ protected:
     void IEncipher(uint32_t* const v, uint32_t n);
     void IDecipher(uint32_t* const v, uint32_t n);
 
+    // Deciphers a run of independent 8 byte chunks in place, splitting the
+    // work across threads for large buffers
+    void IDecipherChunks(void* buffer, uint32_t numChunks);
+    void IOpenDecrypted(uint32_t numChunks);
+
     bool IWriteEncrypted(hsStream* sourceStream, const plFileName& outputFile);
 
     static bool ICheckMagicString(hsFD fp);
@@ -103,7 +112,7 @@ public:
     virtual void Skip(uint32_t deltaByteCount);
     virtual void Rewind();
     virtual void FastFwd();
-    virtual uint32_t GetEOF();
+    virtual uint64_t GetEOF();
 
     uint32_t GetActualFileSize() const {return fActualFileSize;}
 
@@ -133,6 +142,10 @@ public:
     static bool GetSecureEncryptionKey(const plFileName& filename, uint32_t* key, unsigned length);
 
     static const char kKeyFilename[];
+
+    //  CPU-optimized functions
+    typedef void(*decipher_chunks_ptr)(const uint32_t* key, uint32_t* v, uint32_t numChunks);
+    static hsCpuFunctionDispatcher<decipher_chunks_ptr> decipher_chunks;
 };
 
 #endif // plSecureStream_h_inc
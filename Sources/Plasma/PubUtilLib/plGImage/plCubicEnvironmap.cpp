@@ -101,8 +101,10 @@ uint32_t  plCubicEnvironmap::Read( hsStream *s )
     uint32_t  i, tr = plBitmap::Read( s );
 
 
+    // The faces make up one device texture, which doesn't get rebuilt when a
+    // single face changes, so they can't stream
     for( i = 0; i < 6; i++ )
-        tr += fFaces[ i ]->Read( s );
+        tr += fFaces[ i ]->IRead( s, false );
 
     fInitialized = true;
 
@@ -56,7 +56,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsExceptions.h"
 
 #include "plGImage/plMipmap.h"
+#include "plGImage/plMipmapDecoder.h"
 
+#include <vector>
 #include <jpeglib.h>
 #include <jerror.h>
 
@@ -64,10 +66,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 //  Done this way so we don't have to declare them in the .h file and pull in
 //  the platform-specific library
 
-// It is not thread-safe to use a static char buffer, but it wasn't really
-// thread-safe to use a static int either. The char buffer is slightly
-// worse since you could get mangled strings instead of just a stale error.
-static char jpegmsg[JMSG_LENGTH_MAX];
+// One per thread, since plMipmapDecoder's workers decode alongside
+// whatever the main thread is reading.
+static thread_local char jpegmsg[JMSG_LENGTH_MAX];
 
 // jpeglib error handlers
 static void plJPEG_error_exit( j_common_ptr cinfo )
@@ -103,22 +104,19 @@ const char  *plJPEG::GetLastError( void )
     return jpegmsg;
 }
 
-//// IRead ////////////////////////////////////////////////////////////////////
-//  Given an open hsStream (or a filename), reads the JPEG data off of the 
-//  stream and decodes it into a new plMipmap. The mipmap's buffer ends up 
-//  being a packed RGBx buffer, where x is 8 bits of unused alpha (go figure 
-//  that JPEG images can't store alpha, or even if they can, IJL certainly 
-//  doesn't know about it).
-//  Returns a pointer to the new mipmap if successful, nil otherwise.
+//// IDecode //////////////////////////////////////////////////////////////////
+//  Decodes a JPEG image in memory into packed BGRx pixels, where x is 8 bits
+//  of unused alpha (go figure that JPEG images can't store alpha, or even if
+//  they can, IJL certainly doesn't know about it). Once the header is read,
+//  getDest is handed the image size and returns where the pixels go, or nil
+//  to give up.
 //  Note: more or less lifted straight out of the IJL documentation, with
 //  some changes to fit Plasma coding style and formats.
 
-plMipmap    *plJPEG::IRead( hsStream *inStream )
+bool    plJPEG::IDecode( const uint8_t *data, uint32_t size, const std::function<uint8_t *(uint32_t, uint32_t)> &getDest )
 {
-    plMipmap    *newMipmap = nil;
-    uint8_t       *jpegSourceBuffer = nil;
-    uint32_t      jpegSourceSize;
-    
+    bool    result = true;
+
     struct jpeg_decompress_struct   cinfo;
     struct jpeg_error_mgr       jerr;
 
@@ -132,19 +130,7 @@ plMipmap    *plJPEG::IRead( hsStream *inStream )
     {
         jpeg_create_decompress( &cinfo );
 
-        /// Read in the JPEG header
-        if ( inStream->GetEOF() == 0 )
-            throw false;
-
-        /// Wonderful limitation of mixing our streams with IJL--it wants either a filename
-        /// or a memory buffer. Since we can't give it the former, we have to read the entire
-        /// JPEG stream into a separate buffer before we can decode it. Which means we ALSO
-        /// have to write/read a length of said buffer. Such is life, I guess...
-        jpegSourceSize = inStream->ReadLE32();
-        jpegSourceBuffer = new uint8_t[ jpegSourceSize ];
-
-        inStream->Read( jpegSourceSize, jpegSourceBuffer );
-        jpeg_mem_src( &cinfo, jpegSourceBuffer, jpegSourceSize );
+        jpeg_mem_src( &cinfo, (unsigned char *)data, size );
         (void) jpeg_read_header( &cinfo, TRUE );
 
         /// So we got lots of data to play with now. First, set the JPEG color
@@ -163,7 +149,13 @@ plMipmap    *plJPEG::IRead( hsStream *inStream )
         {
             case JCS_GRAYSCALE:
             case JCS_YCbCr:
+#ifdef JCS_ALPHA_EXTENSIONS
+                // libjpeg-turbo can write our layout itself, with its own
+                // SIMD color conversion
+                cinfo.out_color_space = JCS_EXT_BGRA;
+#else
                 cinfo.out_color_space = JCS_RGB;
+#endif
                 break;
 
             default:
@@ -175,53 +167,145 @@ plMipmap    *plJPEG::IRead( hsStream *inStream )
 
         (void) jpeg_start_decompress( &cinfo );
 
-        /// Construct a new mipmap to hold everything
-        newMipmap = new plMipmap( cinfo.output_width, cinfo.output_height, plMipmap::kRGB32Config, 1, plMipmap::kJPEGCompression );
+        uint8_t *destp = getDest( cinfo.output_width, cinfo.output_height );
+        if( destp == nil )
+            throw false;
 
-        /// Set up to read in to that buffer we now have
-        JSAMPROW jbuffer;
-        int row_stride = cinfo.output_width * cinfo.output_components;
         int out_stride = cinfo.output_width * 4;  // Decompress to RGBA
-        jbuffer = new JSAMPLE[row_stride];
-
-        uint8_t *destp = (uint8_t *)newMipmap->GetImage();
-        while( cinfo.output_scanline < cinfo.output_height )
+        if( cinfo.output_components == 4 && cinfo.out_color_space != JCS_UNKNOWN )
         {
-            (void) jpeg_read_scanlines( &cinfo, &jbuffer, 1 );
-            (void) memset( destp, 0xFF, out_stride );
-            
-            for( size_t pixel = 0; pixel < cinfo.output_width; ++pixel )
+            // Already in our layout, straight into the buffer
+            while( cinfo.output_scanline < cinfo.output_height )
             {
-                (void) memcpy( destp + (pixel * 4),
-                               jbuffer + (pixel * cinfo.output_components),
-                               cinfo.out_color_components );
+                JSAMPROW row = destp + cinfo.output_scanline * out_stride;
+                (void) jpeg_read_scanlines( &cinfo, &row, 1 );
             }
+        }
+        else
+        {
+            /// Set up to read in to that buffer we now have
+            std::vector<JSAMPLE> jbuffer( cinfo.output_width * cinfo.output_components );
+            JSAMPROW row = jbuffer.data();
 
-            destp += out_stride;
+            while( cinfo.output_scanline < cinfo.output_height )
+            {
+                (void) jpeg_read_scanlines( &cinfo, &row, 1 );
+
+                if( cinfo.output_components == 3 )
+                    plMipmapDecoder::expand_rgb.call( destp, row, cinfo.output_width );
+                else
+                {
+                    (void) memset( destp, 0xFF, out_stride );
+                    for( size_t pixel = 0; pixel < cinfo.output_width; ++pixel )
+                    {
+                        (void) memcpy( destp + (pixel * 4),
+                                       row + (pixel * cinfo.output_components),
+                                       cinfo.out_color_components );
+                    }
+
+                    // Sometimes life just sucks
+                    ISwapRGBAComponents( (uint32_t *)destp, cinfo.output_width );
+                }
+
+                destp += out_stride;
+            }
         }
 
         (void) jpeg_finish_decompress(&cinfo);
-        delete [] jbuffer;
-
-        // Sometimes life just sucks
-        ISwapRGBAComponents( (uint32_t *)newMipmap->GetImage(), newMipmap->GetWidth() * newMipmap->GetHeight() );
     }
     catch (...)
     {
-        delete newMipmap;
-        newMipmap = nil;
+        result = false;
     }
 
-    // Cleanup
-    delete [] jpegSourceBuffer;
-
     // Clean up the JPEG Library
     jpeg_destroy_decompress( &cinfo );
 
+    return result;
+}
+
+//// IRead ////////////////////////////////////////////////////////////////////
+//  Given an open hsStream (or a filename), reads the JPEG data off of the 
+//  stream and decodes it into a new plMipmap. The mipmap's buffer ends up 
+//  being a packed BGRx buffer, as IDecode() leaves it.
+//  Returns a pointer to the new mipmap if successful, nil otherwise.
+
+plMipmap    *plJPEG::IRead( hsStream *inStream )
+{
+    plMipmap    *newMipmap = nil;
+
+    /// Read in the JPEG header
+    if ( inStream->GetEOF() == 0 )
+        return nil;
+
+    /// Wonderful limitation of mixing our streams with IJL--it wants either a filename
+    /// or a memory buffer. Since we can't give it the former, we have to read the entire
+    /// JPEG stream into a separate buffer before we can decode it. Which means we ALSO
+    /// have to write/read a length of said buffer. Such is life, I guess...
+    uint32_t jpegSourceSize = inStream->ReadLE32();
+    std::vector<uint8_t> jpegSourceBuffer( jpegSourceSize );
+    inStream->Read( jpegSourceSize, jpegSourceBuffer.data() );
+
+    bool ok = IDecode( jpegSourceBuffer.data(), jpegSourceSize,
+        [&newMipmap]( uint32_t width, uint32_t height )
+        {
+            /// Construct a new mipmap to hold everything
+            newMipmap = new plMipmap( width, height, plMipmap::kRGB32Config, 1, plMipmap::kJPEGCompression );
+            return (uint8_t *)newMipmap->GetImage();
+        } );
+
+    if( !ok )
+    {
+        delete newMipmap;
+        newMipmap = nil;
+    }
+
     // All done!
     return newMipmap;
 }
 
+//// ReadHeader / ReadToBuffer ////////////////////////////////////////////////
+
+bool    plJPEG::ReadHeader( const uint8_t *data, uint32_t size, uint32_t *width, uint32_t *height )
+{
+    bool    result = true;
+
+    struct jpeg_decompress_struct   cinfo;
+    struct jpeg_error_mgr       jerr;
+
+    clear_jpegmsg();
+    cinfo.err = jpeg_std_error( &jerr );
+    jerr.error_exit = plJPEG_error_exit;
+    jerr.emit_message = plJPEG_emit_message;
+
+    try
+    {
+        jpeg_create_decompress( &cinfo );
+        jpeg_mem_src( &cinfo, (unsigned char *)data, size );
+        (void) jpeg_read_header( &cinfo, TRUE );
+
+        // We never scale, so these are what we'll decode to
+        *width = cinfo.image_width;
+        *height = cinfo.image_height;
+    }
+    catch (...)
+    {
+        result = false;
+    }
+
+    jpeg_destroy_decompress( &cinfo );
+    return result;
+}
+
+bool    plJPEG::ReadToBuffer( const uint8_t *data, uint32_t size, uint8_t *dest, uint32_t width, uint32_t height )
+{
+    return IDecode( data, size,
+        [=]( uint32_t w, uint32_t h )
+        {
+            return ( w == width && h == height ) ? dest : nil;
+        } );
+}
+
 plMipmap*   plJPEG::ReadFromFile( const plFileName &fileName )
 {
     // we use a stream because the IJL can't handle unicode
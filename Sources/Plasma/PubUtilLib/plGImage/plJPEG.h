@@ -53,6 +53,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #ifndef _plJPEG_h
 #define _plJPEG_h
 
+#include <functional>
 
 //// Class Definition /////////////////////////////////////////////////////////
 
@@ -68,6 +69,7 @@ class plJPEG
 
         // Pick one...
         plMipmap    *IRead( hsStream *inStream );
+        bool        IDecode( const uint8_t *data, uint32_t size, const std::function<uint8_t *(uint32_t, uint32_t)> &getDest );
         bool        IWrite( plMipmap *source, hsStream *outStream );
 
         void        ISwapRGBAComponents( uint32_t *data, uint32_t count );
@@ -77,6 +79,13 @@ class plJPEG
         plMipmap    *ReadFromStream( hsStream *inStream ) { return IRead( inStream ); }
         plMipmap    *ReadFromFile( const plFileName &fileName );
 
+        // For plMipmapDecoder, which decodes straight into a map it has already
+        // sized. The data is a bare JPEG image, without the size ReadFromStream()
+        // expects in front of it; the pixels come out as ReadFromStream() leaves
+        // them. Both are safe to call from any thread.
+        bool        ReadHeader( const uint8_t *data, uint32_t size, uint32_t *width, uint32_t *height );
+        bool        ReadToBuffer( const uint8_t *data, uint32_t size, uint8_t *dest, uint32_t width, uint32_t height );
+
         bool    WriteToStream( hsStream *outStream, plMipmap *sourceData ) { return IWrite( sourceData, outStream ); }
         bool    WriteToFile( const plFileName &fileName, plMipmap *sourceData );
 
@@ -42,6 +42,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "HeadSpin.h"
 #include "plLODMipmap.h"
+#include "plMipmapStreamer.h"
 
 #include "hsResMgr.h"
 #include "hsGDeviceRef.h"
@@ -69,6 +70,9 @@ plLODMipmap::plLODMipmap(plMipmap* mip)
 
     hsgResMgr::ResMgr()->NewKey(mip->GetKey()->GetName(), this, mip->GetKey()->GetUoid().GetLocation());
 
+    // We share the base's image, so it can't be swapped out from under us
+    plMipmapStreamer::Instance().Pin(mip);
+
     // Need some kind of reffing assignment for the mipmap here
     fBase = mip;
     fLevelSizes = new uint32_t[fBase->GetNumLevels()];
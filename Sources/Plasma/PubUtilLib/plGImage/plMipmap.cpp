@@ -53,6 +53,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "HeadSpin.h"
 #include "plMipmap.h"
+#include "plMipmapStreamer.h"
 #include "hsStream.h"
 #include "hsExceptions.h"
 
@@ -61,14 +62,15 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plProfile.h"
 #include "plJPEG.h"
 #include "plPNG.h"
+#include "plMipmapDecoder.h"
 #include <cmath>
 #include <algorithm>
 
-plProfile_CreateMemCounter("Mipmaps", "Memory", MemMipmaps);
+plProfile_CreateMemCounterTagged("Mipmaps", "Memory", MemMipmaps, kMemTagTextures);
 
 //// Constructor & Destructor /////////////////////////////////////////////////
 
-plMipmap::plMipmap() : fImage( nil ), fLevelSizes( nil ), fCurrLevelPtr( nil ), fCurrLevel( 0 ), fTotalSize( 0 )
+plMipmap::plMipmap() : fImage( nil ), fLevelSizes( nil ), fCurrLevelPtr( nil ), fCurrLevel( 0 ), fTotalSize( 0 ), fStreamSource( nil ), fDecodeJob( nil )
 {
     SetConfig( kARGB32Config );
     fCompressionType = kUncompressed;
@@ -91,6 +93,7 @@ plMipmap::~plMipmap()
 }
 
 plMipmap::plMipmap( uint32_t width, uint32_t height, unsigned config, uint8_t numLevels, uint8_t compType, uint8_t format )
+    : fStreamSource( nil ), fDecodeJob( nil )
 {
     Create( width, height, config, numLevels, compType, format );
 
@@ -171,6 +174,9 @@ void    plMipmap::Create( uint32_t width, uint32_t height, unsigned config, uint
 
 void    plMipmap::Reset()
 {
+    IFinishDecode();
+    IStopStreaming();
+
     delete [] fLevelSizes;
     fLevelSizes = nil;
     if( !( fFlags & kUserOwnsBitmap ) )
@@ -202,6 +208,11 @@ uint32_t  plMipmap::GetTotalSize() const
 //// Read /////////////////////////////////////////////////////////////////////
 
 uint32_t  plMipmap::Read( hsStream *s )
+{
+    return IRead( s, true );
+}
+
+uint32_t  plMipmap::IRead( hsStream *s, bool canStream )
 {
     uint32_t totalRead = plBitmap::Read( s );
 
@@ -248,6 +259,54 @@ uint32_t  plMipmap::Read( hsStream *s )
             }
         }
 
+        // If the streamer wants it, leave the top levels on disk as well, and
+        // come back for them once we're drawn big enough to need them.  Only
+        // works if we're reading straight out of the page file, and not for
+        // maps something else reads back on the CPU.
+        uint32_t  amtToStream = 0;
+        if( canStream &&
+            ( fCompressionType == kDirectXCompression || fCompressionType == kUncompressed ) &&
+            !( fFlags & ( kDontThrowAwayImage | kUserOwnsBitmap | kNoMaxSize ) ) )
+        {
+            uint8_t streamLevels = plMipmapStreamer::Instance().LevelsToStream( this );
+            plFileName path = streamLevels > 0 ? s->GetFileName() : plFileName();
+            if( path.IsValid() )
+            {
+                fStreamSource = new plMipmapStreamSource;
+                fStreamSource->fPath = path;
+                fStreamSource->fOffset = s->GetPosition() + amtToSkip;
+                fStreamSource->fWidth = fWidth;
+                fStreamSource->fHeight = fHeight;
+                fStreamSource->fRowBytes = fRowBytes;
+                fStreamSource->fTotalSize = fTotalSize;
+                fStreamSource->fNumLevels = fNumLevels;
+
+                int i;
+                for( i = 0; i < streamLevels; i++ )
+                {
+                    amtToStream += fLevelSizes[ i ];
+                    fWidth >>= 1;
+                    fHeight >>= 1;
+                    fRowBytes >>= 1;
+                    fNumLevels--;
+                }
+                fTotalSize -= amtToStream;
+                IBuildLevelSizes();
+
+                fStreamSource->fStreamSize = amtToStream;
+                fStreamSource->fTailWidth = fWidth;
+                fStreamSource->fTailHeight = fHeight;
+                fStreamSource->fTailRowBytes = fRowBytes;
+                fStreamSource->fTailSize = fTotalSize;
+                fStreamSource->fTailLevels = fNumLevels;
+                fStreamSource->fResident = false;
+                fStreamSource->fLastWanted = 0;
+                fStreamSource->fWantedSize = 0;
+                fStreamSource->fPending = nil;
+                plMipmapStreamer::Instance().Add( this );
+            }
+        }
+
         fImage = (void *)new uint8_t[ fTotalSize ];
 #ifdef MEMORY_LEAK_TRACER
         IAddToMemRecord( this, plRecord::kViaRead );
@@ -257,21 +316,23 @@ uint32_t  plMipmap::Read( hsStream *s )
         switch( fCompressionType )
         {
             case kDirectXCompression:
-                s->Skip( amtToSkip );
+                s->Skip( amtToSkip + amtToStream );
                 s->Read( fTotalSize, fImage );
                 break;
                 
             case kUncompressed:
-                s->Skip( amtToSkip );
+                s->Skip( amtToSkip + amtToStream );
                 IReadRawImage( s );
                 break;
                 
             case kJPEGCompression:
-                IReadJPEGImage( s );
+                if( !plMipmapDecoder::Instance().QueueJPEG( this, s ) )
+                    IReadJPEGImage( s );
                 break;
 
             case kPNGCompression:
-                IReadPNGImage( s );
+                if( !plMipmapDecoder::Instance().QueuePNG( this, s ) )
+                    IReadPNGImage( s );
                 break;
                 
             default:
@@ -287,6 +348,8 @@ uint32_t  plMipmap::Read( hsStream *s )
 
 uint32_t  plMipmap::Write( hsStream *s )
 {
+    IFinishDecode();
+
     uint32_t totalWritten = plBitmap::Write( s );
 
     s->WriteLE32( fWidth );
@@ -428,24 +491,11 @@ plMipmap *plMipmap::ISplitAlpha()
 // alphaChannel must be in the format generated from ISplitAlpha, or strange things will happen
 void plMipmap::IRecombineAlpha( plMipmap *alphaChannel )
 {
-    uint8_t *curLoc = (uint8_t *)alphaChannel->fImage;
-    uint8_t *destLoc = (uint8_t *)fImage;
-    uint32_t numBytes = fTotalSize;
-    uint32_t curByte = 0;
-
     switch( fUncompressedInfo.fType )
     {
     case UncompressedInfo::kRGB8888:
         // first uint8_t is the alpha channel, we will grab this uint8_t from the red channel for reconstitution
-        while (curByte < numBytes)
-        {
-            curLoc += 2; // pointer points at the red channel (where the alpha is stored)
-            destLoc += 3;
-            *destLoc = *curLoc; // copy the data
-            destLoc++; // move the pointer to the next pixel
-            curLoc += 2;
-            curByte += 4;
-        }
+        plMipmapDecoder::merge_alpha.call( (uint8_t *)fImage, (const uint8_t *)alphaChannel->fImage, fTotalSize >> 2 );
         break;
     default:
         break; // not going to mess with other formats for now
@@ -455,12 +505,24 @@ void plMipmap::IRecombineAlpha( plMipmap *alphaChannel )
 
 plMipmap *plMipmap::IReadRLEImage( hsStream *stream )
 {
-    uint32_t count,color;
-    bool done = false;
-
     plMipmap *retVal = new plMipmap(fWidth,fHeight,plMipmap::kARGB32Config,1);
 
-    uint32_t *curPos = (uint32_t*)retVal->fImage;
+    IExpandRLE( stream, (uint32_t*)retVal->fImage, fWidth * fHeight );
+    // We really don't want to suddenly start calling this uncompressed now that it's read in.
+    // Case in point, on export we load in all previously exported textures (like this JPEG one)
+    // share those, add any textures that aren't already there, then write the whole thing back
+    // out. Viola, we just converted our nice small compressed 1024x1024 JPEG (~128k) to a 
+    // monster uncompressed 4Mb which it will remain for ever more.
+//  retVal->fCompressionType = kUncompressed;
+    return retVal;
+}
+
+// Reads (count, color) runs down to the zero count that ends them. Runs past
+// the end of dest are dropped, and anything the runs don't cover is zeroed.
+void plMipmap::IExpandRLE( hsStream *stream, uint32_t *dest, uint32_t numPixels )
+{
+    uint32_t count,color;
+    bool done = false;
     uint32_t curLoc = 0;
 
     while (!done)
@@ -471,21 +533,12 @@ plMipmap *plMipmap::IReadRLEImage( hsStream *stream )
             done = true;
         else
         {
-            for (uint32_t i=0; i<count; i++)
-            {
-                *curPos = color;
-                curPos++;
-                curLoc++;
-            }
+            count = std::min(count, numPixels - curLoc);
+            std::fill(dest + curLoc, dest + curLoc + count, color);
+            curLoc += count;
         }
     }
-    // We really don't want to suddenly start calling this uncompressed now that it's read in.
-    // Case in point, on export we load in all previously exported textures (like this JPEG one)
-    // share those, add any textures that aren't already there, then write the whole thing back
-    // out. Viola, we just converted our nice small compressed 1024x1024 JPEG (~128k) to a 
-    // monster uncompressed 4Mb which it will remain for ever more.
-//  retVal->fCompressionType = kUncompressed;
-    return retVal;
+    std::fill(dest + curLoc, dest + numPixels, 0);
 }
 
 void plMipmap::IWriteRLEImage( hsStream *stream, plMipmap *mipmap )
@@ -658,6 +711,73 @@ void    plMipmap::IBuildLevelSizes()
     }
 }
 
+//// IStopStreaming ///////////////////////////////////////////////////////////
+//  Whatever levels we have now are all we'll ever have.
+
+void    plMipmap::IStopStreaming()
+{
+    if( fStreamSource != nil )
+    {
+        plMipmapStreamer::Instance().Forget( this );
+        delete fStreamSource;
+        fStreamSource = nil;
+    }
+}
+
+//// ISetDecodedSize //////////////////////////////////////////////////////////
+//  For plMipmapDecoder. Leaves us the shape CopyFrom() would, given a map of
+//  the decoded image, with a buffer sized for it to decode into.
+
+void    plMipmap::ISetDecodedSize( uint32_t width, uint32_t height, unsigned config, uint8_t compType )
+{
+    IStopStreaming();
+
+    uint32_t totalSize = width * height * 4;
+    if( totalSize != fTotalSize || fImage == nil )
+    {
+        plProfile_DelMem(MemMipmaps, fTotalSize);
+#ifdef MEMORY_LEAK_TRACER
+        IRemoveFromMemRecord( (uint8_t *)fImage );
+#endif
+        delete[] (uint8_t*)fImage;
+
+        fImage = (void *)new uint8_t[ totalSize ];
+#ifdef MEMORY_LEAK_TRACER
+        IAddToMemRecord( this, plRecord::kViaCopyFrom );
+#endif
+        plProfile_NewMem(MemMipmaps, totalSize);
+    }
+
+    SetConfig( config );
+    fWidth = width;
+    fHeight = height;
+    fRowBytes = width * 4;
+    fTotalSize = totalSize;
+    fCompressionType = compType;
+    fNumLevels = 1;
+    fUncompressedInfo.fType = UncompressedInfo::kRGB8888;
+
+    IBuildLevelSizes();
+
+    // The buffer won't move again, so GetAddr*() can find it without a
+    // SetCurrLevel() (they still wait for the pixels themselves)
+    fCurrLevel = 0;
+    fCurrLevelPtr = fImage;
+    fCurrLevelWidth = fWidth;
+    fCurrLevelHeight = fHeight;
+    fCurrLevelRowBytes = fRowBytes;
+
+    if( GetDeviceRef() != nil )
+        GetDeviceRef()->SetDirty( true );
+}
+
+//// IWaitForDecode ///////////////////////////////////////////////////////////
+
+void    plMipmap::IWaitForDecode() const
+{
+    plMipmapDecoder::Instance().Finish( this );
+}
+
 //// GetLevelPtr //////////////////////////////////////////////////////////////
 
 uint8_t   *plMipmap::GetLevelPtr( uint8_t level, uint32_t *width, uint32_t *height, uint32_t *rowBytes )
@@ -665,6 +785,7 @@ uint8_t   *plMipmap::GetLevelPtr( uint8_t level, uint32_t *width, uint32_t *heig
     uint8_t   *data, i;
     uint32_t  w, h, r;
 
+    IFinishDecode();
 
     if( fLevelSizes == nil )
         IBuildLevelSizes();
@@ -759,6 +880,8 @@ void    plMipmap::ClipToMaxSize( uint32_t maxDimension )
     uint32_t      newSize;
 
 
+    IFinishDecode();
+
     for( i = 0, newSize = fTotalSize, srcData = (uint8_t *)fImage; fWidth > maxDimension || fHeight > maxDimension; i++ )
     {
         srcData += fLevelSizes[ i ];
@@ -807,6 +930,8 @@ void    plMipmap::RemoveMipping()
     uint8_t       *destData;
 
 
+    IFinishDecode();
+
     /// Create a new image pointer
     destData = new uint8_t[ fLevelSizes[ 0 ] ];
     hsAssert( destData != nil, "Out of memory in ClipToMaxSize()" );
@@ -919,6 +1044,7 @@ plFilterMask::~plFilterMask()
 plMipmap::plMipmap( plMipmap *bm, float sig, uint32_t createFlags, 
         float detailDropoffStart, float detailDropoffStop, 
         float detailMax, float detailMin)
+    : fStreamSource( nil ), fDecodeJob( nil )
 {
     int     i;
 
@@ -1031,6 +1157,7 @@ void plMipmap::SetBitmapAsLevel(uint8_t iDst, plMipmap *bm, float sig, uint32_t
                                       float detailMax, float detailMin)
 {
     SetCurrLevel( iDst );
+    bm->IFinishDecode();
 
     hsAssert((bm->fHeight == fCurrLevelHeight) && (bm->fWidth == fCurrLevelWidth), "Wrong size bitmap for Mipmap level.");
 
@@ -1371,8 +1498,11 @@ void    plMipmap::EnsureKonstantBorder( bool clampU, bool clampV )
 bool    plMipmap::IGrabBorderColor( bool grabVNotU, uint32_t *color )
 {
     int         i;
-    uint32_t      *src1 = (uint32_t *)fImage, *src2, testColor;
+    uint32_t      *src1, *src2, testColor;
+
 
+    IFinishDecode();
+    src1 = (uint32_t *)fImage;
 
     if( !grabVNotU )
     {
@@ -1446,6 +1576,7 @@ void plMipmap::Filter(float sig)
 {
     hsAssert(fPixelSize == 32, "Only 32 bit implemented");
     ASSERT_UNCOMPRESSED();
+    IFinishDecode();
 
     int i, j, ii, jj;
 
@@ -1555,6 +1686,7 @@ uint32_t plMipmap::CopyOutPixels(uint32_t destXSize, uint32_t destYSize,
 
     hsAssert(fPixelSize == 32, "Only 32 bit implemented");
     ASSERT_UNCOMPRESSED();
+    IFinishDecode();
 
     int i;
 
@@ -1578,6 +1710,10 @@ void    plMipmap::CopyFrom( const plMipmap *source )
 {
     hsAssert( source != nil, "nil source in plMipmap::CopyFrom()" );
 
+    IFinishDecode();
+    source->IFinishDecode();
+    IStopStreaming();
+
     plProfile_DelMem(MemMipmaps, fTotalSize);
 #ifdef MEMORY_LEAK_TRACER
     IRemoveFromMemRecord( (uint8_t *)fImage );
@@ -1653,6 +1789,12 @@ void    plMipmap::Composite( plMipmap *source, uint16_t x, uint16_t y, plMipmap:
     uint16_t  srcClipX, srcClipY;
 
 
+    // Composites are made once, so they need the whole source now
+    plMipmapStreamer::Instance().Pin( source );
+    plMipmapStreamer::Instance().Pin( this );
+    source->IFinishDecode();
+    IFinishDecode();
+
     // Currently we only support 32 bit uncompressed mipmaps
     if( fPixelSize != 32 || fCompressionType == kDirectXCompression )
     {
@@ -1942,6 +2084,8 @@ void    plMipmap::Colorize()
         return;
     }
 
+    IFinishDecode();
+
     /// First handle compressed levels, if any
     currLevel = 0;
     currColor = 0;
@@ -2035,6 +2179,7 @@ void    plMipmap::ScaleNicely( uint32_t *destPtr, uint16_t destWidth, uint16_t d
 
 
     // Init
+    IFinishDecode();
     destToSrcXScale = (float)fWidth / (float)destWidth;
     destToSrcYScale = (float)fHeight / (float)destHeight;
 
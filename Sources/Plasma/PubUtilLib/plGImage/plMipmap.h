@@ -74,11 +74,17 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 class plBitmapCreator;
 class plTextGenerator;
+class plMipmapStreamer;
+struct plMipmapStreamSource;
+class plMipmapDecoder;
+struct plMipmapDecodeJob;
 
 class plMipmap : public plBitmap
 {
     friend class plBitmapCreator;
     friend class plTextGenerator;
+    friend class plMipmapStreamer;
+    friend class plMipmapDecoder;
 
     public:
         //// Public Flags ////
@@ -122,13 +128,16 @@ class plMipmap : public plBitmap
         inline uint32_t   GetHeight() const { return fHeight; }
         inline uint32_t   GetRowBytes() const { return fRowBytes; }
 
-        void            *GetImage() const { return fImage; }
+        void            *GetImage() const { IFinishDecode(); return fImage; }
         void            SetImagePtr( void *ptr ) { fImage = ptr; }
+
+        // True if plMipmapStreamer left our top levels on disk at Read()
+        bool            IsStreamed() const { return fStreamSource != nil; }
         uint8_t           *GetLevelPtr( uint8_t level, uint32_t *width = nil, uint32_t *height = nil, uint32_t *rowBytes = nil );
 
         // Sets the current level pointer for use with GetAddr*
         virtual void    SetCurrLevel(uint8_t level);
-        void            *GetCurrLevelPtr() const { return fCurrLevelPtr; }
+        void            *GetCurrLevelPtr() const { IFinishDecode(); return fCurrLevelPtr; }
         uint32_t          GetCurrWidth() const { return fCurrLevelWidth; }
         uint32_t          GetCurrHeight() const { return fCurrLevelHeight; }
         uint32_t          GetCurrLevelSize() const { return fLevelSizes[ fCurrLevel ]; }
@@ -136,13 +145,15 @@ class plMipmap : public plBitmap
 
         //  These methods return the address of the pixel specified by x and y
         //  They are meant to be fast, therefore they are inlined and do not check
-        //  the fPixelSize field at runtime (except when debugging)
+        //  the fPixelSize field at runtime (except when debugging). They do wait
+        //  for our pixels if plMipmapDecoder still has them.
 
         uint8_t*  GetAddr8(unsigned x, unsigned y) const
                 {
                     ASSERT_PIXELSIZE(this, 8);
                     ASSERT_XY(this, x, y);
                     ASSERT_UNCOMPRESSED();
+                    IFinishDecode();
                     return (uint8_t*)((char*)fCurrLevelPtr + y * fCurrLevelRowBytes + x);
                 }
         uint16_t* GetAddr16(unsigned x, unsigned y) const
@@ -150,6 +161,7 @@ class plMipmap : public plBitmap
                     ASSERT_PIXELSIZE(this, 16);
                     ASSERT_XY(this, x, y);
                     ASSERT_UNCOMPRESSED();
+                    IFinishDecode();
                     return (uint16_t*)((char*)fCurrLevelPtr + y * fCurrLevelRowBytes + (x << 1));
                 }
         uint32_t* GetAddr32(unsigned x, unsigned y) const
@@ -157,6 +169,7 @@ class plMipmap : public plBitmap
                     ASSERT_PIXELSIZE(this, 32);
                     ASSERT_XY(this, x, y);
                     ASSERT_UNCOMPRESSED();
+                    IFinishDecode();
                     return (uint32_t*)((char*)fCurrLevelPtr + y * fCurrLevelRowBytes + (x << 2));
                 }
         void*   GetAddr64(unsigned x, unsigned y) const
@@ -164,6 +177,7 @@ class plMipmap : public plBitmap
                     ASSERT_PIXELSIZE(this, 64);
                     ASSERT_XY(this, x, y);
                     ASSERT_UNCOMPRESSED();
+                    IFinishDecode();
                     return (void*)((char*)fCurrLevelPtr + y * fCurrLevelRowBytes + (x << 3));
                 }
 
@@ -302,17 +316,28 @@ class plMipmap : public plBitmap
         uint8_t     fCurrLevel;
         uint32_t    fCurrLevelWidth, fCurrLevelHeight, fCurrLevelRowBytes;
 
+        // Non-nil while our top levels are left on disk for plMipmapStreamer
+        plMipmapStreamSource    *fStreamSource;
+
+        // Non-nil until plMipmapDecoder has filled in our pixels
+        mutable plMipmapDecodeJob   *fDecodeJob;
+
         void    IReadRawImage( hsStream *stream );
         void    IWriteRawImage( hsStream *stream );
         plMipmap *ISplitAlpha();
         void    IRecombineAlpha( plMipmap *alphaChannel );
         plMipmap *IReadRLEImage( hsStream *stream );
+        static void IExpandRLE( hsStream *stream, uint32_t *dest, uint32_t numPixels );
         void    IWriteRLEImage( hsStream *stream, plMipmap *mipmap );
         void    IReadJPEGImage( hsStream *stream );
         void    IWriteJPEGImage( hsStream *stream );
         void    IReadPNGImage( hsStream *stream );
         void    IWritePNGImage( hsStream *stream );
         void    IBuildLevelSizes();
+        void    IStopStreaming();
+        void    ISetDecodedSize( uint32_t width, uint32_t height, unsigned config, uint8_t compType );
+        void    IFinishDecode() const { if( fDecodeJob != nil ) IWaitForDecode(); }
+        void    IWaitForDecode() const;
 
         void    IColorLevel( uint8_t level, const uint8_t *colorMask );
 
@@ -327,6 +352,7 @@ class plMipmap : public plBitmap
 
         virtual uint32_t  Read( hsStream *s );
         virtual uint32_t  Write( hsStream *s );
+        uint32_t          IRead( hsStream *s, bool canStream );
 
         friend class plCubicEnvironmap;
 
@@ -0,0 +1,489 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "plMipmapDecoder.h"
+#include "plMipmap.h"
+#include "plJPEG.h"
+#include "plPNG.h"
+#include "hsLockGuard.h"
+#include "hsStream.h"
+#include "hsWorkerPool.h"
+#include "plProfile.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+plProfile_CreateCounterNoReset("Texture Decodes Pending", "Memory", TexDecodesPending);
+plProfile_CreateCounterNoReset("Texture Decode Time (ms)", "Memory", TexDecodeTime);
+
+typedef std::chrono::steady_clock plDecodeClock;
+
+//// plMipmapDecodeJob ////////////////////////////////////////////////////////
+//  One map's compressed image.  Set up by the reading thread before queueing;
+//  whoever decodes it only writes fDest, fAlphaOk and fMillis.
+
+struct plMipmapDecodeJob
+{
+    enum State
+    {
+        kQueued,
+        kDecoding,
+        kDone
+    };
+
+    plMipmap*   fMip;
+    uint8_t     fCompressionType;   // plBitmap::kJPEGCompression or kPNGCompression
+    uint8_t     fFlags;             // plMipmap::kColorDataRLE etc, for JPEGs
+    std::vector<uint8_t>    fColor; // The whole PNG, or the JPEG color data
+    std::vector<uint8_t>    fAlpha; // JPEG alpha data
+    uint8_t*    fDest;
+    uint32_t    fWidth, fHeight;
+    bool        fAlphaFlag;         // Read() set kAlphaChannelFlag ahead of the alpha
+    bool        fAlphaOk;
+    float       fMillis;
+    State       fState;
+
+    plMipmapDecodeJob(uint8_t compType)
+        : fMip(nil), fCompressionType(compType), fFlags(0), fDest(nil),
+          fWidth(0), fHeight(0), fAlphaFlag(false), fAlphaOk(true),
+          fMillis(0), fState(kQueued)
+    { }
+};
+
+//// Instance /////////////////////////////////////////////////////////////////
+
+plMipmapDecoder& plMipmapDecoder::Instance()
+{
+    static plMipmapDecoder theInstance;
+    return theInstance;
+}
+
+plMipmapDecoder::plMipmapDecoder()
+:   fEnabled(true),
+    fNumDecoded(0),
+    fTotalTime(0)
+{
+}
+
+plMipmapDecoder::~plMipmapDecoder()
+{
+    Shutdown();
+}
+
+//// Workers //////////////////////////////////////////////////////////////////
+
+void plMipmapDecoder::SetEnabled(bool on)
+{
+    fEnabled = on;
+}
+
+void plMipmapDecoder::Shutdown()
+{
+    Flush();
+
+    // Anything read from here on decodes inline
+    fEnabled = false;
+}
+
+// One of these goes to the worker pool per job queued
+void plMipmapDecoder::IDecodeNext()
+{
+    plMipmapDecodeJob* job = nil;
+    {
+        hsLockGuard(fMutex);
+        if (!fQueue.empty())
+        {
+            job = fQueue.front();
+            fQueue.pop_front();
+            job->fState = plMipmapDecodeJob::kDecoding;
+        }
+    }
+
+    // Finish() may have taken it for itself
+    if (!job)
+        return;
+
+    IDecode(job);
+
+    {
+        hsLockGuard(fMutex);
+        job->fState = plMipmapDecodeJob::kDone;
+    }
+    fDoneCondition.notify_all();
+}
+
+//// Read Support /////////////////////////////////////////////////////////////
+
+static uint32_t IReadBE32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// One half of what plMipmap::IWriteJPEGImage() wrote: a sized JPEG image, or
+// RLE runs down to the zero count that ends them
+static void ICaptureJPEGSection(hsStream* s, bool rle, std::vector<uint8_t>& data)
+{
+    if (rle)
+    {
+        uint32_t run[2];
+        do
+        {
+            run[0] = s->ReadLE32();
+            run[1] = s->ReadLE32();
+            size_t at = data.size();
+            data.resize(at + sizeof(run));
+            memcpy(data.data() + at, run, sizeof(run));
+        } while (run[0] != 0 && !s->AtEnd());
+
+        // Kept in the byte order hsReadOnlyStream::ReadLE32() expects
+        uint32_t* runs = (uint32_t*)data.data();
+        for (size_t i = 0; i < data.size() / sizeof(uint32_t); i++)
+            runs[i] = hsToLE32(runs[i]);
+    }
+    else
+    {
+        uint32_t size = s->ReadLE32();
+        data.resize(size);
+        s->Read(size, data.data());
+    }
+}
+
+// The signature, then every chunk through IEND, the same bytes libpng reads
+static bool ICapturePNG(hsStream* s, std::vector<uint8_t>& data)
+{
+    static const uint8_t kSignature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+    data.resize(sizeof(kSignature));
+    if (s->Read(data.size(), data.data()) != data.size() ||
+        memcmp(data.data(), kSignature, sizeof(kSignature)) != 0)
+        return false;
+
+    for (;;)
+    {
+        // Length, type, data, CRC
+        uint8_t head[8];
+        if (s->Read(sizeof(head), head) != sizeof(head))
+            return false;
+        uint32_t length = IReadBE32(head);
+        if (length > 0x7FFFFFFF)
+            return false;
+
+        size_t at = data.size();
+        data.resize(at + sizeof(head) + length + 4);
+        memcpy(data.data() + at, head, sizeof(head));
+        if (s->Read(length + 4, data.data() + at + sizeof(head)) != length + 4)
+            return false;
+
+        if (memcmp(head + 4, "IEND", 4) == 0)
+            return true;
+    }
+}
+
+bool plMipmapDecoder::QueueJPEG(plMipmap* mip, hsStream* s)
+{
+    if (!fEnabled)
+        return false;
+
+    plMipmapDecodeJob* job = new plMipmapDecodeJob(plBitmap::kJPEGCompression);
+    job->fFlags = s->ReadByte();
+    ICaptureJPEGSection(s, (job->fFlags & plMipmap::kColorDataRLE) != 0, job->fColor);
+    ICaptureJPEGSection(s, (job->fFlags & plMipmap::kAlphaDataRLE) != 0, job->fAlpha);
+
+    // Size the map the way plMipmap::IReadJPEGImage() would leave it
+    if (job->fFlags & plMipmap::kColorDataRLE)
+        mip->ISetDecodedSize(mip->fWidth, mip->fHeight, plMipmap::kARGB32Config, plBitmap::kUncompressed);
+    else
+    {
+        uint32_t width, height;
+        if (!plJPEG::Instance().ReadHeader(job->fColor.data(), job->fColor.size(), &width, &height))
+        {
+            // Same as a failed inline decode, the map stays as it was read
+            delete job;
+            return true;
+        }
+        mip->ISetDecodedSize(width, height, plMipmap::kRGB32Config, plBitmap::kJPEGCompression);
+        mip->fFlags |= plBitmap::kAlphaChannelFlag;
+        job->fAlphaFlag = true;
+    }
+
+    IQueue(mip, job);
+    return true;
+}
+
+bool plMipmapDecoder::QueuePNG(plMipmap* mip, hsStream* s)
+{
+    if (!fEnabled)
+        return false;
+
+    plMipmapDecodeJob* job = new plMipmapDecodeJob(plBitmap::kPNGCompression);
+    uint32_t width, height;
+    if (!ICapturePNG(s, job->fColor) ||
+        !plPNG::Instance().ReadHeader(job->fColor.data(), job->fColor.size(), &width, &height))
+    {
+        delete job;
+        return true;
+    }
+
+    // Size the map the way plMipmap::IReadPNGImage() would leave it
+    mip->ISetDecodedSize(width, height, plMipmap::kARGB32Config, plBitmap::kUncompressed);
+
+    IQueue(mip, job);
+    return true;
+}
+
+void plMipmapDecoder::IQueue(plMipmap* mip, plMipmapDecodeJob* job)
+{
+    job->fMip = mip;
+    job->fDest = (uint8_t*)mip->fImage;
+    job->fWidth = mip->fWidth;
+    job->fHeight = mip->fHeight;
+    mip->fDecodeJob = job;
+
+    {
+        hsLockGuard(fMutex);
+        fJobs.push_back(job);
+        fQueue.push_back(job);
+    }
+
+    // With no pool threads, it waits for the first Finish()
+    hsWorkerPool::Instance().Queue([this]() { IDecodeNext(); });
+}
+
+//// Decoding /////////////////////////////////////////////////////////////////
+//  Called on a worker, or on whichever thread wanted the pixels first.  Only
+//  touches the job and the buffer it points at.
+
+void plMipmapDecoder::IDecode(plMipmapDecodeJob* job)
+{
+    plDecodeClock::time_point start = plDecodeClock::now();
+    uint32_t numPixels = job->fWidth * job->fHeight;
+
+    if (job->fCompressionType == plBitmap::kJPEGCompression)
+    {
+        if (job->fFlags & plMipmap::kColorDataRLE)
+        {
+            hsReadOnlyStream s(job->fColor.size(), job->fColor.data());
+            plMipmap::IExpandRLE(&s, (uint32_t*)job->fDest, numPixels);
+        }
+        else
+            plJPEG::Instance().ReadToBuffer(job->fColor.data(), job->fColor.size(), job->fDest, job->fWidth, job->fHeight);
+
+        std::vector<uint32_t> alpha(numPixels);
+        if (job->fFlags & plMipmap::kAlphaDataRLE)
+        {
+            hsReadOnlyStream s(job->fAlpha.size(), job->fAlpha.data());
+            plMipmap::IExpandRLE(&s, alpha.data(), numPixels);
+        }
+        else
+            job->fAlphaOk = plJPEG::Instance().ReadToBuffer(job->fAlpha.data(), job->fAlpha.size(), (uint8_t*)alpha.data(), job->fWidth, job->fHeight);
+
+        if (job->fAlphaOk)
+            merge_alpha.call(job->fDest, (const uint8_t*)alpha.data(), numPixels);
+    }
+    else
+    {
+        hsReadOnlyStream s(job->fColor.size(), job->fColor.data());
+        plPNG::Instance().ReadToBuffer(&s, job->fDest, job->fWidth, job->fHeight);
+    }
+
+    job->fMillis = std::chrono::duration<float, std::milli>(plDecodeClock::now() - start).count();
+}
+
+//// Waiting //////////////////////////////////////////////////////////////////
+
+void plMipmapDecoder::Finish(const plMipmap* mip)
+{
+    plMipmapDecodeJob* job = mip->fDecodeJob;
+    if (!job)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(fMutex);
+        if (job->fState == plMipmapDecodeJob::kQueued)
+        {
+            // Nobody has started on it, so don't wait behind the rest of the queue
+            fQueue.erase(std::find(fQueue.begin(), fQueue.end(), job));
+            job->fState = plMipmapDecodeJob::kDecoding;
+            lock.unlock();
+            IDecode(job);
+            lock.lock();
+            job->fState = plMipmapDecodeJob::kDone;
+        }
+        else
+            fDoneCondition.wait(lock, [job]() { return job->fState == plMipmapDecodeJob::kDone; });
+    }
+
+    IRetire(job);
+}
+
+void plMipmapDecoder::Flush()
+{
+    std::vector<plMipmapDecodeJob*> jobs;
+    {
+        hsLockGuard(fMutex);
+        jobs = fJobs;
+    }
+    for (plMipmapDecodeJob* job : jobs)
+        Finish(job->fMip);
+}
+
+void plMipmapDecoder::Update()
+{
+    std::vector<plMipmapDecodeJob*> done;
+    {
+        hsLockGuard(fMutex);
+        for (plMipmapDecodeJob* job : fJobs)
+        {
+            if (job->fState == plMipmapDecodeJob::kDone)
+                done.push_back(job);
+        }
+    }
+    for (plMipmapDecodeJob* job : done)
+        IRetire(job);
+
+    plProfile_Set(TexDecodesPending, fJobs.size());
+    plProfile_Set(TexDecodeTime, uint32_t(GetAverageTime()));
+}
+
+void plMipmapDecoder::IRetire(plMipmapDecodeJob* job)
+{
+    {
+        hsLockGuard(fMutex);
+        auto it = std::find(fJobs.begin(), fJobs.end(), job);
+        *it = fJobs.back();
+        fJobs.pop_back();
+    }
+
+    // Inline, a failed alpha decode would never have set the flag
+    if (job->fAlphaFlag && !job->fAlphaOk)
+        job->fMip->fFlags &= ~plBitmap::kAlphaChannelFlag;
+    job->fMip->fDecodeJob = nil;
+
+    fNumDecoded++;
+    fTotalTime += job->fMillis;
+    delete job;
+}
+
+//// CPU-optimized functions //////////////////////////////////////////////////
+
+static void expand_rgb_fpu(uint8_t* dst, const uint8_t* src, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 0xFF;
+        src += 3;
+        dst += 4;
+    }
+}
+
+static void expand_rgb_ssse3(uint8_t* dst, const uint8_t* src, uint32_t count)
+{
+#ifdef HS_SSSE3
+    // Four pixels a load.  The shuffle swaps red and blue as it spreads them
+    // out, and the alpha is ORed in after.
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+
+    // Each load reads 16 bytes to use 12, so stop short of the end of src
+    uint32_t i = 0;
+    for (; i + 6 <= count; i += 4)
+    {
+        __m128i rgb = _mm_loadu_si128((const __m128i*)(src + i * 3));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+    }
+    expand_rgb_fpu(dst + i * 4, src + i * 3, count - i);
+#endif  // HS_SSSE3
+}
+
+static void merge_alpha_fpu(uint8_t* dst, const uint8_t* alpha, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        dst[i * 4 + 3] = alpha[i * 4 + 2];
+}
+
+static void merge_alpha_sse2(uint8_t* dst, const uint8_t* alpha, uint32_t count)
+{
+#ifdef HS_SSE2
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i color = _mm_loadu_si128((const __m128i*)(dst + i * 4));
+        __m128i a = _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(alpha + i * 4)), 8);
+        color = _mm_or_si128(_mm_and_si128(color, colorMask), _mm_and_si128(a, alphaMask));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), color);
+    }
+    merge_alpha_fpu(dst + i * 4, alpha + i * 4, count - i);
+#endif  // HS_SSE2
+}
+
+hsCpuFunctionDispatcher<plMipmapDecoder::expand_rgb_ptr> plMipmapDecoder::expand_rgb {
+    &expand_rgb_fpu,
+    nullptr,                // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    &expand_rgb_ssse3,      // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+hsCpuFunctionDispatcher<plMipmapDecoder::merge_alpha_ptr> plMipmapDecoder::merge_alpha {
+    &merge_alpha_fpu,
+    nullptr,                // SSE1
+    &merge_alpha_sse2,      // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
@@ -0,0 +1,131 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plMipmapDecoder_inc
+#define plMipmapDecoder_inc
+
+#include "HeadSpin.h"
+#include "hsCpuID.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class hsStream;
+class plMipmap;
+struct plMipmapDecodeJob;
+
+//// plMipmapDecoder //////////////////////////////////////////////////////////
+//  Decodes JPEG and PNG maps on hsWorkerPool's threads as pages load.
+//  plMipmap::Read() hands the compressed data over and goes on with the rest
+//  of the page; the map is sized for its decoded image right away, and the
+//  pixels land in its buffer when a worker gets to it.  Anything that wants
+//  at the pixels before then waits for them (or decodes them itself, if no
+//  worker has started on them yet, or the pool has no threads).
+
+class plMipmapDecoder
+{
+public:
+    static plMipmapDecoder& Instance();
+
+    // On by default.  When off, maps decode inline on the reading thread as
+    // before.  Only affects maps read after the change.
+    void    SetEnabled(bool on);
+    bool    IsEnabled() const { return fEnabled; }
+
+    // Called by plMipmap::Read() in place of decoding.  Reads the compressed
+    // image off the stream and queues it.  Returns false if the caller should
+    // decode it inline instead.
+    bool    QueueJPEG(plMipmap* mip, hsStream* s);
+    bool    QueuePNG(plMipmap* mip, hsStream* s);
+
+    // Wait for one map's pixels
+    void    Finish(const plMipmap* mip);
+
+    // ...or everything queued so far
+    void    Flush();
+
+    // Once per frame on the main thread.  Retires finished decodes.
+    void    Update();
+
+    // Finishes anything still queued, and decodes inline from then on
+    void    Shutdown();
+
+    // Stats
+    uint32_t    GetNumPending() const { return fJobs.size(); }
+    uint32_t    GetNumDecoded() const { return fNumDecoded; }
+    float       GetAverageTime() const { return fNumDecoded ? fTotalTime / fNumDecoded : 0.f; }  // ms
+
+    //  CPU-optimized functions
+    // Expands count packed RGB pixels into the BGRx layout plMipmap uses,
+    // with the unused byte set to 0xFF.
+    typedef void(*expand_rgb_ptr)(uint8_t* dst, const uint8_t* src, uint32_t count);
+    static hsCpuFunctionDispatcher<expand_rgb_ptr> expand_rgb;
+
+    // Moves the alpha plMipmap::ISplitAlpha() stored in the red byte of each
+    // alpha pixel into the alpha byte of the matching dst pixel.
+    typedef void(*merge_alpha_ptr)(uint8_t* dst, const uint8_t* alpha, uint32_t count);
+    static hsCpuFunctionDispatcher<merge_alpha_ptr> merge_alpha;
+
+protected:
+    plMipmapDecoder();
+    virtual ~plMipmapDecoder();
+
+    bool    fEnabled;
+
+    uint32_t    fNumDecoded;
+    float       fTotalTime;
+
+    // Shared with the workers
+    std::mutex      fMutex;
+    std::condition_variable fDoneCondition;
+    std::deque<plMipmapDecodeJob*>  fQueue;     // Not started yet
+    std::vector<plMipmapDecodeJob*> fJobs;      // Every job not yet retired
+
+    void    IQueue(plMipmap* mip, plMipmapDecodeJob* job);
+    void    IDecodeNext();
+    void    IRetire(plMipmapDecodeJob* job);
+    static void IDecode(plMipmapDecodeJob* job);
+};
+
+#endif // plMipmapDecoder_inc
@@ -0,0 +1,490 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "plMipmapStreamer.h"
+#include "plMipmap.h"
+#include "hsStream.h"
+#include "plProfile.h"
+
+#include <algorithm>
+#include <chrono>
+
+plProfile_Extern(MemMipmaps);
+plProfile_CreateMemCounter("Mipmap Stream Resident", "Memory", MemMipmapStreamResident);
+plProfile_CreateMemCounter("Mipmap Stream Requested", "Memory", MemMipmapStreamRequested);
+plProfile_CreateCounterNoReset("Mipmap Stream Latency (ms)", "Memory", MipmapStreamLatency);
+
+typedef std::chrono::steady_clock plStreamClock;
+
+//// plMipmapStreamJob ////////////////////////////////////////////////////////
+//  One read of a map's top levels.  The I/O thread fills fData; the rest is
+//  set up by the main thread before queueing and read back after.
+
+struct plMipmapStreamJob
+{
+    plMipmap*   fMip;           // nil once the map is forgotten
+    plFileName  fPath;
+    uint64_t    fOffset;
+    uint32_t    fSize;          // Bytes to read into the front of fData
+    uint8_t     fCompressionType;
+    uint8_t     fPixelSize;
+    uint8_t*    fData;          // Sized for the full image
+    bool        fOk;
+    plStreamClock::time_point   fQueued;
+};
+
+//// Instance /////////////////////////////////////////////////////////////////
+
+plMipmapStreamer& plMipmapStreamer::Instance()
+{
+    static plMipmapStreamer theInstance;
+    return theInstance;
+}
+
+plMipmapStreamer::plMipmapStreamer()
+:   fEnabled(false),
+    fRunning(false),
+    fResidentSize(kDefaultResidentSize),
+    fBudget(kDefaultBudget),
+    fFrame(1),
+    fResidentBytes(0),
+    fRequestedBytes(0),
+    fAverageLatency(0)
+{
+}
+
+plMipmapStreamer::~plMipmapStreamer()
+{
+    Shutdown();
+}
+
+//// I/O Thread ///////////////////////////////////////////////////////////////
+
+void plMipmapStreamer::SetEnabled(bool on)
+{
+    fEnabled = on;
+    if (fEnabled && !fRunning)
+    {
+        fRunning = true;
+        hsThread::Start();
+    }
+}
+
+void plMipmapStreamer::Stop()
+{
+    fRunning = false;
+    fEvent.Signal();
+    hsThread::Stop();
+}
+
+void plMipmapStreamer::Shutdown()
+{
+    Stop();
+
+    std::vector<plMipmapStreamJob*> jobs(fQueue.begin(), fQueue.end());
+    jobs.insert(jobs.end(), fDone.begin(), fDone.end());
+    fQueue.clear();
+    fDone.clear();
+    for (plMipmapStreamJob* job : jobs)
+    {
+        if (job->fMip)
+            job->fMip->fStreamSource->fPending = nil;
+        delete [] job->fData;
+        delete job;
+    }
+    fRequestedBytes = 0;
+    fWanted.clear();
+}
+
+void plMipmapStreamer::Run()
+{
+    // Most reads in a row come from the same page, so keep it open until we
+    // run out of work
+    hsUNIXStream stream;
+    plFileName openPath;
+
+    while (fRunning)
+    {
+        plMipmapStreamJob* job = nil;
+        {
+            hsLockGuard(fMutex);
+            if (!fQueue.empty())
+            {
+                job = fQueue.front();
+                fQueue.pop_front();
+            }
+        }
+
+        if (!job)
+        {
+            if (openPath.IsValid())
+            {
+                stream.Close();
+                openPath = plFileName();
+            }
+            fEvent.Wait();
+            continue;
+        }
+
+        if (job->fPath != openPath)
+        {
+            if (openPath.IsValid())
+                stream.Close();
+            openPath = stream.Open(job->fPath, "rb") ? job->fPath : plFileName();
+        }
+        job->fOk = openPath.IsValid() && IRead(job, &stream);
+
+        hsLockGuard(fMutex);
+        fDone.push_back(job);
+    }
+
+    if (openPath.IsValid())
+        stream.Close();
+}
+
+bool plMipmapStreamer::IRead(plMipmapStreamJob* job, hsStream* stream)
+{
+    if (job->fOffset + job->fSize > stream->GetEOF())
+        return false;
+
+    stream->SetPosition(job->fOffset);
+    switch (job->fCompressionType)
+    {
+        case plBitmap::kDirectXCompression:
+            return stream->Read(job->fSize, job->fData) == job->fSize;
+
+        case plBitmap::kUncompressed:
+            // Same as plMipmap::IReadRawImage().  Every level is a whole
+            // number of pixels, so the levels can go in one run.
+            if (job->fPixelSize == 32)
+                stream->ReadLE32(job->fSize >> 2, (uint32_t*)job->fData);
+            else
+                stream->ReadLE16(job->fSize >> 1, (uint16_t*)job->fData);
+            return true;
+    }
+    return false;
+}
+
+//// Read Support /////////////////////////////////////////////////////////////
+
+uint8_t plMipmapStreamer::LevelsToStream(const plMipmap* mip) const
+{
+    if (!fEnabled)
+        return 0;
+
+    // Same limits as the level chop in plMipmap::Read()
+    uint8_t levels = 0;
+    uint32_t width = mip->GetWidth();
+    uint32_t height = mip->GetHeight();
+    while (levels + 1 < mip->GetNumLevels() && width > 4 && height > 4 &&
+           std::max(width, height) > fResidentSize)
+    {
+        width >>= 1;
+        height >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+void plMipmapStreamer::Add(plMipmap* mip)
+{
+    fStreamed.push_back(mip);
+}
+
+void plMipmapStreamer::Forget(plMipmap* mip)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+    if (!src)
+        return;
+
+    if (src->fPending)
+        src->fPending->fMip = nil;
+    if (src->fResident)
+    {
+        fResident.erase(std::find(fResident.begin(), fResident.end(), mip));
+        fResidentBytes -= src->fStreamSize;
+    }
+    auto wanted = std::find(fWanted.begin(), fWanted.end(), mip);
+    if (wanted != fWanted.end())
+        fWanted.erase(wanted);
+
+    auto it = std::find(fStreamed.begin(), fStreamed.end(), mip);
+    if (it != fStreamed.end())
+    {
+        *it = fStreamed.back();
+        fStreamed.pop_back();
+    }
+}
+
+void plMipmapStreamer::Pin(plMipmap* mip)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+    if (!src)
+        return;
+
+    if (!src->fResident)
+    {
+        plMipmapStreamJob* job = IMakeJob(mip);
+        hsUNIXStream stream;
+        if (stream.Open(job->fPath, "rb"))
+        {
+            if (IRead(job, &stream))
+            {
+                ISetImage(mip, job->fData, true);
+                job->fData = nil;
+            }
+            stream.Close();
+        }
+        delete [] job->fData;
+        delete job;
+    }
+
+    Forget(mip);
+    delete src;
+    mip->fStreamSource = nil;
+}
+
+//// Requests /////////////////////////////////////////////////////////////////
+
+void plMipmapStreamer::Request(plMipmap* mip, float screenSize)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+    if (!src)
+        return;
+
+    // The resident levels cover it
+    if (screenSize <= std::max(src->fTailWidth, src->fTailHeight))
+        return;
+
+    if (src->fLastWanted == fFrame)
+    {
+        src->fWantedSize = std::max(src->fWantedSize, screenSize);
+        return;
+    }
+    src->fLastWanted = fFrame;
+    src->fWantedSize = screenSize;
+    if (!src->fResident && !src->fPending)
+        fWanted.push_back(mip);
+}
+
+void plMipmapStreamer::Update()
+{
+    std::vector<plMipmapStreamJob*> done;
+    {
+        hsLockGuard(fMutex);
+        done.swap(fDone);
+    }
+    for (plMipmapStreamJob* job : done)
+        IApply(job);
+
+    // Biggest on screen first, and only as much as fits.  Levels nobody has
+    // wanted for a while make room; anything wanted lately stays, so two
+    // views fighting over the budget don't thrash the disk.
+    std::sort(fWanted.begin(), fWanted.end(),
+        [](const plMipmap* a, const plMipmap* b) {
+            return a->fStreamSource->fWantedSize > b->fStreamSource->fWantedSize;
+        });
+    for (plMipmap* mip : fWanted)
+    {
+        uint32_t size = mip->fStreamSource->fStreamSize;
+        IMakeRoom(size, kEvictFrames);
+        if (fResidentBytes + fRequestedBytes + size > fBudget)
+            break;
+        IQueue(mip);
+    }
+    fWanted.clear();
+
+    // If the budget was lowered, whatever isn't on screen goes
+    IMakeRoom(0, 1);
+
+    fFrame++;
+    IUpdateCounters();
+}
+
+void plMipmapStreamer::IMakeRoom(uint32_t bytes, uint32_t minAge)
+{
+    if (fResidentBytes + fRequestedBytes + bytes <= fBudget)
+        return;
+
+    std::sort(fResident.begin(), fResident.end(),
+        [](const plMipmap* a, const plMipmap* b) {
+            return a->fStreamSource->fLastWanted < b->fStreamSource->fLastWanted;
+        });
+    while (!fResident.empty() && fResidentBytes + fRequestedBytes + bytes > fBudget)
+    {
+        plMipmap* oldest = fResident.front();
+        if (fFrame - oldest->fStreamSource->fLastWanted < minAge)
+            break;
+        IEvict(oldest);
+    }
+}
+
+plMipmapStreamJob* plMipmapStreamer::IMakeJob(plMipmap* mip)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+
+    plMipmapStreamJob* job = new plMipmapStreamJob;
+    job->fMip = mip;
+    job->fPath = src->fPath;
+    job->fOffset = src->fOffset;
+    job->fSize = src->fStreamSize;
+    job->fCompressionType = mip->fCompressionType;
+    job->fPixelSize = mip->fPixelSize;
+    job->fData = new uint8_t[src->fTotalSize];
+    job->fOk = false;
+    job->fQueued = plStreamClock::now();
+    return job;
+}
+
+void plMipmapStreamer::IQueue(plMipmap* mip)
+{
+    plMipmapStreamJob* job = IMakeJob(mip);
+    mip->fStreamSource->fPending = job;
+    fRequestedBytes += job->fSize;
+    {
+        hsLockGuard(fMutex);
+        fQueue.push_back(job);
+    }
+    fEvent.Signal();
+}
+
+void plMipmapStreamer::IApply(plMipmapStreamJob* job)
+{
+    fRequestedBytes -= job->fSize;
+
+    plMipmap* mip = job->fMip;
+    if (mip)
+    {
+        plMipmapStreamSource* src = mip->fStreamSource;
+        src->fPending = nil;
+
+        if (job->fOk)
+        {
+            float ms = std::chrono::duration<float, std::milli>(plStreamClock::now() - job->fQueued).count();
+            fAverageLatency = fAverageLatency > 0 ? fAverageLatency * 0.9f + ms * 0.1f : ms;
+
+            ISetImage(mip, job->fData, true);
+            job->fData = nil;
+            src->fResident = true;
+            fResident.push_back(mip);
+            fResidentBytes += src->fStreamSize;
+        }
+        else
+        {
+            // Page moved or shrank underneath us, settle for what we have
+            hsStatusMessageF("Can't stream mip levels of %s from %s\n",
+                             mip->GetKeyName().c_str(), src->fPath.AsString().c_str());
+            Forget(mip);
+            delete src;
+            mip->fStreamSource = nil;
+        }
+    }
+
+    delete [] job->fData;
+    delete job;
+}
+
+void plMipmapStreamer::IEvict(plMipmap* mip)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+
+    uint8_t* tail = new uint8_t[src->fTailSize];
+    memcpy(tail, (uint8_t*)mip->fImage + src->fStreamSize, src->fTailSize);
+    ISetImage(mip, tail, false);
+
+    src->fResident = false;
+    fResident.erase(std::find(fResident.begin(), fResident.end(), mip));
+    fResidentBytes -= src->fStreamSize;
+}
+
+//// ISetImage ////////////////////////////////////////////////////////////////
+//  Swaps in a full image (with the top levels read into its front) or just
+//  the tail, and has the pipeline rebuild the texture next time it's used.
+
+void plMipmapStreamer::ISetImage(plMipmap* mip, uint8_t* image, bool full)
+{
+    plMipmapStreamSource* src = mip->fStreamSource;
+
+    if (full)
+        memcpy(image + src->fStreamSize, mip->fImage, src->fTailSize);
+
+    plProfile_DelMem(MemMipmaps, mip->fTotalSize);
+#ifdef MEMORY_LEAK_TRACER
+    plMipmap::IRemoveFromMemRecord((uint8_t*)mip->fImage);
+#endif
+    delete [] (uint8_t*)mip->fImage;
+
+    mip->fImage = image;
+    if (full)
+    {
+        mip->fWidth = src->fWidth;
+        mip->fHeight = src->fHeight;
+        mip->fRowBytes = src->fRowBytes;
+        mip->fTotalSize = src->fTotalSize;
+        mip->fNumLevels = src->fNumLevels;
+    }
+    else
+    {
+        mip->fWidth = src->fTailWidth;
+        mip->fHeight = src->fTailHeight;
+        mip->fRowBytes = src->fTailRowBytes;
+        mip->fTotalSize = src->fTailSize;
+        mip->fNumLevels = src->fTailLevels;
+    }
+    mip->IBuildLevelSizes();
+    mip->SetCurrLevel(0);
+
+    plProfile_NewMem(MemMipmaps, mip->fTotalSize);
+#ifdef MEMORY_LEAK_TRACER
+    plMipmap::IAddToMemRecord(mip, plMipmap::plRecord::kViaRead);
+#endif
+
+    mip->MakeDirty();
+}
+
+void plMipmapStreamer::IUpdateCounters()
+{
+    plProfile_Set(MemMipmapStreamResident, fResidentBytes);
+    plProfile_Set(MemMipmapStreamRequested, fRequestedBytes);
+    plProfile_Set(MipmapStreamLatency, uint32_t(fAverageLatency));
+}
@@ -0,0 +1,179 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plMipmapStreamer_inc
+#define plMipmapStreamer_inc
+
+#include "HeadSpin.h"
+#include "hsThread.h"
+#include "plFileSystem.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class hsStream;
+class plMipmap;
+struct plMipmapStreamJob;
+
+//// plMipmapStreamSource /////////////////////////////////////////////////////
+//  Where a streamed mipmap's top levels live on disk, and what the full map
+//  looks like.  Owned by the mipmap; only touched from the main thread.
+
+struct plMipmapStreamSource
+{
+    plFileName  fPath;
+    uint64_t    fOffset;        // First byte of the level 0 data in fPath
+    uint32_t    fStreamSize;    // Bytes of the levels left on disk
+
+    // The full map, as written
+    uint32_t    fWidth, fHeight, fRowBytes, fTotalSize;
+    uint8_t     fNumLevels;
+
+    // The resident tail, what Read() keeps in memory
+    uint32_t    fTailWidth, fTailHeight, fTailRowBytes, fTailSize;
+    uint8_t     fTailLevels;
+
+    bool        fResident;      // Top levels are loaded
+    uint32_t    fLastWanted;    // Frame the pipeline last asked for them
+    float       fWantedSize;    // Largest screen size asked for that frame
+
+    plMipmapStreamJob*  fPending;   // Read in flight
+};
+
+//// plMipmapStreamer /////////////////////////////////////////////////////////
+//  Loads only the small mip levels of page textures up front, and reads the
+//  large ones in on an I/O thread once the pipeline reports a texture is big
+//  enough on screen to need them.  Loaded levels count against a memory
+//  budget; the least recently wanted are dropped when it runs over.
+//
+//  Only DXT and raw maps read straight from a page file stream; JPEG and PNG
+//  maps, and maps in compressed pages, load whole as before.
+
+class plMipmapStreamer : public hsThread
+{
+public:
+    enum
+    {
+        kDefaultResidentSize    = 128,                  // Largest level loaded up front
+        kDefaultBudget          = 64 * 1024 * 1024,     // Bytes of streamed levels
+        kEvictFrames            = 60,                   // Unwanted this long, drop when over budget
+    };
+
+    static plMipmapStreamer& Instance();
+
+    void    Run() HS_OVERRIDE;
+    void    Stop() HS_OVERRIDE;
+
+    // Stops the I/O thread and drops any reads still in flight
+    void    Shutdown();
+
+    // Off by default.  Only affects maps read after the change.
+    void    SetEnabled(bool on);
+    bool    IsEnabled() const { return fEnabled; }
+
+    void        SetResidentSize(uint32_t size) { fResidentSize = size; }
+    uint32_t    GetResidentSize() const { return fResidentSize; }
+
+    void        SetBudget(uint32_t bytes) { fBudget = bytes; }
+    uint32_t    GetBudget() const { return fBudget; }
+
+    // Called by plMipmap::Read(), returns how many top levels to leave on disk
+    uint8_t     LevelsToStream(const plMipmap* mip) const;
+
+    // ...and this once it has set up the map's stream source
+    void        Add(plMipmap* mip);
+
+    // The pipeline reports a map drawn at roughly screenSize pixels across
+    void    Request(plMipmap* mip, float screenSize);
+
+    // Once per frame on the main thread.  Applies finished loads, drops
+    // levels over budget and queues new reads.
+    void    Update();
+
+    // Load everything now and stop streaming this map
+    void    Pin(plMipmap* mip);
+
+    // The map is going away or giving up its image
+    void    Forget(plMipmap* mip);
+
+    // Stats
+    uint32_t    GetResidentBytes() const { return fResidentBytes; }
+    uint32_t    GetRequestedBytes() const { return fRequestedBytes; }
+    float       GetAverageLatency() const { return fAverageLatency; }   // ms
+    uint32_t    GetNumStreamed() const { return fStreamed.size(); }
+
+protected:
+    plMipmapStreamer();
+    virtual ~plMipmapStreamer();
+
+    bool        fEnabled;
+    bool        fRunning;
+    uint32_t    fResidentSize;
+    uint32_t    fBudget;
+    uint32_t    fFrame;
+
+    std::vector<plMipmap*>  fStreamed;      // Maps with a stream source
+    std::vector<plMipmap*>  fResident;      // ...whose top levels are loaded
+    std::vector<plMipmap*>  fWanted;        // ...wanted this frame but not loaded
+
+    uint32_t    fResidentBytes;
+    uint32_t    fRequestedBytes;
+    float       fAverageLatency;
+
+    // Shared with the I/O thread
+    std::mutex          fMutex;
+    hsEvent             fEvent;
+    std::deque<plMipmapStreamJob*>  fQueue;
+    std::vector<plMipmapStreamJob*> fDone;
+
+    plMipmapStreamJob*  IMakeJob(plMipmap* mip);
+    void    IQueue(plMipmap* mip);
+    void    IApply(plMipmapStreamJob* job);
+    void    IMakeRoom(uint32_t bytes, uint32_t minAge);
+    void    IEvict(plMipmap* mip);
+    void    ISetImage(plMipmap* mip, uint8_t* image, bool full);
+    void    IUpdateCounters();
+    static bool IRead(plMipmapStreamJob* job, hsStream* stream);
+};
+
+#endif // plMipmapStreamer_inc
@@ -75,15 +75,14 @@ plPNG& plPNG::Instance(void)
     return theInstance;
 }
 
-//// IRead ////////////////////////////////////////////////////////////////////
-//  Given an open hsStream, reads the PNG data off of the
-//  stream and decodes it into a new plMipmap. The mipmap's buffer ends up
-//  being a packed RGBA buffer.
-//  Returns a pointer to the new mipmap if successful, NULL otherwise.
+//// IDecode //////////////////////////////////////////////////////////////////
+//  Given an open hsStream, reads the PNG data off of the stream and decodes
+//  it into packed BGRA pixels. Once the header is read, getDest is handed
+//  the image size and returns where the pixels go, or NULL to give up.
 
-plMipmap* plPNG::IRead(hsStream* inStream)
+bool plPNG::IDecode(hsStream* inStream, const std::function<uint8_t*(uint32_t, uint32_t)>& getDest)
 {
-    plMipmap* newMipmap = NULL;
+    bool result = false;
     png_structp png_ptr;
     png_infop info_ptr;
     png_infop end_info;
@@ -126,6 +125,11 @@ plMipmap* plPNG::IRead(hsStream* inStream)
             png_uint_32 channels   = png_get_channels(png_ptr, info_ptr);
             png_uint_32 color_type = png_get_color_type(png_ptr, info_ptr);
 
+            //  We only keep 8 bits per channel
+            if (bitdepth == 16) {
+                png_set_strip_16(png_ptr);
+            }
+
             //  Convert images to RGB color space
             switch (color_type) {
                 case PNG_COLOR_TYPE_PALETTE:
@@ -133,12 +137,14 @@ plMipmap* plPNG::IRead(hsStream* inStream)
                     channels = 3;
                     break;
                 case PNG_COLOR_TYPE_GRAY:
+                case PNG_COLOR_TYPE_GRAY_ALPHA:
 
                     if (bitdepth < 8) {
                         png_set_expand_gray_1_2_4_to_8(png_ptr);
                     }
 
-                    bitdepth = 8;
+                    png_set_gray_to_rgb(png_ptr);
+                    channels += 2;
                     break;
             }
 
@@ -154,24 +160,50 @@ plMipmap* plPNG::IRead(hsStream* inStream)
 
             // Invert color byte-order as used by plMipmap for DirectX
             png_set_bgr(png_ptr);
-            /// Construct a new mipmap to hold everything
-            newMipmap = new plMipmap(imgWidth, imgHeight, plMipmap::kARGB32Config, 1, plMipmap::kUncompressed);
-            char* destp = (char*)newMipmap->GetImage();
-            png_bytep* row_ptrs = new png_bytep[imgHeight];
-            const unsigned int stride = imgWidth * bitdepth * channels / 8;
-
-            //  Assign row pointers to the appropriate locations in the newly-created Mipmap
-            for (size_t i = 0; i < imgHeight; i++) {
-                row_ptrs[i] = (png_bytep)destp + (i * stride);
+
+            uint8_t* destp = getDest(imgWidth, imgHeight);
+            if (destp) {
+                png_bytep* row_ptrs = new png_bytep[imgHeight];
+                const unsigned int stride = imgWidth * 4;
+
+                //  Assign row pointers to the appropriate locations in the buffer
+                for (size_t i = 0; i < imgHeight; i++) {
+                    row_ptrs[i] = (png_bytep)destp + (i * stride);
+                }
+
+                png_read_image(png_ptr, row_ptrs);
+                png_read_end(png_ptr, end_info);
+                delete [] row_ptrs;
+                result = true;
             }
 
-            png_read_image(png_ptr, row_ptrs);
-            png_read_end(png_ptr, end_info);
             //  Clean up allocated structs
             png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-            delete [] row_ptrs;
         }
     } catch (...) {
+        result = false;
+    }
+
+    return result;
+}
+
+//// IRead ////////////////////////////////////////////////////////////////////
+//  Given an open hsStream, reads the PNG data off of the
+//  stream and decodes it into a new plMipmap. The mipmap's buffer ends up
+//  being a packed RGBA buffer.
+//  Returns a pointer to the new mipmap if successful, NULL otherwise.
+
+plMipmap* plPNG::IRead(hsStream* inStream)
+{
+    plMipmap* newMipmap = NULL;
+
+    bool ok = IDecode(inStream, [&newMipmap](uint32_t width, uint32_t height) {
+        /// Construct a new mipmap to hold everything
+        newMipmap = new plMipmap(width, height, plMipmap::kARGB32Config, 1, plMipmap::kUncompressed);
+        return (uint8_t*)newMipmap->GetImage();
+    });
+
+    if (!ok) {
         delete newMipmap;
         newMipmap = nullptr;
     }
@@ -179,6 +211,32 @@ plMipmap* plPNG::IRead(hsStream* inStream)
     return newMipmap;
 }
 
+//// ReadHeader / ReadToBuffer ////////////////////////////////////////////////
+
+bool plPNG::ReadHeader(const uint8_t* data, uint32_t size, uint32_t* width, uint32_t* height)
+{
+    //  The signature, then IHDR, which has to come first
+    const uint32_t kIHDROffset = PNGSIGSIZE + 8;
+    if (size < kIHDROffset + 8 || png_sig_cmp((png_const_bytep)data, 0, PNGSIGSIZE) ||
+        memcmp(data + PNGSIGSIZE + 4, "IHDR", 4) != 0) {
+        return false;
+    }
+
+    auto readBE32 = [](const uint8_t* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    };
+    *width = readBE32(data + kIHDROffset);
+    *height = readBE32(data + kIHDROffset + 4);
+    return *width > 0 && *height > 0;
+}
+
+bool plPNG::ReadToBuffer(hsStream* inStream, uint8_t* dest, uint32_t width, uint32_t height)
+{
+    return IDecode(inStream, [=](uint32_t w, uint32_t h) {
+        return (w == width && h == height) ? dest : nullptr;
+    });
+}
+
 plMipmap* plPNG::ReadFromFile(const plFileName& fileName)
 {
     hsUNIXStream in;
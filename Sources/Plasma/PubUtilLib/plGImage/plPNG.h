@@ -43,6 +43,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #ifndef _plPNG_h
 #define _plPNG_h
 
+#include <functional>
 #include <map>
 
 //// Class Definition /////////////////////////////////////////////////////////
@@ -54,6 +55,7 @@ class plPNG {
 protected:
 
     plMipmap* IRead(hsStream* inStream);
+    bool IDecode(hsStream* inStream, const std::function<uint8_t*(uint32_t, uint32_t)>& getDest);
     bool IWrite(plMipmap* source, hsStream* outStream, const std::multimap<ST::string, ST::string>& textFields = std::multimap<ST::string, ST::string>());
 
 public:
@@ -61,6 +63,13 @@ public:
     plMipmap* ReadFromStream(hsStream* inStream) { return IRead(inStream); }
     plMipmap* ReadFromFile(const plFileName& fileName);
 
+    // For plMipmapDecoder, which decodes straight into a map it has already
+    // sized.  ReadHeader() looks at a whole PNG file in memory; ReadToBuffer()
+    // reads one off the stream just as ReadFromStream() does.  Both are safe
+    // to call from any thread.
+    bool ReadHeader(const uint8_t* data, uint32_t size, uint32_t* width, uint32_t* height);
+    bool ReadToBuffer(hsStream* inStream, uint8_t* dest, uint32_t width, uint32_t height);
+
     bool WriteToStream(hsStream* outStream, plMipmap* sourceData,
         const std::multimap<ST::string, ST::string>& textFields = std::multimap<ST::string, ST::string>()) { return IWrite(sourceData, outStream, textFields); }
     bool WriteToFile(const plFileName& fileName, plMipmap* sourceData, const std::multimap<ST::string, ST::string>& textFields = std::multimap<ST::string, ST::string>());
@@ -398,110 +398,83 @@ static inline hsKeyFrame* GetKey(int32_t i, void *keys, int32_t size)
 // a fraction (p=0-1) indicating where the time falls between them.
 // Returns the index of the first key which can be passed in as a hint (lastKeyIdx)
 // for the next search.
+// Playback almost always lands in the hinted pair or its neighbour in the
+// direction of play, so those are checked first. Anything else (seeks, wraps,
+// big time steps) is a binary search on the key frames instead of a scan.
 //
 void hsInterp::GetBoundaryKeyFrames(float time, uint32_t numKeys, void *keys, uint32_t size,
                                     hsKeyFrame **kF1, hsKeyFrame **kF2, uint32_t *lastKeyIdx, float *p, bool forwards)
 {
     hsAssert(numKeys>1, "Must have more than 1 keyframe");
-    int k1, k2;
+    uint32_t k1;
     float frame = time * MAX_FRAMES_PER_SEC;
 
     // boundary case, past end
     if (frame > GetKey(numKeys-1, keys, size)->fFrame)
     {
-        k1=k2=numKeys-1;
+        k1 = numKeys-1;
         (*kF2) = GetKey(k1, keys, size);
         (*kF1) = (*kF2);
         *p = 0.0;
-        goto ret;
+        *lastKeyIdx = k1;
+        return;
     }
 
-    hsKeyFrame *key1, *key2;
     // boundary case, before start
-    if (frame < (key1=GetKey(0, keys, size))->fFrame)
+    if (frame < GetKey(0, keys, size)->fFrame)
     {
-        k1=k2=0;
+        k1 = 0;
         (*kF1) = GetKey(k1, keys, size);
         (*kF2) = (*kF1);
         *p = 0.0;
-        goto ret;
+        *lastKeyIdx = k1;
+        return;
     }
 
-    // prime loop
-    int i;
-    i = 1;
-    if (*lastKeyIdx > 0 && *lastKeyIdx < numKeys - 1)
-    {
-        // new starting point for search
-        if (forwards)
-            key1 = GetKey(*lastKeyIdx, keys, size);
-        else
-            key2 = GetKey(*lastKeyIdx + 1, keys, size);
+    hsKeyFrame *key1, *key2;
 
-        i = *lastKeyIdx + 1;
-    }
-    else if (!forwards)
+    // hinted pair
+    k1 = (*lastKeyIdx < numKeys - 1 ? *lastKeyIdx : 0);
+    key1 = GetKey(k1, keys, size);
+    key2 = GetKey(k1 + 1, keys, size);
+    if (frame >= key1->fFrame && frame <= key2->fFrame)
+        goto found;
+
+    // next pair in the direction of play
+    if (forwards ? (k1 + 2 < numKeys) : (k1 > 0))
     {
-        key2 = GetKey(1, keys, size);
+        k1 = (forwards ? k1 + 1 : k1 - 1);
+        key1 = GetKey(k1, keys, size);
+        key2 = GetKey(k1 + 1, keys, size);
+        if (frame >= key1->fFrame && frame <= key2->fFrame)
+            goto found;
     }
 
-    // search pairs of keys
-    int count;
-    if (forwards)
+    // Binary search for the first key at or after frame, so a pair of keys
+    // sharing a frame is never picked over the pair leading into it.
     {
-        for (count = 1; count <= numKeys; count++, i++)
+        uint32_t lo = 0, hi = numKeys - 1;
+        while (hi - lo > 1)
         {
-            if (i >= numKeys)
-            {
-                key1 = GetKey(0, keys, size);
-                i = 1;
-                count++;
-            }
-                
-            key2 = GetKey(i, keys, size);
-            if (frame <= key2->fFrame && frame >= key1->fFrame)
-            {
-                k2=i;
-                k1=i-1;
-                (*kF2) = key2;
-                (*kF1) = key1;
-                *p = (time - (*kF1)->fFrame / MAX_FRAMES_PER_SEC) / (((*kF2)->fFrame - (*kF1)->fFrame) / MAX_FRAMES_PER_SEC);
-                goto ret;
-            }
-            key1=key2;
+            uint32_t mid = lo + ((hi - lo) >> 1);
+            if (GetKey(mid, keys, size)->fFrame < frame)
+                lo = mid;
+            else
+                hi = mid;
         }
+        k1 = lo;
+        key1 = GetKey(k1, keys, size);
+        key2 = GetKey(k1 + 1, keys, size);
     }
-    else
-    {
-        for (count = 1; count <= numKeys; count++, i--)
-        {
-            if (i < 1)
-            {
-                i = numKeys - 1;
-                key2 = GetKey(i, keys, size);
-                count++;
-            }
-            
-            key1 = GetKey(i - 1, keys, size);
-            if (frame <= key2->fFrame && frame >= key1->fFrame)
-            {
-                k2 = i;
-                k1 = i - 1;
-                (*kF2) = key2;
-                (*kF1) = key1;
-                *p = (time - (*kF1)->fFrame / MAX_FRAMES_PER_SEC) / (((*kF2)->fFrame - (*kF1)->fFrame) / MAX_FRAMES_PER_SEC);
-                goto ret;
-            }
-            key2=key1;
-        }
-    }       
 
-ret:
-;
+found:
+    (*kF1) = key1;
+    (*kF2) = key2;
+    *p = (time - key1->fFrame / MAX_FRAMES_PER_SEC) / ((key2->fFrame - key1->fFrame) / MAX_FRAMES_PER_SEC);
 
 #if 0
     char str[128];
-    sprintf(str, "k1=%d, k2=%d, p=%f\n", k1, k2, *p);
+    sprintf(str, "k1=%d, k2=%d, p=%f\n", k1, k1 + 1, *p);
     OutputDebugString(str);
 #endif
     *lastKeyIdx = k1;
@@ -439,6 +439,54 @@ void hsCompressedQuatKey64::GetQuat(hsQuat &q)
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+
+const float hsCompressedPoint3Key::k16BitScaleRange = 65535;
+
+void hsCompressedPoint3Key::Read(hsStream *stream)
+{
+    fFrame = stream->ReadLE16();
+    fData[0] = stream->ReadLE16();
+    fData[1] = stream->ReadLE16();
+    fData[2] = stream->ReadLE16();
+}
+
+void hsCompressedPoint3Key::Write(hsStream *stream)
+{
+    stream->WriteLE16(fFrame);
+    stream->WriteLE16(fData[0]);
+    stream->WriteLE16(fData[1]);
+    stream->WriteLE16(fData[2]);
+}
+
+bool hsCompressedPoint3Key::CompareValue(hsCompressedPoint3Key *key)
+{
+    return (fData[0] == key->fData[0]) && (fData[1] == key->fData[1]) && (fData[2] == key->fData[2]);
+}
+
+// step is the size of one quantization step on each axis, which is the
+// track's range over k16BitScaleRange. A zero step means the axis is constant.
+void hsCompressedPoint3Key::SetPoint(const hsScalarTriple &pt, const hsPoint3 &offset, const hsPoint3 &step)
+{
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        float q = step[i] > 0 ? (pt[i] - offset[i]) / step[i] + 0.5f : 0;
+        if (q < 0)
+            q = 0;
+        if (q > k16BitScaleRange)
+            q = k16BitScaleRange;
+        fData[i] = (uint16_t)q;
+    }
+}
+
+void hsCompressedPoint3Key::GetPoint(hsScalarTriple &pt, const hsPoint3 &offset, const hsPoint3 &step) const
+{
+    pt.fX = offset.fX + fData[0] * step.fX;
+    pt.fY = offset.fY + fData[1] * step.fY;
+    pt.fZ = offset.fZ + fData[2] * step.fZ;
+}
+
 /////////////////////////////////////////
 // Not a key
 //
@@ -68,6 +68,7 @@ struct hsKeyFrame
         k3dsMaxKeyFrame,
         kMatrix33KeyFrame,
         kMatrix44KeyFrame,
+        kCompressedPoint3KeyFrame,
     };
 
     uint16_t fFrame;
@@ -179,6 +180,24 @@ protected:
     uint32_t fData[2];
 };
 
+// Each axis is stored as 16 bits spread across a range shared by every key
+// in the track. The range lives in the owning plLeafController.
+struct hsCompressedPoint3Key : public hsKeyFrame
+{
+    static const float k16BitScaleRange;
+
+    void SetPoint(const hsScalarTriple &pt, const hsPoint3 &offset, const hsPoint3 &step);
+    void GetPoint(hsScalarTriple &pt, const hsPoint3 &offset, const hsPoint3 &step) const;
+
+    void Read(hsStream *stream);
+    void Write(hsStream *stream);
+
+    bool CompareValue(hsCompressedPoint3Key *key);
+
+protected:
+    uint16_t fData[3];
+};
+
 struct hsScaleValue : public hsKeyFrame
 {
     hsVector3   fS; /* Scale components for x,y,z */
@@ -47,6 +47,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plAnimTimeConvert.h"
 
 #include <algorithm>
+#include <cmath>
 #include <type_traits>
 
 
@@ -78,11 +79,33 @@ void plControllerCacheInfo::SetATC(plAnimTimeConvert *atc)
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+bool plLeafController::fCompressOnRead = false;
+const float plLeafController::kDefaultQuatTolerance = 0.002f;
+const float plLeafController::kDefaultPosTolerance = 0.001f;
+
 plLeafController::~plLeafController()
 {
     delete[] reinterpret_cast<hsKeyFrame *>(fKeys);
 }
 
+void plLeafController::IGetBoundaryKeyFrames(float time, uint32_t size, hsKeyFrame **kF1, hsKeyFrame **kF2,
+                                             uint32_t *idxStore, float *p, bool forwards) const
+{
+    // Evenly spaced keys can be indexed directly. Handing the index over as
+    // the hint means the search finds it on its first check.
+    if (fKeySpacing)
+    {
+        float idx = (time * MAX_FRAMES_PER_SEC - ((hsKeyFrame *)fKeys)->fFrame) / fKeySpacing;
+        if (idx <= 0)
+            *idxStore = 0;
+        else if (idx < fNumKeys - 1)
+            *idxStore = (uint32_t)idx;
+        else
+            *idxStore = fNumKeys - 2;
+    }
+    hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, size, kF1, kF2, idxStore, p, forwards);
+}
+
 void plLeafController::Interp(float time, float* result, plControllerCacheInfo *cache) const
 {
     hsAssert(fType == hsKeyFrame::kScalarKeyFrame || fType == hsKeyFrame::kBezScalarKeyFrame, kInvalidInterpString);
@@ -93,7 +116,7 @@ void plLeafController::Interp(float time, float* result, plControllerCacheInfo *
         hsScalarKey *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsScalarKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsScalarKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::LinInterp(k1->fValue, k2->fValue, t, result);
     }
     else
@@ -101,14 +124,16 @@ void plLeafController::Interp(float time, float* result, plControllerCacheInfo *
         hsBezScalarKey *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsBezScalarKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsBezScalarKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::BezInterp(k1, k2, t, result);
     }
 }
 
 void plLeafController::Interp(float time, hsScalarTriple* result, plControllerCacheInfo *cache) const
 {
-    hsAssert(fType == hsKeyFrame::kPoint3KeyFrame || fType == hsKeyFrame::kBezPoint3KeyFrame, kInvalidInterpString);
+    hsAssert(fType == hsKeyFrame::kPoint3KeyFrame || 
+             fType == hsKeyFrame::kBezPoint3KeyFrame ||
+             fType == hsKeyFrame::kCompressedPoint3KeyFrame, kInvalidInterpString);
 
     bool tryForward = (cache? cache->fAtc->IsForewards() : true);
     if (fType == hsKeyFrame::kPoint3KeyFrame)
@@ -116,15 +141,27 @@ void plLeafController::Interp(float time, hsScalarTriple* result, plControllerCa
         hsPoint3Key *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsPoint3Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsPoint3Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::LinInterp(&k1->fValue, &k2->fValue, t, result);
     }
+    else if (fType == hsKeyFrame::kCompressedPoint3KeyFrame)
+    {
+        hsCompressedPoint3Key *k1, *k2;
+        float t;
+        uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
+        IGetBoundaryKeyFrames(time, sizeof(hsCompressedPoint3Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+
+        hsPoint3 p1, p2;
+        k1->GetPoint(p1, fQuantOffset, fQuantStep);
+        k2->GetPoint(p2, fQuantOffset, fQuantStep);
+        hsInterp::LinInterp(&p1, &p2, t, result);
+    }
     else
     {
         hsBezPoint3Key *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsBezPoint3Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsBezPoint3Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::BezInterp(k1, k2, t, result);
     }
 }
@@ -139,7 +176,7 @@ void plLeafController::Interp(float time, hsScaleValue* result, plControllerCach
         hsScaleKey *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsScaleKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsScaleKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::LinInterp(&k1->fValue, &k2->fValue, t, result);
     }
     else
@@ -147,7 +184,7 @@ void plLeafController::Interp(float time, hsScaleValue* result, plControllerCach
         hsBezScaleKey *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsBezScaleKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsBezScaleKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::BezInterp(k1, k2, t, result);
     }
 }
@@ -164,7 +201,7 @@ void plLeafController::Interp(float time, hsQuat* result, plControllerCacheInfo
         hsQuatKey *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsQuatKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsQuatKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
         hsInterp::LinInterp(&k1->fValue, &k2->fValue, t, result);
     }
     else if (fType == hsKeyFrame::kCompressedQuatKeyFrame32)
@@ -172,7 +209,7 @@ void plLeafController::Interp(float time, hsQuat* result, plControllerCacheInfo
         hsCompressedQuatKey32 *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsCompressedQuatKey32), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsCompressedQuatKey32), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
 
         hsQuat q1, q2;
         k1->GetQuat(q1);
@@ -184,7 +221,7 @@ void plLeafController::Interp(float time, hsQuat* result, plControllerCacheInfo
         hsCompressedQuatKey64 *k1, *k2;
         float t;
         uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-        hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsCompressedQuatKey64), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+        IGetBoundaryKeyFrames(time, sizeof(hsCompressedQuatKey64), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
 
         hsQuat q1, q2;
         k1->GetQuat(q1);
@@ -201,7 +238,7 @@ void plLeafController::Interp(float time, hsMatrix33* result, plControllerCacheI
     hsMatrix33Key *k1, *k2;
     float t;
     uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-    hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsMatrix33Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+    IGetBoundaryKeyFrames(time, sizeof(hsMatrix33Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
     hsInterp::LinInterp(&k1->fValue, &k2->fValue, t, result);
 }
 
@@ -213,7 +250,7 @@ void plLeafController::Interp(float time, hsMatrix44* result, plControllerCacheI
     hsMatrix44Key *k1, *k2;
     float t;
     uint32_t *idxStore = (cache ? &cache->fKeyIndex : &fLastKeyIdx);
-    hsInterp::GetBoundaryKeyFrames(time, fNumKeys, fKeys, sizeof(hsMatrix44Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
+    IGetBoundaryKeyFrames(time, sizeof(hsMatrix44Key), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, idxStore, &t, tryForward);
     hsInterp::LinInterp(&k1->fValue, &k2->fValue, t, result);
 }
 
@@ -271,6 +308,8 @@ uint32_t plLeafController::GetStride() const
         return sizeof(hsMatrix33Key);
     case hsKeyFrame::kMatrix44KeyFrame:
         return sizeof(hsMatrix44Key);
+    case hsKeyFrame::kCompressedPoint3KeyFrame:
+        return sizeof(hsCompressedPoint3Key);
     case hsKeyFrame::kUnknownKeyFrame:
     default:
         return 0;
@@ -373,6 +412,14 @@ hsMatrix44Key *plLeafController::GetMatrix44Key(uint32_t i) const
     return (hsMatrix44Key *)((uint8_t *)fKeys + i * sizeof(hsMatrix44Key));
 }
 
+hsCompressedPoint3Key *plLeafController::GetCompressedPoint3Key(uint32_t i) const
+{
+    if (fType != hsKeyFrame::kCompressedPoint3KeyFrame)
+        return nil;
+
+    return (hsCompressedPoint3Key *)((uint8_t *)fKeys + i * sizeof(hsCompressedPoint3Key));
+}
+
 void plLeafController::GetKeyTimes(hsTArray<float> &keyTimes) const
 {
     int cIdx = 0;
@@ -413,6 +460,7 @@ void plLeafController::AllocKeys(uint32_t numKeys, uint8_t type)
     delete[] reinterpret_cast<hsKeyFrame *>(fKeys);
     fNumKeys = numKeys;
     fType = type;
+    fKeySpacing = 0;
 
     switch (fType)
     {
@@ -488,6 +536,12 @@ void plLeafController::AllocKeys(uint32_t numKeys, uint8_t type)
         fKeys = new hsMatrix44Key[fNumKeys];
         break;
 
+    case hsKeyFrame::kCompressedPoint3KeyFrame:
+        static_assert(std::is_trivially_destructible<hsCompressedPoint3Key>::value,
+                      "hsCompressedPoint3Key MUST be trivially destructible");
+        fKeys = new hsCompressedPoint3Key[fNumKeys];
+        break;
+
     case hsKeyFrame::kUnknownKeyFrame:
     default:
         hsAssert(false, "Trying to allocate unknown keyframe type");
@@ -505,6 +559,7 @@ void plLeafController::QuickScalarController(int numKeys, float* times, float* v
         ((hsScalarKey*)fKeys)[i].fValue = *values;
         values = (float *)((uint8_t *)values + valueStrides);
     }
+    UpdateKeySpacing();
 }
 
 // If all the keys are the same, this controller is pretty useless.
@@ -616,6 +671,14 @@ bool plLeafController::AllKeysMatch() const
                     return false;
                 break;
             }
+        case hsKeyFrame::kCompressedPoint3KeyFrame:
+            {
+                hsCompressedPoint3Key *k1 = GetCompressedPoint3Key(idx - 1);
+                hsCompressedPoint3Key *k2 = GetCompressedPoint3Key(idx);
+                if (!k1->CompareValue(k2))
+                    return false;
+                break;
+            }
         case hsKeyFrame::kUnknownKeyFrame:
         default:
             hsAssert(false, "Trying to compare unknown keyframe type");
@@ -630,6 +693,147 @@ bool plLeafController::PurgeRedundantSubcontrollers()
     return AllKeysMatch();
 }
 
+void plLeafController::UpdateKeySpacing()
+{
+    fKeySpacing = 0;
+
+    uint32_t stride = GetStride();
+    if (stride == 0 || fNumKeys < 2)
+        return;
+
+    uint8_t *keyPtr = (uint8_t *)fKeys;
+    uint32_t first = ((hsKeyFrame *)keyPtr)->fFrame;
+    uint32_t spacing = ((hsKeyFrame *)(keyPtr + stride))->fFrame - first;
+    if (spacing == 0 || spacing > hsKeyFrame::kMaxFrameNumber)
+        return;
+
+    uint32_t i;
+    for (i = 2; i < fNumKeys; i++)
+    {
+        if (((hsKeyFrame *)(keyPtr + i * stride))->fFrame != first + i * spacing)
+            return;
+    }
+    fKeySpacing = (uint16_t)spacing;
+}
+
+// q and -q are the same rotation, and the compressed formats are free to
+// hand back either one.
+static bool IQuatWithinTolerance(const hsQuat &a, const hsQuat &b, float tolerance)
+{
+    float pos = std::max(std::max(fabs(a.fX - b.fX), fabs(a.fY - b.fY)), std::max(fabs(a.fZ - b.fZ), fabs(a.fW - b.fW)));
+    float neg = std::max(std::max(fabs(a.fX + b.fX), fabs(a.fY + b.fY)), std::max(fabs(a.fZ + b.fZ), fabs(a.fW + b.fW)));
+    return std::min(pos, neg) <= tolerance;
+}
+
+template <class T>
+static bool IQuatKeysFit(const hsQuatKey *keys, uint32_t numKeys, float tolerance)
+{
+    uint32_t i;
+    for (i = 0; i < numKeys; i++)
+    {
+        hsQuat q = keys[i].fValue;
+        q.Normalize();
+
+        T comp;
+        hsQuat in = q;
+        comp.SetQuat(in);
+        hsQuat out;
+        comp.GetQuat(out);
+        if (!IQuatWithinTolerance(q, out, tolerance))
+            return false;
+    }
+    return true;
+}
+
+template <class T>
+static void ICompressQuatKeys(const hsQuatKey *src, T *dst, uint32_t numKeys)
+{
+    uint32_t i;
+    for (i = 0; i < numKeys; i++)
+    {
+        hsQuat q = src[i].fValue;
+        dst[i].fFrame = src[i].fFrame;
+        dst[i].SetQuat(q);
+    }
+}
+
+bool plLeafController::CompressKeys(float quatTolerance, float posTolerance)
+{
+    if (fNumKeys < 2)
+        return false;
+
+    uint32_t i;
+    if (fType == hsKeyFrame::kQuatKeyFrame)
+    {
+        uint8_t type;
+        if (IQuatKeysFit<hsCompressedQuatKey32>((hsQuatKey *)fKeys, fNumKeys, quatTolerance))
+            type = hsKeyFrame::kCompressedQuatKeyFrame32;
+        else if (IQuatKeysFit<hsCompressedQuatKey64>((hsQuatKey *)fKeys, fNumKeys, quatTolerance))
+            type = hsKeyFrame::kCompressedQuatKeyFrame64;
+        else
+            return false;
+
+        hsQuatKey *src = (hsQuatKey *)fKeys;
+        fKeys = nil;
+        AllocKeys(fNumKeys, type);
+        if (type == hsKeyFrame::kCompressedQuatKeyFrame32)
+            ICompressQuatKeys(src, (hsCompressedQuatKey32 *)fKeys, fNumKeys);
+        else
+            ICompressQuatKeys(src, (hsCompressedQuatKey64 *)fKeys, fNumKeys);
+        delete[] src;
+        UpdateKeySpacing();
+        return true;
+    }
+
+    if (fType == hsKeyFrame::kPoint3KeyFrame)
+    {
+        hsPoint3Key *src = (hsPoint3Key *)fKeys;
+
+        hsPoint3 lo = src[0].fValue;
+        hsPoint3 hi = src[0].fValue;
+        for (i = 1; i < fNumKeys; i++)
+        {
+            lo.fX = std::min(lo.fX, src[i].fValue.fX);
+            lo.fY = std::min(lo.fY, src[i].fValue.fY);
+            lo.fZ = std::min(lo.fZ, src[i].fValue.fZ);
+            hi.fX = std::max(hi.fX, src[i].fValue.fX);
+            hi.fY = std::max(hi.fY, src[i].fValue.fY);
+            hi.fZ = std::max(hi.fZ, src[i].fValue.fZ);
+        }
+        hsPoint3 step((hi.fX - lo.fX) / hsCompressedPoint3Key::k16BitScaleRange,
+                      (hi.fY - lo.fY) / hsCompressedPoint3Key::k16BitScaleRange,
+                      (hi.fZ - lo.fZ) / hsCompressedPoint3Key::k16BitScaleRange);
+
+        for (i = 0; i < fNumKeys; i++)
+        {
+            hsCompressedPoint3Key comp;
+            comp.SetPoint(src[i].fValue, lo, step);
+            hsPoint3 out;
+            comp.GetPoint(out, lo, step);
+            if (fabs(out.fX - src[i].fValue.fX) > posTolerance ||
+                fabs(out.fY - src[i].fValue.fY) > posTolerance ||
+                fabs(out.fZ - src[i].fValue.fZ) > posTolerance)
+                return false;
+        }
+
+        fKeys = nil;
+        AllocKeys(fNumKeys, hsKeyFrame::kCompressedPoint3KeyFrame);
+        fQuantOffset = lo;
+        fQuantStep = step;
+        hsCompressedPoint3Key *dst = (hsCompressedPoint3Key *)fKeys;
+        for (i = 0; i < fNumKeys; i++)
+        {
+            dst[i].fFrame = src[i].fFrame;
+            dst[i].SetPoint(src[i].fValue, lo, step);
+        }
+        delete[] src;
+        UpdateKeySpacing();
+        return true;
+    }
+
+    return false;
+}
+
 void plLeafController::Read(hsStream* s, hsResMgr *mgr)
 {
     uint8_t type = s->ReadByte();
@@ -699,11 +903,22 @@ void plLeafController::Read(hsStream* s, hsResMgr *mgr)
             ((hsMatrix44Key *)fKeys)[i].Read(s);
         break;
 
+    case hsKeyFrame::kCompressedPoint3KeyFrame:
+        fQuantOffset.Read(s);
+        fQuantStep.Read(s);
+        for (i = 0; i < fNumKeys; i++)
+            ((hsCompressedPoint3Key *)fKeys)[i].Read(s);
+        break;
+
     case hsKeyFrame::kUnknownKeyFrame:
     default:
         hsAssert(false, "Reading in controller with unknown key data");
         break;
     }
+
+    if (fCompressOnRead)
+        CompressKeys();
+    UpdateKeySpacing();
 }
 
 void plLeafController::Write(hsStream* s, hsResMgr *mgr)
@@ -774,6 +989,13 @@ void plLeafController::Write(hsStream* s, hsResMgr *mgr)
             ((hsMatrix44Key *)fKeys)[i].Write(s);
         break;
 
+    case hsKeyFrame::kCompressedPoint3KeyFrame:
+        fQuantOffset.Write(s);
+        fQuantStep.Write(s);
+        for (i = 0; i < fNumKeys; i++)
+            ((hsCompressedPoint3Key *)fKeys)[i].Write(s);
+        break;
+
     case hsKeyFrame::kUnknownKeyFrame:
     default:
         hsAssert(false, "Writing controller with unknown key data");
@@ -130,9 +130,21 @@ protected:
     void *fKeys; // Need to pay attend to fType to determine what these actually are
     uint32_t fNumKeys;
     mutable uint32_t fLastKeyIdx;
+    uint16_t fKeySpacing;   // Frames between keys if they are evenly spaced, else 0
+    hsPoint3 fQuantOffset;  // Range of kCompressedPoint3KeyFrame keys
+    hsPoint3 fQuantStep;
+
+    static bool fCompressOnRead;
+
+    void IGetBoundaryKeyFrames(float time, uint32_t size, hsKeyFrame **kF1, hsKeyFrame **kF2,
+                               uint32_t *idxStore, float *p, bool forwards) const;
 
 public:
-    plLeafController() : fType(hsKeyFrame::kUnknownKeyFrame), fKeys(nil), fNumKeys(0), fLastKeyIdx(0) {}
+    static const float kDefaultQuatTolerance;
+    static const float kDefaultPosTolerance;
+
+    plLeafController() : fType(hsKeyFrame::kUnknownKeyFrame), fKeys(nil), fNumKeys(0), fLastKeyIdx(0),
+        fKeySpacing(0), fQuantOffset(0, 0, 0), fQuantStep(0, 0, 0) {}
     virtual ~plLeafController();
 
     CLASSNAME_REGISTER( plLeafController );
@@ -162,6 +174,7 @@ public:
     hsG3DSMaxKeyFrame *Get3DSMaxKey(uint32_t i) const;
     hsMatrix33Key *GetMatrix33Key(uint32_t i) const;
     hsMatrix44Key *GetMatrix44Key(uint32_t i) const;
+    hsCompressedPoint3Key *GetCompressedPoint3Key(uint32_t i) const;
 
     uint8_t GetType() const { return fType; }
     uint32_t GetNumKeys() const { return fNumKeys; }
@@ -172,6 +185,19 @@ public:
     bool AllKeysMatch() const;
     bool PurgeRedundantSubcontrollers();
 
+    // Evenly spaced keys are looked up by index instead of searched for.
+    // Call this after filling in keys by hand; Read does it for you.
+    void UpdateKeySpacing();
+    uint16_t GetKeySpacing() const { return fKeySpacing; }
+
+    // Requantizes linear rotation keys to 32 or 64 bit compressed quats and
+    // linear position keys to 16 bits per axis, keeping every key within
+    // the given tolerance of its original value. Returns true if anything
+    // was compressed.
+    bool CompressKeys(float quatTolerance = kDefaultQuatTolerance, float posTolerance = kDefaultPosTolerance);
+    static void SetCompressOnRead(bool on) { fCompressOnRead = on; }
+    static bool GetCompressOnRead() { return fCompressOnRead; }
+
     void Read(hsStream* s, hsResMgr* mgr);
     void Write(hsStream* s, hsResMgr* mgr);
 };
@@ -605,6 +605,19 @@ plVolumeCullResult plParallelIsect::Test(const hsBounds3Ext& bnd) const
     return retVal;
 }
 
+bool plParallelIsect::GetCullPlanes(hsTArray<hsPlane3>& planes) const
+{
+    // Each pair is the slab fMin <= n.p <= fMax.
+    int i;
+    for( i = 0; i < fPlanes.GetCount(); i++ )
+    {
+        hsVector3 negNorm = -fPlanes[i].fNorm;
+        planes.Append(hsPlane3(&fPlanes[i].fNorm, -fPlanes[i].fMin));
+        planes.Append(hsPlane3(&negNorm, fPlanes[i].fMax));
+    }
+    return true;
+}
+
 float plParallelIsect::Test(const hsPoint3& pos) const
 {
     float maxDist = 0;
@@ -761,6 +774,18 @@ plVolumeCullResult plConvexIsect::Test(const hsBounds3Ext& bnd) const
     return retVal;
 }
 
+bool plConvexIsect::GetCullPlanes(hsTArray<hsPlane3>& planes) const
+{
+    // We're inside where n.p <= fWorldDist.
+    int i;
+    for( i = 0; i < fPlanes.GetCount(); i++ )
+    {
+        hsVector3 negNorm = -fPlanes[i].fWorldNorm;
+        planes.Append(hsPlane3(&negNorm, fPlanes[i].fWorldDist));
+    }
+    return true;
+}
+
 float plConvexIsect::Test(const hsPoint3& pos) const
 {
     float maxDist = 0;
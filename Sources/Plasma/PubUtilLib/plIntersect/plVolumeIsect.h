@@ -70,6 +70,11 @@ public:
     virtual plVolumeCullResult  Test(const hsBounds3Ext& bnd) const = 0;    
     virtual float            Test(const hsPoint3& pos) const = 0;
 
+    // If the volume is just the inside of a set of world space planes, appends
+    // them with n.p + d >= 0 inside and returns true. Test() must agree with
+    // culling a bounds by any plane it's entirely outside of.
+    virtual bool GetCullPlanes(hsTArray<hsPlane3>& planes) const { return false; }
+
     virtual void Read(hsStream* s, hsResMgr* mgr) = 0;
     virtual void Write(hsStream* s, hsResMgr* mgr) = 0;
 };
@@ -210,6 +215,8 @@ public:
     virtual plVolumeCullResult  Test(const hsBounds3Ext& bnd) const;
     virtual float            Test(const hsPoint3& pos) const;
 
+    virtual bool GetCullPlanes(hsTArray<hsPlane3>& planes) const;
+
     virtual void Read(hsStream* s, hsResMgr* mgr);
     virtual void Write(hsStream* s, hsResMgr* mgr);
 };
@@ -247,6 +254,8 @@ public:
     virtual plVolumeCullResult  Test(const hsBounds3Ext& bnd) const;
     virtual float            Test(const hsPoint3& pos) const;
 
+    virtual bool GetCullPlanes(hsTArray<hsPlane3>& planes) const;
+
     virtual void Read(hsStream* s, hsResMgr* mgr);
     virtual void Write(hsStream* s, hsResMgr* mgr);
 };
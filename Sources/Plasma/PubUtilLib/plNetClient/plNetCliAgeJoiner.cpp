@@ -388,6 +388,8 @@ bool plNCAgeJoiner::MsgReceive (plMessage * msg) {
         if (resMsg->Success())
         {
             nc->ResetServerTimeOffset();
+            // A new game server, only zlib until it says otherwise
+            plNetMsgStreamHelper::SetPeerAcceptsCompressionType(plNetMessage::kCompressionLZ4, false);
             NetCommLinkToAge(
                 age,
                 this
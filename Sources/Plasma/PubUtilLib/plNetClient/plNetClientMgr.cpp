@@ -121,6 +121,26 @@ plNetClientMgr::PendingLoad::~PendingLoad()
     delete fSDRec;
 }
 
+// How often (and after how long) states that can't be delivered are thrown away once in game
+static const double kPendingLoadSweepSecs = 1.0;
+
+size_t plNetClientMgr::PendingLoadUoidHash::operator()(const plUoid& uoid) const
+{
+    size_t hash = ST::hash()(uoid.GetObjectName());
+    hash ^= (size_t(uoid.GetLocation().GetSequenceNumber()) << 16) ^ uoid.GetClassType();
+    hash ^= (size_t(uoid.GetClonePlayerID()) << 8) ^ uoid.GetCloneID();
+    return hash;
+}
+
+bool plNetClientMgr::PendingLoadUoidEqual::operator()(const plUoid& lhs, const plUoid& rhs) const
+{
+    return lhs.GetLocation() == rhs.GetLocation()
+        && lhs.GetClassType() == rhs.GetClassType()
+        && lhs.GetCloneID() == rhs.GetCloneID()
+        && lhs.GetClonePlayerID() == rhs.GetClonePlayerID()
+        && lhs.GetObjectName() == rhs.GetObjectName();
+}
+
 ////////////////////////////////////////////////////////////////////
 
 //
@@ -143,7 +163,8 @@ plNetClientMgr::plNetClientMgr() :
         fNumInitialSDLStates(0),
         fRequiredNumInitialSDLStates(0),
         fDisableMsg(nil),
-        fIsOwner(true)
+        fIsOwner(true),
+        fNextPendingLoadSweep(0)
 {   
 #ifndef HS_DEBUGGING
     // release code will timeout inactive players on servers by default
@@ -210,10 +231,9 @@ void plNetClientMgr::Shutdown()
 //
 void plNetClientMgr::IClearPendingLoads()
 {
-    std::for_each( fPendingLoads.begin(), fPendingLoads.end(),
-        [](PendingLoad *pl) { delete pl; }
-    );
-    fPendingLoads.clear();
+    while (!fPendingLoads.empty())
+        IDiscardPendingLoads(fPendingLoads.begin());
+    fReadyLoads.clear();
 }
 
 //
@@ -561,6 +581,55 @@ int plNetClientMgr::Update(double secs)
     return ret;
 }
 
+//
+// Queue up a state, asking to be told when its object is created if it isn't already
+//
+void plNetClientMgr::IQueuePendingLoad(PendingLoad* pl)
+{
+    pl->fQueuedTime = hsTimer::GetSysSeconds();
+
+    PendingLoadsEntry& entry = fPendingLoads[pl->fUoid];
+    if (entry.fLoads.empty() && !entry.fReady && !entry.fNotifyAdded)
+    {
+        entry.fKey = pl->fKey ? pl->fKey : hsgResMgr::ResMgr()->FindKey(pl->fUoid);
+
+        // Loaded objects (and missing keys, which get discarded) can be looked at right away
+        if (!entry.fKey || entry.fKey->ObjectIsLoaded())
+            ISetPendingLoadReady(pl->fUoid);
+        else
+        {
+            plGenRefMsg* refMsg = new plGenRefMsg(GetKey(), plRefMsg::kOnCreate, 0, kPendingLoad);
+            hsgResMgr::ResMgr()->AddViaNotify(entry.fKey, refMsg, plRefFlags::kPassiveRef);
+            entry.fNotifyAdded = true;
+        }
+    }
+
+    pl->fKey = entry.fKey;
+    entry.fLoads.push_back(pl);
+}
+
+void plNetClientMgr::ISetPendingLoadReady(const plUoid& uoid)
+{
+    auto it = fPendingLoads.find(uoid);
+    if (it != fPendingLoads.end() && !it->second.fReady)
+    {
+        it->second.fReady = true;
+        fReadyLoads.push_back(uoid);
+    }
+}
+
+void plNetClientMgr::IDiscardPendingLoads(PendingLoadsMap::iterator it)
+{
+    PendingLoadsEntry& entry = it->second;
+    if (entry.fNotifyAdded && GetKey())
+        GetKey()->Release(entry.fKey);
+
+    std::for_each(entry.fLoads.begin(), entry.fLoads.end(),
+        [](PendingLoad *pl) { delete pl; }
+    );
+    fPendingLoads.erase(it);
+}
+
 //
 // See if there is state recvd from the network that needsto be delivered
 //
@@ -570,60 +639,91 @@ void plNetClientMgr::ICheckPendingStateLoad(double secs)
     if (!(GetFlagsBit(kPlayingGame) || (GetFlagsBit(kLoadingInitialAgeState) && !GetFlagsBit(kNeedInitialAgeStateCount))))
         return;
 
-    for (auto it = fPendingLoads.begin(); it != fPendingLoads.end();)
+    // Only objects we've heard have been created need to be looked at
+    std::vector<plUoid> readyLoads;
+    readyLoads.swap(fReadyLoads);
+    for (const plUoid& uoid : readyLoads)
     {
-        PendingLoad* load = *it;
-
-        // If no key has been cached, we need to find it.
-        if (!load->fKey)
+        auto it = fPendingLoads.find(uoid);
+        if (it == fPendingLoads.end())
+            continue;
+        PendingLoadsEntry& entry = it->second;
+
+        // By this point, we should have all the age's keys downloaded from filesrv
+        // So, if fKey is null at this point, this state is garbage
+        if (!entry.fKey)
         {
-            load->fKey = hsgResMgr::ResMgr()->FindKey(load->fUoid);
-
-            // By this point, we should have all the age's keys downloaded from filesrv
-            // So, if fKey is null at this point, this state is garbage
-            if (!load->fKey)
-            {
-                ErrorMsg("Key `{}` not found. Discarding state for `{}`",
-                          load->fUoid.GetObjectName(),
-                          load->fSDRec->GetDescriptor()->GetName());
-                it = fPendingLoads.erase(it);
-                delete load;
-                continue;
-            }
+            ErrorMsg("Key `{}` not found. Discarding state for `{}`",
+                      uoid.GetObjectName(),
+                      entry.fLoads.front()->fSDRec->GetDescriptor()->GetName());
+            IDiscardPendingLoads(it);
+            continue;
         }
 
-        // Time to deliver the state!
-        plSynchedObject* synchObj = plSynchedObject::ConvertNoRef(load->fKey->ObjectIsLoaded());
+        hsKeyedObject* ko = entry.fKey->ObjectIsLoaded();
+        plSynchedObject* synchObj = plSynchedObject::ConvertNoRef(ko);
         if (synchObj && synchObj->IsFinal())
         {
-            plSDLModifierMsg* msg = new plSDLModifierMsg(load->fSDRec->GetDescriptor()->GetName(), plSDLModifierMsg::kRecv);
-            msg->SetState(load->fSDRec, true);
-            load->fSDRec = nullptr;
-            msg->SetPlayerID(load->fPlayerID);
+            // Time to deliver the state!
+            for (PendingLoad* load : entry.fLoads)
+            {
+                plSDLModifierMsg* msg = new plSDLModifierMsg(load->fSDRec->GetDescriptor()->GetName(), plSDLModifierMsg::kRecv);
+                msg->SetState(load->fSDRec, true);
+                load->fSDRec = nullptr;
+                msg->SetPlayerID(load->fPlayerID);
 
 #ifdef HS_DEBUGGING
-            if (plNetObjectDebugger::GetInstance()->IsDebugObject(synchObj))
-            {
-                DebugMsg("Delivering SDL State '{}' to {} owned key {}",
-                    msg->GetState()->GetDescriptor()->GetName(),
-                    (synchObj->IsLocallyOwned() == plSynchedObject::kYes) ? "locally" : "remote",
-                    load->fUoid.StringIze());
-            }
+                if (plNetObjectDebugger::GetInstance()->IsDebugObject(synchObj))
+                {
+                    DebugMsg("Delivering SDL State '{}' to {} owned key {}",
+                        msg->GetState()->GetDescriptor()->GetName(),
+                        (synchObj->IsLocallyOwned() == plSynchedObject::kYes) ? "locally" : "remote",
+                        load->fUoid.StringIze());
+                }
 #endif
-            msg->Send(load->fKey);
-            it = fPendingLoads.erase(it);
-            delete load;
+                msg->Send(entry.fKey);
+            }
+            IDiscardPendingLoads(it);
         }
-        else if (GetFlagsBit(kPlayingGame))
+        else if (synchObj)
         {
-            // If we're playing the game and object isn't loaded/final, then this state is probably
-            // never going to be useful (it's from some paged in hack or something that's been deleted)
-            // Throw it away.
-            it = fPendingLoads.erase(it);
-            delete load;
+            // Loaded but not final yet (avatars, mostly), keep checking until
+            // it is or the sweep gives up on it
+            fReadyLoads.push_back(uoid);
         }
         else
-            ++it;
+        {
+            // Unloaded again before we got to it (or never something that takes
+            // state), wait for the next create or the sweep
+            entry.fReady = false;
+        }
+    }
+
+    // If we're playing the game and the object still isn't loaded and final, then this
+    // state is probably never going to be useful (it's from some paged in hack or something
+    // that's been deleted, or an object that never finished loading).  Throw it away, but
+    // only look every so often.
+    if (GetFlagsBit(kPlayingGame) && secs >= fNextPendingLoadSweep)
+    {
+        fNextPendingLoadSweep = secs + kPendingLoadSweepSecs;
+
+        double cutoff = hsTimer::GetSysSeconds() - kPendingLoadSweepSecs;
+        for (auto it = fPendingLoads.begin(); it != fPendingLoads.end();)
+        {
+            auto next = std::next(it);
+            const PendingLoadsEntry& entry = it->second;
+            if (entry.fLoads.back()->fQueuedTime < cutoff)
+            {
+                hsKeyedObject* ko = entry.fKey ? entry.fKey->ObjectIsLoaded() : nullptr;
+                plSynchedObject* synchObj = plSynchedObject::ConvertNoRef(ko);
+                if (!synchObj || !synchObj->IsFinal())
+                    IDiscardPendingLoads(it);
+            }
+            it = next;
+        }
+
+        auto isStale = [this](const plUoid& uoid) { return fPendingLoads.find(uoid) == fPendingLoads.end(); };
+        fReadyLoads.erase(std::remove_if(fReadyLoads.begin(), fReadyLoads.end(), isStale), fReadyLoads.end());
     }
 }
 
@@ -892,6 +992,14 @@ bool plNetClientMgr::MsgReceive( plMessage* msg )
             return true;
         }
 
+        if (ref->fType == kPendingLoad)
+        {
+            // An object with SDL state waiting on it has been loaded
+            if (ref->GetContext() == plRefMsg::kOnCreate && ref->GetRef())
+                ISetPendingLoadReady(ref->GetRef()->GetKey()->GetUoid());
+            return true;
+        }
+
         hsAssert(ref->fType==kAgeSDLHook, "unknown ref msg context");
         if (ref->GetContext()==plRefMsg::kOnCreate)
         {
@@ -1445,7 +1553,7 @@ void plNetClientMgr::AddPendingLoad(PendingLoad *pl)
     }
 
     // add entry
-    fPendingLoads.push_back(pl);
+    IQueuePendingLoad(pl);
 }
 
 void plNetClientMgr::AddPendingPagingRoomMsg( plNetMsgPagingRoom * msg )
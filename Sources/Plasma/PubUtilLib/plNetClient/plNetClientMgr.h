@@ -44,6 +44,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "HeadSpin.h"
 #include <list>
+#include <unordered_map>
 
 #include "plNetClientGroup.h"
 #include "plNetVoiceList.h"
@@ -116,7 +117,8 @@ public:
     enum RefContext
     {
         kVaultImage = 0,
-        kAgeSDLHook = 1
+        kAgeSDLHook = 1,
+        kPendingLoad = 2
     };
 
     struct PendingLoad
@@ -128,16 +130,43 @@ public:
 
         // set by NetClient
         plKey fKey;                 // the key of the object it's meant for
+        double fQueuedTime;         // when the state arrived, for discarding stale states
 
-        PendingLoad() : fSDRec(nullptr), fPlayerID(0), fKey(nullptr) { }
+        PendingLoad() : fSDRec(nullptr), fPlayerID(0), fKey(nullptr), fQueuedTime(0) { }
         ~PendingLoad();
     };
 
 private:
     plOperationProgress* fTaskProgBar;
 
+    // Pending loads are grouped by the object they are meant for.  Objects that aren't
+    // loaded yet get a passive ref, and only move to fReadyLoads once they are created,
+    // so nothing is done per frame for states that are still waiting on their page.
+    // Object IDs and load masks aren't always filled in on network uoids, so they
+    // don't take part in the lookup.
+    struct PendingLoadUoidHash
+    {
+        size_t operator()(const plUoid& uoid) const;
+    };
+    struct PendingLoadUoidEqual
+    {
+        bool operator()(const plUoid& lhs, const plUoid& rhs) const;
+    };
+
     typedef std::list<PendingLoad*> PendingLoadsList;
-    PendingLoadsList fPendingLoads;
+    struct PendingLoadsEntry
+    {
+        PendingLoadsList fLoads;    // in the order they arrived
+        plKey fKey;
+        bool fReady;                // object has been created, check it on the next update
+        bool fNotifyAdded;          // we hold a passive ref on fKey
+
+        PendingLoadsEntry() : fReady(false), fNotifyAdded(false) { }
+    };
+    typedef std::unordered_map<plUoid, PendingLoadsEntry, PendingLoadUoidHash, PendingLoadUoidEqual> PendingLoadsMap;
+    PendingLoadsMap fPendingLoads;
+    std::vector<plUoid> fReadyLoads;
+    double fNextPendingLoadSweep;
             
     // pending room page msgs
     std::vector<plNetMsgPagingRoom*>    fPendingPagingRoomMsgs;
@@ -195,6 +224,9 @@ private:
 
     //
     void ICheckPendingStateLoad(double secs);
+    void IQueuePendingLoad(PendingLoad* pl);
+    void ISetPendingLoadReady(const plUoid& uoid);
+    void IDiscardPendingLoads(PendingLoadsMap::iterator it);
     int IDeduceLocallyOwned(const plUoid& loc) const;
     bool IHandlePlayerPageMsg(plPlayerPageMsg *playerMsg);  // *** 
 
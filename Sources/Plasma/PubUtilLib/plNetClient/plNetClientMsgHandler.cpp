@@ -132,6 +132,8 @@ int plNetClientMsgHandler::ReceiveMsg(plNetMessage *& netMsg)
 #endif
 
     plNetClientMgr::GetInstance()->UpdateServerTimeOffset(netMsg);
+    if (netMsg->IsBitSet(plNetMessage::kAcceptsLZ4Streams))
+        plNetMsgStreamHelper::SetPeerAcceptsCompressionType(plNetMessage::kCompressionLZ4, true);
     
     switch(netMsg->ClassIndex())
     {
@@ -285,7 +287,7 @@ MSG_HANDLER_DEFN(plNetClientMsgHandler,plNetMsgSDLState)
         pl->fUoid = m->ObjectInfo()->GetUoid();
 
         // queue up state
-        nc->fPendingLoads.push_back(pl);
+        nc->IQueuePendingLoad(pl);
         hsLogEntry( nc->DebugMsg( "Added pending SDL delivery for {}:{}",
                                   m->ObjectInfo()->GetObjectName(), des->GetName() ) );
     }
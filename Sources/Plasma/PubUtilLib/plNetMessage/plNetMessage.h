@@ -116,6 +116,8 @@ protected:
     void ISetPeekStatus(uint32_t s) { fPeekStatus=s;  }
 
 public:
+    HS_MEMTAG_NEW(kMemTagNet);
+
     typedef uint16_t plStrLen;
     static const uint8_t kVerMajor, kVerMinor;    // version of the networking code
 
@@ -151,6 +153,7 @@ public:
         kIsSystemMessage    = 0x20000,
         kNeedsReliableSend  = 0x40000,
         kRouteToAllPlayers  = 0x80000,  // send this message to all online players.
+        kAcceptsLZ4Streams  = 0x100000, // set by a server that can read kCompressionLZ4 streams
     };
     enum PeekOptions        // options for partial peeking
     {
@@ -173,7 +176,8 @@ public:
         kCompressionNone,       // not compressed
         kCompressionFailed,     // failed to compress
         kCompressionZlib,       // zlib compressed
-        kCompressionDont        // don't compress
+        kCompressionDont,       // don't compress
+        kCompressionLZ4         // LZ4 block compressed, only sent to peers that can read it
     };
 
     CLASSNAME_REGISTER( plNetMessage );
@@ -42,12 +42,16 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plNetMsgHelpers.h"
 #include "plNetMessage.h"
 #include "plCompression/plZlibCompress.h"
+#include "plCompression/plLZ4Compress.h"
 #include "pnNetCommon/plNetServers.h"
 #include "pnNetCommon/plNetApp.h"
 #include "pnKeyedObject/plKey.h"
 #include "pnMessage/plMessage.h"
 #include "hsStream.h"
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 
 ////////////////////////////////////////////////////////////////////
@@ -264,25 +268,119 @@ void plNetMsgStreamHelper::CopyFrom(const plNetMsgStreamHelper* other)
     CopyStream(other->GetStreamLen(), other->GetStreamBuf());
 }
 
+static plCompress* CreateZlibCodec() { return new plZlibCompress; }
+static plCompress* CreateLZ4Codec() { return new plLZ4Compress; }
+
+static plNetMsgStreamHelper::CodecCreator sCodecCreators[plNetMsgStreamHelper::kMaxCodecs] =
+{
+    nullptr,            // kCompressionNone
+    nullptr,            // kCompressionFailed
+    CreateZlibCodec,    // kCompressionZlib
+    nullptr,            // kCompressionDont
+    CreateLZ4Codec,     // kCompressionLZ4
+};
+
+static std::atomic<uint8_t> sPreferredCompressionType(plNetMessage::kCompressionZlib);
+static std::atomic<uint32_t> sPeerCompressionTypes(1 << plNetMessage::kCompressionZlib);
+
+// per thread, so no locking when (un)compressing
+static thread_local std::unique_ptr<plCompress> sCodecs[plNetMsgStreamHelper::kMaxCodecs];
+static thread_local std::vector<uint8_t> sCompressScratch;
+
+void plNetMsgStreamHelper::RegisterCodec(uint8_t compressionType, CodecCreator creator)
+{
+    hsAssert(compressionType < kMaxCodecs, "plNetMsgStreamHelper: codec type out of range");
+    if (compressionType < kMaxCodecs)
+        sCodecCreators[compressionType] = creator;
+}
+
+bool plNetMsgStreamHelper::HasCodec(uint8_t compressionType)
+{
+    return compressionType < kMaxCodecs && sCodecCreators[compressionType] != nullptr;
+}
+
+void plNetMsgStreamHelper::SetPreferredCompressionType(uint8_t compressionType)
+{
+    sPreferredCompressionType = HasCodec(compressionType) ? compressionType : (uint8_t)plNetMessage::kCompressionZlib;
+}
+
+uint8_t plNetMsgStreamHelper::GetPreferredCompressionType()
+{
+    return sPreferredCompressionType;
+}
+
+void plNetMsgStreamHelper::SetPeerAcceptsCompressionType(uint8_t compressionType, bool accepts)
+{
+    // Everyone reads zlib
+    if (compressionType >= kMaxCodecs || compressionType == plNetMessage::kCompressionZlib)
+        return;
+    if (accepts)
+        sPeerCompressionTypes |= (1 << compressionType);
+    else
+        sPeerCompressionTypes &= ~(1 << compressionType);
+}
+
+bool plNetMsgStreamHelper::PeerAcceptsCompressionType(uint8_t compressionType)
+{
+    return compressionType < kMaxCodecs && (sPeerCompressionTypes & (1 << compressionType)) != 0;
+}
+
+plCompress* plNetMsgStreamHelper::IGetCodec(uint8_t compressionType)
+{
+    if (!HasCodec(compressionType))
+        return nullptr;
+    std::unique_ptr<plCompress>& codec = sCodecs[compressionType];
+    if (!codec)
+        codec.reset(sCodecCreators[compressionType]());
+    return codec.get();
+}
+
+//
+// Compress into this thread's scratch buffer, then copy out at the final size
+//
+bool plNetMsgStreamHelper::ICompressWith(uint8_t compressionType, int offset)
+{
+    plCompress* codec = IGetCodec(compressionType);
+    if (!codec)
+        return false;
+
+    uint32_t srcLen = fStreamLen - offset;
+    uint32_t bufLen = codec->GetMaxCompressedSize(srcLen);
+    if (sCompressScratch.size() < bufLen)
+        sCompressScratch.resize(bufLen);
+
+    if (!codec->Compress(sCompressScratch.data(), &bufLen, fStreamBuf + offset, srcLen) || bufLen >= srcLen)
+        return false;
+
+    uint8_t* buf = new uint8_t[offset + bufLen];
+    memcpy(buf, fStreamBuf, offset);    // creatable index stays uncompressed
+    memcpy(buf + offset, sCompressScratch.data(), bufLen);
+    delete [] fStreamBuf;
+
+    SetStreamBuf(buf);
+    SetStreamLen(offset + bufLen);
+    SetCompressionType(compressionType);
+    return true;
+}
+
 bool plNetMsgStreamHelper::Compress(int offset)
 {
     if ( !IsCompressable() )
         return true;
 
-    plZlibCompress compressor;
-    uint8_t* buf = (uint8_t*)GetStreamBuf();    // skip creatable index
-    uint32_t bufLen = GetStreamLen();
-    uint32_t uncompressedSize = bufLen;
+    uint32_t uncompressedSize = GetStreamLen();
     SetUncompressedSize( uncompressedSize );
-    if ( compressor.Compress( &buf, &bufLen, offset) )
+
+    uint8_t compressionType = GetPreferredCompressionType();
+    if (!PeerAcceptsCompressionType(compressionType))
+        compressionType = plNetMessage::kCompressionZlib;
+    if ( ICompressWith( compressionType, offset ) ||
+        ( compressionType != plNetMessage::kCompressionZlib && ICompressWith( plNetMessage::kCompressionZlib, offset ) ) )
     {
-        SetCompressionType( plNetMessage::kCompressionZlib );
-        SetStreamLen(bufLen);
-        SetStreamBuf(buf);
-        int32_t diff = uncompressedSize-bufLen;
 #if 0
+        int32_t diff = uncompressedSize-GetStreamLen();
         plNetApp::StaticDebugMsg( "\tCompressed stream: {}->{} bytes, ({} {} bytes, {.1f}%)",
-            uncompressedSize, bufLen, (diff>=0)?"shrunk":"GREW?!?", diff, (diff/(float)uncompressedSize)*100 );
+            uncompressedSize, GetStreamLen(), (diff>=0)?"shrunk":"GREW?!?", diff, (diff/(float)uncompressedSize)*100 );
 #endif
         return true;
     }
@@ -300,23 +398,27 @@ bool plNetMsgStreamHelper::Uncompress(int offset)
         return true;
 
     uint32_t origLen = GetStreamLen();
-    plZlibCompress compressor;
-    uint8_t* buf = (uint8_t*)GetStreamBuf();
-    uint32_t bufLen = origLen;
-    if ( compressor.Uncompress( &buf, &bufLen, GetUncompressedSize(), offset ) )
+    plCompress* codec = IGetCodec( GetCompressionType() );
+    uint32_t bufLen = GetUncompressedSize();
+    uint8_t* buf = new uint8_t[offset + bufLen];
+    if ( origLen >= (uint32_t)offset && codec->Uncompress( buf + offset, &bufLen, GetStreamBuf() + offset, origLen - offset ) )
     {
+        memcpy(buf, GetStreamBuf(), offset);
+        delete [] fStreamBuf;
+
         SetCompressionType( plNetMessage::kCompressionNone );
-        SetStreamLen(bufLen);
+        SetStreamLen(offset + bufLen);
         SetStreamBuf(buf);
-        int32_t diff = bufLen-origLen;
 #if 0
+        int32_t diff = GetStreamLen()-origLen;
         plNetApp::StaticDebugMsg( "\tUncompressed stream: {}->{} bytes, ({} {} bytes, {.1f}%)",
-            origLen, bufLen, (diff>=0)?"grew":"SHRUNK?!?", diff, (diff/(float)bufLen)*100 );
+            origLen, GetStreamLen(), (diff>=0)?"grew":"SHRUNK?!?", diff, (diff/(float)GetStreamLen())*100 );
 #endif
         return true;
     }
     else
     {
+        delete [] buf;
         hsAssert( false, "plNetMsgStreamHelper: Uncompression failed" );
         SetCompressionType( plNetMessage::kCompressionFailed );
         return false;
@@ -325,7 +427,7 @@ bool plNetMsgStreamHelper::Uncompress(int offset)
 
 bool plNetMsgStreamHelper::IsCompressed() const
 {
-    return ( fCompressionType==plNetMessage::kCompressionZlib );
+    return HasCodec( fCompressionType );
 }
 
 bool plNetMsgStreamHelper::IsCompressable() const
@@ -60,6 +60,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 class plKey;
 class hsStream;
+class plCompress;
 
 
 ////////////////////////////////////////////////////////////////////
@@ -132,9 +133,14 @@ protected:
     uint32_t  fCompressionThreshold;  // NOT WRITTEN
 
     void IAllocStream(uint32_t len);
+    bool ICompressWith(uint8_t compressionType, int offset);
+    static plCompress* IGetCodec(uint8_t compressionType);
 
 public:
     enum { kDefaultCompressionThreshold = 255 }; // bytes
+    enum { kMaxCodecs = 8 };
+
+    typedef plCompress* (*CodecCreator)();
 
     plNetMsgStreamHelper();
     virtual ~plNetMsgStreamHelper() { delete [] fStreamBuf; }
@@ -178,6 +184,20 @@ public:
     bool    IsCompressable() const;
     uint32_t  GetCompressionThreshold() const { return fCompressionThreshold; }
     void    SetCompressionThreshold( uint32_t v ) { fCompressionThreshold=v; }
+
+    // Codecs by plNetMessage::CompressionType.  Zlib and LZ4 are built in; register
+    // others at startup, before any messages are sent.  Each thread gets its own codec
+    // instances, so compression contexts and buffers are reused without locking.
+    static void RegisterCodec(uint8_t compressionType, CodecCreator creator);
+    static bool HasCodec(uint8_t compressionType);
+
+    // What outgoing streams are compressed with.  The preferred codec is only used once
+    // the server has said it can read it (see plNetMessage::kAcceptsLZ4Streams); until
+    // then, and whenever it fails, streams go out as zlib like they always have.
+    static void SetPreferredCompressionType(uint8_t compressionType);
+    static uint8_t GetPreferredCompressionType();
+    static void SetPeerAcceptsCompressionType(uint8_t compressionType, bool accepts);
+    static bool PeerAcceptsCompressionType(uint8_t compressionType);
 };
 
 //
@@ -669,6 +669,7 @@ plParticleFlockEffect::plParticleFlockEffect() :
     fMaxOrbitSpeed(1),
     fMaxChaseSpeed(1),
     fMaxParticles(0),
+    fNumTabled(0),
     fDistSq(nil),
     fInfluences(nil)
 {
@@ -683,21 +684,21 @@ plParticleFlockEffect::~plParticleFlockEffect()
 
 void plParticleFlockEffect::IUpdateDistances(const plEffectTargetInfo& target)
 {
-    uint32_t numParticles = std::min(static_cast<uint32_t>(fMaxParticles), target.fNumValidParticles);
+    uint32_t numParticles = fNumTabled;
 
     for (uint32_t i = 0; i < numParticles; i++)
     {
         for (uint32_t j = i + 1; j < numParticles; j++)
         {
             hsVector3 diff((hsPoint3*)(target.fPos + i * target.fPosStride), (hsPoint3*)(target.fPos + j * target.fPosStride));
-            fDistSq[i * fMaxParticles + j] = fDistSq[j * fMaxParticles + i] = diff.MagnitudeSquared();
+            fDistSq[i * numParticles + j] = fDistSq[j * numParticles + i] = diff.MagnitudeSquared();
         }
     }
 }
 
 void plParticleFlockEffect::IUpdateInfluences(const plEffectTargetInfo &target)
 {
-    uint32_t numParticles = std::min(static_cast<uint32_t>(fMaxParticles), target.fNumValidParticles);
+    uint32_t numParticles = fNumTabled;
     
     for (uint32_t i = 0; i < numParticles; i++)
     {
@@ -711,7 +712,7 @@ void plParticleFlockEffect::IUpdateInfluences(const plEffectTargetInfo &target)
             if (i == j)
                 continue;
 
-            const int distIdx = i * fMaxParticles + j;
+            const int distIdx = i * numParticles + j;
             if (fDistSq[distIdx] > fInfAvgRadSq)
             {
                 numAvg++;
@@ -737,6 +738,13 @@ void plParticleFlockEffect::IUpdateInfluences(const plEffectTargetInfo &target)
 
 void plParticleFlockEffect::PrepareEffect(const plEffectTargetInfo& target)
 {
+    // The tables are only needed until ApplyEffect() is through with this
+    // update, so they come out of the frame arena instead of sitting around
+    // at fMaxParticles squared for the life of the effect.
+    fNumTabled = std::min(static_cast<uint32_t>(fMaxParticles), target.fNumValidParticles);
+    fDistSq = hsFrameArena::Frame().New<float>(fNumTabled * fNumTabled);
+    fInfluences = hsFrameArena::Frame().New<plParticleInfluenceInfo>(fNumTabled);
+
     IUpdateDistances(target);
     IUpdateInfluences(target);
 }
@@ -745,7 +753,7 @@ void plParticleFlockEffect::PrepareEffect(const plEffectTargetInfo& target)
 // Holding off on that until I like the behavior.
 bool plParticleFlockEffect::ApplyEffect(const plEffectTargetInfo& target, int32_t i)
 {
-    if (i >= fMaxParticles)
+    if (i >= fNumTabled)
         return false; // Don't have the memory to deal with you. Good luck kid...
 
     const hsPoint3 &pos = *(hsPoint3*)(target.fPos + i * target.fPosStride);
@@ -806,15 +814,7 @@ bool plParticleFlockEffect::ApplyEffect(const plEffectTargetInfo& target, int32_
 
 void plParticleFlockEffect::SetMaxParticles(const uint16_t num)
 {
-    delete [] fDistSq;
-    delete [] fInfluences;
     fMaxParticles = num;
-
-    if (num > 0)
-    {
-        fDistSq = new float[num * num];
-        fInfluences = new plParticleInfluenceInfo[num];
-    }
 }
 
 void plParticleFlockEffect::Read(hsStream *s, hsResMgr *mgr)
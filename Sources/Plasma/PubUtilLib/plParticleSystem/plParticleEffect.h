@@ -301,8 +301,9 @@ protected:
     float fMaxChaseSpeed;
 
     uint16_t fMaxParticles;
-    float *fDistSq;          // Table of distances from particle to particle
-    plParticleInfluenceInfo *fInfluences; 
+    uint32_t fNumTabled;     // Particles covered by the tables below this frame
+    float *fDistSq;          // Table of distances from particle to particle, frame scratch
+    plParticleInfluenceInfo *fInfluences;  // Frame scratch, rebuilt every PrepareEffect()
 
     void IUpdateDistances(const plEffectTargetInfo &target);
     void IUpdateInfluences(const plEffectTargetInfo &target);
@@ -53,7 +53,10 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plTweak.h"
 
+#include "plGImage/plMipmap.h"
+#include "plGImage/plMipmapStreamer.h"
 #include "plSurface/hsGMaterial.h"
+#include "plSurface/plLayerInterface.h"
 #include "plDrawable/plDrawableSpans.h"
 #include "plDrawable/plSpaceTree.h"
 #include "plDrawable/plSpanTypes.h"
@@ -65,6 +68,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plScene/plRenderRequest.h"
 #include "plScene/plVisMgr.h"
 
+#include <algorithm>
+#include <cfloat>
+
 plProfile_CreateTimer("RenderScene",            "PipeT", RenderScene);
 plProfile_CreateTimer("VisEval",                "PipeT", VisEval);
 plProfile_CreateTimer("VisSelect",              "PipeT", VisSelect);
@@ -185,6 +191,9 @@ void pl3DPipeline::Render(plDrawable* d, const hsTArray<int16_t>& visList)
 
     if (ds)
     {
+        if (plMipmapStreamer::Instance().GetNumStreamed())
+            IRequestTextureDetail(ds, visList);
+
         RenderSpans(ds, visList);
     }
 }
@@ -689,6 +698,43 @@ void pl3DPipeline::ISetShadowFromGroup(plDrawableSpans* drawable, const plSpan*
 }
 
 
+void pl3DPipeline::IRequestTextureDetail(plDrawableSpans* drawable, const hsTArray<int16_t>& visList)
+{
+    plMipmapStreamer& streamer = plMipmapStreamer::Instance();
+    const plViewTransform& view = GetViewTransform();
+
+    // Pixels across for something a foot wide a foot away.  Ortho views
+    // (shadows, GUI) don't shrink with distance, so just give them it all.
+    bool ortho = view.GetOrthogonal();
+    float pixelScale = ortho ? 0.f : float(view.GetViewPortHeight()) / (2.f * tanf(view.GetFovY() * 0.5f));
+    hsPoint3 viewPos = view.GetPosition();
+
+    for (size_t i = 0; i < visList.GetCount(); i++)
+    {
+        const plSpan* span = drawable->GetSpan(visList[i]);
+        hsGMaterial* material = drawable->GetMaterial(span->fMaterialIdx);
+        if (!material)
+            continue;
+
+        float screenSize = FLT_MAX;
+        const hsBounds3Ext& bnd = span->fWorldBounds;
+        if (!ortho && bnd.GetType() == kBoundsNormal)
+        {
+            float size = hsVector3(&bnd.GetMaxs(), &bnd.GetMins()).Magnitude();
+            float dist = hsVector3(&bnd.GetCenter(), &viewPos).Magnitude() - size * 0.5f;
+            screenSize = size * pixelScale / std::max(dist, 1.f);
+        }
+
+        for (size_t j = 0; j < material->GetNumLayers(); j++)
+        {
+            plMipmap* mip = plMipmap::ConvertNoRef(material->GetLayer(j)->GetTexture());
+            if (mip && mip->IsStreamed())
+                streamer.Request(mip, screenSize);
+        }
+    }
+}
+
+
 void pl3DPipeline::ICheckLighting(plDrawableSpans* drawable, hsTArray<int16_t>& visList, plVisMgr* visMgr)
 {
     if (fView.fRenderState & kRenderNoLights)
@@ -736,6 +736,16 @@ protected:
     void ICheckLighting(plDrawableSpans* drawable, hsTArray<int16_t>& visList, plVisMgr* visMgr);
 
 
+    /**
+     * Tell the mipmap streamer roughly how big the textures on each visible
+     * span are on screen, so it can bring in the levels they need.
+     *
+     * This assumes a texture maps once across its span, which holds for
+     * most of the art and errs towards loading too much for tiled maps.
+     */
+    void IRequestTextureDetail(plDrawableSpans* drawable, const hsTArray<int16_t>& visList);
+
+
     /**
      * Get the camera to NDC transform.
      *
@@ -66,6 +66,9 @@ static const float kTolerance = 1.e-3f;
 static const float kTolerance = 1.e-1f;
 #endif // CULL_SMALL_TOLERANCE
 
+// How far outside a plane a bounds must be to be culled.
+static const float kSafetyDist = -0.1f;
+
 plProfile_CreateCounter("Harvest Nodes", "Draw", HarvestNodes);
 
 //////////////////////////////////////////////////////////////////////
@@ -139,7 +142,6 @@ plCullNode::plCullStatus plCullNode::TestBounds(const hsBounds3Ext& bnd) const
     hsPoint2 depth;
     bnd.TestPlane(fNorm, depth);
 
-    const float kSafetyDist = -0.1f;
     if( depth.fY + fDist < kSafetyDist )
         return kCulled;
 
@@ -1067,12 +1069,41 @@ void plCullTree::SetViewPos(const hsPoint3& p)
 //////////////////////////////////////////////////////////////////////
 // Use the tree
 //////////////////////////////////////////////////////////////////////
+// Without any occluders, the tree is just the frustum planes hanging off each
+// other's outer child. In that case the space tree can cull against them
+// all at once from its packed quads.
+bool plCullTree::IGetPlaneChain(hsTArray<hsPlane3>& planes) const
+{
+    planes.SetCount(0);
+
+    const plCullNode* node = IGetRoot();
+    while( node )
+    {
+        if( (node->fInnerChild >= 0) || (planes.GetCount() >= plSpaceTree::kMaxCullPlanes) )
+            return false;
+
+        planes.Append(hsPlane3(&node->fNorm, node->fDist));
+        node = IGetNode(node->fOuterChild);
+    }
+    return true;
+}
+
 void plCullTree::Harvest(const plSpaceTree* space, hsTArray<int16_t>& outList) const
 {
     outList.SetCount(0);
-    if (!space->IsEmpty())
-        IGetRoot()->IHarvest(space, outList);
+    if (space->IsEmpty())
+        return;
+
+    if (plSpaceTree::GetPackedCulling() && IGetPlaneChain(fScratchPlanes))
+    {
+        plSpaceTreePlaneSet planes(fScratchPlanes.AcquireArray(), fScratchPlanes.GetCount(), kSafetyDist, true);
+        space->HarvestLeaves(planes, ScratchBitVec());
+        space->BitVectorToList(outList, ScratchBitVec());
+        ScratchBitVec().Clear();
+        return;
+    }
 
+    IGetRoot()->IHarvest(space, outList);
 }
 
 bool plCullTree::BoundsVisible(const hsBounds3Ext& bnd) const
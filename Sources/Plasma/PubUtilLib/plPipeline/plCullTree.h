@@ -79,6 +79,7 @@ protected:
     mutable hsLargeArray<int16_t>     fScratchCulled;
     mutable hsBitVector             fScratchBitVec;
     mutable hsBitVector             fScratchTotVec;
+    mutable hsTArray<hsPlane3>      fScratchPlanes;
 
     void        IVisPolyShape(const plCullPoly& poly, bool dark) const;
     void        IVisPolyEdge(const hsPoint3& p0, const hsPoint3& p1, bool dark) const;
@@ -95,6 +96,8 @@ protected:
     void                ITestNode(const plSpaceTree* space, int16_t who, hsTArray<int16_t>& outList) const; // Appends to outlist
     void                ITestList(const plSpaceTree* space, const hsTArray<int16_t>& inList, hsTArray<int16_t>& outList) const;
 
+    bool                IGetPlaneChain(hsTArray<hsPlane3>& planes) const;
+
     int16_t               IAddPolyRecur(const plCullPoly& poly, int16_t iNode);
     int16_t               IMakeHoleSubTree(const plCullPoly& poly) const;
     int16_t               IMakePolySubTree(const plCullPoly& poly) const;
@@ -0,0 +1,657 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include "HeadSpin.h"
+#include "plHiZBuffer.h"
+#include "plDrawable/plSpaceTree.h"
+#include "plScene/plCullPoly.h"
+#include "hsFastMath.h"
+#include "plProfile.h"
+
+#include "plTweak.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#ifdef HS_SIMD_INCLUDE
+#  include HS_SIMD_INCLUDE
+#endif
+
+plProfile_CreateCounter("HiZ Occluders", "Draw", HiZOccluders);
+plProfile_CreateCounter("HiZ Culled", "Draw", HiZCulled);
+
+bool plHiZBuffer::fEnabled = false;
+
+// Bounds are pushed out this far before testing, matching the distance
+// the cull tree wants them behind its planes.
+static const float kSafetyDist = 0.1f;
+
+// Clipped occluder polys with more verts than this are just skipped.
+static const int kMaxPolyVerts = 32;
+
+static const float kMinW = 1.e-4f;
+
+///////////////////////////////////////////////////////////////////////////////
+// Span fill and pyramid reduction kernels.
+
+static void fill_span_fpu(float* row, int x0, int x1, float z0, float dzdx)
+{
+    int x;
+    for( x = x0; x <= x1; x++ )
+        row[x] = std::min(row[x], z0 + x * dzdx);
+}
+
+static void fill_span_sse1(float* row, int x0, int x1, float z0, float dzdx)
+{
+#ifdef HS_SSE1
+    const __m128 step = _mm_mul_ps(_mm_set_ps(3.f, 2.f, 1.f, 0.f), _mm_set1_ps(dzdx));
+    int x = x0;
+    for( ; x + 3 <= x1; x += 4 )
+    {
+        __m128 z = _mm_add_ps(_mm_set1_ps(z0 + x * dzdx), step);
+        _mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), z));
+    }
+    for( ; x <= x1; x++ )
+        row[x] = std::min(row[x], z0 + x * dzdx);
+#endif  // HS_SSE1
+}
+
+static void fill_span_avx(float* row, int x0, int x1, float z0, float dzdx)
+{
+#ifdef HS_AVX
+    const __m256 step = _mm256_mul_ps(_mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f), _mm256_set1_ps(dzdx));
+    int x = x0;
+    for( ; x + 7 <= x1; x += 8 )
+    {
+        __m256 z = _mm256_add_ps(_mm256_set1_ps(z0 + x * dzdx), step);
+        _mm256_storeu_ps(row + x, _mm256_min_ps(_mm256_loadu_ps(row + x), z));
+    }
+    for( ; x <= x1; x++ )
+        row[x] = std::min(row[x], z0 + x * dzdx);
+#endif  // HS_AVX
+}
+
+static void reduce_level_fpu(const float* src, float* dst, int dstW, int dstH)
+{
+    const int srcW = dstW << 1;
+    int y;
+    for( y = 0; y < dstH; y++ )
+    {
+        const float* s0 = src + (y << 1) * srcW;
+        const float* s1 = s0 + srcW;
+        int x;
+        for( x = 0; x < dstW; x++ )
+            dst[x] = std::max(std::max(s0[2*x], s0[2*x+1]), std::max(s1[2*x], s1[2*x+1]));
+        dst += dstW;
+    }
+}
+
+static void reduce_level_sse1(const float* src, float* dst, int dstW, int dstH)
+{
+#ifdef HS_SSE1
+    const int srcW = dstW << 1;
+    int y;
+    for( y = 0; y < dstH; y++ )
+    {
+        const float* s0 = src + (y << 1) * srcW;
+        const float* s1 = s0 + srcW;
+        int x = 0;
+        for( ; x + 4 <= dstW; x += 4 )
+        {
+            __m128 lo = _mm_max_ps(_mm_loadu_ps(s0 + 2*x), _mm_loadu_ps(s1 + 2*x));
+            __m128 hi = _mm_max_ps(_mm_loadu_ps(s0 + 2*x + 4), _mm_loadu_ps(s1 + 2*x + 4));
+            __m128 even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(dst + x, _mm_max_ps(even, odd));
+        }
+        for( ; x < dstW; x++ )
+            dst[x] = std::max(std::max(s0[2*x], s0[2*x+1]), std::max(s1[2*x], s1[2*x+1]));
+        dst += dstW;
+    }
+#endif  // HS_SSE1
+}
+
+static bool project_bounds_fpu(const float* world2NDC, const float* mins, const float* maxs, float* rect)
+{
+    const float* r0 = world2NDC;
+    const float* r1 = world2NDC + 4;
+    const float* r2 = world2NDC + 8;
+    const float* r3 = world2NDC + 12;
+
+    rect[0] = rect[1] = rect[4] = FLT_MAX;
+    rect[2] = rect[3] = -FLT_MAX;
+    int i;
+    for( i = 0; i < 8; i++ )
+    {
+        const float x = (i & 1) ? maxs[0] : mins[0];
+        const float y = (i & 2) ? maxs[1] : mins[1];
+        const float z = (i & 4) ? maxs[2] : mins[2];
+
+        const float w = r3[0] * x + r3[1] * y + r3[2] * z + r3[3];
+        if( w < kMinW )
+            return false;
+        const float invW = 1.f / w;
+
+        const float sx = (r0[0] * x + r0[1] * y + r0[2] * z + r0[3]) * invW;
+        const float sy = (r1[0] * x + r1[1] * y + r1[2] * z + r1[3]) * invW;
+        const float sz = (r2[0] * x + r2[1] * y + r2[2] * z + r2[3]) * invW;
+        rect[0] = std::min(rect[0], sx);
+        rect[1] = std::min(rect[1], sy);
+        rect[2] = std::max(rect[2], sx);
+        rect[3] = std::max(rect[3], sy);
+        rect[4] = std::min(rect[4], sz);
+    }
+    return true;
+}
+
+#ifdef HS_SSE1
+static inline float IHMin(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float IHMax(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif  // HS_SSE1
+
+static bool project_bounds_sse1(const float* world2NDC, const float* mins, const float* maxs, float* rect)
+{
+#ifdef HS_SSE1
+    // Corners 0-3 in one register and 4-7 in the other, differing only in z.
+    const __m128 x = _mm_set_ps(maxs[0], mins[0], maxs[0], mins[0]);
+    const __m128 y = _mm_set_ps(maxs[1], maxs[1], mins[1], mins[1]);
+    const __m128 zLo = _mm_set1_ps(mins[2]);
+    const __m128 zHi = _mm_set1_ps(maxs[2]);
+
+    __m128 xy[4];
+    __m128 rz[4];
+    int i;
+    for( i = 0; i < 4; i++ )
+    {
+        const float* r = world2NDC + (i << 2);
+        xy[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), x), _mm_mul_ps(_mm_set1_ps(r[1]), y)), _mm_set1_ps(r[3]));
+        rz[i] = _mm_set1_ps(r[2]);
+    }
+
+    const __m128 wLo = _mm_add_ps(xy[3], _mm_mul_ps(rz[3], zLo));
+    const __m128 wHi = _mm_add_ps(xy[3], _mm_mul_ps(rz[3], zHi));
+    const __m128 minW = _mm_set1_ps(kMinW);
+    if( _mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(wLo, minW), _mm_cmplt_ps(wHi, minW))) )
+        return false;
+
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 invLo = _mm_div_ps(one, wLo);
+    const __m128 invHi = _mm_div_ps(one, wHi);
+
+    const __m128 sxLo = _mm_mul_ps(_mm_add_ps(xy[0], _mm_mul_ps(rz[0], zLo)), invLo);
+    const __m128 sxHi = _mm_mul_ps(_mm_add_ps(xy[0], _mm_mul_ps(rz[0], zHi)), invHi);
+    const __m128 syLo = _mm_mul_ps(_mm_add_ps(xy[1], _mm_mul_ps(rz[1], zLo)), invLo);
+    const __m128 syHi = _mm_mul_ps(_mm_add_ps(xy[1], _mm_mul_ps(rz[1], zHi)), invHi);
+    const __m128 szLo = _mm_mul_ps(_mm_add_ps(xy[2], _mm_mul_ps(rz[2], zLo)), invLo);
+    const __m128 szHi = _mm_mul_ps(_mm_add_ps(xy[2], _mm_mul_ps(rz[2], zHi)), invHi);
+
+    rect[0] = IHMin(_mm_min_ps(sxLo, sxHi));
+    rect[1] = IHMin(_mm_min_ps(syLo, syHi));
+    rect[2] = IHMax(_mm_max_ps(sxLo, sxHi));
+    rect[3] = IHMax(_mm_max_ps(syLo, syHi));
+    rect[4] = IHMin(_mm_min_ps(szLo, szHi));
+    return true;
+#endif  // HS_SSE1
+}
+
+// CPU-optimized functions requiring dispatch
+hsCpuFunctionDispatcher<plHiZBuffer::fill_span_ptr> plHiZBuffer::fill_span {
+    &fill_span_fpu,
+    &fill_span_sse1,        // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    &fill_span_avx          // AVX
+};
+
+hsCpuFunctionDispatcher<plHiZBuffer::reduce_level_ptr> plHiZBuffer::reduce_level {
+    &reduce_level_fpu,
+    &reduce_level_sse1,     // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+hsCpuFunctionDispatcher<plHiZBuffer::project_bounds_ptr> plHiZBuffer::project_bounds {
+    &project_bounds_fpu,
+    &project_bounds_sse1,   // SSE1
+    nullptr,                // SSE2
+    nullptr,                // SSE3
+    nullptr,                // SSSE3
+    nullptr,                // SSE4.1
+    nullptr,                // SSE4.2
+    nullptr                 // AVX
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+int plHiZBuffer::ILevelOffset(int level)
+{
+    int offset = 0;
+    int i;
+    for( i = 0; i < level; i++ )
+        offset += (kWidth >> i) * (kHeight >> i);
+    return offset;
+}
+
+// Same rules the cull tree uses to decide whether a poly is worth adding.
+bool plHiZBuffer::IFacing(const plCullPoly& poly, bool& backFace) const
+{
+    hsVector3 cenToEye(&fViewPos, &poly.fCenter);
+    hsFastMath::NormalizeAppr(cenToEye);
+    float camDist = cenToEye.InnerProduct(poly.fNorm);
+    plConst(float) kTol(0.1f);
+    backFace = camDist < -kTol;
+    if( !backFace && (camDist < kTol) )
+        return false;
+
+    if( poly.IsHole() )
+        return backFace;
+
+    return !backFace || poly.IsTwoSided();
+}
+
+// Clip to the hither plane and take the verts to buffer pixels, with NDC depth in fZ.
+bool plHiZBuffer::IProjectPoly(const plCullPoly& poly, hsTArray<hsPoint3>& scrVerts) const
+{
+    scrVerts.SetCount(0);
+
+    const int nVerts = poly.fVerts.GetCount();
+    if( (nVerts < 3) || (nVerts >= kMaxPolyVerts) )
+        return false;
+
+    float clip[kMaxPolyVerts][4];
+    int i;
+    for( i = 0; i < nVerts; i++ )
+    {
+        const hsPoint3& p = poly.fVerts[i];
+        int j;
+        for( j = 0; j < 4; j++ )
+        {
+            const float* r = fWorldToNDC.fMap[j];
+            clip[i][j] = r[0] * p.fX + r[1] * p.fY + r[2] * p.fZ + r[3];
+        }
+    }
+
+    // z >= 0 is in front of hither.
+    float outVerts[kMaxPolyVerts+1][4];
+    int nOut = 0;
+    for( i = 0; i < nVerts; i++ )
+    {
+        const float* p0 = clip[i];
+        const float* p1 = clip[(i + 1) % nVerts];
+        bool in0 = p0[2] >= 0;
+        bool in1 = p1[2] >= 0;
+        if( in0 )
+            memcpy(outVerts[nOut++], p0, sizeof(outVerts[0]));
+        if( in0 != in1 )
+        {
+            float t = p0[2] / (p0[2] - p1[2]);
+            int j;
+            for( j = 0; j < 4; j++ )
+                outVerts[nOut][j] = p0[j] + (p1[j] - p0[j]) * t;
+            nOut++;
+        }
+    }
+    if( nOut < 3 )
+        return false;
+
+    scrVerts.SetCount(nOut);
+    for( i = 0; i < nOut; i++ )
+    {
+        const float w = outVerts[i][3];
+        if( w < kMinW )
+            return false;
+        const float invW = 1.f / w;
+        scrVerts[i].Set((outVerts[i][0] * invW * 0.5f + 0.5f) * kWidth,
+                        (outVerts[i][1] * invW * 0.5f + 0.5f) * kHeight,
+                        outVerts[i][2] * invW);
+    }
+    return true;
+}
+
+void plHiZBuffer::IRasterPoly(const hsTArray<hsPoint3>& scrVerts)
+{
+    const int nVerts = scrVerts.GetCount();
+
+    // Orientation, and the most stable triangle for the depth plane.
+    float area = 0;
+    float bestCross = 0;
+    int bestTri = 1;
+    int i;
+    for( i = 1; i + 1 < nVerts; i++ )
+    {
+        hsVector3 d1(&scrVerts[i], &scrVerts[0]);
+        hsVector3 d2(&scrVerts[i+1], &scrVerts[0]);
+        float cross = d1.fX * d2.fY - d1.fY * d2.fX;
+        area += cross;
+        if( fabs(cross) > fabs(bestCross) )
+        {
+            bestCross = cross;
+            bestTri = i;
+        }
+    }
+    if( fabs(bestCross) < 1.e-6f )
+        return;
+    const float sign = area > 0 ? 1.f : -1.f;
+
+    hsVector3 d1(&scrVerts[bestTri], &scrVerts[0]);
+    hsVector3 d2(&scrVerts[bestTri+1], &scrVerts[0]);
+    const float invCross = 1.f / bestCross;
+    const float dzdx = (d1.fZ * d2.fY - d2.fZ * d1.fY) * invCross;
+    const float dzdy = (d2.fZ * d1.fX - d1.fZ * d2.fX) * invCross;
+    const float zc = scrVerts[0].fZ - dzdx * scrVerts[0].fX - dzdy * scrVerts[0].fY;
+
+    // Farthest depth anywhere in the pixel, so the fill never claims to be
+    // nearer than the occluder really is.
+    const float zSlop = 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+    // Edge functions positive inside, pulled in by half a pixel's extent so
+    // only pixels entirely inside pass.
+    float edgeA[kMaxPolyVerts+1];
+    float edgeB[kMaxPolyVerts+1];
+    float edgeC[kMaxPolyVerts+1];
+    float minY = FLT_MAX;
+    float maxY = -FLT_MAX;
+    for( i = 0; i < nVerts; i++ )
+    {
+        const hsPoint3& p0 = scrVerts[i];
+        const hsPoint3& p1 = scrVerts[(i + 1) % nVerts];
+        float dx = p1.fX - p0.fX;
+        float dy = p1.fY - p0.fY;
+        edgeA[i] = -dy * sign;
+        edgeB[i] = dx * sign;
+        edgeC[i] = (dy * p0.fX - dx * p0.fY) * sign - 0.5f * (fabs(dx) + fabs(dy));
+
+        minY = std::min(minY, p0.fY);
+        maxY = std::max(maxY, p0.fY);
+    }
+
+    int y0 = std::max(0, int(floor(minY)));
+    int y1 = std::min(int(kHeight) - 1, int(ceil(maxY)) - 1);
+
+    float* row = ILevel(0) + y0 * kWidth;
+    int y;
+    for( y = y0; y <= y1; y++, row += kWidth )
+    {
+        const float yc = y + 0.5f;
+        float lo = 0.5f;
+        float hi = kWidth - 0.5f;
+        for( i = 0; i < nVerts; i++ )
+        {
+            float k = edgeB[i] * yc + edgeC[i];
+            if( edgeA[i] > 0 )
+                lo = std::max(lo, -k / edgeA[i]);
+            else if( edgeA[i] < 0 )
+                hi = std::min(hi, -k / edgeA[i]);
+            else if( k < 0 )
+                hi = -1.f;
+        }
+        if( lo > hi )
+            continue;
+
+        int x0 = int(ceil(lo - 0.5f));
+        int x1 = int(floor(hi - 0.5f));
+        if( x0 > x1 )
+            continue;
+
+        fill_span.call(row, x0, x1, zc + dzdy * yc + dzdx * 0.5f + zSlop, dzdx);
+    }
+}
+
+void plHiZBuffer::IBuildLevels()
+{
+    int i;
+    for( i = 1; i < kNumLevels; i++ )
+        reduce_level.call(ILevel(i-1), ILevel(i), kWidth >> i, kHeight >> i);
+}
+
+void plHiZBuffer::Build(const hsMatrix44& world2NDC, const hsPoint3& viewPos,
+                        const hsTArray<const plCullPoly*>& polys,
+                        const hsTArray<const plCullPoly*>& holes)
+{
+    fWorldToNDC = world2NDC;
+    fViewPos = viewPos;
+    fNumOccluders = 0;
+
+    if( !polys.GetCount() )
+        return;
+
+    if( fDepth.empty() )
+        fDepth.resize(ILevelOffset(kNumLevels));
+    std::fill(ILevel(0), ILevel(0) + kWidth * kHeight, FLT_MAX);
+
+    // Screen rects of the holes we can see, as min/max pairs.
+    fScratchHoleRects.SetCount(0);
+    int i;
+    for( i = 0; i < holes.GetCount(); i++ )
+    {
+        bool backFace;
+        if( !IFacing(*holes[i], backFace) || !IProjectPoly(*holes[i], fScratchVerts) )
+            continue;
+
+        hsPoint3 lo(FLT_MAX, FLT_MAX, 0);
+        hsPoint3 hi(-FLT_MAX, -FLT_MAX, 0);
+        int j;
+        for( j = 0; j < fScratchVerts.GetCount(); j++ )
+        {
+            lo.fX = std::min(lo.fX, fScratchVerts[j].fX - 1.f);
+            lo.fY = std::min(lo.fY, fScratchVerts[j].fY - 1.f);
+            hi.fX = std::max(hi.fX, fScratchVerts[j].fX + 1.f);
+            hi.fY = std::max(hi.fY, fScratchVerts[j].fY + 1.f);
+        }
+        fScratchHoleRects.Append(lo);
+        fScratchHoleRects.Append(hi);
+    }
+
+    for( i = 0; i < polys.GetCount(); i++ )
+    {
+        bool backFace;
+        if( !IFacing(*polys[i], backFace) || !IProjectPoly(*polys[i], fScratchVerts) )
+            continue;
+
+        if( fScratchHoleRects.GetCount() )
+        {
+            hsPoint3 lo(FLT_MAX, FLT_MAX, 0);
+            hsPoint3 hi(-FLT_MAX, -FLT_MAX, 0);
+            int j;
+            for( j = 0; j < fScratchVerts.GetCount(); j++ )
+            {
+                lo.fX = std::min(lo.fX, fScratchVerts[j].fX);
+                lo.fY = std::min(lo.fY, fScratchVerts[j].fY);
+                hi.fX = std::max(hi.fX, fScratchVerts[j].fX);
+                hi.fY = std::max(hi.fY, fScratchVerts[j].fY);
+            }
+            for( j = 0; j < fScratchHoleRects.GetCount(); j += 2 )
+            {
+                const hsPoint3& holeLo = fScratchHoleRects[j];
+                const hsPoint3& holeHi = fScratchHoleRects[j+1];
+                if( (lo.fX <= holeHi.fX) && (hi.fX >= holeLo.fX) && (lo.fY <= holeHi.fY) && (hi.fY >= holeLo.fY) )
+                    break;
+            }
+            if( j < fScratchHoleRects.GetCount() )
+                continue;
+        }
+
+        IRasterPoly(fScratchVerts);
+        fNumOccluders++;
+    }
+
+    if( fNumOccluders )
+        IBuildLevels();
+
+    plProfile_IncCount(HiZOccluders, fNumOccluders);
+}
+
+// True if every texel of the level under the (level 0) pixel rect is nearer than depth.
+bool plHiZBuffer::ITestRect(int level, int x0, int y0, int x1, int y1, float depth) const
+{
+    const int width = kWidth >> level;
+    x0 >>= level;
+    x1 >>= level;
+    y0 >>= level;
+    y1 >>= level;
+
+    const float* row = ILevel(level) + y0 * width;
+    int y;
+    for( y = y0; y <= y1; y++, row += width )
+    {
+        int x;
+        for( x = x0; x <= x1; x++ )
+        {
+            if( row[x] >= depth )
+                return false;
+        }
+    }
+    return true;
+}
+
+bool plHiZBuffer::BoundsVisible(const hsBounds3Ext& bnd) const
+{
+    if( !fNumOccluders || (bnd.GetType() != kBoundsNormal) )
+        return true;
+
+    const hsPoint3& mins = bnd.GetMins();
+    const hsPoint3& maxs = bnd.GetMaxs();
+    const float lo[3] = { mins.fX - kSafetyDist, mins.fY - kSafetyDist, mins.fZ - kSafetyDist };
+    const float hi[3] = { maxs.fX + kSafetyDist, maxs.fY + kSafetyDist, maxs.fZ + kSafetyDist };
+
+    // Anything reaching back past the eye is left to the frustum.
+    float rect[5];
+    if( !project_bounds.call(&fWorldToNDC.fMap[0][0], lo, hi, rect) )
+        return true;
+
+    const float minX = (rect[0] * 0.5f + 0.5f) * kWidth;
+    const float minY = (rect[1] * 0.5f + 0.5f) * kHeight;
+    const float maxX = (rect[2] * 0.5f + 0.5f) * kWidth;
+    const float maxY = (rect[3] * 0.5f + 0.5f) * kHeight;
+    const float minZ = rect[4];
+    if( (maxX < 0) || (minX >= kWidth) || (maxY < 0) || (minY >= kHeight) )
+        return true;
+
+    const int x0 = std::max(0, int(floor(minX)));
+    const int x1 = std::min(int(kWidth) - 1, int(floor(maxX)));
+    const int y0 = std::max(0, int(floor(minY)));
+    const int y1 = std::min(int(kHeight) - 1, int(floor(maxY)));
+
+    // Start where the rect spans a handful of texels, and give the finer
+    // levels a couple of chances before calling it visible.
+    int level = 0;
+    while( (level < kNumLevels - 1) && (((x1 >> level) - (x0 >> level) >= 4) || ((y1 >> level) - (y0 >> level) >= 4)) )
+        level++;
+
+    const int finest = std::max(0, level - 2);
+    for( ; level >= finest; level-- )
+    {
+        if( ITestRect(level, x0, y0, x1, y1, minZ) )
+            return false;
+    }
+    return true;
+}
+
+void plHiZBuffer::IHarvestRecur(const plSpaceTree* space, int16_t who) const
+{
+    if( fScratchNodes[who] != kNodeWanted )
+        return;
+
+    const plSpaceTreeNode& node = space->GetNode(who);
+    if( !BoundsVisible(node.fWorldBounds) )
+        return;
+
+    if( node.IsLeaf() )
+    {
+        fScratchNodes[who] = kNodeVisible;
+        return;
+    }
+
+    IHarvestRecur(space, node.GetChild(0));
+    IHarvestRecur(space, node.GetChild(1));
+}
+
+void plHiZBuffer::Harvest(const plSpaceTree* space, hsTArray<int16_t>& list) const
+{
+    if( !fNumOccluders || !list.GetCount() )
+        return;
+
+    // Mark the path from each listed leaf up to the root, so the walk down
+    // only visits subtrees with something left to cull.
+    fScratchNodes.assign(space->GetNumNodes(), kNodeSkip);
+    int i;
+    for( i = 0; i < list.GetCount(); i++ )
+    {
+        int16_t who = list[i];
+        while( (who != plSpaceTree::kRootParent) && (fScratchNodes[who] == kNodeSkip) )
+        {
+            fScratchNodes[who] = kNodeWanted;
+            who = space->GetNode(who).GetParent();
+        }
+    }
+
+    IHarvestRecur(space, space->GetRoot());
+
+    int numVis = 0;
+    for( i = 0; i < list.GetCount(); i++ )
+    {
+        if( fScratchNodes[list[i]] == kNodeVisible )
+            list[numVis++] = list[i];
+    }
+    plProfile_IncCount(HiZCulled, list.GetCount() - numVis);
+    list.SetCount(numVis);
+}
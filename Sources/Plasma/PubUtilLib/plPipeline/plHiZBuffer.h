@@ -0,0 +1,157 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#ifndef plHiZBuffer_inc
+#define plHiZBuffer_inc
+
+#include "hsBounds.h"
+#include "hsCpuID.h"
+#include "hsGeometry3.h"
+#include "hsMatrix44.h"
+#include "hsTemplates.h"
+
+#include <vector>
+
+class plCullPoly;
+class plSpaceTree;
+
+// A small software depth buffer the occluder polys are rasterized into, as
+// an alternative to merging them into the plCullTree BSP. Each pixel holds
+// the farthest NDC depth of the nearest occluder covering all of it, and the
+// coarser levels hold the farthest depth of the 2x2 texels below them, so a
+// bounds is occluded once every texel its screen rect touches is nearer than
+// its nearest corner. Both the coverage and the depths are conservative, an
+// occluder only ever claims pixels it covers completely.
+class plHiZBuffer
+{
+public:
+    enum
+    {
+        kWidth      = 256,
+        kHeight     = 128,
+        kNumLevels  = 8 // down to 2x1
+    };
+
+protected:
+    enum
+    {
+        kNodeSkip       = 0,
+        kNodeWanted     = 1,
+        kNodeVisible    = 2
+    };
+
+    hsMatrix44                  fWorldToNDC;
+    hsPoint3                    fViewPos;
+
+    // All the levels, finest first. Only allocated once there's something
+    // to rasterize, the pipeline copies its view settings around freely.
+    std::vector<float>          fDepth;
+
+    uint32_t                    fNumOccluders;
+
+    // Screen space scratch for the poly being rasterized.
+    mutable hsTArray<hsPoint3>  fScratchVerts;
+    mutable hsTArray<hsPoint3>  fScratchHoleRects;
+    // Per space tree node during Harvest, one of the kNode states.
+    mutable std::vector<uint8_t> fScratchNodes;
+
+    static bool                 fEnabled;
+
+    static int                  ILevelOffset(int level);
+    float*                      ILevel(int level) { return fDepth.data() + ILevelOffset(level); }
+    const float*                ILevel(int level) const { return fDepth.data() + ILevelOffset(level); }
+
+    bool                        IFacing(const plCullPoly& poly, bool& backFace) const;
+    bool                        IProjectPoly(const plCullPoly& poly, hsTArray<hsPoint3>& scrVerts) const;
+    void                        IRasterPoly(const hsTArray<hsPoint3>& scrVerts);
+    void                        IBuildLevels();
+    bool                        ITestRect(int level, int x0, int y0, int x1, int y1, float depth) const;
+    void                        IHarvestRecur(const plSpaceTree* space, int16_t who) const;
+
+public:
+    plHiZBuffer() : fNumOccluders(0) {}
+
+    /** Forget every occluder, nothing will test as occluded until the next Build. */
+    void            Clear() { fNumOccluders = 0; }
+
+    /**
+     * Rasterize the occluder polys for this view. Occluders whose screen rect
+     * overlaps one of the visible holes are left out, since the buffer has
+     * no way to cut the hole back out of them.
+     */
+    void            Build(const hsMatrix44& world2NDC, const hsPoint3& viewPos,
+                          const hsTArray<const plCullPoly*>& polys,
+                          const hsTArray<const plCullPoly*>& holes);
+
+    uint32_t        GetNumOccluders() const { return fNumOccluders; }
+    bool            HasOccluders() const { return fNumOccluders > 0; }
+
+    /** False if the bounds are entirely hidden behind the rasterized occluders. */
+    bool            BoundsVisible(const hsBounds3Ext& bnd) const;
+
+    /**
+     * Remove the occluded leaves from a list already culled against the
+     * frustum. Only the interior nodes over leaves in the list are tested,
+     * and a node found occluded takes its whole subtree with it.
+     */
+    void            Harvest(const plSpaceTree* space, hsTArray<int16_t>& list) const;
+
+    static bool     GetEnabled() { return fEnabled; }
+    static void     SetEnabled(bool on) { fEnabled = on; }
+
+    //  CPU-optimized functions
+    // Pulls the row in to the nearer of what's there and z0 + x * dzdx, for x in [x0, x1].
+    typedef void(*fill_span_ptr)(float* row, int x0, int x1, float z0, float dzdx);
+    static hsCpuFunctionDispatcher<fill_span_ptr> fill_span;
+
+    // Writes the farthest of each 2x2 block of src (2*dstW wide) into dst.
+    typedef void(*reduce_level_ptr)(const float* src, float* dst, int dstW, int dstH);
+    static hsCpuFunctionDispatcher<reduce_level_ptr> reduce_level;
+
+    // Projects the corners of the box through the row major world2NDC into
+    // rect as NDC min x, min y, max x, max y and the nearest z. Returns false
+    // if any corner is at or behind the eye.
+    typedef bool(*project_bounds_ptr)(const float* world2NDC, const float* mins, const float* maxs, float* rect);
+    static hsCpuFunctionDispatcher<project_bounds_ptr> project_bounds;
+};
+
+#endif // plHiZBuffer_inc
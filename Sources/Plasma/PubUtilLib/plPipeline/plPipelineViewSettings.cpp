@@ -90,6 +90,7 @@ void plPipelineViewSettings::Reset(pl3DPipeline* pipeline)
     // node planes) keeps rising.
     const uint16_t kCullMaxNodes = 250;
     fCullTree.Reset();
+    fHiZ.Clear();
     fCullTreeDirty = true;
     fMaxCullNodes = kCullMaxNodes;
 
@@ -194,6 +195,7 @@ void plPipelineViewSettings::RefreshCullTree()
         plProfile_BeginTiming(DrawOccBuild);
 
         fCullTree.Reset();
+        fHiZ.Clear();
 
         fCullTree.SetViewPos(GetViewPositionWorld());
 
@@ -214,7 +216,14 @@ void plPipelineViewSettings::RefreshCullTree()
         fCullTree.InitFrustum(fTransform.GetWorldToNDC());
         fCullTreeDirty = false;
 
-        if (fMaxCullNodes)
+        if (fMaxCullNodes && plHiZBuffer::GetEnabled())
+        {
+            fHiZ.Build(fTransform.GetWorldToNDC(), GetViewPositionWorld(), fCullPolys, fCullHoles);
+            plProfile_Set(OccPolyUsed, fHiZ.GetNumOccluders());
+            fCullPolys.SetCount(0);
+            fCullHoles.SetCount(0);
+        }
+        else if (fMaxCullNodes)
         {
             int i;
             for (i = 0; i < fCullPolys.GetCount(); i++)
@@ -259,6 +268,7 @@ bool plPipelineViewSettings::HarvestVisible(plSpaceTree* space, hsTArray<int16_t
 
     plProfile_BeginTiming(Harvest);
     fCullTree.Harvest(space, visList);
+    fHiZ.Harvest(space, visList);
     plProfile_EndTiming(Harvest);
 
     return visList.GetCount() != 0;
@@ -293,6 +303,7 @@ void plPipelineViewSettings::GetVisibleSpans(plDrawableSpans* drawable, hsTArray
     {
         fCullTree.Harvest(drawable->GetSpaceTree(), tmpVis);
     }
+    fHiZ.Harvest(drawable->GetSpaceTree(), tmpVis);
 
     // This is a big waste of time, As a desparate "optimization" pass, the artists
     // insist on going through and marking objects to fade or pop out of rendering
@@ -367,7 +378,7 @@ bool plPipelineViewSettings::TestVisibleWorld(const hsBounds3Ext& wBnd)
         RefreshCullTree();
 
     if (wBnd.GetType() == kBoundsNormal)
-        return fCullTree.BoundsVisible(wBnd);
+        return fCullTree.BoundsVisible(wBnd) && fHiZ.BoundsVisible(wBnd);
     else
         return false;
 }
@@ -52,6 +52,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "hsBitVector.h"
 #include "hsPoint2.h"
 #include "plCullTree.h"
+#include "plHiZBuffer.h"
 #include "plViewTransform.h"
 
 //// General Settings /////////////////////////////////////////////////////////
@@ -87,6 +88,7 @@ protected:
     hsTArray<const plCullPoly*> fCullPolys;
     hsTArray<const plCullPoly*> fCullHoles;
     plCullTree                  fCullTree;
+    plHiZBuffer                 fHiZ;
     plDrawableSpans*            fCullProxy;
 
     uint16_t                    fMaxCullNodes;
@@ -186,7 +188,11 @@ public:
      * into a single BSP tree.
      * It must be recomputed any time the camera moves.
      *
+     * With plHiZBuffer enabled, the occluders are rasterized into the depth
+     * buffer instead and the cull tree only holds the frustum.
+     *
      * \sa plCullTree
+     * \sa plHiZBuffer
      */
     void    RefreshCullTree();
 
@@ -0,0 +1,109 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include "plLoadTrace.h"
+
+#include "hsStream.h"
+
+static const uint32_t kLoadTraceTag = 0x52544c50; // 'PLTR'
+static const uint32_t kLoadTraceVersion = 1;
+
+void plLoadTrace::AddRecord(const plUoid& uoid, uint32_t startPos, uint32_t dataLen, float time)
+{
+    Record rec;
+    rec.fUoid = uoid;
+    rec.fStartPos = startPos;
+    rec.fDataLen = dataLen;
+    rec.fTime = time;
+    fRecords.push_back(rec);
+}
+
+bool plLoadTrace::Read(const plFileName& fileName)
+{
+    fRecords.clear();
+
+    hsUNIXStream s;
+    if (!s.Open(fileName, "rb"))
+        return false;
+
+    if (s.ReadLE32() != kLoadTraceTag || s.ReadLE32() != kLoadTraceVersion)
+    {
+        s.Close();
+        return false;
+    }
+
+    uint32_t numRecords = s.ReadLE32();
+    fRecords.reserve(numRecords);
+    for (uint32_t i = 0; i < numRecords && !s.AtEnd(); i++)
+    {
+        Record rec;
+        rec.fUoid.Read(&s);
+        rec.fStartPos = s.ReadLE32();
+        rec.fDataLen = s.ReadLE32();
+        rec.fTime = s.ReadLEFloat();
+        fRecords.push_back(rec);
+    }
+
+    s.Close();
+    return fRecords.size() == numRecords;
+}
+
+bool plLoadTrace::Write(const plFileName& fileName) const
+{
+    hsUNIXStream s;
+    if (!s.Open(fileName, "wb"))
+        return false;
+
+    s.WriteLE32(kLoadTraceTag);
+    s.WriteLE32(kLoadTraceVersion);
+    s.WriteLE32(uint32_t(fRecords.size()));
+    for (size_t i = 0; i < fRecords.size(); i++)
+    {
+        const Record& rec = fRecords[i];
+        rec.fUoid.Write(&s);
+        s.WriteLE32(rec.fStartPos);
+        s.WriteLE32(rec.fDataLen);
+        s.WriteLEFloat(rec.fTime);
+    }
+
+    s.Close();
+    return true;
+}
@@ -0,0 +1,278 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include "plPageCompressor.h"
+#include "plPageInfo.h"
+#include "plRegistryNode.h"
+
+#include "hsStream.h"
+#include "plCompression/plLZ4Compress.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    struct KeyEntry
+    {
+        plUoid   fUoid;
+        uint32_t fStartPos;
+        uint32_t fDataLen;
+        uint32_t fUncompressedLen;
+    };
+
+    struct KeyType
+    {
+        uint16_t fClassType;
+        std::vector<KeyEntry> fKeys;
+    };
+
+    struct ObjectMove
+    {
+        uint32_t fOldStart, fOldEnd;
+        uint32_t fNewStart, fNewEnd;
+    };
+}
+
+static bool IReadIndex(hsStream* s, std::vector<KeyType>& types, bool compressed)
+{
+    uint32_t numTypes = s->ReadLE32();
+    types.resize(numTypes);
+    for (uint32_t i = 0; i < numTypes; i++)
+    {
+        KeyType& type = types[i];
+        type.fClassType = s->ReadLE16();
+        s->ReadLE32(); // List length, we recompute it on write
+        s->ReadByte(); // Unused flags
+
+        uint32_t numKeys = s->ReadLE32();
+        type.fKeys.resize(numKeys);
+        for (uint32_t j = 0; j < numKeys; j++)
+        {
+            KeyEntry& key = type.fKeys[j];
+            key.fUoid.Read(s);
+            key.fStartPos = s->ReadLE32();
+            key.fDataLen = s->ReadLE32();
+            key.fUncompressedLen = compressed ? s->ReadLE32() : 0;
+        }
+
+        if (s->AtEnd() && i + 1 < numTypes)
+            return false;
+    }
+    return true;
+}
+
+static void IWriteIndex(hsStream* s, const std::vector<KeyType>& types, bool compressed)
+{
+    s->WriteLE32(uint32_t(types.size()));
+    for (size_t i = 0; i < types.size(); i++)
+    {
+        const KeyType& type = types[i];
+        s->WriteLE16(type.fClassType);
+
+        // Same layout plRegistryKeyList::Write uses
+        uint32_t beginPos = s->GetPosition();
+        s->WriteLE32(0);
+        s->WriteByte(0);
+        s->WriteLE32(uint32_t(type.fKeys.size()));
+        for (size_t j = 0; j < type.fKeys.size(); j++)
+        {
+            const KeyEntry& key = type.fKeys[j];
+            key.fUoid.Write(s);
+            s->WriteLE32(key.fStartPos);
+            s->WriteLE32(key.fDataLen);
+            if (compressed)
+                s->WriteLE32(key.fUncompressedLen);
+        }
+
+        uint32_t endPos = s->GetPosition();
+        s->SetPosition(beginPos);
+        s->WriteLE32(endPos - beginPos - sizeof(uint32_t));
+        s->SetPosition(endPos);
+    }
+}
+
+bool plPageCompressor::Convert(const plFileName& srcPage, const plFileName& dstPage, bool compress, Stats* stats)
+{
+    hsUNIXStream src;
+    if (!src.Open(srcPage, "rb"))
+        return false;
+
+    plPageInfo info;
+    info.Read(&src);
+    if (!info.IsValid())
+        return false;
+
+    std::vector<KeyType> types;
+    src.SetPosition(info.GetIndexStart());
+    if (!IReadIndex(&src, types, info.IsCompressed()))
+        return false;
+
+    std::vector<plReadAheadRange> readAhead;
+    plRegistryPageNode::ReadReadAhead(&src, readAhead);
+
+    // Write the objects out in the order they're in now, so we don't undo
+    // whatever plPageOptimizer did
+    std::vector<KeyEntry*> objects;
+    for (size_t i = 0; i < types.size(); i++)
+    {
+        for (size_t j = 0; j < types[i].fKeys.size(); j++)
+            objects.push_back(&types[i].fKeys[j]);
+    }
+    std::sort(objects.begin(), objects.end(),
+        [](const KeyEntry* a, const KeyEntry* b) { return a->fStartPos < b->fStartPos; });
+
+    hsUNIXStream dst;
+    if (!dst.Open(dstPage, "wb"))
+        return false;
+
+    if (compress)
+        info.SetFlags(info.GetFlags() | plPageInfo::kCompressedObjects);
+    else
+        info.SetFlags(info.GetFlags() & ~plPageInfo::kCompressedObjects);
+
+    // Placeholder header, rewritten with the final offsets at the end
+    info.Write(&dst);
+    info.SetDataStart(dst.GetPosition());
+
+    plLZ4Compress codec;
+    std::vector<uint8_t> stored, raw, packed;
+    std::vector<ObjectMove> moves;
+    moves.reserve(objects.size());
+
+    Stats localStats;
+    bool ok = true;
+    for (size_t i = 0; i < objects.size() && ok; i++)
+    {
+        KeyEntry& key = *objects[i];
+
+        stored.resize(key.fDataLen);
+        src.SetPosition(key.fStartPos);
+        if (src.Read(key.fDataLen, stored.data()) != key.fDataLen)
+        {
+            ok = false;
+            break;
+        }
+
+        // Get the raw object back, if it was compressed
+        const uint8_t* rawData = stored.data();
+        uint32_t rawLen = key.fDataLen;
+        if (key.fUncompressedLen != 0)
+        {
+            raw.resize(key.fUncompressedLen);
+            rawLen = key.fUncompressedLen;
+            if (!codec.Uncompress(raw.data(), &rawLen, stored.data(), key.fDataLen) || rawLen != key.fUncompressedLen)
+            {
+                ok = false;
+                break;
+            }
+            rawData = raw.data();
+        }
+
+        const uint8_t* outData = rawData;
+        uint32_t outLen = rawLen;
+        key.fUncompressedLen = 0;
+        if (compress && rawLen > 0)
+        {
+            packed.resize(codec.GetMaxCompressedSize(rawLen));
+            uint32_t packedLen = uint32_t(packed.size());
+            if (codec.Compress(packed.data(), &packedLen, rawData, rawLen) && packedLen < rawLen)
+            {
+                outData = packed.data();
+                outLen = packedLen;
+                key.fUncompressedLen = rawLen;
+                localStats.fNumCompressed++;
+            }
+        }
+
+        ObjectMove move;
+        move.fOldStart = key.fStartPos;
+        move.fOldEnd = key.fStartPos + key.fDataLen;
+        move.fNewStart = dst.GetPosition();
+        move.fNewEnd = move.fNewStart + outLen;
+        moves.push_back(move);
+
+        key.fStartPos = move.fNewStart;
+        key.fDataLen = outLen;
+        dst.Write(outLen, outData);
+
+        localStats.fNumObjects++;
+        localStats.fRawSize += rawLen;
+        localStats.fStoredSize += outLen;
+    }
+
+    if (ok)
+    {
+        info.SetIndexStart(dst.GetPosition());
+        IWriteIndex(&dst, types, compress);
+
+        // Map each read-ahead range onto the objects it covered
+        std::vector<plReadAheadRange> newReadAhead;
+        for (size_t i = 0; i < readAhead.size(); i++)
+        {
+            uint32_t rangeEnd = readAhead[i].fStart + readAhead[i].fLength;
+            std::vector<ObjectMove>::const_iterator first = std::lower_bound(moves.begin(), moves.end(), readAhead[i].fStart,
+                [](const ObjectMove& m, uint32_t pos) { return m.fOldStart < pos; });
+            std::vector<ObjectMove>::const_iterator last = std::lower_bound(first, moves.cend(), rangeEnd,
+                [](const ObjectMove& m, uint32_t pos) { return m.fOldEnd <= pos; });
+            if (first == last)
+                continue;
+
+            plReadAheadRange range;
+            range.fStart = first->fNewStart;
+            range.fLength = (last - 1)->fNewEnd - first->fNewStart;
+            newReadAhead.push_back(range);
+        }
+        if (!newReadAhead.empty())
+            plRegistryPageNode::WriteReadAhead(&dst, newReadAhead);
+
+        info.SetChecksum(dst.GetPosition() - info.GetDataStart());
+        dst.Rewind();
+        info.Write(&dst);
+    }
+
+    dst.Close();
+    src.Close();
+
+    if (stats)
+        *stats = localStats;
+    return ok;
+}
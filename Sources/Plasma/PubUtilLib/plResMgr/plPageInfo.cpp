@@ -45,7 +45,10 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnKeyedObject/plUoid.h"
 #include "plVersion.h"
 
-static uint32_t       sCurrPageInfoVersion = 6;
+static uint32_t       sCurrPageInfoVersion = 7;
+// Pages without any flags are still written as version 6, so they stay
+// readable by older clients
+static uint32_t       sUnflaggedPageInfoVersion = 6;
 
 //// Constructor/Destructor //////////////////////////////////////////////////
 plPageInfo::plPageInfo()
@@ -67,6 +70,7 @@ void plPageInfo::IInit()
     fClassVersions.clear();
     fChecksum = 0;
     fDataStart = fIndexStart = 0;
+    fFlags = 0;
 }
 
 plPageInfo::~plPageInfo()
@@ -96,6 +100,7 @@ void    plPageInfo::ISetFrom( const plPageInfo &src )
     fChecksum = src.fChecksum;
     fDataStart = src.fDataStart;
     fIndexStart = src.fIndexStart;
+    fFlags = src.fFlags;
 }
 
 void    plPageInfo::SetStrings(const ST::string& age, const ST::string& page)
@@ -167,11 +172,14 @@ void plPageInfo::Read( hsStream *s )
             fClassVersions.push_back(cv);
         }
     }
+
+    if (version >= 7)
+        s->ReadLE( &fFlags );
 }
 
 void    plPageInfo::Write( hsStream *s )
 {
-    s->WriteLE32( sCurrPageInfoVersion );
+    s->WriteLE32( fFlags != 0 ? sCurrPageInfoVersion : sUnflaggedPageInfoVersion );
     fLocation.Write( s );
     s->WriteSafeString( fAge );
     s->WriteSafeString( fPage );
@@ -187,6 +195,8 @@ void    plPageInfo::Write( hsStream *s )
         s->WriteLE16(cv.Class);
         s->WriteLE16(cv.Version);
     }
+    if (fFlags != 0)
+        s->WriteLE( fFlags );
 }
 
 //// IsValid /////////////////////////////////////////////////////////////////
@@ -57,6 +57,11 @@ class plLocation;
 class plPageInfo
 {
 public:
+    enum
+    {
+        kCompressedObjects = 0x1,   // Object data is compressed individually, see plRegistryKeyList
+    };
+
     struct ClassVersion { uint16_t Class; uint16_t Version; };
     typedef std::vector<ClassVersion> ClassVerVec;
 
@@ -68,6 +73,7 @@ protected:
     ClassVerVec fClassVersions;
     uint32_t    fChecksum;
     uint32_t    fDataStart, fIndexStart;
+    uint32_t    fFlags;
 
     void        IInit( void );
     void        ISetFrom( const plPageInfo &src );
@@ -109,5 +115,10 @@ public:
 
     uint32_t  GetIndexStart( void ) const { return fIndexStart; }
     void    SetIndexStart( uint32_t s ) { fIndexStart = s; }
+
+    // Pages with any flags set are written as version 7, which older clients reject
+    uint32_t  GetFlags() const { return fFlags; }
+    void    SetFlags( uint32_t f ) { fFlags = f; }
+    bool    IsCompressed() const { return (fFlags & kCompressedObjects) != 0; }
 };
 #endif // _plPageInfo_h
@@ -0,0 +1,362 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include "HeadSpin.h"
+#include "plPagePrefetcher.h"
+#include "plRegistryNode.h"
+#include "hsLockGuard.h"
+#include "hsStream.h"
+#include "hsWorkerPool.h"
+#include "plProfile.h"
+
+#include <algorithm>
+#include <chrono>
+
+plProfile_CreateCounterNoReset("Page Prefetches Pending", "Memory", PagePrefetchesPending);
+plProfile_CreateMemCounter("Page Prefetch Data", "Memory", PagePrefetchData);
+
+typedef std::chrono::steady_clock plPrefetchClock;
+
+//// plPagePrefetchJob ////////////////////////////////////////////////////////
+//  One page file.  The worker only touches fPath, fData, fMillis and fState.
+
+struct plPagePrefetchJob
+{
+    enum State
+    {
+        kQueued,
+        kReading,
+        kDone
+    };
+
+    plRegistryPageNode* fPage;
+    plFileName  fPath;
+    std::vector<uint8_t>    fData;      // Empty if the read failed or was skipped
+    bool        fShared;
+    float       fMillis;
+    State       fState;
+
+    plPagePrefetchJob(plRegistryPageNode* page, bool shared)
+        : fPage(page), fPath(page->GetPagePath()), fShared(shared),
+          fMillis(0), fState(kQueued)
+    { }
+};
+
+//// Instance /////////////////////////////////////////////////////////////////
+
+plPagePrefetcher& plPagePrefetcher::Instance()
+{
+    static plPagePrefetcher theInstance;
+    return theInstance;
+}
+
+plPagePrefetcher::plPagePrefetcher()
+:   fEnabled(true),
+    fNumPrefetched(0),
+    fNumMissed(0),
+    fBytesResident(0),
+    fWaitTime(0),
+    fReadTime(0),
+    fReading(false)
+{
+}
+
+plPagePrefetcher::~plPagePrefetcher()
+{
+    Shutdown();
+}
+
+void plPagePrefetcher::SetEnabled(bool on)
+{
+    if (!on)
+    {
+        while (!fJobs.empty())
+            Cancel(fJobs.back()->fPage);
+        IReleaseShared();
+    }
+    fEnabled = on;
+}
+
+void plPagePrefetcher::Shutdown()
+{
+    SetEnabled(false);
+}
+
+//// Worker ///////////////////////////////////////////////////////////////////
+//  Runs as a task on the worker pool.  Only one at a time, so the pages come
+//  off the disk in the order they were queued.
+
+void plPagePrefetcher::IWork()
+{
+    for (;;)
+    {
+        plPagePrefetchJob* job;
+        {
+            hsLockGuard(fMutex);
+            if (fQueue.empty())
+            {
+                fReading = false;
+                return;
+            }
+            job = fQueue.front();
+            fQueue.pop_front();
+            job->fState = plPagePrefetchJob::kReading;
+        }
+
+        IRead(job);
+
+        {
+            hsLockGuard(fMutex);
+            job->fState = plPagePrefetchJob::kDone;
+        }
+        fDoneCondition.notify_all();
+    }
+}
+
+void plPagePrefetcher::IRead(plPagePrefetchJob* job)
+{
+    plPrefetchClock::time_point start = plPrefetchClock::now();
+
+    hsUNIXStream s;
+    if (s.Open(job->fPath, "rb"))
+    {
+        uint64_t size = s.GetEOF();
+        if (size > 0 && size <= kMaxPageSize)
+        {
+            job->fData.resize(size);
+            if (s.Read(size, job->fData.data()) != size)
+                job->fData.clear();
+        }
+        s.Close();
+    }
+
+    job->fMillis = std::chrono::duration<float, std::milli>(plPrefetchClock::now() - start).count();
+}
+
+//// Queueing /////////////////////////////////////////////////////////////////
+
+plPagePrefetchJob* plPagePrefetcher::IFindJob(const plRegistryPageNode* page) const
+{
+    for (plPagePrefetchJob* job : fJobs)
+    {
+        if (job->fPage == page)
+            return job;
+    }
+    return nil;
+}
+
+bool plPagePrefetcher::Prefetch(plRegistryPageNode* page, bool shared)
+{
+    if (!fEnabled || !page || page->HasPageData() || IFindJob(page))
+        return false;
+
+    plPagePrefetchJob* job = new plPagePrefetchJob(page, shared);
+    fJobs.push_back(job);
+    bool startReading;
+    {
+        hsLockGuard(fMutex);
+
+        // Every room reads from the shared pages, so get them in first
+        auto it = fQueue.end();
+        if (shared)
+        {
+            it = std::find_if(fQueue.begin(), fQueue.end(),
+                              [](const plPagePrefetchJob* queued) { return !queued->fShared; });
+        }
+        fQueue.insert(it, job);
+
+        startReading = !fReading;
+        fReading = true;
+    }
+
+    // With no pool threads to read on, the jobs wait for Flush() or Claim()
+    if (startReading && !hsWorkerPool::Instance().Queue([this]() { IWork(); }))
+    {
+        hsLockGuard(fMutex);
+        fReading = false;
+    }
+    return true;
+}
+
+bool plPagePrefetcher::IWait(plPagePrefetchJob* job, bool cancel)
+{
+    std::unique_lock<std::mutex> lock(fMutex);
+    if (job->fState == plPagePrefetchJob::kQueued)
+    {
+        fQueue.erase(std::find(fQueue.begin(), fQueue.end(), job));
+        if (cancel)
+        {
+            // Reading it now would only race the worker for the disk, so let
+            // the page go to its file as usual
+            job->fState = plPagePrefetchJob::kDone;
+            return false;
+        }
+
+        // Nobody has started on it, so read it here rather than wait behind
+        // the rest of the queue
+        job->fState = plPagePrefetchJob::kReading;
+        lock.unlock();
+        IRead(job);
+        lock.lock();
+        job->fState = plPagePrefetchJob::kDone;
+    }
+    else if (job->fState != plPagePrefetchJob::kDone)
+    {
+        plPrefetchClock::time_point start = plPrefetchClock::now();
+        fDoneCondition.wait(lock, [job]() { return job->fState == plPagePrefetchJob::kDone; });
+        fWaitTime += std::chrono::duration<float, std::milli>(plPrefetchClock::now() - start).count();
+    }
+    return true;
+}
+
+void plPagePrefetcher::IRetire(plPagePrefetchJob* job, bool adopt)
+{
+    auto it = std::find(fJobs.begin(), fJobs.end(), job);
+    *it = fJobs.back();
+    fJobs.pop_back();
+
+    fReadTime += job->fMillis;
+    if (adopt && !job->fData.empty() && job->fPage->AdoptPageData(job->fData))
+    {
+        fNumPrefetched++;
+        fBytesResident += job->fPage->GetPageDataSize();
+        if (job->fShared)
+            fShared.push_back(job->fPage);
+    }
+    delete job;
+}
+
+//// Page-in //////////////////////////////////////////////////////////////////
+
+bool plPagePrefetcher::Claim(plRegistryPageNode* page)
+{
+    plPagePrefetchJob* job = IFindJob(page);
+    if (job)
+    {
+        if (!IWait(job, true))
+            fNumMissed++;
+        IRetire(job, true);
+    }
+
+    // The worker reads shared pages first, so by now they're in too
+    IAdoptShared();
+    return page->HasPageData();
+}
+
+void plPagePrefetcher::Flush()
+{
+    for (plPagePrefetchJob* job : fJobs)
+        IWait(job, false);
+}
+
+void plPagePrefetcher::Release(plRegistryPageNode* page)
+{
+    if (!page->HasPageData() || std::find(fShared.begin(), fShared.end(), page) != fShared.end())
+        return;
+
+    fBytesResident -= page->GetPageDataSize();
+    page->ReleasePageData();
+}
+
+void plPagePrefetcher::ReleaseShared()
+{
+    // A shared page still on its way is no use to anyone now
+    std::vector<plPagePrefetchJob*> jobs = fJobs;
+    for (plPagePrefetchJob* job : jobs)
+    {
+        if (job->fShared)
+            Cancel(job->fPage);
+    }
+    IReleaseShared();
+}
+
+void plPagePrefetcher::IReleaseShared()
+{
+    for (plRegistryPageNode* page : fShared)
+    {
+        fBytesResident -= page->GetPageDataSize();
+        page->ReleasePageData();
+    }
+    fShared.clear();
+}
+
+void plPagePrefetcher::Cancel(plRegistryPageNode* page)
+{
+    plPagePrefetchJob* job = IFindJob(page);
+    if (job)
+    {
+        IWait(job, true);
+        IRetire(job, false);
+    }
+
+    auto it = std::find(fShared.begin(), fShared.end(), page);
+    if (it != fShared.end())
+    {
+        fBytesResident -= page->GetPageDataSize();
+        page->ReleasePageData();
+        fShared.erase(it);
+    }
+}
+
+void plPagePrefetcher::IAdoptShared()
+{
+    // Shared pages are read from by other rooms' objects, not paged in
+    // themselves, so nobody would Claim() them
+    std::vector<plPagePrefetchJob*> done;
+    {
+        hsLockGuard(fMutex);
+        for (plPagePrefetchJob* job : fJobs)
+        {
+            if (job->fShared && job->fState == plPagePrefetchJob::kDone)
+                done.push_back(job);
+        }
+    }
+    for (plPagePrefetchJob* job : done)
+        IRetire(job, true);
+}
+
+void plPagePrefetcher::Update()
+{
+    IAdoptShared();
+
+    plProfile_Set(PagePrefetchesPending, fJobs.size());
+    plProfile_Set(PagePrefetchData, fBytesResident);
+}
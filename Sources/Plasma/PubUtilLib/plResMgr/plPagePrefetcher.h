@@ -0,0 +1,146 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#ifndef plPagePrefetcher_inc
+#define plPagePrefetcher_inc
+
+#include "HeadSpin.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class plRegistryPageNode;
+struct plPagePrefetchJob;
+
+//// plPagePrefetcher /////////////////////////////////////////////////////////
+//  Reads whole page files into memory on hsWorkerPool, so the rooms
+//  queued behind the one being paged in are off the disk by the time their
+//  turn comes.  The main thread still does everything else: it hands each
+//  finished read to its page node, which then serves its key index and
+//  objects out of memory instead of the file.
+//
+//  Shared pages (an age's Textures and BuiltIn pages, which every room reads
+//  from) jump the queue and stay in memory until ReleaseShared(); room pages
+//  are let go as soon as they've been paged in.
+
+class plPagePrefetcher
+{
+public:
+    enum
+    {
+        kMaxRoomsInFlight = 3,                  // Rooms read ahead of the one paging in
+        kMaxPageSize = 64 * 1024 * 1024,        // Bigger pages are left to the file
+    };
+
+    static plPagePrefetcher& Instance();
+
+    // On by default.  Turning it off lets go of anything already read.
+    void    SetEnabled(bool on);
+    bool    IsEnabled() const { return fEnabled; }
+
+    // Queues the page to be read in.  Returns false if it won't be.
+    bool    Prefetch(plRegistryPageNode* page, bool shared = false);
+
+    // Call before paging in.  Waits for a read in progress, cancels one that
+    // hasn't started, and gives the page its data.  Returns true if the page
+    // now reads from memory.
+    bool    Claim(plRegistryPageNode* page);
+
+    // Waits for everything queued so far to be read, reading what nobody
+    // has started on itself
+    void    Flush();
+
+    // Call after paging in.  Frees the page's data unless it's shared.
+    void    Release(plRegistryPageNode* page);
+
+    // Frees the shared pages' data, once a batch of rooms is done
+    void    ReleaseShared();
+
+    // Forgets about a page that's going away
+    void    Cancel(plRegistryPageNode* page);
+
+    // Once per frame on the main thread.  Hands finished shared pages over.
+    void    Update();
+
+    // Drops everything
+    void    Shutdown();
+
+    // Stats
+    uint32_t    GetNumPending() const { return fJobs.size(); }
+    uint32_t    GetNumPrefetched() const { return fNumPrefetched; }
+    uint32_t    GetNumMissed() const { return fNumMissed; }
+    uint32_t    GetBytesResident() const { return fBytesResident; }
+    float       GetWaitTime() const { return fWaitTime; }       // ms the main thread waited
+    float       GetReadTime() const { return fReadTime; }       // ms spent reading
+
+protected:
+    plPagePrefetcher();
+    virtual ~plPagePrefetcher();
+
+    bool    fEnabled;
+
+    std::vector<plPagePrefetchJob*>     fJobs;      // Every job not yet retired, main thread only
+    std::vector<plRegistryPageNode*>    fShared;    // Shared pages holding data
+
+    uint32_t    fNumPrefetched;
+    uint32_t    fNumMissed;
+    uint32_t    fBytesResident;
+    float       fWaitTime;
+    float       fReadTime;
+
+    // Shared with the worker
+    std::mutex      fMutex;
+    std::condition_variable fDoneCondition;
+    std::deque<plPagePrefetchJob*>  fQueue;         // Not started yet
+    bool            fReading;       // A pool task is working through fQueue
+
+    plPagePrefetchJob*  IFindJob(const plRegistryPageNode* page) const;
+    bool    IWait(plPagePrefetchJob* job, bool cancel);    // False if it was cancelled instead
+    void    IRetire(plPagePrefetchJob* job, bool adopt);
+    void    IAdoptShared();
+    void    IReleaseShared();
+    void    IWork();
+    static void IRead(plPagePrefetchJob* job);
+};
+
+#endif // plPagePrefetcher_inc
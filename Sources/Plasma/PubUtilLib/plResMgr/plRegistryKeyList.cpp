@@ -190,7 +190,7 @@ bool plRegistryKeyList::SetKeyUnused(plKeyImp* key, LoadStatus& loadStatusChange
     return foundKey != nullptr;
 }
 
-void plRegistryKeyList::Read(hsStream* s)
+void plRegistryKeyList::Read(hsStream* s, bool compressed)
 {
     uint32_t keyListLen = s->ReadLE32();
     if (!fKeys.empty())
@@ -199,8 +199,8 @@ void plRegistryKeyList::Read(hsStream* s)
         return;
     }
 
-    // deprecated flags. used to indicate alphabetically sorted keys for some "optimization"
-    // that really appeared to do nothing. no loss.
+    // Skip the flags. These used to indicate alphabetically sorted keys for some "optimization"
+    // that really appeared to do nothing.  Old pages may still have them set.
     s->ReadByte();
 
     uint32_t numKeys = s->ReadLE32();
@@ -209,7 +209,7 @@ void plRegistryKeyList::Read(hsStream* s)
     for (uint32_t i = 0; i < numKeys; ++i)
     {
         plKeyImp* newKey = new plKeyImp;
-        newKey->Read(s);
+        newKey->Read(s, compressed);
 
         uint32_t id = newKey->GetUoid().GetObjectID();
         if (fKeys.size() < id)
@@ -224,7 +224,7 @@ void plRegistryKeyList::Write(hsStream* s)
     // Save space for the length of our data
     uint32_t beginPos = s->GetPosition();
     s->WriteLE32(0);
-    s->WriteByte(0); // Deprecated flags
+    s->WriteByte(0); // Flags, unused
 
     // We only write out keys with data. Fill this value in later...
     uint32_t countPos = s->GetPosition();
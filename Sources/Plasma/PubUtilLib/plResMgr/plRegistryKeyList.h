@@ -93,7 +93,9 @@ public:
     void SetKeyUsed(plKeyImp* key) { ++fReffedKeys; }
     bool SetKeyUnused(plKeyImp* key, LoadStatus& loadStatusChange);
 
-    void Read(hsStream* s);
+    // Keys in pages with plPageInfo::kCompressedObjects set carry an
+    // uncompressed length after the data length
+    void Read(hsStream* s, bool compressed);
     void Write(hsStream* s);
 };
 
@@ -49,12 +49,23 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plVersion.h"
 
+#include <algorithm>
+
+// Tag in front of the read-ahead table that optimized pages append after the
+// key index.  Older pages just end after the index.
+static const uint32_t kReadAheadTag = 0x44484152; // 'RAHD'
+// Most we'll prefetch in one go, no matter how long the range is
+static const uint32_t kMaxReadAhead = 512 * 1024;
+
+bool plRegistryPageNode::fReadAheadEnabled = true;
+
 plRegistryPageNode::plRegistryPageNode(const plFileName& path)
     : fValid(kPageCorrupt)
     , fPath(path)
     , fLoadedTypes(0)
     , fOpenRequests(0)
     , fIsNewPage(false)
+    , fDropPageData(false)
 {
     hsStream* stream = OpenStream();
     if (stream)
@@ -72,6 +83,7 @@ plRegistryPageNode::plRegistryPageNode(const plLocation& location, const ST::str
     , fLoadedTypes(0)
     , fOpenRequests(0)
     , fIsNewPage(true)
+    , fDropPageData(false)
 {
     fPageInfo.SetStrings(age, page);
 
@@ -123,6 +135,18 @@ PageCond plRegistryPageNode::IVerify()
 
 hsStream* plRegistryPageNode::OpenStream()
 {
+    if (!fPageData.empty())
+    {
+        if (fOpenRequests == 0)
+        {
+            fDataStream.Init(fPageData.size(), fPageData.data());
+            fDataStream.SetFileName(fPath);
+            fDataStream.Rewind();
+        }
+        fOpenRequests++;
+        return &fDataStream;
+    }
+
     if (fOpenRequests == 0)
     {
         if (!fStream.Open(fPath, "rb"))
@@ -137,8 +161,103 @@ void plRegistryPageNode::CloseStream()
     if (fOpenRequests > 0)
         fOpenRequests--;
 
-    if (fOpenRequests == 0)
+    if (fOpenRequests == 0 && !fPageData.empty())
+    {
+        if (fDropPageData)
+            ReleasePageData();
+    }
+    else if (fOpenRequests == 0)
+    {
         fStream.Close();
+
+        // Read-ahead may have grown the buffer, don't hang on to it
+        if (fStream.GetBufferSize() > hsBufferedStream::GetDefaultBufferSize())
+            fStream.SetBufferSize(hsBufferedStream::GetDefaultBufferSize());
+    }
+}
+
+bool plRegistryPageNode::AdoptPageData(std::vector<uint8_t>& data)
+{
+    if (fOpenRequests > 0 || !fPageData.empty())
+        return false;
+
+    fPageData.swap(data);
+    fDropPageData = false;
+    return true;
+}
+
+void plRegistryPageNode::ReleasePageData()
+{
+    // Don't pull the data out from under a reader, wait for CloseStream
+    if (fOpenRequests > 0)
+    {
+        fDropPageData = true;
+        return;
+    }
+
+    std::vector<uint8_t>().swap(fPageData);
+    fDropPageData = false;
+}
+
+void plRegistryPageNode::ReadAhead(uint32_t startPos)
+{
+    // Nothing to read ahead of if the whole page is in memory
+    if (!fReadAheadEnabled || fReadAhead.empty() || fOpenRequests == 0 || !fPageData.empty())
+        return;
+
+    // Find the last range starting at or before startPos
+    ReadAheadVec::const_iterator it = std::upper_bound(fReadAhead.begin(), fReadAhead.end(), startPos,
+        [](uint32_t pos, const plReadAheadRange& range) { return pos < range.fStart; });
+    if (it == fReadAhead.begin())
+        return;
+    --it;
+
+    uint32_t rangeEnd = it->fStart + it->fLength;
+    if (startPos >= rangeEnd)
+        return;
+
+    uint32_t len = rangeEnd - startPos;
+    if (len > kMaxReadAhead)
+        len = kMaxReadAhead;
+    fStream.Prefetch(startPos, len);
+}
+
+bool plRegistryPageNode::ReadReadAhead(hsStream* s, std::vector<plReadAheadRange>& ranges)
+{
+    ranges.clear();
+
+    if (s->GetSizeLeft() < 2 * sizeof(uint32_t) || s->ReadLE32() != kReadAheadTag)
+        return false;
+
+    uint32_t numRanges = s->ReadLE32();
+    if (s->GetSizeLeft() < numRanges * 2 * sizeof(uint32_t))
+    {
+        hsAssert(0, "Truncated read-ahead table");
+        return false;
+    }
+
+    ranges.resize(numRanges);
+    for (uint32_t i = 0; i < numRanges; i++)
+    {
+        ranges[i].fStart = s->ReadLE32();
+        ranges[i].fLength = s->ReadLE32();
+    }
+    return true;
+}
+
+void plRegistryPageNode::WriteReadAhead(hsStream* s, const std::vector<plReadAheadRange>& ranges)
+{
+    std::vector<plReadAheadRange> sorted = ranges;
+    std::sort(sorted.begin(), sorted.end(),
+        [](const plReadAheadRange& a, const plReadAheadRange& b) { return a.fStart < b.fStart; });
+
+    s->WriteLE32(kReadAheadTag);
+    s->WriteLE32(uint32_t(sorted.size()));
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        s->WriteLE32(sorted[i].fStart);
+        s->WriteLE32(sorted[i].fLength);
+    }
 }
 
 void plRegistryPageNode::LoadKeys()
@@ -172,9 +291,12 @@ void plRegistryPageNode::LoadKeys()
             keyList = new plRegistryKeyList(classType);
             fKeyLists[classType] = keyList;
         }
-        keyList->Read(stream);
+        keyList->Read(stream, fPageInfo.IsCompressed());
     }
 
+    // Optimized pages have a read-ahead table after the keys
+    ReadReadAhead(stream, fReadAhead);
+
     stream->SetPosition(oldPos);
     CloseStream();
     fLoadedTypes = fKeyLists.size();
@@ -189,6 +311,7 @@ void plRegistryPageNode::UnloadKeys()
         delete keyList;
     }
     fKeyLists.clear();
+    fReadAhead.clear();
 
     fLoadedTypes = 0;
 }
@@ -47,6 +47,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plPageInfo.h"
 
 #include <map>
+#include <vector>
 
 class plRegistryKeyList;
 class hsStream;
@@ -61,6 +62,32 @@ enum PageCond
     kPageCorrupt,
 };
 
+//
+// A page file that was read into memory ahead of time.  It still reports the
+// page's path, so anything that goes back to the file later (mipmaps leaving
+// their top levels on disk) finds the same bytes at the same offsets.
+//
+class plPageDataStream : public hsReadOnlyStream
+{
+protected:
+    plFileName fPath;
+
+public:
+    void SetFileName(const plFileName& path) { fPath = path; }
+    plFileName GetFileName() const HS_OVERRIDE { return fPath; }
+};
+
+//
+// A span of object data that was read in one burst when the page was profiled.
+// Optimized pages store a table of these after the key index, and reading an
+// object that starts inside one prefetches the rest of it.
+//
+struct plReadAheadRange
+{
+    uint32_t fStart;
+    uint32_t fLength;
+};
+
 //
 // Represents one entire (age,page) location and contains all keys in that
 // location. Note: just because the node exists does not mean that the keys are loaded.
@@ -84,6 +111,15 @@ protected:
                                 // zero if it's closed)
     bool fIsNewPage;          // True if this page is new (not read off disk)
 
+    std::vector<uint8_t> fPageData; // The whole page file, if it was read in ahead of time
+    plPageDataStream fDataStream;   // Reads fPageData in place of fStream
+    bool fDropPageData;         // Free fPageData once the stream closes
+
+    typedef std::vector<plReadAheadRange> ReadAheadVec;
+    ReadAheadVec fReadAhead;    // Read-ahead table, sorted by start, loaded with the keys
+
+    static bool fReadAheadEnabled;
+
     plRegistryPageNode() {}
 
     plRegistryKeyList* IGetKeyList(uint16_t classType) const;
@@ -138,6 +174,27 @@ public:
     hsStream*   OpenStream();
     void        CloseStream();
 
+    // Prefetches the rest of the read-ahead range that startPos falls in, if
+    // there is one.  Call with the stream open.
+    void        ReadAhead(uint32_t startPos);
+    const std::vector<plReadAheadRange>& GetReadAhead() const { return fReadAhead; }
+
+    // Read-ahead table in the format LoadKeys expects after the key index.
+    // Reading returns false and leaves ranges empty if there isn't one.
+    static bool ReadReadAhead(hsStream* s, std::vector<plReadAheadRange>& ranges);
+    static void WriteReadAhead(hsStream* s, const std::vector<plReadAheadRange>& ranges);
+
+    // Takes the contents of the page file (see plPagePrefetcher), leaving data
+    // empty.  Until it's released, OpenStream reads from it instead of the
+    // file.  Fails if the stream is open.
+    bool        AdoptPageData(std::vector<uint8_t>& data);
+    void        ReleasePageData();
+    bool        HasPageData() const { return !fPageData.empty(); }
+    uint32_t    GetPageDataSize() const { return fPageData.size(); }
+
+    static void SetReadAheadEnabled(bool enabled) { fReadAheadEnabled = enabled; }
+    static bool GetReadAheadEnabled() { return fReadAheadEnabled; }
+
     // Takes care of everything involved in writing this page to disk
     void Write();
     void DeleteSource();
@@ -44,6 +44,9 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plResManagerHelper.h"
 #include "plResMgrSettings.h"
 #include "plLocalization.h"
+#include "plLoadTrace.h"
+#include "plPagePrefetcher.h"
+#include "plCompression/plLZ4Compress.h"
 #include "hsSTLStream.h"
 
 #include "hsTimer.h"
@@ -63,6 +66,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnNetCommon/plSynchedObject.h"
 #include "pnNetCommon/plNetApp.h"
 #include "plAgeDescription/plAgeDescription.h"
+#include "plGImage/plMipmapStreamer.h"
 
 bool gDataServerLocal = false;
 
@@ -103,6 +107,10 @@ plResManager::plResManager():
     fProgressProc(nil),
     fMyHelper(nil),
     fLogReadTimes(false),
+    fObjectCodec(nil),
+    fObjectBufferDepth(0),
+    fLoadTrace(nil),
+    fLoadTraceStart(0),
     fPageListLock(0),
     fPagesNeedCleanup(false),
     fLastFoundPage(nil)
@@ -177,8 +185,12 @@ void plResManager::IShutdown()
 
     kResMgrLog(1, ILog(1, "Shutting down resManager..."));
 
+    if (fLoadTrace)
+        StopLoadTrace();
+
     // Make sure we're not holding on to any ages for load optimization
     IDropAllAgeKeys();
+    plPagePrefetcher::Instance().Shutdown();
 
     // At this point, we may have an undelivered future time stamped message
     // in the Dispatch, which is reffing a bunch of keys we "temporarily" loaded.
@@ -226,6 +238,11 @@ void plResManager::IShutdown()
     hsRefCnt_SafeUnRef(fDispatch);
     fDispatch = nullptr;
 
+    delete fObjectCodec;
+    fObjectCodec = nil;
+    fCompressedBuffer.clear();
+    fObjectBuffers.clear();
+
     kResMgrLog(1, ILog(1, "   ...Shutdown successful!"));
 
     fInited = false;
@@ -256,6 +273,7 @@ void plResManager::RemoveSinglePage(const plFileName& path)
     {
         plLocation loc = node->GetPageInfo().GetLocation();
         fAllPages.erase(loc);
+        plPagePrefetcher::Instance().Cancel(node);
         delete node;
     }
 }
@@ -275,6 +293,28 @@ void plResManager::LogReadTimes(bool logReadTimes)
     }
 }
 
+void plResManager::StartLoadTrace(const plFileName& fileName)
+{
+    if (!fLoadTrace)
+        fLoadTrace = new plLoadTrace;
+    fLoadTrace->Clear();
+    fLoadTracePath = fileName;
+    fLoadTraceStart = hsTimer::GetTicks();
+}
+
+bool plResManager::StopLoadTrace()
+{
+    if (!fLoadTrace)
+        return false;
+
+    bool written = fLoadTrace->Write(fLoadTracePath);
+    kResMgrLog(1, ILog(1, "Wrote %d object reads to load trace %s", int(fLoadTrace->GetRecords().size()), fLoadTracePath.AsString().c_str()));
+
+    delete fLoadTrace;
+    fLoadTrace = nil;
+    return written;
+}
+
 hsKeyedObject* plResManager::IGetSharedObject(plKeyImp* pKey)
 {
     plKeyImp* origKey = (plKeyImp*)pKey->GetCloneOwner();
@@ -322,7 +362,12 @@ bool plResManager::ReadObject(plKeyImp* key)
         return false;
     }
     fReadingObject = true;
-    bool ret = IReadObject(key, pageNode->OpenStream());
+    hsStream* stream = pageNode->OpenStream();
+    // If the page was laid out from a load trace, pull in the rest of the
+    // objects that were read along with this one
+    if (stream && !key->GetUoid().IsClone())
+        pageNode->ReadAhead(key->GetStartPos());
+    bool ret = IReadObject(key, stream);
     fReadingObject = false;
 
     if (!fQueuedReads.empty())
@@ -414,7 +459,15 @@ bool plResManager::IReadObject(plKeyImp* pKey, hsStream *stream)
         stream->SetPosition(pKey->GetStartPos());
         kResMgrLog(4, ILog(4, "   ...Reading from position %d bytes...", pKey->GetStartPos()));
 
-        plCreatable* cre = ReadCreatable(stream);
+        if (fLoadTrace)
+            fLoadTrace->AddRecord(uoid, pKey->GetStartPos(), pKey->GetDataLen(),
+                                  hsTimer::GetSeconds<float>(hsTimer::GetTicks() - fLoadTraceStart));
+
+        plCreatable* cre;
+        if (pKey->GetUncompressedLen() != 0)
+            cre = IReadCompressedObject(pKey, stream);
+        else
+            cre = ReadCreatable(stream);
         hsAssert(cre, "Could not Create Object");
         if (cre)
         {   
@@ -466,6 +519,46 @@ bool plResManager::IReadObject(plKeyImp* pKey, hsStream *stream)
     return (ko != nil);
 }
 
+plCreatable* plResManager::IReadCompressedObject(plKeyImp* pKey, hsStream* stream)
+{
+    uint32_t dataLen = pKey->GetDataLen();
+    uint32_t rawLen = pKey->GetUncompressedLen();
+
+    // Decompress straight out of the stream's buffer if the whole object is in it
+    const uint8_t* data = (const uint8_t*)stream->ReadInPlace(dataLen);
+    if (!data)
+    {
+        fCompressedBuffer.resize(dataLen);
+        if (stream->Read(dataLen, fCompressedBuffer.data()) != dataLen)
+        {
+            kResMgrLog(3, ILog(3, "   ...ERROR: Compressed object is truncated!"));
+            return nil;
+        }
+        data = fCompressedBuffer.data();
+    }
+
+    if (!fObjectCodec)
+        fObjectCodec = new plLZ4Compress;
+
+    if (fObjectBufferDepth == fObjectBuffers.size())
+        fObjectBuffers.emplace_back();
+    std::vector<uint8_t>& buffer = fObjectBuffers[fObjectBufferDepth];
+    buffer.resize(rawLen);
+
+    uint32_t outLen = rawLen;
+    if (!fObjectCodec->Uncompress(buffer.data(), &outLen, data, dataLen) || outLen != rawLen)
+    {
+        kResMgrLog(3, ILog(3, "   ...ERROR: Unable to uncompress object!"));
+        return nil;
+    }
+
+    hsReadOnlyStream objStream(rawLen, buffer.data());
+    fObjectBufferDepth++;
+    plCreatable* cre = ReadCreatable(&objStream);
+    fObjectBufferDepth--;
+    return cre;
+}
+
 //// plPageOutIterator ///////////////////////////////////////////////////////
 //  See below function
 class plPageOutIterator : public plRegistryPageIterator
@@ -1170,7 +1263,9 @@ void plResManager::PageInRoom(const plLocation& page, uint16_t objClassToRef, pl
         return;
     }
 
-    // Step 0.9: Open the stream on this page, so it remains open for the entire loading process
+    // Step 0.9: Open the stream on this page, so it remains open for the entire loading process.
+    // If the page was prefetched, this reads from memory.
+    plPagePrefetcher::Instance().Claim(pageNode);
     pageNode->OpenStream();
 
     // Step 1: We force a load on all the keys in the given page
@@ -1192,6 +1287,7 @@ void plResManager::PageInRoom(const plLocation& page, uint16_t objClassToRef, pl
         // This is coming up a lot lately; too intrusive to be an assert.
         // hsAssert( false, "No object found on which to base our PageInRoom()" );
         pageNode->CloseStream();
+        plPagePrefetcher::Instance().Release(pageNode);
         return;
     }
 
@@ -1212,6 +1308,7 @@ void plResManager::PageInRoom(const plLocation& page, uint16_t objClassToRef, pl
 
     // Step 5.9: Close the page stream
     pageNode->CloseStream();
+    plPagePrefetcher::Instance().Release(pageNode);
 
     // All done!
     kResMgrLog(1, ILog(1, "...Page in complete!"));
@@ -1226,6 +1323,58 @@ void plResManager::PageInRoom(const plLocation& page, uint16_t objClassToRef, pl
     }
 }
 
+void plResManager::PrefetchRooms(const std::vector<plLocation>& pages)
+{
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+    if (!prefetcher.IsEnabled())
+        return;
+
+    // Mipmaps can only leave their top levels on disk when they're read
+    // straight from the page file, so the texture page stays on disk while
+    // the streamer is running
+    bool skipTextures = plMipmapStreamer::Instance().IsEnabled();
+
+    for (const plLocation& loc : pages)
+    {
+        plRegistryPageNode* pageNode = FindPage(loc);
+        if (!pageNode || !pageNode->IsValid())
+            continue;
+
+        // Every room reads its textures and such from the shared pages, so
+        // those go ahead of it
+        const ST::string& age = pageNode->GetPageInfo().GetAge();
+        bool isShared = false;
+        bool isTextures = false;
+        for (int i = 0; i < plAgeDescription::kNumCommonPages; i++)
+        {
+            const char* commonPage = plAgeDescription::GetCommonPage(i);
+            if (pageNode->GetPageInfo().GetPage().compare_i(commonPage) == 0)
+            {
+                isShared = true;
+                isTextures = (i == plAgeDescription::kTextures);
+            }
+
+            if (skipTextures && i == plAgeDescription::kTextures)
+                continue;
+
+            plRegistryPageNode* sharedNode = FindPage(age, commonPage);
+            if (sharedNode && sharedNode->IsValid())
+                prefetcher.Prefetch(sharedNode, true);
+        }
+
+        if (skipTextures && isTextures)
+            continue;
+
+        if (prefetcher.Prefetch(pageNode, isShared))
+            kResMgrLog(2, ILog(2, "Prefetching page %s>%s", age.c_str(), pageNode->GetPageInfo().GetPage().c_str()));
+    }
+}
+
+void plResManager::ReleasePrefetchedPages()
+{
+    plPagePrefetcher::Instance().ReleaseShared();
+}
+
 class plPageInAgeIter : public plRegistryPageIterator
 {
 private:
@@ -1535,7 +1684,7 @@ static void sIReportLeak(plKeyImp* key, plRegistryPageNode* page)
     class plKeyImpRef : public plKeyImp
     {
     public:
-        uint16_t GetRefCnt() const { return fRefCount; }
+        uint32_t GetRefCnt() const { return fRefCount; }
     };
 
     static bool alreadyDone = false;
@@ -46,6 +46,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include <set>
 #include <map>
 #include <vector>
+#include <deque>
 #include <string>
 #include "plFileSystem.h"
 
@@ -56,6 +57,8 @@ class plRegistryDataStream;
 class plResAgeHolder;
 class plResManagerHelper;
 class plDispatch;
+class plLoadTrace;
+class plLZ4Compress;
 
 // plProgressProc is a proc called every time an object loads, to keep a progress bar for
 // loading ages up-to-date.
@@ -139,6 +142,13 @@ public:
     void PageInRoom(const plLocation& page, uint16_t objClassToRef, plRefMsg* refMsg);
     void PageInAge(const ST::string& age);
 
+    // Starts reading the given rooms' pages into memory on a worker thread
+    // (see plPagePrefetcher), along with their ages' shared pages, so that
+    // PageInRoom doesn't have to wait on the disk for them.  The shared pages
+    // stay in memory until ReleasePrefetchedPages.
+    void PrefetchRooms(const std::vector<plLocation>& pages);
+    void ReleasePrefetchedPages();
+
     // Usually, a page file is kept open during load because the first keyed object
     // read causes all the other objects to be read before it returns.  In some
     // cases though (mostly just the texture file), this doesn't work.  In that
@@ -151,6 +161,12 @@ public:
     // Determines whether the time to read each object is dumped to a log
     void LogReadTimes(bool logReadTimes);
 
+    // Records every object read off disk (page, key, offset, length, time)
+    // until StopLoadTrace, which writes the trace out for plPageOptimizer.
+    void StartLoadTrace(const plFileName& fileName);
+    bool StopLoadTrace();
+    bool IsRecordingLoadTrace() const { return fLoadTrace != nil; }
+
     // All keys version
     bool IterateKeys(plRegistryKeyIterator* iterator);
     // Single page version
@@ -180,6 +196,7 @@ protected:
     virtual bool    IReadObject(plKeyImp* pKey, hsStream *stream);  
 
     plCreatable*    IReadCreatable(hsStream* s) const;
+    plCreatable*    IReadCompressedObject(plKeyImp* pKey, hsStream* stream);
     plKey           ICloneKey(const plUoid& objUoid, uint32_t playerID, uint32_t cloneID);
 
     virtual void    IKeyReffed(plKeyImp* key);
@@ -231,6 +248,17 @@ protected:
 
     bool    fLogReadTimes;
 
+    // For objects in compressed pages.  Objects can read other objects while
+    // they load, so each level of nesting gets its own uncompressed buffer.
+    plLZ4Compress*  fObjectCodec;
+    std::vector<uint8_t> fCompressedBuffer;
+    std::deque<std::vector<uint8_t>> fObjectBuffers;
+    uint32_t        fObjectBufferDepth;
+
+    plLoadTrace*    fLoadTrace;
+    plFileName      fLoadTracePath;
+    uint64_t        fLoadTraceStart;
+
     uint8_t fPageListLock;     // Number of locks on the page lists.  If it's greater than zero, they can't be modified
     bool    fPagesNeedCleanup; // True if something modified the page lists while they were locked.
 
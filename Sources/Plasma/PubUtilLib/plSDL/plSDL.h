@@ -57,6 +57,8 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 #include "plUnifiedTime/plUnifiedTime.h"
 
+class hsBitVector;
+
 namespace plSDL
 {
     typedef std::list<plStateDescriptor*> DescriptorList;   
@@ -101,8 +103,14 @@ namespace plSDL
     };
 
     extern const ST::string kAgeSDLObjectName;
+    extern const float kDeltaFloatQuantum;      // step size for delta encoded vector floats
     void VariableLengthRead(hsStream* s, int size, int* val);
     void VariableLengthWrite(hsStream* s, int size, int val);
+
+    // Which of 'size' items changed, for delta IO.  Written as a count, then either the
+    // changed indices or one bit per item, whichever is smaller.
+    bool ChangeMaskRead(hsStream* s, int size, hsBitVector* mask);
+    void ChangeMaskWrite(hsStream* s, int size, const hsBitVector& mask);
 };
 
 class plStateVarNotificationInfo
@@ -135,6 +143,8 @@ protected:
     uint32_t fFlags;
     plStateVarNotificationInfo fNotificationInfo;
 public:
+    HS_MEMTAG_NEW(kMemTagSDL);
+
     plStateVariable() : fFlags(0) {}
     virtual ~plStateVariable() {}
 
@@ -253,6 +263,11 @@ protected:
     bool IReadData(hsStream* s, float timeConvert, int idx, uint32_t readOptions);    
     bool IWriteData(hsStream* s, float timeConvert, int idx, uint32_t writeOptions) const;
 
+    bool IElementHasDelta(const plSimpleStateVariable* baseline, int idx) const;
+    bool IReadDeltaElement(hsStream* s, float timeConvert, int idx, uint32_t readOptions);
+    void IWriteDeltaElement(hsStream* s, plSimpleStateVariable* baseline, float timeConvert, int idx, uint32_t writeOptions) const;
+    void ICopyElement(const plSimpleStateVariable* other, int idx);
+
 public:
 
     plSimpleStateVariable() { IInit(); }        
@@ -267,6 +282,7 @@ public:
     void TimeStamp( const plUnifiedTime & ut=plUnifiedTime::GetCurrent() );
     void CopyFrom(plVarDescriptor* v);
     void CopyData(const plSimpleStateVariable* other, uint32_t writeOptions=0);
+    void CopyValues(const plSimpleStateVariable* other);    // just the data, no flags or timestamps
     bool SetFromString(const ST::string& value, int idx, bool timeStampNow);  // set value from string, type.  return false on err
     ST::string GetAsString(int idx) const;
     bool ConvertTo(plSimpleVarDescriptor* toVar, bool force=false);         // return false on err
@@ -324,6 +340,13 @@ public:
     // IO
     bool ReadData(hsStream* s, float timeConvert, uint32_t readOptions);  
     bool WriteData(hsStream* s, float timeConvert, uint32_t writeOptions) const;
+
+    // Delta IO.  WriteDeltaData writes how this differs from baseline, then updates baseline
+    // to exactly what the reader ends up with.  ReadDeltaData applies the delta to this var,
+    // which must hold the reader's copy of the same baseline.
+    bool HasDeltaFrom(const plSimpleStateVariable* baseline) const;
+    bool ReadDeltaData(hsStream* s, float timeConvert, uint32_t readOptions);
+    bool WriteDeltaData(hsStream* s, plSimpleStateVariable* baseline, float timeConvert, uint32_t writeOptions) const;
 };
 
 //
@@ -386,6 +409,11 @@ public:
     // IO
     bool ReadData(hsStream* s, float timeConvert, uint32_t readOptions);  
     bool WriteData(hsStream* s, float timeConvert, uint32_t writeOptions) const;
+
+    // Delta IO, see plSimpleStateVariable
+    bool HasDeltaFrom(const plSDStateVariable* baseline) const;
+    bool ReadDeltaData(hsStream* s, float timeConvert, uint32_t readOptions);
+    bool WriteDeltaData(hsStream* s, plSDStateVariable* baseline, float timeConvert, uint32_t writeOptions) const;
 };
 
 //
@@ -410,6 +438,7 @@ protected:
     VarsList    fSDVarsList;        // list of nested data records
     uint32_t    fFlags;
     static const uint8_t kIOVersion;  // I/O Version
+    static const uint8_t kDeltaIOVersion; // I/O Version of delta records, so plain Read rejects them
     
     void IDeleteVarsList(VarsList& vars);
     void IInitDescriptor(const ST::string& name, int version);    // or plSDL::kLatestVersion
@@ -430,6 +459,7 @@ protected:
 public:
     CLASSNAME_REGISTER( plStateDataRecord );
     GETINTERFACE_ANY( plStateDataRecord, plCreatable);
+    HS_MEMTAG_NEW(kMemTagSDL);
 
     plStateDataRecord(const ST::string& sdName, int version=plSDL::kLatestVersion);
     plStateDataRecord(plStateDescriptor* sd);
@@ -499,6 +529,13 @@ public:
     bool Read(hsStream* s, float timeConvert, uint32_t readOptions=0);
     void Write(hsStream* s, float timeConvert, uint32_t writeOptions=0) const;
 
+    // Delta IO.  Only vars that differ from baseline are written, as changes against it.
+    // Both ends keep their own copy of baseline, which these update to the new state.
+    // Like a dirty-only Read, ReadDelta only sets the changed vars in this record.
+    bool HasDeltaFrom(const plStateDataRecord* baseline) const;
+    bool ReadDelta(hsStream* s, plStateDataRecord* baseline, float timeConvert, uint32_t readOptions=0);
+    bool WriteDelta(hsStream* s, plStateDataRecord* baseline, float timeConvert, uint32_t writeOptions=0) const;
+
     static bool ReadStreamHeader(hsStream* s, ST::string* name, int* version, plUoid* objUoid=nil);
     void WriteStreamHeader(hsStream* s, plUoid* objUoid=nil) const;
 };
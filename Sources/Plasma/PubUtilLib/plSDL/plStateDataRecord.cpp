@@ -40,6 +40,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 
 *==LICENSE==*/
 #include <algorithm>
+#include "hsBitVector.h"
 #include "hsTimer.h"
 #include "hsTemplates.h"
 #include "hsStream.h"
@@ -49,9 +50,11 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "pnNetCommon/plNetApp.h"
 
 const ST::string plSDL::kAgeSDLObjectName = ST_LITERAL("AgeSDLHook");
+const float plSDL::kDeltaFloatQuantum = 1.f / 1024.f;
 
 // static 
 const uint8_t plStateDataRecord::kIOVersion=6;
+const uint8_t plStateDataRecord::kDeltaIOVersion=0x80|6;
 
 //
 // helper 
@@ -91,6 +94,91 @@ void plSDL::VariableLengthWrite(hsStream* s, int size, int val)
         s->WriteLE32(val);
 }
 
+//
+// helper
+//
+static int IChangeMaskIndexSize(int size)
+{
+    return (size < (1<<8)) ? 1 : (size < (1<<16)) ? 2 : 4;
+}
+
+bool plSDL::ChangeMaskRead(hsStream* s, int size, hsBitVector* mask)
+{
+    mask->Clear();
+
+    int num;
+    VariableLengthRead(s, size, &num);
+    if (num < 0 || num > size)
+        return false;
+
+    if (num == size)
+    {
+        // everything changed
+        for (int i = 0; i < size; i++)
+            mask->SetBit(i);
+    }
+    else if (num * IChangeMaskIndexSize(size) <= (size + 7) / 8)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            int idx;
+            VariableLengthRead(s, size, &idx);
+            if (idx < 0 || idx >= size)
+                return false;
+            mask->SetBit(idx);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < size; i += 8)
+        {
+            uint8_t bits = s->ReadByte();
+            for (int j = 0; j < 8 && i + j < size; j++)
+            {
+                if (bits & (1 << j))
+                    mask->SetBit(i + j);
+            }
+        }
+    }
+    return true;
+}
+
+void plSDL::ChangeMaskWrite(hsStream* s, int size, const hsBitVector& mask)
+{
+    int num = 0;
+    for (int i = 0; i < size; i++)
+    {
+        if (mask.IsBitSet(i))
+            num++;
+    }
+    VariableLengthWrite(s, size, num);
+
+    if (num == 0 || num == size)
+        return;     // the count says it all
+
+    if (num * IChangeMaskIndexSize(size) <= (size + 7) / 8)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            if (mask.IsBitSet(i))
+                VariableLengthWrite(s, size, i);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < size; i += 8)
+        {
+            uint8_t bits = 0;
+            for (int j = 0; j < 8 && i + j < size; j++)
+            {
+                if (mask.IsBitSet(i + j))
+                    bits |= (1 << j);
+            }
+            s->WriteByte(bits);
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 // State Data
 /////////////////////////////////////////////////////////////////////////////////
@@ -404,6 +492,141 @@ void plStateDataRecord::Write(hsStream* s, float timeConvert, uint32_t writeOpti
     }
 }
 
+//
+// true if WriteDelta would have anything to send
+//
+bool plStateDataRecord::HasDeltaFrom(const plStateDataRecord* baseline) const
+{
+    int i;
+    for (i = 0; i < fVarsList.size(); i++)
+    {
+        if (GetVar(i)->HasDeltaFrom(baseline->GetVar(i)))
+            return true;
+    }
+    for (i = 0; i < fSDVarsList.size(); i++)
+    {
+        if (GetSDVar(i)->HasDeltaFrom(baseline->GetSDVar(i)))
+            return true;
+    }
+    return false;
+}
+
+//
+// read the changes from baseline, applying them to it.  Changed vars are also copied
+// into this record, which must have the same descriptor.  Return true on success.
+//
+bool plStateDataRecord::ReadDelta(hsStream* s, plStateDataRecord* baseline, float timeConvert, uint32_t readOptions)
+{
+    fFlags = s->ReadLE16();
+    uint8_t ioVersion = s->ReadByte();
+    if (ioVersion != kDeltaIOVersion)
+        return false;
+
+    hsAssert(fDescriptor, "State Data Record has nil SDL descriptor");
+    hsAssert(baseline && baseline->GetDescriptor()==fDescriptor, "SDL delta baseline has a different descriptor");
+    if (!fDescriptor || !baseline || baseline->GetDescriptor() != fDescriptor)
+        return false;
+
+    bool setDirty = (readOptions & (plSDL::kKeepDirty | plSDL::kMakeDirty)) != 0;
+    bool timeStamp = (readOptions & plSDL::kTimeStampOnRead) && plSDLMgr::GetInstance()->AllowTimeStamping();
+
+    hsBitVector changed;
+    if (!plSDL::ChangeMaskRead(s, fVarsList.size(), &changed))
+        return false;
+
+    int i;
+    for (i = 0; i < fVarsList.size(); i++)
+    {
+        if (!changed.IsBitSet(i))
+            continue;
+
+        plSimpleStateVariable* baseVar = baseline->GetVar(i);
+        if (!baseVar->ReadDeltaData(s, timeConvert, readOptions))
+        {
+            if (plSDLMgr::GetInstance()->GetNetApp())
+                plSDLMgr::GetInstance()->GetNetApp()->ErrorMsg("Failed reading SDL delta, desc {}",
+                        fDescriptor->GetName());
+            return false;
+        }
+        GetVar(i)->CopyValues(baseVar);
+        GetVar(i)->SetUsed(true);
+        GetVar(i)->SetDirty(setDirty);
+        if (timeStamp)
+            GetVar(i)->TimeStamp();
+    }
+
+    if (!plSDL::ChangeMaskRead(s, fSDVarsList.size(), &changed))
+        return false;
+
+    for (i = 0; i < fSDVarsList.size(); i++)
+    {
+        if (!changed.IsBitSet(i))
+            continue;
+
+        plSDStateVariable* baseVar = baseline->GetSDVar(i);
+        if (!baseVar->ReadDeltaData(s, timeConvert, readOptions))
+        {
+            if (plSDLMgr::GetInstance()->GetNetApp())
+                plSDLMgr::GetInstance()->GetNetApp()->ErrorMsg("Failed reading nested SDL delta, desc {}",
+                        fDescriptor->GetName());
+            return false;
+        }
+        GetSDVar(i)->CopyFrom(baseVar);
+        GetSDVar(i)->SetDirty(setDirty);
+    }
+
+    baseline->SetFlags(fFlags);
+    return true;
+}
+
+//
+// write the vars which differ from baseline as changes against it, then bring
+// baseline up to date.  Returns false if baseline can't be used.
+//
+bool plStateDataRecord::WriteDelta(hsStream* s, plStateDataRecord* baseline, float timeConvert, uint32_t writeOptions) const
+{
+    hsAssert(baseline && baseline->GetDescriptor()==fDescriptor, "SDL delta baseline has a different descriptor");
+    if (!baseline || baseline->GetDescriptor() != fDescriptor)
+        return false;
+
+    s->WriteLE16((uint16_t)fFlags);
+    s->WriteByte(kDeltaIOVersion);
+
+    bool dirtyOnly = (writeOptions & plSDL::kDirtyOnly) != 0;
+
+    hsBitVector changed;
+    int i;
+    for (i = 0; i < fVarsList.size(); i++)
+    {
+        if ((!dirtyOnly || fVarsList[i]->IsDirty()) && GetVar(i)->HasDeltaFrom(baseline->GetVar(i)))
+            changed.SetBit(i);
+    }
+    plSDL::ChangeMaskWrite(s, fVarsList.size(), changed);
+
+    for (i = 0; i < fVarsList.size(); i++)
+    {
+        if (changed.IsBitSet(i))
+            GetVar(i)->WriteDeltaData(s, baseline->GetVar(i), timeConvert, writeOptions);
+    }
+
+    changed.Clear();
+    for (i = 0; i < fSDVarsList.size(); i++)
+    {
+        if ((!dirtyOnly || fSDVarsList[i]->IsDirty()) && GetSDVar(i)->HasDeltaFrom(baseline->GetSDVar(i)))
+            changed.SetBit(i);
+    }
+    plSDL::ChangeMaskWrite(s, fSDVarsList.size(), changed);
+
+    for (i = 0; i < fSDVarsList.size(); i++)
+    {
+        if (changed.IsBitSet(i))
+            GetSDVar(i)->WriteDeltaData(s, baseline->GetSDVar(i), timeConvert, writeOptions);
+    }
+
+    baseline->SetFlags(fFlags);
+    return true;
+}
+
 //
 // STATIC - read prefix header.  returns true on success 
 //
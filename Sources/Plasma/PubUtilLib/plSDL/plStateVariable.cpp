@@ -39,6 +39,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
       Mead, WA   99021
 
 *==LICENSE==*/
+#include "hsBitVector.h"
 #include "hsStream.h"
 #include "hsTimer.h"
 #include "plSDL.h"
@@ -2103,6 +2104,381 @@ void plSimpleStateVariable::CopyData(const plSimpleStateVariable* other, uint32_
     ReadData(&stream, 0, writeOptions);
 }
 
+//
+// Delta IO helpers.  Small deltas are written as zigzag varints.
+//
+static void IWriteVarUInt(hsStream* s, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        s->WriteByte((uint8_t)(val | 0x80));
+        val >>= 7;
+    }
+    s->WriteByte((uint8_t)val);
+}
+
+static uint32_t IReadVarUInt(hsStream* s)
+{
+    uint32_t val = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        uint8_t b = s->ReadByte();
+        val |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    return val;
+}
+
+static inline uint32_t IZigZag(int32_t val) { return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31); }
+static inline int32_t IUnZigZag(uint32_t val) { return (int32_t)(val >> 1) ^ -(int32_t)(val & 1); }
+
+// Vector floats (positions, rotations, colors) are sent as a number of quantum steps from
+// the baseline.  Both ends must compute the new value exactly the same way.
+static const int32_t kMaxFloatSteps = 1<<20;
+
+static inline bool IQuantizeFloat(float base, float val, int32_t* steps)
+{
+    if (!std::isfinite(base) || !std::isfinite(val))
+        return false;
+    float q = std::round((val - base) / plSDL::kDeltaFloatQuantum);
+    if (std::fabs(q) >= kMaxFloatSteps)
+        return false;
+    *steps = (int32_t)q;
+    return true;
+}
+
+static inline float IDequantizeFloat(float base, int32_t steps)
+{
+    return base + (float)steps * plSDL::kDeltaFloatQuantum;
+}
+
+static inline bool IIsQuantized(const plSimpleVarDescriptor& var)
+{
+    return var.GetAtomicType() == plVarDescriptor::kFloat && var.GetAtomicCount() > 1;
+}
+
+//
+// Copy one element's worth of atomics from other
+//
+void plSimpleStateVariable::ICopyElement(const plSimpleStateVariable* other, int idx)
+{
+    int j = idx*fVar.GetAtomicCount();
+    int i;
+    switch (fVar.GetAtomicType())
+    {
+    case plVarDescriptor::kInt:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fI[j+i] = other->fI[j+i];
+        break;
+    case plVarDescriptor::kShort:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fS[j+i] = other->fS[j+i];
+        break;
+    case plVarDescriptor::kByte:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fBy[j+i] = other->fBy[j+i];
+        break;
+    case plVarDescriptor::kFloat:
+    case plVarDescriptor::kAgeTimeOfDay:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fF[j+i] = other->fF[j+i];
+        break;
+    case plVarDescriptor::kDouble:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fD[j+i] = other->fD[j+i];
+        break;
+    case plVarDescriptor::kBool:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fB[j+i] = other->fB[j+i];
+        break;
+    default:
+        {
+            // times, keys, strings and creatables go through a stream
+            hsRAMStream stream;
+            other->IWriteData(&stream, 0, idx, 0);
+            stream.Rewind();
+            IReadData(&stream, 0, idx, 0);
+        }
+        break;
+    }
+}
+
+void plSimpleStateVariable::CopyValues(const plSimpleStateVariable* other)
+{
+    if (GetCount() != other->GetCount())
+    {
+        fVar.SetCount(other->GetCount());
+        Alloc();
+    }
+
+    int i;
+    for (i = 0; i < GetCount(); i++)
+        ICopyElement(other, i);
+}
+
+//
+// Would the element be written in a delta against baseline?
+//
+bool plSimpleStateVariable::IElementHasDelta(const plSimpleStateVariable* baseline, int idx) const
+{
+    int j = idx*fVar.GetAtomicCount();
+    int i;
+    switch (fVar.GetAtomicType())
+    {
+    case plVarDescriptor::kAgeTimeOfDay:
+        return false;       // computed on the fly
+    case plVarDescriptor::kInt:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fI[j+i] != baseline->fI[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kShort:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fS[j+i] != baseline->fS[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kByte:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fBy[j+i] != baseline->fBy[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kFloat:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+        {
+            if (IIsQuantized(fVar))
+            {
+                // changes of less than half a step never get sent
+                int32_t steps;
+                if (!IQuantizeFloat(baseline->fF[j+i], fF[j+i], &steps) || steps != 0)
+                    return true;
+            }
+            else if (memcmp(&fF[j+i], &baseline->fF[j+i], sizeof(float)))
+                return true;
+        }
+        return false;
+    case plVarDescriptor::kDouble:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (memcmp(&fD[j+i], &baseline->fD[j+i], sizeof(double)))
+                return true;
+        return false;
+    case plVarDescriptor::kBool:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fB[j+i] != baseline->fB[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kTime:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fT[j+i] != baseline->fT[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kKey:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (fU[j+i] != baseline->fU[j+i])
+                return true;
+        return false;
+    case plVarDescriptor::kString32:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            if (strncmp(fS32[j+i], baseline->fS32[j+i], sizeof(plVarDescriptor::String32)))
+                return true;
+        return false;
+    default:
+        {
+            // creatables are copies, compare what they write
+            hsRAMStream mine, theirs;
+            IWriteData(&mine, 0, idx, 0);
+            baseline->IWriteData(&theirs, 0, idx, 0);
+            if (mine.GetEOF() != theirs.GetEOF())
+                return true;
+            std::vector<uint8_t> mineBuf(mine.GetEOF()), theirBuf(theirs.GetEOF());
+            mine.CopyToMem(mineBuf.data());
+            theirs.CopyToMem(theirBuf.data());
+            return mineBuf != theirBuf;
+        }
+    }
+}
+
+bool plSimpleStateVariable::HasDeltaFrom(const plSimpleStateVariable* baseline) const
+{
+    if (!IsUsed())
+        return false;
+    if (!baseline->IsUsed() || GetCount() != baseline->GetCount())
+        return true;
+
+    int i;
+    for (i = 0; i < GetCount(); i++)
+    {
+        if (IElementHasDelta(baseline, i))
+            return true;
+    }
+    return false;
+}
+
+void plSimpleStateVariable::IWriteDeltaElement(hsStream* s, plSimpleStateVariable* baseline, float timeConvert, int idx, uint32_t writeOptions) const
+{
+    int j = idx*fVar.GetAtomicCount();
+    int i;
+    switch (fVar.GetAtomicType())
+    {
+    case plVarDescriptor::kInt:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            IWriteVarUInt(s, IZigZag((int32_t)((uint32_t)fI[j+i] - (uint32_t)baseline->fI[j+i])));
+        break;
+    case plVarDescriptor::kShort:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            IWriteVarUInt(s, IZigZag(fS[j+i] - baseline->fS[j+i]));
+        break;
+    case plVarDescriptor::kByte:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            IWriteVarUInt(s, IZigZag(fBy[j+i] - baseline->fBy[j+i]));
+        break;
+    case plVarDescriptor::kFloat:
+        if (IIsQuantized(fVar))
+        {
+            for (i = 0; i < fVar.GetAtomicCount(); i++)
+            {
+                // 0 means the full value follows, otherwise steps+1
+                int32_t steps;
+                if (IQuantizeFloat(baseline->fF[j+i], fF[j+i], &steps))
+                {
+                    IWriteVarUInt(s, IZigZag(steps) + 1);
+                    baseline->fF[j+i] = IDequantizeFloat(baseline->fF[j+i], steps);
+                }
+                else
+                {
+                    IWriteVarUInt(s, 0);
+                    s->WriteLEScalar(fF[j+i]);
+                    baseline->fF[j+i] = fF[j+i];
+                }
+            }
+            return;
+        }
+        IWriteData(s, timeConvert, idx, writeOptions);
+        break;
+    case plVarDescriptor::kBool:
+        // a changed bool can only have flipped
+        break;
+    default:
+        IWriteData(s, timeConvert, idx, writeOptions);
+        break;
+    }
+    baseline->ICopyElement(this, idx);
+}
+
+bool plSimpleStateVariable::IReadDeltaElement(hsStream* s, float timeConvert, int idx, uint32_t readOptions)
+{
+    int j = idx*fVar.GetAtomicCount();
+    int i;
+    switch (fVar.GetAtomicType())
+    {
+    case plVarDescriptor::kInt:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fI[j+i] = (int)((uint32_t)fI[j+i] + (uint32_t)IUnZigZag(IReadVarUInt(s)));
+        break;
+    case plVarDescriptor::kShort:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fS[j+i] = (short)(fS[j+i] + IUnZigZag(IReadVarUInt(s)));
+        break;
+    case plVarDescriptor::kByte:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fBy[j+i] = (uint8_t)(fBy[j+i] + IUnZigZag(IReadVarUInt(s)));
+        break;
+    case plVarDescriptor::kFloat:
+        if (IIsQuantized(fVar))
+        {
+            for (i = 0; i < fVar.GetAtomicCount(); i++)
+            {
+                uint32_t code = IReadVarUInt(s);
+                if (code)
+                    fF[j+i] = IDequantizeFloat(fF[j+i], IUnZigZag(code - 1));
+                else
+                    fF[j+i] = s->ReadLEScalar();
+            }
+            break;
+        }
+        return IReadData(s, timeConvert, idx, readOptions);
+    case plVarDescriptor::kBool:
+        for (i = 0; i < fVar.GetAtomicCount(); i++)
+            fB[j+i] = !fB[j+i];
+        break;
+    default:
+        return IReadData(s, timeConvert, idx, readOptions);
+    }
+    return true;
+}
+
+//
+// Either the changed elements, or everything if the baseline is empty or a different size
+//
+bool plSimpleStateVariable::WriteDeltaData(hsStream* s, plSimpleStateVariable* baseline, float timeConvert, uint32_t writeOptions) const
+{
+    bool full = (!baseline->IsUsed() || GetCount() != baseline->GetCount());
+    s->WriteBool(full);
+
+    int i;
+    if (full)
+    {
+        if (GetVarDescriptor()->IsVariableLength())
+            s->WriteLE32(GetCount());
+        for (i = 0; i < GetCount(); i++)
+            if (!IWriteData(s, timeConvert, i, writeOptions))
+                return false;
+        baseline->CopyValues(this);
+    }
+    else
+    {
+        hsBitVector changed;
+        for (i = 0; i < GetCount(); i++)
+            if (IElementHasDelta(baseline, i))
+                changed.SetBit(i);
+
+        plSDL::ChangeMaskWrite(s, GetCount(), changed);
+        for (i = 0; i < GetCount(); i++)
+            if (changed.IsBitSet(i))
+                IWriteDeltaElement(s, baseline, timeConvert, i, writeOptions);
+    }
+
+    baseline->SetUsed(true);
+    return true;
+}
+
+bool plSimpleStateVariable::ReadDeltaData(hsStream* s, float timeConvert, uint32_t readOptions)
+{
+    bool full = s->ReadBool();
+
+    int i;
+    if (full)
+    {
+        if (GetVarDescriptor()->IsVariableLength())
+        {
+            uint32_t cnt;
+            s->ReadLE(&cnt);
+            if (cnt >= plSDL::kMaxListSize)
+                return false;
+            fVar.SetCount(cnt);
+            Alloc();
+        }
+        for (i = 0; i < GetCount(); i++)
+            if (!IReadData(s, timeConvert, i, readOptions))
+                return false;
+    }
+    else
+    {
+        if (!IsUsed())
+            return false;   // out of sync with the writer
+
+        hsBitVector changed;
+        if (!plSDL::ChangeMaskRead(s, GetCount(), &changed))
+            return false;
+        for (i = 0; i < GetCount(); i++)
+            if (changed.IsBitSet(i) && !IReadDeltaElement(s, timeConvert, i, readOptions))
+                return false;
+    }
+
+    SetUsed(true);
+    return true;
+}
+
 //
 // send notification msg if necessary, called internally
 //
@@ -2688,6 +3064,83 @@ bool plSDStateVariable::WriteData(hsStream* s, float timeConvert, uint32_t write
     return true;
 }
 
+bool plSDStateVariable::HasDeltaFrom(const plSDStateVariable* baseline) const
+{
+    if (!IsUsed())
+        return false;
+    if (GetCount() != baseline->GetCount())
+        return true;
+
+    int i;
+    for (i = 0; i < GetCount(); i++)
+    {
+        if (GetStateDataRecord(i)->HasDeltaFrom(baseline->GetStateDataRecord(i)))
+            return true;
+    }
+    return false;
+}
+
+//
+// Changed records as deltas, or the whole list if its size changed
+//
+bool plSDStateVariable::WriteDeltaData(hsStream* s, plSDStateVariable* baseline, float timeConvert, uint32_t writeOptions) const
+{
+    writeOptions &= ~plSDL::kDirtyOnly;     // nested records are compared, not dirtied
+
+    bool full = (GetCount() != baseline->GetCount());
+    s->WriteBool(full);
+
+    if (full)
+    {
+        if (!WriteData(s, timeConvert, writeOptions))
+            return false;
+        baseline->CopyFrom(const_cast<plSDStateVariable*>(this));
+        return true;
+    }
+
+    hsBitVector changed;
+    int i;
+    for (i = 0; i < GetCount(); i++)
+        if (GetStateDataRecord(i)->HasDeltaFrom(baseline->GetStateDataRecord(i)))
+            changed.SetBit(i);
+
+    plSDL::ChangeMaskWrite(s, GetCount(), changed);
+    for (i = 0; i < GetCount(); i++)
+    {
+        if (changed.IsBitSet(i) &&
+            !GetStateDataRecord(i)->WriteDelta(s, baseline->GetStateDataRecord(i), timeConvert, writeOptions))
+            return false;
+    }
+    return true;
+}
+
+bool plSDStateVariable::ReadDeltaData(hsStream* s, float timeConvert, uint32_t readOptions)
+{
+    bool full = s->ReadBool();
+
+    if (full)
+    {
+        // start from empty records so we match the writer's copy
+        Alloc(GetVarDescriptor()->IsVariableLength() ? 0 : -1);
+        return ReadData(s, timeConvert, readOptions);
+    }
+
+    hsBitVector changed;
+    if (!plSDL::ChangeMaskRead(s, GetCount(), &changed))
+        return false;
+
+    int i;
+    for (i = 0; i < GetCount(); i++)
+    {
+        if (!changed.IsBitSet(i))
+            continue;
+        plStateDataRecord delta(GetSDVarDescriptor()->GetStateDescriptor());
+        if (!delta.ReadDelta(s, GetStateDataRecord(i), timeConvert, readOptions))
+            return false;
+    }
+    return true;
+}
+
 //
 //
 //
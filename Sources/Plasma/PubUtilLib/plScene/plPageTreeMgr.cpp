@@ -46,9 +46,11 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "plPageTreeMgr.h"
 #include "plDrawable/plSpaceTreeMaker.h"
 #include "plDrawable/plSpaceTree.h"
+#include "plDrawable/plDrawableSpans.h"
 #include "plDrawable.h"
 #include "plScene/plSceneNode.h"
 #include "plPipeline.h"
+#include "plPipeDebugFlags.h"
 #include "plMath/hsRadixSort.h"
 #include "plCullPoly.h"
 #include "plOccluder.h"
@@ -208,6 +210,19 @@ int plPageTreeMgr::IRenderVisList(plPipeline* pipe, hsTArray<plDrawVisList>& lev
     // the sorted list which have the same render priority and which also want their
     // spans sorted.
     int i;
+
+    // Drawing one drawable doesn't change what the next one's face sort
+    // sees, so sort the faces of everything drawn on its own up front, where
+    // they can sort alongside each other.
+    static hsTArray<plDrawVisList*> presortList;
+    presortList.SetCount(0);
+    for( i = 0; i < sortedDrawList.GetCount(); i++ )
+    {
+        if( !sortedDrawList[i].fDrawable->GetNativeProperty(plDrawable::kPropSortSpans) )
+            presortList.Append(&sortedDrawList[i]);
+    }
+    IPresortFaces(pipe, presortList);
+
     for( i = 0; i < sortedDrawList.GetCount(); i++ )
     {
         plDrawable* p = sortedDrawList[i].fDrawable;
@@ -333,6 +348,33 @@ int plPageTreeMgr::IPrepForRenderSortingSpans(plPipeline* pipe, hsTArray<plDrawV
     return numDrawn;
 }
 
+// Face sort the drawables in drawList that want it, ahead of their PrepForRender.
+void plPageTreeMgr::IPresortFaces(plPipeline* pipe, const hsTArray<plDrawVisList*>& drawList)
+{
+    static hsTArray<plDrawableSpans*> drawables;
+    static hsTArray<const hsTArray<int16_t>*> visLists;
+    drawables.SetCount(0);
+    visLists.SetCount(0);
+
+    bool sortFaces = !pipe->IsDebugFlagSet(plPipeDbg::kFlagDontSortFaces);
+    int i;
+    for( i = 0; sortFaces && i < drawList.GetCount(); i++ )
+    {
+        plDrawable* drawable = drawList[i]->fDrawable;
+        if( !drawable->GetNativeProperty(plDrawable::kPropSortFaces) )
+            continue;
+
+        plDrawableSpans* spans = plDrawableSpans::ConvertNoRef(drawable);
+        if( spans )
+        {
+            drawables.Append(spans);
+            visLists.Append(&drawList[i]->fVisList);
+        }
+    }
+    // Even with nothing to sort, so nobody skips a sort on last frame's say-so
+    plDrawableSpans::PresortVisibleSpans(drawables.AcquireArray(), visLists.AcquireArray(), drawables.GetCount(), pipe->GetViewPositionWorld());
+}
+
 bool plPageTreeMgr::IRenderSortingSpans(plPipeline* pipe, hsTArray<plDrawVisList*>& drawList, hsTArray<plDrawSpanPair>& pairs)
 {
 
@@ -408,6 +450,7 @@ bool plPageTreeMgr::IRenderSortingSpans(plPipeline* pipe, hsTArray<plDrawVisList
         drawList[curPair.fDrawable]->fVisList.Append(curPair.fSpan);
         listTrav = listTrav->fNext;
     }
+    IPresortFaces(pipe, drawList);
     for( i = 0; i < drawList.GetCount(); i++ )
     {
         pipe->PrepForRender(drawList[i]->fDrawable, drawList[i]->fVisList, visMgr);
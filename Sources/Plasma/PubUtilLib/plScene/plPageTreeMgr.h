@@ -104,6 +104,7 @@ protected:
     int                         IPrepForRenderSortingSpans(plPipeline* pipe, hsTArray<plDrawVisList>& drawVis, int& iDrawStart);
     bool                        IRenderSortingSpans(plPipeline* pipe, hsTArray<plDrawVisList*>& drawList, hsTArray<plDrawSpanPair>& pairs);
     int                         IRenderVisList(plPipeline* pipe, hsTArray<plDrawVisList>& visList);
+    void                        IPresortFaces(plPipeline* pipe, const hsTArray<plDrawVisList*>& drawList);
 
 public:
     plPageTreeMgr();
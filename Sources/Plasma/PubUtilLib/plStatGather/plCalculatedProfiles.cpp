@@ -62,6 +62,44 @@ plProfile_CreateCounter("Polys Per Material", "General", PolysPerMat);
 #define plProfile_GetValue(varName) 0
 #endif
 
+// Live and peak bytes come straight from hsMemTracker, allocations are the
+// number of tagged allocations made since the last frame
+plProfile_CreateMemCounter("ResMgr Live", "MemTags", MemTagResMgrLive);
+plProfile_CreateMemCounter("ResMgr Peak", "MemTags", MemTagResMgrPeak);
+plProfile_CreateCounter("ResMgr Allocs", "MemTags", MemTagResMgrAllocs);
+plProfile_CreateMemCounter("Textures Live", "MemTags", MemTagTexturesLive);
+plProfile_CreateMemCounter("Textures Peak", "MemTags", MemTagTexturesPeak);
+plProfile_CreateCounter("Textures Allocs", "MemTags", MemTagTexturesAllocs);
+plProfile_CreateMemCounter("Geometry Live", "MemTags", MemTagGeometryLive);
+plProfile_CreateMemCounter("Geometry Peak", "MemTags", MemTagGeometryPeak);
+plProfile_CreateCounter("Geometry Allocs", "MemTags", MemTagGeometryAllocs);
+plProfile_CreateMemCounter("SDL Live", "MemTags", MemTagSDLLive);
+plProfile_CreateMemCounter("SDL Peak", "MemTags", MemTagSDLPeak);
+plProfile_CreateCounter("SDL Allocs", "MemTags", MemTagSDLAllocs);
+plProfile_CreateMemCounter("Python Live", "MemTags", MemTagPythonLive);
+plProfile_CreateMemCounter("Python Peak", "MemTags", MemTagPythonPeak);
+plProfile_CreateCounter("Python Allocs", "MemTags", MemTagPythonAllocs);
+plProfile_CreateMemCounter("Net Live", "MemTags", MemTagNetLive);
+plProfile_CreateMemCounter("Net Peak", "MemTags", MemTagNetPeak);
+plProfile_CreateCounter("Net Allocs", "MemTags", MemTagNetAllocs);
+plProfile_CreateMemCounter("Audio Live", "MemTags", MemTagAudioLive);
+plProfile_CreateMemCounter("Audio Peak", "MemTags", MemTagAudioPeak);
+plProfile_CreateCounter("Audio Allocs", "MemTags", MemTagAudioAllocs);
+
+plProfile_CreateMemCounterReset("Frame Arena Used", "MemTags", FrameArenaUsed);
+plProfile_CreateMemCounter("Frame Arena Peak", "MemTags", FrameArenaPeak);
+plProfile_CreateCounterNoReset("Frame Arena Chunks", "MemTags", FrameArenaChunks);
+
+#define ISetMemTagProfile(tag, name) \
+    { \
+        static uint64_t lastAllocs = 0; \
+        uint64_t allocs = hsMemTracker::GetNumAllocs(tag); \
+        plProfile_Set(MemTag##name##Live, hsMemTracker::GetLiveBytes(tag)); \
+        plProfile_Set(MemTag##name##Peak, hsMemTracker::GetPeakBytes(tag)); \
+        plProfile_Set(MemTag##name##Allocs, allocs - lastAllocs); \
+        lastAllocs = allocs; \
+    }
+
 void CalculateProfiles()
 {
     // KLUDGE - do timing that overlaps the beginframe / endframe (where timing is normally reset)
@@ -76,6 +114,19 @@ void CalculateProfiles()
     else
         plProfile_Set(PolysPerMat, plProfile_GetValue(DrawTriangles) / plProfile_GetValue(MatChange));
 
+    ISetMemTagProfile(kMemTagResMgr, ResMgr);
+    ISetMemTagProfile(kMemTagTextures, Textures);
+    ISetMemTagProfile(kMemTagGeometry, Geometry);
+    ISetMemTagProfile(kMemTagSDL, SDL);
+    ISetMemTagProfile(kMemTagPython, Python);
+    ISetMemTagProfile(kMemTagNet, Net);
+    ISetMemTagProfile(kMemTagAudio, Audio);
+
+    hsFrameArena& arena = hsFrameArena::Frame();
+    plProfile_Set(FrameArenaUsed, arena.GetUsedBytes());
+    plProfile_Set(FrameArenaPeak, arena.GetPeakBytes());
+    plProfile_Set(FrameArenaChunks, arena.GetNumChunkAllocs());
+
     #ifdef HS_FIND_MEM_LEAKS
 //  plProfile_Set(MemAllocated, MemGetAllocated());
 //  plProfile_Set(MemPeakAlloc, MemGetPeakAllocated());
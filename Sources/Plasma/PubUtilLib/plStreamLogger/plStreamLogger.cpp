@@ -125,7 +125,7 @@ void hsReadOnlyLoggingStream::FastFwd()
     hsThrow( "can't fast forward a logging stream");
 }
 
-void hsReadOnlyLoggingStream::SetPosition(uint32_t position)
+void hsReadOnlyLoggingStream::SetPosition(uint64_t position)
 {
     hsThrow( "can't set position on a logging stream");
 }
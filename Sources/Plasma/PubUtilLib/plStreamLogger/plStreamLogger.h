@@ -112,9 +112,12 @@ class hsReadOnlyLoggingStream : public hsReadOnlyStream, public plStreamLogger
 private:
 
 public:
+    // No inline window, so every read goes through the logging Read()
+    void    Init(int size, const void* data) { hsReadOnlyStream::Init(size, data); fWindowEnd = (const uint8_t*)fStart; }
+
     void    Rewind();
     void    FastFwd();
-    void    SetPosition(uint32_t position);
+    void    SetPosition(uint64_t position);
 
     uint32_t Read(uint32_t byteCount, void * buffer);
     void Skip(uint32_t deltaByteCount);
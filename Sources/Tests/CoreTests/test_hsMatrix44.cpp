@@ -0,0 +1,226 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsBounds.h"
+#include "hsGeometry3.h"
+#include "hsMatrix44.h"
+
+static float IRand(uint32_t& seed)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) / float(1 << 24) * 2.f - 1.f;
+}
+
+static hsMatrix44 RandomAffine(uint32_t& seed)
+{
+    hsMatrix44 m;
+    m.Reset(false);
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+            m.fMap[r][c] = IRand(seed) * 2.f;
+        m.fMap[r][3] = IRand(seed) * 100.f;
+    }
+    return m;
+}
+
+// Laid out like an interleaved vertex, with a guard after each member to
+// catch a kernel writing a fourth float.
+struct TestVert
+{
+    hsPoint3    fPos;
+    float       fPosGuard;
+    hsVector3   fNorm;
+    float       fNormGuard;
+    uint32_t    fColor;
+};
+
+static const float kGuard = 12345.f;
+
+static std::vector<TestVert> RandomVerts(size_t count, uint32_t& seed)
+{
+    std::vector<TestVert> verts(count);
+    for (TestVert& v : verts)
+    {
+        v.fPos.Set(IRand(seed) * 50.f, IRand(seed) * 50.f, IRand(seed) * 50.f);
+        v.fNorm.Set(IRand(seed), IRand(seed), IRand(seed));
+        v.fPosGuard = v.fNormGuard = kGuard;
+        v.fColor = 0xdeadbeef;
+    }
+    return verts;
+}
+
+static void ExpectNear(const hsScalarTriple& expected, const hsScalarTriple& actual)
+{
+    EXPECT_NEAR(expected.fX, actual.fX, 1e-4f * (1.f + fabs(expected.fX)));
+    EXPECT_NEAR(expected.fY, actual.fY, 1e-4f * (1.f + fabs(expected.fY)));
+    EXPECT_NEAR(expected.fZ, actual.fZ, 1e-4f * (1.f + fabs(expected.fZ)));
+}
+
+TEST(hsMatrix44, map_points)
+{
+    uint32_t seed = 1;
+    hsMatrix44 m = RandomAffine(seed);
+
+    // Odd counts exercise the tails of the wide kernels.
+    for (size_t count : { 0, 1, 3, 7, 8, 9, 17, 1000 })
+    {
+        std::vector<TestVert> src = RandomVerts(count, seed);
+        std::vector<TestVert> dst = src;
+
+        hsMatrix44::map_points.call(m, &dst.data()->fPos, sizeof(TestVert), &dst.data()->fPos, sizeof(TestVert), count);
+        hsMatrix44::map_vectors.call(m, &dst.data()->fNorm, sizeof(TestVert), &dst.data()->fNorm, sizeof(TestVert), count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            ExpectNear(m * src[i].fPos, dst[i].fPos);
+            ExpectNear(m * src[i].fNorm, dst[i].fNorm);
+            EXPECT_EQ(kGuard, dst[i].fPosGuard);
+            EXPECT_EQ(kGuard, dst[i].fNormGuard);
+            EXPECT_EQ(0xdeadbeef, dst[i].fColor);
+        }
+    }
+}
+
+TEST(hsMatrix44, map_points_packed)
+{
+    uint32_t seed = 2;
+    hsMatrix44 m = RandomAffine(seed);
+
+    std::vector<hsPoint3> src(33), dst(34);
+    for (hsPoint3& p : src)
+        p.Set(IRand(seed), IRand(seed), IRand(seed));
+    dst[33].Set(kGuard, kGuard, kGuard);
+
+    hsMatrix44::map_points.call(m, src.data(), sizeof(hsPoint3), dst.data(), sizeof(hsPoint3), src.size());
+    for (size_t i = 0; i < src.size(); i++)
+        ExpectNear(m * src[i], dst[i]);
+    EXPECT_EQ(kGuard, dst[33].fX);
+
+    // MapPoints goes through the same kernel
+    std::vector<hsPoint3> mapped = src;
+    m.MapPoints(mapped.size(), mapped.data());
+    for (size_t i = 0; i < src.size(); i++)
+        ExpectNear(m * src[i], mapped[i]);
+}
+
+TEST(hsMatrix44, map_bounds)
+{
+    uint32_t seed = 3;
+    for (int n = 0; n < 200; n++)
+    {
+        hsMatrix44 m = RandomAffine(seed);
+
+        hsPoint3 lo(IRand(seed) * 10.f, IRand(seed) * 10.f, IRand(seed) * 10.f);
+        hsPoint3 hi = lo + hsVector3(fabs(IRand(seed)) * 5.f, fabs(IRand(seed)) * 5.f, fabs(IRand(seed)) * 5.f);
+
+        hsBounds3 expected;
+        expected.Reset(&lo);
+        expected.Union(&hi);
+        hsPoint3 corners[8];
+        expected.GetCorners(corners);
+        for (hsPoint3& c : corners)
+            c = m * c;
+        expected.Reset(8, corners);
+
+        hsPoint3 outLo, outHi;
+        hsMatrix44::map_bounds.call(m, &lo, &hi, 0, &outLo, &outHi, 0, 1);
+        ExpectNear(expected.GetMins(), outLo);
+        ExpectNear(expected.GetMaxs(), outHi);
+
+        hsBounds3 bnd;
+        bnd.Reset(&lo);
+        bnd.Union(&hi);
+        bnd.Transform(&m);
+        ExpectNear(expected.GetMins(), bnd.GetMins());
+        ExpectNear(expected.GetMaxs(), bnd.GetMaxs());
+    }
+}
+
+TEST(hsMatrix44, mul_34_batch)
+{
+    uint32_t seed = 4;
+    const size_t count = 37;
+    hsMatrix44 one = RandomAffine(seed);
+    std::vector<hsMatrix44> many(count), out(count);
+    for (hsMatrix44& m : many)
+        m = RandomAffine(seed);
+
+    hsMatrix44::mul_34_batch.call(&one, 0, many.data(), 1, out.data(), nullptr, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        hsMatrix44 expected = one * many[i];
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                EXPECT_NEAR(expected.fMap[r][c], out[i].fMap[r][c], 1e-3f);
+        EXPECT_FALSE(out[i].fFlags & hsMatrix44::kIsIdent);
+    }
+
+    // Gathered through an index list, only touching the listed entries.
+    const uint32_t idx[] = { 3, 0, 17, 36, 5 };
+    std::vector<hsMatrix44> gathered(count);
+    for (hsMatrix44& m : gathered)
+        m.Reset();
+    hsMatrix44::mul_34_batch.call(many.data(), 1, &one, 0, gathered.data(), idx, arrsize(idx));
+    for (size_t i = 0; i < count; i++)
+    {
+        bool listed = std::find(idx, idx + arrsize(idx), i) != idx + arrsize(idx);
+        hsMatrix44 expected = listed ? many[i] * one : hsMatrix44().Reset();
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                EXPECT_NEAR(expected.fMap[r][c], gathered[i].fMap[r][c], 1e-3f);
+    }
+
+    // In place
+    std::vector<hsMatrix44> inPlace = many;
+    hsMatrix44::mul_34_batch.call(&one, 0, inPlace.data(), 1, inPlace.data(), nullptr, count);
+    for (size_t i = 0; i < count; i++)
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 4; c++)
+                EXPECT_EQ(out[i].fMap[r][c], inPlace[i].fMap[r][c]);
+}
@@ -0,0 +1,164 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsMemory.h"
+#include "hsTemplates.h"
+
+struct TaggedThing
+{
+    HS_MEMTAG_NEW(kMemTagNet);
+
+    double  fValues[5];
+};
+
+TEST(hsMemory, TrackerCounts)
+{
+    int64_t live = hsMemTracker::GetLiveBytes(kMemTagAudio);
+    uint64_t allocs = hsMemTracker::GetNumAllocs(kMemTagAudio);
+    uint64_t frees = hsMemTracker::GetNumFrees(kMemTagAudio);
+
+    hsMemTracker::Add(kMemTagAudio, 1000);
+    hsMemTracker::Add(kMemTagAudio, 500);
+    EXPECT_EQ(live + 1500, hsMemTracker::GetLiveBytes(kMemTagAudio));
+    EXPECT_GE(hsMemTracker::GetPeakBytes(kMemTagAudio), live + 1500);
+
+    hsMemTracker::Remove(kMemTagAudio, 1000);
+    hsMemTracker::Remove(kMemTagAudio, 500);
+    EXPECT_EQ(live, hsMemTracker::GetLiveBytes(kMemTagAudio));
+    EXPECT_GE(hsMemTracker::GetPeakBytes(kMemTagAudio), live + 1500);
+    EXPECT_EQ(allocs + 2, hsMemTracker::GetNumAllocs(kMemTagAudio));
+    EXPECT_EQ(frees + 2, hsMemTracker::GetNumFrees(kMemTagAudio));
+
+    EXPECT_STREQ("Audio", hsMemTracker::GetTagName(kMemTagAudio));
+}
+
+TEST(hsMemory, TaggedNew)
+{
+    int64_t live = hsMemTracker::GetLiveBytes(kMemTagNet);
+    int64_t otherLive = hsMemTracker::GetLiveBytes(kMemTagSDL);
+
+    TaggedThing* things[10];
+    for (TaggedThing*& thing : things)
+    {
+        thing = new TaggedThing;
+        EXPECT_EQ(0, uintptr_t(thing) % alignof(std::max_align_t));
+    }
+    EXPECT_EQ(live + 10 * int64_t(sizeof(TaggedThing)), hsMemTracker::GetLiveBytes(kMemTagNet));
+
+    for (TaggedThing* thing : things)
+        delete thing;
+    EXPECT_EQ(live, hsMemTracker::GetLiveBytes(kMemTagNet));
+    EXPECT_EQ(otherLive, hsMemTracker::GetLiveBytes(kMemTagSDL));
+
+    // Placement new still works and isn't counted
+    alignas(TaggedThing) uint8_t buffer[sizeof(TaggedThing)];
+    TaggedThing* placed = new (buffer) TaggedThing;
+    EXPECT_EQ(static_cast<void*>(buffer), static_cast<void*>(placed));
+    EXPECT_EQ(live, hsMemTracker::GetLiveBytes(kMemTagNet));
+}
+
+TEST(hsMemory, ArenaAlignment)
+{
+    hsFrameArena arena(256);
+
+    const size_t aligns[] = { 1, 2, 4, 8, 16, 64 };
+    uint8_t* blocks[60];
+    for (int i = 0; i < 60; i++)
+    {
+        size_t align = aligns[i % arrsize(aligns)];
+        blocks[i] = static_cast<uint8_t*>(arena.Alloc(i + 1, align));
+        ASSERT_EQ(0, uintptr_t(blocks[i]) % align) << "block " << i;
+        memset(blocks[i], i, i + 1);
+    }
+
+    // Blocks don't overlap
+    for (int i = 0; i < 60; i++)
+    {
+        for (int j = 0; j <= i; j++)
+            ASSERT_EQ(uint8_t(i), blocks[i][j]) << "block " << i;
+    }
+    EXPECT_GT(arena.GetNumChunkAllocs(), 1);
+
+    // A request bigger than a whole chunk gets a chunk of its own
+    uint8_t* big = static_cast<uint8_t*>(arena.Alloc(4096, 128));
+    EXPECT_EQ(0, uintptr_t(big) % 128);
+    memset(big, 0xff, 4096);
+    EXPECT_GE(arena.GetCapacity(), 4096);
+}
+
+TEST(hsMemory, ArenaReset)
+{
+    hsFrameArena arena(1024);
+
+    auto frame = [&arena]() {
+        for (int i = 0; i < 100; i++)
+        {
+            float* table = arena.New<float>(i);
+            for (int j = 0; j < i; j++)
+                table[j] = float(j);
+        }
+    };
+
+    frame();
+    size_t used = arena.GetUsedBytes();
+    EXPECT_GE(used, 99 * 100 / 2 * sizeof(float));
+    EXPECT_GT(arena.GetNumChunkAllocs(), 1);
+
+    // The spilled frame gets folded into one chunk that holds all of it
+    arena.Reset();
+    EXPECT_EQ(0, arena.GetUsedBytes());
+    EXPECT_EQ(used, arena.GetLastFrameBytes());
+    EXPECT_GE(arena.GetCapacity(), used);
+
+    uint32_t chunkAllocs = arena.GetNumChunkAllocs();
+    for (int i = 0; i < 10; i++)
+    {
+        frame();
+        EXPECT_EQ(used, arena.GetUsedBytes());
+        arena.Reset();
+    }
+    EXPECT_EQ(chunkAllocs, arena.GetNumChunkAllocs());
+    EXPECT_EQ(used, arena.GetPeakBytes());
+}
@@ -0,0 +1,159 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsMemory.h"
+#include "hsTemplates.h"
+
+// Counts every trip to the global heap so the report below can show how many
+// allocations a frame costs. This replaces the global operator new, so it
+// gets its own executable rather than running under every CoreLib test.
+static std::atomic<uint32_t> sHeapAllocs(0);
+
+void* operator new(size_t size)
+{
+    sHeapAllocs++;
+    void* mem = malloc(size ? size : 1);
+    if (!mem)
+        throw std::bad_alloc();
+    return mem;
+}
+
+void operator delete(void* mem) noexcept
+{
+    free(mem);
+}
+
+// A frame's worth of the allocation patterns the arena and the dispatcher's
+// wrap recycling replace: a few per-frame scratch tables, and a stream of
+// message wraps each collecting a receiver list.
+struct ReportWrap
+{
+    ReportWrap*     fNext;
+    hsTArray<int>   fReceivers;
+};
+
+static const int kReportTables = 8;
+static const int kReportMessages = 400;
+
+static void ReportFrameBefore()
+{
+    for (int i = 0; i < kReportTables; i++)
+    {
+        float* table = new float[64 * 64];
+        table[0] = 0.f;
+        delete [] table;
+    }
+    for (int i = 0; i < kReportMessages; i++)
+    {
+        ReportWrap* wrap = new ReportWrap;
+        for (int j = 0; j < (i % 12) + 1; j++)
+            wrap->fReceivers.Append(j);
+        delete wrap;
+    }
+}
+
+static void ReportFrameAfter(hsFrameArena& arena, ReportWrap*& freeList)
+{
+    for (int i = 0; i < kReportTables; i++)
+    {
+        float* table = arena.New<float>(64 * 64);
+        table[0] = 0.f;
+    }
+    for (int i = 0; i < kReportMessages; i++)
+    {
+        ReportWrap* wrap = freeList;
+        if (wrap)
+            freeList = wrap->fNext;
+        else
+            wrap = new ReportWrap;
+
+        int numReceivers = (i % 12) + 1;
+        wrap->fReceivers.Expand(numReceivers);
+        for (int j = 0; j < numReceivers; j++)
+            wrap->fReceivers.Append(j);
+
+        wrap->fReceivers.SetCount(0);
+        wrap->fNext = freeList;
+        freeList = wrap;
+    }
+    arena.Reset();
+}
+
+TEST(hsMemory, AllocationReport)
+{
+    const int kFrames = 30;
+
+    uint32_t start = sHeapAllocs;
+    for (int i = 0; i < kFrames; i++)
+        ReportFrameBefore();
+    uint32_t before = (sHeapAllocs - start) / kFrames;
+
+    hsFrameArena arena;
+    ReportWrap* freeList = nil;
+    start = sHeapAllocs;
+    ReportFrameAfter(arena, freeList);
+    uint32_t firstFrame = sHeapAllocs - start;
+
+    start = sHeapAllocs;
+    for (int i = 1; i < kFrames; i++)
+        ReportFrameAfter(arena, freeList);
+    uint32_t after = (sHeapAllocs - start) / (kFrames - 1);
+
+    while (freeList)
+    {
+        ReportWrap* next = freeList->fNext;
+        delete freeList;
+        freeList = next;
+    }
+
+    printf("[   INFO   ] heap allocations per frame: %u before, %u after "
+           "(%u on the first frame while the arena and free list warm up)\n",
+           before, after, firstFrame);
+    EXPECT_LT(after, before);
+    EXPECT_EQ(0, after);
+}
@@ -0,0 +1,209 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+
+static const plFileName kTestFile = "test_hsStream.dat";
+
+// One small record of mixed primitives, the shape most object Read()s have
+static const uint32_t kRecordSize = 1 + 2 + 4 + 4 + 8 + 3 * 4;
+
+static void WriteRecord(hsStream* s, uint32_t i)
+{
+    s->WriteByte(uint8_t(i));
+    s->WriteLE16(uint16_t(i * 3));
+    s->WriteLE32(i * 7919);
+    s->WriteLEFloat(float(i) * 0.5f);
+    s->WriteLEDouble(double(i) * 0.25);
+    float v[3] = { float(i), float(i) + 1.f, float(i) + 2.f };
+    s->WriteLEFloat(3, v);
+}
+
+static bool CheckRecord(hsStream* s, uint32_t i)
+{
+    bool ok = true;
+    ok &= s->ReadByte() == uint8_t(i);
+    ok &= s->ReadLE16() == uint16_t(i * 3);
+    ok &= s->ReadLE32() == i * 7919;
+    ok &= s->ReadLEFloat() == float(i) * 0.5f;
+    ok &= s->ReadLEDouble() == double(i) * 0.25;
+    float v[3];
+    s->ReadLEFloat(3, v);
+    ok &= v[0] == float(i) && v[1] == float(i) + 1.f && v[2] == float(i) + 2.f;
+    return ok;
+}
+
+static std::vector<uint8_t> MakeRecords(uint32_t count)
+{
+    hsRAMStream ram;
+    for (uint32_t i = 0; i < count; i++)
+        WriteRecord(&ram, i);
+    std::vector<uint8_t> data(ram.GetEOF());
+    ram.CopyToMem(data.data());
+    return data;
+}
+
+static void WriteFile(const std::vector<uint8_t>& data)
+{
+    hsUNIXStream out;
+    ASSERT_TRUE(out.Open(kTestFile, "wb"));
+    out.Write(data.size(), data.data());
+    out.Close();
+}
+
+TEST(hsStream, ReadOnlyPrimitives)
+{
+    const uint32_t count = 1000;
+    std::vector<uint8_t> data = MakeRecords(count);
+    ASSERT_EQ(count * kRecordSize, data.size());
+
+    hsReadOnlyStream s(data.size(), data.data());
+    for (uint32_t i = 0; i < count; i++)
+        ASSERT_TRUE(CheckRecord(&s, i)) << "record " << i;
+    EXPECT_EQ(data.size(), s.GetPosition());
+    EXPECT_TRUE(s.AtEnd());
+
+    s.Rewind();
+    s.Skip(10 * kRecordSize);
+    EXPECT_TRUE(CheckRecord(&s, 10));
+    s.SetPosition(500 * kRecordSize);
+    EXPECT_TRUE(CheckRecord(&s, 500));
+    EXPECT_EQ(501 * kRecordSize, s.GetPosition());
+}
+
+TEST(hsStream, BufferedPrimitives)
+{
+    const uint32_t count = 4000;
+    std::vector<uint8_t> data = MakeRecords(count);
+    WriteFile(data);
+
+    // Record size is odd against every buffer size, so reads keep straddling
+    // the end of the buffered block.
+    const uint32_t bufferSizes[] = { 16, 29, hsBufferedStream::kDefaultBufferSize, 64 * 1024 };
+    for (uint32_t bufferSize : bufferSizes)
+    {
+        hsBufferedStream s(bufferSize);
+        ASSERT_TRUE(s.Open(kTestFile, "rb"));
+        EXPECT_EQ(bufferSize, s.GetBufferSize());
+        EXPECT_EQ(data.size(), s.GetEOF());
+
+        for (uint32_t i = 0; i < count; i++)
+            ASSERT_TRUE(CheckRecord(&s, i)) << "record " << i << ", buffer " << bufferSize;
+        EXPECT_EQ(data.size(), s.GetPosition());
+        EXPECT_TRUE(s.AtEnd());
+
+        // Backwards and forwards, inside and outside the buffered block
+        const uint32_t seeks[] = { 7, 6, 3000, 2999, 0, 3999, 1 };
+        for (uint32_t rec : seeks)
+        {
+            s.SetPosition(uint64_t(rec) * kRecordSize);
+            ASSERT_TRUE(CheckRecord(&s, rec)) << "seek to " << rec << ", buffer " << bufferSize;
+        }
+
+        s.Rewind();
+        s.Skip(100 * kRecordSize);
+        EXPECT_TRUE(CheckRecord(&s, 100));
+        s.Skip(kRecordSize);
+        EXPECT_TRUE(CheckRecord(&s, 102));
+
+        // A read larger than the buffer goes straight to the file
+        std::vector<uint8_t> bulk(50 * kRecordSize + 3);
+        s.SetPosition(1000 * kRecordSize - 3);
+        EXPECT_EQ(bulk.size(), s.Read(bulk.size(), bulk.data()));
+        EXPECT_TRUE(std::equal(bulk.begin(), bulk.end(), data.begin() + 1000 * kRecordSize - 3));
+        EXPECT_TRUE(CheckRecord(&s, 1050));
+
+        s.Close();
+    }
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(hsStream, BufferSizeChange)
+{
+    std::vector<uint8_t> data = MakeRecords(200);
+    WriteFile(data);
+
+    hsBufferedStream s;
+    EXPECT_EQ(hsBufferedStream::GetDefaultBufferSize(), s.GetBufferSize());
+    ASSERT_TRUE(s.Open(kTestFile, "rb"));
+    EXPECT_TRUE(CheckRecord(&s, 0));
+    s.SetBufferSize(64);
+    for (uint32_t i = 1; i < 200; i++)
+        ASSERT_TRUE(CheckRecord(&s, i)) << "record " << i;
+    s.Close();
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(hsStream, Prefetch)
+{
+    std::vector<uint8_t> data = MakeRecords(1000);
+    WriteFile(data);
+
+    hsBufferedStream s;
+    ASSERT_TRUE(s.Open(kTestFile, "rb"));
+    EXPECT_TRUE(CheckRecord(&s, 0));
+
+    // Prefetching doesn't move the read position, and grows the buffer to
+    // cover the whole range
+    uint32_t rangeStart = 500 * kRecordSize;
+    uint32_t rangeLen = 400 * kRecordSize;
+    s.Prefetch(rangeStart, rangeLen);
+    EXPECT_EQ(kRecordSize, s.GetPosition());
+    EXPECT_GE(s.GetBufferSize(), rangeLen);
+    EXPECT_TRUE(CheckRecord(&s, 1));
+
+    s.SetPosition(rangeStart);
+    for (uint32_t i = 500; i < 1000; i++)
+        ASSERT_TRUE(CheckRecord(&s, i)) << "record " << i;
+
+    // Ranges past the end are clamped
+    s.Prefetch(data.size() - kRecordSize, 1024 * 1024);
+    s.SetPosition(data.size() - kRecordSize);
+    EXPECT_TRUE(CheckRecord(&s, 999));
+    s.Prefetch(data.size() + 16, 64);
+    s.Close();
+    plFileSystem::Unlink(kTestFile);
+}
@@ -0,0 +1,120 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsWorkerPool.h"
+
+TEST(hsWorkerPool, RunsEachPieceOnce)
+{
+    hsWorkerPool& pool = hsWorkerPool::Instance();
+    EXPECT_GE(pool.GetNumThreads(), 1u);
+
+    // Plenty of back to back jobs, so a late wakeup from one would trip
+    // over the next
+    for (uint32_t count = 0; count < 200; count++)
+    {
+        std::vector<std::atomic<int>> hits(count);
+        for (std::atomic<int>& hit : hits)
+            hit = 0;
+
+        pool.Run(count, [&hits](uint32_t i) { hits[i]++; });
+
+        for (uint32_t i = 0; i < count; i++)
+            ASSERT_EQ(1, hits[i].load()) << "piece " << i << " of " << count;
+    }
+}
+
+TEST(hsWorkerPool, NestedRun)
+{
+    hsWorkerPool& pool = hsWorkerPool::Instance();
+
+    std::atomic<uint32_t> total(0);
+    pool.Run(8, [&pool, &total](uint32_t) {
+        pool.Run(8, [&total](uint32_t i) { total += i; });
+    });
+    EXPECT_EQ(8u * 28u, total.load());
+}
+
+TEST(hsWorkerPool, QueuedTasksRun)
+{
+    hsWorkerPool& pool = hsWorkerPool::Instance();
+
+    // With no threads of its own (one core) the pool turns them down
+    const uint32_t kNumTasks = 64;
+    std::atomic<uint32_t> done(0);
+    uint32_t queued = 0;
+    for (uint32_t i = 0; i < kNumTasks; i++)
+    {
+        if (pool.Queue([&done]() { done++; }))
+            queued++;
+    }
+    EXPECT_EQ(pool.GetNumThreads() > 1 ? kNumTasks : 0, queued);
+
+    // A Run() in the middle of them still gets every piece done
+    std::atomic<uint32_t> total(0);
+    pool.Run(16, [&total](uint32_t i) { total += i; });
+    EXPECT_EQ(120u, total.load());
+
+    for (int wait = 0; wait < 1000 && done.load() < queued; wait++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(queued, done.load());
+}
+
+// Keep last, it stops the pool for the rest of the run
+TEST(hsWorkerPool, RunAfterShutdown)
+{
+    hsWorkerPool& pool = hsWorkerPool::Instance();
+    pool.Shutdown();
+    EXPECT_EQ(1u, pool.GetNumThreads());
+
+    uint32_t total = 0;
+    pool.Run(16, [&total](uint32_t i) { total += i; });
+    EXPECT_EQ(120u, total);
+
+    EXPECT_FALSE(pool.Queue([&total]() { total = 0; }));
+}
@@ -0,0 +1,414 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include <string_theory/format>
+
+#include "HeadSpin.h"
+#include "hsResMgr.h"
+#include "plgDispatch.h"
+#include "pnFactory/plCreator.h"
+#include "pnKeyedObject/hsKeyedObject.h"
+#include "pnKeyedObject/plKeyImp.h"
+#include "pnMessage/plRefMsg.h"
+#include "pnMessage/plSelfDestructMsg.h"
+
+// Just the creatables we use, the full pnNucleus list would drag in most of
+// the engine.
+REGISTER_NONCREATABLE( plDispatchBase );
+REGISTER_NONCREATABLE( plReceiver );
+REGISTER_CREATABLE( hsKeyedObject );
+REGISTER_NONCREATABLE( plMessage );
+REGISTER_CREATABLE( plRefMsg );
+REGISTER_CREATABLE( plGenRefMsg );
+REGISTER_CREATABLE( plSelfDestructMsg );
+
+// Counts the ref messages sent, by context
+class TestDispatch : public plDispatchBase
+{
+public:
+    uint32_t fCreated;
+    uint32_t fDestroyed;
+    uint32_t fRemoved;
+    uint32_t fSelfDestructs;
+
+    TestDispatch() { Reset(); }
+    void Reset() { fCreated = fDestroyed = fRemoved = fSelfDestructs = 0; }
+
+    void RegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void RegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterAll(const plKey&) HS_OVERRIDE { }
+
+    bool MsgSend(plMessage* msg, bool) HS_OVERRIDE
+    {
+        if (plRefMsg* refMsg = plRefMsg::ConvertNoRef(msg))
+        {
+            if (refMsg->GetContext() & plRefMsg::kOnCreate)
+                fCreated++;
+            else if (refMsg->GetContext() & plRefMsg::kOnDestroy)
+                fDestroyed++;
+            else if (refMsg->GetContext() & plRefMsg::kOnRemove)
+                fRemoved++;
+        }
+        else if (plSelfDestructMsg::ConvertNoRef(msg))
+            fSelfDestructs++;
+        hsRefCnt_SafeUnRef(msg);
+        return true;
+    }
+
+    void MsgQueue(plMessage*) HS_OVERRIDE { }
+    void MsgQueueProcess() HS_OVERRIDE { }
+    void MsgQueueOnOff(bool) HS_OVERRIDE { }
+    bool SetMsgBuffering(bool) HS_OVERRIDE { return false; }
+    void BeginShutdown() HS_OVERRIDE { }
+};
+
+// Only there for the dispatcher and key refcounting
+class TestResMgr : public hsResMgr
+{
+public:
+    TestDispatch fDispatch;
+
+    void  Load(const plKey&) HS_OVERRIDE { }
+    bool  Unload(const plKey&) HS_OVERRIDE { return false; }
+    plKey CloneKey(const plKey&) HS_OVERRIDE { return nil; }
+    plKey FindKey(const plUoid&) HS_OVERRIDE { return nil; }
+    bool  AddViaNotify(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  AddViaNotify(plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(hsKeyedObject*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    plKey ReadKeyNotifyMe(hsStream*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return nil; }
+    plKey ReadKey(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteKey(hsStream*, hsKeyedObject*) HS_OVERRIDE { }
+    void  WriteKey(hsStream*, const plKey&) HS_OVERRIDE { }
+    plCreatable* ReadCreatable(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatable(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plCreatable* ReadCreatableVersion(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatableVersion(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plKey NewKey(const ST::string&, hsKeyedObject*, const plLocation&, const plLoadMask&) HS_OVERRIDE { return nil; }
+    plKey NewKey(plUoid&, hsKeyedObject*) HS_OVERRIDE { return nil; }
+    plDispatchBase* Dispatch() HS_OVERRIDE { return &fDispatch; }
+
+protected:
+    plKey ReRegister(const ST::string&, const plUoid&) HS_OVERRIDE { return nil; }
+    bool  ReadObject(plKeyImp*) HS_OVERRIDE { return false; }
+    void  IKeyReffed(plKeyImp*) HS_OVERRIDE { }
+    void  IKeyUnreffed(plKeyImp*) HS_OVERRIDE { }
+    bool  IReset() HS_OVERRIDE { return true; }
+    bool  IInit() HS_OVERRIDE { return true; }
+    void  IShutdown() HS_OVERRIDE { }
+};
+
+// Gets at the protected notify state
+class plKeyImpPeeker : public plKeyImp
+{
+public:
+    bool IsRefNotified(int i) const { return IsNotified(i); }
+};
+
+// plKeyImp hides the public const accessors with protected ones
+static uint32_t NumNotifies(const plKeyImp* key) { return key->GetNumNotifyCreated(); }
+static plRefMsg* Notify(const plKeyImp* key, int i) { return key->GetNotifyCreated(i); }
+
+class plKeyImpTest : public ::testing::Test
+{
+protected:
+    TestResMgr* fResMgr;
+    std::vector<plKeyImp*> fKeys;
+
+    void SetUp() HS_OVERRIDE
+    {
+        // hsgResMgr takes our ref
+        fResMgr = new TestResMgr;
+        hsgResMgr::Init(fResMgr);
+    }
+
+    void TearDown() HS_OVERRIDE
+    {
+        for (plKeyImp* key : fKeys)
+            key->UnRegister();
+        // Newest first, so clones go before their owners
+        for (auto it = fKeys.rbegin(); it != fKeys.rend(); ++it)
+            delete *it;
+        hsgResMgr::Shutdown();
+    }
+
+    TestDispatch& Sent() { return fResMgr->fDispatch; }
+
+    plKeyImp* MakeKey(uint32_t id)
+    {
+        plKeyImp* key = new plKeyImp(plUoid(plLocation::MakeNormal(1), hsKeyedObject::Index(), ST::format("Key{}", id)), 0, 0);
+        key->SetObjectID(id);
+        fKeys.push_back(key);
+        return key;
+    }
+
+    plKeyImp* MakeClone(plKeyImp* owner, uint32_t playerID, uint32_t cloneID)
+    {
+        plKeyImp* key = new plKeyImp;
+        key->CopyForClone(owner, playerID, cloneID);
+        owner->AddClone(key);
+        fKeys.push_back(key);
+        return key;
+    }
+
+    // What the resmgr does once an object has been read
+    static void Load(plKeyImp* key)
+    {
+        key->SetObjectPtr(new hsKeyedObject);
+        key->NotifyCreated();
+    }
+
+    // rcv wants to hear about target
+    static void Ref(plKeyImp* target, plKeyImp* rcv, int32_t which = 0,
+                    plRefFlags::Type flags = plRefFlags::kActiveRef)
+    {
+        target->SetupNotify(new plGenRefMsg(plKey::Make(rcv), plRefMsg::kOnCreate, which, 0), flags);
+    }
+
+    // The keys involved in one age: a scene node holding every object, and a
+    // handful of materials shared between all of them
+    struct Age
+    {
+        plKeyImp* fNode;
+        std::vector<plKeyImp*> fMaterials;
+        std::vector<plKeyImp*> fObjects;
+    };
+
+    Age MakeAge(uint32_t numObjects, uint32_t numMaterials)
+    {
+        Age age;
+        uint32_t id = 0;
+        age.fNode = MakeKey(id++);
+        for (uint32_t i = 0; i < numMaterials; i++)
+            age.fMaterials.push_back(MakeKey(id++));
+        for (uint32_t i = 0; i < numObjects; i++)
+            age.fObjects.push_back(MakeKey(id++));
+        return age;
+    }
+
+    // Reads the age the way the resmgr would: the node first, then each
+    // object, which refs its material. Half the materials only load once
+    // their users have, so both NotifyCreated and INotifySelf have work to do.
+    void PageIn(Age& age)
+    {
+        Load(age.fNode);
+        size_t numMats = age.fMaterials.size();
+        for (size_t i = 0; i < age.fObjects.size(); i++)
+        {
+            plKeyImp* obj = age.fObjects[i];
+            Ref(obj, age.fNode, int32_t(i));
+            Ref(age.fMaterials[i % numMats], obj);
+            Load(obj);
+
+            if (i == age.fObjects.size() / 2)
+            {
+                for (size_t j = 0; j < numMats; j += 2)
+                    Load(age.fMaterials[j]);
+            }
+        }
+        for (size_t j = 1; j < numMats; j += 2)
+            Load(age.fMaterials[j]);
+    }
+
+    // Unloads every object in a random order. The last user of each material
+    // takes it down with it.
+    void PageOut(Age& age, uint32_t seed)
+    {
+        std::vector<plKeyImp*> order = age.fObjects;
+        std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+        for (plKeyImp* obj : order)
+            obj->UnRegister();
+        age.fNode->UnRegister();
+    }
+
+    void CheckPagedIn(const Age& age)
+    {
+        size_t numObjects = age.fObjects.size();
+        size_t numMats = age.fMaterials.size();
+
+        // Every ref was delivered exactly once
+        EXPECT_EQ(2 * numObjects, Sent().fCreated);
+        EXPECT_EQ(numObjects, age.fNode->GetNumRefs());
+        for (size_t j = 0; j < numMats; j++)
+        {
+            plKeyImpPeeker* mat = (plKeyImpPeeker*)age.fMaterials[j];
+            uint32_t users = uint32_t((numObjects - j + numMats - 1) / numMats);
+            EXPECT_EQ(users, NumNotifies(mat));
+            EXPECT_EQ(users, mat->GetActiveRefs());
+            for (uint32_t i = 0; i < NumNotifies(mat); i++)
+                EXPECT_TRUE(mat->IsRefNotified(i));
+        }
+    }
+
+    void CheckPagedOut(const Age& age)
+    {
+        size_t numObjects = age.fObjects.size();
+        size_t numMats = age.fMaterials.size();
+
+        // The node hears about every object going, and each material's
+        // users get told they lost it, except the last who takes it down
+        EXPECT_EQ(numObjects + numMats, Sent().fDestroyed);
+        EXPECT_EQ(numObjects - numMats, Sent().fRemoved);
+        EXPECT_EQ(numMats, Sent().fSelfDestructs);
+        EXPECT_EQ(0, age.fNode->GetNumRefs());
+        for (plKeyImp* mat : age.fMaterials)
+        {
+            EXPECT_EQ(0, NumNotifies(mat));
+            EXPECT_EQ(0, mat->GetActiveRefs());
+        }
+        for (plKeyImp* obj : age.fObjects)
+        {
+            EXPECT_EQ(0, obj->GetNumRefs());
+            EXPECT_EQ(0, NumNotifies(obj));
+        }
+    }
+};
+
+TEST_F(plKeyImpTest, PageInOutSmall)
+{
+    // Short enough that nothing gets indexed
+    Age age = MakeAge(plKeyImp::kIndexThreshold / 2, 3);
+    PageIn(age);
+    CheckPagedIn(age);
+    Sent().Reset();
+    PageOut(age, 1);
+    CheckPagedOut(age);
+}
+
+TEST_F(plKeyImpTest, PageInOutLarge)
+{
+    // One material alone has more users than a 16-bit count could hold
+    Age age = MakeAge(80000, 1);
+    PageIn(age);
+    CheckPagedIn(age);
+    EXPECT_EQ(80000, NumNotifies(age.fMaterials[0]));
+    Sent().Reset();
+    PageOut(age, 2);
+    CheckPagedOut(age);
+}
+
+TEST_F(plKeyImpTest, ReleaseOneOfMany)
+{
+    for (uint32_t numOthers : { 4u, 100u })
+    {
+        plKeyImp* target = MakeKey(0);
+        plKeyImp* rcv = MakeKey(1);
+        Load(target);
+        Load(rcv);
+
+        // rcv holds three passive refs on target among everyone else's
+        Ref(target, rcv, 0, plRefFlags::kPassiveRef);
+        for (uint32_t i = 0; i < numOthers; i++)
+        {
+            plKeyImp* other = MakeKey(2 + i);
+            Load(other);
+            Ref(target, other, 0, plRefFlags::kPassiveRef);
+            if (i == numOthers / 2)
+                Ref(target, rcv, 1, plRefFlags::kPassiveRef);
+        }
+        Ref(target, rcv, 2, plRefFlags::kPassiveRef);
+        ASSERT_EQ(numOthers + 3, NumNotifies(target));
+        ASSERT_EQ(3, rcv->GetNumRefs());
+
+        // Released oldest first, and nobody else's refs move
+        Sent().Reset();
+        for (int32_t which = 0; which < 3; which++)
+        {
+            int rcvRefs = 0;
+            for (uint32_t i = 0; i < NumNotifies(target); i++)
+            {
+                plGenRefMsg* msg = plGenRefMsg::ConvertNoRef(Notify(target, i));
+                if (msg->GetReceiver(0) == plKey::Make(rcv))
+                {
+                    EXPECT_LE(which, msg->fWhich);
+                    rcvRefs++;
+                }
+            }
+            EXPECT_EQ(3 - which, rcvRefs);
+
+            rcv->Release(plKey::Make(target));
+            EXPECT_EQ(numOthers + 2 - which, NumNotifies(target));
+        }
+        EXPECT_EQ(3, Sent().fRemoved);
+        EXPECT_EQ(0, rcv->GetNumRefs());
+        EXPECT_EQ(0, Sent().fSelfDestructs);
+    }
+}
+
+TEST_F(plKeyImpTest, Clones)
+{
+    const uint32_t kNumPlayers = 200;
+    plKeyImp* owner = MakeKey(0);
+    std::vector<plKeyImp*> clones;
+    for (uint32_t i = 0; i < kNumPlayers; i++)
+        clones.push_back(MakeClone(owner, 1000 + i, 1 + i % 3));
+    EXPECT_EQ(kNumPlayers, owner->GetNumClones());
+
+    for (uint32_t i = 0; i < kNumPlayers; i++)
+        EXPECT_EQ(plKey::Make(clones[i]), owner->GetClone(1000 + i, 1 + i % 3));
+    EXPECT_EQ(plKey(), owner->GetClone(1000, 2));
+    EXPECT_EQ(plKey(), owner->GetClone(999, 1));
+
+    // Every other player leaves
+    for (uint32_t i = 0; i < kNumPlayers; i += 2)
+    {
+        owner->RemoveClone(clones[i]);
+        EXPECT_EQ(plKey(), clones[i]->GetCloneOwner());
+    }
+    EXPECT_EQ(kNumPlayers / 2, owner->GetNumClones());
+    for (uint32_t i = 0; i < kNumPlayers; i++)
+    {
+        plKey expected = (i % 2) ? plKey::Make(clones[i]) : plKey();
+        EXPECT_EQ(expected, owner->GetClone(1000 + i, 1 + i % 3)) << "player " << i;
+    }
+    for (uint32_t i = 0; i < owner->GetNumClones(); i++)
+    {
+        uint32_t player = owner->GetCloneByIdx(i)->GetUoid().GetClonePlayerID();
+        EXPECT_EQ(1, (player - 1000) % 2);
+    }
+}
@@ -0,0 +1,597 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsResMgr.h"
+#include "plgDispatch.h"
+#include "pnFactory/plCreator.h"
+#include "pnMessage/plAttachMsg.h"
+#include "pnMessage/plCorrectionMsg.h"
+#include "pnMessage/plEnableMsg.h"
+#include "pnMessage/plIntRefMsg.h"
+#include "pnMessage/plMessageWithCallbacks.h"
+#include "pnMessage/plNodeChangeMsg.h"
+#include "pnMessage/plNodeRefMsg.h"
+#include "pnMessage/plObjRefMsg.h"
+#include "pnMessage/plSelfDestructMsg.h"
+#include "pnMessage/plSetNetGroupIDMsg.h"
+#include "pnMessage/plSimulationMsg.h"
+#include "pnMessage/plSimulationSynchMsg.h"
+#include "pnMessage/plSoundMsg.h"
+#include "pnMessage/plTimeMsg.h"
+#include "pnMessage/plWarpMsg.h"
+#include "pnModifier/plSingleModifier.h"
+#include "pnNetCommon/plNetApp.h"
+#include "pnSceneObject/plAudioInterface.h"
+#include "pnSceneObject/plCoordinateInterface.h"
+#include "pnSceneObject/plDrawInterface.h"
+#include "pnSceneObject/plSceneObject.h"
+#include "pnSceneObject/plSimulationInterface.h"
+#include "pnSceneObject/plTransformHierarchy.h"
+#include "pfAnimation/plFilterCoordInterface.h"
+
+// Just the creatables we use, and the ones plSceneObject and its interfaces
+// ask about. The full pnNucleus list would drag in most of the engine.
+REGISTER_NONCREATABLE( plDispatchBase );
+REGISTER_NONCREATABLE( plReceiver );
+REGISTER_NONCREATABLE( hsKeyedObject );
+REGISTER_NONCREATABLE( plSynchedObject );
+REGISTER_NONCREATABLE( plNetApp );
+REGISTER_NONCREATABLE( plNetClientApp );
+REGISTER_NONCREATABLE( plModifier );
+REGISTER_NONCREATABLE( plSingleModifier );
+REGISTER_NONCREATABLE( plObjInterface );
+REGISTER_CREATABLE( plCoordinateInterface );
+REGISTER_CREATABLE( plFilterCoordInterface );
+REGISTER_NONCREATABLE( plDrawInterface );
+REGISTER_NONCREATABLE( plSimulationInterface );
+REGISTER_NONCREATABLE( plAudioInterface );
+REGISTER_CREATABLE( plSceneObject );
+REGISTER_NONCREATABLE( plMessage );
+REGISTER_CREATABLE( plRefMsg );
+REGISTER_CREATABLE( plGenRefMsg );
+REGISTER_CREATABLE( plIntRefMsg );
+REGISTER_NONCREATABLE( plObjRefMsg );
+REGISTER_NONCREATABLE( plNodeRefMsg );
+REGISTER_NONCREATABLE( plTimeMsg );
+REGISTER_NONCREATABLE( plEvalMsg );
+REGISTER_CREATABLE( plTransformMsg );
+REGISTER_CREATABLE( plDelayedTransformMsg );
+REGISTER_NONCREATABLE( plMessageWithCallbacks );
+REGISTER_NONCREATABLE( plAttachMsg );
+REGISTER_NONCREATABLE( plCorrectionMsg );
+REGISTER_NONCREATABLE( plEnableMsg );
+REGISTER_NONCREATABLE( plNodeChangeMsg );
+REGISTER_NONCREATABLE( plSelfDestructMsg );
+REGISTER_NONCREATABLE( plSetNetGroupIDMsg );
+REGISTER_NONCREATABLE( plSimulationMsg );
+REGISTER_NONCREATABLE( plSimulationSynchMsg );
+REGISTER_NONCREATABLE( plSoundMsg );
+REGISTER_NONCREATABLE( plWarpMsg );
+
+// The recursive path registers for transform messages, which we deliver by hand
+class TestDispatch : public plDispatchBase
+{
+public:
+    void RegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void RegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterAll(const plKey&) HS_OVERRIDE { }
+    bool MsgSend(plMessage* msg, bool) HS_OVERRIDE { hsRefCnt_SafeUnRef(msg); return true; }
+    void MsgQueue(plMessage*) HS_OVERRIDE { }
+    void MsgQueueProcess() HS_OVERRIDE { }
+    void MsgQueueOnOff(bool) HS_OVERRIDE { }
+    bool SetMsgBuffering(bool) HS_OVERRIDE { return false; }
+    void BeginShutdown() HS_OVERRIDE { }
+};
+
+// Only there for the dispatcher
+class TestResMgr : public hsResMgr
+{
+public:
+    TestDispatch fDispatch;
+
+    void  Load(const plKey&) HS_OVERRIDE { }
+    bool  Unload(const plKey&) HS_OVERRIDE { return false; }
+    plKey CloneKey(const plKey&) HS_OVERRIDE { return nil; }
+    plKey FindKey(const plUoid&) HS_OVERRIDE { return nil; }
+    bool  AddViaNotify(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  AddViaNotify(plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(hsKeyedObject*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    plKey ReadKeyNotifyMe(hsStream*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return nil; }
+    plKey ReadKey(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteKey(hsStream*, hsKeyedObject*) HS_OVERRIDE { }
+    void  WriteKey(hsStream*, const plKey&) HS_OVERRIDE { }
+    plCreatable* ReadCreatable(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatable(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plCreatable* ReadCreatableVersion(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatableVersion(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plKey NewKey(const ST::string&, hsKeyedObject*, const plLocation&, const plLoadMask&) HS_OVERRIDE { return nil; }
+    plKey NewKey(plUoid&, hsKeyedObject*) HS_OVERRIDE { return nil; }
+    plDispatchBase* Dispatch() HS_OVERRIDE { return &fDispatch; }
+
+protected:
+    plKey ReRegister(const ST::string&, const plUoid&) HS_OVERRIDE { return nil; }
+    bool  ReadObject(plKeyImp*) HS_OVERRIDE { return false; }
+    void  IKeyReffed(plKeyImp*) HS_OVERRIDE { }
+    void  IKeyUnreffed(plKeyImp*) HS_OVERRIDE { }
+    bool  IReset() HS_OVERRIDE { return true; }
+    bool  IInit() HS_OVERRIDE { return true; }
+    void  IShutdown() HS_OVERRIDE { }
+};
+
+// Sees every transform its object is handed, and can act on one
+class TestMod : public plSingleModifier
+{
+public:
+    uint32_t                fSends;
+    hsMatrix44              fLocalToWorld;
+    std::function<void()>   fOnNextSend;
+
+    TestMod() : fSends(0) { fLocalToWorld.Reset(); }
+
+    void SetTransform(const hsMatrix44& l2w, const hsMatrix44&) HS_OVERRIDE
+    {
+        fSends++;
+        fLocalToWorld = l2w;
+        if (fOnNextSend)
+        {
+            std::function<void()> onSend;
+            onSend.swap(fOnNextSend);
+            onSend();
+        }
+    }
+
+protected:
+    bool IEval(double, float, uint32_t) HS_OVERRIDE { return false; }
+};
+
+//
+// Two trees, the first several levels deep:
+//
+//  0 -+- 1 -+- 3 --- 6 --- 10
+//     |     +- 4* -+- 7*
+//     |            +- 8* (filter)
+//     +- 2 (filter) --- 5 --- 9 --- 11
+//
+// 12 --- 13
+//
+// where * holds back for the delayed pass.
+//
+struct NodeDesc
+{
+    int     fParent;
+    bool    fFilter;
+    bool    fDelayed;
+};
+
+static const NodeDesc kNodes[] = {
+    { -1, false, false },
+    {  0, false, false },
+    {  0, true,  false },
+    {  1, false, false },
+    {  1, false, true  },
+    {  2, false, false },
+    {  3, false, false },
+    {  4, false, true  },
+    {  4, true,  true  },
+    {  5, false, false },
+    {  6, false, false },
+    {  9, false, false },
+    { -1, false, false },
+    { 12, false, false },
+};
+static const int kNumNodes = sizeof(kNodes) / sizeof(kNodes[0]);
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+static void MakeTRS(uint32_t& seed, hsMatrix44& l2p, hsMatrix44& p2l)
+{
+    hsVector3 trans(Rand(seed) * 10.f - 5.f, Rand(seed) * 10.f - 5.f, Rand(seed) * 10.f - 5.f);
+    float scale = 0.5f + Rand(seed);
+    hsVector3 scales(scale, scale, scale);
+
+    hsMatrix44 xlate, rot, scl;
+    xlate.MakeTranslateMat(&trans);
+    rot.MakeRotateMat(int(Rand(seed) * 2.99f), Rand(seed) * 6.f);
+    scl.MakeScaleMat(&scales);
+
+    l2p = xlate * rot * scl;
+    l2p.GetInverse(&p2l);
+}
+
+static bool MatrixClose(const hsMatrix44& a, const hsMatrix44& b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            if (std::fabs(a.fMap[i][j] - b.fMap[i][j]) > 1.e-3f)
+                return false;
+        }
+    }
+    return true;
+}
+
+// What a scene looked like at one point of a script
+struct Snapshot
+{
+    std::string             fWhen;
+    std::vector<hsMatrix44> fLocalToWorld;
+    std::vector<hsMatrix44> fWorldToLocal;
+    std::vector<hsMatrix44> fSeen;          // what each object was last handed
+    std::vector<uint32_t>   fSends;
+};
+
+// One copy of the hierarchy, driven through either the flat store or the
+// transform messages and recursion it replaces.  Only one exists at a time,
+// since turning the store off settles whatever it still has queued.
+class TestScene
+{
+public:
+    bool                                fFlat;
+    std::vector<plSceneObject*>         fObjects;
+    std::vector<plCoordinateInterface*> fCIs;
+    std::vector<TestMod*>               fMods;
+    std::vector<Snapshot>               fSnapshots;
+
+    TestScene(bool flat) : fFlat(flat)
+    {
+        plTransformHierarchy::SetEnabled(fFlat);
+
+        uint32_t seed = 7;
+        int i;
+        for (i = 0; i < kNumNodes; i++)
+        {
+            plSceneObject* so = new plSceneObject;
+            plCoordinateInterface* ci;
+            if (kNodes[i].fFilter)
+            {
+                plFilterCoordInterface* filter = new plFilterCoordInterface;
+                filter->SetFilterMask(i == 2 ? plFilterCoordInterface::kNoRotation : plFilterCoordInterface::kNoTransZ);
+                hsMatrix44 ref, inv;
+                MakeTRS(seed, ref, inv);
+                filter->SetRefLocalToWorld(ref);
+                ci = filter;
+            }
+            else
+                ci = new plCoordinateInterface;
+            ci->SetProperty(plCoordinateInterface::kCanEverDelayTransform, kNodes[i].fDelayed);
+            ci->SetProperty(plCoordinateInterface::kDelayedTransformEval, kNodes[i].fDelayed);
+
+            hsMatrix44 l2p, p2l;
+            MakeTRS(seed, l2p, p2l);
+            ci->SetLocalToParent(l2p, p2l);
+
+            TestMod* mod = new TestMod;
+            so->AddModifier(mod);
+            so->SetCoordinateInterface(ci);
+
+            fObjects.push_back(so);
+            fCIs.push_back(ci);
+            fMods.push_back(mod);
+        }
+        for (i = 0; i < kNumNodes; i++)
+        {
+            if (kNodes[i].fParent >= 0)
+                AddChild(kNodes[i].fParent, i);
+        }
+        RunPhase(plTransformHierarchy::kPhaseNormal);
+        RunPhase(plTransformHierarchy::kPhaseDelayed);
+        Snap("after loading");
+    }
+
+    ~TestScene()
+    {
+        // Take the interfaces away from their objects first, so neither one
+        // goes looking for the other once it's gone
+        int i;
+        for (i = kNumNodes - 1; i >= 0; i--)
+        {
+            fObjects[i]->SetCoordinateInterface(nil);
+            delete fCIs[i];
+        }
+        for (i = 0; i < kNumNodes; i++)
+        {
+            delete fObjects[i];
+            delete fMods[i];
+        }
+        plTransformHierarchy::SetEnabled(false);
+    }
+
+    void AddChild(int parent, int child)
+    {
+        plIntRefMsg* msg = new plIntRefMsg(nil, plRefMsg::kOnCreate, -1, plIntRefMsg::kChildObject);
+        msg->SetRef(fObjects[child]);
+        fCIs[parent]->MsgReceive(msg);
+        hsRefCnt_SafeUnRef(msg);
+    }
+
+    void RemoveChild(int parent, int child)
+    {
+        plIntRefMsg* msg = new plIntRefMsg(nil, plRefMsg::kOnDestroy, -1, plIntRefMsg::kChildObject);
+        msg->SetRef(fObjects[child]);
+        fCIs[parent]->MsgReceive(msg);
+        hsRefCnt_SafeUnRef(msg);
+    }
+
+    void Move(int i, uint32_t seed)
+    {
+        hsMatrix44 l2p, p2l;
+        MakeTRS(seed, l2p, p2l);
+        fCIs[i]->SetLocalToParent(l2p, p2l);
+    }
+
+    // What the client does once per transform phase
+    void RunPhase(plTransformHierarchy::Phase phase)
+    {
+        if (phase == plTransformHierarchy::kPhaseDelayed)
+            plCoordinateInterface::SetTransformPhase(plCoordinateInterface::kTransformPhaseDelayed);
+
+        if (fFlat)
+            plTransformHierarchy::Instance()->Flush(phase);
+        else
+        {
+            // Every root gets it, registered or not; the ones with nothing
+            // dirty do nothing with it.
+            int i;
+            for (i = 0; i < kNumNodes; i++)
+            {
+                if (fCIs[i]->GetParent())
+                    continue;
+                plTransformMsg* msg = phase == plTransformHierarchy::kPhaseDelayed
+                                    ? new plDelayedTransformMsg(nil, nil, nil, nil)
+                                    : new plTransformMsg(nil, nil, nil, nil);
+                fObjects[i]->MsgReceive(msg);
+                hsRefCnt_SafeUnRef(msg);
+            }
+        }
+
+        plCoordinateInterface::SetTransformPhase(plCoordinateInterface::kTransformPhaseNormal);
+    }
+
+    void RunPhases()
+    {
+        RunPhase(plTransformHierarchy::kPhaseNormal);
+        RunPhase(plTransformHierarchy::kPhaseDelayed);
+    }
+
+    void Snap(const char* when)
+    {
+        Snapshot snap;
+        snap.fWhen = when;
+        int i;
+        for (i = 0; i < kNumNodes; i++)
+        {
+            snap.fLocalToWorld.push_back(fCIs[i]->GetLocalToWorld());
+            snap.fWorldToLocal.push_back(fCIs[i]->GetWorldToLocal());
+            snap.fSeen.push_back(fMods[i]->fLocalToWorld);
+            snap.fSends.push_back(fMods[i]->fSends);
+        }
+        fSnapshots.push_back(snap);
+    }
+
+    const char* Name() const { return fFlat ? "flat" : "recursive"; }
+};
+
+//
+// Run the script through the flat store, then again through the transform
+// messages, and expect the same transforms everywhere it took a snapshot.
+// Send counts are compared too unless the two are known to get there in
+// different numbers of steps.
+//
+static void ExpectSameTransforms(const std::function<void(TestScene&)>& script, bool sameSends)
+{
+    std::vector<Snapshot> flat, recursive;
+    {
+        TestScene scene(true);
+        script(scene);
+        flat = scene.fSnapshots;
+    }
+    {
+        TestScene scene(false);
+        script(scene);
+        recursive = scene.fSnapshots;
+    }
+
+    ASSERT_EQ(flat.size(), recursive.size());
+    size_t s;
+    for (s = 0; s < flat.size(); s++)
+    {
+        const char* when = flat[s].fWhen.c_str();
+        int i;
+        for (i = 0; i < kNumNodes; i++)
+        {
+            EXPECT_TRUE(MatrixClose(flat[s].fLocalToWorld[i], recursive[s].fLocalToWorld[i]))
+                << "l2w of node " << i << " " << when;
+            EXPECT_TRUE(MatrixClose(flat[s].fWorldToLocal[i], recursive[s].fWorldToLocal[i]))
+                << "w2l of node " << i << " " << when;
+            EXPECT_TRUE(MatrixClose(flat[s].fSeen[i], recursive[s].fSeen[i]))
+                << "transform node " << i << "'s object last saw " << when;
+            if (sameSends)
+                EXPECT_EQ(flat[s].fSends[i], recursive[s].fSends[i]) << "sends to node " << i << " " << when;
+        }
+    }
+}
+
+class plTransformHierarchyTest : public ::testing::Test
+{
+protected:
+    void SetUp() HS_OVERRIDE
+    {
+        // hsgResMgr takes our ref
+        hsgResMgr::Init(new TestResMgr);
+    }
+
+    void TearDown() HS_OVERRIDE
+    {
+        plTransformHierarchy::SetEnabled(false);
+        hsgResMgr::Shutdown();
+    }
+};
+
+TEST_F(plTransformHierarchyTest, OffByDefault)
+{
+    EXPECT_FALSE(plTransformHierarchy::GetEnabled());
+}
+
+TEST_F(plTransformHierarchyTest, FlushMatchesRecursion)
+{
+    ExpectSameTransforms([](TestScene& scene)
+    {
+        // Moves a few nodes a frame, whole subtrees and leaves, delayed or not
+        static const int kMoves[][3] = {
+            {  0, -1, -1 },
+            {  3, 12, -1 },
+            {  4, -1, -1 },
+            {  7,  9, -1 },
+            {  2,  8, 13 },
+            {  1,  5, 11 },
+            { 10,  4,  0 },
+        };
+        static const uint32_t kNumMoves = sizeof(kMoves) / sizeof(kMoves[0]);
+        for (uint32_t frame = 0; frame < 3 * kNumMoves; frame++)
+        {
+            const int* moves = kMoves[frame % kNumMoves];
+            int m;
+            for (m = 0; m < 3 && moves[m] >= 0; m++)
+                scene.Move(moves[m], frame * 31 + m);
+
+            scene.RunPhase(plTransformHierarchy::kPhaseNormal);
+            scene.Snap("after the normal pass");
+            scene.RunPhase(plTransformHierarchy::kPhaseDelayed);
+            scene.Snap("after the delayed pass");
+        }
+    }, true);
+}
+
+TEST_F(plTransformHierarchyTest, DelayedNodesWaitForTheDelayedPass)
+{
+    ExpectSameTransforms([](TestScene& scene)
+    {
+        // The parent of the delayed subtree moves
+        hsMatrix44 before = scene.fCIs[7]->GetLocalToWorld();
+        uint32_t sends4 = scene.fMods[4]->fSends;
+        uint32_t sends7 = scene.fMods[7]->fSends;
+        scene.Move(1, 99);
+
+        scene.RunPhase(plTransformHierarchy::kPhaseNormal);
+        scene.Snap("after the normal pass");
+
+        // 4 was recalced on its parent's account, its children were left alone
+        EXPECT_EQ(sends4 + 1, scene.fMods[4]->fSends) << scene.Name();
+        EXPECT_EQ(sends7, scene.fMods[7]->fSends) << scene.Name();
+        EXPECT_TRUE(MatrixClose(before, scene.fCIs[7]->GetLocalToWorld())) << scene.Name();
+
+        scene.RunPhase(plTransformHierarchy::kPhaseDelayed);
+        scene.Snap("after the delayed pass");
+        EXPECT_FALSE(MatrixClose(before, scene.fCIs[7]->GetLocalToWorld())) << scene.Name();
+    }, true);
+}
+
+TEST_F(plTransformHierarchyTest, FlushTransformMatchesRecursion)
+{
+    ExpectSameTransforms([](TestScene& scene)
+    {
+        // From the root, and from under it, delayed nodes included
+        static const int kFlushFrom[] = { 0, 8, 11, 13 };
+        uint32_t seed = 1000;
+        for (int from : kFlushFrom)
+        {
+            int i;
+            for (i = 0; i < kNumNodes; i += 3)
+                scene.Move(i, seed++);
+
+            scene.fCIs[from]->FlushTransform();
+            scene.Snap("after FlushTransform");
+        }
+
+        // And nothing left for the passes to do
+        scene.RunPhases();
+        scene.Snap("after the passes");
+    }, true);
+}
+
+TEST_F(plTransformHierarchyTest, ReparentDuringSetTransform)
+{
+    // When 3 hears it moved, it takes 9 (and 11 with it) away from 5 and
+    // hands it to 6, which hasn't been updated yet.  The flat store gives up
+    // on the rest of the tree and does it all again next time around, so
+    // only the end results are comparable.
+    ExpectSameTransforms([](TestScene& scene)
+    {
+        TestScene* s = &scene;
+        scene.fMods[3]->fOnNextSend = [s]()
+        {
+            s->RemoveChild(5, 9);
+            s->AddChild(6, 9);
+        };
+        scene.Move(1, 555);
+        scene.Move(5, 556);
+
+        scene.RunPhases();
+        EXPECT_EQ(scene.fCIs[6], scene.fCIs[9]->GetParent()) << scene.Name();
+
+        scene.RunPhases();
+        scene.Snap("once the reparent settled");
+
+        hsMatrix44 l2w = scene.fCIs[6]->GetLocalToWorld() * scene.fCIs[9]->GetLocalToParent();
+        EXPECT_TRUE(MatrixClose(l2w, scene.fCIs[9]->GetLocalToWorld())) << scene.Name();
+
+        // ...and both keep going from there
+        scene.Move(6, 557);
+        scene.RunPhases();
+        scene.Snap("after moving the new parent");
+    }, false);
+}
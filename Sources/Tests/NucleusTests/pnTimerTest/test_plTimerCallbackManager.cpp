@@ -0,0 +1,325 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsResMgr.h"
+#include "plgDispatch.h"
+#include "plTimerCallbackManager.h"
+#include "pnFactory/plCreator.h"
+#include "pnKeyedObject/plKeyImp.h"
+#include "pnMessage/plEventCallbackMsg.h"
+#include "pnMessage/plTimeMsg.h"
+
+// Just the creatables we use, the full pnNucleus list would drag in most of
+// the engine.
+REGISTER_NONCREATABLE( plDispatchBase );
+REGISTER_NONCREATABLE( plReceiver );
+REGISTER_CREATABLE( hsKeyedObject );
+REGISTER_CREATABLE( plTimerCallbackManager );
+REGISTER_NONCREATABLE( plMessage );
+REGISTER_CREATABLE( plTimeMsg );
+REGISTER_CREATABLE( plEventCallbackMsg );
+
+// Remembers the fUser of every callback message sent, in order
+class TestDispatch : public plDispatchBase
+{
+public:
+    std::vector<int> fSent;
+
+    void RegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void RegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterForExactType(uint16_t, const plKey&) HS_OVERRIDE { }
+    void UnRegisterAll(const plKey&) HS_OVERRIDE { }
+
+    bool MsgSend(plMessage* msg, bool) HS_OVERRIDE
+    {
+        fSent.push_back(plEventCallbackMsg::ConvertNoRef(msg)->fUser);
+        hsRefCnt_SafeUnRef(msg);
+        return true;
+    }
+
+    void MsgQueue(plMessage*) HS_OVERRIDE { }
+    void MsgQueueProcess() HS_OVERRIDE { }
+    void MsgQueueOnOff(bool) HS_OVERRIDE { }
+    bool SetMsgBuffering(bool) HS_OVERRIDE { return false; }
+    void BeginShutdown() HS_OVERRIDE { }
+};
+
+// Only there for the dispatcher and key refcounting
+class TestResMgr : public hsResMgr
+{
+public:
+    TestDispatch fDispatch;
+
+    void  Load(const plKey&) HS_OVERRIDE { }
+    bool  Unload(const plKey&) HS_OVERRIDE { return false; }
+    plKey CloneKey(const plKey&) HS_OVERRIDE { return nil; }
+    plKey FindKey(const plUoid&) HS_OVERRIDE { return nil; }
+    bool  AddViaNotify(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  AddViaNotify(plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(const plKey&, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    bool  SendRef(hsKeyedObject*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return false; }
+    plKey ReadKeyNotifyMe(hsStream*, plRefMsg*, plRefFlags::Type) HS_OVERRIDE { return nil; }
+    plKey ReadKey(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteKey(hsStream*, hsKeyedObject*) HS_OVERRIDE { }
+    void  WriteKey(hsStream*, const plKey&) HS_OVERRIDE { }
+    plCreatable* ReadCreatable(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatable(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plCreatable* ReadCreatableVersion(hsStream*) HS_OVERRIDE { return nil; }
+    void  WriteCreatableVersion(hsStream*, plCreatable*) HS_OVERRIDE { }
+    plKey NewKey(const ST::string&, hsKeyedObject*, const plLocation&, const plLoadMask&) HS_OVERRIDE { return nil; }
+    plKey NewKey(plUoid&, hsKeyedObject*) HS_OVERRIDE { return nil; }
+    plDispatchBase* Dispatch() HS_OVERRIDE { return &fDispatch; }
+
+protected:
+    plKey ReRegister(const ST::string&, const plUoid&) HS_OVERRIDE { return nil; }
+    bool  ReadObject(plKeyImp*) HS_OVERRIDE { return false; }
+    void  IKeyReffed(plKeyImp*) HS_OVERRIDE { }
+    void  IKeyUnreffed(plKeyImp*) HS_OVERRIDE { }
+    bool  IReset() HS_OVERRIDE { return true; }
+    bool  IInit() HS_OVERRIDE { return true; }
+    void  IShutdown() HS_OVERRIDE { }
+};
+
+class plTimerCallbackManagerTest : public ::testing::Test
+{
+protected:
+    TestResMgr* fResMgr;
+    std::vector<plKeyImp*> fKeys;
+
+    void SetUp() HS_OVERRIDE
+    {
+        // hsgResMgr takes our ref
+        fResMgr = new TestResMgr;
+        hsgResMgr::Init(fResMgr);
+    }
+
+    void TearDown() HS_OVERRIDE
+    {
+        hsgResMgr::Shutdown();
+        for (plKeyImp* key : fKeys)
+            delete key;
+    }
+
+    const std::vector<int>& Sent() const { return fResMgr->fDispatch.fSent; }
+
+    plKey MakeKey(const char* name)
+    {
+        plKeyImp* key = new plKeyImp(plUoid(plLocation::MakeNormal(1), hsKeyedObject::Index(), name), 0, 0);
+        fKeys.push_back(key);
+        return plKey::Make(key);
+    }
+
+    static plMessage* MakeMsg(int id, const plKey& receiver = nil)
+    {
+        return new plEventCallbackMsg(receiver, kTime, 0, 0.f, -1, uint16_t(id));
+    }
+
+    static void Tick(plTimerCallbackManager& mgr, double time)
+    {
+        plTimeMsg* msg = new plTimeMsg(nil, nil, &time, nil);
+        mgr.MsgReceive(msg);
+        hsRefCnt_SafeUnRef(msg);
+    }
+};
+
+TEST_F(plTimerCallbackManagerTest, FiresAllDueInOrder)
+{
+    plTimerCallbackManager mgr;
+    const float times[] = { 5.f, 1.f, 3.f, 2.f, 4.f, 3.f, 10.f };
+    for (int i = 0; i < 7; i++)
+        mgr.NewTimer(times[i], MakeMsg(i));
+    EXPECT_EQ(7, mgr.GetNumCallbacks());
+
+    Tick(mgr, 0.5);
+    EXPECT_TRUE(Sent().empty());
+
+    // Everything due goes out on one tick, soonest first, and equal times in
+    // the order they were added
+    Tick(mgr, 3.0);
+    EXPECT_EQ(std::vector<int>({ 1, 3, 2, 5 }), Sent());
+
+    Tick(mgr, 9.0);
+    EXPECT_EQ(std::vector<int>({ 1, 3, 2, 5, 4, 0 }), Sent());
+    EXPECT_EQ(1, mgr.GetNumCallbacks());
+
+    Tick(mgr, 10.0);
+    EXPECT_EQ(7, Sent().size());
+    EXPECT_EQ(0, mgr.GetNumCallbacks());
+}
+
+TEST_F(plTimerCallbackManagerTest, CancelByHandle)
+{
+    plTimerCallbackManager mgr;
+    std::vector<plTimerCallback*> handles;
+    for (int i = 0; i < 20; i++)
+        handles.push_back(mgr.NewTimer(float((i * 7) % 20), MakeMsg(i)));
+
+    // From the top of the heap, the bottom and the middle
+    EXPECT_TRUE(mgr.CancelCallback(handles[0]));
+    EXPECT_TRUE(mgr.CancelCallback(handles[19]));
+    EXPECT_TRUE(mgr.CancelCallback(handles[10]));
+    EXPECT_FALSE(mgr.CancelCallback(nil));
+    EXPECT_EQ(17, mgr.GetNumCallbacks());
+
+    Tick(mgr, 100.0);
+    std::vector<int> expected;
+    for (int t = 0; t < 20; t++)
+    {
+        for (int i = 0; i < 20; i++)
+        {
+            if ((i * 7) % 20 == t && i != 0 && i != 19 && i != 10)
+                expected.push_back(i);
+        }
+    }
+    EXPECT_EQ(expected, Sent());
+}
+
+TEST_F(plTimerCallbackManagerTest, CancelByReceiver)
+{
+    plTimerCallbackManager mgr;
+    plKey a = MakeKey("A");
+    plKey b = MakeKey("B");
+
+    mgr.NewTimer(1.f, MakeMsg(0, a));
+    mgr.NewTimer(2.f, MakeMsg(1, b));
+    mgr.NewTimer(3.f, MakeMsg(2, a));
+    plMessage* both = MakeMsg(3, a);
+    both->AddReceiver(b);
+    mgr.NewTimer(4.f, both);
+    mgr.NewTimer(5.f, MakeMsg(4));
+
+    EXPECT_TRUE(mgr.CancelCallbacksToKey(a));
+    EXPECT_FALSE(mgr.CancelCallbacksToKey(a));
+    EXPECT_EQ(2, mgr.GetNumCallbacks());
+
+    Tick(mgr, 10.0);
+    EXPECT_EQ(std::vector<int>({ 1, 4 }), Sent());
+
+    // Fired callbacks are gone from the index too
+    EXPECT_FALSE(mgr.CancelCallbacksToKey(b));
+}
+
+TEST_F(plTimerCallbackManagerTest, DuplicateReceiver)
+{
+    plTimerCallbackManager mgr;
+    plKey a = MakeKey("A");
+    plKey b = MakeKey("B");
+
+    // AddReceiver doesn't check for repeats
+    plMessage* twice = MakeMsg(0, a);
+    twice->AddReceiver(b);
+    twice->AddReceiver(a);
+    mgr.NewTimer(1.f, twice);
+    plMessage* again = MakeMsg(1, a);
+    again->AddReceiver(a);
+    mgr.NewTimer(2.f, again);
+    mgr.NewTimer(3.f, MakeMsg(2, b));
+
+    EXPECT_TRUE(mgr.CancelCallbacksToKey(a));
+    EXPECT_FALSE(mgr.CancelCallbacksToKey(a));
+    EXPECT_EQ(1, mgr.GetNumCallbacks());
+
+    // Firing one with a repeated receiver cleans up after it too
+    plMessage* fired = MakeMsg(3, a);
+    fired->AddReceiver(a);
+    mgr.NewTimer(0.5f, fired);
+    Tick(mgr, 1.0);
+    EXPECT_EQ(std::vector<int>({ 3 }), Sent());
+    EXPECT_FALSE(mgr.CancelCallbacksToKey(a));
+
+    EXPECT_TRUE(mgr.CancelCallbacksToKey(b));
+    EXPECT_EQ(0, mgr.GetNumCallbacks());
+}
+
+TEST_F(plTimerCallbackManagerTest, ManyTimers)
+{
+    const int kNumTimers = 2000;
+    const int kNumReceivers = 50;
+
+    std::vector<plKey> receivers;
+    for (int i = 0; i < kNumReceivers; i++)
+        receivers.push_back(MakeKey("Receiver"));
+
+    plTimerCallbackManager mgr;
+    std::vector<plTimerCallback*> handles;
+    std::vector<float> times;
+    uint32_t seed = 1;
+    for (int i = 0; i < kNumTimers; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        times.push_back(float((seed >> 16) % 10000) / 100.f);
+        handles.push_back(mgr.NewTimer(times.back(), MakeMsg(i, receivers[i % kNumReceivers])));
+    }
+
+    std::vector<bool> live(kNumTimers, true);
+    for (int i = 0; i < kNumTimers; i += 4)
+    {
+        EXPECT_TRUE(mgr.CancelCallback(handles[i]));
+        live[i] = false;
+    }
+    for (int r = 0; r < kNumReceivers; r += 10)
+    {
+        EXPECT_TRUE(mgr.CancelCallbacksToKey(receivers[r]));
+        for (int i = r; i < kNumTimers; i += kNumReceivers)
+            live[i] = false;
+    }
+    size_t remaining = std::count(live.begin(), live.end(), true);
+    EXPECT_EQ(remaining, mgr.GetNumCallbacks());
+
+    // A second's worth of ticks over the whole range, and everything left
+    // goes out soonest first
+    for (int frame = 1; frame <= 60; frame++)
+        Tick(mgr, frame * 100.0 / 60.0);
+    EXPECT_EQ(0, mgr.GetNumCallbacks());
+    ASSERT_EQ(remaining, Sent().size());
+    for (size_t i = 0; i < Sent().size(); i++)
+    {
+        EXPECT_TRUE(live[Sent()[i]]) << Sent()[i];
+        if (i > 0)
+            EXPECT_LE(times[Sent()[i - 1]], times[Sent()[i]]);
+    }
+}
@@ -0,0 +1,179 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cstring>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plCompression/plLZ4Compress.h"
+#include "plCompression/plZlibCompress.h"
+
+typedef std::vector<uint8_t> Payload;
+
+static Payload MakeRandom(uint32_t size, uint32_t seed)
+{
+    Payload data(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    return data;
+}
+
+// Looks roughly like a streamed SDL state: a creatable index, then a run of
+// variable records with names, flags, small ints and floats that mostly repeat.
+static Payload MakeStateLike(uint32_t numVars, uint32_t seed)
+{
+    static const char* kNames[] = { "position", "rotation", "enabled", "state", "timer", "owner" };
+
+    hsRAMStream s;
+    s.WriteLE16(0x02B0);
+    for (uint32_t i = 0; i < numVars; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        s.WriteSafeString(kNames[i % arrsize(kNames)]);
+        s.WriteByte((uint8_t)(i & 3));
+        s.WriteLE32(seed % 8);
+        s.WriteLEScalar(float(i) * 0.25f);
+        s.WriteLEScalar(float(seed >> 20));
+    }
+
+    Payload data(s.GetEOF());
+    s.Rewind();
+    s.Read(data.size(), data.data());
+    return data;
+}
+
+static Payload RoundTrip(plCompress& codec, const Payload& data, uint32_t* compressedSize=nullptr)
+{
+    Payload compressed(codec.GetMaxCompressedSize(data.size()));
+    uint32_t len = compressed.size();
+    EXPECT_TRUE(codec.Compress(compressed.data(), &len, data.data(), data.size()));
+    EXPECT_LE(len, codec.GetMaxCompressedSize(data.size()));
+    if (compressedSize)
+        *compressedSize = len;
+
+    Payload result(data.size());
+    uint32_t outLen = result.size();
+    EXPECT_TRUE(codec.Uncompress(result.data(), &outLen, compressed.data(), len));
+    result.resize(outLen);
+    return result;
+}
+
+TEST(plLZ4Compress, RoundTrip)
+{
+    plLZ4Compress codec;
+    static const uint32_t kSizes[] = { 0, 1, 12, 13, 100, 4096, 70000, 300000 };
+    for (uint32_t size : kSizes)
+    {
+        Payload random = MakeRandom(size, size);
+        EXPECT_EQ(random, RoundTrip(codec, random)) << "random " << size;
+
+        Payload runs(size, 'x');
+        for (uint32_t i = 0; i < size; i += 37)
+            runs[i] = (uint8_t)i;
+        EXPECT_EQ(runs, RoundTrip(codec, runs)) << "runs " << size;
+    }
+
+    // The same instance keeps working across calls
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        Payload state = MakeStateLike(10 + i, i);
+        uint32_t compressedSize;
+        EXPECT_EQ(state, RoundTrip(codec, state, &compressedSize));
+        EXPECT_LT(compressedSize, state.size());
+    }
+}
+
+TEST(plLZ4Compress, RejectsBadInput)
+{
+    plLZ4Compress codec;
+    Payload state = MakeStateLike(50, 1);
+    Payload compressed(codec.GetMaxCompressedSize(state.size()));
+    uint32_t len = compressed.size();
+    ASSERT_TRUE(codec.Compress(compressed.data(), &len, state.data(), state.size()));
+
+    // Output too small
+    Payload out(state.size() - 1);
+    uint32_t outLen = out.size();
+    EXPECT_FALSE(codec.Uncompress(out.data(), &outLen, compressed.data(), len));
+
+    // Truncated input never reads or writes out of bounds
+    out.resize(state.size());
+    for (uint32_t cut = 1; cut < len; cut++)
+    {
+        outLen = out.size();
+        codec.Uncompress(out.data(), &outLen, compressed.data(), cut);
+        EXPECT_LE(outLen, out.size());
+    }
+}
+
+TEST(plLZ4Compress, InPlace)
+{
+    plLZ4Compress codec;
+    Payload state = MakeStateLike(40, 7);
+
+    uint32_t len = state.size();
+    uint8_t* buf = new uint8_t[len];
+    memcpy(buf, state.data(), len);
+
+    ASSERT_TRUE(codec.Compress(&buf, &len, 2));
+    EXPECT_LT(len, state.size());
+    EXPECT_EQ(0, memcmp(buf, state.data(), 2));
+
+    ASSERT_TRUE(codec.Uncompress(&buf, &len, state.size() - 2, 2));
+    EXPECT_EQ(state, Payload(buf, buf + len));
+    delete [] buf;
+}
+
+TEST(plZlibCompress, ReusedContext)
+{
+    plZlibCompress codec;
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        Payload state = MakeStateLike(10 + i * 7, i);
+        EXPECT_EQ(state, RoundTrip(codec, state));
+    }
+}
@@ -0,0 +1,201 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsGeometry3.h"
+#include "hsMatrix44.h"
+#include "plDrawable/plAccessTriSpan.h"
+#include "plDrawable/plCutter.h"
+#include "plDrawable/plSpanTriTree.h"
+#include "pnFactory/plCreator.h"
+
+REGISTER_CREATABLE( plCutter );
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+// Bumpy ground in world space, the sort of thing footprints and bullet
+// holes get cut out of.
+struct plTestGround
+{
+    struct Vert
+    {
+        hsPoint3    fPos;
+        hsVector3   fNorm;
+        uint32_t    fColor;
+    };
+
+    std::vector<Vert>       fVerts;
+    std::vector<uint16_t>   fTris;
+    plAccessTriSpan         fSpan;
+    float                   fExtent;
+
+    plTestGround(int gridSize, float cell, uint32_t seed)
+    {
+        fExtent = (gridSize - 1) * cell;
+        for (int y = 0; y < gridSize; y++)
+        {
+            for (int x = 0; x < gridSize; x++)
+            {
+                Vert v;
+                v.fPos.Set(x * cell, y * cell, sinf(x * 0.3f) * 0.4f + cosf(y * 0.2f) * 0.6f + Rand(seed) * 0.1f);
+                v.fNorm.Set(0, 0, 1.f);
+                v.fColor = 0xff808080;
+                fVerts.push_back(v);
+            }
+        }
+        for (int y = 0; y < gridSize - 1; y++)
+        {
+            for (int x = 0; x < gridSize - 1; x++)
+            {
+                const uint16_t v = uint16_t(y * gridSize + x);
+                const uint16_t tris[6] = { v, uint16_t(v + 1), uint16_t(v + gridSize + 1),
+                                           v, uint16_t(v + gridSize + 1), uint16_t(v + gridSize) };
+                fTris.insert(fTris.end(), tris, tris + 6);
+            }
+        }
+
+        fSpan.ClearVerts();
+        fSpan.ClearTris();
+        fSpan.PositionStream(fVerts.data(), sizeof(Vert), 0);
+        fSpan.NormalStream(fVerts.data(), sizeof(Vert), offsetof(Vert, fNorm));
+        fSpan.DiffuseStream(fVerts.data(), sizeof(Vert), offsetof(Vert, fColor));
+        fSpan.SetVertCount(uint16_t(fVerts.size()));
+        fSpan.fTris = fTris.data();
+        fSpan.fNumTris = uint32_t(fTris.size() / 3);
+    }
+
+    // A footprint sized cutter pointing down at a random spot.
+    void RandomCutter(plCutter& cutter, uint32_t& seed) const
+    {
+        cutter.SetLength(hsVector3(0.6f, 1.2f, 2.f));
+        const hsPoint3 pos(1.f + Rand(seed) * (fExtent - 2.f), 1.f + Rand(seed) * (fExtent - 2.f), 0);
+        const float angle = Rand(seed) * 6.28f;
+        cutter.Set(pos, hsVector3(cosf(angle), sinf(angle), 0), hsVector3(0, 0, 1.f));
+    }
+};
+
+TEST(plCutter, TreeFindsTheSamePolys)
+{
+    plTestGround ground(96, 0.5f, 1);
+    plSpanTriTree tree;
+    tree.Build(ground.fSpan);
+
+    uint32_t seed = 5;
+    for (int i = 0; i < 200; i++)
+    {
+        plCutter cutter;
+        ground.RandomCutter(cutter, seed);
+
+        hsTArray<plCutoutPoly> scanned;
+        hsTArray<plCutoutPoly> indexed;
+        cutter.CutoutTris(ground.fSpan, nil, nil, nil, false, nil, scanned);
+        cutter.CutoutTris(ground.fSpan, nil, nil, nil, false, &tree, indexed);
+
+        ASSERT_GT(scanned.GetCount(), 0);
+        ASSERT_EQ(scanned.GetCount(), indexed.GetCount());
+        for (int j = 0; j < scanned.GetCount(); j++)
+        {
+            ASSERT_EQ(scanned[j].fVerts.GetCount(), indexed[j].fVerts.GetCount());
+            for (int k = 0; k < scanned[j].fVerts.GetCount(); k++)
+            {
+                EXPECT_EQ(scanned[j].fVerts[k].fPos, indexed[j].fVerts[k].fPos);
+                EXPECT_EQ(scanned[j].fVerts[k].fUVW, indexed[j].fVerts[k].fUVW);
+            }
+        }
+    }
+}
+
+TEST(plCutter, ClipsToTheUnitCube)
+{
+    plTestGround ground(32, 0.25f, 2);
+
+    uint32_t seed = 9;
+    for (int i = 0; i < 50; i++)
+    {
+        plCutter cutter;
+        ground.RandomCutter(cutter, seed);
+
+        hsTArray<plCutoutPoly> polys;
+        cutter.CutoutTris(ground.fSpan, nil, nil, nil, false, nil, polys);
+        for (int j = 0; j < polys.GetCount(); j++)
+        {
+            EXPECT_GE(polys[j].fVerts.GetCount(), 3);
+            for (int k = 0; k < polys[j].fVerts.GetCount(); k++)
+            {
+                const hsPoint3& uvw = polys[j].fVerts[k].fUVW;
+                for (int ax = 0; ax < 3; ax++)
+                {
+                    EXPECT_GE(uvw[ax], -1.e-4f);
+                    EXPECT_LE(uvw[ax], 1.f + 1.e-4f);
+                }
+            }
+        }
+    }
+}
+
+TEST(plCutter, WaterIsCutAtItsHeight)
+{
+    plTestGround ground(16, 0.5f, 3);
+
+    plCutter cutter;
+    cutter.SetLength(hsVector3(1.f, 1.f, 1.f));
+    cutter.Set(hsPoint3(3.f, 3.f, 10.f), hsVector3(1.f, 0, 0), hsVector3(0, 0, 1.f));
+
+    // The ground is nowhere near the cutter, the water surface is.
+    hsTArray<plCutoutPoly> polys;
+    cutter.CutoutTris(ground.fSpan, nil, nil, nil, false, nil, polys);
+    EXPECT_EQ(0, polys.GetCount());
+
+    plSpanTriTree tree;
+    tree.Build(ground.fSpan);
+    const float waterHeight = 10.f;
+    cutter.CutoutTris(ground.fSpan, nil, nil, &waterHeight, false, &tree, polys);
+    EXPECT_GT(polys.GetCount(), 0);
+}
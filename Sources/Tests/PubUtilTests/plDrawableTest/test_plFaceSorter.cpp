@@ -0,0 +1,340 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsGeometry3.h"
+#include "plDrawable/plDrawableSpans.h"
+#include "plDrawable/plFaceSorter.h"
+#include "plDrawable/plGBufferGroup.h"
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+// A span's worth of sort data, faces scattered through a box around org.
+static std::vector<plGBufferTriangle> MakeTris(uint32_t numTris, const hsPoint3& org, float size, uint32_t& seed)
+{
+    std::vector<plGBufferTriangle> tris(numTris);
+    for (uint32_t i = 0; i < numTris; i++)
+    {
+        tris[i].fIndex1 = uint16_t(i * 3);
+        tris[i].fIndex2 = uint16_t(i * 3 + 1);
+        tris[i].fIndex3 = uint16_t(i * 3 + 2);
+        tris[i].fSpanIndex = 0;
+        tris[i].fCenter.Set(org.fX + Rand(seed) * size, org.fY + Rand(seed) * size, org.fZ + Rand(seed) * size);
+    }
+    return tris;
+}
+
+static float DistSq(const std::vector<plGBufferTriangle>& tris, uint16_t idx, const hsPoint3& viewPos)
+{
+    return hsVector3(&tris[idx / 3].fCenter, &viewPos).MagnitudeSquared();
+}
+
+// Every face comes back exactly once, with its own three indices.
+static void CheckAllFaces(const uint16_t* indices, uint32_t numTris)
+{
+    std::vector<bool> seen(numTris, false);
+    for (uint32_t i = 0; i < numTris; i++)
+    {
+        uint16_t first = indices[i * 3];
+        ASSERT_EQ(0, first % 3);
+        ASSERT_LT(first / 3u, numTris);
+        EXPECT_FALSE(seen[first / 3]);
+        seen[first / 3] = true;
+        EXPECT_EQ(first + 1, indices[i * 3 + 1]);
+        EXPECT_EQ(first + 2, indices[i * 3 + 2]);
+    }
+}
+
+TEST(plFaceSorter, SortsBackToFront)
+{
+    uint32_t seed = 1;
+    std::vector<plGBufferTriangle> tris = MakeTris(1001, hsPoint3(-10.f, -10.f, -10.f), 20.f, seed);
+    hsPoint3 viewPos(3.f, -2.f, 1.f);
+
+    plFaceSorter sorter;
+    sorter.AddSpan(tris.data(), uint32_t(tris.size()), viewPos, false);
+    EXPECT_EQ(tris.size(), sorter.Sort());
+
+    const uint16_t* indices = sorter.GetIndices(0);
+    CheckAllFaces(indices, uint32_t(tris.size()));
+    for (size_t i = 1; i < tris.size(); i++)
+        EXPECT_GE(DistSq(tris, indices[(i - 1) * 3], viewPos), DistSq(tris, indices[i * 3], viewPos));
+}
+
+TEST(plFaceSorter, SpansKeepTheirOwnRuns)
+{
+    // Enough faces that the spans go through more than one radix sort
+    uint32_t seed = 2;
+    std::vector<std::vector<plGBufferTriangle>> spans;
+    std::vector<hsPoint3> viewPos;
+    for (int i = 0; i < 12; i++)
+    {
+        spans.push_back(MakeTris(150 + i * 97, hsPoint3(i * 5.f, 0, 0), 8.f, seed));
+        viewPos.push_back(hsPoint3(Rand(seed) * 40.f, 3.f, -2.f));
+    }
+    spans.push_back(std::vector<plGBufferTriangle>());
+    viewPos.push_back(hsPoint3(0, 0, 0));
+
+    plFaceSorter sorter;
+    uint32_t total = 0;
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        sorter.AddSpan(spans[i].data(), uint32_t(spans[i].size()), viewPos[i], i & 1);
+        total += uint32_t(spans[i].size());
+    }
+    EXPECT_EQ(total, sorter.Sort());
+    EXPECT_GT(total, uint32_t(plFaceSorter::kTriCutoff));
+
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        const uint16_t* indices = sorter.GetIndices(i);
+        CheckAllFaces(indices, uint32_t(spans[i].size()));
+
+        // Reversed spans come out front to back
+        for (size_t j = 1; j < spans[i].size(); j++)
+        {
+            float prev = DistSq(spans[i], indices[(j - 1) * 3], viewPos[i]);
+            float cur = DistSq(spans[i], indices[j * 3], viewPos[i]);
+            if (i & 1)
+                EXPECT_LE(prev, cur);
+            else
+                EXPECT_GE(prev, cur);
+        }
+    }
+}
+
+TEST(plFaceSorter, DepthKeysSortAscending)
+{
+    uint32_t seed = 3;
+    std::vector<plGBufferTriangle> tris = MakeTris(300, hsPoint3(-5.f, -5.f, -5.f), 10.f, seed);
+
+    plFaceSorter::KeyParams params;
+    params.fViewPos.Set(0, 0, 0);
+    params.fScale = 0;
+    params.fDir.Set(0.6f, 0, 0.8f);
+    params.fDist = 2.f;
+
+    plFaceSorter sorter;
+    sorter.AddSpan(tris.data(), uint32_t(tris.size()), params, false);
+    sorter.Sort();
+
+    const uint16_t* indices = sorter.GetIndices(0);
+    CheckAllFaces(indices, uint32_t(tris.size()));
+    for (size_t i = 1; i < tris.size(); i++)
+        EXPECT_LE(params.fDir.InnerProduct(tris[indices[(i - 1) * 3] / 3].fCenter),
+                  params.fDir.InnerProduct(tris[indices[i * 3] / 3].fCenter));
+}
+
+TEST(plFaceSorter, KeysMatchTheScalarMath)
+{
+    uint32_t seed = 4;
+    std::vector<plGBufferTriangle> tris = MakeTris(103, hsPoint3(-50.f, -50.f, -50.f), 100.f, seed);
+
+    plFaceSorter::KeyParams params;
+    params.fViewPos.Set(1.f, 2.f, 3.f);
+    params.fScale = -1.f;
+    params.fDir.Set(0.25f, -0.5f, 1.f);
+    params.fDist = -4.f;
+
+    std::vector<float> keys(tris.size());
+    plFaceSorter::face_keys.call(tris.data(), uint32_t(tris.size()), params, keys.data());
+    for (size_t i = 0; i < tris.size(); i++)
+    {
+        const hsPoint3& c = tris[i].fCenter;
+        float expected = -hsVector3(&c, &params.fViewPos).MagnitudeSquared() + params.fDir.InnerProduct(c) + params.fDist;
+        EXPECT_NEAR(expected, keys[i], fabsf(expected) * 1.e-5f);
+    }
+}
+
+TEST(plFaceSorter, UnsortedKeepsTheOriginalOrder)
+{
+    uint32_t seed = 5;
+    std::vector<plGBufferTriangle> tris = MakeTris(50, hsPoint3(0, 0, 0), 1.f, seed);
+
+    plFaceSorter sorter;
+    sorter.AddSpan(tris.data(), uint32_t(tris.size()), hsPoint3(0, 0, 0), true);
+    EXPECT_EQ(tris.size(), sorter.Sort(false));
+
+    const uint16_t* indices = sorter.GetIndices(0);
+    for (uint16_t i = 0; i < tris.size() * 3; i++)
+        EXPECT_EQ(i, indices[i]);
+}
+
+// Face sorted spans built straight into a buffer group, the way
+// plDrawableSpans::UnPackCluster does, so they can be sorted without a
+// pipeline or any export data. Every fourth span is left out of the
+// visList and every fifth sorts front to back.
+class plSortTestDrawable : public plDrawableSpans
+{
+public:
+    hsTArray<int16_t> fVisList;
+
+    plSortTestDrawable(uint32_t numSpans, uint32_t seed)
+    {
+        fProps |= kPropSortFaces;
+
+        std::vector<uint32_t> spanTris(numSpans);
+        uint32_t numTris = 0;
+        uint32_t i;
+        for (i = 0; i < numSpans; i++)
+        {
+            spanTris[i] = 40 + uint32_t(Rand(seed) * 80);
+            numTris += spanTris[i];
+        }
+
+        uint8_t grpIdx = IFindBufferGroup(0, 3 * numTris, 0, false, true);
+        plGBufferGroup* group = fGroups[grpIdx];
+        uint32_t vbIdx, cellIdx, cellOffset;
+        group->ReserveVertStorage(3 * numTris, &vbIdx, &cellIdx, &cellOffset,
+                                  plGBufferGroup::kReserveInterleaved | plGBufferGroup::kReserveIsolate);
+        uint32_t ibIdx, ibStart;
+        group->ReserveIndexStorage(3 * numTris, &ibIdx, &ibStart);
+
+        // Little triangles scattered over a field, each one's centroid
+        // right where we put it.
+        uint8_t* verts = group->GetVertBufferData(vbIdx);
+        uint16_t* indices = group->GetIndexBufferData(ibIdx);
+        for (i = 0; i < numTris; i++)
+        {
+            hsPoint3 center(Rand(seed) * 200.f, Rand(seed) * 200.f, Rand(seed) * 10.f);
+            const float offsets[3][2] = { { 0.5f, 0.f }, { 0.f, 0.5f }, { -0.5f, -0.5f } };
+            int j;
+            for (j = 0; j < 3; j++)
+            {
+                float* pos = (float*)(verts + (3 * i + j) * group->GetVertexSize());
+                pos[0] = center.fX + offsets[j][0];
+                pos[1] = center.fY + offsets[j][1];
+                pos[2] = center.fZ;
+                indices[3 * i + j] = uint16_t(3 * i + j);
+            }
+        }
+
+        fIcicles.SetCount(numSpans);
+        fSpans.SetCount(numSpans);
+        uint32_t start = 0;
+        for (i = 0; i < numSpans; i++)
+        {
+            plIcicle& span = fIcicles[i];
+            fSpans[i] = &span;
+
+            span.fTypeMask = plSpan::kSpan | plSpan::kVertexSpan | plSpan::kIcicleSpan;
+            if (i % 5 == 4)
+                span.fProps |= plSpan::kPropReverseSort;
+            span.fLocalToWorld.Reset();
+            span.fWorldToLocal.Reset();
+            span.fGroupIdx = grpIdx;
+            span.fVBufferIdx = vbIdx;
+            span.fCellIdx = cellIdx;
+            span.fCellOffset = cellOffset;
+            span.fVStartIdx = start;
+            span.fVLength = 3 * spanTris[i];
+            span.fIBufferIdx = ibIdx;
+            span.fIPackedIdx = span.fIStartIdx = start;
+            span.fILength = 3 * spanTris[i];
+            start += span.fILength;
+
+            if (i % 4 != 3)
+                fVisList.Append(int16_t(i));
+        }
+    }
+
+    std::vector<uint16_t> GetIndices()
+    {
+        plGBufferGroup* group = fGroups[0];
+        return std::vector<uint16_t>(group->GetIndexBufferData(0), group->GetIndexBufferData(0) + group->GetIndexBufferCount(0));
+    }
+};
+
+// A batch with enough faces gets split across the worker pool. Each drawable
+// still has to come out exactly as it sorts on its own, which never leaves
+// the calling thread.
+TEST(plFaceSorter, PresortBatchMatchesSerialSort)
+{
+    const int kNumDrawables = 16;
+    const uint32_t kSpansPerDrawable = 24;
+
+    std::vector<std::unique_ptr<plSortTestDrawable>> batch, serial;
+    std::vector<plDrawableSpans*> draws;
+    std::vector<const hsTArray<int16_t>*> visLists;
+    uint32_t totTris = 0;
+    int i;
+    for (i = 0; i < kNumDrawables; i++)
+    {
+        batch.emplace_back(new plSortTestDrawable(kSpansPerDrawable, 6 + i));
+        serial.emplace_back(new plSortTestDrawable(kSpansPerDrawable, 6 + i));
+        draws.push_back(batch.back().get());
+        visLists.push_back(&batch.back()->fVisList);
+
+        const hsTArray<int16_t>& visList = batch.back()->fVisList;
+        int j;
+        for (j = 0; j < visList.GetCount(); j++)
+            totTris += ((const plIcicle*)batch.back()->GetSpan(visList[j]))->fILength / 3;
+    }
+    // Enough visible faces to split across at least two threads
+    ASSERT_GT(totTris, 2 * 8192);
+
+    ASSERT_TRUE(plDrawableSpans::GetPresortFaces());
+    const hsPoint3 viewPos(100.f, -20.f, 6.f);
+    plDrawableSpans::PresortVisibleSpans(draws.data(), visLists.data(), draws.size(), viewPos);
+
+    for (i = 0; i < kNumDrawables; i++)
+    {
+        std::vector<uint16_t> unsorted = serial[i]->GetIndices();
+
+        plDrawableSpans* one = serial[i].get();
+        const hsTArray<int16_t>* oneVis = &serial[i]->fVisList;
+        plDrawableSpans::PresortVisibleSpans(&one, &oneVis, 1, viewPos);
+
+        std::vector<uint16_t> sorted = serial[i]->GetIndices();
+        EXPECT_NE(unsorted, sorted) << "drawable " << i;
+        EXPECT_EQ(sorted, batch[i]->GetIndices()) << "drawable " << i;
+    }
+}
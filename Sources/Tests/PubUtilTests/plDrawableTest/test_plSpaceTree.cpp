@@ -0,0 +1,433 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsBounds.h"
+#include "hsGeometry3.h"
+#include "hsMatrix44.h"
+#include "plDrawable/plSpaceTree.h"
+#include "plDrawable/plSpaceTreeMaker.h"
+#include "plIntersect/plVolumeIsect.h"
+#include "pnFactory/plCreator.h"
+
+// Just the creatables we use, the full plDrawable and plIntersect lists would
+// drag in most of the engine.
+REGISTER_NONCREATABLE( plVolumeIsect );
+REGISTER_CREATABLE( plSphereIsect );
+REGISTER_CREATABLE( plConeIsect );
+REGISTER_CREATABLE( plCylinderIsect );
+REGISTER_CREATABLE( plParallelIsect );
+REGISTER_CREATABLE( plConvexIsect );
+REGISTER_CREATABLE( plBoundsIsect );
+REGISTER_NONCREATABLE( plComplexIsect );
+REGISTER_CREATABLE( plUnionIsect );
+REGISTER_CREATABLE( plIntersectionIsect );
+REGISTER_CREATABLE( plSpaceTree );
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+// Something shaped like an age: a few hundred clumps of detail spread over a
+// big area, each clump holding a mix of small props and larger pieces of
+// architecture, with some terrain sized spans over everything.
+static void AddAgeLikeLeaves(plSpaceTreeMaker& maker, int numLeaves, uint32_t seed)
+{
+    const int kNumClumps = 200;
+    hsPoint3 clumps[kNumClumps];
+    for (int i = 0; i < kNumClumps; i++)
+        clumps[i].Set(Rand(seed) * 2000.f - 1000.f, Rand(seed) * 2000.f - 1000.f, Rand(seed) * 100.f);
+
+    for (int i = 0; i < numLeaves; i++)
+    {
+        hsPoint3 center;
+        float size;
+        if ((i % 100) == 0)
+        {
+            center.Set(Rand(seed) * 2000.f - 1000.f, Rand(seed) * 2000.f - 1000.f, 0);
+            size = 200.f + Rand(seed) * 300.f;
+        }
+        else
+        {
+            const hsPoint3& clump = clumps[i % kNumClumps];
+            center.Set(clump.fX + Rand(seed) * 60.f - 30.f,
+                       clump.fY + Rand(seed) * 60.f - 30.f,
+                       clump.fZ + Rand(seed) * 20.f);
+            size = (i % 7) ? 0.5f + Rand(seed) * 3.f : 5.f + Rand(seed) * 20.f;
+        }
+
+        hsPoint3 corners[2];
+        corners[0].Set(center.fX - size * Rand(seed), center.fY - size * Rand(seed), center.fZ - size * Rand(seed));
+        corners[1].Set(center.fX + size * Rand(seed), center.fY + size * Rand(seed), center.fZ + size * Rand(seed));
+
+        hsBounds3Ext bnd;
+        bnd.Reset(2, corners);
+        maker.AddLeaf(bnd);
+    }
+}
+
+static plSpaceTree* MakeAgeLikeTree(int numLeaves, uint32_t seed)
+{
+    plSpaceTreeMaker maker;
+    maker.Reset();
+    AddAgeLikeLeaves(maker, numLeaves, seed);
+
+    plSpaceTree* tree = maker.MakeTree();
+    maker.Cleanup();
+    return tree;
+}
+
+// A view frustum looking along dir from pos, as outward facing planes.
+static void MakeFrustum(plConvexIsect& isect, const hsPoint3& pos, float yaw, float pitch, float yon)
+{
+    hsVector3 dir(cosf(yaw) * cosf(pitch), sinf(yaw) * cosf(pitch), sinf(pitch));
+    hsVector3 up(0, 0, 1);
+    hsVector3 right = dir % up;
+    right.Normalize();
+    up = right % dir;
+
+    const float kHalfFov = 0.6f;
+    float c = cosf(kHalfFov);
+    float s = sinf(kHalfFov);
+
+    isect.ClearPlanes();
+    isect.AddPlane(-dir, pos);
+    isect.AddPlane(dir, pos + dir * yon);
+    isect.AddPlane(right * c - dir * s, pos);
+    isect.AddPlane(-right * c - dir * s, pos);
+    isect.AddPlane(up * c - dir * s, pos);
+    isect.AddPlane(-up * c - dir * s, pos);
+
+    hsMatrix44 ident;
+    ident.Reset();
+    isect.SetTransform(ident, ident);
+}
+
+static void RandomFrustum(plConvexIsect& isect, uint32_t& seed)
+{
+    hsPoint3 pos(Rand(seed) * 1600.f - 800.f, Rand(seed) * 1600.f - 800.f, 5.f + Rand(seed) * 50.f);
+    MakeFrustum(isect, pos, Rand(seed) * 6.28f, Rand(seed) * 0.6f - 0.3f, 300.f + Rand(seed) * 700.f);
+}
+
+static std::vector<int16_t> Harvest(const plSpaceTree* tree, plVolumeIsect* isect, bool packed)
+{
+    plSpaceTree::SetPackedCulling(packed);
+    hsTArray<int16_t> list;
+    tree->HarvestLeaves(isect, list);
+    plSpaceTree::SetPackedCulling(true);
+
+    return std::vector<int16_t>(list.AcquireArray(), list.AcquireArray() + list.GetCount());
+}
+
+// The packed path can keep a leaf the per node path culls, when the culling
+// interior node was folded into a quad, but must never lose one.
+static void ExpectSameLeaves(const std::vector<int16_t>& perNode, const std::vector<int16_t>& packed)
+{
+    size_t j = 0;
+    for (size_t i = 0; i < perNode.size(); i++)
+    {
+        while (j < packed.size() && packed[j] < perNode[i])
+            j++;
+        ASSERT_TRUE(j < packed.size() && packed[j] == perNode[i]) << "leaf " << perNode[i] << " lost";
+    }
+    EXPECT_LE(packed.size(), perNode.size() + perNode.size() / 100 + 1);
+}
+
+TEST(plSpaceTree, PackedMatchesPerNode)
+{
+    plSpaceTree* tree = MakeAgeLikeTree(6000, 1);
+    uint32_t seed = 2;
+
+    plConvexIsect isect;
+    for (int i = 0; i < 200; i++)
+    {
+        RandomFrustum(isect, seed);
+        ExpectSameLeaves(Harvest(tree, &isect, false), Harvest(tree, &isect, true));
+    }
+    delete tree;
+}
+
+TEST(plSpaceTree, PackedParallelIsect)
+{
+    plSpaceTree* tree = MakeAgeLikeTree(3000, 3);
+
+    plParallelIsect isect;
+    isect.SetNumPlanes(2);
+    isect.SetPlane(0, hsPoint3(-100.f, 0, 0), hsPoint3(250.f, 0, 0));
+    isect.SetPlane(1, hsPoint3(0, -400.f, 0), hsPoint3(0, 50.f, 0));
+    hsMatrix44 ident;
+    ident.Reset();
+    isect.SetTransform(ident, ident);
+
+    std::vector<int16_t> perNode = Harvest(tree, &isect, false);
+    EXPECT_FALSE(perNode.empty());
+    ExpectSameLeaves(perNode, Harvest(tree, &isect, true));
+    delete tree;
+}
+
+TEST(plSpaceTree, PackedSkipsDisabled)
+{
+    plSpaceTree* tree = MakeAgeLikeTree(2000, 4);
+    for (int16_t i = 0; i < tree->GetNumLeaves(); i += 3)
+        tree->SetLeafFlag(i, plSpaceTreeNode::kDisabled);
+
+    uint32_t seed = 5;
+    plConvexIsect isect;
+    for (int i = 0; i < 50; i++)
+    {
+        RandomFrustum(isect, seed);
+        std::vector<int16_t> packed = Harvest(tree, &isect, true);
+        for (size_t j = 0; j < packed.size(); j++)
+            EXPECT_NE(0, packed[j] % 3);
+        ExpectSameLeaves(Harvest(tree, &isect, false), packed);
+    }
+    delete tree;
+}
+
+TEST(plSpaceTree, PackedFollowsMovedLeaves)
+{
+    plSpaceTree* tree = MakeAgeLikeTree(2000, 6);
+
+    plConvexIsect isect;
+    MakeFrustum(isect, hsPoint3(0, 0, 10.f), 0, 0, 200.f);
+
+    // Build the quads before anything moves.
+    Harvest(tree, &isect, true);
+
+    uint32_t seed = 7;
+    for (int16_t i = 0; i < tree->GetNumLeaves(); i += 5)
+    {
+        hsPoint3 corners[2];
+        corners[0].Set(40.f + Rand(seed) * 130.f, Rand(seed) * 20.f - 10.f, 5.f);
+        corners[1] = corners[0] + hsVector3(1.f, 1.f, 1.f);
+        hsBounds3Ext bnd;
+        bnd.Reset(2, corners);
+        tree->MoveLeaf(i, bnd);
+    }
+    tree->Refresh();
+
+    std::vector<int16_t> packed = Harvest(tree, &isect, true);
+    for (int16_t i = 0; i < tree->GetNumLeaves(); i += 5)
+        EXPECT_TRUE(std::binary_search(packed.begin(), packed.end(), i)) << "leaf " << i << " missing";
+    ExpectSameLeaves(Harvest(tree, &isect, false), packed);
+    delete tree;
+}
+
+// The kernel has to agree with plCullNode::TestBounds, sphere test and all.
+TEST(plSpaceTree, QuadKernelMatchesBoundsTest)
+{
+    uint32_t seed = 8;
+    const float kSafetyDist = -0.1f;
+
+    for (int iter = 0; iter < 2000; iter++)
+    {
+        plSpaceTreeQuad quad;
+        memset(&quad, 0, sizeof(quad));
+        hsBounds3Ext bnds[4];
+        for (int j = 0; j < 4; j++)
+        {
+            hsPoint3 corners[2];
+            corners[0].Set(Rand(seed) * 20.f - 10.f, Rand(seed) * 20.f - 10.f, Rand(seed) * 20.f - 10.f);
+            corners[1] = corners[0] + hsVector3(Rand(seed) * 5.f, Rand(seed) * 5.f, Rand(seed) * 5.f);
+            bnds[j].Reset(2, corners);
+            for (int k = 0; k < 3; k++)
+            {
+                quad.fMins[k][j] = bnds[j].GetMins()[k];
+                quad.fMaxs[k][j] = bnds[j].GetMaxs()[k];
+                quad.fCenter[k][j] = bnds[j].GetCenter()[k];
+            }
+            quad.fRadius[j] = bnds[j].GetRadius();
+        }
+        quad.fValid = 0xf;
+
+        hsPlane3 planes[6];
+        for (int i = 0; i < 6; i++)
+        {
+            planes[i].fN.Set(Rand(seed) - 0.5f, Rand(seed) - 0.5f, Rand(seed) - 0.5f);
+            planes[i].fN.Normalize();
+            planes[i].fD = Rand(seed) * 16.f - 8.f;
+        }
+
+        plSpaceTreePlaneSet set(planes, 6, kSafetyDist, true);
+        uint32_t laneActive[4];
+        uint32_t culled = plSpaceTree::cull_quad.call(quad, set, 0x3f, laneActive);
+
+        for (int j = 0; j < 4; j++)
+        {
+            bool refCulled = false;
+            uint32_t refActive = 0x3f;
+            for (int i = 0; i < 6; i++)
+            {
+                float dist = planes[i].fN.InnerProduct(bnds[j].GetCenter()) + planes[i].fD;
+                float rad = bnds[j].GetRadius();
+                hsPoint2 depth;
+                bnds[j].TestPlane(planes[i].fN, depth);
+                if (dist < -rad || depth.fY + planes[i].fD < kSafetyDist)
+                    refCulled = true;
+                else if (dist > rad || depth.fX + planes[i].fD >= 0)
+                    refActive &= ~(1 << i);
+            }
+            EXPECT_EQ(refCulled, 0 != (culled & (1 << j)));
+            if (!refCulled)
+                EXPECT_EQ(refActive, laneActive[j]);
+        }
+    }
+}
+
+static plSpaceTree* MakeAgeLikeTree(int numLeaves, uint32_t seed, bool sah)
+{
+    plSpaceTreeMaker::SetBuildSAH(sah);
+    plSpaceTree* tree = MakeAgeLikeTree(numLeaves, seed);
+    plSpaceTreeMaker::SetBuildSAH(true);
+    return tree;
+}
+
+// Nodes the per node harvest would test, the measure of tree quality.
+static int CountVisits(const plSpaceTree* tree, int16_t nodeIdx, plVolumeIsect* isect)
+{
+    const plSpaceTreeNode& node = tree->GetNode(nodeIdx);
+    if (node.IsLeaf())
+        return 1;
+    if (isect->Test(node.fWorldBounds) != kVolumeSplit)
+        return 1;
+    return 1 + CountVisits(tree, node.GetChild(0), isect) + CountVisits(tree, node.GetChild(1), isect);
+}
+
+static void ExpectWellFormed(const plSpaceTree* tree, int16_t nodeIdx, std::vector<bool>& seen)
+{
+    const plSpaceTreeNode& node = tree->GetNode(nodeIdx);
+    if (node.IsLeaf())
+    {
+        ASSERT_EQ(nodeIdx, node.fLeafIndex);
+        ASSERT_FALSE(seen[nodeIdx]) << "leaf " << nodeIdx << " reached twice";
+        seen[nodeIdx] = true;
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        int16_t child = node.GetChild(i);
+        ASSERT_EQ(nodeIdx, tree->GetNode(child).fParent);
+
+        const hsBounds3Ext& bnd = tree->GetNode(child).fWorldBounds;
+        EXPECT_GE(bnd.GetMins().fX, node.fWorldBounds.GetMins().fX);
+        EXPECT_GE(bnd.GetMins().fY, node.fWorldBounds.GetMins().fY);
+        EXPECT_GE(bnd.GetMins().fZ, node.fWorldBounds.GetMins().fZ);
+        EXPECT_LE(bnd.GetMaxs().fX, node.fWorldBounds.GetMaxs().fX);
+        EXPECT_LE(bnd.GetMaxs().fY, node.fWorldBounds.GetMaxs().fY);
+        EXPECT_LE(bnd.GetMaxs().fZ, node.fWorldBounds.GetMaxs().fZ);
+
+        ExpectWellFormed(tree, child, seen);
+    }
+}
+
+TEST(plSpaceTreeMaker, SAHTreeMatchesMedianSplit)
+{
+    // Big enough to take the threaded path.
+    const int kNumLeaves = 9000;
+    plSpaceTree* median = MakeAgeLikeTree(kNumLeaves, 11, false);
+    plSpaceTree* sah = MakeAgeLikeTree(kNumLeaves, 11, true);
+
+    ASSERT_EQ(kNumLeaves, sah->GetNumLeaves());
+    ASSERT_EQ(2 * kNumLeaves - 1, sah->GetRoot() + 1);
+    std::vector<bool> seen(kNumLeaves, false);
+    ExpectWellFormed(sah, sah->GetRoot(), seen);
+    EXPECT_EQ(kNumLeaves, std::count(seen.begin(), seen.end(), true));
+
+    uint32_t seed = 12;
+    plConvexIsect isect;
+    for (int i = 0; i < 100; i++)
+    {
+        RandomFrustum(isect, seed);
+        EXPECT_EQ(Harvest(median, &isect, false), Harvest(sah, &isect, false));
+    }
+
+    delete median;
+    delete sah;
+}
+
+TEST(plSpaceTreeMaker, SAHKeepsDisabledLeaves)
+{
+    plSpaceTreeMaker maker;
+    maker.Reset();
+    for (int i = 0; i < 100; i++)
+    {
+        hsPoint3 corners[2] = { hsPoint3(float(i), 0, 0), hsPoint3(float(i) + 0.5f, 1.f, 1.f) };
+        hsBounds3Ext bnd;
+        bnd.Reset(2, corners);
+        maker.AddLeaf(bnd, (i % 3) == 0);
+    }
+    plSpaceTree* tree = maker.MakeTree();
+
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ((i % 3) == 0, tree->IsDisabled(i));
+
+    delete tree;
+}
+
+TEST(plSpaceTreeMaker, SAHVisitsFewerNodes)
+{
+    const int kNumLeaves = 4000;
+    plSpaceTree* median = MakeAgeLikeTree(kNumLeaves, 13, false);
+    plSpaceTree* sah = MakeAgeLikeTree(kNumLeaves, 13, true);
+
+    size_t medianVisits = 0, sahVisits = 0;
+    uint32_t seed = 14;
+    plConvexIsect isect;
+    for (int i = 0; i < 100; i++)
+    {
+        RandomFrustum(isect, seed);
+        medianVisits += CountVisits(median, median->GetRoot(), &isect);
+        sahVisits += CountVisits(sah, sah->GetRoot(), &isect);
+    }
+    EXPECT_LT(sahVisits, medianVisits);
+
+    delete median;
+    delete sah;
+}
@@ -0,0 +1,250 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsGeometry3.h"
+#include "plDrawable/plAccessTriSpan.h"
+#include "plDrawable/plSpanTriTree.h"
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+// Rolling terrain with rocks and clutter scattered over it, about as dense
+// as the big spans in an age get.
+struct plTestMesh
+{
+    std::vector<hsPoint3>   fVerts;
+    std::vector<uint16_t>   fTris;
+    plAccessTriSpan         fSpan;
+
+    plTestMesh(int gridSize, int numRocks, uint32_t seed)
+    {
+        const float kCell = 2.f;
+        for (int y = 0; y < gridSize; y++)
+        {
+            for (int x = 0; x < gridSize; x++)
+            {
+                const float h = sinf(x * 0.13f) * 3.f + cosf(y * 0.07f) * 5.f + Rand(seed) * 0.5f;
+                fVerts.push_back(hsPoint3(x * kCell, y * kCell, h));
+            }
+        }
+        for (int y = 0; y < gridSize - 1; y++)
+        {
+            for (int x = 0; x < gridSize - 1; x++)
+            {
+                const uint16_t v = uint16_t(y * gridSize + x);
+                AddTri(v, v + 1, v + gridSize + 1);
+                AddTri(v, v + gridSize + 1, v + gridSize);
+            }
+        }
+
+        // Little tetrahedra poking up out of the ground.
+        const float extent = (gridSize - 1) * kCell;
+        for (int i = 0; i < numRocks && fVerts.size() + 4 <= 0x10000; i++)
+        {
+            const hsPoint3 base(Rand(seed) * extent, Rand(seed) * extent, Rand(seed) * 5.f);
+            const float size = 0.2f + Rand(seed) * 1.5f;
+            const uint16_t v = uint16_t(fVerts.size());
+            fVerts.push_back(base + hsVector3(-size, -size, 0));
+            fVerts.push_back(base + hsVector3(size, -size, 0));
+            fVerts.push_back(base + hsVector3(0, size, 0));
+            fVerts.push_back(base + hsVector3(0, 0, size * 2.f));
+            AddTri(v, v + 2, v + 1);
+            AddTri(v, v + 1, v + 3);
+            AddTri(v + 1, v + 2, v + 3);
+            AddTri(v + 2, v, v + 3);
+        }
+
+        fSpan.ClearVerts();
+        fSpan.ClearTris();
+        fSpan.PositionStream(fVerts.data(), sizeof(hsPoint3), 0);
+        fSpan.SetVertCount(uint16_t(std::min<size_t>(fVerts.size(), 0xffff)));
+        fSpan.fTris = fTris.data();
+        fSpan.fNumTris = uint32_t(fTris.size() / 3);
+    }
+
+    void AddTri(uint16_t a, uint16_t b, uint16_t c)
+    {
+        fTris.push_back(a);
+        fTris.push_back(b);
+        fTris.push_back(c);
+    }
+};
+
+// The loop plVisLOSMgr runs over every triangle of a span when there's no
+// tree, one sided.
+static bool BruteForcePick(plAccessTriSpan& span, const hsPoint3& from, const hsVector3& dir, float& maxDist)
+{
+    bool retVal = false;
+    plAccTriIterator tri(&span);
+    for (tri.Begin(); tri.More(); tri.Advance())
+    {
+        hsVector3 norm = hsVector3(&tri.Position(1), &tri.Position(0)) % hsVector3(&tri.Position(2), &tri.Position(0));
+        float dotNorm = norm.InnerProduct(dir);
+
+        const float kMinDotNorm = 1.e-3f;
+        if (dotNorm >= -kMinDotNorm)
+            continue;
+        float dist = hsVector3(&tri.Position(0), &from).InnerProduct(norm);
+        if (dist > 0)
+            continue;
+        dist /= dotNorm;
+        hsPoint3 projPt = from;
+        projPt += dir * dist;
+
+        if (dist > maxDist)
+            continue;
+
+        hsVector3 cross0 = hsVector3(&tri.Position(1), &tri.Position(0)) % hsVector3(&projPt, &tri.Position(0));
+        hsVector3 cross1 = hsVector3(&tri.Position(2), &tri.Position(1)) % hsVector3(&projPt, &tri.Position(1));
+        hsVector3 cross2 = hsVector3(&tri.Position(0), &tri.Position(2)) % hsVector3(&projPt, &tri.Position(2));
+        float dot0 = cross0.InnerProduct(dir);
+        float dot1 = cross1.InnerProduct(dir);
+        float dot2 = cross2.InnerProduct(dir);
+
+        if (((dot0 <= 0) && (dot1 <= 0) && (dot2 <= 0))
+            || ((dot0 >= 0) && (dot1 >= 0) && (dot2 >= 0)))
+        {
+            if (dist < maxDist)
+            {
+                maxDist = dist;
+                retVal = true;
+            }
+        }
+    }
+    return retVal;
+}
+
+// A ray from somewhere above the mesh down to a random spot on it, the way
+// a cursor pick comes in.
+static void RandomPickRay(const plTestMesh& mesh, int gridSize, uint32_t& seed, hsPoint3& from, hsVector3& dir, float& dist)
+{
+    const float extent = (gridSize - 1) * 2.f;
+    from.Set(Rand(seed) * extent, Rand(seed) * extent, 20.f + Rand(seed) * 40.f);
+    const hsPoint3 targ(Rand(seed) * extent, Rand(seed) * extent, -20.f);
+    dir.Set(&targ, &from);
+    dist = dir.Magnitude();
+    dir /= dist;
+}
+
+TEST(plSpanTriTree, MatchesBruteForce)
+{
+    const int kGrid = 64;
+    plTestMesh mesh(kGrid, 400, 1);
+
+    plSpanTriTree tree;
+    tree.Build(mesh.fSpan);
+    EXPECT_EQ(mesh.fSpan.TriCount(), tree.GetNumTris());
+
+    uint32_t seed = 7;
+    int numHits = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        hsPoint3 from;
+        hsVector3 dir;
+        float dist;
+        RandomPickRay(mesh, kGrid, seed, from, dir, dist);
+
+        float bruteDist = dist;
+        float treeDist = dist;
+        const bool bruteHit = BruteForcePick(mesh.fSpan, from, dir, bruteDist);
+        const bool treeHit = tree.Intersect(from, dir, false, treeDist);
+
+        // Rays grazing a shared edge can land on either side of it, but
+        // never at a different distance.
+        ASSERT_EQ(bruteHit, treeHit) << "ray " << i;
+        if (bruteHit)
+        {
+            EXPECT_NEAR(bruteDist, treeDist, 1.e-3f * bruteDist) << "ray " << i;
+            numHits++;
+        }
+    }
+    EXPECT_GT(numHits, 1000);
+}
+
+TEST(plSpanTriTree, SmallAndEmptySpans)
+{
+    plTestMesh mesh(2, 0, 1);
+    ASSERT_EQ(2, mesh.fSpan.TriCount());
+
+    plSpanTriTree tree;
+    tree.Build(mesh.fSpan);
+    EXPECT_FALSE(tree.IsEmpty());
+
+    float dist = 100.f;
+    EXPECT_TRUE(tree.Intersect(hsPoint3(1.f, 1.f, 50.f), hsVector3(0, 0, -1.f), false, dist));
+    EXPECT_GT(dist, 40.f);
+    EXPECT_LT(dist, 60.f);
+
+    // Pointing away, and falling short.
+    dist = 100.f;
+    EXPECT_FALSE(tree.Intersect(hsPoint3(1.f, 1.f, 50.f), hsVector3(0, 0, 1.f), false, dist));
+    dist = 10.f;
+    EXPECT_FALSE(tree.Intersect(hsPoint3(1.f, 1.f, 50.f), hsVector3(0, 0, -1.f), false, dist));
+
+    mesh.fSpan.fNumTris = 0;
+    tree.Build(mesh.fSpan);
+    EXPECT_TRUE(tree.IsEmpty());
+    dist = 100.f;
+    EXPECT_FALSE(tree.Intersect(hsPoint3(1.f, 1.f, 50.f), hsVector3(0, 0, -1.f), false, dist));
+}
+
+TEST(plSpanTriTree, TwoSidedHitsBackFacesInFront)
+{
+    plTestMesh mesh(2, 0, 1);
+    plSpanTriTree tree;
+    tree.Build(mesh.fSpan);
+
+    // From underneath the ground only a two sided material stops the ray.
+    float dist = 100.f;
+    EXPECT_FALSE(tree.Intersect(hsPoint3(1.f, 1.f, -50.f), hsVector3(0, 0, 1.f), false, dist));
+    EXPECT_TRUE(tree.Intersect(hsPoint3(1.f, 1.f, -50.f), hsVector3(0, 0, 1.f), true, dist));
+    EXPECT_GT(dist, 40.f);
+    EXPECT_LT(dist, 60.f);
+}
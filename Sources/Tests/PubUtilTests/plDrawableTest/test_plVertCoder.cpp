@@ -0,0 +1,252 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plDrawable/plGBufferGroup.h"
+#include "plDrawable/plVertCoder.h"
+
+static const plFileName kTestFile = "test_plVertCoder.dat";
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+static uint32_t VertSize(uint8_t format)
+{
+    const uint32_t numWeights = (format & plGBufferGroup::kSkinWeightMask) >> 4;
+    uint32_t size = 3 * sizeof(float) + numWeights * sizeof(float);
+    if (numWeights && (format & plGBufferGroup::kSkinIndices))
+        size += sizeof(uint32_t);
+    size += 3 * sizeof(float) + 2 * sizeof(uint32_t);
+    size += (format & plGBufferGroup::kUVCountMask) * 3 * sizeof(float);
+    return size;
+}
+
+// Vertices the way an exported mesh has them: smooth positions with the odd
+// jump too far for one run, flat colored stretches between noisy ones, and
+// UV channels that are constant, smooth or jumpy.
+static std::vector<uint8_t> MakeVerts(uint8_t format, uint32_t numVerts, uint32_t seed)
+{
+    const uint32_t stride = VertSize(format);
+    const uint32_t numWeights = (format & plGBufferGroup::kSkinWeightMask) >> 4;
+    const uint32_t numUVWs = format & plGBufferGroup::kUVCountMask;
+
+    std::vector<uint8_t> verts(numVerts * stride);
+    uint8_t flatColor = 0;
+    for (uint32_t i = 0; i < numVerts; i++)
+    {
+        float* f = (float*)&verts[i * stride];
+        float jump = (i % 97) == 96 ? 100.f : 0.f;
+        *f++ = float(i % 50) + Rand(seed) + jump;
+        *f++ = 20.f * Rand(seed);
+        *f++ = -5.f + Rand(seed);
+
+        for (uint32_t j = 0; j < numWeights; j++)
+            *f++ = Rand(seed);
+        if (numWeights && (format & plGBufferGroup::kSkinIndices))
+        {
+            uint32_t idx = uint32_t(Rand(seed) * 65535.f) * 65537u;
+            memcpy(f++, &idx, sizeof(idx));
+        }
+
+        for (uint32_t j = 0; j < 3; j++)
+            *f++ = Rand(seed) * 2.f - 1.f;
+
+        uint8_t* color = (uint8_t*)f;
+        if ((i / 13) % 3 == 0)
+            flatColor = uint8_t(Rand(seed) * 255.f);
+        for (uint32_t j = 0; j < 4; j++)
+            color[j] = (i / 13) % 3 == 0 || j == 3 ? flatColor : uint8_t(Rand(seed) * 255.f);
+        f++;
+        *f++ = Rand(seed);  // COLOR2, the coder drops it
+
+        for (uint32_t j = 0; j < numUVWs; j++)
+        {
+            *f++ = j == 0 ? Rand(seed) : float(i % 7) / 7.f;
+            *f++ = j == 1 && (i % 31) == 30 ? 5.f : Rand(seed);
+            *f++ = 0.f;
+        }
+    }
+    return verts;
+}
+
+static std::vector<uint8_t> Encode(const std::vector<uint8_t>& verts, uint8_t format, uint32_t numVerts)
+{
+    hsRAMStream ram;
+    plVertCoder coder;
+    coder.Write(&ram, verts.data(), format, VertSize(format), numVerts);
+    std::vector<uint8_t> coded(ram.GetEOF());
+    ram.CopyToMem(coded.data());
+    return coded;
+}
+
+static std::vector<uint8_t> Decode(hsStream* s, uint8_t format, uint32_t numVerts, bool bulk)
+{
+    bool wasBulk = plVertCoder::GetBulkDecode();
+    plVertCoder::SetBulkDecode(bulk);
+
+    std::vector<uint8_t> verts(numVerts * VertSize(format));
+    plVertCoder coder;
+    coder.Read(s, verts.data(), format, VertSize(format), numVerts);
+
+    plVertCoder::SetBulkDecode(wasBulk);
+    return verts;
+}
+
+static const uint8_t kFormats[] = {
+    0,
+    1,
+    2,
+    plGBufferGroup::kSkin1Weight | 1,
+    plGBufferGroup::kSkin1Weight | plGBufferGroup::kSkinIndices | 2,
+    plGBufferGroup::kSkinWeightMask | plGBufferGroup::kSkinIndices | 3,
+    plGBufferGroup::kSkinWeightMask | 8,
+};
+
+static const uint32_t kVertCounts[] = { 1, 3, 4, 5, 17, 1000, 20000, 32768, 65535 };
+
+TEST(plVertCoder, BulkMatchesFieldByField)
+{
+    uint32_t seed = 1;
+    for (uint8_t format : kFormats)
+    {
+        for (uint32_t numVerts : kVertCounts)
+        {
+            std::vector<uint8_t> verts = MakeVerts(format, numVerts, seed++);
+            std::vector<uint8_t> coded = Encode(verts, format, numVerts);
+
+            hsReadOnlyStream ref(coded.size(), coded.data());
+            std::vector<uint8_t> expected = Decode(&ref, format, numVerts, false);
+            EXPECT_EQ(coded.size(), ref.GetPosition());
+
+            // In place out of the read window
+            hsReadOnlyStream inPlace(coded.size(), coded.data());
+            EXPECT_TRUE(Decode(&inPlace, format, numVerts, true) == expected)
+                << "format " << int(format) << ", " << numVerts << " verts";
+            EXPECT_EQ(coded.size(), inPlace.GetPosition());
+
+            // No window, every run is staged
+            hsRAMStream staged;
+            staged.Write(coded.size(), coded.data());
+            staged.Rewind();
+            EXPECT_TRUE(Decode(&staged, format, numVerts, true) == expected)
+                << "format " << int(format) << ", " << numVerts << " verts, staged";
+            EXPECT_EQ(coded.size(), staged.GetPosition());
+        }
+    }
+}
+
+TEST(plVertCoder, BackToBackBuffers)
+{
+    // One coder reading buffer after buffer, as plGBufferGroup::Read does,
+    // out of a small buffered window that runs keep straddling.
+    const uint8_t format = plGBufferGroup::kSkin1Weight | plGBufferGroup::kSkinIndices | 2;
+    hsRAMStream ram;
+    std::vector<std::vector<uint8_t>> expected;
+    uint32_t seed = 7;
+    for (uint32_t numVerts : kVertCounts)
+    {
+        std::vector<uint8_t> verts = MakeVerts(format, numVerts, seed++);
+        std::vector<uint8_t> coded = Encode(verts, format, numVerts);
+        ram.Write(coded.size(), coded.data());
+
+        hsReadOnlyStream ref(coded.size(), coded.data());
+        expected.push_back(Decode(&ref, format, numVerts, false));
+    }
+    std::vector<uint8_t> page(ram.GetEOF());
+    ram.CopyToMem(page.data());
+
+    hsUNIXStream out;
+    ASSERT_TRUE(out.Open(kTestFile, "wb"));
+    out.Write(page.size(), page.data());
+    out.Close();
+
+    hsBufferedStream in(100);
+    ASSERT_TRUE(in.Open(kTestFile, "rb"));
+    plVertCoder coder;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        std::vector<uint8_t> verts(expected[i].size());
+        coder.Read(&in, verts.data(), format, VertSize(format), kVertCounts[i]);
+        EXPECT_TRUE(verts == expected[i]) << kVertCounts[i] << " verts";
+    }
+    EXPECT_EQ(page.size(), in.GetPosition());
+    in.Close();
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(plVertCoder, RoundTrip)
+{
+    const uint8_t format = plGBufferGroup::kSkinWeightMask | plGBufferGroup::kSkinIndices | 3;
+    const uint32_t numVerts = 5000;
+    const uint32_t stride = VertSize(format);
+    std::vector<uint8_t> verts = MakeVerts(format, numVerts, 3);
+    std::vector<uint8_t> coded = Encode(verts, format, numVerts);
+
+    hsReadOnlyStream s(coded.size(), coded.data());
+    std::vector<uint8_t> decoded = Decode(&s, format, numVerts, true);
+
+    for (uint32_t i = 0; i < numVerts; i++)
+    {
+        const float* a = (const float*)&verts[i * stride];
+        const float* b = (const float*)&decoded[i * stride];
+        for (int j = 0; j < 3; j++)
+            ASSERT_NEAR(a[j], b[j], 1.f / 1024.f) << "position, vert " << i;
+        for (int j = 3; j < 6; j++)
+            ASSERT_NEAR(a[j], b[j], 1.f / 32768.f) << "weight, vert " << i;
+        ASSERT_EQ(0, memcmp(a + 6, b + 6, sizeof(uint32_t))) << "indices, vert " << i;
+        for (int j = 7; j < 10; j++)
+            ASSERT_NEAR(a[j], b[j], 2.f / 255.f) << "normal, vert " << i;
+        ASSERT_EQ(0, memcmp(a + 10, b + 10, sizeof(uint32_t))) << "color, vert " << i;
+        ASSERT_EQ(0.f, b[11]) << "color2, vert " << i;
+        for (int j = 12; j < 21; j++)
+            ASSERT_NEAR(a[j], b[j], 1.f / 65536.f) << "uvw, vert " << i;
+    }
+}
@@ -0,0 +1,128 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plFile/plSecureStream.h"
+
+static const plFileName kTestFile = "test_plSecureStream.dat";
+
+static std::vector<uint8_t> MakeData(uint32_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t seed = size;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    return data;
+}
+
+static void WriteEncrypted(const std::vector<uint8_t>& data)
+{
+    plSecureStream out;
+    ASSERT_TRUE(out.Open(kTestFile, "wb"));
+    if (!data.empty())
+        out.Write(data.size(), data.data());
+    out.Close();
+}
+
+static std::vector<uint8_t> ReadAll(hsStream* stream, uint32_t readSize)
+{
+    std::vector<uint8_t> result;
+    std::vector<uint8_t> buf(readSize);
+    while (!stream->AtEnd())
+    {
+        uint32_t numRead = stream->Read(readSize, buf.data());
+        if (numRead == 0)
+            break;
+        result.insert(result.end(), buf.begin(), buf.begin() + numRead);
+    }
+    return result;
+}
+
+// Sizes around the chunk boundaries, plus typical .age/.sdl/.fni/.pak sizes.
+// The larger ones go through the unbuffered and multithreaded paths.
+static const uint32_t kTestSizes[] = {
+    1, 7, 8, 9, 1000, 5000, 10*1024, 10*1024 + 1, 30000, 1024*1024 + 3
+};
+
+TEST(plSecureStream, RoundTripFile)
+{
+    for (uint32_t size : kTestSizes)
+    {
+        std::vector<uint8_t> data = MakeData(size);
+        WriteEncrypted(data);
+        ASSERT_TRUE(plSecureStream::IsSecureFile(kTestFile));
+
+        // Odd sized reads so we keep landing in the middle of a chunk
+        plSecureStream in;
+        ASSERT_TRUE(in.Open(kTestFile, "rb"));
+        EXPECT_EQ(size, in.GetActualFileSize());
+        EXPECT_EQ(data, ReadAll(&in, 1021)) << "size " << size;
+        in.Close();
+    }
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(plSecureStream, RoundTripStream)
+{
+    for (uint32_t size : kTestSizes)
+    {
+        std::vector<uint8_t> data = MakeData(size);
+        WriteEncrypted(data);
+
+        hsUNIXStream base;
+        ASSERT_TRUE(base.Open(kTestFile, "rb"));
+        plSecureStream in(&base);
+        base.Close();
+
+        EXPECT_EQ(size, in.GetActualFileSize());
+        EXPECT_EQ(data, ReadAll(&in, 4096)) << "size " << size;
+        in.Close();
+    }
+    plFileSystem::Unlink(kTestFile);
+}
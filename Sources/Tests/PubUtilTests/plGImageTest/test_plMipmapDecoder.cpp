@@ -0,0 +1,372 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include <jpeglib.h>
+#include <png.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plGImage/plJPEG.h"
+#include "plGImage/plMipmap.h"
+#include "plGImage/plMipmapDecoder.h"
+#include "plGImage/plPNG.h"
+
+class DecodeMipmap : public plMipmap
+{
+public:
+    DecodeMipmap() { }
+    DecodeMipmap(uint32_t width, uint32_t height, uint8_t compType)
+        : plMipmap(width, height, kARGB32Config, 1, compType)
+    { }
+
+    uint8_t GetCompressionType() const { return fCompressionType; }
+
+    using plMipmap::Read;
+    using plMipmap::Write;
+};
+
+// Smooth enough to stay JPEG, with an alpha that isn't flat
+static void FillGradient(plMipmap& mip, uint32_t seed)
+{
+    uint8_t* data = (uint8_t*)mip.GetImage();
+    for (uint32_t y = 0; y < mip.GetHeight(); y++)
+    {
+        for (uint32_t x = 0; x < mip.GetWidth(); x++)
+        {
+            uint8_t* p = data + (y * mip.GetWidth() + x) * 4;
+            p[0] = uint8_t(x * 255 / mip.GetWidth() + seed);
+            p[1] = uint8_t(y * 255 / mip.GetHeight());
+            p[2] = uint8_t((x + y + seed) >> 1);
+            p[3] = uint8_t((x * y) >> 4);
+        }
+    }
+}
+
+// Flat, so both halves of a JPEG map go out as RLE
+static void FillFlat(plMipmap& mip)
+{
+    uint32_t* data = (uint32_t*)mip.GetImage();
+    for (uint32_t i = 0; i < mip.GetWidth() * mip.GetHeight(); i++)
+        data[i] = 0x80336699;
+}
+
+static std::vector<uint8_t> WriteMap(DecodeMipmap& mip)
+{
+    hsRAMStream ram;
+    mip.Write(&ram);
+    std::vector<uint8_t> data(ram.GetEOF());
+    ram.CopyToMem(data.data());
+    return data;
+}
+
+static void ReadMap(DecodeMipmap& mip, const std::vector<uint8_t>& data, bool async)
+{
+    plMipmapDecoder::Instance().SetEnabled(async);
+    hsReadOnlyStream s(data.size(), data.data());
+    mip.Read(&s);
+    EXPECT_EQ(data.size(), s.GetPosition());
+}
+
+static void ExpectSame(const DecodeMipmap& a, const DecodeMipmap& b)
+{
+    ASSERT_EQ(a.GetWidth(), b.GetWidth());
+    ASSERT_EQ(a.GetHeight(), b.GetHeight());
+    ASSERT_EQ(a.GetTotalSize(), b.GetTotalSize());
+    EXPECT_EQ(a.GetNumLevels(), b.GetNumLevels());
+    EXPECT_EQ(a.GetFlags(), b.GetFlags());
+    EXPECT_EQ(a.GetCompressionType(), b.GetCompressionType());
+    EXPECT_EQ(0, memcmp(a.GetImage(), b.GetImage(), a.GetTotalSize()));
+}
+
+static void DecodeRoundTrip(uint32_t width, uint32_t height, uint8_t compType, bool flat)
+{
+    DecodeMipmap src(width, height, compType);
+    if (flat)
+        FillFlat(src);
+    else
+        FillGradient(src, 0);
+    std::vector<uint8_t> data = WriteMap(src);
+
+    DecodeMipmap inline_, async;
+    ReadMap(inline_, data, false);
+    ReadMap(async, data, true);
+    ExpectSame(inline_, async);
+
+    EXPECT_EQ(width, async.GetWidth());
+    EXPECT_EQ(height, async.GetHeight());
+    EXPECT_TRUE(async.GetFlags() & plBitmap::kAlphaChannelFlag);
+    plMipmapDecoder::Instance().Flush();
+    EXPECT_EQ(0, plMipmapDecoder::Instance().GetNumPending());
+}
+
+TEST(plMipmapDecoder, JPEG)
+{
+    // Widths that aren't a multiple of the SIMD or JPEG block sizes
+    DecodeRoundTrip(256, 128, plBitmap::kJPEGCompression, false);
+    DecodeRoundTrip(203, 77, plBitmap::kJPEGCompression, false);
+}
+
+TEST(plMipmapDecoder, JPEGRLE)
+{
+    DecodeRoundTrip(64, 64, plBitmap::kJPEGCompression, true);
+}
+
+TEST(plMipmapDecoder, PNG)
+{
+    DecodeRoundTrip(256, 128, plBitmap::kPNGCompression, false);
+    DecodeRoundTrip(203, 77, plBitmap::kPNGCompression, false);
+}
+
+TEST(plMipmapDecoder, PNGLossless)
+{
+    DecodeMipmap src(97, 33, plBitmap::kPNGCompression);
+    FillGradient(src, 5);
+    std::vector<uint8_t> data = WriteMap(src);
+
+    DecodeMipmap async;
+    ReadMap(async, data, true);
+    ASSERT_EQ(src.GetTotalSize(), async.GetTotalSize());
+    EXPECT_EQ(0, memcmp(src.GetImage(), async.GetImage(), src.GetTotalSize()));
+}
+
+static void WritePNGData(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    std::vector<uint8_t>* out = (std::vector<uint8_t>*)png_get_io_ptr(png_ptr);
+    out->insert(out->end(), data, data + length);
+}
+
+TEST(plMipmapDecoder, PNGGray)
+{
+    // plPNG only writes RGBA, so make a gray one by hand
+    const uint32_t width = 13, height = 5;
+    std::vector<uint8_t> file;
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    png_set_write_fn(png_ptr, &file, WritePNGData, nullptr);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+    uint8_t row[width];
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+            row[x] = uint8_t(x * 19 + y);
+        png_write_row(png_ptr, row);
+    }
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    hsReadOnlyStream s(file.size(), file.data());
+    std::unique_ptr<plMipmap> mip(plPNG::Instance().ReadFromStream(&s));
+    ASSERT_TRUE(mip != nullptr);
+    ASSERT_EQ(width, mip->GetWidth());
+    const uint8_t* data = (const uint8_t*)mip->GetImage();
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const uint8_t* p = data + (y * width + x) * 4;
+            uint8_t gray = uint8_t(x * 19 + y);
+            EXPECT_TRUE(p[0] == gray && p[1] == gray && p[2] == gray && p[3] == 0xFF) << x << ", " << y;
+        }
+    }
+}
+
+TEST(plMipmapDecoder, JPEGMatchesRGB)
+{
+    // Whichever way plJPEG gets to BGRx, it has to match decoding to plain RGB
+    DecodeMipmap src(203, 77, plBitmap::kJPEGCompression);
+    FillGradient(src, 9);
+    hsRAMStream ram;
+    plJPEG::Instance().SetWriteQuality(70);
+    ASSERT_TRUE(plJPEG::Instance().WriteToStream(&ram, &src));
+    ram.Rewind();
+    uint32_t size = ram.ReadLE32();
+    std::vector<uint8_t> jpeg(size);
+    ram.Read(size, jpeg.data());
+
+    std::vector<uint8_t> bgrx(203 * 77 * 4);
+    ASSERT_TRUE(plJPEG::Instance().ReadToBuffer(jpeg.data(), size, bgrx.data(), 203, 77));
+    EXPECT_FALSE(plJPEG::Instance().ReadToBuffer(jpeg.data(), size, bgrx.data(), 202, 77));
+
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg.data(), size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    std::vector<uint8_t> rgb(cinfo.output_width * 3);
+    bool same = true;
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        const uint8_t* dst = bgrx.data() + cinfo.output_scanline * 203 * 4;
+        JSAMPROW row = rgb.data();
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        for (uint32_t x = 0; x < cinfo.output_width; x++)
+        {
+            const uint8_t* p = dst + x * 4;
+            same &= p[0] == rgb[x * 3 + 2] && p[1] == rgb[x * 3 + 1] && p[2] == rgb[x * 3] && p[3] == 0xFF;
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    EXPECT_TRUE(same);
+}
+
+TEST(plMipmapDecoder, ExpandRGB)
+{
+    // Every tail length the SIMD loop can leave
+    for (uint32_t count = 0; count < 40; count++)
+    {
+        std::vector<uint8_t> src(count * 3);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = uint8_t(i * 37 + 11);
+
+        std::vector<uint8_t> dst(count * 4 + 4, 0x5A);
+        plMipmapDecoder::expand_rgb.call(dst.data(), src.data(), count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            ASSERT_EQ(src[i * 3 + 2], dst[i * 4 + 0]) << count << ", " << i;
+            ASSERT_EQ(src[i * 3 + 1], dst[i * 4 + 1]) << count << ", " << i;
+            ASSERT_EQ(src[i * 3 + 0], dst[i * 4 + 2]) << count << ", " << i;
+            ASSERT_EQ(0xFF, dst[i * 4 + 3]) << count << ", " << i;
+        }
+        // Nothing past the end
+        for (uint32_t i = count * 4; i < dst.size(); i++)
+            ASSERT_EQ(0x5A, dst[i]);
+    }
+}
+
+TEST(plMipmapDecoder, MergeAlpha)
+{
+    for (uint32_t count = 0; count < 40; count++)
+    {
+        std::vector<uint8_t> dst(count * 4 + 4), alpha(count * 4), expected;
+        for (size_t i = 0; i < dst.size(); i++)
+            dst[i] = uint8_t(i * 13 + 1);
+        for (size_t i = 0; i < alpha.size(); i++)
+            alpha[i] = uint8_t(i * 29 + 7);
+
+        expected = dst;
+        for (uint32_t i = 0; i < count; i++)
+            expected[i * 4 + 3] = alpha[i * 4 + 2];
+
+        plMipmapDecoder::merge_alpha.call(dst.data(), alpha.data(), count);
+        ASSERT_EQ(expected, dst) << count;
+    }
+}
+
+TEST(plMipmapDecoder, ManyMaps)
+{
+    const uint32_t count = 24;
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::unique_ptr<DecodeMipmap>> inline_;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DecodeMipmap src(128 + i, 64, i & 1 ? plBitmap::kPNGCompression : plBitmap::kJPEGCompression);
+        FillGradient(src, i);
+        data.push_back(WriteMap(src));
+        inline_.emplace_back(new DecodeMipmap);
+        ReadMap(*inline_.back(), data.back(), false);
+    }
+
+    std::vector<std::unique_ptr<DecodeMipmap>> async;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        async.emplace_back(new DecodeMipmap);
+        ReadMap(*async.back(), data[i], true);
+    }
+
+    // Some go away before anyone looks at them
+    for (uint32_t i = 0; i < count; i += 5)
+        async[i].reset();
+
+    plMipmapDecoder::Instance().Flush();
+    EXPECT_EQ(0, plMipmapDecoder::Instance().GetNumPending());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (async[i])
+            ExpectSame(*inline_[i], *async[i]);
+    }
+}
+
+TEST(plMipmapDecoder, AddrAfterRead)
+{
+    const uint32_t count = 16;
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::unique_ptr<DecodeMipmap>> inline_;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DecodeMipmap src(96, 80 + i, i & 1 ? plBitmap::kPNGCompression : plBitmap::kJPEGCompression);
+        FillGradient(src, i);
+        data.push_back(WriteMap(src));
+        inline_.emplace_back(new DecodeMipmap);
+        ReadMap(*inline_.back(), data.back(), false);
+    }
+
+    plMipmapDecoder::Instance().Flush();
+    std::vector<std::unique_ptr<DecodeMipmap>> async;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        async.emplace_back(new DecodeMipmap);
+        ReadMap(*async.back(), data[i], true);
+    }
+
+    // Straight at the pixels, without a SetCurrLevel() to wait for them.
+    // Each map's job is done and retired by the time GetAddr32() returns.
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const DecodeMipmap& mip = *async[i];
+        uint32_t* pixels = mip.GetAddr32(0, 0);
+        EXPECT_EQ(count - i - 1, plMipmapDecoder::Instance().GetNumPending());
+        const uint32_t* expected = (const uint32_t*)inline_[i]->GetImage();
+        ASSERT_EQ(inline_[i]->GetTotalSize(), mip.GetCurrLevelSize());
+        EXPECT_EQ(0, memcmp(expected, pixels, mip.GetCurrLevelSize()));
+        EXPECT_EQ(expected[7 * mip.GetWidth() + 5], *mip.GetAddr32(5, 7));
+    }
+    EXPECT_EQ(0, plMipmapDecoder::Instance().GetNumPending());
+}
@@ -0,0 +1,245 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plGImage/plMipmap.h"
+#include "plGImage/plMipmapStreamer.h"
+
+static const plFileName kTestFile = "test_plMipmapStreamer.dat";
+
+// Something for the map to sit behind, like the rest of a page
+static const uint32_t kPrefixSize = 37;
+
+class TestMipmap : public plMipmap
+{
+public:
+    TestMipmap() { }
+    TestMipmap(uint32_t width, uint32_t height, uint8_t compType, uint8_t format)
+        : plMipmap(width, height, kARGB32Config, 0, compType, format)
+    {
+        uint8_t* data = (uint8_t*)GetImage();
+        for (uint32_t i = 0; i < GetTotalSize(); i++)
+            data[i] = uint8_t(i * 7 + (i >> 9));
+    }
+
+    using plMipmap::Read;
+    using plMipmap::Write;
+};
+
+static void WriteMap(TestMipmap& mip)
+{
+    hsUNIXStream out;
+    ASSERT_TRUE(out.Open(kTestFile, "wb"));
+    for (uint32_t i = 0; i < kPrefixSize; i++)
+        out.WriteByte(uint8_t(i));
+    mip.Write(&out);
+    out.Close();
+}
+
+static void ReadMap(TestMipmap& mip)
+{
+    hsBufferedStream in;
+    ASSERT_TRUE(in.Open(kTestFile, "rb"));
+    in.Skip(kPrefixSize);
+    mip.Read(&in);
+    in.Close();
+}
+
+static bool Matches(const plMipmap& mip, const plMipmap& src)
+{
+    // A streamed map's image is always a tail of the source's
+    const uint8_t* image = (const uint8_t*)mip.GetImage();
+    const uint8_t* srcImage = (const uint8_t*)src.GetImage() + src.GetTotalSize() - mip.GetTotalSize();
+    return memcmp(image, srcImage, mip.GetTotalSize()) == 0;
+}
+
+static void WaitForReads(plMipmapStreamer& streamer)
+{
+    for (int i = 0; i < 5000 && streamer.GetRequestedBytes() > 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        streamer.Update();
+    }
+}
+
+static void StreamRoundTrip(uint8_t compType, uint8_t format)
+{
+    plMipmapStreamer& streamer = plMipmapStreamer::Instance();
+    streamer.SetEnabled(true);
+    streamer.SetResidentSize(32);
+    streamer.SetBudget(plMipmapStreamer::kDefaultBudget);
+
+    TestMipmap src(256, 128, compType, format);
+    WriteMap(src);
+
+    TestMipmap mip;
+    ReadMap(mip);
+    ASSERT_TRUE(mip.IsStreamed());
+    EXPECT_EQ(32, mip.GetWidth());
+    EXPECT_EQ(16, mip.GetHeight());
+    EXPECT_EQ(src.GetNumLevels() - 3, mip.GetNumLevels());
+    EXPECT_TRUE(Matches(mip, src));
+    uint32_t tailSize = mip.GetTotalSize();
+
+    // Small on screen, the resident levels will do
+    streamer.Request(&mip, 20.f);
+    streamer.Update();
+    EXPECT_EQ(0, streamer.GetRequestedBytes());
+
+    streamer.Request(&mip, 200.f);
+    streamer.Update();
+    EXPECT_EQ(src.GetTotalSize() - tailSize, streamer.GetRequestedBytes());
+    WaitForReads(streamer);
+    EXPECT_EQ(256, mip.GetWidth());
+    EXPECT_EQ(src.GetNumLevels(), mip.GetNumLevels());
+    ASSERT_EQ(src.GetTotalSize(), mip.GetTotalSize());
+    EXPECT_TRUE(Matches(mip, src));
+    EXPECT_EQ(src.GetTotalSize() - tailSize, streamer.GetResidentBytes());
+    EXPECT_GT(streamer.GetAverageLatency(), 0.f);
+
+    // Not wanted this frame and over budget, so it drops back to the tail
+    streamer.SetBudget(0);
+    streamer.Update();
+    EXPECT_EQ(32, mip.GetWidth());
+    EXPECT_EQ(tailSize, mip.GetTotalSize());
+    EXPECT_TRUE(Matches(mip, src));
+    EXPECT_EQ(0, streamer.GetResidentBytes());
+
+    // Nothing fits, so nothing is read
+    streamer.Request(&mip, 200.f);
+    streamer.Update();
+    EXPECT_EQ(0, streamer.GetRequestedBytes());
+
+    // Pinning loads it all now, for good
+    streamer.Pin(&mip);
+    EXPECT_FALSE(mip.IsStreamed());
+    ASSERT_EQ(src.GetTotalSize(), mip.GetTotalSize());
+    EXPECT_TRUE(Matches(mip, src));
+
+    streamer.SetEnabled(false);
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(plMipmapStreamer, StreamRawLevels)
+{
+    StreamRoundTrip(plBitmap::kUncompressed, plBitmap::UncompressedInfo::kRGB8888);
+}
+
+TEST(plMipmapStreamer, StreamDXTLevels)
+{
+    StreamRoundTrip(plBitmap::kDirectXCompression, plBitmap::DirectXInfo::kDXT5);
+}
+
+TEST(plMipmapStreamer, ForgetInFlight)
+{
+    plMipmapStreamer& streamer = plMipmapStreamer::Instance();
+    streamer.SetEnabled(true);
+    streamer.SetResidentSize(32);
+    streamer.SetBudget(plMipmapStreamer::kDefaultBudget);
+
+    TestMipmap src(512, 512, plBitmap::kUncompressed, plBitmap::UncompressedInfo::kRGB8888);
+    WriteMap(src);
+
+    uint32_t numStreamed = streamer.GetNumStreamed();
+    {
+        TestMipmap mip;
+        ReadMap(mip);
+        ASSERT_TRUE(mip.IsStreamed());
+        EXPECT_EQ(numStreamed + 1, streamer.GetNumStreamed());
+        streamer.Request(&mip, 1000.f);
+        streamer.Update();
+    }
+    EXPECT_EQ(numStreamed, streamer.GetNumStreamed());
+
+    // The orphaned read completes and is thrown away
+    WaitForReads(streamer);
+    EXPECT_EQ(0, streamer.GetRequestedBytes());
+    EXPECT_EQ(0, streamer.GetResidentBytes());
+
+    streamer.SetEnabled(false);
+    plFileSystem::Unlink(kTestFile);
+}
+
+TEST(plMipmapStreamer, LoadsWholeWhenItCantStream)
+{
+    plMipmapStreamer& streamer = plMipmapStreamer::Instance();
+    streamer.SetResidentSize(32);
+
+    TestMipmap src(256, 256, plBitmap::kUncompressed, plBitmap::UncompressedInfo::kRGB8888);
+    WriteMap(src);
+
+    // Streaming off
+    TestMipmap off;
+    ReadMap(off);
+    EXPECT_FALSE(off.IsStreamed());
+    EXPECT_EQ(src.GetTotalSize(), off.GetTotalSize());
+
+    streamer.SetEnabled(true);
+
+    // Maps read back on the CPU
+    src.SetFlags(src.GetFlags() | plBitmap::kDontThrowAwayImage);
+    WriteMap(src);
+    TestMipmap keep;
+    ReadMap(keep);
+    EXPECT_FALSE(keep.IsStreamed());
+    EXPECT_EQ(src.GetTotalSize(), keep.GetTotalSize());
+    src.SetFlags(src.GetFlags() & ~plBitmap::kDontThrowAwayImage);
+
+    // Streams with no file behind them
+    hsRAMStream ram;
+    src.Write(&ram);
+    ram.Rewind();
+    TestMipmap mem;
+    mem.Read(&ram);
+    EXPECT_FALSE(mem.IsStreamed());
+    EXPECT_EQ(src.GetTotalSize(), mem.GetTotalSize());
+    EXPECT_TRUE(Matches(mem, src));
+
+    streamer.SetEnabled(false);
+    plFileSystem::Unlink(kTestFile);
+}
@@ -0,0 +1,379 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plInterp/hsInterp.h"
+#include "plInterp/hsKeys.h"
+#include "plInterp/plController.h"
+#include "pnFactory/plCreator.h"
+
+REGISTER_NONCREATABLE( plController );
+REGISTER_CREATABLE( plLeafController );
+
+static float IRand(uint32_t& seed)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) / float(1 << 24);
+}
+
+// The key search as it was before the binary search went in, for reference.
+static void LinearBoundaryKeyFrames(float time, uint32_t numKeys, void *keys, uint32_t size,
+                                    hsKeyFrame **kF1, hsKeyFrame **kF2, uint32_t *lastKeyIdx, float *p, bool forwards)
+{
+    auto GetKey = [=](int32_t i) { return (hsKeyFrame*)((char*)keys + size * i); };
+    int k1, k2;
+    float frame = time * MAX_FRAMES_PER_SEC;
+
+    if (frame > GetKey(numKeys-1)->fFrame)
+    {
+        k1 = k2 = numKeys-1;
+        *kF1 = *kF2 = GetKey(k1);
+        *p = 0.f;
+        *lastKeyIdx = k1;
+        return;
+    }
+    hsKeyFrame *key1, *key2;
+    if (frame < (key1 = GetKey(0))->fFrame)
+    {
+        k1 = k2 = 0;
+        *kF1 = *kF2 = GetKey(k1);
+        *p = 0.f;
+        *lastKeyIdx = k1;
+        return;
+    }
+
+    int i = 1;
+    if (*lastKeyIdx > 0 && *lastKeyIdx < numKeys - 1)
+    {
+        if (forwards)
+            key1 = GetKey(*lastKeyIdx);
+        else
+            key2 = GetKey(*lastKeyIdx + 1);
+        i = *lastKeyIdx + 1;
+    }
+    else if (!forwards)
+        key2 = GetKey(1);
+
+    for (int count = 1; count <= numKeys; count++, forwards ? i++ : i--)
+    {
+        if (forwards)
+        {
+            if (i >= numKeys)
+            {
+                key1 = GetKey(0);
+                i = 1;
+                count++;
+            }
+            key2 = GetKey(i);
+        }
+        else
+        {
+            if (i < 1)
+            {
+                i = numKeys - 1;
+                key2 = GetKey(i);
+                count++;
+            }
+            key1 = GetKey(i - 1);
+        }
+        if (frame <= key2->fFrame && frame >= key1->fFrame)
+        {
+            *kF1 = key1;
+            *kF2 = key2;
+            *p = (time - key1->fFrame / MAX_FRAMES_PER_SEC) / ((key2->fFrame - key1->fFrame) / MAX_FRAMES_PER_SEC);
+            *lastKeyIdx = i - 1;
+            return;
+        }
+        if (forwards)
+            key1 = key2;
+        else
+            key2 = key1;
+    }
+}
+
+// Scalar keys with frame gaps of 1 to 4, like a reduced Max export.
+static plLeafController* MakeIrregularTrack(uint32_t numKeys, uint32_t& seed)
+{
+    plLeafController* ctl = new plLeafController;
+    ctl->AllocKeys(numKeys, hsKeyFrame::kScalarKeyFrame);
+    uint16_t frame = 0;
+    for (uint32_t i = 0; i < numKeys; i++)
+    {
+        hsScalarKey* key = ctl->GetScalarKey(i);
+        key->fFrame = frame;
+        key->fValue = IRand(seed) * 10.f;
+        frame += 1 + uint16_t(IRand(seed) * 4.f);
+    }
+    ctl->UpdateKeySpacing();
+    return ctl;
+}
+
+// Avatar tracks are sampled once a frame at export, so the keys are evenly
+// spaced and the values move smoothly.
+static plLeafController* MakeRotTrack(uint32_t numKeys, uint32_t& seed)
+{
+    plLeafController* ctl = new plLeafController;
+    ctl->AllocKeys(numKeys, hsKeyFrame::kQuatKeyFrame);
+    hsVector3 axis(IRand(seed) - 0.5f, IRand(seed) - 0.5f, IRand(seed) + 0.1f);
+    axis.Normalize();
+    float rate = 0.02f + IRand(seed) * 0.1f;
+    for (uint32_t i = 0; i < numKeys; i++)
+    {
+        hsQuatKey* key = ctl->GetQuatKey(i);
+        key->fFrame = uint16_t(i);
+        key->fValue.SetAngleAxis(sin(i * rate) * 1.5f, axis);
+    }
+    ctl->UpdateKeySpacing();
+    return ctl;
+}
+
+static plLeafController* MakePosTrack(uint32_t numKeys, uint32_t& seed)
+{
+    plLeafController* ctl = new plLeafController;
+    ctl->AllocKeys(numKeys, hsKeyFrame::kPoint3KeyFrame);
+    hsPoint3 base(IRand(seed) * 4.f, IRand(seed) * 4.f, IRand(seed) * 6.f);
+    float rate = 0.02f + IRand(seed) * 0.1f;
+    for (uint32_t i = 0; i < numKeys; i++)
+    {
+        hsPoint3Key* key = ctl->GetPoint3Key(i);
+        key->fFrame = uint16_t(i);
+        key->fValue.Set(base.fX + sin(i * rate) * 0.5f, base.fY + cos(i * rate) * 0.25f, base.fZ);
+    }
+    ctl->UpdateKeySpacing();
+    return ctl;
+}
+
+static float QuatError(const hsQuat& a, const hsQuat& b)
+{
+    return std::min(std::max(std::max(fabs(a.fX - b.fX), fabs(a.fY - b.fY)), std::max(fabs(a.fZ - b.fZ), fabs(a.fW - b.fW))),
+                    std::max(std::max(fabs(a.fX + b.fX), fabs(a.fY + b.fY)), std::max(fabs(a.fZ + b.fZ), fabs(a.fW + b.fW))));
+}
+
+TEST(plLeafController, BoundaryKeysMatchLinearSearch)
+{
+    uint32_t seed = 1;
+    plLeafController* ctl = MakeIrregularTrack(200, seed);
+    EXPECT_EQ(0, ctl->GetKeySpacing());
+
+    hsScalarKey* keys = ctl->GetScalarKey(0);
+    float length = ctl->GetLength();
+    for (int i = 0; i < 20000; i++)
+    {
+        float time = (IRand(seed) * 1.2f - 0.1f) * length;
+        // Land on key frames exactly now and then.
+        if (i % 7 == 0)
+            time = keys[uint32_t(IRand(seed) * 199)].fFrame / MAX_FRAMES_PER_SEC;
+        bool forwards = (i & 1) != 0;
+        uint32_t hint = uint32_t(IRand(seed) * 200);
+
+        hsScalarKey *a1, *a2, *b1, *b2;
+        float pa, pb;
+        uint32_t hintA = hint, hintB = hint;
+        hsInterp::GetBoundaryKeyFrames(time, 200, keys, sizeof(hsScalarKey), (hsKeyFrame**)&a1, (hsKeyFrame**)&a2, &hintA, &pa, forwards);
+        LinearBoundaryKeyFrames(time, 200, keys, sizeof(hsScalarKey), (hsKeyFrame**)&b1, (hsKeyFrame**)&b2, &hintB, &pb, forwards);
+
+        ASSERT_LE(a1->fFrame, a2->fFrame);
+        EXPECT_EQ(a1, ctl->GetScalarKey(hintA));
+
+        float va, vb;
+        hsInterp::LinInterp(a1->fValue, a2->fValue, pa, &va);
+        hsInterp::LinInterp(b1->fValue, b2->fValue, pb, &vb);
+        ASSERT_NEAR(vb, va, 1e-4f) << "time " << time << " hint " << hint;
+    }
+    delete ctl;
+}
+
+TEST(plLeafController, HintFollowsPlayback)
+{
+    uint32_t seed = 2;
+    plLeafController* ctl = MakeIrregularTrack(100, seed);
+    hsScalarKey* keys = ctl->GetScalarKey(0);
+    float length = ctl->GetLength();
+
+    for (int dir = 0; dir < 2; dir++)
+    {
+        bool forwards = (dir == 0);
+        uint32_t hint = forwards ? 0 : 98;
+        for (int f = 0; f <= 1000; f++)
+        {
+            float time = (forwards ? f : 1000 - f) * length / 1000;
+            hsScalarKey *k1, *k2;
+            float p;
+            hsInterp::GetBoundaryKeyFrames(time, 100, keys, sizeof(hsScalarKey), (hsKeyFrame**)&k1, (hsKeyFrame**)&k2, &hint, &p, forwards);
+            float frame = time * MAX_FRAMES_PER_SEC;
+            ASSERT_LE(k1->fFrame, frame + 1e-3f);
+            ASSERT_GE(k2->fFrame, frame - 1e-3f);
+            ASSERT_GE(p, -1e-4f);
+            ASSERT_LE(p, 1.f + 1e-4f);
+        }
+    }
+    delete ctl;
+}
+
+TEST(plLeafController, UniformTracksIndexDirectly)
+{
+    float times[64], values[64];
+    for (int i = 0; i < 64; i++)
+    {
+        times[i] = (i * 2 + 3.5f) / MAX_FRAMES_PER_SEC;
+        values[i] = float(i * i);
+    }
+    plLeafController even;
+    even.QuickScalarController(64, times, values, sizeof(float));
+    EXPECT_EQ(2, even.GetKeySpacing());
+
+    uint32_t seed = 3;
+    for (int i = 0; i < 1000; i++)
+    {
+        float time = IRand(seed) * 5.f - 0.2f;
+        float frame = time * MAX_FRAMES_PER_SEC;
+        float expected;
+        if (frame <= 3.f)
+            expected = 0.f;
+        else if (frame >= 129.f)
+            expected = 63.f * 63.f;
+        else
+        {
+            int k = int((frame - 3.f) / 2.f);
+            float t = (frame - 3.f - k * 2.f) / 2.f;
+            expected = k * k + t * ((k + 1) * (k + 1) - k * k);
+        }
+        float result;
+        even.Interp(time, &result);
+        ASSERT_NEAR(expected, result, 1e-2f) << "time " << time;
+    }
+
+    times[10] += 1.f / MAX_FRAMES_PER_SEC;
+    plLeafController uneven;
+    uneven.QuickScalarController(64, times, values, sizeof(float));
+    EXPECT_EQ(0, uneven.GetKeySpacing());
+}
+
+TEST(plLeafController, CompressQuatKeys)
+{
+    uint32_t seed = 4;
+    plLeafController* ref = MakeRotTrack(120, seed);
+    seed = 4;
+    plLeafController* comp = MakeRotTrack(120, seed);
+
+    EXPECT_TRUE(comp->CompressKeys());
+    EXPECT_EQ(hsKeyFrame::kCompressedQuatKeyFrame32, comp->GetType());
+    EXPECT_EQ(1, comp->GetKeySpacing());
+
+    float maxErr = 0.f;
+    for (int f = 0; f < 1200; f++)
+    {
+        float time = f / (10.f * MAX_FRAMES_PER_SEC);
+        hsQuat a, b;
+        ref->Interp(time, &a);
+        comp->Interp(time, &b);
+        maxErr = std::max(maxErr, QuatError(a, b));
+    }
+    EXPECT_LT(maxErr, 2.f * plLeafController::kDefaultQuatTolerance);
+
+    // Too tight for 32 bits, fine for 64.
+    seed = 4;
+    plLeafController* comp64 = MakeRotTrack(120, seed);
+    EXPECT_TRUE(comp64->CompressKeys(1e-4f));
+    EXPECT_EQ(hsKeyFrame::kCompressedQuatKeyFrame64, comp64->GetType());
+    for (int f = 0; f < 1200; f++)
+    {
+        float time = f / (10.f * MAX_FRAMES_PER_SEC);
+        hsQuat a, b;
+        ref->Interp(time, &a);
+        comp64->Interp(time, &b);
+        ASSERT_LT(QuatError(a, b), 2e-4f);
+    }
+
+    delete ref;
+    delete comp;
+    delete comp64;
+}
+
+TEST(plLeafController, CompressPosKeys)
+{
+    uint32_t seed = 5;
+    plLeafController* ref = MakePosTrack(120, seed);
+    seed = 5;
+    plLeafController* comp = MakePosTrack(120, seed);
+
+    EXPECT_FALSE(comp->CompressKeys(plLeafController::kDefaultQuatTolerance, 1e-7f));
+    EXPECT_EQ(hsKeyFrame::kPoint3KeyFrame, comp->GetType());
+
+    EXPECT_TRUE(comp->CompressKeys());
+    EXPECT_EQ(hsKeyFrame::kCompressedPoint3KeyFrame, comp->GetType());
+    EXPECT_EQ(1, comp->GetKeySpacing());
+
+    for (int f = 0; f < 1200; f++)
+    {
+        float time = f / (10.f * MAX_FRAMES_PER_SEC);
+        hsPoint3 a, b;
+        ref->Interp(time, &a);
+        comp->Interp(time, &b);
+        ASSERT_NEAR(a.fX, b.fX, plLeafController::kDefaultPosTolerance);
+        ASSERT_NEAR(a.fY, b.fY, plLeafController::kDefaultPosTolerance);
+        ASSERT_NEAR(a.fZ, b.fZ, plLeafController::kDefaultPosTolerance);
+    }
+
+    // The quantization range goes out with the keys.
+    hsRAMStream stream;
+    comp->Write(&stream, nil);
+    stream.Rewind();
+    plLeafController read;
+    read.Read(&stream, nil);
+    EXPECT_EQ(hsKeyFrame::kCompressedPoint3KeyFrame, read.GetType());
+    EXPECT_EQ(1, read.GetKeySpacing());
+    for (int f = 0; f < 120; f++)
+    {
+        hsPoint3 a, b;
+        comp->Interp(f / MAX_FRAMES_PER_SEC, &a);
+        read.Interp(f / MAX_FRAMES_PER_SEC, &b);
+        ASSERT_EQ(a, b);
+    }
+
+    delete ref;
+    delete comp;
+}
@@ -0,0 +1,383 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsBounds.h"
+#include "hsGeometry3.h"
+#include "hsMatrix44.h"
+#include "plViewTransform.h"
+#include "plDrawable/plSpaceTree.h"
+#include "plDrawable/plSpaceTreeMaker.h"
+#include "plPipeline/plCullTree.h"
+#include "plPipeline/plHiZBuffer.h"
+#include "plScene/plCullPoly.h"
+#include "pnFactory/plCreator.h"
+
+REGISTER_CREATABLE( plSpaceTree );
+
+static float Rand(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return float((seed >> 8) & 0xffff) / 65535.f;
+}
+
+static hsMatrix44 MakeWorldToNDC(const hsPoint3& from, float yaw, float pitch)
+{
+    hsVector3 dir(cosf(yaw) * cosf(pitch), sinf(yaw) * cosf(pitch), sinf(pitch));
+    hsPoint3 at = from + dir;
+
+    hsMatrix44 w2c, c2w;
+    hsMatrix44::MakeCameraMatrices(from, at, hsVector3(0, 0, 1.f), w2c, c2w);
+
+    plViewTransform view;
+    view.SetScreenSize(800, 600);
+    view.SetCameraTransform(w2c, c2w);
+    view.SetFovDeg(90.f, 67.5f);
+    view.SetDepth(0.3f, 2000.f);
+    view.SetPerspective(true);
+
+    return view.GetWorldToNDC();
+}
+
+// A one sided quad facing along outward, wound so InitFromVerts agrees.
+static void MakeQuad(plCullPoly& poly, const hsPoint3 corners[4], const hsVector3& outward, uint32_t flags = plCullPoly::kNone)
+{
+    poly.fVerts.SetCount(4);
+    for (int i = 0; i < 4; i++)
+        poly.fVerts[i] = corners[i];
+    poly.InitFromVerts(flags);
+    if (poly.fNorm.InnerProduct(outward) < 0)
+    {
+        std::swap(poly.fVerts[1], poly.fVerts[3]);
+        poly.InitFromVerts(flags);
+    }
+}
+
+static hsBounds3Ext MakeBox(const hsPoint3& mins, const hsPoint3& maxs)
+{
+    hsBounds3Ext bnd;
+    bnd.Reset(&mins);
+    bnd.Union(&maxs);
+    return bnd;
+}
+
+// A dense age stand in: a grid of city blocks, each a building whose walls
+// are occluders, with props scattered through the streets between them.
+class plTestCity
+{
+public:
+    std::vector<plCullPoly>     fWalls;
+    std::vector<hsBounds3Ext>   fLeaves;
+    plSpaceTree*                fTree;
+
+    static const float kBlock;
+    static const float kStreet;
+
+    plTestCity(int blocksPerSide, int numProps, uint32_t seed)
+    {
+        const float kWallInset = 0.5f;
+        for (int i = 0; i < blocksPerSide; i++)
+        {
+            for (int j = 0; j < blocksPerSide; j++)
+            {
+                float x0 = i * (kBlock + kStreet);
+                float y0 = j * (kBlock + kStreet);
+                float height = 15.f + Rand(seed) * 25.f;
+                fLeaves.push_back(MakeBox(hsPoint3(x0, y0, 0), hsPoint3(x0 + kBlock, y0 + kBlock, height)));
+
+                // Occluders sit just inside the building's faces.
+                float lo = kWallInset;
+                float hi = kBlock - kWallInset;
+                float top = height - kWallInset;
+                hsPoint3 c[4];
+                fWalls.resize(fWalls.size() + 4);
+                plCullPoly* wall = &fWalls[fWalls.size() - 4];
+
+                c[0].Set(x0 + lo, y0 + lo, 0); c[1].Set(x0 + hi, y0 + lo, 0); c[2].Set(x0 + hi, y0 + lo, top); c[3].Set(x0 + lo, y0 + lo, top);
+                MakeQuad(wall[0], c, hsVector3(0, -1.f, 0));
+                c[0].Set(x0 + lo, y0 + hi, 0); c[1].Set(x0 + hi, y0 + hi, 0); c[2].Set(x0 + hi, y0 + hi, top); c[3].Set(x0 + lo, y0 + hi, top);
+                MakeQuad(wall[1], c, hsVector3(0, 1.f, 0));
+                c[0].Set(x0 + lo, y0 + lo, 0); c[1].Set(x0 + lo, y0 + hi, 0); c[2].Set(x0 + lo, y0 + hi, top); c[3].Set(x0 + lo, y0 + lo, top);
+                MakeQuad(wall[2], c, hsVector3(-1.f, 0, 0));
+                c[0].Set(x0 + hi, y0 + lo, 0); c[1].Set(x0 + hi, y0 + hi, 0); c[2].Set(x0 + hi, y0 + hi, top); c[3].Set(x0 + hi, y0 + lo, top);
+                MakeQuad(wall[3], c, hsVector3(1.f, 0, 0));
+            }
+        }
+
+        // Props stay in the streets, so none of them are inside a building.
+        const float extent = blocksPerSide * (kBlock + kStreet);
+        while (int(fLeaves.size()) < blocksPerSide * blocksPerSide + numProps)
+        {
+            float x = Rand(seed) * extent;
+            float y = Rand(seed) * extent;
+            float size = 0.5f + Rand(seed) * 2.5f;
+            if (fmodf(x, kBlock + kStreet) < kBlock + 1.f && fmodf(y, kBlock + kStreet) < kBlock + 1.f)
+                continue;
+            fLeaves.push_back(MakeBox(hsPoint3(x, y, 0), hsPoint3(x + size, y + size, size)));
+        }
+
+        plSpaceTreeMaker maker;
+        maker.Reset();
+        for (const hsBounds3Ext& bnd : fLeaves)
+            maker.AddLeaf(bnd);
+        fTree = maker.MakeTree();
+    }
+    ~plTestCity() { delete fTree; }
+
+    // A viewer walking the streets.
+    hsMatrix44 RandomView(uint32_t& seed, hsPoint3& pos) const
+    {
+        int blocksPerSide = int(sqrtf(float(fWalls.size() / 4)));
+        int street = int(Rand(seed) * blocksPerSide);
+        float along = Rand(seed) * blocksPerSide * (kBlock + kStreet);
+        pos.Set(street * (kBlock + kStreet) + kBlock + kStreet * 0.5f, along, 1.8f);
+        if (Rand(seed) < 0.5f)
+            std::swap(pos.fX, pos.fY);
+        return MakeWorldToNDC(pos, Rand(seed) * 6.28f, Rand(seed) * 0.2f - 0.05f);
+    }
+
+    // The same nearest first ordering and cap plPageTreeMgr applies.
+    void SortedWalls(const hsPoint3& viewPos, hsTArray<const plCullPoly*>& polys) const
+    {
+        std::vector<const plCullPoly*> sorted;
+        for (const plCullPoly& wall : fWalls)
+            sorted.push_back(&wall);
+        std::sort(sorted.begin(), sorted.end(), [&viewPos](const plCullPoly* a, const plCullPoly* b)
+        {
+            return (a->GetCenter() - viewPos).MagnitudeSquared() < (b->GetCenter() - viewPos).MagnitudeSquared();
+        });
+        const size_t kMaxCullPolys = 300;
+        if (sorted.size() > kMaxCullPolys)
+            sorted.resize(kMaxCullPolys);
+
+        polys.SetCount(0);
+        for (const plCullPoly* poly : sorted)
+            polys.Append(poly);
+    }
+};
+
+const float plTestCity::kBlock = 24.f;
+const float plTestCity::kStreet = 12.f;
+
+static std::vector<int16_t> ToVector(hsTArray<int16_t>& list)
+{
+    std::vector<int16_t> vec(list.AcquireArray(), list.AcquireArray() + list.GetCount());
+    std::sort(vec.begin(), vec.end());
+    return vec;
+}
+
+// The BSP the pipeline builds, up to maxNodes nodes.
+static void BuildCullTree(plCullTree& tree, const hsMatrix44& w2ndc, const hsPoint3& viewPos,
+                          const hsTArray<const plCullPoly*>& polys, uint32_t maxNodes)
+{
+    tree.Reset();
+    tree.SetViewPos(viewPos);
+    tree.InitFrustum(w2ndc);
+    for (int i = 0; i < polys.GetCount() && tree.GetNumNodes() < maxNodes; i++)
+        tree.AddPoly(*polys[i]);
+}
+
+TEST(plHiZBuffer, WallHidesWhatsBehindIt)
+{
+    hsPoint3 eye(0, 0, 0);
+    hsMatrix44 w2ndc = MakeWorldToNDC(eye, 0, 0);
+
+    plCullPoly wall;
+    hsPoint3 c[4] = { hsPoint3(50.f, -20.f, -20.f), hsPoint3(50.f, 20.f, -20.f), hsPoint3(50.f, 20.f, 20.f), hsPoint3(50.f, -20.f, 20.f) };
+    MakeQuad(wall, c, hsVector3(-1.f, 0, 0));
+
+    hsTArray<const plCullPoly*> polys;
+    hsTArray<const plCullPoly*> holes;
+    polys.Append(&wall);
+
+    plHiZBuffer hiZ;
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(100.f, -1.f, -1.f), hsPoint3(102.f, 1.f, 1.f))));
+
+    hiZ.Build(w2ndc, eye, polys, holes);
+    ASSERT_EQ(1, hiZ.GetNumOccluders());
+
+    EXPECT_FALSE(hiZ.BoundsVisible(MakeBox(hsPoint3(100.f, -1.f, -1.f), hsPoint3(102.f, 1.f, 1.f))));
+    EXPECT_FALSE(hiZ.BoundsVisible(MakeBox(hsPoint3(60.f, -10.f, -10.f), hsPoint3(80.f, 10.f, 10.f))));
+    // In front of the wall.
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(30.f, -1.f, -1.f), hsPoint3(32.f, 1.f, 1.f))));
+    // Straddling it.
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(49.f, -1.f, -1.f), hsPoint3(52.f, 1.f, 1.f))));
+    // Poking out past its edge.
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(100.f, 30.f, -1.f), hsPoint3(102.f, 60.f, 1.f))));
+    // Behind the eye.
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(-10.f, -1.f, -1.f), hsPoint3(-8.f, 1.f, 1.f))));
+
+    // Seen from behind, a one sided wall hides nothing.
+    hsPoint3 behind(100.f, 0, 0);
+    hiZ.Build(MakeWorldToNDC(behind, 3.14159f, 0), behind, polys, holes);
+    EXPECT_EQ(0, hiZ.GetNumOccluders());
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(10.f, -1.f, -1.f), hsPoint3(12.f, 1.f, 1.f))));
+}
+
+TEST(plHiZBuffer, HoleKeepsOccluderOut)
+{
+    hsPoint3 eye(0, 0, 0);
+    hsMatrix44 w2ndc = MakeWorldToNDC(eye, 0, 0);
+
+    plCullPoly wall;
+    hsPoint3 c[4] = { hsPoint3(50.f, -20.f, -20.f), hsPoint3(50.f, 20.f, -20.f), hsPoint3(50.f, 20.f, 20.f), hsPoint3(50.f, -20.f, 20.f) };
+    MakeQuad(wall, c, hsVector3(-1.f, 0, 0));
+
+    // Holes count when seen from their back, like the cull tree has them.
+    plCullPoly hole;
+    hsPoint3 h[4] = { hsPoint3(50.f, -2.f, -2.f), hsPoint3(50.f, 2.f, -2.f), hsPoint3(50.f, 2.f, 2.f), hsPoint3(50.f, -2.f, 2.f) };
+    MakeQuad(hole, h, hsVector3(1.f, 0, 0), plCullPoly::kHole);
+
+    hsTArray<const plCullPoly*> polys;
+    hsTArray<const plCullPoly*> holes;
+    polys.Append(&wall);
+    holes.Append(&hole);
+
+    plHiZBuffer hiZ;
+    hiZ.Build(w2ndc, eye, polys, holes);
+    EXPECT_EQ(0, hiZ.GetNumOccluders());
+    EXPECT_TRUE(hiZ.BoundsVisible(MakeBox(hsPoint3(100.f, -1.f, -1.f), hsPoint3(102.f, 1.f, 1.f))));
+}
+
+// True if any of a grid of points over the bounds' faces inside the frustum
+// can see the eye past all the walls.
+static bool AnySampleVisible(const hsBounds3Ext& bnd, const hsMatrix44& w2ndc, const hsPoint3& eye,
+                             const hsTArray<const plCullPoly*>& polys)
+{
+    const int kSteps = 8;
+    const hsPoint3& mins = bnd.GetMins();
+    const hsPoint3& maxs = bnd.GetMaxs();
+    for (int face = 0; face < 6; face++)
+    {
+        for (int u = 0; u <= kSteps; u++)
+        {
+            for (int v = 0; v <= kSteps; v++)
+            {
+                float t[3];
+                int axis = face >> 1;
+                t[axis] = float(face & 1);
+                t[(axis + 1) % 3] = float(u) / kSteps;
+                t[(axis + 2) % 3] = float(v) / kSteps;
+                hsPoint3 p(mins.fX + t[0] * (maxs.fX - mins.fX),
+                           mins.fY + t[1] * (maxs.fY - mins.fY),
+                           mins.fZ + t[2] * (maxs.fZ - mins.fZ));
+
+                float clip[4];
+                for (int r = 0; r < 4; r++)
+                    clip[r] = w2ndc.fMap[r][0] * p.fX + w2ndc.fMap[r][1] * p.fY + w2ndc.fMap[r][2] * p.fZ + w2ndc.fMap[r][3];
+                if (clip[3] <= 0 || fabs(clip[0]) > clip[3] || fabs(clip[1]) > clip[3] || clip[2] < 0 || clip[2] > clip[3])
+                    continue;
+
+                bool hidden = false;
+                for (int k = 0; k < polys.GetCount() && !hidden; k++)
+                {
+                    // The walls are all axis aligned quads.
+                    const plCullPoly& wall = *polys[k];
+                    float d0 = wall.fNorm.InnerProduct(eye) + wall.fDist;
+                    float d1 = wall.fNorm.InnerProduct(p) + wall.fDist;
+                    if (d0 <= 0 || d1 >= 0)
+                        continue;
+
+                    hsPoint3 hit = eye + (p - eye) * (d0 / (d0 - d1));
+                    hsBounds3Ext wallBnd;
+                    wallBnd.Reset(4, &wall.fVerts[0]);
+                    const float kEps = 1.e-3f;
+                    hidden = hit.fX >= wallBnd.GetMins().fX - kEps && hit.fX <= wallBnd.GetMaxs().fX + kEps
+                          && hit.fY >= wallBnd.GetMins().fY - kEps && hit.fY <= wallBnd.GetMaxs().fY + kEps
+                          && hit.fZ >= wallBnd.GetMins().fZ - kEps && hit.fZ <= wallBnd.GetMaxs().fZ + kEps;
+                }
+                if (!hidden)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Nothing the depth buffer culls may have a visible point, and it should
+// find about as much to cull as the cull tree does.
+TEST(plHiZBuffer, OnlyCullsHiddenLeaves)
+{
+    plTestCity city(12, 3000, 1);
+    uint32_t seed = 2;
+
+    plCullTree bsp;
+    plCullTree frustum;
+    plHiZBuffer hiZ;
+    hsTArray<const plCullPoly*> polys;
+    hsTArray<const plCullPoly*> holes;
+    hsTArray<int16_t> list;
+    size_t numBspCulled = 0;
+    size_t numHiZCulled = 0;
+    for (int i = 0; i < 50; i++)
+    {
+        hsPoint3 pos;
+        hsMatrix44 w2ndc = city.RandomView(seed, pos);
+        city.SortedWalls(pos, polys);
+
+        BuildCullTree(frustum, w2ndc, pos, holes, 0);
+        frustum.Harvest(city.fTree, list);
+        std::vector<int16_t> inFrustum = ToVector(list);
+
+        BuildCullTree(bsp, w2ndc, pos, polys, UINT32_MAX);
+        bsp.Harvest(city.fTree, list);
+        numBspCulled += inFrustum.size() - list.GetCount();
+
+        hiZ.Build(w2ndc, pos, polys, holes);
+        frustum.Harvest(city.fTree, list);
+        hiZ.Harvest(city.fTree, list);
+        std::vector<int16_t> hiZVis = ToVector(list);
+        numHiZCulled += inFrustum.size() - hiZVis.size();
+
+        for (int16_t leaf : inFrustum)
+        {
+            if (!std::binary_search(hiZVis.begin(), hiZVis.end(), leaf))
+                EXPECT_FALSE(AnySampleVisible(city.fLeaves[leaf], w2ndc, pos, polys)) << "leaf " << leaf << " view " << i;
+        }
+    }
+    EXPECT_GT(numHiZCulled, numBspCulled * 9 / 10);
+}
@@ -0,0 +1,336 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plFileSystem.h"
+#include "plCompression/plLZ4Compress.h"
+#include "pnFactory/plCreator.h"
+#include "pnKeyedObject/plKeyImp.h"
+#include "pnMessage/plRefMsg.h"
+#include "pnMessage/plSelfDestructMsg.h"
+#include "plResMgr/plPageCompressor.h"
+#include "plResMgr/plPageInfo.h"
+#include "plResMgr/plRegistryNode.h"
+
+// Just the creatables plKeyImp asks about, for the pages we load keys from
+REGISTER_NONCREATABLE( plMessage );
+REGISTER_CREATABLE( plRefMsg );
+REGISTER_CREATABLE( plGenRefMsg );
+REGISTER_CREATABLE( plSelfDestructMsg );
+
+static const plFileName kRawPage = "test_plPageCompressor_raw.prp";
+static const plFileName kPackedPage = "test_plPageCompressor_packed.prp";
+static const plFileName kUnpackedPage = "test_plPageCompressor_unpacked.prp";
+
+typedef std::vector<uint8_t> Payload;
+
+// Looks roughly like a vertex buffer: positions on a grid, unit normals and
+// packed colors, which is most of what big pages are made of.
+static Payload MakeGeometryLike(uint32_t numVerts, uint32_t seed)
+{
+    hsRAMStream s;
+    s.WriteLE32(numVerts);
+    for (uint32_t i = 0; i < numVerts; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        s.WriteLEFloat(float(i % 64) * 0.5f);
+        s.WriteLEFloat(float(i / 64) * 0.5f);
+        s.WriteLEFloat(float((seed >> 16) & 0xff) * 0.01f);
+        s.WriteLEFloat(0.f);
+        s.WriteLEFloat(0.f);
+        s.WriteLEFloat(1.f);
+        s.WriteLE32(0xff808080 | ((seed >> 8) & 0x1f));
+    }
+
+    Payload data(s.GetEOF());
+    s.Rewind();
+    s.Read(data.size(), data.data());
+    return data;
+}
+
+static Payload MakeRandom(uint32_t size, uint32_t seed)
+{
+    Payload data(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    return data;
+}
+
+// Writes a page the way plRegistryPageNode::Write does, with a read-ahead
+// range over the first half of the objects.  Old pages can have the key
+// list's (long unused) sorted flag set.
+static void WritePage(const plFileName& path, const std::vector<Payload>& objects, uint8_t keyListFlags = 0)
+{
+    hsUNIXStream s;
+    ASSERT_TRUE(s.Open(path, "wb"));
+
+    plPageInfo info(plLocation::MakeNormal(100));
+    info.SetStrings("TestAge", "TestPage");
+    info.Write(&s);
+    info.SetDataStart(s.GetPosition());
+
+    std::vector<uint32_t> starts;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        starts.push_back(s.GetPosition());
+        s.Write(objects[i].size(), objects[i].data());
+    }
+    uint32_t halfEnd = s.GetPosition();
+    if (objects.size() > 1)
+        halfEnd = starts[objects.size() / 2];
+
+    info.SetIndexStart(s.GetPosition());
+    s.WriteLE32(1);
+    s.WriteLE16(0x0004);
+    uint32_t beginPos = s.GetPosition();
+    s.WriteLE32(0);
+    s.WriteByte(keyListFlags);
+    s.WriteLE32(uint32_t(objects.size()));
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        plUoid uoid(info.GetLocation(), 0x0004, ST::format("Object{}", i));
+        uoid.SetObjectID(uint32_t(i + 1));
+        uoid.Write(&s);
+        s.WriteLE32(starts[i]);
+        s.WriteLE32(uint32_t(objects[i].size()));
+    }
+    uint32_t endPos = s.GetPosition();
+    s.SetPosition(beginPos);
+    s.WriteLE32(endPos - beginPos - sizeof(uint32_t));
+    s.SetPosition(endPos);
+
+    std::vector<plReadAheadRange> ranges(1);
+    ranges[0].fStart = info.GetDataStart();
+    ranges[0].fLength = halfEnd - info.GetDataStart();
+    plRegistryPageNode::WriteReadAhead(&s, ranges);
+
+    info.SetChecksum(s.GetPosition() - info.GetDataStart());
+    s.Rewind();
+    info.Write(&s);
+    s.Close();
+}
+
+struct PageObject
+{
+    uint32_t fStartPos, fDataLen, fUncompressedLen;
+};
+
+// Reads the page back the way the resManager would: header, key index, then
+// every object in file order, uncompressing where the key says to.
+static bool LoadPage(const plFileName& path, plPageInfo& info, std::vector<Payload>& objects,
+                     std::vector<plReadAheadRange>* ranges=nullptr)
+{
+    hsBufferedStream s;
+    if (!s.Open(path, "rb"))
+        return false;
+
+    info.Read(&s);
+    s.SetPosition(info.GetIndexStart());
+
+    std::vector<PageObject> entries;
+    uint32_t numTypes = s.ReadLE32();
+    for (uint32_t i = 0; i < numTypes; i++)
+    {
+        s.ReadLE16();
+        s.ReadLE32();
+        s.ReadByte();
+        bool compressed = info.IsCompressed();
+        uint32_t numKeys = s.ReadLE32();
+        for (uint32_t j = 0; j < numKeys; j++)
+        {
+            plUoid uoid;
+            uoid.Read(&s);
+            PageObject obj;
+            obj.fStartPos = s.ReadLE32();
+            obj.fDataLen = s.ReadLE32();
+            obj.fUncompressedLen = compressed ? s.ReadLE32() : 0;
+            entries.push_back(obj);
+        }
+    }
+    if (ranges)
+        plRegistryPageNode::ReadReadAhead(&s, *ranges);
+
+    plLZ4Compress codec;
+    Payload stored;
+    objects.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const PageObject& obj = entries[i];
+        stored.resize(obj.fDataLen);
+        s.SetPosition(obj.fStartPos);
+        if (s.Read(obj.fDataLen, stored.data()) != obj.fDataLen)
+            return false;
+
+        if (obj.fUncompressedLen == 0)
+        {
+            objects[i] = stored;
+            continue;
+        }
+
+        objects[i].resize(obj.fUncompressedLen);
+        uint32_t outLen = obj.fUncompressedLen;
+        if (!codec.Uncompress(objects[i].data(), &outLen, stored.data(), obj.fDataLen) || outLen != obj.fUncompressedLen)
+            return false;
+    }
+
+    s.Close();
+    return true;
+}
+
+static Payload ReadFile(const plFileName& path)
+{
+    hsUNIXStream s;
+    Payload data;
+    if (s.Open(path, "rb"))
+    {
+        data.resize(s.GetEOF());
+        s.Read(data.size(), data.data());
+        s.Close();
+    }
+    return data;
+}
+
+TEST(plPageCompressor, RoundTrip)
+{
+    std::vector<Payload> objects;
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        if (i % 5 == 4)
+            objects.push_back(MakeRandom(300 + i * 17, i));    // won't compress, stays raw
+        else
+            objects.push_back(MakeGeometryLike(50 + i * 40, i));
+    }
+    objects.push_back(Payload());
+    WritePage(kRawPage, objects);
+
+    plPageCompressor::Stats stats;
+    ASSERT_TRUE(plPageCompressor::Convert(kRawPage, kPackedPage, true, &stats));
+    EXPECT_EQ(objects.size(), stats.fNumObjects);
+    EXPECT_EQ(32, stats.fNumCompressed);
+    EXPECT_LT(stats.fStoredSize, stats.fRawSize);
+
+    plPageInfo info;
+    std::vector<Payload> loaded;
+    std::vector<plReadAheadRange> ranges;
+    ASSERT_TRUE(LoadPage(kPackedPage, info, loaded, &ranges));
+    EXPECT_TRUE(info.IsCompressed());
+    EXPECT_EQ(plFileInfo(kPackedPage).FileSize() - info.GetDataStart(), info.GetChecksum());
+    EXPECT_EQ(objects, loaded);
+
+    // The read-ahead range still starts at the first object and covers half of them
+    ASSERT_EQ(1, ranges.size());
+    EXPECT_EQ(info.GetDataStart(), ranges[0].fStart);
+
+    // Going back gives us the original page, byte for byte
+    ASSERT_TRUE(plPageCompressor::Convert(kPackedPage, kUnpackedPage, false, &stats));
+    EXPECT_EQ(0, stats.fNumCompressed);
+    EXPECT_EQ(ReadFile(kRawPage), ReadFile(kUnpackedPage));
+
+    plFileSystem::Unlink(kRawPage);
+    plFileSystem::Unlink(kPackedPage);
+    plFileSystem::Unlink(kUnpackedPage);
+}
+
+TEST(plPageCompressor, UnflaggedPagesStayVersion6)
+{
+    plPageInfo info(plLocation::MakeNormal(100));
+    info.SetStrings("TestAge", "TestPage");
+
+    hsRAMStream plain;
+    info.Write(&plain);
+    plain.Rewind();
+    EXPECT_EQ(6, plain.ReadLE32());
+
+    info.SetFlags(plPageInfo::kCompressedObjects);
+    hsRAMStream flagged;
+    info.Write(&flagged);
+    EXPECT_EQ(plain.GetEOF() + sizeof(uint32_t), flagged.GetEOF());
+
+    flagged.Rewind();
+    plPageInfo readBack;
+    readBack.Read(&flagged);
+    EXPECT_TRUE(readBack.IsCompressed());
+    EXPECT_EQ(info.GetLocation(), readBack.GetLocation());
+}
+
+TEST(plPageCompressor, KeyIndexFollowsPageInfo)
+{
+    std::vector<Payload> objects;
+    for (uint32_t i = 0; i < 10; i++)
+        objects.push_back(MakeGeometryLike(50 + i * 40, i));
+
+    // A version 6 page with the old sorted flag set has no uncompressed lengths
+    WritePage(kRawPage, objects, 0x1);
+    ASSERT_TRUE(plPageCompressor::Convert(kRawPage, kPackedPage, true));
+
+    for (const plFileName& path : { kRawPage, kPackedPage })
+    {
+        plRegistryPageNode page(path);
+        ASSERT_TRUE(page.IsValid());
+        page.LoadKeys();
+
+        uint32_t lastEnd = page.GetPageInfo().GetDataStart();
+        for (uint32_t i = 0; i < objects.size(); i++)
+        {
+            plUoid uoid(page.GetPageInfo().GetLocation(), 0x0004, ST::format("Object{}", i));
+            uoid.SetObjectID(i + 1);
+            plKeyImp* key = page.FindKey(uoid);
+            ASSERT_NE(nullptr, key) << path.AsString().c_str();
+            EXPECT_EQ(lastEnd, key->GetStartPos()) << path.AsString().c_str();
+            lastEnd = key->GetStartPos() + key->GetDataLen();
+        }
+        EXPECT_EQ(page.GetPageInfo().GetIndexStart(), lastEnd);
+
+        // ...and the read-ahead table after the index is where it should be
+        EXPECT_EQ(1, page.GetReadAhead().size()) << path.AsString().c_str();
+    }
+
+    plFileSystem::Unlink(kRawPage);
+    plFileSystem::Unlink(kPackedPage);
+}
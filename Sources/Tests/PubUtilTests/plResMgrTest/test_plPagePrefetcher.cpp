@@ -0,0 +1,285 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plFileSystem.h"
+#include "plResMgr/plPageInfo.h"
+#include "plResMgr/plPagePrefetcher.h"
+#include "plResMgr/plRegistryNode.h"
+
+typedef std::vector<uint8_t> Payload;
+typedef std::unique_ptr<plRegistryPageNode> PagePtr;
+
+static plFileName PagePath(uint32_t i)
+{
+    return ST::format("test_plPagePrefetcher_{}.prp", i);
+}
+
+// A page with numObjects objects of objectSize bytes, each filled from its
+// page and object number, and a key index over them
+static void WritePage(const plFileName& path, uint32_t seq, uint32_t numObjects, uint32_t objectSize)
+{
+    hsUNIXStream s;
+    ASSERT_TRUE(s.Open(path, "wb"));
+
+    plPageInfo info(plLocation::MakeNormal(100 + seq));
+    info.SetStrings("TestAge", ST::format("Room{}", seq));
+    info.Write(&s);
+    info.SetDataStart(s.GetPosition());
+
+    std::vector<uint32_t> starts;
+    Payload object(objectSize);
+    for (uint32_t i = 0; i < numObjects; i++)
+    {
+        for (uint32_t j = 0; j < objectSize; j++)
+            object[j] = uint8_t(seq * 31 + i * 7 + j);
+        starts.push_back(s.GetPosition());
+        s.Write(object.size(), object.data());
+    }
+
+    info.SetIndexStart(s.GetPosition());
+    s.WriteLE32(1);
+    s.WriteLE16(0x0004);
+    uint32_t beginPos = s.GetPosition();
+    s.WriteLE32(0);
+    s.WriteByte(0);
+    s.WriteLE32(numObjects);
+    for (uint32_t i = 0; i < numObjects; i++)
+    {
+        plUoid uoid(info.GetLocation(), 0x0004, ST::format("Object{}", i));
+        uoid.SetObjectID(i + 1);
+        uoid.Write(&s);
+        s.WriteLE32(starts[i]);
+        s.WriteLE32(objectSize);
+    }
+    uint32_t endPos = s.GetPosition();
+    s.SetPosition(beginPos);
+    s.WriteLE32(endPos - beginPos - sizeof(uint32_t));
+    s.SetPosition(endPos);
+
+    info.SetChecksum(s.GetPosition() - info.GetDataStart());
+    s.Rewind();
+    info.Write(&s);
+    s.Close();
+}
+
+// Reads every object's bytes the way a page-in would, through the page's
+// own stream, and folds them into a hash
+static uint32_t ReadObjects(plRegistryPageNode* page, uint32_t objectSize)
+{
+    hsStream* s = page->OpenStream();
+    if (!s)
+        return 0;
+
+    uint32_t hash = 2166136261u;
+    Payload object(objectSize);
+    s->SetPosition(page->GetPageInfo().GetDataStart());
+    while (s->GetPosition() + objectSize <= page->GetPageInfo().GetIndexStart())
+    {
+        s->Read(objectSize, object.data());
+        for (uint8_t b : object)
+            hash = (hash ^ b) * 16777619u;
+    }
+    page->CloseStream();
+    return hash;
+}
+
+TEST(plPagePrefetcher, ReadsFromMemory)
+{
+    const uint32_t kNumPages = 4;
+    std::vector<PagePtr> pages;
+    std::vector<uint32_t> fromFile;
+    for (uint32_t i = 0; i < kNumPages; i++)
+    {
+        WritePage(PagePath(i), i, 50, 1000 + i * 100);
+        pages.emplace_back(new plRegistryPageNode(PagePath(i)));
+        fromFile.push_back(ReadObjects(pages[i].get(), 1000 + i * 100));
+    }
+
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+    for (uint32_t i = 0; i < kNumPages; i++)
+        EXPECT_TRUE(prefetcher.Prefetch(pages[i].get()));
+    EXPECT_FALSE(prefetcher.Prefetch(pages[0].get()));
+    prefetcher.Flush();
+
+    uint32_t numPrefetched = prefetcher.GetNumPrefetched();
+    for (uint32_t i = 0; i < kNumPages; i++)
+    {
+        ASSERT_TRUE(prefetcher.Claim(pages[i].get()));
+        EXPECT_EQ(plFileInfo(PagePath(i)).FileSize(), pages[i]->GetPageDataSize());
+        EXPECT_EQ(fromFile[i], ReadObjects(pages[i].get(), 1000 + i * 100));
+
+        prefetcher.Release(pages[i].get());
+        EXPECT_FALSE(pages[i]->HasPageData());
+
+        // And back to the file
+        EXPECT_EQ(fromFile[i], ReadObjects(pages[i].get(), 1000 + i * 100));
+    }
+    EXPECT_EQ(numPrefetched + kNumPages, prefetcher.GetNumPrefetched());
+    EXPECT_EQ(0, prefetcher.GetNumPending());
+    EXPECT_EQ(0, prefetcher.GetBytesResident());
+
+    for (uint32_t i = 0; i < kNumPages; i++)
+        plFileSystem::Unlink(PagePath(i));
+}
+
+TEST(plPagePrefetcher, SharedPagesStay)
+{
+    WritePage(PagePath(0), 0, 20, 500);
+    WritePage(PagePath(1), 1, 20, 500);
+    PagePtr shared(new plRegistryPageNode(PagePath(0)));
+    PagePtr room(new plRegistryPageNode(PagePath(1)));
+
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+    ASSERT_TRUE(prefetcher.Prefetch(room.get()));
+    ASSERT_TRUE(prefetcher.Prefetch(shared.get(), true));
+    prefetcher.Flush();
+
+    // Claiming the room hands over the shared page too
+    EXPECT_TRUE(prefetcher.Claim(room.get()));
+    EXPECT_TRUE(shared->HasPageData());
+
+    prefetcher.Release(room.get());
+    prefetcher.Release(shared.get());
+    EXPECT_FALSE(room->HasPageData());
+    EXPECT_TRUE(shared->HasPageData());
+
+    prefetcher.ReleaseShared();
+    EXPECT_FALSE(shared->HasPageData());
+    EXPECT_EQ(0, prefetcher.GetBytesResident());
+
+    plFileSystem::Unlink(PagePath(0));
+    plFileSystem::Unlink(PagePath(1));
+}
+
+TEST(plPagePrefetcher, CancelAndDisable)
+{
+    WritePage(PagePath(0), 0, 20, 500);
+    PagePtr page(new plRegistryPageNode(PagePath(0)));
+
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+    ASSERT_TRUE(prefetcher.Prefetch(page.get()));
+    prefetcher.Cancel(page.get());
+    EXPECT_EQ(0, prefetcher.GetNumPending());
+    EXPECT_FALSE(prefetcher.Claim(page.get()));
+
+    prefetcher.SetEnabled(false);
+    EXPECT_FALSE(prefetcher.Prefetch(page.get()));
+    prefetcher.SetEnabled(true);
+    EXPECT_TRUE(prefetcher.Prefetch(page.get()));
+    prefetcher.Flush();
+    EXPECT_TRUE(prefetcher.Claim(page.get()));
+    prefetcher.SetEnabled(false);
+    prefetcher.Release(page.get());
+    EXPECT_FALSE(page->HasPageData());
+    prefetcher.SetEnabled(true);
+
+    plFileSystem::Unlink(PagePath(0));
+}
+
+TEST(plPagePrefetcher, ReleaseWhileOpen)
+{
+    WritePage(PagePath(0), 0, 20, 500);
+    PagePtr page(new plRegistryPageNode(PagePath(0)));
+    uint32_t fromFile = ReadObjects(page.get(), 500);
+
+    hsUNIXStream s;
+    ASSERT_TRUE(s.Open(PagePath(0), "rb"));
+    Payload data(s.GetEOF());
+    s.Read(data.size(), data.data());
+    s.Close();
+
+    ASSERT_TRUE(page->AdoptPageData(data));
+    EXPECT_TRUE(data.empty());
+
+    // An open page won't take data, and keeps what it has until it closes
+    hsStream* stream = page->OpenStream();
+    ASSERT_NE(nullptr, stream);
+    // Still names the page, for mipmaps that stream their top levels from it
+    EXPECT_EQ(PagePath(0), stream->GetFileName());
+    Payload more(16);
+    EXPECT_FALSE(page->AdoptPageData(more));
+    page->ReleasePageData();
+    EXPECT_TRUE(page->HasPageData());
+    EXPECT_EQ(fromFile, ReadObjects(page.get(), 500));
+    page->CloseStream();
+    EXPECT_FALSE(page->HasPageData());
+
+    plFileSystem::Unlink(PagePath(0));
+}
+
+// Rooms claimed one after another, with the next few reading in while each
+// one is "constructed", the way the age loader walks an age.
+TEST(plPagePrefetcher, RoomsInFlight)
+{
+    const uint32_t kNumPages = 8;
+    std::vector<PagePtr> pages;
+    std::vector<uint32_t> fromFile;
+    for (uint32_t i = 0; i < kNumPages; i++)
+    {
+        WritePage(PagePath(i), i, 40, 700 + i * 50);
+        pages.emplace_back(new plRegistryPageNode(PagePath(i)));
+        fromFile.push_back(ReadObjects(pages[i].get(), 700 + i * 50));
+    }
+
+    plPagePrefetcher& prefetcher = plPagePrefetcher::Instance();
+    for (uint32_t i = 0; i < kNumPages; i++)
+    {
+        for (uint32_t j = i; j < kNumPages && j <= i + plPagePrefetcher::kMaxRoomsInFlight; j++)
+            prefetcher.Prefetch(pages[j].get());
+        // A room still waiting its turn is dropped and read from the file,
+        // so either way the objects come out the same
+        prefetcher.Claim(pages[i].get());
+        EXPECT_EQ(fromFile[i], ReadObjects(pages[i].get(), 700 + i * 50));
+        prefetcher.Release(pages[i].get());
+    }
+    EXPECT_EQ(0, prefetcher.GetNumPending());
+    EXPECT_EQ(0, prefetcher.GetBytesResident());
+
+    pages.clear();
+    for (uint32_t i = 0; i < kNumPages; i++)
+        plFileSystem::Unlink(PagePath(i));
+}
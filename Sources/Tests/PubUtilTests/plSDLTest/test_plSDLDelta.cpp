@@ -0,0 +1,358 @@
+/*==LICENSE==*
+
+CyanWorlds.com Engine - MMOG client, server and tools
+Copyright (C) 2011  Cyan Worlds, Inc.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Additional permissions under GNU GPL version 3 section 7
+
+If you modify this Program, or any covered work, by linking or
+combining it with any of RAD Game Tools Bink SDK, Autodesk 3ds Max SDK,
+NVIDIA PhysX SDK, Microsoft DirectX SDK, OpenSSL library, Independent
+JPEG Group JPEG library, Microsoft Windows Media SDK, or Apple QuickTime SDK
+(or a modified version of those libraries),
+containing parts covered by the terms of the Bink SDK EULA, 3ds Max EULA,
+PhysX SDK EULA, DirectX SDK EULA, OpenSSL and SSLeay licenses, IJG
+JPEG Library README, Windows Media SDK EULA, or QuickTime SDK EULA, the
+licensors of this Program grant you additional
+permission to convey the resulting work. Corresponding Source for a
+non-source form of such a combination shall include the source code for
+the parts of OpenSSL and IJG JPEG Library used as well as that of the covered
+work.
+
+You can contact Cyan Worlds, Inc. by email legal@cyan.com
+ or by snail mail at:
+      Cyan Worlds, Inc.
+      14617 N Newport Hwy
+      Mead, WA   99021
+
+*==LICENSE==*/
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <gtest/gtest.h>
+
+#include "HeadSpin.h"
+#include "hsStream.h"
+#include "plSDL/plSDL.h"
+
+static plSimpleVarDescriptor* MakeVar(const char* name, const char* type, int count=1)
+{
+    plSimpleVarDescriptor* var = new plSimpleVarDescriptor;
+    var->SetName(name);
+    var->SetType(type);
+    var->SetCount(count);
+    var->SetVariableLength(count == 0);
+    return var;
+}
+
+// Something like the physical and AnimTimeConvert descriptors in SDL/, so the
+// benchmark sees the kind of vars that get streamed every frame.
+static plStateDescriptor* MakeMovingDesc()
+{
+    plStateDescriptor* sd = new plStateDescriptor;
+    sd->SetName("deltaTestMoving");
+    sd->SetVersion(1);
+    sd->AddVar(MakeVar("position", "point3"));
+    sd->AddVar(MakeVar("orientation", "quaternion"));
+    sd->AddVar(MakeVar("linear", "vector3"));
+    sd->AddVar(MakeVar("angular", "vector3"));
+    sd->AddVar(MakeVar("flags", "int"));
+    sd->AddVar(MakeVar("speed", "float"));
+    sd->AddVar(MakeVar("ease", "byte"));
+    sd->AddVar(MakeVar("enabled", "bool"));
+    sd->AddVar(MakeVar("label", "string32"));
+    sd->AddVar(MakeVar("blends", "byte", 0));
+    return sd;
+}
+
+static plStateDescriptor* MakeNestedDesc(plStateDescriptor* child)
+{
+    plStateDescriptor* sd = new plStateDescriptor;
+    sd->SetName("deltaTestNested");
+    sd->SetVersion(1);
+    sd->AddVar(MakeVar("state", "short"));
+
+    plSDVarDescriptor* sdVar = new plSDVarDescriptor(child);
+    sdVar->SetName("children");
+    sdVar->SetCount(0);
+    sdVar->SetVariableLength(true);
+    sd->AddVar(sdVar);
+    return sd;
+}
+
+// One side of a connection.  The sender and receiver keep separate baselines,
+// the way two machines would.
+struct DeltaLink
+{
+    plStateDataRecord fSendBase;
+    plStateDataRecord fRecvBase;
+
+    DeltaLink(plStateDescriptor* sd) : fSendBase(sd), fRecvBase(sd) { }
+
+    uint32_t Send(const plStateDataRecord& state, plStateDataRecord* out)
+    {
+        hsRAMStream s;
+        EXPECT_TRUE(state.WriteDelta(&s, &fSendBase, 0.f));
+        uint32_t len = s.GetEOF();
+        s.Rewind();
+        EXPECT_TRUE(out->ReadDelta(&s, &fRecvBase, 0.f));
+        EXPECT_EQ(len, s.GetPosition());
+        return len;
+    }
+};
+
+static void ExpectFloatsNear(const plSimpleStateVariable* a, const plSimpleStateVariable* b, int n)
+{
+    float va[4], vb[4];
+    ASSERT_TRUE(a->Get(va));
+    ASSERT_TRUE(b->Get(vb));
+    for (int i = 0; i < n; i++)
+        EXPECT_NEAR(va[i], vb[i], plSDL::kDeltaFloatQuantum);
+}
+
+TEST(plSDLDelta, RoundTripSimpleVars)
+{
+    std::unique_ptr<plStateDescriptor> sd(MakeMovingDesc());
+    plStateDataRecord state(sd.get()), received(sd.get());
+    DeltaLink link(sd.get());
+
+    float pos[3] = { 12.5f, -3.25f, 100.f };
+    float quat[4] = { 0.f, 0.f, 0.7071f, 0.7071f };
+    state.FindVar("position")->Set(pos);
+    state.FindVar("orientation")->Set(quat);
+    state.FindVar("flags")->Set(0x1234);
+    state.FindVar("speed")->Set(1.75f);
+    state.FindVar("ease")->Set((uint8_t)2);
+    state.FindVar("enabled")->Set(true);
+    state.FindVar("label")->Set("hello");
+    state.FindVar("blends")->Alloc(3);
+    state.FindVar("blends")->Set((uint8_t)7, 2);
+
+    link.Send(state, &received);
+
+    ExpectFloatsNear(state.FindVar("position"), received.FindVar("position"), 3);
+    ExpectFloatsNear(state.FindVar("orientation"), received.FindVar("orientation"), 4);
+
+    int flags;
+    float speed;
+    uint8_t ease, blend;
+    bool enabled;
+    char label[32];
+    EXPECT_TRUE(received.FindVar("flags")->Get(&flags));
+    EXPECT_EQ(0x1234, flags);
+    EXPECT_TRUE(received.FindVar("speed")->Get(&speed));
+    EXPECT_EQ(1.75f, speed);
+    EXPECT_TRUE(received.FindVar("ease")->Get(&ease));
+    EXPECT_EQ(2, ease);
+    EXPECT_TRUE(received.FindVar("enabled")->Get(&enabled));
+    EXPECT_TRUE(enabled);
+    EXPECT_TRUE(received.FindVar("label")->Get(label));
+    EXPECT_STREQ("hello", label);
+    EXPECT_EQ(3, received.FindVar("blends")->GetCount());
+    EXPECT_TRUE(received.FindVar("blends")->Get(&blend, 2));
+    EXPECT_EQ(7, blend);
+
+    // Nothing changed since, so there is nothing to send but the header and empty masks
+    EXPECT_FALSE(state.HasDeltaFrom(&link.fSendBase));
+    plStateDataRecord empty(sd.get());
+    EXPECT_EQ(5u, link.Send(state, &empty));
+    EXPECT_FALSE(empty.IsUsed());
+
+    // One changed var comes through alone
+    state.FindVar("flags")->Set(-5);
+    EXPECT_TRUE(state.HasDeltaFrom(&link.fSendBase));
+    plStateDataRecord single(sd.get());
+    link.Send(state, &single);
+    EXPECT_EQ(1, single.GetNumUsedVars());
+    EXPECT_TRUE(single.FindVar("flags")->Get(&flags));
+    EXPECT_EQ(-5, flags);
+
+    // Bools carry no payload, the reader flips them
+    state.FindVar("enabled")->Set(false);
+    link.Send(state, &received);
+    EXPECT_TRUE(received.FindVar("enabled")->Get(&enabled));
+    EXPECT_FALSE(enabled);
+}
+
+TEST(plSDLDelta, QuantizedFloatsDoNotDrift)
+{
+    std::unique_ptr<plStateDescriptor> sd(MakeMovingDesc());
+    plStateDataRecord state(sd.get()), received(sd.get());
+    DeltaLink link(sd.get());
+
+    // Many moves smaller than the quantum must add up on the far end,
+    // since the baseline tracks what was actually sent.
+    float pos[3] = { 0.f, 0.f, 0.f };
+    for (int frame = 0; frame < 2000; frame++)
+    {
+        pos[0] += plSDL::kDeltaFloatQuantum * 0.3f;
+        pos[1] -= 0.01f;
+        pos[2] = 50.f * sinf(frame * 0.01f);
+        state.FindVar("position")->Set(pos);
+        link.Send(state, &received);
+        ExpectFloatsNear(state.FindVar("position"), link.fRecvBase.FindVar("position"), 3);
+    }
+
+    // Large jumps and non-finite values go through as raw floats
+    float far[3] = { 1.0e9f, -1.0e-9f, INFINITY };
+    state.FindVar("position")->Set(far);
+    link.Send(state, &received);
+    float got[3];
+    EXPECT_TRUE(received.FindVar("position")->Get(got));
+    EXPECT_EQ(far[0], got[0]);
+    EXPECT_NEAR(far[1], got[1], plSDL::kDeltaFloatQuantum);
+    EXPECT_TRUE(std::isinf(got[2]));
+}
+
+TEST(plSDLDelta, VariableLengthVars)
+{
+    std::unique_ptr<plStateDescriptor> sd(MakeMovingDesc());
+    plStateDataRecord state(sd.get()), received(sd.get());
+    DeltaLink link(sd.get());
+
+    plSimpleStateVariable* blends = state.FindVar("blends");
+    blends->Alloc(40);
+    for (int i = 0; i < 40; i++)
+        blends->Set((uint8_t)i, i);
+    link.Send(state, &received);
+
+    // Sparse changes within the same count
+    blends->Set((uint8_t)200, 3);
+    blends->Set((uint8_t)201, 33);
+    link.Send(state, &received);
+
+    // Then a shrink
+    blends->Alloc(5);
+    for (int i = 0; i < 5; i++)
+        blends->Set((uint8_t)(i * 3), i);
+    link.Send(state, &received);
+
+    plSimpleStateVariable* got = received.FindVar("blends");
+    ASSERT_EQ(5, got->GetCount());
+    for (int i = 0; i < 5; i++)
+    {
+        uint8_t v;
+        EXPECT_TRUE(got->Get(&v, i));
+        EXPECT_EQ(i * 3, v);
+    }
+}
+
+TEST(plSDLDelta, NestedRecords)
+{
+    std::unique_ptr<plStateDescriptor> child(MakeMovingDesc());
+    std::unique_ptr<plStateDescriptor> sd(MakeNestedDesc(child.get()));
+    plStateDataRecord state(sd.get()), received(sd.get());
+    DeltaLink link(sd.get());
+
+    plSDStateVariable* children = state.FindSDVar("children");
+    children->Alloc(3);
+    for (int i = 0; i < 3; i++)
+        children->GetStateDataRecord(i)->FindVar("flags")->Set(i + 10);
+    link.Send(state, &received);
+
+    // Change one var in one child
+    children->GetStateDataRecord(1)->FindVar("speed")->Set(4.5f);
+    link.Send(state, &received);
+
+    plSDStateVariable* got = received.FindSDVar("children");
+    ASSERT_EQ(3, got->GetCount());
+    for (int i = 0; i < 3; i++)
+    {
+        int flags;
+        EXPECT_TRUE(got->GetStateDataRecord(i)->FindVar("flags")->Get(&flags));
+        EXPECT_EQ(i + 10, flags);
+    }
+    float speed;
+    EXPECT_TRUE(got->GetStateDataRecord(1)->FindVar("speed")->Get(&speed));
+    EXPECT_EQ(4.5f, speed);
+
+    // Growing the list resends it whole
+    children->Resize(4);
+    children->GetStateDataRecord(3)->FindVar("flags")->Set(99);
+    link.Send(state, &received);
+    ASSERT_EQ(4, got->GetCount());
+    int flags;
+    EXPECT_TRUE(got->GetStateDataRecord(3)->FindVar("flags")->Get(&flags));
+    EXPECT_EQ(99, flags);
+}
+
+TEST(plSDLDelta, PlainReadRejectsDelta)
+{
+    std::unique_ptr<plStateDescriptor> sd(MakeMovingDesc());
+    plStateDataRecord state(sd.get()), base(sd.get()), received(sd.get());
+    state.FindVar("flags")->Set(1);
+
+    hsRAMStream s;
+    ASSERT_TRUE(state.WriteDelta(&s, &base, 0.f));
+    s.Rewind();
+    EXPECT_FALSE(received.Read(&s, 0.f));
+
+    // and the other way around
+    hsRAMStream full;
+    state.Write(&full, 0.f);
+    full.Rewind();
+    plStateDataRecord recvBase(sd.get());
+    EXPECT_FALSE(received.ReadDelta(&full, &recvBase, 0.f));
+}
+
+// Compares dirty-only records with deltas for an object drifting around
+// a little every frame, the common case for physicals and animations.
+TEST(plSDLDelta, SmallerThanDirtyOnly)
+{
+    const int kFrames = 600;
+
+    std::unique_ptr<plStateDescriptor> sd(MakeMovingDesc());
+    plStateDataRecord state(sd.get()), received(sd.get());
+    DeltaLink link(sd.get());
+    state.SetFromDefaults(false);
+    state.FindVar("label")->Set("door01");
+    state.FindVar("blends")->Alloc(8);
+
+    uint64_t fullBytes = 0, deltaBytes = 0;
+    hsRAMStream s;
+    for (int frame = 0; frame < kFrames; frame++)
+    {
+        float t = frame / 60.f;
+        float pos[3] = { 10.f + t * 0.5f, 2.f * sinf(t), 1.f };
+        float quat[4] = { 0.f, 0.f, sinf(t * 0.1f), cosf(t * 0.1f) };
+        float lin[3] = { 0.5f, 2.f * cosf(t), 0.f };
+        state.FindVar("position")->Set(pos);
+        state.FindVar("orientation")->Set(quat);
+        state.FindVar("linear")->Set(lin);
+        if ((frame % 30) == 0)
+            state.FindVar("flags")->Set(frame / 30);
+        if ((frame % 90) == 0)
+            state.FindVar("blends")->Set((uint8_t)frame, (frame / 90) % 8);
+
+        s.Truncate();
+        state.Write(&s, 0.f, plSDL::kDirtyOnly);
+        s.Rewind();
+        received.Read(&s, 0.f);
+        fullBytes += s.GetEOF();
+
+        s.Truncate();
+        state.WriteDelta(&s, &link.fSendBase, 0.f, plSDL::kDirtyOnly);
+        s.Rewind();
+        received.ReadDelta(&s, &link.fRecvBase, 0.f);
+        deltaBytes += s.GetEOF();
+
+        for (int i = 0; i < state.GetNumVars(); i++)
+            state.GetVar(i)->SetDirty(false);
+    }
+
+    EXPECT_LT(deltaBytes, fullBytes);
+}
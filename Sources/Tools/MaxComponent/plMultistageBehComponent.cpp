@@ -493,7 +493,7 @@ public:
     virtual void Skip(uint32_t deltaByteCount) { hsAssert(0, "Not supported"); }
     virtual void Rewind() { hsAssert(0, "Not supported"); }
 
-    virtual uint32_t  GetEOF() { return (uint32_t)fLoad->CurChunkLength(); }
+    virtual uint64_t  GetEOF() { return (uint64_t)fLoad->CurChunkLength(); }
 
     virtual uint32_t Read(uint32_t byteCount, void * buffer)
     {
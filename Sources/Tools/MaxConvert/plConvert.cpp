@@ -79,6 +79,7 @@ You can contact Cyan Worlds, Inc. by email legal@cyan.com
 #include "MaxMain/plMaxNode.h"
 #include "plMessage/plNodeCleanupMsg.h"
 #include "pnSceneObject/plSceneObject.h"
+#include "pnSceneObject/plTransformHierarchy.h"
 #include "MaxComponent/plClusterComponent.h"
 
 #include "plPhysX/plSimulationMgr.h"
@@ -340,7 +341,9 @@ bool plConvert::Convert(hsTArray<plMaxNode*>& nodes)
     hsVertexShader::Instance().Close();
 
     plgDispatch::MsgSend(new plTransformMsg(nil, nil, nil, nil));
+    plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseNormal);
     plgDispatch::MsgSend(new plDelayedTransformMsg(nil, nil, nil, nil));
+    plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseDelayed);
     DeInit();
 
     return IOK();   
@@ -391,6 +394,8 @@ void plConvert::DeInit()
     // clear out the message queue
     for (int i = 0; i < fMsgQueue.Count(); i++)
         plgDispatch::MsgSend(fMsgQueue[i]);
+    plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseNormal);
+    plTransformHierarchy::Instance()->Flush(plTransformHierarchy::kPhaseDelayed);
 
     fMsgQueue.Reset();
 